@@ -71,6 +71,7 @@
 #include <lists/string_list.h>
 #include <ks_math.h>
 #include <ks_timers.h>
+#include <encodings/crc32.h>
 #include <encodings/utf.h>
 #include <time/rtime.h>
 
@@ -248,6 +249,8 @@
 #include "tasks/task_powerstate.h"
 #include "tasks/tasks_internal.h"
 #include "performance_counters.h"
+#include "performance_histogram.h"
+#include "performance_trace.h"
 
 #include "version.h"
 #include "version_git.h"
@@ -4090,6 +4093,27 @@ static bool generic_menu_init_list(void *data)
    return true;
 }
 
+/* Thumbnail textures are cached below the cache
+ * directory, or next to the thumbnails themselves
+ * if there is none */
+static void menu_driver_open_thumbnail_cache(settings_t *settings)
+{
+   char cache_dir[PATH_MAX_LENGTH];
+   size_t size_limit = (size_t)settings->uints.gfx_thumbnail_cache_size
+      << 20;
+
+   cache_dir[0]      = '\0';
+
+   if (!string_is_empty(settings->paths.directory_cache))
+      fill_pathname_join(cache_dir, settings->paths.directory_cache,
+            "thumbnails", sizeof(cache_dir));
+   else if (!string_is_empty(settings->paths.directory_thumbnails))
+      fill_pathname_join(cache_dir, settings->paths.directory_thumbnails,
+            ".cache", sizeof(cache_dir));
+
+   gfx_thumbnail_open_cache(cache_dir, size_limit);
+}
+
 static bool menu_driver_init_internal(
       struct kingsn_state *p_kingsn,
       settings_t *settings,
@@ -4113,6 +4137,8 @@ static bool menu_driver_init_internal(
    if (!p_kingsn->menu_driver_data || !menu_init(p_kingsn))
       return false;
 
+   menu_driver_open_thumbnail_cache(settings);
+
    /* TODO/FIXME - can we get rid of this? Is this needed? */
    configuration_set_string(settings,
          settings->arrays.menu_driver, p_kingsn->menu_driver_ctx->ident);
@@ -4662,6 +4688,7 @@ bool menu_driver_ctl(enum kingsn_menu_ctl_state state, void *data)
             return true;
 
          playlist_free_cached();
+         gfx_thumbnail_close_cache();
 #if defined(HAVE_CG) || defined(HAVE_GLSL) || defined(HAVE_SLANG) || defined(HAVE_HLSL)
          menu_shader_manager_free(p_kingsn);
 #endif
@@ -7904,6 +7931,31 @@ static void kingsn_perf_log(struct kingsn_state *p_kingsn)
    log_counters(p_kingsn->perf_counters_kingsn, p_kingsn->perf_ptr_kingsn);
 }
 
+static const char *frame_stats_names[FRAME_STATS_LAST] = {
+   "frame_time", "core_run", "video_frame", "audio_fill"
+};
+
+static const char *frame_stats_units[FRAME_STATS_LAST] = {
+   "usec", "usec", "usec", "%"
+};
+
+static void kingsn_frame_stats_log(struct kingsn_state *p_kingsn)
+{
+   unsigned i;
+   char line[256];
+
+   if (!p_kingsn->frame_stats[FRAME_STATS_FRAME_TIME].count)
+      return;
+
+   KINGSN_LOG("[PERF]: Frame statistics:\n");
+   for (i = 0; i < FRAME_STATS_LAST; i++)
+   {
+      performance_histogram_format(&p_kingsn->frame_stats[i],
+            frame_stats_names[i], frame_stats_units[i], line, sizeof(line));
+      KINGSN_LOG("[PERF]: %s\n", line);
+   }
+}
+
 static void ks_perf_log(void)
 {
    struct kingsn_state *p_kingsn = &kingsn_st;
@@ -9959,6 +10011,40 @@ static bool command_get_status(const char* arg)
    return true;
 }
 
+static bool command_get_frame_stats(const char* arg)
+{
+   unsigned i;
+   char reply[2048];
+   size_t pos                  = 0;
+   struct kingsn_state *p_kingsn = &kingsn_st;
+
+   reply[0]                    = '\0';
+
+   for (i = 0; i < FRAME_STATS_LAST; i++)
+   {
+      if (!string_is_empty(arg) && !string_is_equal(arg, frame_stats_names[i]))
+         continue;
+
+      /* strlcpy returns the source length, so stop once
+       * the reply is full instead of running pos past it */
+      pos += strlcpy(reply + pos, "GET_FRAME_STATS ", sizeof(reply) - pos);
+      if (pos >= sizeof(reply))
+         break;
+      pos += performance_histogram_format(&p_kingsn->frame_stats[i],
+            frame_stats_names[i], frame_stats_units[i],
+            reply + pos, sizeof(reply) - pos);
+      pos += strlcpy(reply + pos, "\n", sizeof(reply) - pos);
+      if (pos >= sizeof(reply))
+         break;
+   }
+
+   if (!pos)
+      snprintf(reply, sizeof(reply), "GET_FRAME_STATS %s unsupported\n", arg);
+
+   command_reply(p_kingsn, reply, strlen(reply));
+   return true;
+}
+
 static bool command_show_osd_msg(const char* arg)
 {
     runloop_msg_queue_push(arg, 1, 180, false, NULL,
@@ -10099,7 +10185,7 @@ static bool command_get_arg(const char *tok,
             return false;
 
          if (arg)
-            *arg = argument + 1;
+            *arg = *argument ? argument + 1 : argument;
 
          if (index)
             *index = i;
@@ -13588,6 +13674,7 @@ bool command_event(enum event_command cmd, void *data)
             playlist_config.old_format             = settings->bools.playlist_use_old_format;
             playlist_config.compress               = settings->bools.playlist_compression;
             playlist_config.fuzzy_archive_match    = settings->bools.playlist_fuzzy_archive_match;
+            playlist_config.binary_cache           = settings->bools.playlist_binary_cache;
             /* don't use relative paths for content, music, video, and image histories */
             playlist_config_set_base_content_directory(&playlist_config, NULL);
 
@@ -13642,22 +13729,42 @@ bool command_event(enum event_command cmd, void *data)
       case CMD_EVENT_CORE_INFO_INIT:
          {
             char ext_name[255];
+            char cache_path[PATH_MAX_LENGTH];
             const char *dir_libks       = settings->paths.directory_libks;
             const char *path_libks_info = settings->paths.path_libks_info;
+            const char *dir_cache       = settings->paths.directory_cache;
             bool show_hidden_files         = settings->bools.show_hidden_files;
+            bool core_info_cache_enable    = settings->bools.core_info_cache_enable;
 
             ext_name[0]                    = '\0';
+            cache_path[0]                  = '\0';
 
             command_event(CMD_EVENT_CORE_INFO_DEINIT, NULL);
 
             if (!frontend_driver_get_core_extension(ext_name, sizeof(ext_name)))
                return false;
 
+            /* The core info cache lives in the cache directory,
+             * or next to the .info files if there is none */
+            if (core_info_cache_enable)
+            {
+               if (!string_is_empty(dir_cache))
+                  fill_pathname_join(cache_path, dir_cache,
+                        "core_info.cache", sizeof(cache_path));
+               else if (!string_is_empty(path_libks_info))
+                  fill_pathname_join(cache_path, path_libks_info,
+                        ".core_info.cache", sizeof(cache_path));
+               else if (!string_is_empty(dir_libks))
+                  fill_pathname_join(cache_path, dir_libks,
+                        ".core_info.cache", sizeof(cache_path));
+            }
+
             if (!string_is_empty(dir_libks))
                core_info_init_list(path_libks_info,
                      dir_libks,
                      ext_name,
-                     show_hidden_files
+                     show_hidden_files,
+                     cache_path
                      );
          }
          break;
@@ -14797,6 +14904,9 @@ void main_exit(void *args)
    if (p_kingsn->runloop_perfcnt_enable)
       kingsn_perf_log(p_kingsn);
 
+   kingsn_frame_stats_log(p_kingsn);
+   performance_trace_stop();
+
 #if defined(HAVE_LOGGER) && !defined(ANDROID)
    logger_shutdown();
 #endif
@@ -14943,7 +15053,9 @@ int kingsn_main(int argc, char *argv[], void *data)
 #endif
       ret = runloop_iterate();
 
+      performance_trace_begin("task_queue_check");
       task_queue_check();
+      performance_trace_end("task_queue_check");
 
 #ifdef HAVE_QT
       app_exit = ui_companion_qt.application->exiting;
@@ -15002,7 +15114,9 @@ void emscripten_mainloop(void)
 
    ret = runloop_iterate();
 
+   performance_trace_begin("task_queue_check");
    task_queue_check();
+   performance_trace_end("task_queue_check");
 
    if (ret != -1)
       return;
@@ -19443,6 +19557,144 @@ static bool record_driver_init_first(
    return false;
 }
 
+#ifdef HAVE_THREADS
+/* Called by the recording driver, possibly on one of its
+ * threads, once it is done with a frame it was lent. */
+static void recording_frame_release(void *userdata)
+{
+   struct kingsn_state *p_kingsn = (struct kingsn_state*)userdata;
+
+   slock_lock(p_kingsn->recording_lock);
+   p_kingsn->recording_frames_lent--;
+   scond_signal(p_kingsn->recording_cond);
+   slock_unlock(p_kingsn->recording_lock);
+}
+
+static void recording_readback_release(void *userdata)
+{
+   struct kingsn_state *p_kingsn = &kingsn_st;
+   recording_readback_t *rb      = (recording_readback_t*)userdata;
+
+   slock_lock(p_kingsn->recording_lock);
+   rb->done = true;
+   scond_signal(p_kingsn->recording_cond);
+   slock_unlock(p_kingsn->recording_lock);
+}
+
+/* Waits until the recording driver no longer needs the
+ * frames that were lent to it. */
+static void recording_wait_frames(struct kingsn_state *p_kingsn)
+{
+   slock_lock(p_kingsn->recording_lock);
+   while (p_kingsn->recording_frames_lent)
+      scond_wait(p_kingsn->recording_cond, p_kingsn->recording_lock);
+   slock_unlock(p_kingsn->recording_lock);
+}
+#endif
+
+/* Gives the viewport readbacks the recording driver is done
+ * with back to the video driver. With @wait set, waits for
+ * all of them. Main thread only. */
+static void recording_release_readbacks(
+      struct kingsn_state *p_kingsn, bool wait)
+{
+#ifdef HAVE_THREADS
+   unsigned i;
+
+   for (i = 0; i < VIDEO_DRIVER_MAX_READBACKS; i++)
+   {
+      bool done                = false;
+      recording_readback_t *rb = &p_kingsn->recording_readbacks[i];
+
+      if (!rb->in_use)
+         continue;
+
+      slock_lock(p_kingsn->recording_lock);
+      while (wait && !rb->done)
+         scond_wait(p_kingsn->recording_cond, p_kingsn->recording_lock);
+      done = rb->done;
+      slock_unlock(p_kingsn->recording_lock);
+
+      if (!done)
+         continue;
+
+      video_driver_read_viewport_async_release(&rb->readback);
+      rb->in_use = false;
+      rb->done   = false;
+   }
+#endif
+}
+
+/* Pushes a finished asynchronous viewport readback, or a dupe
+ * if it was dropped. The pixels are lent to the recording
+ * driver when possible, so they are only read once. */
+static void recording_readback_cb(void *userdata,
+      const video_viewport_readback_t *readback)
+{
+   struct record_video_data ffemu_data;
+   struct kingsn_state *p_kingsn = (struct kingsn_state*)userdata;
+   recording_readback_t *rb      = NULL;
+
+   /* Recording was stopped in the meantime */
+   if (     !p_kingsn->recording_data
+         || !p_kingsn->recording_driver
+         || !p_kingsn->recording_driver->push_video)
+   {
+      if (readback)
+         video_driver_read_viewport_async_release(readback);
+      return;
+   }
+
+   ffemu_data.data     = NULL;
+   ffemu_data.release  = NULL;
+   ffemu_data.userdata = NULL;
+   ffemu_data.width    = 0;
+   ffemu_data.height   = 0;
+   ffemu_data.pitch    = 0;
+   ffemu_data.is_dupe  = !readback;
+   ffemu_data.rgba     = false;
+
+   if (readback)
+   {
+#ifdef HAVE_THREADS
+      unsigned i;
+
+      for (i = 0; p_kingsn->recording_lock
+            && i < VIDEO_DRIVER_MAX_READBACKS; i++)
+      {
+         if (!p_kingsn->recording_readbacks[i].in_use)
+         {
+            rb           = &p_kingsn->recording_readbacks[i];
+            rb->readback = *readback;
+            rb->in_use   = true;
+            rb->done     = false;
+            break;
+         }
+      }
+#endif
+
+      /* Readbacks start at the bottom row */
+      ffemu_data.data   = readback->data
+         + (int)(readback->height - 1) * readback->pitch;
+      ffemu_data.pitch  = -readback->pitch;
+      ffemu_data.width  = readback->width;
+      ffemu_data.height = readback->height;
+      ffemu_data.rgba   = readback->rgba;
+
+      if (rb)
+      {
+         ffemu_data.release  = recording_readback_release;
+         ffemu_data.userdata = rb;
+      }
+   }
+
+   p_kingsn->recording_driver->push_video(p_kingsn->recording_data, &ffemu_data);
+
+   /* Copied by the recording driver */
+   if (readback && !rb)
+      video_driver_read_viewport_async_release(readback);
+}
+
 static void recording_dump_frame(
       struct kingsn_state *p_kingsn,
       const void *data, unsigned width,
@@ -19451,12 +19703,16 @@ static void recording_dump_frame(
    struct record_video_data ffemu_data;
 
    ffemu_data.data     = data;
+   ffemu_data.release  = NULL;
+   ffemu_data.userdata = NULL;
    ffemu_data.width    = width;
    ffemu_data.height   = height;
    ffemu_data.pitch    = (int)pitch;
    ffemu_data.is_dupe  = false;
+   ffemu_data.rgba     = false;
 
-   if (p_kingsn->video_driver_record_gpu_buffer)
+   if (     p_kingsn->video_driver_record_gpu_buffer
+         || p_kingsn->recording_gpu_async)
    {
       struct video_viewport vp;
 
@@ -19494,6 +19750,23 @@ static void recording_dump_frame(
          return;
       }
 
+      if (p_kingsn->recording_gpu_async)
+      {
+         recording_release_readbacks(p_kingsn, false);
+
+         /* The frame reaches recording_readback_cb() a few
+          * frames from now, keep the frame count if it can't. */
+         if (!video_driver_read_viewport_async(
+                  recording_readback_cb, p_kingsn))
+         {
+            ffemu_data.data    = NULL;
+            ffemu_data.is_dupe = true;
+            p_kingsn->recording_driver->push_video(
+                  p_kingsn->recording_data, &ffemu_data);
+         }
+         return;
+      }
+
       /* Big bottleneck.
        * Since we might need to do read-backs asynchronously,
        * it might take 3-4 times before this returns true. */
@@ -19508,8 +19781,24 @@ static void recording_dump_frame(
       ffemu_data.pitch  = -ffemu_data.pitch;
    }
    else
+   {
       ffemu_data.is_dupe = !data;
 
+#ifdef HAVE_THREADS
+      /* The frame stays valid until video_driver_frame()
+       * returns, which waits for it to be released. */
+      if (data && p_kingsn->recording_lock)
+      {
+         slock_lock(p_kingsn->recording_lock);
+         p_kingsn->recording_frames_lent++;
+         slock_unlock(p_kingsn->recording_lock);
+
+         ffemu_data.release  = recording_frame_release;
+         ffemu_data.userdata = p_kingsn;
+      }
+#endif
+   }
+
    p_kingsn->recording_driver->push_video(p_kingsn->recording_data, &ffemu_data);
 }
 
@@ -19527,8 +19816,19 @@ static bool recording_deinit(struct kingsn_state *p_kingsn)
    p_kingsn->recording_data            = NULL;
    p_kingsn->recording_driver          = NULL;
 
+   /* Finalizing converted everything that was pushed */
+   recording_release_readbacks(p_kingsn, true);
    video_driver_gpu_record_deinit(p_kingsn);
 
+#ifdef HAVE_THREADS
+   if (p_kingsn->recording_lock)
+      slock_free(p_kingsn->recording_lock);
+   if (p_kingsn->recording_cond)
+      scond_free(p_kingsn->recording_cond);
+   p_kingsn->recording_lock            = NULL;
+   p_kingsn->recording_cond            = NULL;
+#endif
+
    return true;
 }
 
@@ -19564,6 +19864,7 @@ static void video_driver_gpu_record_deinit(struct kingsn_state *p_kingsn)
    if (p_kingsn->video_driver_record_gpu_buffer)
       free(p_kingsn->video_driver_record_gpu_buffer);
    p_kingsn->video_driver_record_gpu_buffer = NULL;
+   p_kingsn->recording_gpu_async            = false;
 }
 
 /**
@@ -19743,9 +20044,19 @@ static bool recording_init(
       KINGSN_LOG("[recording] %s %u x %u\n", msg_hash_to_str(MSG_DETECTED_VIEWPORT_OF),
             vp.width, vp.height);
 
-      gpu_size = vp.width * vp.height * 3;
-      if (!video_driver_gpu_record_init(p_kingsn, gpu_size))
-         return false;
+      /* Read back without stalling the GPU. The pixels are
+       * 4 bytes each, the byte order comes with every frame. */
+      if (video_driver_supports_viewport_read_async())
+      {
+         params.pix_fmt                    = FFEMU_PIX_ARGB8888;
+         p_kingsn->recording_gpu_async     = true;
+      }
+      else
+      {
+         gpu_size = vp.width * vp.height * 3;
+         if (!video_driver_gpu_record_init(p_kingsn, gpu_size))
+            return false;
+      }
    }
    else
    {
@@ -19799,6 +20110,23 @@ static bool recording_init(
       return false;
    }
 
+#ifdef HAVE_THREADS
+   /* Lets the recording driver convert frames in place */
+   p_kingsn->recording_lock        = slock_new();
+   p_kingsn->recording_cond        = scond_new();
+   p_kingsn->recording_frames_lent = 0;
+
+   if (!p_kingsn->recording_lock || !p_kingsn->recording_cond)
+   {
+      if (p_kingsn->recording_lock)
+         slock_free(p_kingsn->recording_lock);
+      if (p_kingsn->recording_cond)
+         scond_free(p_kingsn->recording_cond);
+      p_kingsn->recording_lock     = NULL;
+      p_kingsn->recording_cond     = NULL;
+   }
+#endif
+
    return true;
 }
 
@@ -21680,12 +22008,7 @@ float input_sensor_get_input(unsigned port, unsigned id)
    return 0.0f;
 }
 
-/**
- * input_poll:
- *
- * Input polling callback function.
- **/
-static void input_driver_poll(void)
+static void input_driver_poll_internal(void)
 {
    size_t i, j;
    kingsn_joypad_info_t joypad_info[MAX_USERS];
@@ -22075,6 +22398,18 @@ static void input_driver_poll(void)
 #endif
 }
 
+/**
+ * input_poll:
+ *
+ * Input polling callback function.
+ **/
+static void input_driver_poll(void)
+{
+   performance_trace_begin("input_driver_poll");
+   input_driver_poll_internal();
+   performance_trace_end("input_driver_poll");
+}
+
 static int16_t input_state_device(
       struct kingsn_state *p_kingsn,
       int16_t ret,
@@ -27623,6 +27958,18 @@ static bool audio_driver_init_internal(
 
    p_kingsn->audio_driver_output_samples_buf = (float*)samples_buf;
    p_kingsn->audio_driver_control            = false;
+   p_kingsn->audio_driver_buffer_size        = 0;
+
+   /* The buffer size is also needed for the audio_fill
+    * frame stats, so query it even without rate control. */
+   if (
+         !audio_cb_inited
+         && p_kingsn->audio_driver_active
+         && p_kingsn->current_audio->buffer_size
+      )
+      p_kingsn->audio_driver_buffer_size =
+         p_kingsn->current_audio->buffer_size(
+               p_kingsn->audio_driver_context_audio_data);
 
    if (
          !audio_cb_inited
@@ -27633,12 +27980,7 @@ static bool audio_driver_init_internal(
       /* Audio rate control requires write_avail
        * and buffer_size to be implemented. */
       if (p_kingsn->current_audio->buffer_size)
-      {
-         p_kingsn->audio_driver_buffer_size =
-            p_kingsn->current_audio->buffer_size(
-                  p_kingsn->audio_driver_context_audio_data);
          p_kingsn->audio_driver_control     = true;
-      }
       else
          KINGSN_WARN("Audio rate control was desired, but driver does not support needed features.\n");
    }
@@ -27672,6 +28014,12 @@ error:
  *
  * Writes audio samples to audio driver. Will first
  * perform DSP processing (if enabled) and resampling.
+ *
+ * The stages run on blocks of AUDIO_FLUSH_BLOCK_FRAMES
+ * input frames: each block goes from s16 through DSP,
+ * resampler, mixer and back to s16 while it is still in
+ * the cache. Every stage keeps its state across calls,
+ * so the output is the same as for one pass per stage.
  **/
 static void audio_driver_flush(
       struct kingsn_state *p_kingsn,
@@ -27680,53 +28028,40 @@ static void audio_driver_flush(
       const int16_t *data, size_t samples,
       bool is_slowmotion, bool is_fastmotion)
 {
-   struct resampler_data src_data;
+   size_t pos;
+   double ratio;
+   int avail                         = 0;
+   size_t frames                     = samples >> 1;
+   size_t output_frames              = 0;
+#ifdef HAVE_AUDIOMIXER
+   bool mixer_override               = true;
+   float mixer_gain                  = 0.0f;
+#endif
    float audio_volume_gain           = (p_kingsn->audio_driver_mute_enable ||
          (audio_fastforward_mute && is_fastmotion)) ?
                0.0f : p_kingsn->audio_driver_volume_gain;
 
-   src_data.data_out                 = NULL;
-   src_data.output_frames            = 0;
-
-   convert_s16_to_float(p_kingsn->audio_driver_input_data, data, samples,
-         audio_volume_gain);
+   performance_trace_begin("audio_driver_flush");
 
-   src_data.data_in                  = p_kingsn->audio_driver_input_data;
-   src_data.input_frames             = samples >> 1;
-
-#ifdef HAVE_DSP_FILTER
-   if (p_kingsn->audio_driver_dsp)
+   if (     p_kingsn->audio_driver_control
+         || (p_kingsn->audio_driver_buffer_size
+            && p_kingsn->current_audio->write_avail))
    {
-      struct ks_dsp_data dsp_data;
-
-      dsp_data.input                 = NULL;
-      dsp_data.input_frames          = 0;
-      dsp_data.output                = NULL;
-      dsp_data.output_frames         = 0;
-
-      dsp_data.input                 = p_kingsn->audio_driver_input_data;
-      dsp_data.input_frames          = (unsigned)(samples >> 1);
+      avail = (int)p_kingsn->current_audio->write_avail(
+            p_kingsn->audio_driver_context_audio_data);
 
-      ks_dsp_filter_process(p_kingsn->audio_driver_dsp, &dsp_data);
-
-      if (dsp_data.output)
-      {
-         src_data.data_in            = dsp_data.output;
-         src_data.input_frames       = dsp_data.output_frames;
-      }
+      if (p_kingsn->audio_driver_buffer_size && avail >= 0)
+         performance_histogram_add(
+               &p_kingsn->frame_stats[FRAME_STATS_AUDIO_FILL],
+               100 - MIN((size_t)avail, p_kingsn->audio_driver_buffer_size)
+               * 100 / p_kingsn->audio_driver_buffer_size);
    }
-#endif
-
-   src_data.data_out                 = p_kingsn->audio_driver_output_samples_buf;
 
    if (p_kingsn->audio_driver_control)
    {
       /* Readjust the audio input rate. */
       int      half_size           =
          (int)(p_kingsn->audio_driver_buffer_size / 2);
-      int      avail               =
-         (int)p_kingsn->current_audio->write_avail(
-               p_kingsn->audio_driver_context_audio_data);
       int      delta_mid           = avail - half_size;
       double   direction           = (double)delta_mid / half_size;
       double   adjust              = 1.0 +
@@ -27737,6 +28072,7 @@ static void audio_driver_flush(
 
       p_kingsn->audio_driver_free_samples_buf
          [write_idx]                        = avail;
+
       p_kingsn->audio_source_ratio_current   =
          p_kingsn->audio_source_ratio_original * adjust;
 
@@ -27753,10 +28089,10 @@ static void audio_driver_flush(
 #endif
    }
 
-   src_data.ratio           = p_kingsn->audio_source_ratio_current;
+   ratio                    = p_kingsn->audio_source_ratio_current;
 
    if (is_slowmotion)
-      src_data.ratio       *= slowmotion_ratio;
+      ratio                *= slowmotion_ratio;
 
    /* Note: Ideally we would divide by the user-configured
     * 'fastforward_ratio' when fast forward is enabled,
@@ -27775,50 +28111,90 @@ static void audio_driver_flush(
     * trying to do anything. Just leave the ratio as-is,
     * and hope for the best... */
 
-   p_kingsn->audio_driver_resampler->process(
-         p_kingsn->audio_driver_resampler_data, &src_data);
-
 #ifdef HAVE_AUDIOMIXER
-   if (p_kingsn->audio_mixer_active)
+   if (     p_kingsn->audio_mixer_active
+         && !p_kingsn->audio_driver_mixer_mute_enable)
+   {
+      if (p_kingsn->audio_driver_mixer_volume_gain == 1.0f)
+         mixer_override               = false;
+      mixer_gain                      =
+         p_kingsn->audio_driver_mixer_volume_gain;
+   }
+#endif
+
+   for (pos = 0; pos < frames; pos += AUDIO_FLUSH_BLOCK_FRAMES)
    {
-      bool override                       = true;
-      float mixer_gain                    = 0.0f;
-      bool audio_driver_mixer_mute_enable =
-         p_kingsn->audio_driver_mixer_mute_enable;
+      struct resampler_data src_data;
+      size_t block_frames            = MIN(frames - pos,
+            AUDIO_FLUSH_BLOCK_FRAMES);
+      float *block_out               =
+         p_kingsn->audio_driver_output_samples_buf + output_frames * 2;
+
+      convert_s16_to_float(p_kingsn->audio_driver_input_data,
+            data + pos * 2, block_frames * 2, audio_volume_gain);
 
-      if (!audio_driver_mixer_mute_enable)
+      src_data.data_in               = p_kingsn->audio_driver_input_data;
+      src_data.input_frames          = block_frames;
+
+#ifdef HAVE_DSP_FILTER
+      if (p_kingsn->audio_driver_dsp)
       {
-         if (p_kingsn->audio_driver_mixer_volume_gain == 1.0f)
-            override                      = false;
-         mixer_gain                       =
-            p_kingsn->audio_driver_mixer_volume_gain;
+         struct ks_dsp_data dsp_data;
+
+         dsp_data.input              = p_kingsn->audio_driver_input_data;
+         dsp_data.input_frames       = (unsigned)block_frames;
+         dsp_data.output             = NULL;
+         dsp_data.output_frames      = 0;
+
+         ks_dsp_filter_process(p_kingsn->audio_driver_dsp, &dsp_data);
+
+         if (dsp_data.output)
+         {
+            src_data.data_in         = dsp_data.output;
+            src_data.input_frames    = dsp_data.output_frames;
+         }
       }
-      audio_mixer_mix(
-            p_kingsn->audio_driver_output_samples_buf,
-            src_data.output_frames, mixer_gain, override);
-   }
 #endif
 
+      src_data.data_out              = block_out;
+      src_data.output_frames         = 0;
+      src_data.ratio                 = ratio;
+
+      p_kingsn->audio_driver_resampler->process(
+            p_kingsn->audio_driver_resampler_data, &src_data);
+
+#ifdef HAVE_AUDIOMIXER
+      if (p_kingsn->audio_mixer_active)
+         audio_mixer_mix(block_out, src_data.output_frames,
+               mixer_gain, mixer_override);
+#endif
+
+      if (!p_kingsn->audio_driver_use_float)
+         convert_float_to_s16(
+               p_kingsn->audio_driver_output_samples_conv_buf
+               + output_frames * 2,
+               block_out, src_data.output_frames * 2);
+
+      output_frames                 += src_data.output_frames;
+   }
+
    {
       const void *output_data = p_kingsn->audio_driver_output_samples_buf;
-      unsigned output_frames  = (unsigned)src_data.output_frames;
+      size_t output_size      = output_frames * 2 * sizeof(float);
 
-      if (p_kingsn->audio_driver_use_float)
-         output_frames       *= sizeof(float);
-      else
+      if (!p_kingsn->audio_driver_use_float)
       {
-         convert_float_to_s16(p_kingsn->audio_driver_output_samples_conv_buf,
-               (const float*)output_data, output_frames * 2);
-
          output_data          = p_kingsn->audio_driver_output_samples_conv_buf;
-         output_frames       *= sizeof(int16_t);
+         output_size          = output_frames * 2 * sizeof(int16_t);
       }
 
       if (p_kingsn->current_audio->write(
                p_kingsn->audio_driver_context_audio_data,
-               output_data, output_frames * 2) < 0)
+               output_data, output_size) < 0)
          p_kingsn->audio_driver_active = false;
    }
+
+   performance_trace_end("audio_driver_flush");
 }
 
 /**
@@ -29448,6 +29824,76 @@ static void video_driver_free_hw_context(struct kingsn_state *p_kingsn)
    p_kingsn->hw_render_context_negotiation = NULL;
 }
 
+/* Hands finished asynchronous viewport readbacks over to
+ * their callbacks, oldest first. */
+static void video_driver_poll_readbacks(struct kingsn_state *p_kingsn)
+{
+   unsigned i = 0;
+
+   while (i < p_kingsn->video_driver_readbacks_pending)
+   {
+      video_viewport_readback_t readback;
+      video_driver_readback_t entry =
+         p_kingsn->video_driver_readbacks[i];
+
+      if (!p_kingsn->current_video->read_viewport_async_poll(
+               p_kingsn->video_driver_data, entry.slot, &readback))
+      {
+         i++;
+         continue;
+      }
+
+      p_kingsn->video_driver_readbacks_pending--;
+      memmove(&p_kingsn->video_driver_readbacks[i],
+            &p_kingsn->video_driver_readbacks[i + 1],
+            (p_kingsn->video_driver_readbacks_pending - i)
+            * sizeof(p_kingsn->video_driver_readbacks[0]));
+
+      readback.slot = entry.slot;
+      p_kingsn->video_driver_readbacks_busy++;
+
+      if (!readback.data)
+      {
+         video_driver_read_viewport_async_release(&readback);
+         entry.cb(entry.userdata, NULL);
+      }
+      else
+         entry.cb(entry.userdata, &readback);
+   }
+}
+
+static bool video_driver_readbacks_in_use(void *data)
+{
+   struct kingsn_state *p_kingsn = (struct kingsn_state*)data;
+   return p_kingsn->video_driver_readbacks_busy != 0;
+}
+
+/* Drops the readbacks still in flight and waits for the
+ * ones that were handed over, as their pixels live in driver
+ * memory. */
+static void video_driver_free_readbacks(struct kingsn_state *p_kingsn)
+{
+   unsigned i;
+
+   for (i = 0; i < p_kingsn->video_driver_readbacks_pending; i++)
+   {
+      video_driver_readback_t *entry = &p_kingsn->video_driver_readbacks[i];
+
+      p_kingsn->current_video->read_viewport_async_release(
+            p_kingsn->video_driver_data, entry->slot);
+      entry->cb(entry->userdata, NULL);
+   }
+   p_kingsn->video_driver_readbacks_pending = 0;
+
+   /* The ones lent to the recording driver only come
+    * back through the main thread */
+   recording_release_readbacks(p_kingsn, true);
+
+   if (p_kingsn->video_driver_readbacks_busy)
+      task_queue_wait(video_driver_readbacks_in_use, p_kingsn);
+   p_kingsn->video_driver_readbacks_busy    = 0;
+}
+
 static void video_driver_free_internal(void)
 {
    struct kingsn_state *p_kingsn = &kingsn_st;
@@ -29481,6 +29927,12 @@ static void video_driver_free_internal(void)
       p_kingsn->current_input_data                         = NULL;
    }
 
+   if (p_kingsn->video_driver_data
+         && p_kingsn->current_video
+         && (     p_kingsn->video_driver_readbacks_pending
+               || p_kingsn->video_driver_readbacks_busy))
+      video_driver_free_readbacks(p_kingsn);
+
    if (p_kingsn->video_driver_data
          && p_kingsn->current_video
          && p_kingsn->current_video->free)
@@ -30708,6 +31160,54 @@ bool video_driver_read_viewport(uint8_t *buffer, bool is_idle)
    return false;
 }
 
+bool video_driver_supports_viewport_read_async(void)
+{
+   struct kingsn_state *p_kingsn = &kingsn_st;
+   return p_kingsn->current_video
+      && p_kingsn->current_video->read_viewport_async
+      && p_kingsn->current_video->read_viewport_async_poll
+      && p_kingsn->current_video->read_viewport_async_release;
+}
+
+bool video_driver_read_viewport_async(video_driver_readback_cb_t cb,
+      void *userdata)
+{
+   int slot;
+   video_driver_readback_t *entry = NULL;
+   struct kingsn_state *p_kingsn  = &kingsn_st;
+
+   if (     !video_driver_supports_viewport_read_async()
+         || p_kingsn->video_driver_readbacks_pending
+         >= VIDEO_DRIVER_MAX_READBACKS)
+      return false;
+
+   slot = p_kingsn->current_video->read_viewport_async(
+         p_kingsn->video_driver_data);
+   if (slot < 0)
+      return false;
+
+   entry           = &p_kingsn->video_driver_readbacks[
+      p_kingsn->video_driver_readbacks_pending++];
+   entry->cb       = cb;
+   entry->userdata = userdata;
+   entry->slot     = (unsigned)slot;
+   return true;
+}
+
+void video_driver_read_viewport_async_release(
+      const video_viewport_readback_t *readback)
+{
+   struct kingsn_state *p_kingsn = &kingsn_st;
+
+   if (p_kingsn->video_driver_readbacks_busy > 0)
+      p_kingsn->video_driver_readbacks_busy--;
+
+   if (     p_kingsn->video_driver_data
+         && video_driver_supports_viewport_read_async())
+      p_kingsn->current_video->read_viewport_async_release(
+            p_kingsn->video_driver_data, readback->slot);
+}
+
 static void video_driver_reinit_context(struct kingsn_state *p_kingsn,
       int flags)
 {
@@ -30921,6 +31421,8 @@ static void video_driver_frame(const void *data, unsigned width,
    if (!video_driver_active)
       return;
 
+   performance_trace_begin("video_driver_frame");
+
    new_time                     = cpu_features_get_time_usec();
 
    if (data)
@@ -30963,6 +31465,10 @@ static void video_driver_frame(const void *data, unsigned width,
          [write_index]                             = frame_time;
       fps_time                                     = new_time;
 
+      performance_histogram_add(
+            &p_kingsn->frame_stats[FRAME_STATS_FRAME_TIME],
+            (uint64_t)frame_time);
+
       if (video_info.fps_show)
          buf_pos = snprintf(
                status_text, sizeof(status_text),
@@ -31091,6 +31597,7 @@ static void video_driver_frame(const void *data, unsigned width,
              !video_info.post_filter_record
           || !data
           || p_kingsn->video_driver_record_gpu_buffer
+          || p_kingsn->recording_gpu_async
          ) && p_kingsn->recording_data
            && p_kingsn->recording_driver
            && p_kingsn->recording_driver->push_video)
@@ -31247,11 +31754,29 @@ static void video_driver_frame(const void *data, unsigned width,
    }
 
    if (p_kingsn->current_video && p_kingsn->current_video->frame)
+   {
+      ks_time_t submit_time         = cpu_features_get_time_usec();
+
       p_kingsn->video_driver_active = p_kingsn->current_video->frame(
             p_kingsn->video_driver_data, data, width, height,
             p_kingsn->video_driver_frame_count,
             (unsigned)pitch, video_driver_msg, &video_info);
 
+      performance_histogram_add(
+            &p_kingsn->frame_stats[FRAME_STATS_VIDEO_FRAME],
+            (uint64_t)(cpu_features_get_time_usec() - submit_time));
+   }
+
+   if (p_kingsn->video_driver_readbacks_pending)
+      video_driver_poll_readbacks(p_kingsn);
+
+#ifdef HAVE_THREADS
+   /* The recording driver converted the frame while the video
+    * driver drew it, the core gets it back from here on. */
+   if (p_kingsn->recording_lock)
+      recording_wait_frames(p_kingsn);
+#endif
+
    p_kingsn->video_driver_frame_count++;
 
    /* Display the status text, with a higher priority. */
@@ -31311,6 +31836,8 @@ static void video_driver_frame(const void *data, unsigned width,
    }
    else if (!video_info.crt_switch_resolution)
       p_kingsn->video_driver_crt_switching_active = false;
+
+   performance_trace_end("video_driver_frame");
 }
 
 void crt_switch_driver_reinit(void)
@@ -33763,6 +34290,11 @@ static void KingStation_print_help(const char *arg0)
       strlcat(buf, "      --max-frames=NUMBER\n"
             "                        Runs for the specified number of frames, "
             "then exits.\n", sizeof(buf));
+      strlcat(buf, "      --benchmark=NUMBER\n"
+            "                        Runs content for the specified number of frames as fast as\n"
+            "                        possible on the null drivers, then prints the frame rate,\n"
+            "                        frame time percentiles and hashes of the last frame and\n"
+            "                        state. Combine with -P to replay a movie.\n", sizeof(buf));
 #ifdef HAVE_SCREENSHOTS
       strlcat(buf, "      --max-frames-ss\n"
             "                        Takes a screenshot at the end of max-frames.\n", sizeof(buf));
@@ -33773,6 +34305,9 @@ static void KingStation_print_help(const char *arg0)
       strlcat(buf, "      --accessibility\n"
             "                        Enables accessibilty for blind users using text-to-speech.\n", sizeof(buf));
 #endif
+      strlcat(buf, "      --trace=FILE\n"
+            "                        Records a timeline of every frame and writes it to FILE\n"
+            "                        on exit, in the Chrome trace event format.\n", sizeof(buf));
       strlcat(buf, "      --load-menu-on-error\n"
             "                        Open menu instead of quitting if specified core or content fails to load.\n", sizeof(buf));
       puts(buf);
@@ -33850,9 +34385,11 @@ static void KingStation_parse_input_and_config(
       { "max-frames",         1, NULL, RA_OPT_MAX_FRAMES },
       { "max-frames-ss",      0, NULL, RA_OPT_MAX_FRAMES_SCREENSHOT },
       { "max-frames-ss-path", 1, NULL, RA_OPT_MAX_FRAMES_SCREENSHOT_PATH },
+      { "benchmark",          1, NULL, RA_OPT_BENCHMARK },
       { "eof-exit",           0, NULL, RA_OPT_EOF_EXIT },
       { "version",            0, NULL, RA_OPT_VERSION },
       { "log-file",           1, NULL, RA_OPT_LOG_FILE },
+      { "trace",              1, NULL, RA_OPT_TRACE },
       { "accessibility",      0, NULL, RA_OPT_ACCESSIBILITY},
       { "load-menu-on-error", 0, NULL, RA_OPT_LOAD_MENU_ON_ERROR },
       { NULL, 0, NULL, 0 }
@@ -34372,6 +34909,40 @@ static void KingStation_parse_input_and_config(
 #endif
                break;
 
+            case RA_OPT_BENCHMARK:
+               {
+                  settings_t *settings = p_kingsn->configuration_settings;
+
+                  p_kingsn->runloop_max_frames = (unsigned)strtoul(optarg, NULL, 10);
+                  p_kingsn->runloop_benchmark  = true;
+
+                  /* Run unthrottled on the null drivers, and keep
+                   * SRAM out of it so that runs are repeatable */
+                  strlcpy(settings->arrays.video_driver, "null",
+                        sizeof(settings->arrays.video_driver));
+                  strlcpy(settings->arrays.audio_driver, "null",
+                        sizeof(settings->arrays.audio_driver));
+                  strlcpy(settings->arrays.input_driver, "null",
+                        sizeof(settings->arrays.input_driver));
+                  configuration_set_bool(settings,
+                        settings->bools.video_threaded, false);
+                  configuration_set_bool(settings,
+                        settings->bools.vrr_runloop_enable, false);
+                  configuration_set_float(settings,
+                        settings->floats.fastforward_ratio, 0.0f);
+                  /* Do not write the overrides back to the config */
+                  configuration_set_bool(settings,
+                        settings->bools.config_save_on_exit, false);
+
+                  p_kingsn->kingsn_is_sram_load_disabled = true;
+                  p_kingsn->kingsn_is_sram_save_disabled = true;
+#ifdef HAVE_BSV_MOVIE
+                  /* A replayed movie ends the run when it runs out */
+                  p_kingsn->bsv_movie_state.eof_exit     = true;
+#endif
+               }
+               break;
+
             case RA_OPT_SUBSYSTEM:
                path_set(KINGSN_PATH_SUBSYSTEM, optarg);
                break;
@@ -34402,6 +34973,10 @@ static void KingStation_parse_input_and_config(
                kingsn_log_file_set_override(optarg);
                break;
 
+            case RA_OPT_TRACE:
+               performance_trace_start(optarg);
+               break;
+
             case 'h':
 #ifdef HAVE_CONFIGFILE
             case 'c':
@@ -35920,10 +36495,16 @@ int KingStation_get_capabilities(enum kingsn_capabilities type,
                strlcat(s, " SSE4.2", len);
             if (cpu & KS_SIMD_AES)
                strlcat(s, " AES", len);
+            if (cpu & KS_SIMD_PCLMUL)
+               strlcat(s, " PCLMUL", len);
             if (cpu & KS_SIMD_AVX)
                strlcat(s, " AVX", len);
             if (cpu & KS_SIMD_AVX2)
                strlcat(s, " AVX2", len);
+            if (cpu & KS_SIMD_FMA3)
+               strlcat(s, " FMA3", len);
+            if (cpu & KS_SIMD_AVX512)
+               strlcat(s, " AVX512", len);
             if (cpu & KS_SIMD_NEON)
                strlcat(s, " NEON", len);
             if (cpu & KS_SIMD_VFPV3)
@@ -35940,6 +36521,8 @@ int KingStation_get_capabilities(enum kingsn_capabilities type,
                strlcat(s, " PS", len);
             if (cpu & KS_SIMD_ASIMD)
                strlcat(s, " ASIMD", len);
+            if (cpu & KS_SIMD_PMULL)
+               strlcat(s, " PMULL", len);
          }
          break;
       case KINGSN_CAPABILITIES_COMPILER:
@@ -36327,6 +36910,73 @@ static void update_savestate_slot(int state_slot)
    KINGSN_LOG("%s\n", msg);
 }
 
+/* Prints the results of --benchmark. The hashes cover
+ * the last frame the core output and its serialized
+ * state, so two runs of the same content and movie
+ * have to match. */
+static void runloop_benchmark_report(struct kingsn_state *p_kingsn)
+{
+   unsigned i;
+   char line[256];
+   ks_ctx_size_info_t size_info;
+   const performance_histogram_t *frames =
+      &p_kingsn->frame_stats[FRAME_STATS_FRAME_TIME];
+   const uint8_t *frame  = (const uint8_t*)p_kingsn->frame_cache_data;
+   double secs           = frames->sum / 1000000.0;
+
+   printf("Benchmark: %" PRIu64 " frames in %.3f s, %.2f fps\n",
+         (uint64_t)p_kingsn->video_driver_frame_count, secs,
+         secs > 0.0 ? frames->count / secs : 0.0);
+
+   for (i = 0; i < FRAME_STATS_AUDIO_FILL; i++)
+   {
+      performance_histogram_format(&p_kingsn->frame_stats[i],
+            frame_stats_names[i], frame_stats_units[i], line, sizeof(line));
+      printf("  %s\n", line);
+   }
+
+   if (frame && frame != KS_HW_FRAME_BUFFER_VALID)
+   {
+      unsigned y;
+      uint32_t crc  = 0;
+      unsigned bpp  = (p_kingsn->video_driver_pix_fmt
+            == KS_PIXEL_FORMAT_XRGB8888) ? 4 : 2;
+
+      for (y = 0; y < p_kingsn->frame_cache_height; y++)
+         crc = encoding_crc32(crc,
+               frame + y * p_kingsn->frame_cache_pitch,
+               p_kingsn->frame_cache_width * bpp);
+
+      printf("Frame hash: %08x (%ux%u)\n", crc,
+            p_kingsn->frame_cache_width, p_kingsn->frame_cache_height);
+   }
+   else
+      printf("Frame hash: unavailable\n");
+
+   size_info.size = 0;
+   if (core_serialize_size(&size_info) && size_info.size)
+   {
+      ks_ctx_serialize_info_t serial_info;
+      void *state           = malloc(size_info.size);
+
+      serial_info.data      = state;
+      serial_info.size      = size_info.size;
+
+      if (state && core_serialize(&serial_info))
+         printf("State hash: %08x (%u bytes)\n",
+               encoding_crc32(0, (const uint8_t*)state, size_info.size),
+               (unsigned)size_info.size);
+      else
+         printf("State hash: unavailable\n");
+
+      free(state);
+   }
+   else
+      printf("State hash: unavailable\n");
+
+   fflush(stdout);
+}
+
 static enum runloop_state runloop_check_state(
       struct kingsn_state *p_kingsn,
       settings_t *settings,
@@ -36732,6 +37382,12 @@ static enum runloop_state runloop_check_state(
          }
 #endif
 
+         if (p_kingsn->runloop_benchmark)
+         {
+            runloop_benchmark_report(p_kingsn);
+            p_kingsn->runloop_benchmark = false;
+         }
+
          if (runloop_exec)
             runloop_exec = false;
 
@@ -37444,16 +38100,7 @@ static enum runloop_state runloop_check_state(
    return RUNLOOP_STATE_ITERATE;
 }
 
-/**
- * runloop_iterate:
- *
- * Run Libks core in KingStation for one frame.
- *
- * Returns: 0 on success, 1 if we have to wait until
- * button input in order to wake up the loop,
- * -1 if we forcibly quit out of the KingStation iteration loop.
- **/
-int runloop_iterate(void)
+static int runloop_iterate_internal(void)
 {
    unsigned i;
    struct kingsn_state                  *p_kingsn = &kingsn_st;
@@ -37806,6 +38453,26 @@ end:
    return 0;
 }
 
+/**
+ * runloop_iterate:
+ *
+ * Run Libks core in KingStation for one frame.
+ *
+ * Returns: 0 on success, 1 if we have to wait until
+ * button input in order to wake up the loop,
+ * -1 if we forcibly quit out of the KingStation iteration loop.
+ **/
+int runloop_iterate(void)
+{
+   int ret;
+
+   performance_trace_begin("runloop_iterate");
+   ret = runloop_iterate_internal();
+   performance_trace_end("runloop_iterate");
+
+   return ret;
+}
+
 kingsn_system_info_t *runloop_get_system_info(void)
 {
    struct kingsn_state *p_kingsn = &kingsn_st;
@@ -37925,6 +38592,7 @@ void kingsn_favorites_init(void)
    playlist_config.old_format          = settings ? settings->bools.playlist_use_old_format : false;
    playlist_config.compress            = settings ? settings->bools.playlist_compression : false;
    playlist_config.fuzzy_archive_match = settings ? settings->bools.playlist_fuzzy_archive_match : false;
+   playlist_config.binary_cache        = settings ? settings->bools.playlist_binary_cache : false;
    playlist_config_set_base_content_directory(&playlist_config, NULL);
 
    if (!settings)
@@ -38287,8 +38955,15 @@ bool core_run(void)
       : current_core->poll_type;
    bool early_polling          = new_poll_type == POLL_TYPE_EARLY;
    bool late_polling           = new_poll_type == POLL_TYPE_LATE;
+   ks_time_t run_time;
+#ifdef HAVE_NETWORKING
+   bool netplay_preframe;
+#endif
+
+   performance_trace_begin("core_run");
+
 #ifdef HAVE_NETWORKING
-   bool netplay_preframe       = netplay_driver_ctl(
+   netplay_preframe            = netplay_driver_ctl(
          KINGSN_NETPLAY_CTL_PRE_FRAME, NULL);
 
    if (!netplay_preframe)
@@ -38297,24 +38972,34 @@ bool core_run(void)
        * netplay peer pausing doesn't just hang. */
       input_driver_poll();
       video_driver_cached_frame();
+      performance_trace_end("core_run");
       return true;
    }
 #endif
 
+   run_time                    = cpu_features_get_time_usec();
+
    if (early_polling)
       input_driver_poll();
    else if (late_polling)
       current_core->input_polled = false;
 
+   performance_trace_begin("ks_run");
    current_core->ks_run();
+   performance_trace_end("ks_run");
 
    if (late_polling && !current_core->input_polled)
       input_driver_poll();
 
+   performance_histogram_add(
+         &p_kingsn->frame_stats[FRAME_STATS_CORE_RUN],
+         (uint64_t)(cpu_features_get_time_usec() - run_time));
+
 #ifdef HAVE_NETWORKING
    netplay_driver_ctl(KINGSN_NETPLAY_CTL_POST_FRAME, NULL);
 #endif
 
+   performance_trace_end("core_run");
    return true;
 }
 
@@ -699,10 +699,19 @@ struct record_params
 struct record_video_data
 {
    const void *data;
+   /* If set, @data is lent to the driver, which may keep using
+    * it after push_video() returns and has to call @release
+    * exactly once, from any thread, when it is done with it,
+    * even if the frame is dropped or push_video() fails.
+    * Otherwise @data has to be copied before returning. */
+   void (*release)(void *userdata);
+   void *userdata;
    unsigned width;
    unsigned height;
    int pitch;
    bool is_dupe;
+   /* 4 byte pixels are R, G, B, X instead of B, G, R, X */
+   bool rgba;
 };
 
 struct record_audio_data
@@ -1412,6 +1421,26 @@ typedef struct video_poke_interface
          const struct ks_hw_render_interface **iface);
 } video_poke_interface_t;
 
+/* Pixels of an asynchronous viewport readback, 4 bytes per
+ * pixel. @data points at the bottom row and @pitch goes from
+ * one row to the one above it, like the buffers handed to
+ * screenshot_dump(). They stay valid until the readback is
+ * released. */
+typedef struct video_viewport_readback
+{
+   const uint8_t *data;
+   int pitch;
+   unsigned width;
+   unsigned height;
+   unsigned slot;
+   bool rgba;     /* R, G, B, X byte order, else B, G, R, X */
+} video_viewport_readback_t;
+
+/* Called on the main thread once an asynchronous readback has
+ * completed, or with NULL if it was dropped. */
+typedef void (*video_driver_readback_cb_t)(void *userdata,
+      const video_viewport_readback_t *readback);
+
 /* msg is for showing a message on the screen
  * along with the video frame. */
 typedef bool (*video_driver_frame_t)(void *data,
@@ -1503,6 +1532,19 @@ typedef struct video_driver
     * if set to false, will use OSD as a fallback */
    bool (*gfx_widgets_enabled)(void *data);
 #endif
+
+   /* Asynchronous variant of read_viewport. Queues a copy of the
+    * viewport of the next frame into driver owned staging memory
+    * without waiting for the GPU, and returns its slot, or -1 if
+    * no slot is free. Might not be implemented. */
+   int (*read_viewport_async)(void *data);
+
+   /* Returns true once the copy in @slot has completed, and fills
+    * in @readback. The pixels stay mapped until the slot is
+    * released. */
+   bool (*read_viewport_async_poll)(void *data, unsigned slot,
+         video_viewport_readback_t *readback);
+   void (*read_viewport_async_release)(void *data, unsigned slot);
 } video_driver_t;
 
 extern struct aspect_ratio_elem aspectratio_lut[ASPECT_RATIO_END];
@@ -1553,6 +1595,27 @@ void video_driver_apply_state_changes(void);
 
 bool video_driver_read_viewport(uint8_t *buffer, bool is_idle);
 
+bool video_driver_supports_viewport_read_async(void);
+
+/**
+ * video_driver_read_viewport_async:
+ * @cb           : called once the pixels are available.
+ * @userdata     : passed to @cb.
+ *
+ * Reads back the viewport of the next frame without stalling
+ * the GPU. @cb runs on the main thread a few frames later and
+ * has to hand the readback to
+ * video_driver_read_viewport_async_release() once it is done
+ * with the pixels, from the main thread as well.
+ *
+ * Returns: false if the driver cannot take another readback.
+ **/
+bool video_driver_read_viewport_async(video_driver_readback_cb_t cb,
+      void *userdata);
+
+void video_driver_read_viewport_async_release(
+      const video_viewport_readback_t *readback);
+
 void video_driver_cached_frame(void);
 
 bool video_driver_is_hw_context(void);
@@ -80,6 +80,10 @@
 
 #define AUDIO_BUFFER_FREE_SAMPLES_COUNT (8 * 1024)
 
+/* audio_driver_flush() takes every block of this many frames
+ * through all stages before the next, so it stays in L1 */
+#define AUDIO_FLUSH_BLOCK_FRAMES 256
+
 #define MENU_SOUND_FORMATS "ogg|mod|xm|s3m|mp3|flac|wav"
 
 #define MIDI_DRIVER_BUF_SIZE 4096
@@ -110,6 +114,8 @@
 #define DEFAULT_NETWORK_CMD_PORT 55355
 #define STDIN_BUF_SIZE           4096
 
+#define VIDEO_DRIVER_MAX_READBACKS 4
+
 #ifdef HAVE_THREADS
 #define VIDEO_DRIVER_IS_THREADED_INTERNAL() ((!video_driver_is_hw_context() && p_kingsn->video_driver_threaded) ? true : false)
 #else
@@ -1272,9 +1278,11 @@ enum
    RA_OPT_VERSION,
    RA_OPT_EOF_EXIT,
    RA_OPT_LOG_FILE,
+   RA_OPT_TRACE,
    RA_OPT_MAX_FRAMES,
    RA_OPT_MAX_FRAMES_SCREENSHOT,
    RA_OPT_MAX_FRAMES_SCREENSHOT_PATH,
+   RA_OPT_BENCHMARK,
    RA_OPT_SET_SHADER,
    RA_OPT_ACCESSIBILITY,
    RA_OPT_LOAD_MENU_ON_ERROR
@@ -1317,6 +1325,17 @@ enum auto_shader_operation
    AUTO_SHADER_OP_EXISTS
 };
 
+/* Histograms kept for the whole session, see
+ * GET_FRAME_STATS and kingsn_frame_stats_log() */
+enum frame_stats_type
+{
+   FRAME_STATS_FRAME_TIME = 0,
+   FRAME_STATS_CORE_RUN,
+   FRAME_STATS_VIDEO_FRAME,
+   FRAME_STATS_AUDIO_FILL,
+   FRAME_STATS_LAST
+};
+
 enum input_game_focus_cmd_type
 {
    GAME_FOCUS_CMD_OFF = 0,
@@ -1384,6 +1403,25 @@ struct bsv_movie
 };
 #endif
 
+/* Asynchronous viewport readback queued by
+ * video_driver_read_viewport_async() */
+typedef struct video_driver_readback
+{
+   video_driver_readback_cb_t cb;
+   void *userdata;
+   unsigned slot;
+} video_driver_readback_t;
+
+/* Viewport readback lent to the recording driver. It has to be
+ * released on the main thread, the recording driver only flags
+ * it as done once it has converted the pixels. */
+typedef struct recording_readback
+{
+   video_viewport_readback_t readback;
+   bool in_use;
+   bool done;      /* Guarded by recording_lock */
+} recording_readback_t;
+
 typedef struct video_pixel_scaler
 {
    struct scaler_ctx *scaler;
@@ -1789,6 +1827,11 @@ struct kingsn_state
 
    const record_driver_t *recording_driver;
    void *recording_data;
+#ifdef HAVE_THREADS
+   /* Guards what the recording driver gives back from its threads */
+   slock_t *recording_lock;
+   scond_t *recording_cond;
+#endif
 
 #ifdef HAVE_THREADS
    slock_t *runloop_msg_queue_lock;
@@ -1836,6 +1879,10 @@ struct kingsn_state
     * being passed to video driver. */
    video_pixel_scaler_t *video_driver_scaler_ptr;
 
+   /* Readbacks waiting for the GPU */
+   video_driver_readback_t video_driver_readbacks[VIDEO_DRIVER_MAX_READBACKS];
+   recording_readback_t recording_readbacks[VIDEO_DRIVER_MAX_READBACKS];
+
    const struct
       ks_hw_render_context_negotiation_interface *
       hw_render_context_negotiation;
@@ -1898,6 +1945,8 @@ struct kingsn_state
    struct ks_perf_counter *perf_counters_kingsn[MAX_COUNTERS];
    struct ks_perf_counter *perf_counters_libks[MAX_COUNTERS];
 
+   performance_histogram_t frame_stats[FRAME_STATS_LAST];
+
    const struct ks_keybind *libks_input_binds[MAX_USERS];
 
 #ifdef HAVE_REWIND
@@ -2048,6 +2097,12 @@ struct kingsn_state
    unsigned frame_cache_height;
    unsigned video_driver_width;
    unsigned video_driver_height;
+   unsigned video_driver_readbacks_pending;
+   /* Readbacks handed out and not released yet */
+   unsigned video_driver_readbacks_busy;
+   /* Frames pushed to the recording driver and not released yet,
+    * guarded by recording_lock */
+   unsigned recording_frames_lent;
    unsigned osk_last_codepoint;
    unsigned osk_last_codepoint_len;
    unsigned input_driver_flushing_input;
@@ -2271,6 +2326,7 @@ struct kingsn_state
 #ifdef HAVE_SCREENSHOTS
    bool runloop_max_frames_screenshot;
 #endif
+   bool runloop_benchmark;
 #if defined(HAVE_CG) || defined(HAVE_GLSL) || defined(HAVE_SLANG) || defined(HAVE_HLSL)
    bool cli_shader_disable;
 #endif
@@ -2331,6 +2387,8 @@ struct kingsn_state
 #endif
 
    bool recording_enable;
+   /* GPU recording through asynchronous viewport readbacks */
+   bool recording_gpu_async;
    bool streaming_enable;
 
    bool midi_drv_input_enabled;
@@ -2680,6 +2738,7 @@ static bool command_set_shader(const char *arg);
 static bool command_version(const char* arg);
 static bool command_get_status(const char* arg);
 static bool command_get_config_param(const char* arg);
+static bool command_get_frame_stats(const char* arg);
 static bool command_show_osd_msg(const char* arg);
 #ifdef HAVE_CHEEVOS
 static bool command_read_ram(const char *arg);
@@ -2693,6 +2752,7 @@ static const struct cmd_action_map action_map[] = {
    { "VERSION",          command_version,          "No argument"},
    { "GET_STATUS",       command_get_status,       "No argument" },
    { "GET_CONFIG_PARAM", command_get_config_param, "<param name>" },
+   { "GET_FRAME_STATS",  command_get_frame_stats,  "[frame_time|core_run|video_frame|audio_fill]" },
    { "SHOW_MSG",         command_show_osd_msg,     "No argument" },
 #if defined(HAVE_CHEEVOS)
    { "READ_CORE_RAM",   command_read_ram,    "<address> <number of bytes>" },
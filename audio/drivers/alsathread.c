@@ -21,7 +21,7 @@
 #include <alsa/asoundlib.h>
 
 #include <rthreads/rthreads.h>
-#include <queues/fifo_queue.h>
+#include <queues/spsc_queue.h>
 #include <string/stdstring.h>
 
 #include "../../KingStation.h"
@@ -33,11 +33,8 @@
 typedef struct alsa_thread
 {
    snd_pcm_t *pcm;
-   fifo_buffer_t *buffer;
+   spsc_queue_t *buffer;
    sthread_t *worker_thread;
-   slock_t *fifo_lock;
-   scond_t *cond;
-   slock_t *cond_lock;
    size_t buffer_size;
    size_t period_size;
    snd_pcm_uframes_t period_frames;
@@ -60,15 +57,10 @@ static void alsa_worker_thread(void *data)
 
    while (!alsa->thread_dead)
    {
-      size_t avail;
       size_t fifo_size;
       snd_pcm_sframes_t frames;
-      slock_lock(alsa->fifo_lock);
-      avail     = FIFO_READ_AVAIL(alsa->buffer);
-      fifo_size = MIN(alsa->period_size, avail);
-      fifo_read(alsa->buffer, buf, fifo_size);
-      scond_signal(alsa->cond);
-      slock_unlock(alsa->fifo_lock);
+
+      fifo_size = spsc_queue_read(alsa->buffer, buf, alsa->period_size);
 
       /* If underrun, fill rest with silence. */
       memset(buf + fifo_size, 0, alsa->period_size - fifo_size);
@@ -96,10 +88,8 @@ static void alsa_worker_thread(void *data)
    }
 
 end:
-   slock_lock(alsa->cond_lock);
    alsa->thread_dead = true;
-   scond_signal(alsa->cond);
-   slock_unlock(alsa->cond_lock);
+   spsc_queue_wake(alsa->buffer);
    free(buf);
 }
 
@@ -129,19 +119,11 @@ static void alsa_thread_free(void *data)
    {
       if (alsa->worker_thread)
       {
-         slock_lock(alsa->cond_lock);
          alsa->thread_dead = true;
-         slock_unlock(alsa->cond_lock);
          sthread_join(alsa->worker_thread);
       }
       if (alsa->buffer)
-         fifo_free(alsa->buffer);
-      if (alsa->cond)
-         scond_free(alsa->cond);
-      if (alsa->fifo_lock)
-         slock_free(alsa->fifo_lock);
-      if (alsa->cond_lock)
-         slock_free(alsa->cond_lock);
+         spsc_queue_free(alsa->buffer);
       if (alsa->pcm)
       {
          snd_pcm_drop(alsa->pcm);
@@ -213,11 +195,8 @@ static void *alsa_thread_init(const char *device,
    snd_pcm_hw_params_free(params);
    snd_pcm_sw_params_free(sw_params);
 
-   alsa->fifo_lock = slock_new();
-   alsa->cond_lock = slock_new();
-   alsa->cond = scond_new();
-   alsa->buffer = fifo_new(alsa->buffer_size);
-   if (!alsa->fifo_lock || !alsa->cond_lock || !alsa->cond || !alsa->buffer)
+   alsa->buffer = spsc_queue_new(alsa->buffer_size);
+   if (!alsa->buffer)
       goto error;
 
    alsa->worker_thread = sthread_create(alsa_worker_thread, alsa);
@@ -250,44 +229,19 @@ static ssize_t alsa_thread_write(void *data, const void *buf, size_t size)
       return -1;
 
    if (alsa->nonblock)
-   {
-      size_t avail;
-      size_t write_amt;
-
-      slock_lock(alsa->fifo_lock);
-      avail           = FIFO_WRITE_AVAIL(alsa->buffer);
-      write_amt       = MIN(avail, size);
-
-      fifo_write(alsa->buffer, buf, write_amt);
-      slock_unlock(alsa->fifo_lock);
-
-      return write_amt;
-   }
+      return spsc_queue_write(alsa->buffer, buf, size);
    else
    {
       size_t written = 0;
       while (written < size && !alsa->thread_dead)
       {
-         size_t avail;
-         slock_lock(alsa->fifo_lock);
-         avail = FIFO_WRITE_AVAIL(alsa->buffer);
+         size_t write_amt = spsc_queue_write(alsa->buffer,
+               (const char*)buf + written, size - written);
 
-         if (avail == 0)
-         {
-            slock_unlock(alsa->fifo_lock);
-            slock_lock(alsa->cond_lock);
-            if (!alsa->thread_dead)
-               scond_wait(alsa->cond, alsa->cond_lock);
-            slock_unlock(alsa->cond_lock);
-         }
-         else
-         {
-            size_t write_amt = MIN(size - written, avail);
-            fifo_write(alsa->buffer,
-                  (const char*)buf + written, write_amt);
-            slock_unlock(alsa->fifo_lock);
-            written += write_amt;
-         }
+         if (write_amt == 0)
+            spsc_queue_wait_write(alsa->buffer, 1, -1);
+
+         written += write_amt;
       }
       return written;
    }
@@ -328,14 +282,10 @@ static bool alsa_thread_start(void *data, bool is_shutdown)
 static size_t alsa_thread_write_avail(void *data)
 {
    alsa_thread_t *alsa = (alsa_thread_t*)data;
-   size_t val;
 
    if (alsa->thread_dead)
       return 0;
-   slock_lock(alsa->fifo_lock);
-   val = FIFO_WRITE_AVAIL(alsa->buffer);
-   slock_unlock(alsa->fifo_lock);
-   return val;
+   return spsc_queue_write_avail(alsa->buffer);
 }
 
 static size_t alsa_thread_buffer_size(void *data)
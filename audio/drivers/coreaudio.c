@@ -26,8 +26,7 @@
 #include <AudioUnit/AUComponent.h>
 
 #include <boolean.h>
-#include <queues/fifo_queue.h>
-#include <rthreads/rthreads.h>
+#include <queues/spsc_queue.h>
 #include <ks_endianness.h>
 #include <string/stdstring.h>
 
@@ -36,14 +35,12 @@
 
 typedef struct coreaudio
 {
-   slock_t *lock;
-   scond_t *cond;
 #if (defined(__MACH__) && (defined(__ppc__) || defined(__ppc64__)))
    ComponentInstance dev;
 #else
    AudioComponentInstance dev;
 #endif
-   fifo_buffer_t *buffer;
+   spsc_queue_t *buffer;
    size_t buffer_size;
    bool dev_alive;
    bool is_paused;
@@ -72,10 +69,7 @@ static void coreaudio_free(void *data)
    }
 
    if (dev->buffer)
-      fifo_free(dev->buffer);
-
-   slock_free(dev->lock);
-   scond_free(dev->cond);
+      spsc_queue_free(dev->buffer);
 
    free(dev);
 }
@@ -99,25 +93,16 @@ static OSStatus audio_write_cb(void *userdata,
    write_avail = io_data->mBuffers[0].mDataByteSize;
    outbuf      = io_data->mBuffers[0].mData;
 
-   slock_lock(dev->lock);
-
-   if (FIFO_READ_AVAIL(dev->buffer) < write_avail)
+   if (spsc_queue_read_avail(dev->buffer) < write_avail)
    {
       *action_flags = kAudioUnitRenderAction_OutputIsSilence;
 
       /* Seems to be needed. */
       memset(outbuf, 0, write_avail);
-
-      slock_unlock(dev->lock);
-
-      /* Technically possible to deadlock without. */
-      scond_signal(dev->cond);
       return noErr;
    }
 
-   fifo_read(dev->buffer, outbuf, write_avail);
-   slock_unlock(dev->lock);
-   scond_signal(dev->cond);
+   spsc_queue_read(dev->buffer, outbuf, write_avail);
    return noErr;
 }
 
@@ -217,9 +202,6 @@ static void *coreaudio_init(const char *device,
    (void)session_initialized;
    (void)device;
 
-   dev->lock = slock_new();
-   dev->cond = scond_new();
-
 #if TARGET_OS_IOS
    if (!session_initialized)
    {
@@ -320,7 +302,7 @@ static void *coreaudio_init(const char *device,
    fifo_size        *= 2 * sizeof(float);
    dev->buffer_size  = fifo_size;
 
-   dev->buffer       = fifo_new(fifo_size);
+   dev->buffer       = spsc_queue_new(fifo_size);
    if (!dev->buffer)
       goto error;
 
@@ -350,34 +332,23 @@ static ssize_t coreaudio_write(void *data, const void *buf_, size_t size)
    while (size > 0)
 #endif
    {
-      size_t write_avail;
-
-      slock_lock(dev->lock);
+      size_t write_avail = spsc_queue_write(dev->buffer, buf, size);
 
-      write_avail = FIFO_WRITE_AVAIL(dev->buffer);
-      if (write_avail > size)
-         write_avail = size;
-
-      fifo_write(dev->buffer, buf, write_avail);
       buf     += write_avail;
       written += write_avail;
       size    -= write_avail;
 
       if (dev->nonblock)
-      {
-         slock_unlock(dev->lock);
          break;
-      }
 
 #if TARGET_OS_IOS
-      if (write_avail == 0 && !scond_wait_timeout(
-               dev->cond, dev->lock, 3000000))
+      if (write_avail == 0 && !spsc_queue_wait_write(
+               dev->buffer, 1, 3000000))
          g_interrupted = true;
 #else
       if (write_avail == 0)
-         scond_wait(dev->cond, dev->lock);
+         spsc_queue_wait_write(dev->buffer, 1, -1);
 #endif
-      slock_unlock(dev->lock);
    }
 
    return written;
@@ -424,14 +395,8 @@ static bool coreaudio_use_float(void *data)
 
 static size_t coreaudio_write_avail(void *data)
 {
-   size_t avail;
    coreaudio_t *dev = (coreaudio_t*)data;
-
-   slock_lock(dev->lock);
-   avail = FIFO_WRITE_AVAIL(dev->buffer);
-   slock_unlock(dev->lock);
-
-   return avail;
+   return spsc_queue_write_avail(dev->buffer);
 }
 
 static size_t coreaudio_buffer_size(void *data)
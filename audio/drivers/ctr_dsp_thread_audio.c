@@ -16,7 +16,7 @@
 #include <3ds.h>
 #include <string.h>
 #include <malloc.h>
-#include <queues/fifo_queue.h>
+#include <queues/spsc_queue.h>
 #include <rthreads/rthreads.h>
 
 #include "../../KingStation.h"
@@ -24,12 +24,9 @@
 
 typedef struct
 {
-   fifo_buffer_t* fifo;
+   spsc_queue_t* fifo;
    size_t fifo_size;
 
-   slock_t* fifo_lock;
-   scond_t* fifo_avail;
-   scond_t* fifo_done;
    sthread_t* thread;
 
    volatile bool running;
@@ -58,37 +55,27 @@ static void ctr_dsp_audio_loop(void* data)
    while (1)
    {
       size_t buf_avail, avail, to_write;
-      slock_lock(ctr->fifo_lock);
 
-      do {
-         avail = FIFO_READ_AVAIL(ctr->fifo);
-
-         if (!avail) {
-            scond_wait(ctr->fifo_avail, ctr->fifo_lock);
-         }
-      } while (!avail && ctr->running);
-
-      slock_unlock(ctr->fifo_lock);
+      /* Returns early once ctr_dsp_thread_audio_free()
+       * has woken the queue up */
+      spsc_queue_wait_read(ctr->fifo, 1, -1);
 
       if (!ctr->running)
          break;
 
+      avail = spsc_queue_read_avail(ctr->fifo);
+
       pos = ctr->pos;
       buf_pos = DSP_SAMPLES_TO_BYTES(ndspChnGetSamplePos(ctr->channel));
 
       buf_avail = buf_pos >= pos ? buf_pos - pos : ctr->fifo_size - pos;
       to_write = MIN(avail, buf_avail);
 
-      slock_lock(ctr->fifo_lock);
-
       if (to_write > 0) {
-         fifo_read(ctr->fifo, ctr->dsp_buf.data_pcm8 + pos, to_write);
+         spsc_queue_read(ctr->fifo, ctr->dsp_buf.data_pcm8 + pos, to_write);
          DSP_FlushDataCache(ctr->dsp_buf.data_pcm8 + pos, to_write);
-         scond_signal(ctr->fifo_done);
       }
 
-      slock_unlock(ctr->fifo_lock);
-
       if (buf_pos == pos) {
          svcSleepThread(100000);
       }
@@ -140,11 +127,7 @@ static void *ctr_dsp_thread_audio_init(const char *device, unsigned rate, unsign
    ctr->dsp_buf.nsamples = DSP_BYTES_TO_SAMPLES(ctr->fifo_size);
    ndspChnWaveBufAdd(ctr->channel, &ctr->dsp_buf);
 
-   ctr->fifo = fifo_new(ctr->fifo_size);
-
-   if (!(ctr->fifo_lock = slock_new()) ||
-       !(ctr->fifo_avail = scond_new()) ||
-       !(ctr->fifo_done = scond_new()) ||
+   if (!(ctr->fifo = spsc_queue_new(ctr->fifo_size)) ||
        !(ctr->thread = sthread_create(ctr_dsp_audio_loop, ctr)))
    {
       KINGSN_LOG("[Audio]: thread creation failed.\n");
@@ -172,19 +155,16 @@ static void ctr_dsp_thread_audio_free(void *data)
    if (ctr->running)
    {
       ctr->running = false;
-      scond_signal(ctr->fifo_avail);
+      if (ctr->fifo)
+         spsc_queue_wake(ctr->fifo);
    }
 
    if (ctr->thread)
       sthread_join(ctr->thread);
 
-   scond_free(ctr->fifo_avail);
-   scond_free(ctr->fifo_done);
-   slock_free(ctr->fifo_lock);
-
    if (ctr->fifo)
    {
-      fifo_free(ctr->fifo);
+      spsc_queue_free(ctr->fifo);
       ctr->fifo = NULL;
    }
 
@@ -199,51 +179,27 @@ static void ctr_dsp_thread_audio_free(void *data)
 
 static ssize_t ctr_dsp_thread_audio_write(void *data, const void *buf, size_t size)
 {
-   size_t avail, written;
+   size_t written;
    ctr_dsp_thread_audio_t * ctr = (ctr_dsp_thread_audio_t*)data;
 
    if (!ctr || !ctr->running)
       return 0;
 
    if (ctr->nonblocking)
-   {
-      slock_lock(ctr->fifo_lock);
-      avail = FIFO_WRITE_AVAIL(ctr->fifo);
-      written = MIN(avail, size);
-      if (written > 0)
-      {
-         fifo_write(ctr->fifo, buf, written);
-         scond_signal(ctr->fifo_avail);
-      }
-      slock_unlock(ctr->fifo_lock);
-   }
+      written = spsc_queue_write(ctr->fifo, buf, size);
    else
    {
       written = 0;
       while (written < size && ctr->running)
       {
-         slock_lock(ctr->fifo_lock);
-         avail = FIFO_WRITE_AVAIL(ctr->fifo);
-         if (avail == 0)
-         {
-            if (ctr->running)
-            {
-               /* Wait a maximum of one frame, skip the write if the thread is still busy */
-               if (!scond_wait_timeout(ctr->fifo_done, ctr->fifo_lock, ctr->frame_time)) {
-                  slock_unlock(ctr->fifo_lock);
-                  break;
-               }
-            }
-            slock_unlock(ctr->fifo_lock);
-         }
-         else
-         {
-            size_t write_amt = MIN(size - written, avail);
-            fifo_write(ctr->fifo, (const char*)buf + written, write_amt);
-            scond_signal(ctr->fifo_avail);
-            slock_unlock(ctr->fifo_lock);
-            written += write_amt;
-         }
+         size_t write_amt = spsc_queue_write(ctr->fifo,
+               (const char*)buf + written, size - written);
+
+         /* Wait a maximum of one frame, skip the write if the thread is still busy */
+         if (write_amt == 0 && !spsc_queue_wait_write(ctr->fifo, 1, ctr->frame_time))
+            break;
+
+         written += write_amt;
       }
    }
 
@@ -306,14 +262,8 @@ static bool ctr_dsp_thread_audio_use_float(void *data)
 
 static size_t ctr_dsp_thread_audio_write_avail(void *data)
 {
-   size_t val;
    ctr_dsp_thread_audio_t* ctr = (ctr_dsp_thread_audio_t*)data;
-
-   slock_lock(ctr->fifo_lock);
-   val = FIFO_WRITE_AVAIL(ctr->fifo);
-   slock_unlock(ctr->fifo_lock);
-
-   return val;
+   return spsc_queue_write_avail(ctr->fifo);
 }
 
 static size_t ctr_dsp_thread_audio_buffer_size(void *data)
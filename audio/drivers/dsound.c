@@ -36,7 +36,7 @@
 #include <rthreads/rthreads.h>
 #endif
 #include <lists/string_list.h>
-#include <queues/fifo_queue.h>
+#include <queues/spsc_queue.h>
 #include <string/stdstring.h>
 
 #include "../../KingStation.h"
@@ -58,8 +58,7 @@ typedef struct dsound
    LPDIRECTSOUND ds;
    LPDIRECTSOUNDBUFFER dsb;
 
-   fifo_buffer_t *buffer;
-   CRITICAL_SECTION crit;
+   spsc_queue_t *buffer;
 
    HANDLE      event;
 #ifdef HAVE_THREADS
@@ -154,9 +153,7 @@ static DWORD CALLBACK dsound_thread(PVOID data)
       IDirectSoundBuffer_GetCurrentPosition(ds->dsb, &read_ptr, NULL);
       avail = write_avail(read_ptr, write_ptr, ds->buffer_size);
 
-      EnterCriticalSection(&ds->crit);
-      fifo_avail = FIFO_READ_AVAIL(ds->buffer);
-      LeaveCriticalSection(&ds->crit);
+      fifo_avail = spsc_queue_read_avail(ds->buffer);
 
       if (avail < CHUNK_SIZE || ((fifo_avail < CHUNK_SIZE) && (avail < ds->buffer_size / 2)))
       {
@@ -193,12 +190,10 @@ static DWORD CALLBACK dsound_thread(PVOID data)
       {
          /* All is good. Pull from it and notify FIFO. */
 
-         EnterCriticalSection(&ds->crit);
          if (region.chunk1)
-            fifo_read(ds->buffer, region.chunk1, region.size1);
+            spsc_queue_read(ds->buffer, region.chunk1, region.size1);
          if (region.chunk2)
-            fifo_read(ds->buffer, region.chunk2, region.size2);
-         LeaveCriticalSection(&ds->crit);
+            spsc_queue_read(ds->buffer, region.chunk2, region.size2);
 
          is_pull = true;
       }
@@ -283,7 +278,6 @@ static void dsound_free(void *data)
 #endif
    }
 
-   DeleteCriticalSection(&ds->crit);
 
    if (ds->dsb)
    {
@@ -298,7 +292,7 @@ static void dsound_free(void *data)
       CloseHandle(ds->event);
 
    if (ds->buffer)
-      fifo_free(ds->buffer);
+      spsc_queue_free(ds->buffer);
 
    free(ds);
 }
@@ -356,8 +350,6 @@ static void *dsound_init(const char *dev, unsigned rate, unsigned latency,
    if (!ds)
       goto error;
 
-   InitializeCriticalSection(&ds->crit);
-
    if (dev)
    {
        /* Search for device name first */
@@ -427,7 +419,7 @@ static void *dsound_init(const char *dev, unsigned rate, unsigned latency,
    if (!ds->event)
       goto error;
 
-   ds->buffer = fifo_new(4 * 1024);
+   ds->buffer = spsc_queue_new(4 * 1024);
    if (!ds->buffer)
       goto error;
 
@@ -509,15 +501,7 @@ static ssize_t dsound_write(void *data, const void *buf_, size_t size)
    {
       if (size > 0)
       {
-         size_t avail;
-
-         EnterCriticalSection(&ds->crit);
-         avail = FIFO_WRITE_AVAIL(ds->buffer);
-         if (avail > size)
-            avail = size;
-
-         fifo_write(ds->buffer, buf, avail);
-         LeaveCriticalSection(&ds->crit);
+         size_t avail = spsc_queue_write(ds->buffer, buf, size);
 
          buf     += avail;
          size    -= avail;
@@ -528,15 +512,7 @@ static ssize_t dsound_write(void *data, const void *buf_, size_t size)
    {
       while (size > 0)
       {
-         size_t avail;
-
-         EnterCriticalSection(&ds->crit);
-         avail = FIFO_WRITE_AVAIL(ds->buffer);
-         if (avail > size)
-            avail = size;
-
-         fifo_write(ds->buffer, buf, avail);
-         LeaveCriticalSection(&ds->crit);
+         size_t avail = spsc_queue_write(ds->buffer, buf, size);
 
          buf     += avail;
          size    -= avail;
@@ -555,13 +531,8 @@ static ssize_t dsound_write(void *data, const void *buf_, size_t size)
 
 static size_t dsound_write_avail(void *data)
 {
-   size_t avail;
    dsound_t *ds = (dsound_t*)data;
-
-   EnterCriticalSection(&ds->crit);
-   avail = FIFO_WRITE_AVAIL(ds->buffer);
-   LeaveCriticalSection(&ds->crit);
-   return avail;
+   return spsc_queue_write_avail(ds->buffer);
 }
 
 static size_t dsound_buffer_size(void *data) { return 4 * 1024; }
@@ -17,7 +17,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include <queues/fifo_queue.h>
+#include <queues/spsc_queue.h>
 
 #include "../../KingStation.h"
 
@@ -28,9 +28,8 @@
 
 typedef struct
 {
-   fifo_buffer_t *buffer;
+   spsc_queue_t *buffer;
    sys_ppu_thread_t thread;
-   sys_lwmutex_t lock;
    sys_lwmutex_t cond_lock;
    sys_lwcond_t cond;
    uint32_t audio_port;
@@ -60,12 +59,10 @@ static void event_loop(uint64_t data)
    {
       sysEventQueueReceive(id, &event, PS3_SYS_NO_TIMEOUT);
 
-      sysLwMutexLock(&aud->lock, PS3_SYS_NO_TIMEOUT);
-      if (FIFO_READ_AVAIL(aud->buffer) >= sizeof(out_tmp))
-         fifo_read(aud->buffer, out_tmp, sizeof(out_tmp));
+      if (spsc_queue_read_avail(aud->buffer) >= sizeof(out_tmp))
+         spsc_queue_read(aud->buffer, out_tmp, sizeof(out_tmp));
       else
          memset(out_tmp, 0, sizeof(out_tmp));
-      sysLwMutexUnlock(&aud->lock);
       sysLwCondSignal(&aud->cond);
 
       audioAddData(aud->audio_port, out_tmp,
@@ -84,17 +81,13 @@ static void *ps3_audio_init(const char *device,
    audioPortParam params;
    ps3_audio_t *data                 = NULL;
 #ifdef __PSL1GHT__
-   sys_lwmutex_attr_t lock_attr      =
-   {SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, "\0"};
    sys_lwmutex_attr_t cond_lock_attr =
    {SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, "\0"};
    sys_lwcond_attr_t cond_attr       = {"\0"};
 #else
-   sys_lwmutex_attr_t lock_attr;
    sys_lwmutex_attr_t cond_lock_attr;
    sys_lwcond_attr_t cond_attr;
 
-   sys_lwmutex_attribute_initialize(lock_attr);
    sys_lwmutex_attribute_initialize(cond_lock_attr);
    sys_lwcond_attribute_initialize(cond_attr);
 #endif
@@ -122,10 +115,19 @@ static void *ps3_audio_init(const char *device,
       return NULL;
    }
 
-   data->buffer = fifo_new(AUDIO_BLOCK_SAMPLES *
+   /* Written by the main thread and read by the event
+    * loop only, so the queue needs no lock of its own */
+   data->buffer = spsc_queue_new(AUDIO_BLOCK_SAMPLES *
          AUDIO_CHANNELS * AUDIO_BLOCKS * sizeof(float));
 
-   sysLwMutexCreate(&data->lock, &lock_attr);
+   if (!data->buffer)
+   {
+      audioPortClose(data->audio_port);
+      audioQuit();
+      free(data);
+      return NULL;
+   }
+
    sysLwMutexCreate(&data->cond_lock, &cond_lock_attr);
    sysLwCondCreate(&data->cond, &data->cond_lock, &cond_attr);
 
@@ -148,16 +150,14 @@ static ssize_t ps3_audio_write(void *data, const void *buf, size_t size)
 
    if (aud->nonblock)
    {
-      if (FIFO_WRITE_AVAIL(aud->buffer) < size)
+      if (spsc_queue_write_avail(aud->buffer) < size)
          return 0;
    }
 
-   while (FIFO_WRITE_AVAIL(aud->buffer) < size)
+   while (spsc_queue_write_avail(aud->buffer) < size)
       sysLwCondWait(&aud->cond, 0);
 
-   sysLwMutexLock(&aud->lock, PS3_SYS_NO_TIMEOUT);
-   fifo_write(aud->buffer, buf, size);
-   sysLwMutexUnlock(&aud->lock);
+   spsc_queue_write(aud->buffer, buf, size);
 
    return size;
 }
@@ -211,9 +211,8 @@ static void ps3_audio_free(void *data)
    ps3_audio_stop(aud);
    audioPortClose(aud->audio_port);
    audioQuit();
-   fifo_free(aud->buffer);
+   spsc_queue_free(aud->buffer);
 
-   sysLwMutexDestroy(&aud->lock);
    sysLwMutexDestroy(&aud->cond_lock);
    sysLwCondDestroy(&aud->cond);
 
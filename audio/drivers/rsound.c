@@ -18,8 +18,7 @@
 
 #include <boolean.h>
 
-#include <queues/fifo_queue.h>
-#include <rthreads/rthreads.h>
+#include <queues/spsc_queue.h>
 
 #include "../../KingStation.h"
 #include "rsound.h"
@@ -28,9 +27,7 @@ typedef struct rsd
 {
    rsound_t *rd;
 
-   fifo_buffer_t *buffer;
-   slock_t *cond_lock;
-   scond_t *cond;
+   spsc_queue_t *buffer;
 
    bool nonblock;
    bool is_paused;
@@ -39,20 +36,16 @@ typedef struct rsd
 
 static ssize_t rsound_audio_cb(void *data, size_t bytes, void *userdata)
 {
-   rsd_t *rsd        = (rsd_t*)userdata;
-   size_t avail      = FIFO_READ_AVAIL(rsd->buffer);
-   size_t write_size = bytes > avail ? avail : bytes;
-   fifo_read(rsd->buffer, data, write_size);
-   scond_signal(rsd->cond);
+   rsd_t *rsd = (rsd_t*)userdata;
 
-   return write_size;
+   return spsc_queue_read(rsd->buffer, data, bytes);
 }
 
 static void err_cb(void *userdata)
 {
    rsd_t *rsd = (rsd_t*)userdata;
    rsd->has_error = true;
-   scond_signal(rsd->cond);
+   spsc_queue_wake(rsd->buffer);
 }
 
 static void *rs_init(const char *device, unsigned rate, unsigned latency,
@@ -68,10 +61,11 @@ static void *rs_init(const char *device, unsigned rate, unsigned latency,
    if (rsd_init(&rd) < 0)
       goto error;
 
-   rsd->cond_lock = slock_new();
-   rsd->cond      = scond_new();
-
-   rsd->buffer    = fifo_new(1024 * 4);
+   if (!(rsd->buffer = spsc_queue_new(1024 * 4)))
+   {
+      free(rsd);
+      goto error;
+   }
 
    channels       = 2;
    format         = RSD_S16_NE;
@@ -89,6 +83,7 @@ static void *rs_init(const char *device, unsigned rate, unsigned latency,
 
    if (rsd_start(rd) < 0)
    {
+      spsc_queue_free(rsd->buffer);
       free(rsd);
       goto error;
    }
@@ -109,45 +104,20 @@ static ssize_t rs_write(void *data, const void *buf, size_t size)
       return -1;
 
    if (rsd->nonblock)
-   {
-      size_t avail, write_amt;
-
-      rsd_callback_lock(rsd->rd);
-
-      avail     = FIFO_WRITE_AVAIL(rsd->buffer);
-      write_amt = avail > size ? size : avail;
-
-      fifo_write(rsd->buffer, buf, write_amt);
-      rsd_callback_unlock(rsd->rd);
-      return write_amt;
-   }
+      return spsc_queue_write(rsd->buffer, buf, size);
    else
    {
       size_t written = 0;
       while (written < size && !rsd->has_error)
       {
-         size_t avail;
-         rsd_callback_lock(rsd->rd);
-
-         avail = FIFO_WRITE_AVAIL(rsd->buffer);
-
-         if (avail == 0)
-         {
-            rsd_callback_unlock(rsd->rd);
-            if (!rsd->has_error)
-            {
-               slock_lock(rsd->cond_lock);
-               scond_wait(rsd->cond, rsd->cond_lock);
-               slock_unlock(rsd->cond_lock);
-            }
-         }
-         else
-         {
-            size_t write_amt = size - written > avail ? avail : size - written;
-            fifo_write(rsd->buffer, (const char*)buf + written, write_amt);
-            rsd_callback_unlock(rsd->rd);
-            written += write_amt;
-         }
+         size_t write_amt = spsc_queue_write(rsd->buffer,
+               (const char*)buf + written, size - written);
+
+         /* err_cb() wakes us up if the stream dies */
+         if (write_amt == 0)
+            spsc_queue_wait_write(rsd->buffer, 1, -1);
+
+         written += write_amt;
       }
       return written;
    }
@@ -193,24 +163,18 @@ static void rs_free(void *data)
    rsd_stop(rsd->rd);
    rsd_free(rsd->rd);
 
-   fifo_free(rsd->buffer);
-   slock_free(rsd->cond_lock);
-   scond_free(rsd->cond);
+   spsc_queue_free(rsd->buffer);
 
    free(rsd);
 }
 
 static size_t rs_write_avail(void *data)
 {
-   size_t val;
    rsd_t *rsd = (rsd_t*)data;
 
    if (rsd->has_error)
       return 0;
-   rsd_callback_lock(rsd->rd);
-   val = FIFO_WRITE_AVAIL(rsd->buffer);
-   rsd_callback_unlock(rsd->rd);
-   return val;
+   return spsc_queue_write_avail(rsd->buffer);
 }
 
 static size_t rs_buffer_size(void *data)
@@ -20,8 +20,7 @@
 #include <string.h>
 
 #include <boolean.h>
-#include <rthreads/rthreads.h>
-#include <queues/fifo_queue.h>
+#include <queues/spsc_queue.h>
 #include <ks_inline.h>
 #include <ks_math.h>
 
@@ -33,11 +32,7 @@
 
 typedef struct sdl_audio
 {
-#ifdef HAVE_THREADS
-   slock_t *lock;
-   scond_t *cond;
-#endif
-   fifo_buffer_t *buffer;
+   spsc_queue_t *buffer;
    bool nonblock;
    bool is_paused;
 } sdl_audio_t;
@@ -45,13 +40,7 @@ typedef struct sdl_audio
 static void sdl_audio_cb(void *data, Uint8 *stream, int len)
 {
    sdl_audio_t  *sdl = (sdl_audio_t*)data;
-   size_t      avail = FIFO_READ_AVAIL(sdl->buffer);
-   size_t write_size = len > (int)avail ? avail : len;
-
-   fifo_read(sdl->buffer, stream, write_size);
-#ifdef HAVE_THREADS
-   scond_signal(sdl->cond);
-#endif
+   size_t write_size = spsc_queue_read(sdl->buffer, stream, len);
 
    /* If underrun, fill rest with silence. */
    memset(stream + write_size, 0, len - write_size);
@@ -113,22 +102,24 @@ static void *sdl_audio_init(const char *device,
 
    *new_rate                = out.freq;
 
-#ifdef HAVE_THREADS
-   sdl->lock                = slock_new();
-   sdl->cond                = scond_new();
-#endif
-
    KINGSN_LOG("[SDL audio]: Requested %u ms latency, got %d ms\n",
          latency, (int)(out.samples * 4 * 1000 / (*new_rate)));
 
    /* Create a buffer twice as big as needed and prefill the buffer. */
    bufsize     = out.samples * 4 * sizeof(int16_t);
    tmp         = calloc(1, bufsize);
-   sdl->buffer = fifo_new(bufsize);
+   sdl->buffer = spsc_queue_new(bufsize);
+
+   if (!sdl->buffer)
+   {
+      free(tmp);
+      SDL_CloseAudio();
+      goto error;
+   }
 
    if (tmp)
    {
-      fifo_write(sdl->buffer, tmp, bufsize);
+      spsc_queue_write(sdl->buffer, tmp, bufsize);
       free(tmp);
    }
 
@@ -146,43 +137,20 @@ static ssize_t sdl_audio_write(void *data, const void *buf, size_t size)
    sdl_audio_t *sdl = (sdl_audio_t*)data;
 
    if (sdl->nonblock)
-   {
-      size_t avail, write_amt;
-
-      SDL_LockAudio();
-      avail = FIFO_WRITE_AVAIL(sdl->buffer);
-      write_amt = avail > size ? size : avail;
-      fifo_write(sdl->buffer, buf, write_amt);
-      SDL_UnlockAudio();
-      ret = write_amt;
-   }
+      ret = spsc_queue_write(sdl->buffer, buf, size);
    else
    {
       size_t written = 0;
 
       while (written < size)
       {
-         size_t avail;
-
-         SDL_LockAudio();
-         avail = FIFO_WRITE_AVAIL(sdl->buffer);
-
-         if (avail == 0)
-         {
-            SDL_UnlockAudio();
-#ifdef HAVE_THREADS
-            slock_lock(sdl->lock);
-            scond_wait(sdl->cond, sdl->lock);
-            slock_unlock(sdl->lock);
-#endif
-         }
-         else
-         {
-            size_t write_amt = size - written > avail ? avail : size - written;
-            fifo_write(sdl->buffer, (const char*)buf + written, write_amt);
-            SDL_UnlockAudio();
-            written += write_amt;
-         }
+         size_t write_amt = spsc_queue_write(sdl->buffer,
+               (const char*)buf + written, size - written);
+
+         if (write_amt == 0)
+            spsc_queue_wait_write(sdl->buffer, 1, -1);
+
+         written += write_amt;
       }
       ret = written;
    }
@@ -230,13 +198,7 @@ static void sdl_audio_free(void *data)
    SDL_QuitSubSystem(SDL_INIT_AUDIO);
 
    if (sdl)
-   {
-      fifo_free(sdl->buffer);
-#ifdef HAVE_THREADS
-      slock_free(sdl->lock);
-      scond_free(sdl->cond);
-#endif
-   }
+      spsc_queue_free(sdl->buffer);
    free(sdl);
 }
 
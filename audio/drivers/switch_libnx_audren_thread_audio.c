@@ -20,7 +20,7 @@
 
 #include <switch.h>
 
-#include <queues/fifo_queue.h>
+#include <queues/spsc_queue.h>
 #include "../../KingStation.h"
 #include "../../verbosity.h"
 #include "../../tasks/tasks_internal.h"
@@ -52,8 +52,7 @@ typedef struct
    size_t samples;
    bool nonblock;
 
-   fifo_buffer_t* fifo;
-   Mutex fifo_lock;
+   spsc_queue_t* fifo;
    CondVar fifo_condvar;
    Mutex fifo_condlock;
    Thread thread;
@@ -95,17 +94,19 @@ static void thread_job(void* data)
 
       if (current_wavebuf)
       {
-         mutexLock(&aud->fifo_lock);
-         available = aud->paused ? 0 : FIFO_READ_AVAIL(aud->fifo);
+         available = aud->paused ? 0 : spsc_queue_read_avail(aud->fifo);
          written_tmp = MIN(available, aud->buffer_size - current_size);
          dstbuf = current_pool_ptr + current_size;
          if (written_tmp > 0)
-            fifo_read(aud->fifo, dstbuf, written_tmp);
-         mutexUnlock(&aud->fifo_lock);
+            spsc_queue_read(aud->fifo, dstbuf, written_tmp);
 
          if (written_tmp > 0)
          {
+            /* Under the lock, so a writer that just found
+             * the queue full cannot miss the wakeup */
+            mutexLock(&aud->fifo_condlock);
             condvarWakeAll(&aud->fifo_condvar);
+            mutexUnlock(&aud->fifo_condlock);
 
             current_size += written_tmp;
             armDCacheFlush(dstbuf, written_tmp);
@@ -219,14 +220,13 @@ static void *libnx_audren_thread_audio_init(const char *device, unsigned rate, u
       }
    }
 
-   aud->fifo = fifo_new(aud->buffer_size);
+   aud->fifo = spsc_queue_new(aud->buffer_size);
    if (!aud->fifo)
    {
       KINGSN_ERR("[Audio]: fifo alloc failed\n");
       goto fail_drv;
    }
 
-   mutexInit(&aud->fifo_lock);
    condvarInit(&aud->fifo_condvar);
    mutexInit(&aud->fifo_condlock);
 
@@ -284,7 +284,7 @@ static ssize_t libnx_audren_thread_audio_write(void *data,
       const void *buf, size_t size)
 {
    libnx_audren_thread_t *aud = (libnx_audren_thread_t*)data;
-   size_t available, written, written_tmp;
+   size_t written, written_tmp;
 
    if (!aud || !aud->running)
       return -1;
@@ -293,33 +293,21 @@ static ssize_t libnx_audren_thread_audio_write(void *data,
       return 0;
 
    if (aud->nonblock)
-   {
-      mutexLock(&aud->fifo_lock);
-      available = FIFO_WRITE_AVAIL(aud->fifo);
-      written = MIN(available, size);
-      if (written > 0)
-         fifo_write(aud->fifo, buf, written);
-      mutexUnlock(&aud->fifo_lock);
-   }
+      written = spsc_queue_write(aud->fifo, buf, size);
    else
    {
       written = 0;
       while (written < size && aud->running)
       {
-         mutexLock(&aud->fifo_lock);
-         available = FIFO_WRITE_AVAIL(aud->fifo);
-         if (available)
-         {
-            written_tmp = MIN(size - written, available);
-            fifo_write(aud->fifo, (const char*)buf + written, written_tmp);
-            mutexUnlock(&aud->fifo_lock);
-            written += written_tmp;
-         }
-         else
+         written_tmp = spsc_queue_write(aud->fifo,
+               (const char*)buf + written, size - written);
+         written    += written_tmp;
+
+         if (!written_tmp)
          {
-            mutexUnlock(&aud->fifo_lock);
             mutexLock(&aud->fifo_condlock);
-            condvarWait(&aud->fifo_condvar, &aud->fifo_condlock);
+            if (aud->running && !spsc_queue_write_avail(aud->fifo))
+               condvarWait(&aud->fifo_condvar, &aud->fifo_condlock);
             mutexUnlock(&aud->fifo_condlock);
          }
       }
@@ -371,7 +359,9 @@ static void libnx_audren_thread_audio_free(void *data)
       return;
 
    aud->running = false;
-   mutexUnlock(&aud->fifo_lock);
+   mutexLock(&aud->fifo_condlock);
+   condvarWakeAll(&aud->fifo_condvar);
+   mutexUnlock(&aud->fifo_condlock);
    threadWaitForExit(&aud->thread);
    threadClose(&aud->thread);
    audrvVoiceStop(&aud->drv, 0);
@@ -384,10 +374,7 @@ static void libnx_audren_thread_audio_free(void *data)
    }
 
    if (aud->fifo)
-   {
-      fifo_clear(aud->fifo);
-      fifo_free(aud->fifo);
-   }
+      spsc_queue_free(aud->fifo);
 
    free(aud);
 }
@@ -401,16 +388,11 @@ static bool libnx_audren_thread_audio_use_float(void *data)
 static size_t libnx_audren_thread_audio_write_avail(void *data)
 {
    libnx_audren_thread_t *aud = (libnx_audren_thread_t*)data;
-   size_t available;
 
    if (!aud)
       return 0;
 
-   mutexLock(&aud->fifo_lock);
-   available = FIFO_WRITE_AVAIL(aud->fifo);
-   mutexUnlock(&aud->fifo_lock);
-
-   return available;
+   return spsc_queue_write_avail(aud->fifo);
 }
 
 static void libnx_audren_thread_audio_set_nonblock_state(void *data, bool state)
@@ -27,7 +27,7 @@
 #include <libtransistor/nx.h>
 #endif
 
-#include <queues/fifo_queue.h>
+#include <queues/spsc_queue.h>
 #include "../../KingStation.h"
 #include "../../verbosity.h"
 
@@ -43,8 +43,7 @@
 
 typedef struct
 {
-   fifo_buffer_t* fifo;
-   compat_mutex fifoLock;
+   spsc_queue_t* fifo;
    compat_condvar cond;
    compat_mutex condLock;
 
@@ -80,7 +79,8 @@ static void mainLoop(void* data)
 
    while (swa->running)
    {
-      size_t buf_avail, avail, to_write;
+      size_t buf_avail, to_write;
+      uint8_t *base;
 
       if (!released_out_buffer)
       {
@@ -104,22 +104,14 @@ static void mainLoop(void* data)
 
       buf_avail = released_out_buffer->buffer_size - released_out_buffer->data_size;
 
-      compat_mutex_lock(&swa->fifoLock);
-
-      avail    = FIFO_READ_AVAIL(swa->fifo);
-      to_write = MIN(avail, buf_avail);
-      if (to_write > 0)
-      {
-	      uint8_t *base;
 #ifdef HAVE_LIBNX
-	      base = (uint8_t*) released_out_buffer->buffer;
+      base     = (uint8_t*) released_out_buffer->buffer;
 #else
-	      base = (uint8_t*) released_out_buffer->sample_data;
+      base     = (uint8_t*) released_out_buffer->sample_data;
 #endif
-         fifo_read(swa->fifo, base + released_out_buffer->data_size, to_write);
-      }
+      to_write = spsc_queue_read(swa->fifo,
+            base + released_out_buffer->data_size, buf_avail);
 
-      compat_mutex_unlock(&swa->fifoLock);
       compat_condvar_wake_all(&swa->cond);
 
       released_out_buffer->data_size += to_write;
@@ -238,8 +230,9 @@ static void *switch_thread_audio_init(const char *device, unsigned rate, unsigne
          goto fail_audio_output;
    }
 
-   compat_mutex_create(&swa->fifoLock);
-   swa->fifo = fifo_new(swa->fifoSize);
+   swa->fifo = spsc_queue_new(swa->fifoSize);
+   if (!swa->fifo)
+      goto fail_audio_output;
 
    compat_condvar_create(&swa->cond);
 
@@ -320,7 +313,7 @@ static void switch_thread_audio_free(void *data)
 
    if (swa->fifo)
    {
-         fifo_free(swa->fifo);
+         spsc_queue_free(swa->fifo);
          swa->fifo = NULL;
    }
 
@@ -339,43 +332,31 @@ static void switch_thread_audio_free(void *data)
 
 static ssize_t switch_thread_audio_write(void *data, const void *buf, size_t size)
 {
-   size_t avail, written;
+   size_t written;
    switch_thread_audio_t *swa = (switch_thread_audio_t *)data;
 
    if (!swa || !swa->running)
          return 0;
 
    if (swa->nonblock)
-   {
-      compat_mutex_lock(&swa->fifoLock);
-      avail = FIFO_WRITE_AVAIL(swa->fifo);
-      written = MIN(avail, size);
-      if (written > 0)
-         fifo_write(swa->fifo, buf, written);
-      compat_mutex_unlock(&swa->fifoLock);
-   }
+      written = spsc_queue_write(swa->fifo, buf, size);
    else
    {
       written = 0;
       while (written < size && swa->running)
       {
-         compat_mutex_lock(&swa->fifoLock);
-         avail = FIFO_WRITE_AVAIL(swa->fifo);
-         if (avail == 0)
+         size_t write_amt = spsc_queue_write(swa->fifo,
+               (const char*)buf + written, size - written);
+
+         if (write_amt == 0)
          {
-            compat_mutex_unlock(&swa->fifoLock);
             compat_mutex_lock(&swa->condLock);
             if (swa->running)
                compat_condvar_wait(&swa->cond, &swa->condLock);
             compat_mutex_unlock(&swa->condLock);
          }
-         else
-         {
-            size_t write_amt = MIN(size - written, avail);
-            fifo_write(swa->fifo, (const char*)buf + written, write_amt);
-            compat_mutex_unlock(&swa->fifoLock);
-            written += write_amt;
-         }
+
+         written += write_amt;
       }
    }
 
@@ -408,14 +389,8 @@ static bool switch_thread_audio_use_float(void *data)
 
 static size_t switch_thread_audio_write_avail(void *data)
 {
-   size_t val;
    switch_thread_audio_t* swa = (switch_thread_audio_t*)data;
-
-   compat_mutex_lock(&swa->fifoLock);
-   val = FIFO_WRITE_AVAIL(swa->fifo);
-   compat_mutex_unlock(&swa->fifoLock);
-
-   return val;
+   return spsc_queue_write_avail(swa->fifo);
 }
 
 size_t switch_thread_audio_buffer_size(void *data)
@@ -235,6 +235,11 @@
 #endif
 #define DEFAULT_CHECK_FIRMWARE_BEFORE_LOADING false
 
+/* Keep a compiled copy of all core .info files in
+ * the cache directory, so that they do not have to
+ * be parsed again on every start */
+#define DEFAULT_CORE_INFO_CACHE_ENABLE true
+
 /* Specifies whether to 'reload' (fork and quit)
  * KingStation when launching content with the
  * currently loaded core
@@ -1143,6 +1148,11 @@ static const int default_content_favorites_size = 200;
 
 #define DEFAULT_PLAYLIST_FUZZY_ARCHIVE_MATCH false
 
+/* Keep a binary copy of each playlist next to it,
+ * which is mapped instead of parsing the playlist
+ * while it has not changed */
+#define DEFAULT_PLAYLIST_BINARY_CACHE true
+
 #define DEFAULT_PLAYLIST_PORTABLE_PATHS false
 
 /* Show Menu start-up screen on boot. */
@@ -1239,6 +1249,9 @@ static const unsigned menu_left_thumbnails_default = 0;
 
 static const unsigned gfx_thumbnail_upscale_threshold = 0;
 
+/* Size limit of the thumbnail cache in MB, 0 disables it */
+static const unsigned gfx_thumbnail_cache_size = 64;
+
 #ifdef HAVE_MENU
 #define DEFAULT_MENU_TIMEDATE_STYLE          MENU_TIMEDATE_STYLE_DDMM_HM
 #define DEFAULT_MENU_TIMEDATE_DATE_SEPARATOR MENU_TIMEDATE_DATE_SEPARATOR_HYPHEN
@@ -0,0 +1,202 @@
+#ifndef QB_CONFIG_H__
+#define QB_CONFIG_H__
+
+#define PACKAGE_NAME "KingStation"
+/* #undef HAVE_7ZIP */
+/* #undef HAVE_ACCESSIBILITY */
+/* #undef HAVE_AL */
+/* #undef HAVE_ALSA */
+/* #undef HAVE_ANGLE */
+/* #undef HAVE_AUDIOIO */
+#define HAVE_AUDIOMIXER 1
+/* #undef HAVE_BLISSBOX */
+#define HAVE_BSV_MOVIE 1
+/* #undef HAVE_BUILTINBEARSSL */
+#define HAVE_BUILTINFLAC 1
+#if __cplusplus || __STDC_VERSION__ >= 199901L
+#define HAVE_BUILTINGLSLANG 1
+#endif
+/* #undef HAVE_BUILTINMBEDTLS */
+/* #undef HAVE_BUILTINMINIUPNPC */
+#define HAVE_BUILTINZLIB 1
+#define HAVE_C99 1
+/* #undef HAVE_CACA */
+#define HAVE_CC 1
+#define HAVE_CC_RESAMPLER 1
+/* #undef HAVE_CDROM */
+/* #undef HAVE_CG */
+#ifndef CXX_BUILD
+#define HAVE_CHD 1
+#endif
+/* #undef HAVE_CHEATS */
+/* #undef HAVE_CHEEVOS */
+#define HAVE_COMMAND 1
+#define HAVE_CONFIGFILE 1
+#define HAVE_CXX 1
+#define HAVE_CXX11 1
+/* #undef HAVE_D3D8 */
+/* #undef HAVE_D3D9 */
+/* #undef HAVE_D3DX8 */
+/* #undef HAVE_D3DX9 */
+/* #undef HAVE_DBUS */
+/* #undef HAVE_DEBUG */
+/* #undef HAVE_DINPUT */
+/* #undef HAVE_DISCORD */
+/* #undef HAVE_DISPMANX */
+/* #undef HAVE_DRM */
+/* #undef HAVE_DRMINGW */
+#define HAVE_DR_MP3 1
+/* #undef HAVE_DSOUND */
+#define HAVE_DSP_FILTER 1
+#define HAVE_DYLIB 1
+#define HAVE_DYNAMIC 1
+/* #undef HAVE_DYNAMIC_EGL */
+#define HAVE_EGL 1
+/* #undef HAVE_EXYNOS */
+/* #undef HAVE_FFMPEG */
+/* #undef HAVE_FLAC */
+/* #undef HAVE_FLOATHARD */
+/* #undef HAVE_FLOATSOFTFP */
+#define HAVE_FONTCONFIG 1
+#define HAVE_FREETYPE 1
+/* #undef HAVE_GBM */
+#define HAVE_GDI 1
+#define HAVE_GETOPT_LONG 1
+#define HAVE_GFX_WIDGETS 1
+/* #undef HAVE_GIT_VERSION */
+#define HAVE_GLSL 1
+#if __cplusplus || __STDC_VERSION__ >= 199901L
+#define HAVE_GLSLANG 1
+#endif
+/* #undef HAVE_GLSLANG_HLSL */
+/* #undef HAVE_GLSLANG_OGLCOMPILER */
+/* #undef HAVE_GLSLANG_OSDEPENDENT */
+/* #undef HAVE_GLSLANG_SPIRV */
+/* #undef HAVE_GLSLANG_SPIRV_TOOLS */
+/* #undef HAVE_GLSLANG_SPIRV_TOOLS_OPT */
+/* #undef HAVE_GONG */
+#define HAVE_HID 1
+/* #undef HAVE_HLSL */
+#define HAVE_IBXM 1
+#define HAVE_IMAGEVIEWER 1
+/* #undef HAVE_JACK */
+/* #undef HAVE_KMS */
+#define HAVE_LANGEXTRA 1
+#define HAVE_LIBKSDB 1
+/* #undef HAVE_LIBSHAKE */
+/* #undef HAVE_LIBUSB */
+/* #undef HAVE_LUA */
+/* #undef HAVE_MALI_FBDEV */
+#define HAVE_MENU 1
+/* #undef HAVE_METAL */
+/* #undef HAVE_MINIUPNPC */
+#define HAVE_MMAP 1
+/* #undef HAVE_MOC */
+/* #undef HAVE_MPV */
+#define HAVE_NEAREST_RESAMPLER 1
+/* #undef HAVE_NEON */
+/* #undef HAVE_NETPLAYDISCOVERY */
+/* #undef HAVE_NETPLAYDISCOVERY */
+/* #undef HAVE_NETWORKGAMEPAD */
+/* #undef HAVE_NETWORKING */
+/* #undef HAVE_NETWORK_CMD */
+/* #undef HAVE_NETWORK_VIDEO */
+#define HAVE_NOUNUSED 1
+#define HAVE_NOUNUSED_VARIABLE 1
+#define HAVE_NO_FFMPEG 1
+#define HAVE_NO_QT 1
+#define HAVE_NO_X11 1
+#define HAVE_NVDA 1
+/* #undef HAVE_ODROIDGO2 */
+/* #undef HAVE_OMAP */
+/* #undef HAVE_ONLINE_UPDATER */
+/* #undef HAVE_OPENDINGUX_FBDEV */
+#define HAVE_OPENGL 1
+#define HAVE_OPENGL1 1
+/* #undef HAVE_OPENGLES */
+/* #undef HAVE_OPENGLES3 */
+/* #undef HAVE_OPENGLES3_1 */
+/* #undef HAVE_OPENGLES3_2 */
+#if __cplusplus || __STDC_VERSION__ >= 199901L
+#define HAVE_OPENGL_CORE 1
+#endif
+/* #undef HAVE_OSMESA */
+#define HAVE_OSS 1
+/* #undef HAVE_OSS_BSD */
+/* #undef HAVE_OSS_LIB */
+#define HAVE_OVERLAY 1
+#define HAVE_PARPORT 1
+/* #undef HAVE_PATCH */
+/* #undef HAVE_PLAIN_DRM */
+/* #undef HAVE_PRESERVE_DYLIB */
+/* #undef HAVE_PULSE */
+/* #undef HAVE_QT */
+#define HAVE_RBMP 1
+/* #undef HAVE_REWIND */
+#define HAVE_RJPEG 1
+/* #undef HAVE_ROAR */
+#define HAVE_RPILED 1
+#define HAVE_RPNG 1
+/* #undef HAVE_RSOUND */
+#define HAVE_RTGA 1
+/* #undef HAVE_RUNAHEAD */
+#define HAVE_RWAV 1
+/* #undef HAVE_SAPI */
+/* #undef HAVE_SCREENSHOTS */
+/* #undef HAVE_SDL */
+/* #undef HAVE_SDL2 */
+/* #undef HAVE_SDL_DINGUX */
+#if __cplusplus || __STDC_VERSION__ >= 199901L
+#define HAVE_SHADERPIPELINE 1
+#endif
+/* #undef HAVE_SIXEL */
+#if __cplusplus || __STDC_VERSION__ >= 199901L
+#define HAVE_SLANG 1
+#endif
+#if __cplusplus || __STDC_VERSION__ >= 199901L
+#define HAVE_SPIRV_CROSS 1
+#endif
+/* #undef HAVE_SSA */
+/* #undef HAVE_SSE */
+/* #undef HAVE_SSL */
+#define HAVE_STB_FONT 1
+#define HAVE_STB_IMAGE 1
+#define HAVE_STB_VORBIS 1
+#define HAVE_STDIN_CMD 1
+/* #undef HAVE_STEAM */
+#define HAVE_STRCASESTR 1
+/* #undef HAVE_STRIPES */
+/* #undef HAVE_SUNXI */
+/* #undef HAVE_SYSTEMD */
+/* #undef HAVE_SYSTEMMBEDTLS */
+#define HAVE_THREADS 1
+#define HAVE_THREAD_STORAGE 1
+#define HAVE_TINYALSA 1
+/* #undef HAVE_TRANSLATE */
+/* #undef HAVE_UDEV */
+#define HAVE_UPDATE_ASSETS 1
+#define HAVE_UPDATE_CORES 1
+/* #undef HAVE_V4L2 */
+/* #undef HAVE_VC_TEST */
+/* #undef HAVE_VG */
+/* #undef HAVE_VIDEOCORE */
+/* #undef HAVE_VIDEOPROCESSOR */
+#define HAVE_VIDEO_FILTER 1
+#define HAVE_VIDEO_LAYOUT 1
+/* #undef HAVE_VIVANTE_FBDEV */
+/* #undef HAVE_VULKAN */
+#define HAVE_VULKAN_DISPLAY 1
+/* #undef HAVE_WAYLAND */
+/* #undef HAVE_WAYLAND_CURSOR */
+/* #undef HAVE_WAYLAND_PROTOS */
+/* #undef HAVE_WAYLAND_SCANNER */
+#define HAVE_WINRAWINPUT 1
+/* #undef HAVE_X11 */
+/* #undef HAVE_XINERAMA */
+/* #undef HAVE_XINPUT */
+/* #undef HAVE_XKBCOMMON */
+/* #undef HAVE_XRANDR */
+/* #undef HAVE_XSHM */
+/* #undef HAVE_XVIDEO */
+#define HAVE_ZLIB 1
+#endif
@@ -221,6 +221,7 @@ typedef struct settings
       unsigned gfx_thumbnails;
       unsigned menu_left_thumbnails;
       unsigned gfx_thumbnail_upscale_threshold;
+      unsigned gfx_thumbnail_cache_size;
       unsigned menu_rgui_thumbnail_downscaler;
       unsigned menu_rgui_thumbnail_delay;
       unsigned menu_rgui_color_theme;
@@ -761,6 +762,7 @@ typedef struct settings
       bool network_remote_enable_user[MAX_USERS];
       bool load_dummy_on_core_shutdown;
       bool check_firmware_before_loading;
+      bool core_info_cache_enable;
 #ifndef HAVE_DYNAMIC
       bool always_reload_core_on_run_content;
 #endif
@@ -801,6 +803,7 @@ typedef struct settings
       bool playlist_show_sublabels;
       bool playlist_fuzzy_archive_match;
       bool playlist_portable_paths;
+      bool playlist_binary_cache;
 
       bool quit_press_twice;
       bool vibrate_on_keypress;
@@ -15,7 +15,10 @@
  *  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <array/rbuf.h>
+#include <array/rhmap.h>
 #include <compat/strl.h>
+#include <features/features_cpu.h>
 #include <string/stdstring.h>
 #include <file/config_file.h>
 #include <file/file_path.h>
@@ -30,7 +33,9 @@
 #include "KingStation.h"
 
 #include "core_info.h"
+#include "core_info_cache.h"
 #include "file_path_special.h"
+#include "verbosity.h"
 
 #if defined(__WINRT__) || defined(WINAPI_FAMILY) && WINAPI_FAMILY == WINAPI_FAMILY_PHONE_APP
 #include "uwp/uwp_func.h"
@@ -90,55 +95,99 @@ static void core_info_list_resolve_all_extensions(
 #endif
 }
 
-static void core_info_list_resolve_all_firmware(
-      core_info_list_t *core_info_list)
+static void core_info_resolve_firmware(core_info_t *info,
+      config_file_t *config)
 {
-   size_t i;
    unsigned c;
+   unsigned count                  = 0;
+   core_info_firmware_t *firmware  = NULL;
 
-   for (i = 0; i < core_info_list->count; i++)
+   if (!config_get_uint(config, "firmware_count", &count) || !count)
+      return;
+
+   firmware = (core_info_firmware_t*)calloc(count, sizeof(*firmware));
+
+   if (!firmware)
+      return;
+
+   info->firmware = firmware;
+
+   for (c = 0; c < count; c++)
    {
-      unsigned count                  = 0;
-      core_info_firmware_t *firmware  = NULL;
-      core_info_t *info               = (core_info_t*)&core_info_list->list[i];
-      config_file_t *config           = (config_file_t*)info->config_data;
+      char path_key[64];
+      char desc_key[64];
+      char opt_key[64];
+      struct config_entry_list 
+         *entry         = NULL;
+      bool tmp_bool     = false;
+      path_key[0]       = desc_key[0] = opt_key[0] = '\0';
 
-      if (!config || !config_get_uint(config, "firmware_count", &count))
-         continue;
+      snprintf(path_key, sizeof(path_key), "firmware%u_path", c);
+      snprintf(desc_key, sizeof(desc_key), "firmware%u_desc", c);
+      snprintf(opt_key,  sizeof(opt_key),  "firmware%u_opt",  c);
 
-      firmware = (core_info_firmware_t*)calloc(count, sizeof(*firmware));
+      entry             = config_get_entry(config, path_key);
 
-      if (!firmware)
-         continue;
+      if (entry && !string_is_empty(entry->value))
+         info->firmware[c].path = strdup(entry->value);
+
+      entry             = config_get_entry(config, desc_key);
 
-      info->firmware = firmware;
+      if (entry && !string_is_empty(entry->value))
+         info->firmware[c].desc     = strdup(entry->value);
 
-      for (c = 0; c < count; c++)
+      if (config_get_bool(config, opt_key , &tmp_bool))
+         info->firmware[c].optional = tmp_bool;
+   }
+}
+
+static void core_info_list_resolve_ext_map(
+      core_info_list_t *core_info_list)
+{
+   size_t i, j;
+
+   for (i = 0; i < core_info_list->count; i++)
+   {
+      const core_info_t *info = &core_info_list->list[i];
+
+      if (!info->path || !info->supported_extensions_list)
+         continue;
+
+      for (j = 0; j < info->supported_extensions_list->size; j++)
       {
-         char path_key[64];
-         char desc_key[64];
-         char opt_key[64];
-         struct config_entry_list 
-            *entry         = NULL;
-         bool tmp_bool     = false;
-         path_key[0]       = desc_key[0] = opt_key[0] = '\0';
+         char ext[255];
+         core_info_ext_t *entry = NULL;
+         const char *elem       =
+            info->supported_extensions_list->elems[j].data;
 
-         snprintf(path_key, sizeof(path_key), "firmware%u_path", c);
-         snprintf(desc_key, sizeof(desc_key), "firmware%u_desc", c);
-         snprintf(opt_key,  sizeof(opt_key),  "firmware%u_opt",  c);
+         /* Extensions are matched with or without
+          * a leading dot, and in any case */
+         if (*elem == '.')
+            elem++;
 
-         entry             = config_get_entry(config, path_key);
+         strlcpy(ext, elem, sizeof(ext));
+         string_to_lower(ext);
 
-         if (entry && !string_is_empty(entry->value))
-            info->firmware[c].path = strdup(entry->value);
+         if (!(entry = RHMAP_GET_STR(core_info_list->ext_map, ext)))
+         {
+            if (!(entry = (core_info_ext_t*)calloc(1, sizeof(*entry))))
+               continue;
 
-         entry             = config_get_entry(config, desc_key);
+            if (!(entry->ext = strdup(ext)))
+            {
+               free(entry);
+               continue;
+            }
 
-         if (entry && !string_is_empty(entry->value))
-            info->firmware[c].desc     = strdup(entry->value);
+            RHMAP_SET_STR(core_info_list->ext_map, ext, entry);
+         }
+         else if (!string_is_equal(entry->ext, ext))
+         {
+            core_info_list->ext_map_collision = true;
+            continue;
+         }
 
-         if (config_get_bool(config, opt_key , &tmp_bool))
-            info->firmware[c].optional = tmp_bool;
+         RBUF_PUSH(entry->paths, info->path);
       }
    }
 }
@@ -178,7 +227,6 @@ static void core_info_list_free(core_info_list_t *core_info_list)
       string_list_free(info->categories_list);
       string_list_free(info->databases_list);
       string_list_free(info->required_hw_api_list);
-      config_file_free((config_file_t*)info->config_data);
 
       for (j = 0; j < info->firmware_count; j++)
       {
@@ -190,21 +238,31 @@ static void core_info_list_free(core_info_list_t *core_info_list)
       free(info->core_file_id.str);
    }
 
+   for (i = 0; i < RHMAP_CAP(core_info_list->ext_map); i++)
+   {
+      core_info_ext_t *entry = core_info_list->ext_map[i];
+
+      if (!RHMAP_KEY(core_info_list->ext_map, i))
+         continue;
+
+      free(entry->ext);
+      RBUF_FREE(entry->paths);
+      free(entry);
+   }
+   RHMAP_FREE(core_info_list->ext_map);
+
    free(core_info_list->all_ext);
    free(core_info_list->list);
    free(core_info_list);
 }
 
-static config_file_t *core_info_list_iterate(
+static void core_info_get_info_path(
       const char *current_path,
-      const char *path_basedir)
+      const char *path_basedir,
+      char *info_path, size_t len)
 {
-   char info_path[PATH_MAX_LENGTH];
    char info_path_base[PATH_MAX_LENGTH];
 
-   if (!current_path)
-      return NULL;
-
    info_path     [0]          = '\0';
    info_path_base[0]          = '\0';
 
@@ -224,23 +282,173 @@ static config_file_t *core_info_list_iterate(
 
    fill_pathname_join(info_path,
          path_basedir,
-         info_path_base, sizeof(info_path_base));
+         info_path_base, len);
+}
+
+static config_file_t *core_info_list_iterate(
+      const char *current_path,
+      const char *path_basedir)
+{
+   char info_path[PATH_MAX_LENGTH];
+
+   if (!current_path)
+      return NULL;
+
+   core_info_get_info_path(current_path, path_basedir,
+         info_path, sizeof(info_path));
 
    if (path_is_valid(info_path))
       return config_file_new_from_path_to_string(info_path);
    return NULL;
 }
 
+/* Reads everything but the core path and lock
+ * status from the core's .info file */
+static void core_info_parse_config(core_info_t *info,
+      config_file_t *conf)
+{
+   bool tmp_bool      = false;
+   unsigned tmp_uint  = 0;
+   struct config_entry_list 
+      *entry = config_get_entry(conf, "display_name");
+
+   if (entry && !string_is_empty(entry->value))
+      info->display_name = strdup(entry->value);
+
+   entry = config_get_entry(conf, "display_version");
+
+   if (entry && !string_is_empty(entry->value))
+      info->display_version = strdup(entry->value);
+
+   entry = config_get_entry(conf, "corename");
+
+   if (entry && !string_is_empty(entry->value))
+      info->core_name = strdup(entry->value);
+
+   entry = config_get_entry(conf, "systemname");
+
+   if (entry && !string_is_empty(entry->value))
+      info->systemname = strdup(entry->value);
+
+   entry = config_get_entry(conf, "systemid");
+
+   if (entry && !string_is_empty(entry->value))
+      info->system_id = strdup(entry->value);
+
+   entry = config_get_entry(conf, "manufacturer");
+
+   if (entry && !string_is_empty(entry->value))
+      info->system_manufacturer = strdup(entry->value);
+
+   config_get_uint(conf, "firmware_count", &tmp_uint);
+   info->firmware_count = tmp_uint;
+
+   entry = config_get_entry(conf, "supported_extensions");
+
+   if (entry && !string_is_empty(entry->value))
+   {
+      info->supported_extensions      = strdup(entry->value);
+      info->supported_extensions_list =
+         string_split(info->supported_extensions, "|");
+   }
+
+   entry = config_get_entry(conf, "authors");
+
+   if (entry && !string_is_empty(entry->value))
+   {
+      info->authors      = strdup(entry->value);
+      info->authors_list =
+         string_split(info->authors, "|");
+   }
+
+   entry = config_get_entry(conf, "permissions");
+
+   if (entry && !string_is_empty(entry->value))
+   {
+      info->permissions      = strdup(entry->value);
+      info->permissions_list =
+         string_split(info->permissions, "|");
+   }
+
+   entry = config_get_entry(conf, "license");
+
+   if (entry && !string_is_empty(entry->value))
+   {
+      info->licenses      = strdup(entry->value);
+      info->licenses_list =
+         string_split(info->licenses, "|");
+   }
+
+   entry = config_get_entry(conf, "categories");
+
+   if (entry && !string_is_empty(entry->value))
+   {
+      info->categories      = strdup(entry->value);
+      info->categories_list =
+         string_split(info->categories, "|");
+   }
+
+   entry = config_get_entry(conf, "database");
+
+   if (entry && !string_is_empty(entry->value))
+   {
+      info->databases      = strdup(entry->value);
+      info->databases_list =
+         string_split(info->databases, "|");
+   }
+
+   entry = config_get_entry(conf, "notes");
+
+   if (entry && !string_is_empty(entry->value))
+   {
+      info->notes     = strdup(entry->value);
+      info->note_list =
+         string_split(info->notes, "|");
+   }
+
+   entry = config_get_entry(conf, "required_hw_api");
+
+   if (entry && !string_is_empty(entry->value))
+   {
+      info->required_hw_api      = strdup(entry->value);
+      info->required_hw_api_list =
+         string_split(info->required_hw_api, "|");
+   }
+
+   entry = config_get_entry(conf, "description");
+
+   if (entry && !string_is_empty(entry->value))
+      info->description = strdup(entry->value);
+
+   if (config_get_bool(conf, "supports_no_game",
+            &tmp_bool))
+      info->supports_no_game = tmp_bool;
+
+   if (config_get_bool(conf, "database_match_archive_member",
+            &tmp_bool))
+      info->database_match_archive_member = tmp_bool;
+
+   if (config_get_bool(conf, "is_experimental",
+            &tmp_bool))
+      info->is_experimental = tmp_bool;
+
+   core_info_resolve_firmware(info, conf);
+}
+
 static core_info_list_t *core_info_list_new(const char *path,
       const char *libks_info_dir,
       const char *exts,
-      bool dir_show_hidden_files)
+      bool dir_show_hidden_files,
+      const char *cache_path)
 {
    size_t i;
    struct string_list contents      = {0};
    core_info_t *core_info           = NULL;
    core_info_list_t *core_info_list = NULL;
+   core_info_cache_t *cache         = NULL;
    const char       *path_basedir   = libks_info_dir;
+   ks_time_t start_time             = cpu_features_get_time_usec();
+   unsigned cached                  = 0;
    bool                          ok = false;
 
    string_list_initialize(&contents);
@@ -273,9 +481,11 @@ static core_info_list_t *core_info_list_new(const char *path,
    if (!core_info_list)
       goto error;
 
-   core_info_list->list    = NULL;
-   core_info_list->count   = 0;
-   core_info_list->all_ext = NULL;
+   core_info_list->list              = NULL;
+   core_info_list->count             = 0;
+   core_info_list->all_ext           = NULL;
+   core_info_list->ext_map           = NULL;
+   core_info_list->ext_map_collision = false;
 
    core_info               = (core_info_t*)
       calloc(contents.size, sizeof(*core_info));
@@ -289,142 +499,45 @@ static core_info_list_t *core_info_list_new(const char *path,
    core_info_list->list    = core_info;
    core_info_list->count   = contents.size;
 
+   if (!string_is_empty(cache_path))
+      cache                = core_info_cache_open(cache_path, path_basedir);
+
    for (i = 0; i < contents.size; i++)
    {
+      core_info_cache_key_t key;
+      char info_path[PATH_MAX_LENGTH];
       const char *base_path = contents.elems[i].data;
-      config_file_t *conf   = core_info_list_iterate(base_path,
-            path_basedir);
-
-      if (conf)
-      {
-         bool tmp_bool      = false;
-         unsigned tmp_uint  = 0;
-         struct config_entry_list 
-            *entry = config_get_entry(conf, "display_name");
-
-         if (entry && !string_is_empty(entry->value))
-            core_info[i].display_name = strdup(entry->value);
-
-         entry = config_get_entry(conf, "display_version");
-
-         if (entry && !string_is_empty(entry->value))
-            core_info[i].display_version = strdup(entry->value);
-
-         entry = config_get_entry(conf, "corename");
-
-         if (entry && !string_is_empty(entry->value))
-            core_info[i].core_name = strdup(entry->value);
-
-         entry = config_get_entry(conf, "systemname");
-
-         if (entry && !string_is_empty(entry->value))
-               core_info[i].systemname = strdup(entry->value);
+      const char *info_name = NULL;
+      bool has_key          = false;
 
-         entry = config_get_entry(conf, "systemid");
+      core_info_get_info_path(base_path, path_basedir,
+            info_path, sizeof(info_path));
+      info_name             = path_basename(info_path);
+      has_key               = core_info_cache_stat(info_path, &key);
 
-         if (entry && !string_is_empty(entry->value))
-            core_info[i].system_id = strdup(entry->value);
-
-         entry = config_get_entry(conf, "manufacturer");
-
-         if (entry && !string_is_empty(entry->value))
-            core_info[i].system_manufacturer = strdup(entry->value);
-
-         config_get_uint(conf, "firmware_count", &tmp_uint);
-         core_info[i].firmware_count = tmp_uint;
-
-         entry = config_get_entry(conf, "supported_extensions");
-
-         if (entry && !string_is_empty(entry->value))
-         {
-            core_info[i].supported_extensions      = strdup(entry->value);
-            core_info[i].supported_extensions_list =
-               string_split(core_info[i].supported_extensions, "|");
-         }
-
-         entry = config_get_entry(conf, "authors");
-
-         if (entry && !string_is_empty(entry->value))
-         {
-            core_info[i].authors      = strdup(entry->value);
-            core_info[i].authors_list =
-               string_split(core_info[i].authors, "|");
-         }
-
-         entry = config_get_entry(conf, "permissions");
-
-         if (entry && !string_is_empty(entry->value))
-         {
-            core_info[i].permissions      = strdup(entry->value);
-            core_info[i].permissions_list =
-               string_split(core_info[i].permissions, "|");
-         }
-
-         entry = config_get_entry(conf, "license");
-
-         if (entry && !string_is_empty(entry->value))
-         {
-            core_info[i].licenses      = strdup(entry->value);
-            core_info[i].licenses_list =
-               string_split(core_info[i].licenses, "|");
-         }
-
-         entry = config_get_entry(conf, "categories");
-
-         if (entry && !string_is_empty(entry->value))
-         {
-            core_info[i].categories      = strdup(entry->value);
-            core_info[i].categories_list =
-               string_split(core_info[i].categories, "|");
-         }
-
-         entry = config_get_entry(conf, "database");
-
-         if (entry && !string_is_empty(entry->value))
-         {
-            core_info[i].databases      = strdup(entry->value);
-            core_info[i].databases_list =
-               string_split(core_info[i].databases, "|");
-         }
-
-         entry = config_get_entry(conf, "notes");
-
-         if (entry && !string_is_empty(entry->value))
-         {
-            core_info[i].notes     = strdup(entry->value);
-            core_info[i].note_list =
-               string_split(core_info[i].notes, "|");
-         }
-
-         entry = config_get_entry(conf, "required_hw_api");
+      if (has_key && core_info_cache_find(cache, info_name, &key,
+               &core_info[i]))
+      {
+         core_info[i].has_info = true;
+         cached++;
+      }
+      else if (has_key || path_is_valid(info_path))
+      {
+         config_file_t *conf = config_file_new_from_path_to_string(
+               info_path);
 
-         if (entry && !string_is_empty(entry->value))
+         if (conf)
          {
-            core_info[i].required_hw_api      = strdup(entry->value);
-            core_info[i].required_hw_api_list =
-               string_split(core_info[i].required_hw_api, "|");
+            core_info_parse_config(&core_info[i], conf);
+            core_info[i].has_info = true;
+            config_file_free(conf);
          }
-
-         entry = config_get_entry(conf, "description");
-
-         if (entry && !string_is_empty(entry->value))
-            core_info[i].description = strdup(entry->value);
-
-         if (config_get_bool(conf, "supports_no_game",
-                  &tmp_bool))
-            core_info[i].supports_no_game = tmp_bool;
-
-         if (config_get_bool(conf, "database_match_archive_member",
-                  &tmp_bool))
-            core_info[i].database_match_archive_member = tmp_bool;
-
-         if (config_get_bool(conf, "is_experimental",
-                  &tmp_bool))
-            core_info[i].is_experimental = tmp_bool;
-
-         core_info[i].config_data = conf;
       }
 
+      /* Raw .info contents, before the fallbacks below */
+      if (has_key && core_info[i].has_info)
+         core_info_cache_add(cache, info_name, &key, &core_info[i]);
+
       if (!string_is_empty(base_path))
       {
          const char *core_filename = path_basename(base_path);
@@ -468,8 +581,15 @@ static core_info_list_t *core_info_list_new(const char *path,
       core_info[i].is_locked = core_info_get_core_lock(core_info[i].path, false);
    }
 
+   core_info_cache_close(cache);
+
    core_info_list_resolve_all_extensions(core_info_list);
-   core_info_list_resolve_all_firmware(core_info_list);
+   core_info_list_resolve_ext_map(core_info_list);
+
+   KINGSN_LOG("[Core Info]: Loaded %u cores in %.1f ms (%u from cache).\n",
+         (unsigned)core_info_list->count,
+         (cpu_features_get_time_usec() - start_time) / 1000.0,
+         cached);
 
    string_list_deinitialize(&contents);
    return core_info_list;
@@ -515,22 +635,6 @@ bool core_info_list_get_info(core_info_list_t *core_info_list,
    return false;
 }
 
-#ifdef HAVE_COMPRESSION
-static bool core_info_does_support_any_file(const core_info_t *core,
-      const struct string_list *list)
-{
-   size_t i;
-   if (!list || !core || !core->supported_extensions_list)
-      return false;
-
-   for (i = 0; i < list->size; i++)
-      if (string_list_find_elem_prefix(core->supported_extensions_list,
-               ".", path_get_extension(list->elems[i].data)))
-         return true;
-   return false;
-}
-#endif
-
 static bool core_info_does_support_file(
       const core_info_t *core, const char *path)
 {
@@ -543,6 +647,58 @@ static bool core_info_does_support_file(
          core->supported_extensions_list, ".", path_get_extension(path));
 }
 
+static int core_info_path_ptr_cmp(const void *a_, const void *b_)
+{
+   const char *a = *(const char**)a_;
+   const char *b = *(const char**)b_;
+   return (a > b) - (a < b);
+}
+
+static bool core_info_is_supported_core(const core_info_t *core,
+      const char **cores)
+{
+   if (!core->path || !cores)
+      return false;
+   return bsearch(&core->path, cores, RBUF_LEN(cores),
+         sizeof(*cores), core_info_path_ptr_cmp) != NULL;
+}
+
+/* Adds the paths of all cores supporting the
+ * extension of @path to @cores */
+static void core_info_list_find_ext(core_info_list_t *core_info_list,
+      const char *path, const char ***cores)
+{
+   size_t i;
+   char ext[255];
+   const core_info_ext_t *entry = NULL;
+
+   if (string_is_empty(path))
+      return;
+
+   if (core_info_list->ext_map_collision)
+   {
+      for (i = 0; i < core_info_list->count; i++)
+      {
+         const core_info_t *core = &core_info_list->list[i];
+
+         if (core->path && core_info_does_support_file(core, path))
+            RBUF_PUSH(*cores, core->path);
+      }
+      return;
+   }
+
+   strlcpy(ext, path_get_extension(path), sizeof(ext));
+   string_to_lower(ext);
+
+   entry = RHMAP_GET_STR(core_info_list->ext_map, ext);
+
+   if (!entry || !string_is_equal(entry->ext, ext))
+      return;
+
+   for (i = 0; i < RBUF_LEN(entry->paths); i++)
+      RBUF_PUSH(*cores, entry->paths[i]);
+}
+
 /* qsort_r() is not in standard C, sadly. */
 
 static int core_info_qsort_cmp(const void *a_, const void *b_)
@@ -550,16 +706,10 @@ static int core_info_qsort_cmp(const void *a_, const void *b_)
    core_info_state_t *p_coreinfo = coreinfo_get_ptr();
    const core_info_t          *a = (const core_info_t*)a_;
    const core_info_t          *b = (const core_info_t*)b_;
-   int support_a                 = core_info_does_support_file(a,
-         p_coreinfo->tmp_path);
-   int support_b                 = core_info_does_support_file(b,
-         p_coreinfo->tmp_path);
-#ifdef HAVE_COMPRESSION
-   support_a            = support_a ||
-      core_info_does_support_any_file(a, p_coreinfo->tmp_list);
-   support_b            = support_b ||
-      core_info_does_support_any_file(b, p_coreinfo->tmp_list);
-#endif
+   int support_a                 = core_info_is_supported_core(a,
+         p_coreinfo->tmp_cores);
+   int support_b                 = core_info_is_supported_core(b,
+         p_coreinfo->tmp_cores);
 
    if (support_a != support_b)
       return support_b - support_a;
@@ -647,9 +797,9 @@ bool core_info_init_current_core(void)
    current->database_match_archive_member = false;
    current->is_experimental               = false;
    current->is_locked                     = false;
+   current->has_info                      = false;
    current->firmware_count                = 0;
    current->path                          = NULL;
-   current->config_data                   = NULL;
    current->display_name                  = NULL;
    current->display_version               = NULL;
    current->core_name                     = NULL;
@@ -700,13 +850,14 @@ void core_info_deinit_list(void)
 }
 
 bool core_info_init_list(const char *path_info, const char *dir_cores,
-      const char *exts, bool dir_show_hidden_files)
+      const char *exts, bool dir_show_hidden_files, const char *cache_path)
 {
    core_info_state_t *p_coreinfo = coreinfo_get_ptr();
    if (!(p_coreinfo->curr_list = core_info_list_new(dir_cores,
                !string_is_empty(path_info) ? path_info : dir_cores,
                exts,
-               dir_show_hidden_files)))
+               dir_show_hidden_files,
+               cache_path)))
       return false;
    return true;
 }
@@ -798,46 +949,48 @@ void core_info_list_get_supported_cores(core_info_list_t *core_info_list,
 {
    size_t i;
    size_t supported              = 0;
-#ifdef HAVE_COMPRESSION
-   struct string_list *list      = NULL;
-#endif
+   const char **cores            = NULL;
    core_info_state_t *p_coreinfo = coreinfo_get_ptr();
 
    if (!core_info_list)
       return;
 
-   p_coreinfo->tmp_path          = path;
+   /* Look up the cores for the file, and for every
+    * file inside it if it is an archive */
+   core_info_list_find_ext(core_info_list, path, &cores);
 
 #ifdef HAVE_COMPRESSION
    if (path_is_compressed_file(path))
-      list = file_archive_get_file_list(path, NULL);
-   p_coreinfo->tmp_list = list;
+   {
+      struct string_list *list = file_archive_get_file_list(path, NULL);
+
+      if (list)
+      {
+         for (i = 0; i < list->size; i++)
+            core_info_list_find_ext(core_info_list,
+                  list->elems[i].data, &cores);
+         string_list_free(list);
+      }
+   }
 #endif
 
+   if (cores)
+      qsort(cores, RBUF_LEN(cores), sizeof(*cores),
+            core_info_path_ptr_cmp);
+
+   p_coreinfo->tmp_cores = cores;
+
    /* Let supported core come first in list so we can return
     * a pointer to them. */
    qsort(core_info_list->list, core_info_list->count,
          sizeof(core_info_t), core_info_qsort_cmp);
 
    for (i = 0; i < core_info_list->count; i++, supported++)
-   {
-      const core_info_t *core = &core_info_list->list[i];
-
-      if (core_info_does_support_file(core, path))
-         continue;
-
-#ifdef HAVE_COMPRESSION
-      if (core_info_does_support_any_file(core, list))
-         continue;
-#endif
-
-      break;
-   }
+      if (!core_info_is_supported_core(&core_info_list->list[i], cores))
+         break;
 
-#ifdef HAVE_COMPRESSION
-   if (list)
-      string_list_free(list);
-#endif
+   p_coreinfo->tmp_cores = NULL;
+   RBUF_FREE(cores);
 
    *infos     = core_info_list->list;
    *num_infos = supported;
@@ -944,11 +1097,7 @@ size_t core_info_list_num_info_files(core_info_list_t *core_info_list)
       return 0;
 
    for (i = 0; i < core_info_list->count; i++)
-   {
-      config_file_t *conf = (config_file_t*)
-         core_info_list->list[i].config_data;
-      num += !!conf;
-   }
+      num += core_info_list->list[i].has_info;
 
    return num;
 }
@@ -63,7 +63,6 @@ typedef struct
 typedef struct
 {
    char *path;
-   void *config_data;
    char *display_name;
    char *display_version;
    char *core_name;
@@ -95,6 +94,8 @@ typedef struct
    bool database_match_archive_member;
    bool is_experimental;
    bool is_locked;
+   /* Set if the core has an .info file */
+   bool has_info;
 } core_info_t;
 
 /* A subset of core_info parameters required for
@@ -107,11 +108,25 @@ typedef struct
    bool is_experimental;
 } core_updater_info_t;
 
+/* All cores supporting one (lower case, dotless) file
+ * extension. Cores are referenced by their path, which
+ * stays put when the list is sorted */
+typedef struct
+{
+   char *ext;
+   const char **paths;
+} core_info_ext_t;
+
 typedef struct
 {
    core_info_t *list;
    char *all_ext;
+   /* core_info_ext_t by hash of the extension */
+   core_info_ext_t **ext_map;
    size_t count;
+   /* Two extensions share a hash, so the map
+    * cannot be used for lookups */
+   bool ext_map_collision;
 } core_info_list_t;
 
 typedef struct core_info_ctx_firmware
@@ -131,10 +146,9 @@ typedef struct core_info_ctx_find
 
 struct core_info_state
 {
-#ifdef HAVE_COMPRESSION
-   const struct string_list *tmp_list;
-#endif
-   const char *tmp_path;
+   /* Paths of the cores supporting the content passed to
+    * core_info_list_get_supported_cores(), sorted */
+   const char **tmp_cores;
    core_info_t *current;
    core_info_list_t *curr_list;
 };
@@ -175,8 +189,11 @@ bool core_info_get_current_core(core_info_t **core);
 
 void core_info_deinit_list(void);
 
+/* Builds the list of installed cores. If @cache_path is
+ * set, .info files are read through the core info cache
+ * at that path. */
 bool core_info_init_list(const char *path_info, const char *dir_cores,
-      const char *exts, bool show_hidden_files);
+      const char *exts, bool show_hidden_files, const char *cache_path);
 
 bool core_info_get_list(core_info_list_t **core);
 
@@ -0,0 +1,725 @@
+/*  KingStation - A frontend for libks.
+ *  Copyright (C) 2011-2017 - Daniel De Matteis
+ *
+ *  KingStation is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  KingStation is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with KingStation.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include <array/rbuf.h>
+#include <array/rhmap.h>
+#include <compat/strl.h>
+#include <ks_miscellaneous.h>
+#include <file/file_path.h>
+#include <lists/string_list.h>
+#include <streams/file_stream.h>
+#include <string/stdstring.h>
+
+#include "core_info_cache.h"
+#include "verbosity.h"
+
+#define CORE_INFO_CACHE_MAGIC   0x4943534B /* "KSCI" */
+#define CORE_INFO_CACHE_VERSION 1
+#define CORE_INFO_CACHE_STRINGS 15
+
+#define CORE_INFO_CACHE_FLAG_SUPPORTS_NO_GAME              (1 << 0)
+#define CORE_INFO_CACHE_FLAG_DATABASE_MATCH_ARCHIVE_MEMBER (1 << 1)
+#define CORE_INFO_CACHE_FLAG_IS_EXPERIMENTAL               (1 << 2)
+
+/* The file is a header, the records, the firmware table
+ * and a blob of nul terminated strings. Strings are
+ * referenced by their offset into the blob, which starts
+ * with an empty string so that offset 0 means 'not set'.
+ * The cache never leaves the machine that wrote it, so
+ * fields are native endian */
+typedef struct
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t record_count;
+   uint32_t firmware_count;
+   uint32_t strings_size;
+   uint32_t info_dir;
+} core_info_cache_header_t;
+
+typedef struct
+{
+   uint64_t size;
+   uint64_t mtime;
+   uint32_t name;
+   uint32_t strings[CORE_INFO_CACHE_STRINGS];
+   uint32_t firmware;
+   uint32_t firmware_count;
+   uint32_t flags;
+   uint32_t reserved;
+} core_info_cache_record_t;
+
+typedef struct
+{
+   uint32_t path;
+   uint32_t desc;
+   uint32_t optional;
+} core_info_cache_firmware_t;
+
+/* A record waiting to be written, strings are owned.
+ * Records which did not change are copied over from the
+ * old file instead, and only have 'cached' set */
+typedef struct
+{
+   const core_info_cache_record_t *cached;
+   char *name;
+   char *strings[CORE_INFO_CACHE_STRINGS];
+   core_info_firmware_t *firmware;
+   core_info_cache_key_t key;
+   size_t firmware_count;
+   uint32_t flags;
+} core_info_cache_entry_t;
+
+/* The string fields of core_info_t which come from the
+ * .info file, in record order. Most of them also have a
+ * list made by splitting the string at '|' */
+typedef struct
+{
+   size_t str;
+   size_t list;
+   bool split;
+} core_info_cache_field_t;
+
+#define CORE_INFO_CACHE_STR(str) \
+   { offsetof(core_info_t, str), 0, false }
+#define CORE_INFO_CACHE_LIST(str, list) \
+   { offsetof(core_info_t, str), offsetof(core_info_t, list), true }
+
+static const core_info_cache_field_t
+core_info_cache_fields[CORE_INFO_CACHE_STRINGS] = {
+   CORE_INFO_CACHE_STR(display_name),
+   CORE_INFO_CACHE_STR(display_version),
+   CORE_INFO_CACHE_STR(core_name),
+   CORE_INFO_CACHE_STR(systemname),
+   CORE_INFO_CACHE_STR(system_id),
+   CORE_INFO_CACHE_STR(system_manufacturer),
+   CORE_INFO_CACHE_LIST(supported_extensions, supported_extensions_list),
+   CORE_INFO_CACHE_LIST(authors, authors_list),
+   CORE_INFO_CACHE_LIST(permissions, permissions_list),
+   CORE_INFO_CACHE_LIST(licenses, licenses_list),
+   CORE_INFO_CACHE_LIST(categories, categories_list),
+   CORE_INFO_CACHE_LIST(databases, databases_list),
+   CORE_INFO_CACHE_LIST(notes, note_list),
+   CORE_INFO_CACHE_LIST(required_hw_api, required_hw_api_list),
+   CORE_INFO_CACHE_STR(description),
+};
+
+#define CORE_INFO_CACHE_FIELD_STR(info, i) \
+   ((char**)((uint8_t*)(info) + core_info_cache_fields[i].str))
+#define CORE_INFO_CACHE_FIELD_LIST(info, i) \
+   ((struct string_list**)((uint8_t*)(info) + core_info_cache_fields[i].list))
+
+struct core_info_cache
+{
+   char *path;
+   char *info_dir;
+   /* Cache file as it was when opened */
+   uint8_t *data;
+   size_t size;
+   const core_info_cache_record_t *records;
+   const core_info_cache_firmware_t *firmware;
+   const char *strings;
+   size_t record_count;
+   size_t firmware_count;
+   size_t strings_size;
+   /* Record index + 1 by hash of the .info file name */
+   uint32_t *index;
+   /* Records to write back, and the names they were added
+    * under, hashed */
+   core_info_cache_entry_t *entries;
+   uint8_t *added;
+   unsigned misses;
+   bool mapped;
+};
+
+static const char *core_info_cache_string(const core_info_cache_t *cache,
+      uint32_t offset)
+{
+   return offset ? cache->strings + offset : NULL;
+}
+
+static void core_info_cache_unload(core_info_cache_t *cache)
+{
+   if (cache->data)
+   {
+#ifdef HAVE_MMAP
+      if (cache->mapped)
+         munmap(cache->data, cache->size);
+      else
+#endif
+         free(cache->data);
+   }
+
+   RHMAP_FREE(cache->index);
+
+   cache->data           = NULL;
+   cache->size           = 0;
+   cache->records        = NULL;
+   cache->firmware       = NULL;
+   cache->strings        = NULL;
+   cache->record_count   = 0;
+   cache->firmware_count = 0;
+   cache->strings_size   = 0;
+   cache->mapped         = false;
+}
+
+static bool core_info_cache_load(core_info_cache_t *cache)
+{
+   size_t i, j;
+   uint64_t expected;
+   const core_info_cache_header_t *header = NULL;
+
+#ifdef HAVE_MMAP
+   {
+      struct stat st;
+      int fd = open(cache->path, O_RDONLY);
+
+      if (fd >= 0)
+      {
+         if (fstat(fd, &st) == 0 && st.st_size > 0)
+         {
+            void *data = mmap(NULL, (size_t)st.st_size,
+                  PROT_READ, MAP_SHARED, fd, 0);
+
+            if (data != MAP_FAILED)
+            {
+               cache->data   = (uint8_t*)data;
+               cache->size   = (size_t)st.st_size;
+               cache->mapped = true;
+            }
+         }
+         close(fd);
+      }
+   }
+#endif
+
+   if (!cache->data)
+   {
+      void *buf   = NULL;
+      int64_t len = 0;
+
+      if (!path_is_valid(cache->path))
+         return false;
+
+      if (!filestream_read_file(cache->path, &buf, &len) || len <= 0)
+      {
+         free(buf);
+         return false;
+      }
+
+      cache->data = (uint8_t*)buf;
+      cache->size = (size_t)len;
+   }
+
+   if (cache->size < sizeof(*header))
+      goto error;
+
+   header   = (const core_info_cache_header_t*)cache->data;
+   expected = sizeof(*header)
+      + (uint64_t)header->record_count   * sizeof(core_info_cache_record_t)
+      + (uint64_t)header->firmware_count * sizeof(core_info_cache_firmware_t)
+      + header->strings_size;
+
+   if (     header->magic   != CORE_INFO_CACHE_MAGIC
+         || header->version != CORE_INFO_CACHE_VERSION
+         || expected        != cache->size
+         || header->strings_size < 1
+         || header->info_dir >= header->strings_size)
+      goto error;
+
+   cache->records        = (const core_info_cache_record_t*)(header + 1);
+   cache->firmware       = (const core_info_cache_firmware_t*)
+      (cache->records + header->record_count);
+   cache->strings        = (const char*)
+      (cache->firmware + header->firmware_count);
+   cache->record_count   = header->record_count;
+   cache->firmware_count = header->firmware_count;
+   cache->strings_size   = header->strings_size;
+
+   if (     cache->strings[0]
+         || cache->strings[cache->strings_size - 1])
+      goto error;
+
+   /* Built for another info directory, every
+    * record would be a miss anyway */
+   if (!string_is_equal(core_info_cache_string(cache, header->info_dir),
+            cache->info_dir))
+   {
+      core_info_cache_unload(cache);
+      return false;
+   }
+
+   /* Check every offset once here, so that lookups
+    * can trust the file */
+   for (i = 0; i < cache->record_count; i++)
+   {
+      const core_info_cache_record_t *rec = &cache->records[i];
+
+      if (     !rec->name
+            || rec->name >= cache->strings_size
+            || rec->firmware > cache->firmware_count
+            || rec->firmware_count > cache->firmware_count - rec->firmware)
+         goto error;
+
+      for (j = 0; j < CORE_INFO_CACHE_STRINGS; j++)
+         if (rec->strings[j] >= cache->strings_size)
+            goto error;
+
+      for (j = 0; j < rec->firmware_count; j++)
+      {
+         const core_info_cache_firmware_t *fw =
+            &cache->firmware[rec->firmware + j];
+
+         if (     fw->path >= cache->strings_size
+               || fw->desc >= cache->strings_size)
+            goto error;
+      }
+
+      RHMAP_SET_STR(cache->index,
+            core_info_cache_string(cache, rec->name), (uint32_t)(i + 1));
+   }
+
+   return true;
+
+error:
+   KINGSN_WARN("[Core Info]: Ignoring invalid core info cache \"%s\".\n",
+         cache->path);
+   core_info_cache_unload(cache);
+   return false;
+}
+
+bool core_info_cache_stat(const char *path, core_info_cache_key_t *key)
+{
+   struct stat st;
+
+   if (string_is_empty(path) || stat(path, &st) != 0)
+      return false;
+
+   key->size  = (uint64_t)st.st_size;
+   key->mtime = (uint64_t)st.st_mtime;
+
+   return true;
+}
+
+core_info_cache_t *core_info_cache_open(const char *path,
+      const char *info_dir)
+{
+   core_info_cache_t *cache = NULL;
+
+   if (string_is_empty(path) || !info_dir)
+      return NULL;
+
+   if (!(cache = (core_info_cache_t*)calloc(1, sizeof(*cache))))
+      return NULL;
+
+   cache->path     = strdup(path);
+   cache->info_dir = strdup(info_dir);
+
+   if (!cache->path || !cache->info_dir)
+   {
+      free(cache->path);
+      free(cache->info_dir);
+      free(cache);
+      return NULL;
+   }
+
+   core_info_cache_load(cache);
+
+   return cache;
+}
+
+static const core_info_cache_record_t *core_info_cache_get_record(
+      const core_info_cache_t *cache, const char *info_name,
+      const core_info_cache_key_t *key)
+{
+   const core_info_cache_record_t *rec = NULL;
+   uint32_t idx                        = RHMAP_GET_STR(cache->index,
+         info_name);
+
+   if (!idx)
+      return NULL;
+
+   rec = &cache->records[idx - 1];
+
+   if (     rec->size  != key->size
+         || rec->mtime != key->mtime
+         || !string_is_equal(core_info_cache_string(cache, rec->name),
+            info_name))
+      return NULL;
+
+   return rec;
+}
+
+bool core_info_cache_find(core_info_cache_t *cache,
+      const char *info_name, const core_info_cache_key_t *key,
+      core_info_t *info)
+{
+   size_t i;
+   const core_info_cache_record_t *rec = NULL;
+
+   if (!cache || string_is_empty(info_name))
+      return false;
+
+   if (!(rec = core_info_cache_get_record(cache, info_name, key)))
+   {
+      cache->misses++;
+      return false;
+   }
+
+   for (i = 0; i < CORE_INFO_CACHE_STRINGS; i++)
+   {
+      const char *s = core_info_cache_string(cache, rec->strings[i]);
+      char **str    = CORE_INFO_CACHE_FIELD_STR(info, i);
+
+      if (!s)
+         continue;
+
+      *str = strdup(s);
+
+      if (*str && core_info_cache_fields[i].split)
+         *CORE_INFO_CACHE_FIELD_LIST(info, i) = string_split(*str, "|");
+   }
+
+   info->firmware_count = rec->firmware_count;
+
+   if (rec->firmware_count)
+   {
+      info->firmware = (core_info_firmware_t*)
+         calloc(rec->firmware_count, sizeof(*info->firmware));
+
+      if (!info->firmware)
+         info->firmware_count = 0;
+
+      for (i = 0; i < info->firmware_count; i++)
+      {
+         const core_info_cache_firmware_t *fw =
+            &cache->firmware[rec->firmware + i];
+         const char *path = core_info_cache_string(cache, fw->path);
+         const char *desc = core_info_cache_string(cache, fw->desc);
+
+         if (path)
+            info->firmware[i].path = strdup(path);
+         if (desc)
+            info->firmware[i].desc = strdup(desc);
+         info->firmware[i].optional = fw->optional != 0;
+      }
+   }
+
+   info->supports_no_game              =
+      !!(rec->flags & CORE_INFO_CACHE_FLAG_SUPPORTS_NO_GAME);
+   info->database_match_archive_member =
+      !!(rec->flags & CORE_INFO_CACHE_FLAG_DATABASE_MATCH_ARCHIVE_MEMBER);
+   info->is_experimental               =
+      !!(rec->flags & CORE_INFO_CACHE_FLAG_IS_EXPERIMENTAL);
+
+   return true;
+}
+
+void core_info_cache_add(core_info_cache_t *cache,
+      const char *info_name, const core_info_cache_key_t *key,
+      const core_info_t *info)
+{
+   size_t i;
+   core_info_cache_entry_t entry;
+
+   if (!cache || string_is_empty(info_name) || !info)
+      return;
+
+   /* Several cores can share one .info file */
+   if (RHMAP_HAS_STR(cache->added, info_name))
+      return;
+
+   memset(&entry, 0, sizeof(entry));
+
+   /* Found in the cache, so @info holds nothing new */
+   if ((entry.cached = core_info_cache_get_record(cache, info_name, key)))
+   {
+      RBUF_PUSH(cache->entries, entry);
+      RHMAP_SET_STR(cache->added, info_name, 1);
+      return;
+   }
+
+   if (!(entry.name = strdup(info_name)))
+      return;
+
+   for (i = 0; i < CORE_INFO_CACHE_STRINGS; i++)
+   {
+      const char *s = *(char *const*)((const uint8_t*)info
+            + core_info_cache_fields[i].str);
+      if (!string_is_empty(s))
+         entry.strings[i] = strdup(s);
+   }
+
+   if (info->firmware && info->firmware_count)
+   {
+      entry.firmware = (core_info_firmware_t*)
+         calloc(info->firmware_count, sizeof(*entry.firmware));
+
+      if (entry.firmware)
+      {
+         entry.firmware_count = info->firmware_count;
+
+         for (i = 0; i < info->firmware_count; i++)
+         {
+            if (!string_is_empty(info->firmware[i].path))
+               entry.firmware[i].path = strdup(info->firmware[i].path);
+            if (!string_is_empty(info->firmware[i].desc))
+               entry.firmware[i].desc = strdup(info->firmware[i].desc);
+            entry.firmware[i].optional = info->firmware[i].optional;
+         }
+      }
+   }
+
+   entry.key = *key;
+
+   if (info->supports_no_game)
+      entry.flags |= CORE_INFO_CACHE_FLAG_SUPPORTS_NO_GAME;
+   if (info->database_match_archive_member)
+      entry.flags |= CORE_INFO_CACHE_FLAG_DATABASE_MATCH_ARCHIVE_MEMBER;
+   if (info->is_experimental)
+      entry.flags |= CORE_INFO_CACHE_FLAG_IS_EXPERIMENTAL;
+
+   RBUF_PUSH(cache->entries, entry);
+   RHMAP_SET_STR(cache->added, info_name, 1);
+}
+
+static uint32_t core_info_cache_push_string(char **strings, const char *s,
+      bool *ok)
+{
+   size_t len;
+   size_t offset = RBUF_LEN(*strings);
+
+   if (string_is_empty(s))
+      return 0;
+
+   len = strlen(s) + 1;
+
+   if (!RBUF_TRYFIT(*strings, offset + len))
+   {
+      *ok = false;
+      return 0;
+   }
+
+   RBUF_RESIZE(*strings, offset + len);
+   memcpy(*strings + offset, s, len);
+
+   return (uint32_t)offset;
+}
+
+static bool core_info_cache_write(core_info_cache_t *cache)
+{
+   size_t i, j;
+   char tmp_path[PATH_MAX_LENGTH];
+   char dir[PATH_MAX_LENGTH];
+   core_info_cache_header_t header;
+   RFILE *fd                             = NULL;
+   core_info_cache_record_t *records     = NULL;
+   core_info_cache_firmware_t *firmware  = NULL;
+   char *strings                         = NULL;
+   size_t count                          = RBUF_LEN(cache->entries);
+   bool ok                               = true;
+   bool ret                              = false;
+
+   if (count && !(records = (core_info_cache_record_t*)
+            calloc(count, sizeof(*records))))
+      return false;
+
+   /* Offset 0 is the empty string */
+   if (!RBUF_TRYFIT(strings, 1))
+      goto end;
+   RBUF_PUSH(strings, '\0');
+   header.info_dir = core_info_cache_push_string(&strings,
+         cache->info_dir, &ok);
+
+   for (i = 0; i < count; i++)
+   {
+      const core_info_cache_entry_t *entry = &cache->entries[i];
+      core_info_cache_record_t *rec        = &records[i];
+
+      if (entry->cached)
+      {
+         const core_info_cache_record_t *old = entry->cached;
+
+         *rec                = *old;
+         rec->name           = core_info_cache_push_string(&strings,
+               core_info_cache_string(cache, old->name), &ok);
+         rec->firmware       = (uint32_t)RBUF_LEN(firmware);
+
+         for (j = 0; j < CORE_INFO_CACHE_STRINGS; j++)
+            rec->strings[j]  = core_info_cache_push_string(&strings,
+                  core_info_cache_string(cache, old->strings[j]), &ok);
+
+         for (j = 0; j < old->firmware_count; j++)
+         {
+            core_info_cache_firmware_t fw =
+               cache->firmware[old->firmware + j];
+
+            fw.path = core_info_cache_push_string(&strings,
+                  core_info_cache_string(cache, fw.path), &ok);
+            fw.desc = core_info_cache_push_string(&strings,
+                  core_info_cache_string(cache, fw.desc), &ok);
+
+            if (!RBUF_TRYFIT(firmware, RBUF_LEN(firmware) + 1))
+               ok = false;
+            else
+               RBUF_PUSH(firmware, fw);
+         }
+
+         continue;
+      }
+
+      rec->size           = entry->key.size;
+      rec->mtime          = entry->key.mtime;
+      rec->name           = core_info_cache_push_string(&strings,
+            entry->name, &ok);
+      rec->firmware       = (uint32_t)RBUF_LEN(firmware);
+      rec->firmware_count = (uint32_t)entry->firmware_count;
+      rec->flags          = entry->flags;
+
+      for (j = 0; j < CORE_INFO_CACHE_STRINGS; j++)
+         rec->strings[j]  = core_info_cache_push_string(&strings,
+               entry->strings[j], &ok);
+
+      for (j = 0; j < entry->firmware_count; j++)
+      {
+         core_info_cache_firmware_t fw;
+
+         fw.path     = core_info_cache_push_string(&strings,
+               entry->firmware[j].path, &ok);
+         fw.desc     = core_info_cache_push_string(&strings,
+               entry->firmware[j].desc, &ok);
+         fw.optional = entry->firmware[j].optional ? 1 : 0;
+
+         if (!RBUF_TRYFIT(firmware, RBUF_LEN(firmware) + 1))
+            ok = false;
+         else
+            RBUF_PUSH(firmware, fw);
+      }
+   }
+
+   if (!ok)
+      goto end;
+
+   header.magic          = CORE_INFO_CACHE_MAGIC;
+   header.version        = CORE_INFO_CACHE_VERSION;
+   header.record_count   = (uint32_t)count;
+   header.firmware_count = (uint32_t)RBUF_LEN(firmware);
+   header.strings_size   = (uint32_t)RBUF_LEN(strings);
+
+   fill_pathname_basedir(dir, cache->path, sizeof(dir));
+   if (!string_is_empty(dir) && !path_is_directory(dir))
+      path_mkdir(dir);
+
+   strlcpy(tmp_path, cache->path, sizeof(tmp_path));
+   strlcat(tmp_path, ".tmp", sizeof(tmp_path));
+
+   if (!(fd = filestream_open(tmp_path,
+               KS_VFS_FILE_ACCESS_WRITE, KS_VFS_FILE_ACCESS_HINT_NONE)))
+      goto end;
+
+   ret =    filestream_write(fd, &header, sizeof(header))
+               == (int64_t)sizeof(header)
+         && filestream_write(fd, records, count * sizeof(*records))
+               == (int64_t)(count * sizeof(*records))
+         && filestream_write(fd, firmware, RBUF_SIZEOF(firmware))
+               == (int64_t)RBUF_SIZEOF(firmware)
+         && filestream_write(fd, strings, RBUF_LEN(strings))
+               == (int64_t)RBUF_LEN(strings);
+
+   if (filestream_close(fd) != 0)
+      ret = false;
+
+   /* The old file may still be mapped, but the
+    * mapping survives it being replaced */
+   if (ret && filestream_rename(tmp_path, cache->path) != 0)
+   {
+      /* Renaming over an existing file fails on some platforms */
+      core_info_cache_unload(cache);
+      filestream_delete(cache->path);
+      ret = filestream_rename(tmp_path, cache->path) == 0;
+   }
+
+   if (!ret)
+      filestream_delete(tmp_path);
+
+end:
+   free(records);
+   RBUF_FREE(firmware);
+   RBUF_FREE(strings);
+
+   return ret;
+}
+
+void core_info_cache_close(core_info_cache_t *cache)
+{
+   size_t i, j;
+   size_t count;
+
+   if (!cache)
+      return;
+
+   count = RBUF_LEN(cache->entries);
+
+   /* A miss means that an .info file was added or changed,
+    * fewer records than before that one was removed */
+   if (!cache->data || cache->misses || count != cache->record_count)
+   {
+      if (core_info_cache_write(cache))
+         KINGSN_LOG("[Core Info]: Saved core info cache with %u entries.\n",
+               (unsigned)count);
+      else
+         KINGSN_ERR("[Core Info]: Failed to save core info cache \"%s\".\n",
+               cache->path);
+   }
+
+   core_info_cache_unload(cache);
+
+   for (i = 0; i < count; i++)
+   {
+      core_info_cache_entry_t *entry = &cache->entries[i];
+
+      free(entry->name);
+      for (j = 0; j < CORE_INFO_CACHE_STRINGS; j++)
+         free(entry->strings[j]);
+      for (j = 0; j < entry->firmware_count; j++)
+      {
+         free(entry->firmware[j].path);
+         free(entry->firmware[j].desc);
+      }
+      free(entry->firmware);
+   }
+
+   RBUF_FREE(cache->entries);
+   RHMAP_FREE(cache->added);
+   free(cache->info_dir);
+   free(cache->path);
+   free(cache);
+}
@@ -0,0 +1,89 @@
+/*  KingStation - A frontend for libks.
+ *  Copyright (C) 2011-2017 - Daniel De Matteis
+ *
+ *  KingStation is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  KingStation is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with KingStation.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORE_INFO_CACHE_H_
+#define CORE_INFO_CACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <boolean.h>
+#include <ks_common_api.h>
+
+#include "core_info.h"
+
+KS_BEGIN_DECLS
+
+/* Compiled copy of everything core_info_list_new() reads
+ * from the .info files, so that startup does not have to
+ * parse hundreds of config files.
+ *
+ * The cache is a flat binary file (fixed size records, a
+ * firmware table and a string blob) which is memory-mapped
+ * and read in place. A record is only used while its .info
+ * file still has the same size and modification time; the
+ * whole file is ignored if it was built for another info
+ * directory. */
+typedef struct core_info_cache core_info_cache_t;
+
+typedef struct core_info_cache_key
+{
+   uint64_t size;
+   uint64_t mtime;
+} core_info_cache_key_t;
+
+/**
+ * core_info_cache_stat:
+ *
+ * Fills in the size and modification time of @path.
+ *
+ * Returns: false if @path cannot be stat'ed.
+ **/
+bool core_info_cache_stat(const char *path, core_info_cache_key_t *key);
+
+/* Opens the cache at @path for the .info files in @info_dir.
+ * A missing, stale or unreadable cache file yields an empty
+ * cache. */
+core_info_cache_t *core_info_cache_open(const char *path,
+      const char *info_dir);
+
+/* Writes the cache back if any .info file was added, changed
+ * or removed since it was opened, and frees it. */
+void core_info_cache_close(core_info_cache_t *cache);
+
+/**
+ * core_info_cache_find:
+ *
+ * Fills in the .info fields of @info (strings, string lists,
+ * firmware and flags) from the record for @info_name. Fields
+ * which do not come from the .info file are left alone.
+ *
+ * Returns: true if @info_name has a record matching @key.
+ **/
+bool core_info_cache_find(core_info_cache_t *cache,
+      const char *info_name, const core_info_cache_key_t *key,
+      core_info_t *info);
+
+/* Records the .info fields of @info for @info_name. Every
+ * .info file that is still in use has to be added, whether
+ * it was found in the cache or not, as records which are
+ * not added again are dropped on close. */
+void core_info_cache_add(core_info_cache_t *cache,
+      const char *info_name, const core_info_cache_key_t *key,
+      const core_info_t *info);
+
+KS_END_DECLS
+
+#endif
@@ -147,14 +147,12 @@ static int database_cursor_iterate(libksdb_cursor_t *cur,
    struct rmsgpack_dom_value item;
    const char* str                = NULL;
 
-   if (libksdb_cursor_read_item(cur, &item) != 0)
+   /* The item belongs to the cursor, nothing to free */
+   if (libksdb_cursor_read_item_view(cur, &item) != 0)
       return -1;
 
    if (item.type != RDT_MAP)
-   {
-      rmsgpack_dom_value_free(&item);
       return 1;
-   }
 
    db_info->analog_supported       = -1;
    db_info->rumble_supported       = -1;
@@ -279,8 +277,12 @@ static int database_cursor_iterate(libksdb_cursor_t *cur,
       else if (string_is_equal(str, "size"))
          db_info->size                    = (unsigned)val->val.uint_;
       else if (string_is_equal(str, "crc"))
-         db_info->crc32 = swap_if_little32(
-               *(uint32_t*)val->val.binary.buff);
+      {
+         /* May point into the mapped database, so it can be unaligned */
+         uint32_t crc32 = 0;
+         memcpy(&crc32, val->val.binary.buff, sizeof(crc32));
+         db_info->crc32 = swap_if_little32(crc32);
+      }
       else if (string_is_equal(str, "sha1"))
          db_info->sha1 = bin_to_hex_alloc(
                (uint8_t*)val->val.binary.buff, val->val.binary.len);
@@ -289,8 +291,6 @@ static int database_cursor_iterate(libksdb_cursor_t *cur,
                (uint8_t*)val->val.binary.buff, val->val.binary.len);
    }
 
-   rmsgpack_dom_value_free(&item);
-
    return 0;
 }
 
@@ -0,0 +1,764 @@
+/*  KingStation - A frontend for libks.
+ *  Copyright (C) 2011-2017 - Daniel De Matteis
+ *
+ *  KingStation is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  KingStation is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with KingStation.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include <compat/strl.h>
+#include <features/features_cpu.h>
+#include <ks_miscellaneous.h>
+#include <file/file_path.h>
+#include <streams/file_stream.h>
+#include <string/stdstring.h>
+
+#include "libks-db/rmsgpack.h"
+
+#include "database_scan_cache.h"
+#include "verbosity.h"
+
+#define SCAN_CACHE_VERSION     1
+/* Every index entry is a big endian path hash and file offset */
+#define SCAN_CACHE_INDEX_ENTRY 16
+#define SCAN_CACHE_FIELDS      10
+
+typedef struct scan_cache_record
+{
+   const char *path;
+   const char *serial;
+   uint64_t hash;
+   size_t seq;
+   database_scan_cache_key_t key;
+   uint32_t path_len;
+   uint32_t serial_len;
+   uint32_t type;
+   uint32_t crc;
+   uint32_t archive_crc;
+} scan_cache_record_t;
+
+typedef struct scan_cache_reader
+{
+   const uint8_t *ptr;
+   const uint8_t *end;
+} scan_cache_reader_t;
+
+struct database_scan_cache
+{
+   char *path;
+   /* Cache file as it was when opened */
+   uint8_t *data;
+   size_t size;
+   const uint8_t *index;
+   size_t count;
+   /* Entries added since, strings are owned */
+   scan_cache_record_t *added;
+   size_t added_count;
+   size_t added_capacity;
+   bool mapped;
+};
+
+static uint64_t scan_cache_hash(const char *s, size_t len)
+{
+   /* FNV-1a */
+   size_t i;
+   uint64_t hash = 0xcbf29ce484222325ULL;
+
+   for (i = 0; i < len; i++)
+   {
+      hash ^= (uint8_t)s[i];
+      hash *= 0x100000001b3ULL;
+   }
+
+   return hash;
+}
+
+static uint64_t scan_cache_load_be(const uint8_t *p, unsigned len)
+{
+   unsigned i;
+   uint64_t val = 0;
+
+   for (i = 0; i < len; i++)
+      val = (val << 8) | p[i];
+
+   return val;
+}
+
+static void scan_cache_store_be64(uint8_t *p, uint64_t val)
+{
+   int i;
+
+   for (i = 7; i >= 0; i--, val >>= 8)
+      p[i] = (uint8_t)val;
+}
+
+static bool scan_cache_read_uint(scan_cache_reader_t *r, uint64_t *val)
+{
+   unsigned len;
+   uint8_t tag;
+
+   if (r->ptr >= r->end)
+      return false;
+
+   tag = *r->ptr++;
+
+   /* positive fixint */
+   if (tag < 0x80)
+   {
+      *val = tag;
+      return true;
+   }
+
+   switch (tag)
+   {
+      case 0xcc:
+         len = 1;
+         break;
+      case 0xcd:
+         len = 2;
+         break;
+      case 0xce:
+         len = 4;
+         break;
+      case 0xcf:
+         len = 8;
+         break;
+      default:
+         return false;
+   }
+
+   if ((size_t)(r->end - r->ptr) < len)
+      return false;
+
+   *val    = scan_cache_load_be(r->ptr, len);
+   r->ptr += len;
+   return true;
+}
+
+/* Reads a string, or a binary blob if @bin is set */
+static bool scan_cache_read_raw(scan_cache_reader_t *r, bool bin,
+      const uint8_t **data, uint32_t *len)
+{
+   unsigned size_len;
+   uint8_t tag;
+
+   if (r->ptr >= r->end)
+      return false;
+
+   tag = *r->ptr++;
+
+   if (!bin && (tag & 0xe0) == 0xa0)
+   {
+      size_len = 0;
+      *len     = tag & 0x1f;
+   }
+   else if (tag == (bin ? 0xc4 : 0xd9))
+      size_len = 1;
+   else if (tag == (bin ? 0xc5 : 0xda))
+      size_len = 2;
+   else if (tag == (bin ? 0xc6 : 0xdb))
+      size_len = 4;
+   else
+      return false;
+
+   if (size_len)
+   {
+      if ((size_t)(r->end - r->ptr) < size_len)
+         return false;
+      *len    = (uint32_t)scan_cache_load_be(r->ptr, size_len);
+      r->ptr += size_len;
+   }
+
+   if ((size_t)(r->end - r->ptr) < *len)
+      return false;
+
+   *data   = r->ptr;
+   r->ptr += *len;
+   return true;
+}
+
+static bool scan_cache_read_container(scan_cache_reader_t *r, bool map,
+      uint32_t *count)
+{
+   uint8_t tag;
+   uint8_t fix = map ? 0x80 : 0x90;
+
+   if (r->ptr >= r->end)
+      return false;
+
+   tag = *r->ptr++;
+
+   if ((tag & 0xf0) == fix)
+   {
+      *count = tag & 0x0f;
+      return true;
+   }
+
+   if (tag == (map ? 0xde : 0xdc) && r->end - r->ptr >= 2)
+   {
+      *count  = (uint32_t)scan_cache_load_be(r->ptr, 2);
+      r->ptr += 2;
+      return true;
+   }
+
+   if (tag == (map ? 0xdf : 0xdd) && r->end - r->ptr >= 4)
+   {
+      *count  = (uint32_t)scan_cache_load_be(r->ptr, 4);
+      r->ptr += 4;
+      return true;
+   }
+
+   return false;
+}
+
+static bool scan_cache_read_record(database_scan_cache_t *cache,
+      uint64_t offset, scan_cache_record_t *rec)
+{
+   uint32_t count;
+   uint64_t val[8];
+   unsigned i;
+   scan_cache_reader_t r;
+
+   /* Leave no field unset, even if the record is truncated */
+   memset(rec, 0, sizeof(*rec));
+   rec->path   = "";
+   rec->serial = "";
+
+   if (offset >= cache->size)
+      return false;
+
+   r.ptr = cache->data + offset;
+   r.end = cache->data + cache->size;
+
+   if (!scan_cache_read_container(&r, false, &count)
+         || count != SCAN_CACHE_FIELDS)
+      return false;
+
+   if (!scan_cache_read_raw(&r, false,
+            (const uint8_t**)&rec->path, &rec->path_len))
+      return false;
+
+   for (i = 0; i < 8; i++)
+      if (!scan_cache_read_uint(&r, &val[i]))
+         return false;
+
+   if (!scan_cache_read_raw(&r, false,
+            (const uint8_t**)&rec->serial, &rec->serial_len))
+      return false;
+
+   rec->key.size      = val[0];
+   rec->key.mtime     = val[1];
+   rec->key.inode     = val[2];
+   rec->key.dep_size  = val[3];
+   rec->key.dep_mtime = val[4];
+   rec->type          = (uint32_t)val[5];
+   rec->crc           = (uint32_t)val[6];
+   rec->archive_crc   = (uint32_t)val[7];
+   rec->hash          = scan_cache_hash(rec->path, rec->path_len);
+   rec->seq           = 0;
+
+   return true;
+}
+
+static void scan_cache_unload(database_scan_cache_t *cache)
+{
+   if (cache->data)
+   {
+#ifdef HAVE_MMAP
+      if (cache->mapped)
+         munmap(cache->data, cache->size);
+      else
+#endif
+         free(cache->data);
+   }
+
+   cache->data   = NULL;
+   cache->size   = 0;
+   cache->index  = NULL;
+   cache->count  = 0;
+   cache->mapped = false;
+}
+
+static bool scan_cache_load(database_scan_cache_t *cache)
+{
+   uint32_t i, pairs;
+   uint64_t version        = 0;
+   uint64_t count          = 0;
+   const uint8_t *index    = NULL;
+   uint32_t index_len      = 0;
+   scan_cache_reader_t r;
+
+#ifdef HAVE_MMAP
+   {
+      struct stat st;
+      int fd = open(cache->path, O_RDONLY);
+
+      if (fd >= 0)
+      {
+         if (fstat(fd, &st) == 0 && st.st_size > 0)
+         {
+            void *data = mmap(NULL, (size_t)st.st_size,
+                  PROT_READ, MAP_SHARED, fd, 0);
+
+            if (data != MAP_FAILED)
+            {
+               cache->data   = (uint8_t*)data;
+               cache->size   = (size_t)st.st_size;
+               cache->mapped = true;
+            }
+         }
+         close(fd);
+      }
+   }
+#endif
+
+   if (!cache->data)
+   {
+      void *buf   = NULL;
+      int64_t len = 0;
+
+      if (!path_is_valid(cache->path))
+         return false;
+
+      if (!filestream_read_file(cache->path, &buf, &len) || len <= 0)
+      {
+         free(buf);
+         return false;
+      }
+
+      cache->data = (uint8_t*)buf;
+      cache->size = (size_t)len;
+   }
+
+   r.ptr = cache->data;
+   r.end = cache->data + cache->size;
+
+   if (!scan_cache_read_container(&r, true, &pairs))
+      goto error;
+
+   for (i = 0; i < pairs; i++)
+   {
+      const uint8_t *key = NULL;
+      uint32_t key_len   = 0;
+
+      if (!scan_cache_read_raw(&r, false, &key, &key_len))
+         goto error;
+
+      if (key_len == 7 && !memcmp(key, "version", 7))
+      {
+         if (!scan_cache_read_uint(&r, &version))
+            goto error;
+      }
+      else if (key_len == 5 && !memcmp(key, "count", 5))
+      {
+         if (!scan_cache_read_uint(&r, &count))
+            goto error;
+      }
+      else if (key_len == 5 && !memcmp(key, "index", 5))
+      {
+         if (!scan_cache_read_raw(&r, true, &index, &index_len))
+            goto error;
+      }
+      else
+         goto error;
+   }
+
+   if (version != SCAN_CACHE_VERSION || !index
+         || count != index_len / SCAN_CACHE_INDEX_ENTRY
+         || index_len % SCAN_CACHE_INDEX_ENTRY)
+      goto error;
+
+   cache->index = index;
+   cache->count = (size_t)count;
+
+   return true;
+
+error:
+   KINGSN_WARN("[Scanner]: Ignoring invalid scan cache \"%s\".\n",
+         cache->path);
+   scan_cache_unload(cache);
+   return false;
+}
+
+bool database_scan_cache_stat(const char *path,
+      database_scan_cache_key_t *key)
+{
+   struct stat st;
+
+   if (string_is_empty(path) || stat(path, &st) != 0)
+      return false;
+
+   key->size      = (uint64_t)st.st_size;
+   key->mtime     = (uint64_t)st.st_mtime;
+   key->inode     = (uint64_t)st.st_ino;
+   key->dep_size  = 0;
+   key->dep_mtime = 0;
+
+   return true;
+}
+
+database_scan_cache_t *database_scan_cache_open(const char *path)
+{
+   database_scan_cache_t *cache = NULL;
+
+   if (string_is_empty(path))
+      return NULL;
+
+   if (!(cache = (database_scan_cache_t*)calloc(1, sizeof(*cache))))
+      return NULL;
+
+   if (!(cache->path = strdup(path)))
+   {
+      free(cache);
+      return NULL;
+   }
+
+   if (scan_cache_load(cache))
+      KINGSN_LOG("[Scanner]: Loaded scan cache with %u entries.\n",
+            (unsigned)cache->count);
+
+   return cache;
+}
+
+static bool scan_cache_key_equal(const database_scan_cache_key_t *a,
+      const database_scan_cache_key_t *b)
+{
+   return a->size      == b->size
+       && a->mtime     == b->mtime
+       && a->inode     == b->inode
+       && a->dep_size  == b->dep_size
+       && a->dep_mtime == b->dep_mtime;
+}
+
+bool database_scan_cache_find(database_scan_cache_t *cache,
+      const char *path, const database_scan_cache_key_t *key,
+      database_scan_cache_info_t *info)
+{
+   size_t lo, hi, path_len;
+   uint64_t hash;
+
+   if (!cache || !cache->count || string_is_empty(path))
+      return false;
+
+   path_len = strlen(path);
+   hash     = scan_cache_hash(path, path_len);
+   lo       = 0;
+   hi       = cache->count;
+
+   /* Find the first index entry with this hash */
+   while (lo < hi)
+   {
+      size_t mid = lo + (hi - lo) / 2;
+      if (scan_cache_load_be(cache->index
+               + mid * SCAN_CACHE_INDEX_ENTRY, 8) < hash)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   for (; lo < cache->count; lo++)
+   {
+      scan_cache_record_t rec;
+      const uint8_t *entry = cache->index + lo * SCAN_CACHE_INDEX_ENTRY;
+
+      if (scan_cache_load_be(entry, 8) != hash)
+         break;
+
+      if (!scan_cache_read_record(cache,
+               scan_cache_load_be(entry + 8, 8), &rec))
+         return false;
+
+      if (rec.path_len != path_len || memcmp(rec.path, path, path_len))
+         continue;
+
+      if (!scan_cache_key_equal(&rec.key, key))
+         return false;
+
+      if (rec.serial_len >= sizeof(info->serial))
+         return false;
+
+      info->type        = rec.type;
+      info->crc         = rec.crc;
+      info->archive_crc = rec.archive_crc;
+      memcpy(info->serial, rec.serial, rec.serial_len);
+      info->serial[rec.serial_len] = '\0';
+
+      return true;
+   }
+
+   return false;
+}
+
+void database_scan_cache_add(database_scan_cache_t *cache,
+      const char *path, const database_scan_cache_key_t *key,
+      const database_scan_cache_info_t *info)
+{
+   scan_cache_record_t *rec = NULL;
+   char *path_copy          = NULL;
+   char *serial_copy        = NULL;
+
+   if (!cache || string_is_empty(path))
+      return;
+
+   if (cache->added_count == cache->added_capacity)
+   {
+      size_t capacity = cache->added_capacity
+         ? cache->added_capacity * 2 : 256;
+      scan_cache_record_t *added = (scan_cache_record_t*)
+         realloc(cache->added, capacity * sizeof(*added));
+
+      if (!added)
+         return;
+
+      cache->added          = added;
+      cache->added_capacity = capacity;
+   }
+
+   path_copy   = strdup(path);
+   serial_copy = strdup(info->serial);
+
+   if (!path_copy || !serial_copy)
+   {
+      free(path_copy);
+      free(serial_copy);
+      return;
+   }
+
+   rec              = &cache->added[cache->added_count++];
+   rec->path        = path_copy;
+   rec->path_len    = (uint32_t)strlen(path_copy);
+   rec->serial      = serial_copy;
+   rec->serial_len  = (uint32_t)strlen(serial_copy);
+   rec->hash        = scan_cache_hash(path_copy, rec->path_len);
+   /* Newer entries win over older ones for the same path */
+   rec->seq         = cache->added_count;
+   rec->key         = *key;
+   rec->type        = info->type;
+   rec->crc         = info->crc;
+   rec->archive_crc = info->archive_crc;
+}
+
+static int scan_cache_record_cmp(const void *a, const void *b)
+{
+   int ret;
+   uint32_t len;
+   const scan_cache_record_t *x = (const scan_cache_record_t*)a;
+   const scan_cache_record_t *y = (const scan_cache_record_t*)b;
+
+   if (x->hash != y->hash)
+      return x->hash < y->hash ? -1 : 1;
+
+   len = x->path_len < y->path_len ? x->path_len : y->path_len;
+   if ((ret = memcmp(x->path, y->path, len)))
+      return ret;
+   if (x->path_len != y->path_len)
+      return x->path_len < y->path_len ? -1 : 1;
+
+   return (x->seq < y->seq) - (x->seq > y->seq);
+}
+
+static bool scan_cache_write_record(RFILE *fd,
+      const scan_cache_record_t *rec)
+{
+   return rmsgpack_write_array_header(fd, SCAN_CACHE_FIELDS) >= 0
+       && rmsgpack_write_string(fd, rec->path, rec->path_len) >= 0
+       && rmsgpack_write_uint(fd, rec->key.size) >= 0
+       && rmsgpack_write_uint(fd, rec->key.mtime) >= 0
+       && rmsgpack_write_uint(fd, rec->key.inode) >= 0
+       && rmsgpack_write_uint(fd, rec->key.dep_size) >= 0
+       && rmsgpack_write_uint(fd, rec->key.dep_mtime) >= 0
+       && rmsgpack_write_uint(fd, rec->type) >= 0
+       && rmsgpack_write_uint(fd, rec->crc) >= 0
+       && rmsgpack_write_uint(fd, rec->archive_crc) >= 0
+       && rmsgpack_write_string(fd, rec->serial, rec->serial_len) >= 0;
+}
+
+/* Entries of files that were deleted or moved are not written back */
+static bool scan_cache_record_exists(const scan_cache_record_t *rec)
+{
+   char path[PATH_MAX_LENGTH];
+
+   if (rec->path_len >= sizeof(path))
+      return false;
+
+   memcpy(path, rec->path, rec->path_len);
+   path[rec->path_len] = '\0';
+
+   return path_is_valid(path);
+}
+
+static bool scan_cache_write(database_scan_cache_t *cache)
+{
+   size_t i, count, total;
+   char tmp_path[PATH_MAX_LENGTH];
+   int64_t header_end;
+   RFILE *fd                    = NULL;
+   uint8_t *index               = NULL;
+   scan_cache_record_t *records = NULL;
+   size_t pruned                = 0;
+   bool ret                     = false;
+
+   /* Another scan may have saved the cache since this one
+    * was opened, so merge with what is on disk now */
+   scan_cache_unload(cache);
+   scan_cache_load(cache);
+
+   total = cache->count + cache->added_count;
+
+   if (!(records = (scan_cache_record_t*)malloc(total * sizeof(*records))))
+      return false;
+
+   /* Merge old and new entries, keeping only the
+    * most recent one for every path */
+   for (i = 0, count = 0; i < cache->count; i++)
+   {
+      if (!scan_cache_read_record(cache, scan_cache_load_be(cache->index
+                  + i * SCAN_CACHE_INDEX_ENTRY + 8, 8), &records[count]))
+         continue;
+
+      if (scan_cache_record_exists(&records[count]))
+         count++;
+      else
+         pruned++;
+   }
+
+   memcpy(records + count, cache->added,
+         cache->added_count * sizeof(*records));
+   total = count + cache->added_count;
+
+   qsort(records, total, sizeof(*records), scan_cache_record_cmp);
+
+   for (i = 0, count = 0; i < total; i++)
+   {
+      if (count
+            && records[count - 1].hash     == records[i].hash
+            && records[count - 1].path_len == records[i].path_len
+            && !memcmp(records[count - 1].path, records[i].path,
+               records[i].path_len))
+         continue;
+      records[count++] = records[i];
+   }
+
+   if (!(index = (uint8_t*)calloc(count ? count : 1,
+               SCAN_CACHE_INDEX_ENTRY)))
+      goto end;
+
+   /* Concurrent saves must not share a temporary file */
+   snprintf(tmp_path, sizeof(tmp_path), "%s.%08x.tmp", cache->path,
+         (unsigned)((uintptr_t)cache ^ cpu_features_get_time_usec()));
+
+   if (!(fd = filestream_open(tmp_path,
+               KS_VFS_FILE_ACCESS_WRITE, KS_VFS_FILE_ACCESS_HINT_NONE)))
+      goto end;
+
+   /* The index is written as zeroes first and
+    * filled in once the entry offsets are known */
+   if (     rmsgpack_write_map_header(fd, 3) < 0
+         || rmsgpack_write_string(fd, "version", 7) < 0
+         || rmsgpack_write_uint(fd, SCAN_CACHE_VERSION) < 0
+         || rmsgpack_write_string(fd, "count", 5) < 0
+         || rmsgpack_write_uint(fd, count) < 0
+         || rmsgpack_write_string(fd, "index", 5) < 0
+         || rmsgpack_write_bin(fd, index,
+            (uint32_t)(count * SCAN_CACHE_INDEX_ENTRY)) < 0)
+      goto end;
+
+   header_end = filestream_tell(fd);
+
+   for (i = 0; i < count; i++)
+   {
+      scan_cache_store_be64(index + i * SCAN_CACHE_INDEX_ENTRY,
+            records[i].hash);
+      scan_cache_store_be64(index + i * SCAN_CACHE_INDEX_ENTRY + 8,
+            (uint64_t)filestream_tell(fd));
+
+      if (!scan_cache_write_record(fd, &records[i]))
+         goto end;
+   }
+
+   if (filestream_seek(fd, header_end
+            - (int64_t)(count * SCAN_CACHE_INDEX_ENTRY),
+            KS_VFS_SEEK_POSITION_START) < 0)
+      goto end;
+
+   if (filestream_write(fd, index, count * SCAN_CACHE_INDEX_ENTRY)
+         != (int64_t)(count * SCAN_CACHE_INDEX_ENTRY))
+      goto end;
+
+   ret = true;
+
+end:
+   if (fd)
+      filestream_close(fd);
+
+   /* Old records point into the mapping,
+    * so it has to stay until here */
+   free(records);
+   free(index);
+   scan_cache_unload(cache);
+
+   if (ret)
+   {
+      if (filestream_rename(tmp_path, cache->path) != 0)
+      {
+         /* Renaming over an existing file fails on some platforms */
+         filestream_delete(cache->path);
+         ret = filestream_rename(tmp_path, cache->path) == 0;
+      }
+
+      if (ret)
+         KINGSN_LOG("[Scanner]: Saved scan cache with %u entries"
+               " (%u pruned).\n", (unsigned)count, (unsigned)pruned);
+   }
+   else if (fd)
+      filestream_delete(tmp_path);
+
+   return ret;
+}
+
+void database_scan_cache_close(database_scan_cache_t *cache)
+{
+   size_t i;
+
+   if (!cache)
+      return;
+
+   if (cache->added_count && !scan_cache_write(cache))
+      KINGSN_ERR("[Scanner]: Failed to save scan cache \"%s\".\n",
+            cache->path);
+
+   scan_cache_unload(cache);
+
+   for (i = 0; i < cache->added_count; i++)
+   {
+      free((char*)cache->added[i].path);
+      free((char*)cache->added[i].serial);
+   }
+
+   free(cache->added);
+   free(cache->path);
+   free(cache);
+}
@@ -0,0 +1,97 @@
+/*  KingStation - A frontend for libks.
+ *  Copyright (C) 2011-2017 - Daniel De Matteis
+ *
+ *  KingStation is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  KingStation is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with KingStation.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DATABASE_SCAN_CACHE_H_
+#define DATABASE_SCAN_CACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <boolean.h>
+#include <ks_common_api.h>
+
+KS_BEGIN_DECLS
+
+/* Remembers what the content scanner read from each file
+ * (CRC32, archive CRC, serial and lookup type) so that a rescan
+ * of an unchanged library does not need to read any content.
+ *
+ * The cache is an rmsgpack file in the playlist directory. It
+ * starts with a map holding a hash index of all entries, so it
+ * is memory-mapped and searched in place instead of parsed.
+ *
+ * An entry is only valid while the file still has the same size,
+ * modification time and inode. Cue and gdi sheets additionally
+ * record the total size and latest modification time of the
+ * tracks they reference. */
+typedef struct database_scan_cache database_scan_cache_t;
+
+typedef struct database_scan_cache_key
+{
+   uint64_t size;
+   uint64_t mtime;
+   uint64_t inode;
+   uint64_t dep_size;
+   uint64_t dep_mtime;
+} database_scan_cache_key_t;
+
+typedef struct database_scan_cache_info
+{
+   unsigned type;
+   uint32_t crc;
+   uint32_t archive_crc;
+   char serial[4096];
+} database_scan_cache_info_t;
+
+/**
+ * database_scan_cache_stat:
+ *
+ * Fills in the size, modification time and inode of @path.
+ * The dependency fields are cleared.
+ *
+ * Returns: false if @path cannot be stat'ed.
+ **/
+bool database_scan_cache_stat(const char *path,
+      database_scan_cache_key_t *key);
+
+/* Opens the cache at @path. A missing or unreadable cache
+ * file yields an empty cache. */
+database_scan_cache_t *database_scan_cache_open(const char *path);
+
+/* If anything was added, merges it with the cache file as it is
+ * now, drops entries of files that no longer exist and replaces
+ * the file through a rename. Then frees the cache. */
+void database_scan_cache_close(database_scan_cache_t *cache);
+
+/**
+ * database_scan_cache_find:
+ *
+ * Only looks at the cache file as it was when opened, so it may
+ * be called from several threads at once and alongside
+ * database_scan_cache_add, but not during database_scan_cache_close.
+ *
+ * Returns: true if @path has an entry matching @key.
+ **/
+bool database_scan_cache_find(database_scan_cache_t *cache,
+      const char *path, const database_scan_cache_key_t *key,
+      database_scan_cache_info_t *info);
+
+void database_scan_cache_add(database_scan_cache_t *cache,
+      const char *path, const database_scan_cache_key_t *key,
+      const database_scan_cache_info_t *info);
+
+KS_END_DECLS
+
+#endif
@@ -89,6 +89,7 @@ KS_BEGIN_DECLS
 #define FILE_PATH_AUTOCONFIG_ZIP "autoconfig.zip"
 #define FILE_PATH_CONTENT_FAVORITES "favorites.lpl"
 #define FILE_PATH_CONTENT_HISTORY "history.lpl"
+#define FILE_PATH_CONTENT_SCAN_CACHE "content_scan_cache.rmsgpack"
 #define FILE_PATH_CONTENT_IMAGE_HISTORY "image_history.lpl"
 #define FILE_PATH_CONTENT_MUSIC_HISTORY "content_music_history.lpl"
 #define FILE_PATH_CONTENT_VIDEO_HISTORY "video_history.lpl"
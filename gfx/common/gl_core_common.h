@@ -42,6 +42,31 @@ KS_BEGIN_DECLS
 #define GL_CORE_NUM_PBOS 4
 #define GL_CORE_NUM_VBOS 256
 #define GL_CORE_NUM_FENCES 8
+#define GL_CORE_NUM_READBACKS 2
+
+enum gl_core_readback_state
+{
+   GL_CORE_READBACK_FREE = 0,
+   /* Waiting for the next frame */
+   GL_CORE_READBACK_QUEUED,
+   /* glReadPixels() issued, waiting for the fence */
+   GL_CORE_READBACK_PENDING,
+   /* Handed out, mapped until released */
+   GL_CORE_READBACK_MAPPED
+};
+
+/* Screenshot readback into a PBO, see
+ * video_driver_read_viewport_async() */
+struct gl_core_readback
+{
+   GLsync fence;
+   GLuint pbo;
+   unsigned size;
+   unsigned width;
+   unsigned height;
+   enum gl_core_readback_state state;
+};
+
 struct gl_core_streamed_texture
 {
    GLuint tex;
@@ -66,6 +91,7 @@ typedef struct gl_core
    video_viewport_t vp;
    struct gl_core_viewport filter_chain_vp;
    struct gl_core_streamed_texture textures[GL_CORE_NUM_TEXTURES];
+   struct gl_core_readback readbacks[GL_CORE_NUM_READBACKS];
 
    GLuint vao;
    GLuint menu_texture;
@@ -117,6 +143,7 @@ typedef struct gl_core
 
    bool pbo_readback_valid[GL_CORE_NUM_PBOS];
    bool pbo_readback_enable;
+   bool readback_queued;
    bool hw_render_bottom_left;
    bool hw_render_enable;
    bool use_shared_context;
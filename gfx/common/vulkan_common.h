@@ -28,6 +28,7 @@
 #define VULKAN_BUFFER_BLOCK_SIZE                (64 * 1024)
 
 #define VULKAN_MAX_SWAPCHAIN_IMAGES             8
+#define VULKAN_MAX_ASYNC_READBACKS              2
 
 #define VULKAN_DIRTY_DYNAMIC_BIT                0x0001
 
@@ -223,6 +224,30 @@ struct vk_texture
    bool mipmap;
 };
 
+enum vk_async_readback_state
+{
+   VK_ASYNC_READBACK_FREE = 0,
+   /* Waiting for the next frame */
+   VK_ASYNC_READBACK_QUEUED,
+   /* Copy recorded into the frame's command buffer */
+   VK_ASYNC_READBACK_RECORDED,
+   /* Submitted, waiting for the fence */
+   VK_ASYNC_READBACK_PENDING,
+   /* Handed out until released */
+   VK_ASYNC_READBACK_DONE
+};
+
+/* Screenshot readback into a staging buffer, see
+ * video_driver_read_viewport_async() */
+struct vk_async_readback
+{
+   struct vk_texture staging;
+   VkFence fence;
+   unsigned width;
+   unsigned height;
+   enum vk_async_readback_state state;
+};
+
 struct vk_buffer
 {
    VkDeviceSize size;      /* uint64_t alignment */
@@ -342,8 +367,10 @@ typedef struct vk
       struct scaler_ctx scaler_bgr;
       struct scaler_ctx scaler_rgb;
       struct vk_texture staging[VULKAN_MAX_SWAPCHAIN_IMAGES];
+      struct vk_async_readback async[VULKAN_MAX_ASYNC_READBACKS];
       bool pending;
       bool streamed;
+      bool async_queued;
    } readback;
 
    struct
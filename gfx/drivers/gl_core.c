@@ -38,6 +38,7 @@
 #endif
 
 #include "../../KingStation.h"
+#include "../../performance_trace.h"
 #include "../../verbosity.h"
 
 #ifdef HAVE_THREADS
@@ -272,6 +273,79 @@ static void gl_core_pbo_async_readback(gl_core_t *gl)
    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 }
 
+static void gl_core_deinit_readbacks(gl_core_t *gl)
+{
+   unsigned i;
+
+   for (i = 0; i < GL_CORE_NUM_READBACKS; i++)
+   {
+      struct gl_core_readback *readback = &gl->readbacks[i];
+
+      if (readback->state == GL_CORE_READBACK_MAPPED)
+      {
+         glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo);
+         glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+         glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+      }
+      if (readback->fence)
+         glDeleteSync(readback->fence);
+      if (readback->pbo != 0)
+         glDeleteBuffers(1, &readback->pbo);
+   }
+
+   memset(gl->readbacks, 0, sizeof(gl->readbacks));
+   gl->readback_queued = false;
+}
+
+/* Copies the viewport into the PBOs of all queued
+ * readbacks. This only queues the copy: the GPU does
+ * it when it gets there, and the fence tells when. */
+static void gl_core_readback_issue(gl_core_t *gl)
+{
+   unsigned i;
+   unsigned size = gl->vp.width * gl->vp.height * sizeof(uint32_t);
+
+   performance_trace_begin("gl_core_readback_queue");
+
+   glPixelStorei(GL_PACK_ALIGNMENT, 4);
+   glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+#ifndef HAVE_OPENGLES
+   glReadBuffer(GL_BACK);
+#endif
+
+   for (i = 0; i < GL_CORE_NUM_READBACKS; i++)
+   {
+      struct gl_core_readback *readback = &gl->readbacks[i];
+
+      if (readback->state != GL_CORE_READBACK_QUEUED)
+         continue;
+
+      if (readback->pbo == 0)
+         glGenBuffers(1, &readback->pbo);
+
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo);
+      if (readback->size != size)
+      {
+         glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+         readback->size = size;
+      }
+
+      glReadPixels(gl->vp.x, gl->vp.y,
+                   gl->vp.width, gl->vp.height,
+                   GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+      readback->fence  = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      readback->width  = gl->vp.width;
+      readback->height = gl->vp.height;
+      readback->state  = GL_CORE_READBACK_PENDING;
+   }
+
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+   gl->readback_queued = false;
+
+   performance_trace_end("gl_core_readback_queue");
+}
+
 static void gl_core_fence_iterate(gl_core_t *gl, unsigned hard_sync_frames)
 {
    if (gl->fence_count < GL_CORE_NUM_FENCES)
@@ -593,6 +667,7 @@ static void gl_core_destroy_resources(gl_core_t *gl)
 #endif
    gl_core_deinit_fences(gl);
    gl_core_deinit_pbo_readback(gl);
+   gl_core_deinit_readbacks(gl);
    gl_core_deinit_hw_render(gl);
 }
 
@@ -1750,6 +1825,108 @@ error:
    return false;
 }
 
+static int gl_core_read_viewport_async(void *data)
+{
+   unsigned i;
+   gl_core_t *gl = (gl_core_t*)data;
+
+   if (!gl)
+      return -1;
+
+   for (i = 0; i < GL_CORE_NUM_READBACKS; i++)
+   {
+      if (gl->readbacks[i].state == GL_CORE_READBACK_FREE)
+      {
+         gl->readbacks[i].state = GL_CORE_READBACK_QUEUED;
+         gl->readback_queued    = true;
+         return (int)i;
+      }
+   }
+
+   return -1;
+}
+
+static bool gl_core_read_viewport_async_poll(void *data, unsigned slot,
+      video_viewport_readback_t *out)
+{
+   GLenum status;
+   const void *ptr                   = NULL;
+   gl_core_t *gl                     = (gl_core_t*)data;
+   struct gl_core_readback *readback = NULL;
+
+   if (!gl || slot >= GL_CORE_NUM_READBACKS)
+      return false;
+
+   readback = &gl->readbacks[slot];
+
+   if (readback->state != GL_CORE_READBACK_PENDING)
+      return false;
+
+   gl_core_context_bind_hw_render(gl, false);
+
+   /* Zero timeout, this only checks the fence */
+   performance_trace_begin("gl_core_readback_fence");
+   status = glClientWaitSync(readback->fence, 0, 0);
+   performance_trace_end("gl_core_readback_fence");
+
+   if (     status != GL_ALREADY_SIGNALED
+         && status != GL_CONDITION_SATISFIED
+         && status != GL_WAIT_FAILED)
+   {
+      gl_core_context_bind_hw_render(gl, true);
+      return false;
+   }
+
+   glDeleteSync(readback->fence);
+   readback->fence = NULL;
+
+   /* Rows are bottom-up, as GL has them */
+   performance_trace_begin("gl_core_readback_map");
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo);
+   ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+         readback->size, GL_MAP_READ_BIT);
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+   performance_trace_end("gl_core_readback_map");
+
+   gl_core_context_bind_hw_render(gl, true);
+
+   readback->state = ptr ? GL_CORE_READBACK_MAPPED : GL_CORE_READBACK_FREE;
+   out->data       = (const uint8_t*)ptr;
+   out->pitch      = readback->width * sizeof(uint32_t);
+   out->width      = readback->width;
+   out->height     = readback->height;
+   out->rgba       = true;
+   return true;
+}
+
+static void gl_core_read_viewport_async_release(void *data, unsigned slot)
+{
+   gl_core_t *gl                     = (gl_core_t*)data;
+   struct gl_core_readback *readback = NULL;
+
+   if (!gl || slot >= GL_CORE_NUM_READBACKS)
+      return;
+
+   readback = &gl->readbacks[slot];
+
+   gl_core_context_bind_hw_render(gl, false);
+
+   if (readback->state == GL_CORE_READBACK_MAPPED)
+   {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+   }
+
+   if (readback->fence)
+      glDeleteSync(readback->fence);
+
+   gl_core_context_bind_hw_render(gl, true);
+
+   readback->fence = NULL;
+   readback->state = GL_CORE_READBACK_FREE;
+}
+
 static void gl_core_update_cpu_texture(gl_core_t *gl,
                                        struct gl_core_streamed_texture *streamed,
                                        const void *frame, unsigned width, unsigned height, unsigned pitch)
@@ -1976,6 +2153,9 @@ static bool gl_core_frame(void *data, const void *frame,
    if (gl->ctx_driver->update_window_title)
       gl->ctx_driver->update_window_title(gl->ctx_data);
 
+   if (gl->readback_queued)
+      gl_core_readback_issue(gl);
+
    if (gl->readback_buffer_screenshot)
    {
       /* For screenshots, just do the regular slow readback. */
@@ -2382,6 +2562,9 @@ video_driver_t video_gl_core = {
    gl_core_get_poke_interface,
    gl_core_wrap_type_to_enum,
 #ifdef HAVE_GFX_WIDGETS
-   gl_core_gfx_widgets_enabled
+   gl_core_gfx_widgets_enabled,
 #endif
+   gl_core_read_viewport_async,
+   gl_core_read_viewport_async_poll,
+   gl_core_read_viewport_async_release
 };
@@ -51,6 +51,7 @@
 #endif
 
 #include "../../KingStation.h"
+#include "../../performance_trace.h"
 #include "../../verbosity.h"
 
 #include "../video_coord_array.h"
@@ -918,6 +919,21 @@ static void vulkan_deinit_static_resources(vk_t *vk)
          vulkan_destroy_texture(
                vk->context->device,
                &vk->readback.staging[i]);
+
+   for (i = 0; i < VULKAN_MAX_ASYNC_READBACKS; i++)
+   {
+      struct vk_async_readback *async = &vk->readback.async[i];
+
+      if (async->state == VK_ASYNC_READBACK_PENDING)
+         vkWaitForFences(vk->context->device, 1, &async->fence,
+               VK_TRUE, UINT64_MAX);
+      if (async->fence != VK_NULL_HANDLE)
+         vkDestroyFence(vk->context->device, async->fence, NULL);
+      if (async->staging.memory != VK_NULL_HANDLE)
+         vulkan_destroy_texture(vk->context->device, &async->staging);
+   }
+   memset(vk->readback.async, 0, sizeof(vk->readback.async));
+   vk->readback.async_queued = false;
 }
 
 static void vulkan_deinit_resources(vk_t *vk)
@@ -1632,6 +1648,105 @@ static void vulkan_readback(vk_t *vk)
          1, &barrier, 0, NULL, 0, NULL);
 }
 
+/* Records a copy of the viewport into the staging buffer of
+ * every queued asynchronous readback. The fences are submitted
+ * after the frame, see vulkan_readback_async_submit(). */
+static void vulkan_readback_async(vk_t *vk)
+{
+   unsigned i;
+   VkBufferImageCopy region;
+   VkMemoryBarrier barrier;
+   struct video_viewport vp;
+
+   performance_trace_begin("vulkan_readback_queue");
+
+   vulkan_viewport_info(vk, &vp);
+
+   region.bufferOffset                    = 0;
+   region.bufferRowLength                 = 0;
+   region.bufferImageHeight               = 0;
+   region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+   region.imageSubresource.mipLevel       = 0;
+   region.imageSubresource.baseArrayLayer = 0;
+   region.imageSubresource.layerCount     = 1;
+   region.imageOffset.x                   = vp.x;
+   region.imageOffset.y                   = vp.y;
+   region.imageOffset.z                   = 0;
+   region.imageExtent.width               = vp.width;
+   region.imageExtent.height              = vp.height;
+   region.imageExtent.depth               = 1;
+
+   for (i = 0; i < VULKAN_MAX_ASYNC_READBACKS; i++)
+   {
+      struct vk_async_readback *async = &vk->readback.async[i];
+
+      if (async->state != VK_ASYNC_READBACK_QUEUED)
+         continue;
+
+      if (     async->staging.memory == VK_NULL_HANDLE
+            || async->staging.width  != vk->vp.width
+            || async->staging.height != vk->vp.height)
+         async->staging = vulkan_create_texture(vk,
+               async->staging.memory != VK_NULL_HANDLE
+               ? &async->staging : NULL,
+               vk->vp.width, vk->vp.height,
+               VK_FORMAT_B8G8R8A8_UNORM,
+               NULL, NULL, VULKAN_TEXTURE_READBACK);
+
+      vkCmdCopyImageToBuffer(vk->cmd, vk->backbuffer->image,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            async->staging.buffer,
+            1, &region);
+
+      async->width  = vp.width;
+      async->height = vp.height;
+      async->state  = VK_ASYNC_READBACK_RECORDED;
+   }
+
+   /* Make the data visible to host. */
+   barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+   barrier.pNext         = NULL;
+   barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+   barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+   vkCmdPipelineBarrier(vk->cmd,
+         VK_PIPELINE_STAGE_TRANSFER_BIT,
+         VK_PIPELINE_STAGE_HOST_BIT, 0,
+         1, &barrier, 0, NULL, 0, NULL);
+
+   vk->readback.async_queued = false;
+
+   performance_trace_end("vulkan_readback_queue");
+}
+
+/* An empty submission signals its fence once everything
+ * submitted before it, i.e. the frame with the copy, is done.
+ * Called with the queue lock held. */
+static void vulkan_readback_async_submit(vk_t *vk)
+{
+   unsigned i;
+
+   for (i = 0; i < VULKAN_MAX_ASYNC_READBACKS; i++)
+   {
+      struct vk_async_readback *async = &vk->readback.async[i];
+
+      if (async->state != VK_ASYNC_READBACK_RECORDED)
+         continue;
+
+      if (async->fence == VK_NULL_HANDLE)
+      {
+         VkFenceCreateInfo fence_info = {
+            VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+         vkCreateFence(vk->context->device, &fence_info, NULL,
+               &async->fence);
+      }
+      else
+         vkResetFences(vk->context->device, 1, &async->fence);
+
+      vkQueueSubmit(vk->context->queue, 0, NULL, async->fence);
+      async->state = VK_ASYNC_READBACK_PENDING;
+   }
+}
+
 static void vulkan_inject_black_frame(vk_t *vk, video_frame_info_t *video_info,
       void *context_data)
 {
@@ -2087,7 +2202,9 @@ static bool vulkan_frame(void *data, const void *frame,
          && vk->context->has_acquired_swapchain
       )
    {
-      if (vk->readback.pending || vk->readback.streamed)
+      if (     vk->readback.pending
+            || vk->readback.streamed
+            || vk->readback.async_queued)
       {
          /* We cannot safely read back from an image which
           * has already been presented as we need to
@@ -2106,7 +2223,10 @@ static bool vulkan_frame(void *data, const void *frame,
                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
                VK_PIPELINE_STAGE_TRANSFER_BIT);
 
-         vulkan_readback(vk);
+         if (vk->readback.pending || vk->readback.streamed)
+            vulkan_readback(vk);
+         if (vk->readback.async_queued)
+            vulkan_readback_async(vk);
 
          /* Prepare for presentation after transfers are complete. */
          VULKAN_IMAGE_LAYOUT_TRANSITION(
@@ -2234,6 +2354,7 @@ static bool vulkan_frame(void *data, const void *frame,
    vkQueueSubmit(vk->context->queue, 1,
          &submit_info, vk->context->swapchain_fences[frame_index]);
    vk->context->swapchain_fences_signalled[frame_index] = true;
+   vulkan_readback_async_submit(vk);
 #ifdef HAVE_THREADS
    slock_unlock(vk->context->queue_lock);
 #endif
@@ -2640,6 +2761,107 @@ static void vulkan_viewport_info(void *data, struct video_viewport *vp)
    vp->full_height = height;
 }
 
+static int vulkan_read_viewport_async(void *data)
+{
+   unsigned i;
+   vk_t *vk = (vk_t*)data;
+
+   if (!vk)
+      return -1;
+
+   for (i = 0; i < VULKAN_MAX_ASYNC_READBACKS; i++)
+   {
+      if (vk->readback.async[i].state == VK_ASYNC_READBACK_FREE)
+      {
+         vk->readback.async[i].state = VK_ASYNC_READBACK_QUEUED;
+         vk->readback.async_queued   = true;
+         return (int)i;
+      }
+   }
+
+   return -1;
+}
+
+static bool vulkan_read_viewport_async_poll(void *data, unsigned slot,
+      video_viewport_readback_t *out)
+{
+   VkResult fence_status;
+   struct vk_texture *staging      = NULL;
+   struct vk_async_readback *async = NULL;
+   vk_t *vk                        = (vk_t*)data;
+
+   if (!vk || slot >= VULKAN_MAX_ASYNC_READBACKS)
+      return false;
+
+   async = &vk->readback.async[slot];
+
+   if (async->state != VK_ASYNC_READBACK_PENDING)
+      return false;
+
+   performance_trace_begin("vulkan_readback_fence");
+   fence_status = vkGetFenceStatus(vk->context->device, async->fence);
+   performance_trace_end("vulkan_readback_fence");
+
+   if (fence_status != VK_SUCCESS)
+      return false;
+
+   staging      = &async->staging;
+   async->state = VK_ASYNC_READBACK_DONE;
+   out->data    = NULL;
+
+   performance_trace_begin("vulkan_readback_map");
+   if (!staging->mapped)
+   {
+      VK_MAP_PERSISTENT_TEXTURE(vk->context->device, staging);
+   }
+
+   if (staging->need_manual_cache_management
+         && staging->memory != VK_NULL_HANDLE)
+      VULKAN_SYNC_TEXTURE_TO_CPU(vk->context->device, staging->memory);
+   performance_trace_end("vulkan_readback_map");
+
+   switch (vk->context->swapchain_format)
+   {
+      case VK_FORMAT_B8G8R8A8_UNORM:
+         out->rgba = false;
+         break;
+      case VK_FORMAT_R8G8B8A8_UNORM:
+      case VK_FORMAT_A8B8G8R8_UNORM_PACK32:
+         out->rgba = true;
+         break;
+      default:
+         KINGSN_ERR("[Vulkan]: Unexpected swapchain format. Cannot readback.\n");
+         return true;
+   }
+
+   /* Rows are top-down */
+   if (staging->mapped)
+      out->data = (const uint8_t*)staging->mapped
+         + (async->height - 1) * staging->stride;
+   out->pitch   = -(int)staging->stride;
+   out->width   = async->width;
+   out->height  = async->height;
+   return true;
+}
+
+static void vulkan_read_viewport_async_release(void *data, unsigned slot)
+{
+   struct vk_async_readback *async = NULL;
+   vk_t *vk                        = (vk_t*)data;
+
+   if (!vk || slot >= VULKAN_MAX_ASYNC_READBACKS)
+      return;
+
+   async = &vk->readback.async[slot];
+
+   /* Only happens when a readback is dropped */
+   if (async->state == VK_ASYNC_READBACK_PENDING)
+      vkWaitForFences(vk->context->device, 1, &async->fence,
+            VK_TRUE, UINT64_MAX);
+
+   async->state = VK_ASYNC_READBACK_FREE;
+}
+
 static bool vulkan_read_viewport(void *data, uint8_t *buffer, bool is_idle)
 {
    struct vk_texture *staging       = NULL;
@@ -3023,6 +3245,9 @@ video_driver_t video_vulkan = {
    vulkan_get_poke_interface,
    NULL,                         /* vulkan_wrap_type_to_enum */
 #ifdef HAVE_GFX_WIDGETS
-   vulkan_gfx_widgets_enabled
+   vulkan_gfx_widgets_enabled,
 #endif
+   vulkan_read_viewport_async,
+   vulkan_read_viewport_async_poll,
+   vulkan_read_viewport_async_release
 };
@@ -82,8 +82,101 @@ void gfx_thumbnail_set_fade_missing(bool fade_missing)
    p_gfx_thumb->fade_missing = fade_missing;
 }
 
+/* Sets the largest width or height at which the menu
+ * driver draws a thumbnail. Images are decoded and
+ * scaled down to fit a square of this size
+ * > If 'max_size' is 0, a size that covers the screen
+ *   is used */
+void gfx_thumbnail_set_max_size(unsigned max_size)
+{
+   gfx_thumbnail_state_t *p_gfx_thumb = gfx_thumb_get_ptr();
+
+   p_gfx_thumb->max_size = max_size;
+}
+
 /* Callbacks */
 
+/* Opens the thumbnail texture cache in 'dir', keeping
+ * it below 'size_limit' bytes. Any previously opened
+ * cache is closed first. Does nothing if 'dir' is empty
+ * or 'size_limit' is 0 */
+void gfx_thumbnail_open_cache(const char *dir, size_t size_limit)
+{
+   gfx_thumbnail_state_t *p_gfx_thumb = gfx_thumb_get_ptr();
+
+   gfx_thumbnail_close_cache();
+   p_gfx_thumb->cache = gfx_thumbnail_cache_new(dir, size_limit);
+}
+
+/* Closes the thumbnail texture cache. Pending image
+ * loads keep it alive until they complete */
+void gfx_thumbnail_close_cache(void)
+{
+   gfx_thumbnail_state_t *p_gfx_thumb = gfx_thumb_get_ptr();
+
+   gfx_thumbnail_cache_release(p_gfx_thumb->cache);
+   p_gfx_thumb->cache = NULL;
+}
+
+/* Returns the size thumbnails are decoded and scaled
+ * down to: the size set by the menu driver or, if there
+ * is none, the smallest power of two that covers the screen */
+static unsigned gfx_thumbnail_get_cache_max_size(
+      gfx_thumbnail_state_t *p_gfx_thumb)
+{
+   unsigned width    = 0;
+   unsigned height   = 0;
+   unsigned max_size = GFX_THUMBNAIL_CACHE_MIN_SIZE;
+
+   if (p_gfx_thumb->max_size > 0)
+   {
+      if (p_gfx_thumb->max_size < GFX_THUMBNAIL_CACHE_MIN_SIZE)
+         return GFX_THUMBNAIL_CACHE_MIN_SIZE;
+      if (p_gfx_thumb->max_size > GFX_THUMBNAIL_CACHE_MAX_SIZE)
+         return GFX_THUMBNAIL_CACHE_MAX_SIZE;
+      return p_gfx_thumb->max_size;
+   }
+
+   video_driver_get_size(&width, &height);
+
+   while (     (max_size < width || max_size < height)
+         &&    (max_size < GFX_THUMBNAIL_CACHE_MAX_SIZE))
+      max_size <<= 1;
+
+   return max_size;
+}
+
+/* Uploads the cached texture of 'path', if there is one.
+ * Cached textures are already scaled and colour converted,
+ * so this skips the image load task entirely */
+static bool gfx_thumbnail_upload_cached(
+      gfx_thumbnail_state_t *p_gfx_thumb,
+      const char *path, const gfx_thumbnail_cache_key_t *cache_key,
+      gfx_thumbnail_t *thumbnail)
+{
+   struct texture_image img;
+   bool uploaded              = false;
+   gfx_thumbnail_blob_t *blob = gfx_thumbnail_cache_map(
+         p_gfx_thumb->cache, path, cache_key, &img);
+
+   if (!blob)
+      return false;
+
+   uploaded = video_driver_texture_load(
+         &img, TEXTURE_FILTER_MIPMAP_LINEAR, &thumbnail->texture);
+
+   gfx_thumbnail_cache_unmap(blob);
+
+   if (!uploaded)
+      return false;
+
+   thumbnail->width  = img.width;
+   thumbnail->height = img.height;
+   thumbnail->status = GFX_THUMBNAIL_STATUS_AVAILABLE;
+
+   return true;
+}
+
 /* Fade animation callback - simply resets thumbnail
  * 'fade_active' status */
 static void gfx_thumbnail_fade_cb(void *userdata)
@@ -229,6 +322,9 @@ void gfx_thumbnail_cancel_pending_requests(void)
  *   GFX_THUMBNAIL_STATUS_MISSING
  * - If operation is successful, 'thumbnail->status' will be
  *   set to GFX_THUMBNAIL_STATUS_PENDING
+ * - If the image is in the texture cache, it is uploaded
+ *   immediately and 'thumbnail->status' will be set to
+ *   GFX_THUMBNAIL_STATUS_AVAILABLE
  * 'thumbnail' will be populated with texture info/metadata
  * once the image load is complete
  * NOTE 1: Must be called *after* gfx_thumbnail_set_system()
@@ -268,8 +364,22 @@ void gfx_thumbnail_request(
    {
       if (path_is_valid(thumbnail_path))
       {
-         gfx_thumbnail_tag_t *thumbnail_tag =
-               (gfx_thumbnail_tag_t*)malloc(sizeof(gfx_thumbnail_tag_t));
+         gfx_thumbnail_cache_key_t cache_key;
+         gfx_thumbnail_tag_t *thumbnail_tag = NULL;
+         bool supports_rgba                 = video_driver_supports_rgba();
+         unsigned max_size                  = gfx_thumbnail_get_cache_max_size(
+               p_gfx_thumb);
+         bool use_cache                     = p_gfx_thumb->cache &&
+               gfx_thumbnail_cache_stat(thumbnail_path, max_size,
+                     gfx_thumbnail_upscale_threshold,
+                     supports_rgba, &cache_key);
+
+         if (use_cache && gfx_thumbnail_upload_cached(
+                  p_gfx_thumb, thumbnail_path, &cache_key, thumbnail))
+            goto end;
+
+         thumbnail_tag = (gfx_thumbnail_tag_t*)
+               malloc(sizeof(gfx_thumbnail_tag_t));
 
          if (!thumbnail_tag)
             goto end;
@@ -280,10 +390,11 @@ void gfx_thumbnail_request(
 
          /* Would like to cancel any existing image load tasks
           * here, but can't see how to do it... */
-         if (task_push_image_load(
-               thumbnail_path, video_driver_supports_rgba(),
-               gfx_thumbnail_upscale_threshold,
-               gfx_thumbnail_handle_upload, thumbnail_tag))
+         if (task_push_thumbnail_load(
+                  thumbnail_path, supports_rgba,
+                  gfx_thumbnail_upscale_threshold, max_size,
+                  use_cache ? p_gfx_thumb->cache : NULL, &cache_key,
+                  gfx_thumbnail_handle_upload, thumbnail_tag))
             thumbnail->status = GFX_THUMBNAIL_STATUS_PENDING;
       }
 #ifdef HAVE_NETWORKING
@@ -380,9 +491,10 @@ void gfx_thumbnail_request_file(
 
    /* Would like to cancel any existing image load tasks
     * here, but can't see how to do it... */
-   if (task_push_image_load(
+   if (task_push_thumbnail_load(
          file_path, video_driver_supports_rgba(),
          gfx_thumbnail_upscale_threshold,
+         gfx_thumbnail_get_cache_max_size(p_gfx_thumb), NULL, NULL,
          gfx_thumbnail_handle_upload, thumbnail_tag))
       thumbnail->status = GFX_THUMBNAIL_STATUS_PENDING;
 }
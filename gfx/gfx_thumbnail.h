@@ -29,6 +29,7 @@
 #include <boolean.h>
 
 #include "gfx_thumbnail_path.h"
+#include "gfx_thumbnail_cache.h"
 
 KS_BEGIN_DECLS
 
@@ -108,6 +109,10 @@ struct gfx_thumbnail_state
     * at the time when the load completes */
    uint64_t list_id;
 
+   /* On-disk cache of scaled thumbnail textures,
+    * NULL when disabled */
+   gfx_thumbnail_cache_t *cache;
+
    /* When streaming thumbnails, to minimise the processing
     * of unnecessary images (i.e. when scrolling rapidly through
     * playlists), we delay loading until an entry has been on screen
@@ -117,6 +122,10 @@ struct gfx_thumbnail_state
    /* Duration in ms of the thumbnail 'fade in' animation */
    float fade_duration;
 
+   /* Largest width or height at which the menu driver
+    * draws a thumbnail, 0 if it has not set one */
+   unsigned max_size;
+
    /* When true, 'fade in' animation will also be
     * triggered for missing thumbnails */
    bool fade_missing;
@@ -144,6 +153,23 @@ void gfx_thumbnail_set_fade_duration(float duration);
  *   any 'thumbnail unavailable' notifications */
 void gfx_thumbnail_set_fade_missing(bool fade_missing);
 
+/* Sets the largest width or height at which the menu
+ * driver draws a thumbnail. Images are decoded and
+ * scaled down to fit a square of this size
+ * > If 'max_size' is 0, a size that covers the screen
+ *   is used */
+void gfx_thumbnail_set_max_size(unsigned max_size);
+
+/* Opens the thumbnail texture cache in 'dir', keeping
+ * it below 'size_limit' bytes. Any previously opened
+ * cache is closed first. Does nothing if 'dir' is empty
+ * or 'size_limit' is 0 */
+void gfx_thumbnail_open_cache(const char *dir, size_t size_limit);
+
+/* Closes the thumbnail texture cache. Pending image
+ * loads keep it alive until they complete */
+void gfx_thumbnail_close_cache(void);
+
 /* Core interface */
 
 /* When called, prevents the handling of any pending
@@ -159,6 +185,9 @@ void gfx_thumbnail_cancel_pending_requests(void);
  *   MUI_THUMBNAIL_STATUS_MISSING
  * - If operation is successful, 'thumbnail->status' will be
  *   set to MUI_THUMBNAIL_STATUS_PENDING
+ * - If the image is in the texture cache, it is uploaded
+ *   immediately and 'thumbnail->status' will be set to
+ *   GFX_THUMBNAIL_STATUS_AVAILABLE
  * 'thumbnail' will be populated with texture info/metadata
  * once the image load is complete
  * NOTE 1: Must be called *after* gfx_thumbnail_set_system()
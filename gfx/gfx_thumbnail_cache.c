@@ -0,0 +1,801 @@
+/* Copyright  (C) 2010-2020 The KingStation team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (gfx_thumbnail_cache.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include <array/rhmap.h>
+#include <compat/strl.h>
+#include <file/file_path.h>
+#include <lists/dir_list.h>
+#include <lists/string_list.h>
+#include <streams/file_stream.h>
+#include <string/stdstring.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#include "gfx_thumbnail_cache.h"
+
+#include "../verbosity.h"
+
+#define THUMBNAIL_CACHE_MAGIC     0x4254534B /* "KSTB" */
+#define THUMBNAIL_CACHE_VERSION   1
+#define THUMBNAIL_CACHE_EXT       "tex"
+#define THUMBNAIL_CACHE_INDEX     "index"
+/* Pixels start on a cache line boundary */
+#define THUMBNAIL_CACHE_ALIGN     64
+/* 16 hex digits, the dot and the extension */
+#define THUMBNAIL_CACHE_NAME_LEN  20
+
+/* Every blob starts with this header, followed by the
+ * source path and the pixels. Blobs never leave the
+ * machine that wrote them, so fields are native endian */
+typedef struct
+{
+   uint32_t magic;
+   uint32_t version;
+   uint64_t mtime;
+   uint64_t size;
+   uint32_t max_size;
+   uint32_t upscale_threshold;
+   uint32_t supports_rgba;
+   uint32_t width;
+   uint32_t height;
+   uint32_t path_len;
+} thumbnail_blob_header_t;
+
+typedef struct thumbnail_cache_entry
+{
+   struct thumbnail_cache_entry *prev; /* More recently used */
+   struct thumbnail_cache_entry *next; /* Less recently used */
+   uint64_t hash;
+   uint64_t bytes;
+} thumbnail_cache_entry_t;
+
+struct gfx_thumbnail_cache
+{
+#ifdef HAVE_THREADS
+   slock_t *lock;
+#endif
+   /* Folded hash -> entry */
+   thumbnail_cache_entry_t **map;
+   thumbnail_cache_entry_t *head;
+   thumbnail_cache_entry_t *tail;
+   uint64_t bytes;
+   uint64_t size_limit;
+   unsigned refs;
+   unsigned tmp_id;
+   char dir[PATH_MAX_LENGTH];
+};
+
+struct gfx_thumbnail_blob
+{
+   void *data;
+   size_t size;
+   bool mapped;
+};
+
+static void thumbnail_cache_lock(gfx_thumbnail_cache_t *cache)
+{
+#ifdef HAVE_THREADS
+   slock_lock(cache->lock);
+#endif
+}
+
+static void thumbnail_cache_unlock(gfx_thumbnail_cache_t *cache)
+{
+#ifdef HAVE_THREADS
+   slock_unlock(cache->lock);
+#endif
+}
+
+/* 64-bit FNV-1a */
+static uint64_t thumbnail_cache_hash_bytes(uint64_t hash,
+      const void *data, size_t len)
+{
+   const uint8_t *p = (const uint8_t*)data;
+
+   while (len--)
+   {
+      hash ^= *p++;
+      hash *= 0x100000001b3ULL;
+   }
+
+   return hash;
+}
+
+static uint64_t thumbnail_cache_hash(const char *path,
+      const gfx_thumbnail_cache_key_t *key)
+{
+   uint64_t hash    = 0xcbf29ce484222325ULL;
+   uint32_t vals[3];
+
+   vals[0] = key->max_size;
+   vals[1] = key->upscale_threshold;
+   vals[2] = key->supports_rgba ? 1 : 0;
+
+   hash = thumbnail_cache_hash_bytes(hash, path, strlen(path));
+   hash = thumbnail_cache_hash_bytes(hash, &key->mtime, sizeof(key->mtime));
+   hash = thumbnail_cache_hash_bytes(hash, &key->size, sizeof(key->size));
+   hash = thumbnail_cache_hash_bytes(hash, vals, sizeof(vals));
+
+   return hash;
+}
+
+/* rhmap keys are 32 bits wide, entries keep the full
+ * hash to tell collisions apart */
+static uint32_t thumbnail_cache_fold(uint64_t hash)
+{
+   uint32_t folded = (uint32_t)(hash ^ (hash >> 32));
+   return folded ? folded : 1;
+}
+
+static void thumbnail_cache_blob_path(gfx_thumbnail_cache_t *cache,
+      uint64_t hash, char *s, size_t len)
+{
+   char name[THUMBNAIL_CACHE_NAME_LEN + 1];
+
+   snprintf(name, sizeof(name), "%08x%08x." THUMBNAIL_CACHE_EXT,
+         (unsigned)(hash >> 32), (unsigned)(hash & 0xffffffff));
+   fill_pathname_join(s, cache->dir, name, len);
+}
+
+/* Parses a blob file name back into its hash */
+static bool thumbnail_cache_parse_name(const char *name, uint64_t *hash)
+{
+   unsigned i;
+   uint64_t val = 0;
+
+   for (i = 0; i < 16; i++)
+   {
+      char c = name[i];
+
+      if (c >= '0' && c <= '9')
+         val = (val << 4) | (uint64_t)(c - '0');
+      else if (c >= 'a' && c <= 'f')
+         val = (val << 4) | (uint64_t)(c - 'a' + 10);
+      else
+         return false;
+   }
+
+   if (!string_is_equal(name + 16, "." THUMBNAIL_CACHE_EXT))
+      return false;
+
+   *hash = val;
+   return true;
+}
+
+/* LRU list, most recently used entry at the head */
+
+static void thumbnail_cache_unlink(gfx_thumbnail_cache_t *cache,
+      thumbnail_cache_entry_t *entry)
+{
+   if (entry->prev)
+      entry->prev->next = entry->next;
+   else
+      cache->head       = entry->next;
+
+   if (entry->next)
+      entry->next->prev = entry->prev;
+   else
+      cache->tail       = entry->prev;
+
+   entry->prev = NULL;
+   entry->next = NULL;
+}
+
+static void thumbnail_cache_push_front(gfx_thumbnail_cache_t *cache,
+      thumbnail_cache_entry_t *entry)
+{
+   entry->prev = NULL;
+   entry->next = cache->head;
+
+   if (cache->head)
+      cache->head->prev = entry;
+   else
+      cache->tail       = entry;
+
+   cache->head = entry;
+}
+
+static thumbnail_cache_entry_t *thumbnail_cache_find(
+      gfx_thumbnail_cache_t *cache, uint64_t hash)
+{
+   thumbnail_cache_entry_t *entry = RHMAP_GET(cache->map,
+         thumbnail_cache_fold(hash));
+
+   if (entry && entry->hash == hash)
+      return entry;
+   return NULL;
+}
+
+static void thumbnail_cache_remove(gfx_thumbnail_cache_t *cache,
+      thumbnail_cache_entry_t *entry, bool delete_blob)
+{
+   if (delete_blob)
+   {
+      char blob_path[PATH_MAX_LENGTH];
+      thumbnail_cache_blob_path(cache, entry->hash,
+            blob_path, sizeof(blob_path));
+      filestream_delete(blob_path);
+   }
+
+   thumbnail_cache_unlink(cache, entry);
+   (void)RHMAP_DEL(cache->map, thumbnail_cache_fold(entry->hash));
+   cache->bytes -= entry->bytes;
+   free(entry);
+}
+
+/* Adds (or refreshes) an entry and makes it the most
+ * recently used one */
+static thumbnail_cache_entry_t *thumbnail_cache_add(
+      gfx_thumbnail_cache_t *cache, uint64_t hash, uint64_t bytes)
+{
+   thumbnail_cache_entry_t *entry = RHMAP_GET(cache->map,
+         thumbnail_cache_fold(hash));
+
+   if (entry)
+   {
+      if (entry->hash == hash)
+      {
+         cache->bytes  -= entry->bytes;
+         cache->bytes  += bytes;
+         entry->bytes   = bytes;
+         thumbnail_cache_unlink(cache, entry);
+         thumbnail_cache_push_front(cache, entry);
+         return entry;
+      }
+
+      /* Only one blob per folded hash can be tracked */
+      thumbnail_cache_remove(cache, entry, true);
+   }
+
+   if (!(entry = (thumbnail_cache_entry_t*)malloc(sizeof(*entry))))
+      return NULL;
+
+   entry->hash  = hash;
+   entry->bytes = bytes;
+   thumbnail_cache_push_front(cache, entry);
+   RHMAP_SET(cache->map, thumbnail_cache_fold(hash), entry);
+   cache->bytes += bytes;
+
+   return entry;
+}
+
+static void thumbnail_cache_evict(gfx_thumbnail_cache_t *cache,
+      const thumbnail_cache_entry_t *keep)
+{
+   while (     cache->bytes > cache->size_limit
+         &&    cache->tail
+         &&    cache->tail != keep)
+      thumbnail_cache_remove(cache, cache->tail, true);
+}
+
+/* Drops the entry for 'hash' if it is (still) there */
+static void thumbnail_cache_forget(gfx_thumbnail_cache_t *cache,
+      uint64_t hash)
+{
+   thumbnail_cache_entry_t *entry = NULL;
+
+   thumbnail_cache_lock(cache);
+   if ((entry = thumbnail_cache_find(cache, hash)))
+      thumbnail_cache_remove(cache, entry, true);
+   thumbnail_cache_unlock(cache);
+}
+
+/* The index lists blobs from least to most recently
+ * used, one "<name> <bytes>" line each */
+static bool thumbnail_cache_load_index(gfx_thumbnail_cache_t *cache,
+      const char *index_path)
+{
+   unsigned version = 0;
+   void *buf        = NULL;
+   int64_t len      = 0;
+   char *line       = NULL;
+   char *next       = NULL;
+
+   if (!path_is_valid(index_path))
+      return false;
+
+   if (!filestream_read_file(index_path, &buf, &len) || len <= 0)
+   {
+      free(buf);
+      return false;
+   }
+
+   for (line = (char*)buf; *line; line = next)
+   {
+      uint64_t hash;
+      char *end      = NULL;
+      uint64_t bytes = 0;
+
+      if ((next = strchr(line, '\n')))
+         *next++ = '\0';
+      else
+         next    = line + strlen(line);
+
+      if (line == (char*)buf)
+      {
+         if (     sscanf(line, "KSTC %u", &version) != 1
+               || version != THUMBNAIL_CACHE_VERSION)
+            goto error;
+         continue;
+      }
+
+      if (     strlen(line) < THUMBNAIL_CACHE_NAME_LEN + 2
+            || line[THUMBNAIL_CACHE_NAME_LEN] != ' ')
+         goto error;
+
+      line[THUMBNAIL_CACHE_NAME_LEN] = '\0';
+
+      if (!thumbnail_cache_parse_name(line, &hash))
+         goto error;
+
+      bytes = strtoull(line + THUMBNAIL_CACHE_NAME_LEN + 1, &end, 10);
+      if (!bytes || *end != '\0')
+         goto error;
+
+      if (!thumbnail_cache_add(cache, hash, bytes))
+         goto error;
+   }
+
+   if (!version)
+      goto error;
+
+   free(buf);
+   return true;
+
+error:
+   KINGSN_WARN("[Thumbnails]: Ignoring invalid cache index \"%s\".\n",
+         index_path);
+   free(buf);
+   while (cache->head)
+      thumbnail_cache_remove(cache, cache->head, false);
+   return false;
+}
+
+/* Without an index, the blobs on disk are taken in
+ * no particular order. Left over temporary files of
+ * interrupted writes are deleted */
+static void thumbnail_cache_scan(gfx_thumbnail_cache_t *cache)
+{
+   size_t i;
+   struct string_list *list = dir_list_new(cache->dir,
+         THUMBNAIL_CACHE_EXT "|tmp", false, false, false, false);
+
+   if (!list)
+      return;
+
+   for (i = 0; i < list->size; i++)
+   {
+      uint64_t hash;
+      const char *path = list->elems[i].data;
+
+      if (string_is_equal(path_get_extension(path), "tmp"))
+         filestream_delete(path);
+      else if (thumbnail_cache_parse_name(path_basename(path), &hash))
+      {
+         int32_t bytes = path_get_size(path);
+         if (bytes > 0)
+            thumbnail_cache_add(cache, hash, (uint64_t)bytes);
+      }
+   }
+
+   string_list_free(list);
+}
+
+static void thumbnail_cache_save_index(gfx_thumbnail_cache_t *cache)
+{
+   char index_path[PATH_MAX_LENGTH];
+   const thumbnail_cache_entry_t *entry = NULL;
+   size_t len                           = 0;
+   size_t cap                           = 16 +
+         RHMAP_LEN(cache->map) * (THUMBNAIL_CACHE_NAME_LEN + 22);
+   char *buf                            = (char*)malloc(cap);
+
+   if (!buf)
+      return;
+
+   fill_pathname_join(index_path, cache->dir,
+         THUMBNAIL_CACHE_INDEX, sizeof(index_path));
+
+   len = snprintf(buf, cap, "KSTC %u\n", THUMBNAIL_CACHE_VERSION);
+
+   for (entry = cache->tail; entry; entry = entry->prev)
+      len += snprintf(buf + len, cap - len,
+            "%08x%08x." THUMBNAIL_CACHE_EXT " %llu\n",
+            (unsigned)(entry->hash >> 32),
+            (unsigned)(entry->hash & 0xffffffff),
+            (unsigned long long)entry->bytes);
+
+   if (filestream_write_file(index_path, buf, len))
+      KINGSN_LOG("[Thumbnails]: Saved cache index with %u entries.\n",
+            (unsigned)RHMAP_LEN(cache->map));
+
+   free(buf);
+}
+
+gfx_thumbnail_cache_t *gfx_thumbnail_cache_new(const char *dir,
+      size_t size_limit)
+{
+   char index_path[PATH_MAX_LENGTH];
+   gfx_thumbnail_cache_t *cache = NULL;
+
+   if (string_is_empty(dir) || !size_limit)
+      return NULL;
+
+   if (!path_is_directory(dir) && !path_mkdir(dir))
+   {
+      KINGSN_WARN("[Thumbnails]: Cannot create cache directory \"%s\".\n",
+            dir);
+      return NULL;
+   }
+
+   if (!(cache = (gfx_thumbnail_cache_t*)calloc(1, sizeof(*cache))))
+      return NULL;
+
+#ifdef HAVE_THREADS
+   if (!(cache->lock = slock_new()))
+   {
+      free(cache);
+      return NULL;
+   }
+#endif
+
+   strlcpy(cache->dir, dir, sizeof(cache->dir));
+   cache->size_limit = size_limit;
+   cache->refs       = 1;
+
+   fill_pathname_join(index_path, dir,
+         THUMBNAIL_CACHE_INDEX, sizeof(index_path));
+
+   if (!thumbnail_cache_load_index(cache, index_path))
+      thumbnail_cache_scan(cache);
+
+   /* The index is only valid until blobs get added or
+    * evicted, it is written again when the cache is freed.
+    * If that never happens, the next start rescans */
+   filestream_delete(index_path);
+
+   thumbnail_cache_evict(cache, NULL);
+
+   KINGSN_LOG("[Thumbnails]: Opened cache \"%s\" with %u entries (%u kB).\n",
+         dir, (unsigned)RHMAP_LEN(cache->map),
+         (unsigned)(cache->bytes >> 10));
+
+   return cache;
+}
+
+void gfx_thumbnail_cache_retain(gfx_thumbnail_cache_t *cache)
+{
+   if (!cache)
+      return;
+
+   thumbnail_cache_lock(cache);
+   cache->refs++;
+   thumbnail_cache_unlock(cache);
+}
+
+void gfx_thumbnail_cache_release(gfx_thumbnail_cache_t *cache)
+{
+   unsigned refs;
+
+   if (!cache)
+      return;
+
+   thumbnail_cache_lock(cache);
+   refs = --cache->refs;
+   thumbnail_cache_unlock(cache);
+
+   if (refs)
+      return;
+
+   thumbnail_cache_save_index(cache);
+
+   while (cache->head)
+      thumbnail_cache_remove(cache, cache->head, false);
+   RHMAP_FREE(cache->map);
+
+#ifdef HAVE_THREADS
+   slock_free(cache->lock);
+#endif
+   free(cache);
+}
+
+bool gfx_thumbnail_cache_stat(const char *path,
+      unsigned max_size, unsigned upscale_threshold,
+      bool supports_rgba, gfx_thumbnail_cache_key_t *key)
+{
+   struct stat st;
+
+   if (string_is_empty(path) || stat(path, &st) != 0)
+      return false;
+
+   key->mtime             = (uint64_t)st.st_mtime;
+   key->size              = (uint64_t)st.st_size;
+   key->max_size          = max_size;
+   key->upscale_threshold = upscale_threshold;
+   key->supports_rgba     = supports_rgba;
+
+   return true;
+}
+
+static size_t thumbnail_cache_pixels_offset(size_t path_len)
+{
+   size_t offset = sizeof(thumbnail_blob_header_t) + path_len;
+   return (offset + THUMBNAIL_CACHE_ALIGN - 1)
+      & ~(size_t)(THUMBNAIL_CACHE_ALIGN - 1);
+}
+
+static bool thumbnail_cache_blob_load(gfx_thumbnail_blob_t *blob,
+      const char *blob_path)
+{
+#ifdef HAVE_MMAP
+   struct stat st;
+   int fd = open(blob_path, O_RDONLY);
+
+   if (fd < 0)
+      return false;
+
+   if (fstat(fd, &st) == 0 && st.st_size > 0)
+   {
+      /* Private and writable, so that video drivers which
+       * convert pixels in place do not touch the file */
+      void *data = mmap(NULL, (size_t)st.st_size,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+      if (data != MAP_FAILED)
+      {
+         blob->data   = data;
+         blob->size   = (size_t)st.st_size;
+         blob->mapped = true;
+      }
+   }
+
+   close(fd);
+
+   if (blob->data)
+      return true;
+#endif
+
+   {
+      void *buf   = NULL;
+      int64_t len = 0;
+
+      if (!path_is_valid(blob_path))
+         return false;
+
+      if (!filestream_read_file(blob_path, &buf, &len) || len <= 0)
+      {
+         free(buf);
+         return false;
+      }
+
+      blob->data = buf;
+      blob->size = (size_t)len;
+   }
+
+   return true;
+}
+
+gfx_thumbnail_blob_t *gfx_thumbnail_cache_map(
+      gfx_thumbnail_cache_t *cache, const char *path,
+      const gfx_thumbnail_cache_key_t *key,
+      struct texture_image *image)
+{
+   char blob_path[PATH_MAX_LENGTH];
+   const thumbnail_blob_header_t *header = NULL;
+   thumbnail_cache_entry_t *entry        = NULL;
+   gfx_thumbnail_blob_t *blob            = NULL;
+   size_t path_len                       = 0;
+   size_t offset                         = 0;
+   uint64_t hash                         = 0;
+
+   if (!cache || string_is_empty(path) || !key || !image)
+      return NULL;
+
+   hash = thumbnail_cache_hash(path, key);
+
+   thumbnail_cache_lock(cache);
+   if ((entry = thumbnail_cache_find(cache, hash)))
+   {
+      thumbnail_cache_unlink(cache, entry);
+      thumbnail_cache_push_front(cache, entry);
+   }
+   thumbnail_cache_unlock(cache);
+
+   if (!entry)
+      return NULL;
+
+   /* The entry may be evicted by another thread from
+    * here on, in which case mapping the blob fails or
+    * keeps the old file alive until it is unmapped */
+   thumbnail_cache_blob_path(cache, hash, blob_path, sizeof(blob_path));
+
+   if (!(blob = (gfx_thumbnail_blob_t*)calloc(1, sizeof(*blob))))
+      return NULL;
+
+   if (!thumbnail_cache_blob_load(blob, blob_path))
+   {
+      free(blob);
+      thumbnail_cache_forget(cache, hash);
+      return NULL;
+   }
+
+   header   = (const thumbnail_blob_header_t*)blob->data;
+   path_len = strlen(path);
+   offset   = thumbnail_cache_pixels_offset(path_len);
+
+   if (     blob->size < offset
+         || header->magic             != THUMBNAIL_CACHE_MAGIC
+         || header->version           != THUMBNAIL_CACHE_VERSION
+         || header->mtime             != key->mtime
+         || header->size              != key->size
+         || header->max_size          != key->max_size
+         || header->upscale_threshold != key->upscale_threshold
+         || header->supports_rgba     != (key->supports_rgba ? 1u : 0u)
+         || header->path_len          != path_len
+         || header->width  < 1
+         || header->height < 1
+         || (uint64_t)header->width * header->height * sizeof(uint32_t)
+            != blob->size - offset
+         || memcmp(header + 1, path, path_len))
+   {
+      KINGSN_WARN("[Thumbnails]: Discarding invalid cache entry \"%s\".\n",
+            blob_path);
+      gfx_thumbnail_cache_unmap(blob);
+      thumbnail_cache_forget(cache, hash);
+      return NULL;
+   }
+
+   image->width         = header->width;
+   image->height        = header->height;
+   image->pixels        = (uint32_t*)((uint8_t*)blob->data + offset);
+   image->supports_rgba = false;
+
+   return blob;
+}
+
+void gfx_thumbnail_cache_unmap(gfx_thumbnail_blob_t *blob)
+{
+   if (!blob)
+      return;
+
+   if (blob->data)
+   {
+#ifdef HAVE_MMAP
+      if (blob->mapped)
+         munmap(blob->data, blob->size);
+      else
+#endif
+         free(blob->data);
+   }
+
+   free(blob);
+}
+
+bool gfx_thumbnail_cache_insert(gfx_thumbnail_cache_t *cache,
+      const char *path, const gfx_thumbnail_cache_key_t *key,
+      const struct texture_image *image)
+{
+   char blob_path[PATH_MAX_LENGTH];
+   char tmp_path[PATH_MAX_LENGTH];
+   char tmp_ext[32];
+   static const uint8_t padding[THUMBNAIL_CACHE_ALIGN] = {0};
+   thumbnail_blob_header_t header;
+   RFILE *file           = NULL;
+   size_t path_len       = 0;
+   size_t offset         = 0;
+   size_t pixels_size    = 0;
+   uint64_t hash         = 0;
+   unsigned tmp_id       = 0;
+   bool ret              = false;
+
+   if (     !cache || string_is_empty(path) || !key || !image
+         || !image->pixels || image->width < 1 || image->height < 1)
+      return false;
+
+   path_len    = strlen(path);
+   offset      = thumbnail_cache_pixels_offset(path_len);
+   pixels_size = (size_t)image->width * image->height * sizeof(uint32_t);
+
+   /* Would be evicted straight away */
+   if (offset + pixels_size > cache->size_limit)
+      return false;
+
+   hash = thumbnail_cache_hash(path, key);
+
+   thumbnail_cache_lock(cache);
+   tmp_id = cache->tmp_id++;
+   thumbnail_cache_unlock(cache);
+
+   /* Blobs are written under a unique temporary name and
+    * renamed once complete, so readers never see partial
+    * files and concurrent loads of the same image do not
+    * clobber each other */
+   thumbnail_cache_blob_path(cache, hash, blob_path, sizeof(blob_path));
+   snprintf(tmp_ext, sizeof(tmp_ext), ".%u.tmp", tmp_id);
+   strlcpy(tmp_path, blob_path, sizeof(tmp_path));
+   strlcat(tmp_path, tmp_ext, sizeof(tmp_path));
+
+   header.magic             = THUMBNAIL_CACHE_MAGIC;
+   header.version           = THUMBNAIL_CACHE_VERSION;
+   header.mtime             = key->mtime;
+   header.size              = key->size;
+   header.max_size          = key->max_size;
+   header.upscale_threshold = key->upscale_threshold;
+   header.supports_rgba     = key->supports_rgba ? 1 : 0;
+   header.width             = image->width;
+   header.height            = image->height;
+   header.path_len          = (uint32_t)path_len;
+
+   if (!(file = filestream_open(tmp_path,
+               KS_VFS_FILE_ACCESS_WRITE, KS_VFS_FILE_ACCESS_HINT_NONE)))
+      return false;
+
+   ret =    filestream_write(file, &header, sizeof(header))
+               == (int64_t)sizeof(header)
+         && filestream_write(file, path, path_len) == (int64_t)path_len
+         && filestream_write(file, padding,
+               offset - sizeof(header) - path_len)
+               == (int64_t)(offset - sizeof(header) - path_len)
+         && filestream_write(file, image->pixels, pixels_size)
+               == (int64_t)pixels_size;
+
+   if (filestream_close(file) != 0)
+      ret = false;
+
+   if (ret && filestream_rename(tmp_path, blob_path) != 0)
+   {
+      /* Renaming over an existing file fails on some platforms */
+      filestream_delete(blob_path);
+      ret = filestream_rename(tmp_path, blob_path) == 0;
+   }
+
+   if (!ret)
+   {
+      filestream_delete(tmp_path);
+      return false;
+   }
+
+   thumbnail_cache_lock(cache);
+   thumbnail_cache_evict(cache,
+         thumbnail_cache_add(cache, hash, offset + pixels_size));
+   thumbnail_cache_unlock(cache);
+
+   return true;
+}
@@ -0,0 +1,100 @@
+/* Copyright  (C) 2010-2020 The KingStation team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (gfx_thumbnail_cache.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GFX_THUMBNAIL_CACHE_H
+#define __GFX_THUMBNAIL_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <ks_common_api.h>
+#include <boolean.h>
+
+#include <formats/image.h>
+
+KS_BEGIN_DECLS
+
+/* Cached thumbnails are downscaled to fit a square of
+ * this many pixels, rounded up to a power of two so that
+ * window resizes do not invalidate the whole cache */
+#define GFX_THUMBNAIL_CACHE_MIN_SIZE 256
+#define GFX_THUMBNAIL_CACHE_MAX_SIZE 4096
+
+/* On-disk cache of decoded, scaled and colour converted
+ * thumbnail textures. Every texture is stored in its own
+ * file, which is memory mapped and handed to the video
+ * driver as is. The cache is reference counted, since
+ * image load tasks may outlive the menu that started them */
+typedef struct gfx_thumbnail_cache gfx_thumbnail_cache_t;
+
+/* A texture mapped from the cache */
+typedef struct gfx_thumbnail_blob gfx_thumbnail_blob_t;
+
+/* Everything a cached texture depends on, besides the
+ * path of the source image */
+typedef struct
+{
+   uint64_t mtime;
+   uint64_t size;
+   unsigned max_size;
+   unsigned upscale_threshold;
+   bool supports_rgba;
+} gfx_thumbnail_cache_key_t;
+
+/* Opens (and creates, if required) the cache in 'dir'.
+ * Least recently used textures are deleted whenever the
+ * cache grows beyond 'size_limit' bytes */
+gfx_thumbnail_cache_t *gfx_thumbnail_cache_new(const char *dir,
+      size_t size_limit);
+
+void gfx_thumbnail_cache_retain(gfx_thumbnail_cache_t *cache);
+
+/* Drops a reference. The last one saves the LRU order
+ * and frees the cache */
+void gfx_thumbnail_cache_release(gfx_thumbnail_cache_t *cache);
+
+/* Fills 'key' for the image at 'path'. Returns false
+ * if the image does not exist */
+bool gfx_thumbnail_cache_stat(const char *path,
+      unsigned max_size, unsigned upscale_threshold,
+      bool supports_rgba, gfx_thumbnail_cache_key_t *key);
+
+/* Looks up the texture for 'path' and 'key'. On a hit,
+ * 'image' points into the returned blob, which must be
+ * released with gfx_thumbnail_cache_unmap() once the
+ * texture has been uploaded. Returns NULL on a miss */
+gfx_thumbnail_blob_t *gfx_thumbnail_cache_map(
+      gfx_thumbnail_cache_t *cache, const char *path,
+      const gfx_thumbnail_cache_key_t *key,
+      struct texture_image *image);
+
+void gfx_thumbnail_cache_unmap(gfx_thumbnail_blob_t *blob);
+
+/* Stores 'image' as the texture for 'path' and 'key'.
+ * Safe to call from any thread */
+bool gfx_thumbnail_cache_insert(gfx_thumbnail_cache_t *cache,
+      const char *path, const gfx_thumbnail_cache_key_t *key,
+      const struct texture_image *image);
+
+KS_END_DECLS
+
+#endif
@@ -62,6 +62,8 @@
 #endif
 
 #include "../verbosity.c"
+#include "../performance_histogram.c"
+#include "../performance_trace.c"
 
 #if defined(HAVE_LOGGER) && !defined(ANDROID)
 #include "../network/net_logger.c"
@@ -382,6 +384,7 @@ VIDEO IMAGE
 #include "../libks-common/formats/image_transfer.c"
 #ifdef HAVE_RPNG
 #include "../libks-common/formats/png/rpng.c"
+#include "../libks-common/formats/png/rpng_filter.c"
 #include "../libks-common/formats/png/rpng_encode.c"
 #endif
 #ifdef HAVE_RJPEG
@@ -832,6 +835,8 @@ INPUT (HID)
 FIFO BUFFER
 ============================================================ */
 #include "../libks-common/queues/fifo_queue.c"
+#include "../libks-common/queues/spsc_queue.c"
+#include "../libks-common/queues/job_pipeline.c"
 
 /*============================================================
 AUDIO RESAMPLER
@@ -980,6 +985,7 @@ DRIVERS
 #include "../gfx/gfx_display.c"
 #include "../gfx/gfx_thumbnail_path.c"
 #include "../gfx/gfx_thumbnail.c"
+#include "../gfx/gfx_thumbnail_cache.c"
 #include "../gfx/video_coord_array.c"
 #ifdef HAVE_AUDIOMIXER
 #include "../libks-common/audio/audio_mixer.c"
@@ -1170,6 +1176,7 @@ FRONTEND
 #endif
 
 #include "../core_info.c"
+#include "../core_info_cache.c"
 #include "../core_backup.c"
 
 #if defined(HAVE_NETWORKING)
@@ -1284,6 +1291,7 @@ THREAD
 #endif
 
 #include "../libks-common/rthreads/rthreads.c"
+#include "../libks-common/rthreads/tpool.c"
 #include "../gfx/video_thread_wrapper.c"
 #include "../audio/audio_thread_wrapper.c"
 #endif
@@ -1561,6 +1569,7 @@ XML
 #include "../libks-db/rmsgpack_dom.c"
 #include "../libks-db/query.c"
 #include "../database_info.c"
+#include "../database_scan_cache.c"
 #endif
 
 #if defined(HAVE_BUILTINMINIUPNPC)
@@ -24,6 +24,11 @@
 #include "../../config.h"
 #endif
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <audio/audio_mix.h>
 #include <audio/audio_mixer.h>
 #include <audio/audio_resampler.h>
 
@@ -862,7 +867,6 @@ static void audio_mixer_mix_wav(float* buffer, size_t num_frames,
       audio_mixer_voice_t* voice,
       float volume)
 {
-   int i;
    unsigned buf_free                = (unsigned)(num_frames * 2);
    const audio_mixer_sound_t* sound = voice->sound;
    unsigned pcm_available           = sound->types.wav.frames
@@ -873,8 +877,8 @@ static void audio_mixer_mix_wav(float* buffer, size_t num_frames,
 again:
    if (pcm_available < buf_free)
    {
-      for (i = pcm_available; i != 0; i--)
-         *buffer++ += *pcm++ * volume;
+      audio_mix_volume(buffer, pcm, volume, pcm_available);
+      buffer += pcm_available;
 
       if (voice->repeat)
       {
@@ -895,8 +899,7 @@ again:
    }
    else
    {
-      for (i = buf_free; i != 0; i--)
-         *buffer++ += *pcm++ * volume;
+      audio_mix_volume(buffer, pcm, volume, buf_free);
 
       voice->types.wav.position += buf_free;
    }
@@ -907,7 +910,6 @@ static void audio_mixer_mix_ogg(float* buffer, size_t num_frames,
       audio_mixer_voice_t* voice,
       float volume)
 {
-   int i;
    float* temp_buffer = NULL;
    unsigned buf_free                = (unsigned)(num_frames * 2);
    unsigned temp_samples            = 0;
@@ -965,15 +967,14 @@ again:
 
    if (voice->types.ogg.samples < buf_free)
    {
-      for (i = voice->types.ogg.samples; i != 0; i--)
-         *buffer++ += *pcm++ * volume;
+      audio_mix_volume(buffer, pcm, volume, voice->types.ogg.samples);
+      buffer += voice->types.ogg.samples;
 
       buf_free -= voice->types.ogg.samples;
       goto again;
    }
 
-   for (i = buf_free; i != 0; --i )
-      *buffer++ += *pcm++ * volume;
+   audio_mix_volume(buffer, pcm, volume, buf_free);
 
    voice->types.ogg.position += buf_free;
    voice->types.ogg.samples  -= buf_free;
@@ -1054,7 +1055,6 @@ static void audio_mixer_mix_flac(float* buffer, size_t num_frames,
       audio_mixer_voice_t* voice,
       float volume)
 {
-   int i;
    struct resampler_data info;
    float temp_buffer[AUDIO_MIXER_TEMP_BUFFER] = { 0 };
    unsigned buf_free                = (unsigned)(num_frames * 2);
@@ -1102,15 +1102,14 @@ again:
 
    if (voice->types.flac.samples < buf_free)
    {
-      for (i = voice->types.flac.samples; i != 0; i--)
-         *buffer++ += *pcm++ * volume;
+      audio_mix_volume(buffer, pcm, volume, voice->types.flac.samples);
+      buffer += voice->types.flac.samples;
 
       buf_free -= voice->types.flac.samples;
       goto again;
    }
 
-   for (i = buf_free; i != 0; --i )
-      *buffer++ += *pcm++ * volume;
+   audio_mix_volume(buffer, pcm, volume, buf_free);
 
    voice->types.flac.position += buf_free;
    voice->types.flac.samples  -= buf_free;
@@ -1122,7 +1121,6 @@ static void audio_mixer_mix_mp3(float* buffer, size_t num_frames,
       audio_mixer_voice_t* voice,
       float volume)
 {
-   int i;
    struct resampler_data info;
    float temp_buffer[AUDIO_MIXER_TEMP_BUFFER] = { 0 };
    unsigned buf_free                = (unsigned)(num_frames * 2);
@@ -1174,15 +1172,14 @@ again:
 
    if (voice->types.mp3.samples < buf_free)
    {
-      for (i = voice->types.mp3.samples; i != 0; i--)
-         *buffer++ += *pcm++ * volume;
+      audio_mix_volume(buffer, pcm, volume, voice->types.mp3.samples);
+      buffer += voice->types.mp3.samples;
 
       buf_free -= voice->types.mp3.samples;
       goto again;
    }
 
-   for (i = buf_free; i != 0; --i )
-      *buffer++ += *pcm++ * volume;
+   audio_mix_volume(buffer, pcm, volume, buf_free);
 
    voice->types.mp3.position += buf_free;
    voice->types.mp3.samples  -= buf_free;
@@ -1231,7 +1228,18 @@ void audio_mixer_mix(float* buffer, size_t num_frames,
       }
    }
 
-   for (j = 0, sample = buffer; j < num_frames * 2; j++, sample++)
+#if defined(__SSE2__)
+   {
+      __m128 min = _mm_set1_ps(-1.0f);
+      __m128 max = _mm_set1_ps( 1.0f);
+
+      for (; j + 4 <= num_frames * 2; j += 4)
+         _mm_storeu_ps(buffer + j, _mm_min_ps(_mm_max_ps(
+                     _mm_loadu_ps(buffer + j), min), max));
+   }
+#endif
+
+   for (sample = buffer + j; j < num_frames * 2; j++, sample++)
    {
       if (*sample < -1.0f)
          *sample = -1.0f;
@@ -137,7 +137,13 @@ void convert_float_to_s16(int16_t *out,
 
    for (; i < samples; i++)
    {
+#if defined(__SSE2__)
+      /* Rounds like _mm_cvtps_epi32() does above, so that
+       * a sample comes out the same wherever a batch ends */
+      int32_t val = _mm_cvtss_si32(_mm_set_ss(in[i] * 0x8000));
+#else
       int32_t val = (int32_t)(in[i] * 0x8000);
+#endif
       out[i]      = (val > 0x7FFF) ? 0x7FFF :
          (val < -0x8000 ? -0x8000 : (int16_t)val);
    }
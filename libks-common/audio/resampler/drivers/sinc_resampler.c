@@ -39,10 +39,32 @@
 #include <xmmintrin.h>
 #endif
 
-#if defined(__AVX__)
+/* The AVX, FMA and AVX-512 kernels are built with per-function
+ * target attributes where possible and only picked when
+ * cpu_features_get() reports the instruction set, so they do not
+ * depend on the flags the rest of the build uses. */
+#if defined(__x86_64__) && defined(__GNUC__) || defined(_M_X64)
+#define SINC_AVX
+#define SINC_FMA
+#define SINC_AVX512
+#elif defined(__AVX__)
+#define SINC_AVX
+#endif
+
+#if defined(SINC_AVX)
 #include <immintrin.h>
 #endif
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SINC_TARGET_AVX    __attribute__((target("avx")))
+#define SINC_TARGET_FMA    __attribute__((target("avx2,fma")))
+#define SINC_TARGET_AVX512 __attribute__((target("avx512f,fma")))
+#else
+#define SINC_TARGET_AVX
+#define SINC_TARGET_FMA
+#define SINC_TARGET_AVX512
+#endif
+
 /* Rough SNR values for upsampling:
  * LOWEST: 40 dB
  * LOWER: 55 dB
@@ -60,11 +82,25 @@ enum sinc_window
    SINC_WINDOW_LANCZOS
 };
 
-/* For the little amount of taps we're using,
- * SSE1 is faster than AVX for some reason.
- * AVX code is kept here though as by increasing number
- * of sinc taps, the AVX code is clearly faster than SSE1.
- */
+/* Largest polyphase bank, in floats (1 MB). */
+#define SINC_BANK_MAX_ELEMS (1 << 18)
+
+/* Input frames a new ratio has to hold still for before
+ * a bank is built for it. */
+#define SINC_BANK_HOLD_FRAMES 4096
+
+#define SINC_AVX512_MIN_TAPS 256
+
+/* Computes one stereo output frame from the filter coefficients
+ * in phase_table. Same signature as process_sinc_neon_asm. */
+typedef void (*sinc_kernel_t)(float *out, const float *buffer_l,
+      const float *buffer_r, const float *phase_table, unsigned taps);
+
+/* Same, but interpolates the coefficients first:
+ * phase_table[i] + delta_table[i] * delta. */
+typedef void (*sinc_kernel_lerp_t)(float *out, const float *buffer_l,
+      const float *buffer_r, const float *phase_table,
+      const float *delta_table, float delta, unsigned taps);
 
 typedef struct kingsn_sinc_resampler
 {
@@ -75,6 +111,16 @@ typedef struct kingsn_sinc_resampler
    float *phase_table;
    float *buffer_l;
    float *buffer_r;
+   /* Coefficients for every output phase of a fixed
+    * ratio, see sinc_bank_update(). */
+   float *bank;
+   sinc_kernel_t kernel;
+   sinc_kernel_lerp_t kernel_lerp;
+   double last_ratio;
+   size_t hold_frames;
+   unsigned bank_phases;
+   unsigned bank_step;
+   unsigned bank_time;
    unsigned enable_avx;
    unsigned phase_bits;
    unsigned subphase_bits;
@@ -98,388 +144,513 @@ typedef struct kingsn_sinc_resampler
 /* Assumes that taps >= 8, and that taps is a multiple of 8. */
 void process_sinc_neon_asm(float *out, const float *left,
       const float *right, const float *coeff, unsigned taps);
+#endif
 
-static void resampler_sinc_process_neon(void *re_, struct resampler_data *data)
+static void sinc_kernel_c(float *out, const float *buffer_l,
+      const float *buffer_r, const float *phase_table, unsigned taps)
 {
-   kingsn_sinc_resampler_t *resamp = (kingsn_sinc_resampler_t*)re_;
-   unsigned phases                = 1 << (resamp->phase_bits + resamp->subphase_bits);
+   unsigned i;
+   float sum_l = 0.0f;
+   float sum_r = 0.0f;
 
-   uint32_t ratio                 = phases / data->ratio;
-   const float *input             = data->data_in;
-   float *output                  = data->data_out;
-   size_t frames                  = data->input_frames;
-   size_t out_frames              = 0;
+   for (i = 0; i < taps; i++)
+   {
+      float sinc_val = phase_table[i];
 
-   while (frames)
+      sum_l         += buffer_l[i] * sinc_val;
+      sum_r         += buffer_r[i] * sinc_val;
+   }
+
+   out[0] = sum_l;
+   out[1] = sum_r;
+}
+
+static void sinc_kernel_lerp_c(float *out, const float *buffer_l,
+      const float *buffer_r, const float *phase_table,
+      const float *delta_table, float delta, unsigned taps)
+{
+   unsigned i;
+   float sum_l = 0.0f;
+   float sum_r = 0.0f;
+
+   for (i = 0; i < taps; i++)
    {
-      while (frames && resamp->time >= phases)
-      {
-         /* Push in reverse to make filter more obvious. */
-         if (!resamp->ptr)
-            resamp->ptr = resamp->taps;
-         resamp->ptr--;
+      float sinc_val = phase_table[i] + delta_table[i] * delta;
 
-         resamp->buffer_l[resamp->ptr + resamp->taps] =
-         resamp->buffer_l[resamp->ptr]                = *input++;
+      sum_l         += buffer_l[i] * sinc_val;
+      sum_r         += buffer_r[i] * sinc_val;
+   }
 
-         resamp->buffer_r[resamp->ptr + resamp->taps] =
-         resamp->buffer_r[resamp->ptr]                = *input++;
+   out[0] = sum_l;
+   out[1] = sum_r;
+}
 
-         resamp->time                                -= phases;
-         frames--;
-      }
+#if defined(__SSE__)
+static INLINE void sinc_store_sse(float *out, __m128 sum_l, __m128 sum_r)
+{
+   /* Them annoying shuffles.
+    * sum_l = { l3, l2, l1, l0 }
+    * sum_r = { r3, r2, r1, r0 }
+    */
 
-      {
-         const float *buffer_l    = resamp->buffer_l + resamp->ptr;
-         const float *buffer_r    = resamp->buffer_r + resamp->ptr;
-         unsigned taps            = resamp->taps;
-         while (resamp->time < phases)
-         {
-            unsigned phase           = resamp->time >> resamp->subphase_bits;
-            const float *phase_table = resamp->phase_table + phase * taps;
+   __m128 sum = _mm_add_ps(_mm_shuffle_ps(sum_l, sum_r,
+            _MM_SHUFFLE(1, 0, 1, 0)),
+         _mm_shuffle_ps(sum_l, sum_r, _MM_SHUFFLE(3, 2, 3, 2)));
 
-            process_sinc_neon_asm(output, buffer_l, buffer_r, phase_table, taps);
+   /* sum   = { r1, r0, l1, l0 } + { r3, r2, l3, l2 }
+    * sum   = { R1, R0, L1, L0 }
+    */
 
-            output += 2;
-            out_frames++;
-            resamp->time += ratio;
-         }
-      }
+   sum = _mm_add_ps(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 1, 1)), sum);
+
+   /* sum   = {R1, R1, L1, L1 } + { R1, R0, L1, L0 }
+    * sum   = { X,  R,  X,  L }
+    */
+
+   /* Store L */
+   _mm_store_ss(out + 0, sum);
+
+   /* movehl { X, R, X, L } == { X, R, X, R } */
+   _mm_store_ss(out + 1, _mm_movehl_ps(sum, sum));
+}
+
+static void sinc_kernel_sse(float *out, const float *buffer_l,
+      const float *buffer_r, const float *phase_table, unsigned taps)
+{
+   unsigned i;
+   __m128 sum_l = _mm_setzero_ps();
+   __m128 sum_r = _mm_setzero_ps();
+
+   for (i = 0; i < taps; i += 4)
+   {
+      __m128 buf_l = _mm_loadu_ps(buffer_l + i);
+      __m128 buf_r = _mm_loadu_ps(buffer_r + i);
+      __m128 _sinc = _mm_load_ps(phase_table + i);
+      sum_l        = _mm_add_ps(sum_l, _mm_mul_ps(buf_l, _sinc));
+      sum_r        = _mm_add_ps(sum_r, _mm_mul_ps(buf_r, _sinc));
    }
 
-   data->output_frames = out_frames;
+   sinc_store_sse(out, sum_l, sum_r);
 }
-#endif
 
-#if defined(__AVX__)
-static void resampler_sinc_process_avx(void *re_, struct resampler_data *data)
+static void sinc_kernel_lerp_sse(float *out, const float *buffer_l,
+      const float *buffer_r, const float *phase_table,
+      const float *delta_table, float delta, unsigned taps)
 {
-   kingsn_sinc_resampler_t *resamp = (kingsn_sinc_resampler_t*)re_;
-   unsigned phases                = 1 << (resamp->phase_bits + resamp->subphase_bits);
+   unsigned i;
+   __m128 sum_l = _mm_setzero_ps();
+   __m128 sum_r = _mm_setzero_ps();
+   __m128 frac  = _mm_set1_ps(delta);
 
-   uint32_t ratio                 = phases / data->ratio;
-   const float *input             = data->data_in;
-   float *output                  = data->data_out;
-   size_t frames                  = data->input_frames;
-   size_t out_frames              = 0;
+   for (i = 0; i < taps; i += 4)
+   {
+      __m128 buf_l  = _mm_loadu_ps(buffer_l + i);
+      __m128 buf_r  = _mm_loadu_ps(buffer_r + i);
+      __m128 deltas = _mm_load_ps(delta_table + i);
+      __m128 _sinc  = _mm_add_ps(_mm_load_ps(phase_table + i),
+            _mm_mul_ps(deltas, frac));
+      sum_l         = _mm_add_ps(sum_l, _mm_mul_ps(buf_l, _sinc));
+      sum_r         = _mm_add_ps(sum_r, _mm_mul_ps(buf_r, _sinc));
+   }
 
-   if (resamp->window_type == SINC_WINDOW_KAISER)
+   sinc_store_sse(out, sum_l, sum_r);
+}
+#endif
+
+#if defined(SINC_AVX)
+SINC_TARGET_AVX
+static void sinc_kernel_avx(float *out, const float *buffer_l,
+      const float *buffer_r, const float *phase_table, unsigned taps)
+{
+   unsigned i;
+   __m256 sum_l = _mm256_setzero_ps();
+   __m256 sum_r = _mm256_setzero_ps();
+
+   for (i = 0; i < taps; i += 8)
    {
-      while (frames)
-      {
-         while (frames && resamp->time >= phases)
-         {
-            /* Push in reverse to make filter more obvious. */
-            if (!resamp->ptr)
-               resamp->ptr = resamp->taps;
-            resamp->ptr--;
+      __m256 buf_l = _mm256_loadu_ps(buffer_l + i);
+      __m256 buf_r = _mm256_loadu_ps(buffer_r + i);
+      __m256 sinc  = _mm256_load_ps(phase_table + i);
 
-            resamp->buffer_l[resamp->ptr + resamp->taps] =
-               resamp->buffer_l[resamp->ptr]                = *input++;
+      sum_l        = _mm256_add_ps(sum_l, _mm256_mul_ps(buf_l, sinc));
+      sum_r        = _mm256_add_ps(sum_r, _mm256_mul_ps(buf_r, sinc));
+   }
 
-            resamp->buffer_r[resamp->ptr + resamp->taps] =
-               resamp->buffer_r[resamp->ptr]                = *input++;
+   sinc_store_sse(out,
+         _mm_add_ps(_mm256_castps256_ps128(sum_l),
+            _mm256_extractf128_ps(sum_l, 1)),
+         _mm_add_ps(_mm256_castps256_ps128(sum_r),
+            _mm256_extractf128_ps(sum_r, 1)));
+}
 
-            resamp->time                                -= phases;
-            frames--;
-         }
+SINC_TARGET_AVX
+static void sinc_kernel_lerp_avx(float *out, const float *buffer_l,
+      const float *buffer_r, const float *phase_table,
+      const float *delta_table, float delta, unsigned taps)
+{
+   unsigned i;
+   __m256 sum_l = _mm256_setzero_ps();
+   __m256 sum_r = _mm256_setzero_ps();
+   __m256 frac  = _mm256_set1_ps(delta);
 
-         {
-            const float *buffer_l    = resamp->buffer_l + resamp->ptr;
-            const float *buffer_r    = resamp->buffer_r + resamp->ptr;
-            unsigned taps            = resamp->taps;
-            while (resamp->time < phases)
-            {
-               unsigned i;
-               unsigned phase           = resamp->time >> resamp->subphase_bits;
+   for (i = 0; i < taps; i += 8)
+   {
+      __m256 buf_l  = _mm256_loadu_ps(buffer_l + i);
+      __m256 buf_r  = _mm256_loadu_ps(buffer_r + i);
+      __m256 deltas = _mm256_load_ps(delta_table + i);
+      __m256 sinc   = _mm256_add_ps(_mm256_load_ps(phase_table + i),
+            _mm256_mul_ps(deltas, frac));
+
+      sum_l         = _mm256_add_ps(sum_l, _mm256_mul_ps(buf_l, sinc));
+      sum_r         = _mm256_add_ps(sum_r, _mm256_mul_ps(buf_r, sinc));
+   }
 
-               float *phase_table       = resamp->phase_table + phase * taps * 2;
-               float *delta_table       = phase_table + taps;
-               __m256 delta             = _mm256_set1_ps((float)
-                     (resamp->time & resamp->subphase_mask) * resamp->subphase_mod);
-
-               __m256 sum_l             = _mm256_setzero_ps();
-               __m256 sum_r             = _mm256_setzero_ps();
-
-               for (i = 0; i < taps; i += 8)
-               {
-                  __m256 buf_l  = _mm256_loadu_ps(buffer_l + i);
-                  __m256 buf_r  = _mm256_loadu_ps(buffer_r + i);
-                  __m256 deltas = _mm256_load_ps(delta_table + i);
-                  __m256 sinc   = _mm256_add_ps(_mm256_load_ps((const float*)phase_table + i),
-                        _mm256_mul_ps(deltas, delta));
-
-                  sum_l         = _mm256_add_ps(sum_l, _mm256_mul_ps(buf_l, sinc));
-                  sum_r         = _mm256_add_ps(sum_r, _mm256_mul_ps(buf_r, sinc));
-               }
-
-               /* hadd on AVX is weird, and acts on low-lanes
-                * and high-lanes separately. */
-               __m256 res_l = _mm256_hadd_ps(sum_l, sum_l);
-               __m256 res_r = _mm256_hadd_ps(sum_r, sum_r);
-               res_l        = _mm256_hadd_ps(res_l, res_l);
-               res_r        = _mm256_hadd_ps(res_r, res_r);
-               res_l        = _mm256_add_ps(_mm256_permute2f128_ps(res_l, res_l, 1), res_l);
-               res_r        = _mm256_add_ps(_mm256_permute2f128_ps(res_r, res_r, 1), res_r);
-
-               /* This is optimized to mov %xmmN, [mem].
-                * There doesn't seem to be any _mm256_store_ss intrinsic. */
-               _mm_store_ss(output + 0, _mm256_extractf128_ps(res_l, 0));
-               _mm_store_ss(output + 1, _mm256_extractf128_ps(res_r, 0));
-
-               output += 2;
-               out_frames++;
-               resamp->time += ratio;
-            }
-         }
-      }
+   sinc_store_sse(out,
+         _mm_add_ps(_mm256_castps256_ps128(sum_l),
+            _mm256_extractf128_ps(sum_l, 1)),
+         _mm_add_ps(_mm256_castps256_ps128(sum_r),
+            _mm256_extractf128_ps(sum_r, 1)));
+}
+#endif
+
+#if defined(SINC_FMA)
+/* Two accumulators per channel to hide the FMA latency. */
+SINC_TARGET_FMA
+static void sinc_kernel_fma(float *out, const float *buffer_l,
+      const float *buffer_r, const float *phase_table, unsigned taps)
+{
+   unsigned i;
+   __m256 sum_l0 = _mm256_setzero_ps();
+   __m256 sum_r0 = _mm256_setzero_ps();
+   __m256 sum_l1 = _mm256_setzero_ps();
+   __m256 sum_r1 = _mm256_setzero_ps();
+
+   for (i = 0; i + 16 <= taps; i += 16)
+   {
+      __m256 sinc0 = _mm256_load_ps(phase_table + i);
+      __m256 sinc1 = _mm256_load_ps(phase_table + i + 8);
+
+      sum_l0 = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_l + i),     sinc0, sum_l0);
+      sum_r0 = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_r + i),     sinc0, sum_r0);
+      sum_l1 = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_l + i + 8), sinc1, sum_l1);
+      sum_r1 = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_r + i + 8), sinc1, sum_r1);
    }
-   else
+
+   if (i < taps)
    {
-      while (frames)
-      {
-         while (frames && resamp->time >= phases)
-         {
-            /* Push in reverse to make filter more obvious. */
-            if (!resamp->ptr)
-               resamp->ptr = resamp->taps;
-            resamp->ptr--;
+      __m256 sinc0 = _mm256_load_ps(phase_table + i);
 
-            resamp->buffer_l[resamp->ptr + resamp->taps] =
-               resamp->buffer_l[resamp->ptr]                = *input++;
+      sum_l0 = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_l + i), sinc0, sum_l0);
+      sum_r0 = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_r + i), sinc0, sum_r0);
+   }
 
-            resamp->buffer_r[resamp->ptr + resamp->taps] =
-               resamp->buffer_r[resamp->ptr]                = *input++;
+   sum_l0 = _mm256_add_ps(sum_l0, sum_l1);
+   sum_r0 = _mm256_add_ps(sum_r0, sum_r1);
 
-            resamp->time                                -= phases;
-            frames--;
-         }
+   sinc_store_sse(out,
+         _mm_add_ps(_mm256_castps256_ps128(sum_l0),
+            _mm256_extractf128_ps(sum_l0, 1)),
+         _mm_add_ps(_mm256_castps256_ps128(sum_r0),
+            _mm256_extractf128_ps(sum_r0, 1)));
+}
 
-         {
-            const float *buffer_l    = resamp->buffer_l + resamp->ptr;
-            const float *buffer_r    = resamp->buffer_r + resamp->ptr;
-            unsigned taps            = resamp->taps;
-            while (resamp->time < phases)
-            {
-               unsigned i;
-               __m256 delta;
-               unsigned phase           = resamp->time >> resamp->subphase_bits;
-               float *phase_table       = resamp->phase_table + phase * taps;
-
-               __m256 sum_l             = _mm256_setzero_ps();
-               __m256 sum_r             = _mm256_setzero_ps();
-
-               for (i = 0; i < taps; i += 8)
-               {
-                  __m256 buf_l  = _mm256_loadu_ps(buffer_l + i);
-                  __m256 buf_r  = _mm256_loadu_ps(buffer_r + i);
-                  __m256 sinc   = _mm256_load_ps((const float*)phase_table + i);
-
-                  sum_l         = _mm256_add_ps(sum_l, _mm256_mul_ps(buf_l, sinc));
-                  sum_r         = _mm256_add_ps(sum_r, _mm256_mul_ps(buf_r, sinc));
-               }
-
-               /* hadd on AVX is weird, and acts on low-lanes
-                * and high-lanes separately. */
-               __m256 res_l = _mm256_hadd_ps(sum_l, sum_l);
-               __m256 res_r = _mm256_hadd_ps(sum_r, sum_r);
-               res_l        = _mm256_hadd_ps(res_l, res_l);
-               res_r        = _mm256_hadd_ps(res_r, res_r);
-               res_l        = _mm256_add_ps(_mm256_permute2f128_ps(res_l, res_l, 1), res_l);
-               res_r        = _mm256_add_ps(_mm256_permute2f128_ps(res_r, res_r, 1), res_r);
-
-               /* This is optimized to mov %xmmN, [mem].
-                * There doesn't seem to be any _mm256_store_ss intrinsic. */
-               _mm_store_ss(output + 0, _mm256_extractf128_ps(res_l, 0));
-               _mm_store_ss(output + 1, _mm256_extractf128_ps(res_r, 0));
-
-               output += 2;
-               out_frames++;
-               resamp->time += ratio;
-            }
-         }
-      }
+SINC_TARGET_FMA
+static void sinc_kernel_lerp_fma(float *out, const float *buffer_l,
+      const float *buffer_r, const float *phase_table,
+      const float *delta_table, float delta, unsigned taps)
+{
+   unsigned i;
+   __m256 sum_l0 = _mm256_setzero_ps();
+   __m256 sum_r0 = _mm256_setzero_ps();
+   __m256 sum_l1 = _mm256_setzero_ps();
+   __m256 sum_r1 = _mm256_setzero_ps();
+   __m256 frac   = _mm256_set1_ps(delta);
+
+   for (i = 0; i + 16 <= taps; i += 16)
+   {
+      __m256 sinc0 = _mm256_fmadd_ps(_mm256_load_ps(delta_table + i),
+            frac, _mm256_load_ps(phase_table + i));
+      __m256 sinc1 = _mm256_fmadd_ps(_mm256_load_ps(delta_table + i + 8),
+            frac, _mm256_load_ps(phase_table + i + 8));
+
+      sum_l0 = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_l + i),     sinc0, sum_l0);
+      sum_r0 = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_r + i),     sinc0, sum_r0);
+      sum_l1 = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_l + i + 8), sinc1, sum_l1);
+      sum_r1 = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_r + i + 8), sinc1, sum_r1);
    }
 
-   data->output_frames = out_frames;
+   if (i < taps)
+   {
+      __m256 sinc0 = _mm256_fmadd_ps(_mm256_load_ps(delta_table + i),
+            frac, _mm256_load_ps(phase_table + i));
+
+      sum_l0 = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_l + i), sinc0, sum_l0);
+      sum_r0 = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_r + i), sinc0, sum_r0);
+   }
+
+   sum_l0 = _mm256_add_ps(sum_l0, sum_l1);
+   sum_r0 = _mm256_add_ps(sum_r0, sum_r1);
+
+   sinc_store_sse(out,
+         _mm_add_ps(_mm256_castps256_ps128(sum_l0),
+            _mm256_extractf128_ps(sum_l0, 1)),
+         _mm_add_ps(_mm256_castps256_ps128(sum_r0),
+            _mm256_extractf128_ps(sum_r0, 1)));
 }
 #endif
 
-#if defined(__SSE__)
-static void resampler_sinc_process_sse(void *re_, struct resampler_data *data)
+#if defined(SINC_AVX512)
+/* Rows of the phase table are only 32 byte aligned, and taps
+ * are a multiple of 8, so finish with a 256-bit step. */
+SINC_TARGET_AVX512
+static INLINE __m128 sinc_reduce_avx512(__m512 sum, __m256 tail)
 {
-   kingsn_sinc_resampler_t *resamp = (kingsn_sinc_resampler_t*)re_;
-   unsigned phases                = 1 << (resamp->phase_bits + resamp->subphase_bits);
+   __m256 half = _mm256_add_ps(_mm512_castps512_ps256(sum),
+         _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(sum), 1)));
+   half        = _mm256_add_ps(half, tail);
+   return _mm_add_ps(_mm256_castps256_ps128(half),
+         _mm256_extractf128_ps(half, 1));
+}
 
-   uint32_t ratio                 = phases / data->ratio;
-   const float *input             = data->data_in;
-   float *output                  = data->data_out;
-   size_t frames                  = data->input_frames;
-   size_t out_frames              = 0;
+SINC_TARGET_AVX512
+static void sinc_kernel_avx512(float *out, const float *buffer_l,
+      const float *buffer_r, const float *phase_table, unsigned taps)
+{
+   unsigned i;
+   __m512 sum_l  = _mm512_setzero_ps();
+   __m512 sum_r  = _mm512_setzero_ps();
+   __m256 tail_l = _mm256_setzero_ps();
+   __m256 tail_r = _mm256_setzero_ps();
 
-   if (resamp->window_type == SINC_WINDOW_KAISER)
+   for (i = 0; i + 16 <= taps; i += 16)
    {
-      while (frames)
-      {
-         while (frames && resamp->time >= phases)
-         {
-            /* Push in reverse to make filter more obvious. */
-            if (!resamp->ptr)
-               resamp->ptr = resamp->taps;
-            resamp->ptr--;
+      __m512 sinc = _mm512_loadu_ps(phase_table + i);
 
-            resamp->buffer_l[resamp->ptr + resamp->taps] =
-               resamp->buffer_l[resamp->ptr]                = *input++;
+      sum_l       = _mm512_fmadd_ps(_mm512_loadu_ps(buffer_l + i), sinc, sum_l);
+      sum_r       = _mm512_fmadd_ps(_mm512_loadu_ps(buffer_r + i), sinc, sum_r);
+   }
 
-            resamp->buffer_r[resamp->ptr + resamp->taps] =
-               resamp->buffer_r[resamp->ptr]                = *input++;
+   if (i < taps)
+   {
+      __m256 sinc = _mm256_load_ps(phase_table + i);
 
-            resamp->time                                -= phases;
-            frames--;
-         }
+      tail_l      = _mm256_mul_ps(_mm256_loadu_ps(buffer_l + i), sinc);
+      tail_r      = _mm256_mul_ps(_mm256_loadu_ps(buffer_r + i), sinc);
+   }
 
-         {
-            const float *buffer_l    = resamp->buffer_l + resamp->ptr;
-            const float *buffer_r    = resamp->buffer_r + resamp->ptr;
-            unsigned taps            = resamp->taps;
-            while (resamp->time < phases)
-            {
-               unsigned i;
-               __m128 sum;
-               unsigned phase           = resamp->time >> resamp->subphase_bits;
-               float *phase_table       = resamp->phase_table + phase * taps * 2;
-               float *delta_table       = phase_table + taps;
-               __m128 delta             = _mm_set1_ps((float)
-                     (resamp->time & resamp->subphase_mask) * resamp->subphase_mod);
-
-               __m128 sum_l             = _mm_setzero_ps();
-               __m128 sum_r             = _mm_setzero_ps();
-
-               for (i = 0; i < taps; i += 4)
-               {
-                  __m128 buf_l = _mm_loadu_ps(buffer_l + i);
-                  __m128 buf_r = _mm_loadu_ps(buffer_r + i);
-                  __m128 deltas = _mm_load_ps(delta_table + i);
-                  __m128 _sinc  = _mm_add_ps(_mm_load_ps((const float*)phase_table + i),
-                        _mm_mul_ps(deltas, delta));
-                  sum_l        = _mm_add_ps(sum_l, _mm_mul_ps(buf_l, _sinc));
-                  sum_r        = _mm_add_ps(sum_r, _mm_mul_ps(buf_r, _sinc));
-               }
-
-               /* Them annoying shuffles.
-                * sum_l = { l3, l2, l1, l0 }
-                * sum_r = { r3, r2, r1, r0 }
-                */
-
-               sum = _mm_add_ps(_mm_shuffle_ps(sum_l, sum_r,
-                        _MM_SHUFFLE(1, 0, 1, 0)),
-                     _mm_shuffle_ps(sum_l, sum_r, _MM_SHUFFLE(3, 2, 3, 2)));
-
-               /* sum   = { r1, r0, l1, l0 } + { r3, r2, l3, l2 }
-                * sum   = { R1, R0, L1, L0 }
-                */
-
-               sum = _mm_add_ps(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 1, 1)), sum);
-
-               /* sum   = {R1, R1, L1, L1 } + { R1, R0, L1, L0 }
-                * sum   = { X,  R,  X,  L }
-                */
-
-               /* Store L */
-               _mm_store_ss(output + 0, sum);
-
-               /* movehl { X, R, X, L } == { X, R, X, R } */
-               _mm_store_ss(output + 1, _mm_movehl_ps(sum, sum));
-
-               output += 2;
-               out_frames++;
-               resamp->time += ratio;
-            }
-         }
-      }
+   sinc_store_sse(out, sinc_reduce_avx512(sum_l, tail_l),
+         sinc_reduce_avx512(sum_r, tail_r));
+}
+
+SINC_TARGET_AVX512
+static void sinc_kernel_lerp_avx512(float *out, const float *buffer_l,
+      const float *buffer_r, const float *phase_table,
+      const float *delta_table, float delta, unsigned taps)
+{
+   unsigned i;
+   __m512 sum_l  = _mm512_setzero_ps();
+   __m512 sum_r  = _mm512_setzero_ps();
+   __m256 tail_l = _mm256_setzero_ps();
+   __m256 tail_r = _mm256_setzero_ps();
+   __m512 frac   = _mm512_set1_ps(delta);
+
+   for (i = 0; i + 16 <= taps; i += 16)
+   {
+      __m512 sinc = _mm512_fmadd_ps(_mm512_loadu_ps(delta_table + i),
+            frac, _mm512_loadu_ps(phase_table + i));
+
+      sum_l       = _mm512_fmadd_ps(_mm512_loadu_ps(buffer_l + i), sinc, sum_l);
+      sum_r       = _mm512_fmadd_ps(_mm512_loadu_ps(buffer_r + i), sinc, sum_r);
    }
-   else
+
+   if (i < taps)
    {
-      while (frames)
+      __m256 sinc = _mm256_fmadd_ps(_mm256_load_ps(delta_table + i),
+            _mm512_castps512_ps256(frac), _mm256_load_ps(phase_table + i));
+
+      tail_l      = _mm256_mul_ps(_mm256_loadu_ps(buffer_l + i), sinc);
+      tail_r      = _mm256_mul_ps(_mm256_loadu_ps(buffer_r + i), sinc);
+   }
+
+   sinc_store_sse(out, sinc_reduce_avx512(sum_l, tail_l),
+         sinc_reduce_avx512(sum_r, tail_r));
+}
+#endif
+
+static INLINE void resampler_sinc_push(kingsn_sinc_resampler_t *resamp,
+      const float *input)
+{
+   /* Push in reverse to make filter more obvious. */
+   if (!resamp->ptr)
+      resamp->ptr = resamp->taps;
+   resamp->ptr--;
+
+   resamp->buffer_l[resamp->ptr + resamp->taps] =
+      resamp->buffer_l[resamp->ptr]             = input[0];
+
+   resamp->buffer_r[resamp->ptr + resamp->taps] =
+      resamp->buffer_r[resamp->ptr]             = input[1];
+}
+
+/* Builds a bank holding the interpolated filter for every phase
+ * a fixed ratio of out/in = bank_phases/bank_step ever lands on.
+ * Stepping through it with integer arithmetic is exact, and each
+ * output frame then only needs one table read per tap. Ratios
+ * that are not a ratio of small integers (e.g. while dynamic rate
+ * control adjusts them) keep interpolating. */
+static bool sinc_bank_init(kingsn_sinc_resampler_t *resamp, double ratio)
+{
+   unsigned i, j;
+   unsigned bank_phases = 0;
+   unsigned bank_step   = 0;
+   unsigned taps        = resamp->taps;
+   unsigned max_phases  = SINC_BANK_MAX_ELEMS / taps;
+
+   for (i = 1; i <= max_phases; i++)
+   {
+      double step = i / ratio;
+      j           = (unsigned)(step + 0.5);
+      if (j && fabs(step - j) <= step * 1e-9)
       {
-         while (frames && resamp->time >= phases)
-         {
-            /* Push in reverse to make filter more obvious. */
-            if (!resamp->ptr)
-               resamp->ptr = resamp->taps;
-            resamp->ptr--;
+         bank_phases = i;
+         bank_step   = j;
+         break;
+      }
+   }
 
-            resamp->buffer_l[resamp->ptr + resamp->taps] =
-               resamp->buffer_l[resamp->ptr]                = *input++;
+   if (!bank_phases)
+      return false;
 
-            resamp->buffer_r[resamp->ptr + resamp->taps] =
-               resamp->buffer_r[resamp->ptr]                = *input++;
+   resamp->bank = (float*)memalign_alloc(128,
+         sizeof(float) * bank_phases * taps);
+   if (!resamp->bank)
+      return false;
 
-            resamp->time                                -= phases;
-            frames--;
-         }
+   for (i = 0; i < bank_phases; i++)
+   {
+      double pos          = (double)i * (1 << resamp->phase_bits) / bank_phases;
+      unsigned phase      = (unsigned)pos;
+      float delta         = (float)(pos - phase);
+      const float *table  = resamp->phase_table + phase * taps * 2;
+      float *coeffs       = resamp->bank + i * taps;
 
-         {
-            const float *buffer_l    = resamp->buffer_l + resamp->ptr;
-            const float *buffer_r    = resamp->buffer_r + resamp->ptr;
-            unsigned taps            = resamp->taps;
-            while (resamp->time < phases)
-            {
-               unsigned i;
-               __m128 sum;
-               unsigned phase           = resamp->time >> resamp->subphase_bits;
-               float *phase_table       = resamp->phase_table + phase * taps;
+      for (j = 0; j < taps; j++)
+         coeffs[j] = table[j] + table[taps + j] * delta;
+   }
+
+   resamp->bank_phases = bank_phases;
+   resamp->bank_step   = bank_step;
+   resamp->bank_time   = (unsigned)(((uint64_t)resamp->time * bank_phases
+            + (1u << (resamp->phase_bits + resamp->subphase_bits - 1)))
+         >> (resamp->phase_bits + resamp->subphase_bits));
+   return true;
+}
 
-               __m128 sum_l             = _mm_setzero_ps();
-               __m128 sum_r             = _mm_setzero_ps();
+static void sinc_bank_update(kingsn_sinc_resampler_t *resamp, double ratio)
+{
+   if (resamp->bank)
+   {
+      resamp->time = (uint32_t)((((uint64_t)resamp->bank_time
+               << (resamp->phase_bits + resamp->subphase_bits))
+            + resamp->bank_phases / 2) / resamp->bank_phases);
+      memalign_free(resamp->bank);
+      resamp->bank = NULL;
+   }
 
-               for (i = 0; i < taps; i += 4)
-               {
-                  __m128 buf_l = _mm_loadu_ps(buffer_l + i);
-                  __m128 buf_r = _mm_loadu_ps(buffer_r + i);
-                  __m128 _sinc = _mm_load_ps((const float*)phase_table + i);
-                  sum_l        = _mm_add_ps(sum_l, _mm_mul_ps(buf_l, _sinc));
-                  sum_r        = _mm_add_ps(sum_r, _mm_mul_ps(buf_r, _sinc));
-               }
+   /* Try on the first call right away, otherwise once the
+    * new ratio has held still for SINC_BANK_HOLD_FRAMES, see
+    * resampler_sinc_process(). Switching snaps the position to
+    * the nearest bank phase, at most half a 1/bank_phases step. */
+   if (resamp->last_ratio == 0.0)
+   {
+      sinc_bank_init(resamp, ratio);
+      resamp->hold_frames = SINC_BANK_HOLD_FRAMES;
+   }
+   else
+      resamp->hold_frames = 0;
 
-               /* Them annoying shuffles.
-                * sum_l = { l3, l2, l1, l0 }
-                * sum_r = { r3, r2, r1, r0 }
-                */
+   resamp->last_ratio = ratio;
+}
 
-               sum = _mm_add_ps(_mm_shuffle_ps(sum_l, sum_r,
-                        _MM_SHUFFLE(1, 0, 1, 0)),
-                     _mm_shuffle_ps(sum_l, sum_r, _MM_SHUFFLE(3, 2, 3, 2)));
+static size_t resampler_sinc_process_bank(kingsn_sinc_resampler_t *resamp,
+      const float *input, size_t frames, float *output)
+{
+   size_t out_frames              = 0;
+   unsigned taps                  = resamp->taps;
+   unsigned phases                = resamp->bank_phases;
+   unsigned step                  = resamp->bank_step;
+   sinc_kernel_t kernel           = resamp->kernel;
 
-               /* sum   = { r1, r0, l1, l0 } + { r3, r2, l3, l2 }
-                * sum   = { R1, R0, L1, L0 }
-                */
+   while (frames)
+   {
+      while (frames && resamp->bank_time >= phases)
+      {
+         resampler_sinc_push(resamp, input);
+         input                   += 2;
+         resamp->bank_time       -= phases;
+         frames--;
+      }
 
-               sum = _mm_add_ps(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 1, 1)), sum);
+      {
+         const float *buffer_l    = resamp->buffer_l + resamp->ptr;
+         const float *buffer_r    = resamp->buffer_r + resamp->ptr;
+         while (resamp->bank_time < phases)
+         {
+            kernel(output, buffer_l, buffer_r,
+                  resamp->bank + resamp->bank_time * taps, taps);
 
-               /* sum   = {R1, R1, L1, L1 } + { R1, R0, L1, L0 }
-                * sum   = { X,  R,  X,  L }
-                */
+            output               += 2;
+            out_frames++;
+            resamp->bank_time    += step;
+         }
+      }
+   }
 
-               /* Store L */
-               _mm_store_ss(output + 0, sum);
+   return out_frames;
+}
 
-               /* movehl { X, R, X, L } == { X, R, X, R } */
-               _mm_store_ss(output + 1, _mm_movehl_ps(sum, sum));
+static size_t resampler_sinc_process_lerp(kingsn_sinc_resampler_t *resamp,
+      const float *input, size_t frames, float *output, uint32_t ratio)
+{
+   size_t out_frames              = 0;
+   unsigned phases                = 1 << (resamp->phase_bits + resamp->subphase_bits);
+   unsigned taps                  = resamp->taps;
+   sinc_kernel_lerp_t kernel      = resamp->kernel_lerp;
 
-               output += 2;
-               out_frames++;
-               resamp->time += ratio;
-            }
+   while (frames)
+   {
+      while (frames && resamp->time >= phases)
+      {
+         resampler_sinc_push(resamp, input);
+         input                   += 2;
+         resamp->time            -= phases;
+         frames--;
+      }
+
+      {
+         const float *buffer_l    = resamp->buffer_l + resamp->ptr;
+         const float *buffer_r    = resamp->buffer_r + resamp->ptr;
+         while (resamp->time < phases)
+         {
+            unsigned phase           = resamp->time >> resamp->subphase_bits;
+            const float *phase_table = resamp->phase_table + phase * taps * 2;
+            float delta              = (float)
+               (resamp->time & resamp->subphase_mask) * resamp->subphase_mod;
+
+            kernel(output, buffer_l, buffer_r,
+                  phase_table, phase_table + taps, delta, taps);
+
+            output                  += 2;
+            out_frames++;
+            resamp->time            += ratio;
          }
       }
    }
 
-   data->output_frames = out_frames;
+   return out_frames;
 }
-#endif
 
-static void resampler_sinc_process_c(void *re_, struct resampler_data *data)
+static void resampler_sinc_process(void *re_, struct resampler_data *data)
 {
    kingsn_sinc_resampler_t *resamp = (kingsn_sinc_resampler_t*)re_;
    unsigned phases                = 1 << (resamp->phase_bits + resamp->subphase_bits);
@@ -489,112 +660,70 @@ static void resampler_sinc_process_c(void *re_, struct resampler_data *data)
    float *output                  = data->data_out;
    size_t frames                  = data->input_frames;
    size_t out_frames              = 0;
+   unsigned taps                  = resamp->taps;
 
    if (resamp->window_type == SINC_WINDOW_KAISER)
    {
-      while (frames)
-      {
-         while (frames && resamp->time >= phases)
-         {
-            /* Push in reverse to make filter more obvious. */
-            if (!resamp->ptr)
-               resamp->ptr = resamp->taps;
-            resamp->ptr--;
-
-            resamp->buffer_l[resamp->ptr + resamp->taps]    =
-               resamp->buffer_l[resamp->ptr]                = *input++;
-
-            resamp->buffer_r[resamp->ptr + resamp->taps]    =
-               resamp->buffer_r[resamp->ptr]                = *input++;
-
-            resamp->time                                   -= phases;
-            frames--;
-         }
+      if (data->ratio != resamp->last_ratio)
+         sinc_bank_update(resamp, data->ratio);
 
-         {
-            const float *buffer_l    = resamp->buffer_l + resamp->ptr;
-            const float *buffer_r    = resamp->buffer_r + resamp->ptr;
-            unsigned taps            = resamp->taps;
-            while (resamp->time < phases)
-            {
-               unsigned i;
-               float sum_l              = 0.0f;
-               float sum_r              = 0.0f;
-               unsigned phase           = resamp->time >> resamp->subphase_bits;
-               float *phase_table       = resamp->phase_table + phase * taps * 2;
-               float *delta_table       = phase_table + taps;
-               float delta              = (float)
-                  (resamp->time & resamp->subphase_mask) * resamp->subphase_mod;
-
-               for (i = 0; i < taps; i++)
-               {
-                  float sinc_val        = phase_table[i] + delta_table[i] * delta;
-
-                  sum_l                += buffer_l[i] * sinc_val;
-                  sum_r                += buffer_r[i] * sinc_val;
-               }
+      /* Switches to a bank at the input frame where the ratio
+       * has held still long enough, no matter how the input
+       * is split into calls. */
+      if (!resamp->bank && resamp->hold_frames < SINC_BANK_HOLD_FRAMES)
+      {
+         size_t hold          = SINC_BANK_HOLD_FRAMES - resamp->hold_frames;
 
-               output[0]                = sum_l;
-               output[1]                = sum_r;
+         if (hold > frames)
+            hold              = frames;
 
-               output                  += 2;
-               out_frames++;
-               resamp->time            += ratio;
-            }
-         }
+         out_frames           = resampler_sinc_process_lerp(resamp,
+               input, hold, output, ratio);
+         input               += hold * 2;
+         output              += out_frames * 2;
+         frames              -= hold;
+         resamp->hold_frames += hold;
 
+         if (resamp->hold_frames == SINC_BANK_HOLD_FRAMES)
+            sinc_bank_init(resamp, data->ratio);
       }
+
+      if (resamp->bank)
+         out_frames          += resampler_sinc_process_bank(resamp,
+               input, frames, output);
+      else
+         out_frames          += resampler_sinc_process_lerp(resamp,
+               input, frames, output, ratio);
    }
    else
    {
+      sinc_kernel_t kernel        = resamp->kernel;
+
       while (frames)
       {
          while (frames && resamp->time >= phases)
          {
-            /* Push in reverse to make filter more obvious. */
-            if (!resamp->ptr)
-               resamp->ptr = resamp->taps;
-            resamp->ptr--;
-
-            resamp->buffer_l[resamp->ptr + resamp->taps]    =
-               resamp->buffer_l[resamp->ptr]                = *input++;
-
-            resamp->buffer_r[resamp->ptr + resamp->taps]    =
-               resamp->buffer_r[resamp->ptr]                = *input++;
-
-            resamp->time                                   -= phases;
+            resampler_sinc_push(resamp, input);
+            input                   += 2;
+            resamp->time            -= phases;
             frames--;
          }
 
          {
             const float *buffer_l    = resamp->buffer_l + resamp->ptr;
             const float *buffer_r    = resamp->buffer_r + resamp->ptr;
-            unsigned taps            = resamp->taps;
             while (resamp->time < phases)
             {
-               unsigned i;
-               float sum_l              = 0.0f;
-               float sum_r              = 0.0f;
                unsigned phase           = resamp->time >> resamp->subphase_bits;
-               float *phase_table       = resamp->phase_table + phase * taps;
 
-               for (i = 0; i < taps; i++)
-               {
-                  float sinc_val        = phase_table[i];
-
-                  sum_l                += buffer_l[i] * sinc_val;
-                  sum_r                += buffer_r[i] * sinc_val;
-               }
-
-               output[0]                = sum_l;
-               output[1]                = sum_r;
+               kernel(output, buffer_l, buffer_r,
+                     resamp->phase_table + phase * taps, taps);
 
                output                  += 2;
                out_frames++;
                resamp->time            += ratio;
             }
          }
-
       }
    }
 
@@ -605,7 +734,10 @@ static void resampler_sinc_free(void *data)
 {
    kingsn_sinc_resampler_t *resamp = (kingsn_sinc_resampler_t*)data;
    if (resamp)
+   {
       memalign_free(resamp->main_buffer);
+      memalign_free(resamp->bank);
+   }
    free(resamp);
 }
 
@@ -725,6 +857,7 @@ static void sinc_init_table_lanczos(
    }
 }
 
+
 static void *resampler_sinc_new(const struct resampler_config *config,
       double bandwidth_mod, enum resampler_quality quality,
       resampler_simd_mask_t mask)
@@ -801,20 +934,66 @@ static void *resampler_sinc_new(const struct resampler_config *config,
       re->taps = (unsigned)ceil(re->taps / bandwidth_mod);
    }
 
-   /* Be SIMD-friendly. */
-#if defined(__AVX__)
+   /* Be SIMD-friendly. The wide kernels only pay off with the long
+    * filters of the higher presets. The filter length only depends
+    * on the preset, not on the kernel the CPU ends up with. */
+#if defined(WANT_NEON)
+   re->taps          = (re->taps + 7) & ~7;
+#else
    if (re->enable_avx)
-      re->taps  = (re->taps + 7) & ~7;
+      re->taps       = (re->taps + 7) & ~7;
    else
+      re->taps       = (re->taps + 3) & ~3;
 #endif
+
+   re->kernel        = sinc_kernel_c;
+   re->kernel_lerp   = sinc_kernel_lerp_c;
+
+#if defined(__SSE__)
+   if (mask & RESAMPLER_SIMD_SSE)
    {
-#if defined(WANT_NEON)
-      re->taps     = (re->taps + 7) & ~7;
-#else
-      re->taps     = (re->taps + 3) & ~3;
+      re->kernel      = sinc_kernel_sse;
+      re->kernel_lerp = sinc_kernel_lerp_sse;
+   }
+#endif
+
+   if (re->enable_avx)
+   {
+#if defined(SINC_AVX512)
+      /* Slower than FMA with shorter filters */
+      if ((mask & RESAMPLER_SIMD_AVX512)
+            && re->taps >= SINC_AVX512_MIN_TAPS)
+      {
+         re->kernel      = sinc_kernel_avx512;
+         re->kernel_lerp = sinc_kernel_lerp_avx512;
+      }
+      else
+#endif
+#if defined(SINC_FMA)
+      if ((mask & RESAMPLER_SIMD_AVX2) && (mask & RESAMPLER_SIMD_FMA3))
+      {
+         re->kernel      = sinc_kernel_fma;
+         re->kernel_lerp = sinc_kernel_lerp_fma;
+      }
+      else
 #endif
+#if defined(SINC_AVX)
+      if (mask & RESAMPLER_SIMD_AVX)
+      {
+         re->kernel      = sinc_kernel_avx;
+         re->kernel_lerp = sinc_kernel_lerp_avx;
+      }
+#endif
+      ;
    }
 
+#if defined(WANT_NEON)
+   /* There is no interpolating NEON kernel, so Kaiser
+    * filters only use it through a polyphase bank. */
+   if (mask & RESAMPLER_SIMD_NEON)
+      re->kernel = process_sinc_neon_asm;
+#endif
+
    phase_elems     = ((1 << re->phase_bits) * re->taps);
    if (re->window_type == SINC_WINDOW_KAISER)
       phase_elems  = phase_elems * 2;
@@ -844,27 +1023,6 @@ static void *resampler_sinc_new(const struct resampler_config *config,
          goto error;
    }
 
-   sinc_resampler.process = resampler_sinc_process_c;
-
-   if (mask & RESAMPLER_SIMD_AVX && re->enable_avx)
-   {
-#if defined(__AVX__)
-      sinc_resampler.process = resampler_sinc_process_avx;
-#endif
-   }
-   else if (mask & RESAMPLER_SIMD_SSE)
-   {
-#if defined(__SSE__)
-      sinc_resampler.process = resampler_sinc_process_sse;
-#endif
-   }
-   else if (mask & RESAMPLER_SIMD_NEON && re->window_type != SINC_WINDOW_KAISER)
-   {
-#if defined(WANT_NEON)
-      sinc_resampler.process = resampler_sinc_process_neon;
-#endif
-   }
-
    return re;
 
 error:
@@ -874,7 +1032,7 @@ error:
 
 ks_resampler_t sinc_resampler = {
    resampler_sinc_new,
-   resampler_sinc_process_c,
+   resampler_sinc_process,
    resampler_sinc_free,
    RESAMPLER_API_VERSION,
    "sinc",
@@ -594,6 +594,7 @@ uint64_t cpu_features_get(void)
    uint64_t cpu        = 0;
 #if defined(CPU_X86) && !defined(__MACH__)
    int vendor_is_intel = 0;
+   uint64_t xcr0       = 0;
    const int avx_flags = (1 << 27) | (1 << 28);
 #endif
 #if defined(__MACH__)
@@ -638,6 +639,10 @@ uint64_t cpu_features_get(void)
    if (sysctlbyname("hw.optional.aes", NULL, &len, NULL, 0) == 0)
       cpu |= KS_SIMD_AES;
 
+   len            = sizeof(size_t);
+   if (sysctlbyname("hw.optional.arm.FEAT_PMULL", NULL, &len, NULL, 0) == 0)
+      cpu |= KS_SIMD_PMULL;
+
    len            = sizeof(size_t);
    if (sysctlbyname("hw.optional.avx1_0", NULL, &len, NULL, 0) == 0)
       cpu |= KS_SIMD_AVX;
@@ -646,6 +651,14 @@ uint64_t cpu_features_get(void)
    if (sysctlbyname("hw.optional.avx2_0", NULL, &len, NULL, 0) == 0)
       cpu |= KS_SIMD_AVX2;
 
+   len            = sizeof(size_t);
+   if (sysctlbyname("hw.optional.fma", NULL, &len, NULL, 0) == 0)
+      cpu |= KS_SIMD_FMA3;
+
+   len            = sizeof(size_t);
+   if (sysctlbyname("hw.optional.avx512f", NULL, &len, NULL, 0) == 0)
+      cpu |= KS_SIMD_AVX512;
+
    len            = sizeof(size_t);
    if (sysctlbyname("hw.optional.altivec", NULL, &len, NULL, 0) == 0)
       cpu |= KS_SIMD_VMX;
@@ -722,17 +735,31 @@ uint64_t cpu_features_get(void)
    if (flags[2] & (1 << 25))
       cpu |= KS_SIMD_AES;
 
+   if (flags[2] & (1 << 1))
+      cpu |= KS_SIMD_PCLMUL;
+
    /* Must only perform xgetbv check if we have
     * AVX CPU support (guaranteed to have at least i686). */
-   if (((flags[2] & avx_flags) == avx_flags)
-         && ((xgetbv_x86(0) & 0x6) == 0x6))
+   if ((flags[2] & avx_flags) == avx_flags)
+      xcr0 = xgetbv_x86(0);
+
+   if ((xcr0 & 0x6) == 0x6)
+   {
       cpu |= KS_SIMD_AVX;
 
+      if (flags[2] & (1 << 12))
+         cpu |= KS_SIMD_FMA3;
+   }
+
    if (max_flag >= 7)
    {
       x86_cpuid(7, flags);
-      if (flags[1] & (1 << 5))
+      if ((cpu & KS_SIMD_AVX) && (flags[1] & (1 << 5)))
          cpu |= KS_SIMD_AVX2;
+
+      /* The OS must also save the opmask and upper ZMM state. */
+      if (((xcr0 & 0xe6) == 0xe6) && (flags[1] & (1 << 16)))
+         cpu |= KS_SIMD_AVX512;
    }
 
    x86_cpuid(0x80000000, flags);
@@ -769,6 +796,9 @@ uint64_t cpu_features_get(void)
 #endif
    }
 
+   if (check_arm_cpu_feature("pmull"))
+      cpu |= KS_SIMD_PMULL;
+
 #if 0
     check_arm_cpu_feature("swp");
     check_arm_cpu_feature("half");
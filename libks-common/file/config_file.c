@@ -35,6 +35,7 @@
 #include <compat/posix_string.h>
 #include <compat/fopen_utf8.h>
 #include <compat/msvc.h>
+#include <array/rhmap.h>
 #include <file/config_file.h>
 #include <file/file_path.h>
 #include <string/stdstring.h>
@@ -52,6 +53,39 @@ struct config_include_list
 static bool config_file_parse_line(config_file_t *conf,
       struct config_entry_list *list, char *line, config_file_cb_t *cb);
 
+/* Lookups return the first entry in the list with a
+ * matching key, so the index maps the hash of a key to
+ * the first entry with that hash. Keys with colliding
+ * hashes are told apart by walking the list from there. */
+static void config_file_index_add(config_file_t *conf,
+      struct config_entry_list *entry)
+{
+   uint32_t hash;
+
+   if (!entry->key)
+      return;
+
+   hash = hash_string(entry->key);
+   if (!RHMAP_HAS(conf->entries_map, hash))
+      RHMAP_SET(conf->entries_map, hash, entry);
+}
+
+/* Rebuilds the index and the tail pointer after
+ * the list was reordered */
+static void config_file_index_rebuild(config_file_t *conf)
+{
+   struct config_entry_list *entry = NULL;
+
+   RHMAP_CLEAR(conf->entries_map);
+   conf->tail = NULL;
+
+   for (entry = conf->entries; entry; entry = entry->next)
+   {
+      config_file_index_add(conf, entry);
+      conf->tail = entry;
+   }
+}
+
 static int config_file_sort_compare_func(struct config_entry_list *a,
       struct config_entry_list *b)
 {
@@ -273,45 +307,29 @@ static char *config_file_extract_value(char *line, bool is_value)
 static void config_file_add_child_list(config_file_t *parent, config_file_t *child)
 {
    struct config_entry_list *list = child->entries;
-   if (parent->entries)
-   {
-      struct config_entry_list *head = parent->entries;
-      while (head->next)
-         head = head->next;
 
-      /* set list readonly */
-      while (list)
-      {
-         list->readonly = true;
-         list           = list->next;
-      }
-      head->next        = child->entries;
-   }
-   else
+   if (!list)
+      return;
+
+   /* set list readonly, entries already in the
+    * parent take precedence */
+   while (list)
    {
-      /* set list readonly */
-      while (list)
-      {
-         list->readonly = true;
-         list           = list->next;
-      }
-      parent->entries   = child->entries;
+      list->readonly = true;
+      config_file_index_add(parent, list);
+      list           = list->next;
    }
 
-   child->entries = NULL;
+   if (parent->entries)
+      parent->tail->next = child->entries;
+   else
+      parent->entries    = child->entries;
 
    /* Rebase tail. */
-   if (parent->entries)
-   {
-      struct config_entry_list *head =
-         (struct config_entry_list*)parent->entries;
+   parent->tail          = child->tail;
 
-      while (head->next)
-         head = head->next;
-      parent->tail = head;
-   }
-   else
-      parent->tail = NULL;
+   child->entries        = NULL;
+   child->tail           = NULL;
 }
 
 static void config_file_get_realpath(char *s, size_t len,
@@ -423,6 +441,7 @@ static int config_file_load_internal(
             conf->entries    = list;
 
          conf->tail = list;
+         config_file_index_add(conf, list);
 
          if (cb && list->key && list->value)
             cb->config_file_new_entry_cb(list->key, list->value) ;
@@ -626,6 +645,7 @@ static int config_file_from_string_internal(
             conf->entries    = list;
 
          conf->tail          = list;
+         config_file_index_add(conf, list);
       }
 
       if (list != conf->tail)
@@ -698,6 +718,8 @@ bool config_file_deinitialize(config_file_t *conf)
          free(hold);
    }
 
+   RHMAP_FREE(conf->entries_map);
+
    if (conf->reference)
       free(conf->reference);
 
@@ -724,6 +746,9 @@ bool config_append_file(config_file_t *conf, const char *path)
       new_conf->tail->next = conf->entries;
       conf->entries        = new_conf->entries; /* Pilfer. */
       new_conf->entries    = NULL;
+
+      /* The new entries now come first */
+      config_file_index_rebuild(conf);
    }
 
    config_file_free(new_conf);
@@ -821,6 +846,7 @@ void config_file_initialize(struct config_file *conf)
    conf->last                     = NULL;
    conf->reference                = NULL;
    conf->includes                 = NULL;
+   conf->entries_map              = NULL;
    conf->include_depth            = 0;
    conf->guaranteed_no_duplicates = false;
    conf->modified                 = false;
@@ -835,32 +861,20 @@ config_file_t *config_file_new_alloc(void)
    return conf;
 }
 
-static struct config_entry_list *config_get_entry_internal(
-      const config_file_t *conf,
-      const char *key, struct config_entry_list **prev)
+struct config_entry_list *config_get_entry(
+      const config_file_t *conf, const char *key)
 {
-   struct config_entry_list *entry    = NULL;
-   struct config_entry_list *previous = prev ? *prev : NULL;
-
-   for (entry = conf->entries; entry; entry = entry->next)
-   {
-      if (string_is_equal(key, entry->key))
-         return entry;
-
-      previous = entry;
-   }
+   ptrdiff_t idx;
+   struct config_entry_list *entry = NULL;
 
-   if (prev)
-      *prev = previous;
+   if (!key)
+      return NULL;
 
-   return NULL;
-}
+   idx = RHMAP_IDX(conf->entries_map, hash_string(key));
+   if (idx == -1)
+      return NULL;
 
-struct config_entry_list *config_get_entry(
-      const config_file_t *conf, const char *key)
-{
-   struct config_entry_list *entry    = NULL;
-   for (entry = conf->entries; entry; entry = entry->next)
+   for (entry = conf->entries_map[idx]; entry; entry = entry->next)
    {
       if (string_is_equal(key, entry->key))
          return entry;
@@ -1079,23 +1093,14 @@ bool config_get_bool(config_file_t *conf, const char *key, bool *in)
 
 void config_set_string(config_file_t *conf, const char *key, const char *val)
 {
-   struct config_entry_list *last  = NULL;
    struct config_entry_list *entry = NULL;
 
    if (!conf || !key || !val)
       return;
 
-   last                            = conf->entries;
-
-   if (conf->guaranteed_no_duplicates)
-   {
-      if (conf->last)
-         last                      = conf->last;
-   }
-   else
+   if (!conf->guaranteed_no_duplicates)
    {
-      entry                        = config_get_entry_internal(
-            conf, key, &last);
+      entry                        = config_get_entry(conf, key);
       if (entry)
       {
          /* An entry corresponding to 'key' already exists
@@ -1133,28 +1138,47 @@ void config_set_string(config_file_t *conf, const char *key, const char *val)
    entry->next      = NULL;
    conf->modified   = true;
 
-   if (last)
-      last->next    = entry;
+   if (conf->tail)
+      conf->tail->next = entry;
    else
-      conf->entries = entry;
+      conf->entries    = entry;
 
+   conf->tail       = entry;
    conf->last       = entry;
+   config_file_index_add(conf, entry);
 }
 
 void config_unset(config_file_t *conf, const char *key)
 {
-   struct config_entry_list *last  = NULL;
+   uint32_t hash;
    struct config_entry_list *entry = NULL;
+   struct config_entry_list *next  = NULL;
 
    if (!conf || !key)
       return;
 
-   last  = conf->entries;
-   entry = config_get_entry_internal(conf, key, &last);
+   entry = config_get_entry(conf, key);
 
    if (!entry)
       return;
 
+   /* If this entry is the one indexed, hand its slot
+    * to the next entry with the same hash, if any */
+   hash  = hash_string(key);
+   if (RHMAP_GET(conf->entries_map, hash) == entry)
+   {
+      for (next = entry->next; next; next = next->next)
+      {
+         if (next->key && hash_string(next->key) == hash)
+            break;
+      }
+
+      if (next)
+         RHMAP_SET(conf->entries_map, hash, next);
+      else
+         (void)RHMAP_DEL(conf->entries_map, hash);
+   }
+
    if (entry->key)
       free(entry->key);
 
@@ -1302,6 +1326,7 @@ void config_file_dump_orbis(config_file_t *conf, int fd)
          (struct config_entry_list*)conf->entries,
          config_file_sort_compare_func);
    conf->entries = list;
+   config_file_index_rebuild(conf);
 
    while (list)
    {
@@ -1344,13 +1369,15 @@ void config_file_dump(config_file_t *conf, FILE *file, bool sort)
    }
 
    if (sort)
-      list = config_file_merge_sort_linked_list(
+   {
+      list          = config_file_merge_sort_linked_list(
             (struct config_entry_list*)conf->entries,
             config_file_sort_compare_func);
+      conf->entries = list;
+      config_file_index_rebuild(conf);
+   }
    else
-      list = (struct config_entry_list*)conf->entries;
-
-   conf->entries = list;
+      list          = (struct config_entry_list*)conf->entries;
 
    while (list)
    {
@@ -1374,16 +1401,7 @@ void config_file_dump(config_file_t *conf, FILE *file, bool sort)
 
 bool config_entry_exists(config_file_t *conf, const char *entry)
 {
-   struct config_entry_list *list = conf->entries;
-
-   while (list)
-   {
-      if (string_is_equal(entry, list->key))
-         return true;
-      list = list->next;
-   }
-
-   return false;
+   return config_get_entry(conf, entry) != NULL;
 }
 
 bool config_get_entry_list_head(config_file_t *conf,
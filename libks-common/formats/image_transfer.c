@@ -207,6 +207,31 @@ void image_transfer_set_buffer_ptr(
    }
 }
 
+void image_transfer_set_target_size(
+      void *data,
+      enum image_type_enum type,
+      unsigned width,
+      unsigned height)
+{
+   switch (type)
+   {
+      case IMAGE_TYPE_PNG:
+#ifdef HAVE_RPNG
+         rpng_set_target_size((rpng_t*)data, width, height);
+#endif
+         break;
+      case IMAGE_TYPE_JPEG:
+#ifdef HAVE_RJPEG
+         rjpeg_set_target_size((rjpeg_t*)data, width, height);
+#endif
+         break;
+      case IMAGE_TYPE_TGA:
+      case IMAGE_TYPE_BMP:
+      case IMAGE_TYPE_NONE:
+         break;
+   }
+}
+
 int image_transfer_process(
       void *data,
       enum image_type_enum type,
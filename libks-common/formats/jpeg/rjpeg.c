@@ -68,6 +68,8 @@ typedef struct
 struct rjpeg
 {
    uint8_t *buff_data;
+   unsigned target_w;
+   unsigned target_h;
 };
 
 #ifdef _MSC_VER
@@ -227,6 +229,11 @@ typedef struct
    int16_t fast_ac[4][1 << FAST_BITS];
    unsigned char  marker;        /* marker seen while filling entropy buffer */
    uint8_t dequant[4][64];
+
+   /* reduced size decoding: every 8x8 block is turned into
+    * (8 >> scale_shift) pixels square by the IDCT */
+   int scale_shift;
+   unsigned target_w, target_h;
 } rjpeg_jpeg;
 
 #define RJPEG_F2F(x)  ((int) (((x) * 4096 + 0.5)))
@@ -893,6 +900,164 @@ static void rjpeg_idct_block(uint8_t *out, int out_stride, short data[64])
    }
 }
 
+/* Reduced size IDCTs, derived from jidctred. They compute a
+ * 4x4, 2x2 or 1x1 block straight from the coefficients, which
+ * decodes the image at 1/2, 1/4 or 1/8 of its size for a
+ * fraction of the work of a full IDCT plus a downscale */
+#define RJPEG_RED_CONST_BITS 13
+#define RJPEG_RED_PASS1_BITS 2
+#define RJPEG_RED_F2F(x)     ((int)((x) * (1 << RJPEG_RED_CONST_BITS) + 0.5))
+#define RJPEG_RED_DESCALE(x, n) (((x) + (1 << ((n) - 1))) >> (n))
+
+static void rjpeg_idct_block_4x4(uint8_t *out, int out_stride, short data[64])
+{
+   int i, val[8 * 4];
+   int       *v = val;
+   int16_t   *d = data;
+
+   /* columns; the second pass does not use column 4 */
+   for (i = 0; i < 8; ++i, ++d, ++v)
+   {
+      int t0, t2, t10, t12;
+
+      if (i == 4)
+         continue;
+
+      if (     d[ 8] == 0
+            && d[16] == 0
+            && d[24] == 0
+            && d[40] == 0
+            && d[48] == 0
+            && d[56] == 0)
+      {
+         int dcterm = d[0] << RJPEG_RED_PASS1_BITS;
+         v[0] = v[8] = v[16] = v[24] = dcterm;
+         continue;
+      }
+
+      t0  = d[0] << (RJPEG_RED_CONST_BITS + 1);
+      t2  = d[16] * RJPEG_RED_F2F(1.847759065f)
+          - d[48] * RJPEG_RED_F2F(0.765366865f);
+      t10 = t0 + t2;
+      t12 = t0 - t2;
+
+      t0  = d[56] * -RJPEG_RED_F2F(0.211164243f)
+          + d[40] *  RJPEG_RED_F2F(1.451774981f)
+          + d[24] * -RJPEG_RED_F2F(2.172734803f)
+          + d[ 8] *  RJPEG_RED_F2F(1.061594337f);
+      t2  = d[56] * -RJPEG_RED_F2F(0.509795579f)
+          + d[40] * -RJPEG_RED_F2F(0.601344887f)
+          + d[24] *  RJPEG_RED_F2F(0.899976223f)
+          + d[ 8] *  RJPEG_RED_F2F(2.562915447f);
+
+      v[ 0] = RJPEG_RED_DESCALE(t10 + t2,
+            RJPEG_RED_CONST_BITS - RJPEG_RED_PASS1_BITS + 1);
+      v[24] = RJPEG_RED_DESCALE(t10 - t2,
+            RJPEG_RED_CONST_BITS - RJPEG_RED_PASS1_BITS + 1);
+      v[ 8] = RJPEG_RED_DESCALE(t12 + t0,
+            RJPEG_RED_CONST_BITS - RJPEG_RED_PASS1_BITS + 1);
+      v[16] = RJPEG_RED_DESCALE(t12 - t0,
+            RJPEG_RED_CONST_BITS - RJPEG_RED_PASS1_BITS + 1);
+   }
+
+   for (i = 0, v = val; i < 4; ++i, v += 8, out += out_stride)
+   {
+      int t0, t2, t10, t12;
+
+      if (!v[1] && !v[2] && !v[3] && !v[5] && !v[6] && !v[7])
+      {
+         out[0] = out[1] = out[2] = out[3] = rjpeg_clamp(
+               RJPEG_RED_DESCALE(v[0], RJPEG_RED_PASS1_BITS + 3) + 128);
+         continue;
+      }
+
+      t0  = v[0] << (RJPEG_RED_CONST_BITS + 1);
+      t2  = v[2] * RJPEG_RED_F2F(1.847759065f)
+          - v[6] * RJPEG_RED_F2F(0.765366865f);
+      t10 = t0 + t2;
+      t12 = t0 - t2;
+
+      t0  = v[7] * -RJPEG_RED_F2F(0.211164243f)
+          + v[5] *  RJPEG_RED_F2F(1.451774981f)
+          + v[3] * -RJPEG_RED_F2F(2.172734803f)
+          + v[1] *  RJPEG_RED_F2F(1.061594337f);
+      t2  = v[7] * -RJPEG_RED_F2F(0.509795579f)
+          + v[5] * -RJPEG_RED_F2F(0.601344887f)
+          + v[3] *  RJPEG_RED_F2F(0.899976223f)
+          + v[1] *  RJPEG_RED_F2F(2.562915447f);
+
+      out[0] = rjpeg_clamp(RJPEG_RED_DESCALE(t10 + t2,
+               RJPEG_RED_CONST_BITS + RJPEG_RED_PASS1_BITS + 4) + 128);
+      out[3] = rjpeg_clamp(RJPEG_RED_DESCALE(t10 - t2,
+               RJPEG_RED_CONST_BITS + RJPEG_RED_PASS1_BITS + 4) + 128);
+      out[1] = rjpeg_clamp(RJPEG_RED_DESCALE(t12 + t0,
+               RJPEG_RED_CONST_BITS + RJPEG_RED_PASS1_BITS + 4) + 128);
+      out[2] = rjpeg_clamp(RJPEG_RED_DESCALE(t12 - t0,
+               RJPEG_RED_CONST_BITS + RJPEG_RED_PASS1_BITS + 4) + 128);
+   }
+}
+
+static void rjpeg_idct_block_2x2(uint8_t *out, int out_stride, short data[64])
+{
+   int i, val[8 * 2];
+   int       *v = val;
+   int16_t   *d = data;
+
+   /* columns; the second pass only uses the odd ones and 0 */
+   for (i = 0; i < 8; ++i, ++d, ++v)
+   {
+      int t0, t10;
+
+      if (i == 2 || i == 4 || i == 6)
+         continue;
+
+      if (d[8] == 0 && d[24] == 0 && d[40] == 0 && d[56] == 0)
+      {
+         v[0] = v[8] = d[0] << RJPEG_RED_PASS1_BITS;
+         continue;
+      }
+
+      t10 = d[0] << (RJPEG_RED_CONST_BITS + 2);
+      t0  = d[56] * -RJPEG_RED_F2F(0.720959822f)
+          + d[40] *  RJPEG_RED_F2F(0.850430095f)
+          + d[24] * -RJPEG_RED_F2F(1.272758580f)
+          + d[ 8] *  RJPEG_RED_F2F(3.624509785f);
+
+      v[0] = RJPEG_RED_DESCALE(t10 + t0,
+            RJPEG_RED_CONST_BITS - RJPEG_RED_PASS1_BITS + 2);
+      v[8] = RJPEG_RED_DESCALE(t10 - t0,
+            RJPEG_RED_CONST_BITS - RJPEG_RED_PASS1_BITS + 2);
+   }
+
+   for (i = 0, v = val; i < 2; ++i, v += 8, out += out_stride)
+   {
+      int t0, t10;
+
+      if (!v[1] && !v[3] && !v[5] && !v[7])
+      {
+         out[0] = out[1] = rjpeg_clamp(
+               RJPEG_RED_DESCALE(v[0], RJPEG_RED_PASS1_BITS + 3) + 128);
+         continue;
+      }
+
+      t10 = v[0] << (RJPEG_RED_CONST_BITS + 2);
+      t0  = v[7] * -RJPEG_RED_F2F(0.720959822f)
+          + v[5] *  RJPEG_RED_F2F(0.850430095f)
+          + v[3] * -RJPEG_RED_F2F(1.272758580f)
+          + v[1] *  RJPEG_RED_F2F(3.624509785f);
+
+      out[0] = rjpeg_clamp(RJPEG_RED_DESCALE(t10 + t0,
+               RJPEG_RED_CONST_BITS + RJPEG_RED_PASS1_BITS + 5) + 128);
+      out[1] = rjpeg_clamp(RJPEG_RED_DESCALE(t10 - t0,
+               RJPEG_RED_CONST_BITS + RJPEG_RED_PASS1_BITS + 5) + 128);
+   }
+}
+
+static void rjpeg_idct_block_1x1(uint8_t *out, int out_stride, short data[64])
+{
+   out[0] = rjpeg_clamp(RJPEG_RED_DESCALE((int)data[0], 3) + 128);
+}
+
 #if defined(__SSE2__)
 /* sse2 integer IDCT. not the fastest possible implementation but it
  * produces bit-identical results to the generic C version so it's
@@ -1331,6 +1496,8 @@ static void rjpeg_jpeg_reset(rjpeg_jpeg *j)
 
 static int rjpeg_parse_entropy_coded_data(rjpeg_jpeg *z)
 {
+   int bs = 8 >> z->scale_shift;
+
    rjpeg_jpeg_reset(z);
 
    if (z->scan_n == 1)
@@ -1391,7 +1558,7 @@ static int rjpeg_parse_entropy_coded_data(rjpeg_jpeg *z)
                         z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq]))
                   return 0;
 
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8,
+               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*bs+i*bs,
                      z->img_comp[n].w2, data);
 
                /* every data block is an MCU, so countdown the restart interval */
@@ -1471,8 +1638,8 @@ static int rjpeg_parse_entropy_coded_data(rjpeg_jpeg *z)
                   {
                      for (x = 0; x < z->img_comp[n].h; ++x)
                      {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
+                        int x2 = (i*z->img_comp[n].h + x)*bs;
+                        int y2 = (j*z->img_comp[n].v + y)*bs;
                         int ha = z->img_comp[n].ha;
 
                         if (!rjpeg_jpeg_decode_block(z, data,
@@ -1515,6 +1682,7 @@ static void rjpeg_jpeg_dequantize(short *data, uint8_t *dequant)
 static void rjpeg_jpeg_finish(rjpeg_jpeg *z)
 {
    int i,j,n;
+   int bs = 8 >> z->scale_shift;
 
    if (!z->progressive)
       return;
@@ -1530,7 +1698,7 @@ static void rjpeg_jpeg_finish(rjpeg_jpeg *z)
          {
             short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
             rjpeg_jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-            z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8,
+            z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*bs+i*bs,
                   z->img_comp[n].w2, data);
          }
       }
@@ -1800,6 +1968,28 @@ static int rjpeg_process_frame_header(rjpeg_jpeg *z, int scan)
          v_max = z->img_comp[i].v;
    }
 
+   /* decode at 1/2, 1/4 or 1/8 of the size if that still
+    * covers the requested target size in either direction */
+   z->scale_shift = 0;
+   if (z->target_w && z->target_h)
+      while (z->scale_shift < 3
+            && (   (z->target_w << (z->scale_shift + 1)) <= s->img_x
+                || (z->target_h << (z->scale_shift + 1)) <= s->img_y))
+         z->scale_shift++;
+
+   switch (z->scale_shift)
+   {
+      case 1:
+         z->idct_block_kernel = rjpeg_idct_block_4x4;
+         break;
+      case 2:
+         z->idct_block_kernel = rjpeg_idct_block_2x2;
+         break;
+      case 3:
+         z->idct_block_kernel = rjpeg_idct_block_1x1;
+         break;
+   }
+
    /* compute interleaved MCU info */
    z->img_h_max = h_max;
    z->img_v_max = v_max;
@@ -1820,8 +2010,8 @@ static int rjpeg_process_frame_header(rjpeg_jpeg *z, int scan)
           * the bogus oversized data from using interleaved MCUs and their
           * big blocks (e.g. a 16x16 iMCU on an image of width 33); we won't
           * discard the extra data until colorspace conversion */
-         z->img_comp[i].w2       = z->img_mcu_x * z->img_comp[i].h * 8;
-         z->img_comp[i].h2       = z->img_mcu_y * z->img_comp[i].v * 8;
+         z->img_comp[i].w2       = z->img_mcu_x * z->img_comp[i].h * (8 >> z->scale_shift);
+         z->img_comp[i].h2       = z->img_mcu_y * z->img_comp[i].v * (8 >> z->scale_shift);
          z->img_comp[i].raw_data = malloc(z->img_comp[i].w2 * z->img_comp[i].h2+15);
 
          /* Out of memory? */
@@ -1839,8 +2029,8 @@ static int rjpeg_process_frame_header(rjpeg_jpeg *z, int scan)
          /* align blocks for IDCT using MMX/SSE */
          z->img_comp[i].data      = (uint8_t*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
          z->img_comp[i].linebuf   = NULL;
-         z->img_comp[i].coeff_w   = (z->img_comp[i].w2 + 7) >> 3;
-         z->img_comp[i].coeff_h   = (z->img_comp[i].h2 + 7) >> 3;
+         z->img_comp[i].coeff_w   = z->img_mcu_x * z->img_comp[i].h;
+         z->img_comp[i].coeff_h   = z->img_mcu_y * z->img_comp[i].v;
          z->img_comp[i].raw_coeff = malloc(z->img_comp[i].coeff_w *
                                     z->img_comp[i].coeff_h * 64 * sizeof(short) + 15);
          z->img_comp[i].coeff     = (short*) (((size_t) z->img_comp[i].raw_coeff + 15) & ~15);
@@ -1858,8 +2048,8 @@ static int rjpeg_process_frame_header(rjpeg_jpeg *z, int scan)
           * the bogus oversized data from using interleaved MCUs and their
           * big blocks (e.g. a 16x16 iMCU on an image of width 33); we won't
           * discard the extra data until colorspace conversion */
-         z->img_comp[i].w2       = z->img_mcu_x * z->img_comp[i].h * 8;
-         z->img_comp[i].h2       = z->img_mcu_y * z->img_comp[i].v * 8;
+         z->img_comp[i].w2       = z->img_mcu_x * z->img_comp[i].h * (8 >> z->scale_shift);
+         z->img_comp[i].h2       = z->img_mcu_y * z->img_comp[i].v * (8 >> z->scale_shift);
          z->img_comp[i].raw_data = malloc(z->img_comp[i].w2 * z->img_comp[i].h2+15);
 
          /* Out of memory? */
@@ -1870,6 +2060,8 @@ static int rjpeg_process_frame_header(rjpeg_jpeg *z, int scan)
                free(z->img_comp[i].raw_data);
                z->img_comp[i].data = NULL;
             }
+
+            return 0;
          }
 
          /* align blocks for IDCT using MMX/SSE */
@@ -2445,6 +2637,16 @@ static uint8_t *rjpeg_load_jpeg_image(rjpeg_jpeg *z,
    if (!rjpeg_decode_jpeg_image(z))
       goto error;
 
+   /* the component planes were decoded at reduced size */
+   if (z->scale_shift)
+   {
+      int round   = (1 << z->scale_shift) - 1;
+      z->s->img_x = (z->s->img_x + round) >> z->scale_shift;
+      z->s->img_y = (z->s->img_y + round) >> z->scale_shift;
+      for (k = 0; k < z->s->img_n; ++k)
+         z->img_comp[k].y = (z->img_comp[k].y + round) >> z->scale_shift;
+   }
+
    /* determine actual number of components to generate */
    n = req_comp ? req_comp : z->s->img_n;
 
@@ -2573,6 +2775,9 @@ int rjpeg_process_image(rjpeg_t *rjpeg, void **buf_data,
    s.img_buffer_end      = (uint8_t*)rjpeg->buff_data + (int)size;
 
    j.s                   = &s;
+   j.scale_shift         = 0;
+   j.target_w            = rjpeg->target_w;
+   j.target_h            = rjpeg->target_h;
 
    rjpeg_setup_jpeg(&j);
 
@@ -2618,6 +2823,16 @@ bool rjpeg_set_buf_ptr(rjpeg_t *rjpeg, void *data)
    return true;
 }
 
+void rjpeg_set_target_size(rjpeg_t *rjpeg,
+      unsigned width, unsigned height)
+{
+   if (!rjpeg)
+      return;
+
+   rjpeg->target_w = width;
+   rjpeg->target_h = height;
+}
+
 void rjpeg_free(rjpeg_t *rjpeg)
 {
    if (!rjpeg)
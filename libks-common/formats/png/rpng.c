@@ -37,8 +37,23 @@
 #include <streams/trans_stream.h>
 #include <string/stdstring.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
 #include "rpng_internal.h"
 
+/* Images whose inflated data is at least this large are
+ * inflated on a separate thread while the scanlines that
+ * are already available get unfiltered */
+#define RPNG_PIPELINE_MIN_SIZE (256 * 1024)
+/* Bytes the inflate thread produces between wakeups */
+#define RPNG_PIPELINE_CHUNK    (64 * 1024)
+
+/* Largest box filter used when decoding to a target size.
+ * Keeps the per channel sums well within 32 bits */
+#define RPNG_MAX_SCALE         256
+
 enum png_ihdr_color_type
 {
    PNG_IHDR_COLOR_GRAY       = 0,
@@ -91,6 +106,16 @@ struct rpng_process
    uint8_t *prev_scanline;
    uint8_t *decoded_scanline;
    uint8_t *inflate_buf;
+   uint8_t *inflate_base; /* inflate_buf before any rows were consumed */
+#ifdef HAVE_THREADS
+   sthread_t *inflate_thread;
+   slock_t *inflate_lock;
+   scond_t *inflate_cond;
+   size_t inflate_done;  /* Guarded by inflate_lock */
+   size_t inflate_ready; /* Consumer's copy of inflate_done */
+#endif
+   uint32_t *scale_row;  /* Full size row, when scaling */
+   uint32_t *scale_sum;  /* Per channel sums of the output row */
    size_t restore_buf_size;
    size_t adam7_restore_buf_size;
    size_t data_restore_buf_size;
@@ -106,7 +131,15 @@ struct rpng_process
    unsigned pass_width;
    unsigned pass_height;
    unsigned pass_pos;
+   unsigned scale;       /* Box filter size, 1 when not scaling */
+   unsigned out_width;
+   unsigned out_height;
+   struct rpng_filter filter;
    bool inflate_initialized;
+   bool inflate_finished; /* Guarded by inflate_lock */
+   bool inflate_cancel;   /* Guarded by inflate_lock */
+   bool pipelined;
+   bool simd;
    bool adam7_pass_initialized;
    bool pass_initialized;
 };
@@ -119,6 +152,9 @@ struct rpng
    struct idat_buffer idat_buf; /* ptr alignment */
    struct png_ihdr ihdr; /* uint32 alignment */
    uint32_t palette[256];
+   unsigned flags;
+   unsigned target_w;
+   unsigned target_h;
    bool has_ihdr;
    bool has_idat;
    bool has_iend;
@@ -483,6 +519,10 @@ static void png_reverse_filter_deinit(struct rpng_process *pngp)
    if (pngp->prev_scanline)
       free(pngp->prev_scanline);
    pngp->prev_scanline    = NULL;
+   free(pngp->scale_row);
+   pngp->scale_row        = NULL;
+   free(pngp->scale_sum);
+   pngp->scale_sum        = NULL;
 
    pngp->pass_initialized = false;
    pngp->h                = 0;
@@ -534,9 +574,12 @@ static int png_reverse_filter_init(const struct png_ihdr *ihdr,
 
    png_pass_geom(ihdr, ihdr->width, ihdr->height, &pngp->bpp, &pngp->pitch, &pass_size);
 
-   if (pngp->total_out < pass_size)
+   /* A pipelined inflate checks this row by row */
+   if (!pngp->pipelined && pngp->total_out < pass_size)
       return -1;
 
+   rpng_filter_init(&pngp->filter, pngp->bpp, pngp->simd);
+
    pngp->restore_buf_size      = 0;
    pngp->data_restore_buf_size = 0;
    pngp->prev_scanline         = (uint8_t*)calloc(1, pngp->pitch);
@@ -545,6 +588,16 @@ static int png_reverse_filter_init(const struct png_ihdr *ihdr,
    if (!pngp->prev_scanline || !pngp->decoded_scanline)
       goto error;
 
+   if (pngp->scale > 1)
+   {
+      pngp->scale_row = (uint32_t*)malloc(ihdr->width * sizeof(uint32_t));
+      pngp->scale_sum = (uint32_t*)calloc(pngp->out_width * 4,
+            sizeof(uint32_t));
+
+      if (!pngp->scale_row || !pngp->scale_sum)
+         goto error;
+   }
+
    pngp->h = 0;
    pngp->pass_initialized = true;
 
@@ -558,7 +611,7 @@ error:
 static int png_reverse_filter_copy_line(uint32_t *data, const struct png_ihdr *ihdr,
       struct rpng_process *pngp, unsigned filter)
 {
-   unsigned i;
+   uint8_t *tmp;
 
    switch (filter)
    {
@@ -566,33 +619,20 @@ static int png_reverse_filter_copy_line(uint32_t *data, const struct png_ihdr *i
          memcpy(pngp->decoded_scanline, pngp->inflate_buf, pngp->pitch);
          break;
       case PNG_FILTER_SUB:
-         for (i = 0; i < pngp->bpp; i++)
-            pngp->decoded_scanline[i] = pngp->inflate_buf[i];
-         for (i = pngp->bpp; i < pngp->pitch; i++)
-            pngp->decoded_scanline[i] = pngp->decoded_scanline[i - pngp->bpp] + pngp->inflate_buf[i];
+         pngp->filter.sub(pngp->decoded_scanline, pngp->inflate_buf,
+               pngp->prev_scanline, pngp->pitch, pngp->bpp);
          break;
       case PNG_FILTER_UP:
-         for (i = 0; i < pngp->pitch; i++)
-            pngp->decoded_scanline[i] = pngp->prev_scanline[i] + pngp->inflate_buf[i];
+         pngp->filter.up(pngp->decoded_scanline, pngp->inflate_buf,
+               pngp->prev_scanline, pngp->pitch, pngp->bpp);
          break;
       case PNG_FILTER_AVERAGE:
-         for (i = 0; i < pngp->bpp; i++)
-         {
-            uint8_t avg = pngp->prev_scanline[i] >> 1;
-            pngp->decoded_scanline[i] = avg + pngp->inflate_buf[i];
-         }
-         for (i = pngp->bpp; i < pngp->pitch; i++)
-         {
-            uint8_t avg = (pngp->decoded_scanline[i - pngp->bpp] + pngp->prev_scanline[i]) >> 1;
-            pngp->decoded_scanline[i] = avg + pngp->inflate_buf[i];
-         }
+         pngp->filter.avg(pngp->decoded_scanline, pngp->inflate_buf,
+               pngp->prev_scanline, pngp->pitch, pngp->bpp);
          break;
       case PNG_FILTER_PAETH:
-         for (i = 0; i < pngp->bpp; i++)
-            pngp->decoded_scanline[i] = paeth(0, pngp->prev_scanline[i], 0) + pngp->inflate_buf[i];
-         for (i = pngp->bpp; i < pngp->pitch; i++)
-            pngp->decoded_scanline[i] = paeth(pngp->decoded_scanline[i - pngp->bpp],
-                  pngp->prev_scanline[i], pngp->prev_scanline[i - pngp->bpp]) + pngp->inflate_buf[i];
+         pngp->filter.paeth(pngp->decoded_scanline, pngp->inflate_buf,
+               pngp->prev_scanline, pngp->pitch, pngp->bpp);
          break;
 
       default:
@@ -605,7 +645,10 @@ static int png_reverse_filter_copy_line(uint32_t *data, const struct png_ihdr *i
          png_reverse_filter_copy_line_bw(data, pngp->decoded_scanline, ihdr->width, ihdr->depth);
          break;
       case PNG_IHDR_COLOR_RGB:
-         png_reverse_filter_copy_line_rgb(data, pngp->decoded_scanline, ihdr->width, ihdr->depth);
+         if (ihdr->depth == 8)
+            pngp->filter.copy_rgb8(data, pngp->decoded_scanline, ihdr->width);
+         else
+            png_reverse_filter_copy_line_rgb(data, pngp->decoded_scanline, ihdr->width, ihdr->depth);
          break;
       case PNG_IHDR_COLOR_PLT:
          png_reverse_filter_copy_line_plt(data, pngp->decoded_scanline, ihdr->width,
@@ -616,15 +659,93 @@ static int png_reverse_filter_copy_line(uint32_t *data, const struct png_ihdr *i
                ihdr->depth);
          break;
       case PNG_IHDR_COLOR_RGBA:
-         png_reverse_filter_copy_line_rgba(data, pngp->decoded_scanline, ihdr->width, ihdr->depth);
+         if (ihdr->depth == 8)
+            pngp->filter.copy_rgba8(data, pngp->decoded_scanline, ihdr->width);
+         else
+            png_reverse_filter_copy_line_rgba(data, pngp->decoded_scanline, ihdr->width, ihdr->depth);
          break;
    }
 
-   memcpy(pngp->prev_scanline, pngp->decoded_scanline, pngp->pitch);
+   /* This row is the previous one for the next row */
+   tmp                    = pngp->prev_scanline;
+   pngp->prev_scanline    = pngp->decoded_scanline;
+   pngp->decoded_scanline = tmp;
 
    return IMAGE_PROCESS_NEXT;
 }
 
+/* Adds the row in scale_row to the sums of the current
+ * output row. Once 'scale' rows (or the last one) have been
+ * added, writes their averages to 'data' and returns true */
+static bool png_reverse_filter_scale_line(uint32_t *data,
+      const struct png_ihdr *ihdr, struct rpng_process *pngp)
+{
+   unsigned x, ox;
+   unsigned rows;
+   uint32_t *sum        = pngp->scale_sum;
+   const uint32_t *in   = pngp->scale_row;
+
+   for (ox = 0, x = 0; ox < pngp->out_width; ox++, sum += 4)
+   {
+      unsigned end = x + pngp->scale;
+
+      if (end > ihdr->width)
+         end = ihdr->width;
+
+      for (; x < end; x++)
+      {
+         uint32_t px = in[x];
+         sum[0]     += (px >> 24);
+         sum[1]     += (px >> 16) & 0xff;
+         sum[2]     += (px >>  8) & 0xff;
+         sum[3]     += (px >>  0) & 0xff;
+      }
+   }
+
+   rows = pngp->h % pngp->scale;
+   if (rows && pngp->h < ihdr->height)
+      return false;
+   if (!rows)
+      rows = pngp->scale;
+
+   for (ox = 0, sum = pngp->scale_sum; ox < pngp->out_width; ox++, sum += 4)
+   {
+      unsigned cols  = pngp->scale;
+      unsigned count;
+
+      if (ox == pngp->out_width - 1 && ihdr->width % pngp->scale)
+         cols  = ihdr->width % pngp->scale;
+
+      count    = cols * rows;
+      data[ox] = (((sum[0] + count / 2) / count) << 24)
+               | (((sum[1] + count / 2) / count) << 16)
+               | (((sum[2] + count / 2) / count) <<  8)
+               | (((sum[3] + count / 2) / count) <<  0);
+      sum[0]   = sum[1] = sum[2] = sum[3] = 0;
+   }
+
+   return true;
+}
+
+#ifdef HAVE_THREADS
+/* Waits until the inflate thread has produced 'size' bytes
+ * of the current image. Returns false if it finished (or
+ * failed) short of that */
+static bool png_pipeline_wait(struct rpng_process *pngp, size_t size)
+{
+   if (size <= pngp->inflate_ready)
+      return true;
+
+   slock_lock(pngp->inflate_lock);
+   while (pngp->inflate_done < size && !pngp->inflate_finished)
+      scond_wait(pngp->inflate_cond, pngp->inflate_lock);
+   pngp->inflate_ready = pngp->inflate_done;
+   slock_unlock(pngp->inflate_lock);
+
+   return size <= pngp->inflate_ready;
+}
+#endif
+
 static int png_reverse_filter_regular_iterate(uint32_t **data, const struct png_ihdr *ihdr,
       struct rpng_process *pngp)
 {
@@ -632,9 +753,21 @@ static int png_reverse_filter_regular_iterate(uint32_t **data, const struct png_
 
    if (pngp->h < ihdr->height)
    {
-      unsigned filter = *pngp->inflate_buf++;
+      unsigned filter;
+
+#ifdef HAVE_THREADS
+      if (pngp->pipelined && !png_pipeline_wait(pngp,
+               pngp->restore_buf_size + pngp->pitch + 1))
+      {
+         ret = IMAGE_PROCESS_ERROR_END;
+         goto end;
+      }
+#endif
+
+      filter = *pngp->inflate_buf++;
       pngp->restore_buf_size += 1;
-      ret = png_reverse_filter_copy_line(*data,
+      ret = png_reverse_filter_copy_line(
+            pngp->scale > 1 ? pngp->scale_row : *data,
             ihdr, pngp, filter);
    }
 
@@ -645,6 +778,16 @@ static int png_reverse_filter_regular_iterate(uint32_t **data, const struct png_
    pngp->inflate_buf           += pngp->pitch;
    pngp->restore_buf_size      += pngp->pitch;
 
+   if (pngp->scale > 1)
+   {
+      if (png_reverse_filter_scale_line(*data, ihdr, pngp))
+      {
+         *data                       += pngp->out_width;
+         pngp->data_restore_buf_size += pngp->out_width;
+      }
+      return IMAGE_PROCESS_NEXT;
+   }
+
    *data                       += ihdr->width;
    pngp->data_restore_buf_size += ihdr->width;
 
@@ -750,6 +893,129 @@ static int png_reverse_filter_iterate(rpng_t *rpng, uint32_t **data)
    return png_reverse_filter_regular_iterate(data, &rpng->ihdr, rpng->process);
 }
 
+static uint32_t *rpng_alloc_image(const rpng_t *rpng)
+{
+#ifdef GEKKO
+   /* we often use these in textures, make sure they're 32-byte aligned */
+   return (uint32_t*)memalign(32, rpng->process->out_width *
+         rpng->process->out_height * sizeof(uint32_t));
+#else
+   return (uint32_t*)malloc(rpng->process->out_width *
+         rpng->process->out_height * sizeof(uint32_t));
+#endif
+}
+
+#ifdef HAVE_THREADS
+static void rpng_inflate_thread(void *data)
+{
+   struct rpng_process *process = (struct rpng_process*)data;
+   size_t done                  = 0;
+
+   while (done < process->inflate_buf_size)
+   {
+      bool zstatus;
+      bool cancel;
+      uint32_t rd, wn;
+      enum trans_stream_error terror = TRANS_STREAM_ERROR_NONE;
+      size_t chunk = process->inflate_buf_size - done;
+
+      if (chunk > RPNG_PIPELINE_CHUNK)
+         chunk = RPNG_PIPELINE_CHUNK;
+
+      process->stream_backend->set_out(process->stream,
+            process->inflate_base + done, (uint32_t)chunk);
+      zstatus = process->stream_backend->trans(process->stream,
+            false, &rd, &wn, &terror);
+
+      if (!zstatus && terror != TRANS_STREAM_ERROR_BUFFER_FULL)
+         break;
+
+      done += wn;
+
+      slock_lock(process->inflate_lock);
+      process->inflate_done = done;
+      cancel                = process->inflate_cancel;
+      scond_signal(process->inflate_cond);
+      slock_unlock(process->inflate_lock);
+
+      if (cancel || terror == TRANS_STREAM_ERROR_NONE || (!rd && !wn))
+         break;
+   }
+
+   slock_lock(process->inflate_lock);
+   process->inflate_finished = true;
+   scond_signal(process->inflate_cond);
+   slock_unlock(process->inflate_lock);
+}
+
+static void rpng_pipeline_stop(struct rpng_process *process)
+{
+   if (process->inflate_thread)
+   {
+      slock_lock(process->inflate_lock);
+      process->inflate_cancel = true;
+      slock_unlock(process->inflate_lock);
+
+      sthread_join(process->inflate_thread);
+      process->inflate_thread = NULL;
+   }
+   if (process->inflate_cond)
+      scond_free(process->inflate_cond);
+   if (process->inflate_lock)
+      slock_free(process->inflate_lock);
+   process->inflate_cond = NULL;
+   process->inflate_lock = NULL;
+}
+
+/* Starts inflating on a separate thread. The scanlines
+ * are unfiltered as soon as they come out, instead of
+ * after the whole image has been inflated */
+static bool rpng_pipeline_start(rpng_t *rpng, uint32_t **data)
+{
+   struct rpng_process *process = rpng->process;
+
+   if (     (rpng->flags & RPNG_DECODE_NO_PIPELINE)
+         || rpng->ihdr.interlace
+         || process->inflate_buf_size < RPNG_PIPELINE_MIN_SIZE)
+      return false;
+
+   if (!(*data = rpng_alloc_image(rpng)))
+      return false;
+
+   process->inflate_done           = 0;
+   process->inflate_ready          = 0;
+   process->inflate_finished       = false;
+   process->inflate_cancel         = false;
+   process->adam7_restore_buf_size = 0;
+   process->restore_buf_size       = 0;
+   process->palette                = rpng->palette;
+   process->pipelined              = true;
+
+   if (png_reverse_filter_init(&rpng->ihdr, process) == -1)
+      goto error;
+
+   process->inflate_lock   = slock_new();
+   process->inflate_cond   = scond_new();
+   if (!process->inflate_lock || !process->inflate_cond)
+      goto error;
+
+   process->inflate_thread = sthread_create(rpng_inflate_thread, process);
+   if (!process->inflate_thread)
+      goto error;
+
+   process->inflate_initialized = true;
+   return true;
+
+error:
+   rpng_pipeline_stop(process);
+   png_reverse_filter_deinit(process);
+   process->pipelined = false;
+   free(*data);
+   *data              = NULL;
+   return false;
+}
+#endif
+
 static int rpng_load_image_argb_process_inflate_init(rpng_t *rpng, uint32_t **data)
 {
    bool zstatus;
@@ -759,6 +1025,11 @@ static int rpng_load_image_argb_process_inflate_init(rpng_t *rpng, uint32_t **da
    bool to_continue        = (process->avail_in > 0
          && process->avail_out > 0);
 
+#ifdef HAVE_THREADS
+   if (process->total_out == 0 && rpng_pipeline_start(rpng, data))
+      return 1;
+#endif
+
    if (!to_continue)
       goto end;
 
@@ -778,15 +1049,7 @@ end:
    process->stream_backend->stream_free(process->stream);
    process->stream = NULL;
 
-#ifdef GEKKO
-   /* we often use these in textures, make sure they're 32-byte aligned */
-   *data = (uint32_t*)memalign(32, rpng->ihdr.width *
-         rpng->ihdr.height * sizeof(uint32_t));
-#else
-   *data = (uint32_t*)malloc(rpng->ihdr.width *
-         rpng->ihdr.height * sizeof(uint32_t));
-#endif
-   if (!*data)
+   if (!(*data = rpng_alloc_image(rpng)))
       goto false_end;
 
    process->adam7_restore_buf_size = 0;
@@ -854,9 +1117,23 @@ static struct rpng_process *rpng_process_init(rpng_t *rpng)
    process->inflate_initialized    = false;
    process->adam7_pass_initialized = false;
    process->pass_initialized       = false;
+   process->inflate_finished       = false;
+   process->inflate_cancel         = false;
+   process->pipelined              = false;
+   process->simd                   = !(rpng->flags & RPNG_DECODE_NO_SIMD);
+#ifdef HAVE_THREADS
+   process->inflate_thread         = NULL;
+   process->inflate_lock           = NULL;
+   process->inflate_cond           = NULL;
+   process->inflate_done           = 0;
+   process->inflate_ready          = 0;
+#endif
    process->prev_scanline          = NULL;
    process->decoded_scanline       = NULL;
+   process->scale_row              = NULL;
+   process->scale_sum              = NULL;
    process->inflate_buf            = NULL;
+   process->inflate_base           = NULL;
 
    process->ihdr.width             = 0;
    process->ihdr.height            = 0;
@@ -880,11 +1157,34 @@ static struct rpng_process *rpng_process_init(rpng_t *rpng)
    process->pass_width             = 0;
    process->pass_height            = 0;
    process->pass_pos               = 0;
+   process->scale                  = 1;
+   process->out_width              = rpng->ihdr.width;
+   process->out_height             = rpng->ihdr.height;
    process->data                   = 0;
    process->palette                = 0;
    process->stream                 = NULL;
    process->stream_backend         = trans_stream_get_zlib_inflate_backend();
 
+   /* Box filter the rows down to the requested size as
+    * they are unfiltered. Interlaced images are left alone,
+    * since their rows only come together in the last pass */
+   if (rpng->target_w && rpng->target_h && !rpng->ihdr.interlace)
+   {
+      unsigned scale_x = rpng->ihdr.width  / rpng->target_w;
+      unsigned scale_y = rpng->ihdr.height / rpng->target_h;
+
+      process->scale   = scale_x > scale_y ? scale_x : scale_y;
+      if (process->scale > RPNG_MAX_SCALE)
+         process->scale = RPNG_MAX_SCALE;
+      if (process->scale < 1)
+         process->scale = 1;
+
+      process->out_width  = (rpng->ihdr.width  + process->scale - 1)
+         / process->scale;
+      process->out_height = (rpng->ihdr.height + process->scale - 1)
+         / process->scale;
+   }
+
    png_pass_geom(&rpng->ihdr, rpng->ihdr.width,
          rpng->ihdr.height, NULL, NULL, &process->inflate_buf_size);
    if (rpng->ihdr.interlace == 1) /* To be sure. */
@@ -902,7 +1202,8 @@ static struct rpng_process *rpng_process_init(rpng_t *rpng)
    if (!inflate_buf)
       goto error;
 
-   process->inflate_buf = inflate_buf;
+   process->inflate_buf  = inflate_buf;
+   process->inflate_base = inflate_buf;
    process->avail_in    = rpng->idat_buf.size;
    process->avail_out   = process->inflate_buf_size;
 
@@ -1156,19 +1457,20 @@ int rpng_process_image(rpng_t *rpng,
       return IMAGE_PROCESS_NEXT;
    }
 
-   *width  = rpng->ihdr.width;
-   *height = rpng->ihdr.height;
+   *width  = rpng->process->out_width;
+   *height = rpng->process->out_height;
 
    return png_reverse_filter_iterate(rpng, data);
 
 error:
    if (rpng->process)
    {
-      if (rpng->process->inflate_buf)
-         free(rpng->process->inflate_buf);
+      if (rpng->process->inflate_base)
+         free(rpng->process->inflate_base);
       if (rpng->process->stream)
          rpng->process->stream_backend->stream_free(rpng->process->stream);
       free(rpng->process);
+      rpng->process = NULL;
    }
    return IMAGE_PROCESS_ERROR;
 }
@@ -1182,8 +1484,12 @@ void rpng_free(rpng_t *rpng)
       free(rpng->idat_buf.data);
    if (rpng->process)
    {
-      if (rpng->process->inflate_buf)
-         free(rpng->process->inflate_buf);
+#ifdef HAVE_THREADS
+      rpng_pipeline_stop(rpng->process);
+#endif
+      png_reverse_filter_deinit(rpng->process);
+      if (rpng->process->inflate_base)
+         free(rpng->process->inflate_base);
       if (rpng->process->stream)
       {
          if (rpng->process->stream_backend && rpng->process->stream_backend->stream_free)
@@ -1244,3 +1550,56 @@ rpng_t *rpng_alloc(void)
       return NULL;
    return rpng;
 }
+
+void rpng_set_decode_flags(rpng_t *rpng, unsigned flags)
+{
+   if (rpng)
+      rpng->flags = flags;
+}
+
+void rpng_set_target_size(rpng_t *rpng, unsigned width, unsigned height)
+{
+   if (!rpng)
+      return;
+
+   rpng->target_w = width;
+   rpng->target_h = height;
+}
+
+bool rpng_load_image_argb_buffer(const void *buf, size_t len,
+      uint32_t **data, unsigned *width, unsigned *height,
+      unsigned flags)
+{
+   int retval   = IMAGE_PROCESS_ERROR;
+   rpng_t *rpng = rpng_alloc();
+
+   *data        = NULL;
+
+   if (!rpng)
+      return false;
+
+   rpng->flags  = flags;
+
+   /* rpng never writes to the buffer it decodes */
+   if (     !rpng_set_buf_ptr(rpng, (void*)buf, len)
+         || !rpng_start(rpng))
+      goto end;
+
+   while (rpng_iterate_image(rpng));
+
+   if (!rpng_is_valid(rpng))
+      goto end;
+
+   do
+   {
+      retval = rpng_process_image(rpng, (void**)data, len, width, height);
+   } while (retval == IMAGE_PROCESS_NEXT);
+
+end:
+   rpng_free(rpng);
+   if (retval == IMAGE_PROCESS_END)
+      return true;
+   free(*data);
+   *data = NULL;
+   return false;
+}
@@ -24,10 +24,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <zlib.h>
+
 #include <libks.h>
 #include <encodings/crc32.h>
+#include <features/features_cpu.h>
 #include <streams/interface_stream.h>
-#include <streams/trans_stream.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/tpool.h>
+#endif
 
 #include "rpng_internal.h"
 
@@ -41,6 +47,49 @@
 double DEFLATE_PADDING = 1.1;
 int PNG_ROUGH_HEADER = 100;
 
+/* Input bytes per deflate job when encoding on several threads.
+ * Every job but the first is primed with the 32 KB in front of
+ * it, as pigz does, so splitting the stream up only costs the
+ * few bytes of a sync flush per job. */
+#define RPNG_ENCODE_CHUNK_SIZE  (256 * 1024)
+#define RPNG_ENCODE_DICT_SIZE   (32 * 1024)
+#define RPNG_ENCODE_MAX_THREADS 8
+
+/* Zero bytes in front of each scanline, at least bpp */
+#define RPNG_ENCODE_LINE_PAD    16
+
+struct rpng_encode
+{
+   struct rpng_filter filter;
+#ifdef HAVE_THREADS
+   tpool_t *pool;
+#endif
+   const uint8_t *data;
+   uint8_t *encode_buf;
+   size_t line_size;
+   signed pitch;
+   unsigned width;
+   unsigned height;
+   unsigned bpp;
+   int level;
+};
+
+/* A strip of rows to filter, or a chunk of the filtered
+ * rows to deflate */
+struct rpng_encode_job
+{
+   struct rpng_encode *enc;
+   uint8_t *out;
+   size_t in_start;
+   size_t in_len;
+   size_t out_len;
+   unsigned row_start;
+   unsigned row_end;
+   uint32_t adler;
+   bool last;
+   bool ok;
+};
+
 static void dword_write_be(uint8_t *buf, uint32_t val)
 {
    *buf++ = (uint8_t)(val >> 24);
@@ -94,14 +143,6 @@ static bool png_write_ihdr_string(intfstream_t *intf_s, const struct png_ihdr *i
          sizeof(ihdr_raw) - sizeof(uint32_t));
 }
 
-static bool png_write_idat_string(intfstream_t* intf_s, const uint8_t *data, size_t size)
-{
-   if (intfstream_write(intf_s, data, size) != (ssize_t)size)
-      return false;
-
-   return png_write_crc_string(intf_s, data + sizeof(uint32_t), size - sizeof(uint32_t));
-}
-
 static bool png_write_iend_string(intfstream_t* intf_s)
 {
    const uint8_t data[] = {
@@ -116,6 +157,7 @@ static bool png_write_iend_string(intfstream_t* intf_s)
          sizeof(data) - sizeof(uint32_t));
 }
 
+#ifdef MSB_FIRST
 static void copy_argb_line(uint8_t *dst, const uint32_t *src, unsigned width)
 {
    unsigned i;
@@ -128,6 +170,7 @@ static void copy_argb_line(uint8_t *dst, const uint32_t *src, unsigned width)
       *dst++ = (uint8_t)(col >> 24);
    }
 }
+#endif
 
 static void copy_bgr24_line(uint8_t *dst, const uint8_t *src, unsigned width)
 {
@@ -140,95 +183,255 @@ static void copy_bgr24_line(uint8_t *dst, const uint8_t *src, unsigned width)
    }
 }
 
-static unsigned count_sad(const uint8_t *data, size_t size)
+/* Runs 'fn' over every job, on the pool if there is one */
+static void rpng_encode_run(struct rpng_encode *enc,
+      void (*fn)(void *arg), struct rpng_encode_job *jobs,
+      unsigned count)
 {
-   size_t i;
-   unsigned cnt = 0;
-   for (i = 0; i < size; i++)
+   unsigned i;
+
+#ifdef HAVE_THREADS
+   if (enc->pool && count > 1)
    {
-      if (data[i])
-         cnt += abs((int8_t)data[i]);
+      for (i = 0; i < count; i++)
+         if (!tpool_add_work(enc->pool, fn, &jobs[i]))
+            fn(&jobs[i]);
+      tpool_wait(enc->pool);
+      return;
    }
-   return cnt;
+#endif
+
+   for (i = 0; i < count; i++)
+      fn(&jobs[i]);
 }
 
-static unsigned filter_up(uint8_t *target, const uint8_t *line,
-      const uint8_t *prev, unsigned width, unsigned bpp)
+static void rpng_encode_line(const struct rpng_encode *enc,
+      uint8_t *line, unsigned row)
 {
-   unsigned i;
-   width *= bpp;
-   for (i = 0; i < width; i++)
-      target[i] = line[i] - prev[i];
+   const uint8_t *src = enc->data + (ptrdiff_t)row * enc->pitch;
+
+   if (enc->bpp == sizeof(uint32_t))
+#ifndef MSB_FIRST
+      /* ARGB8888 words are B, G, R, A in memory, so going
+       * to RGBA is the same R/B swap the decoder does */
+      enc->filter.copy_rgba8((uint32_t*)line, src, enc->width);
+#else
+      copy_argb_line(line, (const uint32_t*)src, enc->width);
+#endif
+   else
+      copy_bgr24_line(line, src, enc->width);
+}
+
+/* Filters a strip of rows into the encode buffer. The first
+ * row is filtered against the raw row above it, so the strips
+ * come out exactly as if filtered in one go. */
+static void rpng_encode_filter_rows(void *arg)
+{
+   unsigned h;
+   struct rpng_encode_job *job   = (struct rpng_encode_job*)arg;
+   const struct rpng_encode *enc = job->enc;
+   unsigned line_bytes           = enc->width * enc->bpp;
+   size_t size                   = RPNG_ENCODE_LINE_PAD + line_bytes;
+   uint8_t *lines                = (uint8_t*)calloc(2, size);
+   uint8_t *target               = enc->encode_buf
+      + job->row_start * enc->line_size;
+   uint8_t *prev                 = NULL;
+   uint8_t *line                 = NULL;
+
+   job->ok = false;
+
+   if (!lines)
+      return;
+
+   /* Both lines are preceded by zero padding, which stands
+    * in for the pixels left of the image */
+   prev = lines + RPNG_ENCODE_LINE_PAD;
+   line = prev  + size;
+
+   if (job->row_start > 0)
+      rpng_encode_line(enc, prev, job->row_start - 1);
+
+   for (h = job->row_start; h < job->row_end;
+         h++, target += enc->line_size)
+   {
+      unsigned scores[5];
+      unsigned type;
+      unsigned filter = 0;
+      uint8_t *tmp    = NULL;
+
+      rpng_encode_line(enc, line, h);
 
-   return count_sad(target, width);
+      /* Try every filtering method, and choose the method
+       * which leaves the smallest sum of absolute values.
+       *
+       * This is probably not very optimal, but it's very
+       * simple to implement.
+       */
+      enc->filter.score(scores, line, prev, line_bytes, enc->bpp);
+      for (type = 1; type < 5; type++)
+         if (scores[type] < scores[filter])
+            filter = type;
+
+      target[0] = (uint8_t)filter;
+      enc->filter.apply(target + 1, line, prev, line_bytes, enc->bpp,
+            filter);
+
+      tmp  = prev;
+      prev = line;
+      line = tmp;
+   }
+
+   free(lines);
+   job->ok = true;
 }
 
-static unsigned filter_sub(uint8_t *target, const uint8_t *line,
-      unsigned width, unsigned bpp)
+/* Deflates one chunk of the encode buffer into a raw deflate
+ * stream. All but the last chunk end on a sync flush, which
+ * leaves them byte aligned and without a final block. */
+static void rpng_encode_deflate(void *arg)
 {
-   unsigned i;
-   width *= bpp;
-   for (i = 0; i < bpp; i++)
-      target[i] = line[i];
-   for (i = bpp; i < width; i++)
-      target[i] = line[i] - line[i - bpp];
+   z_stream z;
+   size_t bound;
+   struct rpng_encode_job *job   = (struct rpng_encode_job*)arg;
+   const struct rpng_encode *enc = job->enc;
+   const uint8_t *in             = enc->encode_buf + job->in_start;
+
+   job->ok = false;
+
+   memset(&z, 0, sizeof(z));
+   if (deflateInit2(&z, enc->level, Z_DEFLATED, -MAX_WBITS, 8,
+            Z_DEFAULT_STRATEGY) != Z_OK)
+      return;
+
+   if (job->in_start > 0)
+   {
+      size_t dict = job->in_start < RPNG_ENCODE_DICT_SIZE
+         ? job->in_start : RPNG_ENCODE_DICT_SIZE;
+      deflateSetDictionary(&z, in - dict, (uInt)dict);
+   }
+
+   /* Some room for the sync flush marker on top */
+   bound    = deflateBound(&z, (uLong)job->in_len) + 16;
+   job->out = (uint8_t*)malloc(bound);
+
+   if (job->out)
+   {
+      int zret;
+
+      z.next_in   = (Bytef*)in;
+      z.avail_in  = (uInt)job->in_len;
+      z.next_out  = job->out;
+      z.avail_out = (uInt)bound;
+
+      zret         = deflate(&z, job->last ? Z_FINISH : Z_SYNC_FLUSH);
+      job->out_len = bound - z.avail_out;
+      job->ok      = z.avail_in == 0 && (job->last
+            ? zret == Z_STREAM_END
+            : (zret == Z_OK && z.avail_out > 0));
+   }
 
-   return count_sad(target, width);
+   deflateEnd(&z);
+
+   job->adler = (uint32_t)adler32(adler32(0L, Z_NULL, 0),
+         in, (uInt)job->in_len);
 }
 
-static unsigned filter_avg(uint8_t *target, const uint8_t *line,
-      const uint8_t *prev, unsigned width, unsigned bpp)
+/* adler32_combine(), which the bundled zlib lacks */
+static uint32_t rpng_adler32_combine(uint32_t adler1, uint32_t adler2,
+      size_t len2)
 {
-   unsigned i;
-   width *= bpp;
-   for (i = 0; i < bpp; i++)
-      target[i] = line[i] - (prev[i] >> 1);
-   for (i = bpp; i < width; i++)
-      target[i] = line[i] - ((line[i - bpp] + prev[i]) >> 1);
+   const uint32_t base = 65521;
+   uint32_t rem        = (uint32_t)(len2 % base);
+   uint32_t sum1       = adler1 & 0xffff;
+   uint32_t sum2       = (uint32_t)(((uint64_t)rem * sum1) % base);
+
+   sum1 += (adler2 & 0xffff) + base - 1;
+   sum2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + base - rem;
+   if (sum1 >= base)
+      sum1 -= base;
+   if (sum1 >= base)
+      sum1 -= base;
+   if (sum2 >= (base << 1))
+      sum2 -= (base << 1);
+   if (sum2 >= base)
+      sum2 -= base;
+   return sum1 | (sum2 << 16);
+}
 
-   return count_sad(target, width);
+static bool png_write_chunk_data(intfstream_t *intf_s,
+      const uint8_t *data, size_t size, uint32_t *crc)
+{
+   *crc = encoding_crc32(*crc, data, size);
+   return intfstream_write(intf_s, data, size) == (ssize_t)size;
 }
 
-static unsigned filter_paeth(uint8_t *target,
-      const uint8_t *line, const uint8_t *prev,
-      unsigned width, unsigned bpp)
+/* Writes the deflate jobs as one IDAT chunk holding a single
+ * zlib stream */
+static bool png_write_idat_jobs(intfstream_t *intf_s,
+      const struct rpng_encode_job *jobs, unsigned count, int level)
 {
    unsigned i;
-   width *= bpp;
-   for (i = 0; i < bpp; i++)
-      target[i] = line[i] - paeth(0, prev[i], 0);
-   for (i = bpp; i < width; i++)
-      target[i] = line[i] - paeth(line[i - bpp], prev[i], prev[i - bpp]);
+   uint8_t header[8];
+   uint8_t zlib_header[2];
+   uint8_t crc_raw[4];
+   uint8_t adler_raw[4];
+   uint32_t crc   = 0;
+   uint32_t adler = jobs[0].adler;
+   size_t size    = sizeof(zlib_header) + sizeof(adler_raw);
+
+   for (i = 0; i < count; i++)
+      size += jobs[i].out_len;
+   for (i = 1; i < count; i++)
+      adler = rpng_adler32_combine(adler, jobs[i].adler, jobs[i].in_len);
+
+   if (size > 0x7fffffff)
+      return false;
 
-   return count_sad(target, width);
+   /* Deflate with a 32 KB window, FLEVEL set like zlib does */
+   zlib_header[0] = 0x78;
+   zlib_header[1] = level < 2 ? 0x00 : 0xc0;
+   zlib_header[1] += 31 - ((zlib_header[0] << 8) | zlib_header[1]) % 31;
+
+   dword_write_be(header, (uint32_t)size);
+   memcpy(header + 4, "IDAT", 4);
+   dword_write_be(adler_raw, adler);
+
+   if (intfstream_write(intf_s, header, 4) != 4)
+      return false;
+   if (!png_write_chunk_data(intf_s, header + 4, 4, &crc))
+      return false;
+   if (!png_write_chunk_data(intf_s, zlib_header, sizeof(zlib_header), &crc))
+      return false;
+   for (i = 0; i < count; i++)
+      if (!png_write_chunk_data(intf_s, jobs[i].out, jobs[i].out_len, &crc))
+         return false;
+   if (!png_write_chunk_data(intf_s, adler_raw, sizeof(adler_raw), &crc))
+      return false;
+
+   dword_write_be(crc_raw, crc);
+   return intfstream_write(intf_s, crc_raw, sizeof(crc_raw))
+      == sizeof(crc_raw);
 }
 
-bool rpng_save_image_stream(const uint8_t *data, intfstream_t* intf_s,
-      unsigned width, unsigned height, signed pitch, unsigned bpp)
+static bool rpng_save_image_stream(const uint8_t *data,
+      intfstream_t* intf_s, unsigned width, unsigned height,
+      signed pitch, unsigned bpp, unsigned flags)
 {
-   unsigned h;
-   struct png_ihdr ihdr = {0};
-   bool ret = true;
-   const struct trans_stream_backend *stream_backend = NULL;
-   size_t encode_buf_size  = 0;
-   uint8_t *encode_buf     = NULL;
-   uint8_t *deflate_buf    = NULL;
-   uint8_t *rgba_line      = NULL;
-   uint8_t *up_filtered    = NULL;
-   uint8_t *sub_filtered   = NULL;
-   uint8_t *avg_filtered   = NULL;
-   uint8_t *paeth_filtered = NULL;
-   uint8_t *prev_encoded   = NULL;
-   uint8_t *encode_target  = NULL;
-   void *stream            = NULL;
-   uint32_t total_in       = 0;
-   uint32_t total_out      = 0;
-   
-   if (!intf_s)
+   unsigned i;
+   struct rpng_encode enc;
+   struct png_ihdr ihdr             = {0};
+   bool ret                         = true;
+   struct rpng_encode_job *jobs     = NULL;
+   unsigned num_jobs                = 0;
+   unsigned strips                  = 1;
+   unsigned chunks                  = 1;
+   size_t encode_buf_size           = 0;
+
+   memset(&enc, 0, sizeof(enc));
+
+   if (!intf_s || !width || !height)
       GOTO_END_ERROR();
 
-   stream_backend = trans_stream_get_zlib_deflate_backend();
-
    if (intfstream_write(intf_s, png_magic, sizeof(png_magic)) != sizeof(png_magic))
       GOTO_END_ERROR();
 
@@ -239,134 +442,97 @@ bool rpng_save_image_stream(const uint8_t *data, intfstream_t* intf_s,
    if (!png_write_ihdr_string(intf_s, &ihdr))
       GOTO_END_ERROR();
 
-   encode_buf_size = (width * bpp + 1) * height;
-   encode_buf      = (uint8_t*)malloc(encode_buf_size);
-   if (!encode_buf)
+   enc.data        = data;
+   enc.pitch       = pitch;
+   enc.width       = width;
+   enc.height      = height;
+   enc.bpp         = bpp;
+   enc.line_size   = width * bpp + 1;
+   enc.level       = (flags & RPNG_ENCODE_FAST) ? 1 : 9;
+   rpng_filter_init(&enc.filter, bpp, !(flags & RPNG_ENCODE_NO_SIMD));
+
+   encode_buf_size = enc.line_size * height;
+   enc.encode_buf  = (uint8_t*)malloc(encode_buf_size);
+   if (!enc.encode_buf)
       GOTO_END_ERROR();
 
-   prev_encoded = (uint8_t*)calloc(1, width * bpp);
-   if (!prev_encoded)
-      GOTO_END_ERROR();
-
-   rgba_line      = (uint8_t*)malloc(width * bpp);
-   up_filtered    = (uint8_t*)malloc(width * bpp);
-   sub_filtered   = (uint8_t*)malloc(width * bpp);
-   avg_filtered   = (uint8_t*)malloc(width * bpp);
-   paeth_filtered = (uint8_t*)malloc(width * bpp);
-   if (!rgba_line || !up_filtered || !sub_filtered || !avg_filtered || !paeth_filtered)
-      GOTO_END_ERROR();
-
-   encode_target = encode_buf;
-   for (h = 0; h < height;
-         h++, encode_target += width * bpp, data += pitch)
+#ifdef HAVE_THREADS
+   /* Small images are not worth waking up threads for */
+   if (     !(flags & RPNG_ENCODE_NO_THREADS)
+         && encode_buf_size > RPNG_ENCODE_CHUNK_SIZE)
    {
-      if (bpp == sizeof(uint32_t))
-         copy_argb_line(rgba_line, (const uint32_t*)data, width);
-      else
-         copy_bgr24_line(rgba_line, data, width);
+      unsigned threads = cpu_features_get_core_amount();
 
-      /* Try every filtering method, and choose the method
-       * which has most entries as zero.
-       *
-       * This is probably not very optimal, but it's very
-       * simple to implement.
-       */
+      if (threads > RPNG_ENCODE_MAX_THREADS)
+         threads = RPNG_ENCODE_MAX_THREADS;
+      if (threads > 1)
+         enc.pool = tpool_create(threads);
+      if (enc.pool)
       {
-         unsigned none_score  = count_sad(rgba_line, width * bpp);
-         unsigned up_score    = filter_up(up_filtered, rgba_line, prev_encoded, width, bpp);
-         unsigned sub_score   = filter_sub(sub_filtered, rgba_line, width, bpp);
-         unsigned avg_score   = filter_avg(avg_filtered, rgba_line, prev_encoded, width, bpp);
-         unsigned paeth_score = filter_paeth(paeth_filtered, rgba_line, prev_encoded, width, bpp);
-
-         uint8_t filter       = 0;
-         unsigned min_sad     = none_score;
-         const uint8_t *chosen_filtered = rgba_line;
-
-         if (sub_score < min_sad)
-         {
-            filter = 1;
-            chosen_filtered = sub_filtered;
-            min_sad = sub_score;
-         }
-
-         if (up_score < min_sad)
-         {
-            filter = 2;
-            chosen_filtered = up_filtered;
-            min_sad = up_score;
-         }
-
-         if (avg_score < min_sad)
-         {
-            filter = 3;
-            chosen_filtered = avg_filtered;
-            min_sad = avg_score;
-         }
-
-         if (paeth_score < min_sad)
-         {
-            filter = 4;
-            chosen_filtered = paeth_filtered;
-         }
-
-         *encode_target++ = filter;
-         memcpy(encode_target, chosen_filtered, width * bpp);
-
-         memcpy(prev_encoded, rgba_line, width * bpp);
+         strips = threads < height ? threads : height;
+         chunks = (unsigned)((encode_buf_size
+                  + RPNG_ENCODE_CHUNK_SIZE - 1) / RPNG_ENCODE_CHUNK_SIZE);
       }
    }
+#endif
 
-   deflate_buf = (uint8_t*)malloc(encode_buf_size * 2); /* Just to be sure. */
-   if (!deflate_buf)
+   num_jobs = strips > chunks ? strips : chunks;
+   jobs     = (struct rpng_encode_job*)calloc(num_jobs, sizeof(*jobs));
+   if (!jobs)
       GOTO_END_ERROR();
 
-   stream = stream_backend->stream_new();
+   for (i = 0; i < strips; i++)
+   {
+      jobs[i].enc       = &enc;
+      jobs[i].row_start = (unsigned)((uint64_t)height * i       / strips);
+      jobs[i].row_end   = (unsigned)((uint64_t)height * (i + 1) / strips);
+   }
 
-   if (!stream)
-      GOTO_END_ERROR();
+   rpng_encode_run(&enc, rpng_encode_filter_rows, jobs, strips);
 
-   stream_backend->set_in(
-         stream,
-         encode_buf,
-         (unsigned)encode_buf_size);
-   stream_backend->set_out(
-         stream,
-         deflate_buf + 8,
-         (unsigned)(encode_buf_size * 2));
+   for (i = 0; i < strips; i++)
+      if (!jobs[i].ok)
+         GOTO_END_ERROR();
 
-   if (!stream_backend->trans(stream, true, &total_in, &total_out, NULL))
-      GOTO_END_ERROR();
+   for (i = 0; i < chunks; i++)
+   {
+      jobs[i].enc      = &enc;
+      jobs[i].in_start = (size_t)i * RPNG_ENCODE_CHUNK_SIZE;
+      jobs[i].in_len   = encode_buf_size - jobs[i].in_start;
+      jobs[i].last     = i == chunks - 1;
+      jobs[i].ok       = false;
+      if (!jobs[i].last)
+         jobs[i].in_len = RPNG_ENCODE_CHUNK_SIZE;
+   }
+
+   rpng_encode_run(&enc, rpng_encode_deflate, jobs, chunks);
+
+   for (i = 0; i < chunks; i++)
+      if (!jobs[i].ok)
+         GOTO_END_ERROR();
 
-   memcpy(deflate_buf + 4, "IDAT", 4);
-   dword_write_be(deflate_buf + 0,        ((uint32_t)total_out));
-   if (!png_write_idat_string(intf_s, deflate_buf, ((size_t)total_out + 8)))
+   if (!png_write_idat_jobs(intf_s, jobs, chunks, enc.level))
       GOTO_END_ERROR();
 
    if (!png_write_iend_string(intf_s))
       GOTO_END_ERROR();
 end:
-   free(encode_buf);
-   free(deflate_buf);
-   free(rgba_line);
-   free(prev_encoded);
-   free(up_filtered);
-   free(sub_filtered);
-   free(avg_filtered);
-   free(paeth_filtered);
-
-   if (stream_backend)
+   if (jobs)
    {
-      if (stream)
-      {
-         if (stream_backend->stream_free)
-            stream_backend->stream_free(stream);
-      }
+      for (i = 0; i < num_jobs; i++)
+         free(jobs[i].out);
+      free(jobs);
    }
+   free(enc.encode_buf);
+#ifdef HAVE_THREADS
+   if (enc.pool)
+      tpool_destroy(enc.pool);
+#endif
    return ret;
 }
 
-bool rpng_save_image_argb(const char *path, const uint32_t *data,
-      unsigned width, unsigned height, unsigned pitch)
+bool rpng_save_image_argb_ex(const char *path, const uint32_t *data,
+      unsigned width, unsigned height, unsigned pitch, unsigned flags)
 {
    bool ret                      = false;
    intfstream_t* intf_s          = NULL;
@@ -377,14 +543,14 @@ bool rpng_save_image_argb(const char *path, const uint32_t *data,
 
    ret = rpng_save_image_stream((const uint8_t*) data, intf_s,
                                 width, height,
-                                (signed) pitch, sizeof(uint32_t));
+                                (signed) pitch, sizeof(uint32_t), flags);
    intfstream_close(intf_s);
    free(intf_s);
    return ret;
 }
 
-bool rpng_save_image_bgr24(const char *path, const uint8_t *data,
-      unsigned width, unsigned height, unsigned pitch)
+bool rpng_save_image_bgr24_ex(const char *path, const uint8_t *data,
+      unsigned width, unsigned height, unsigned pitch, unsigned flags)
 {
    bool ret                      = false;
    intfstream_t* intf_s          = NULL;
@@ -393,12 +559,24 @@ bool rpng_save_image_bgr24(const char *path, const uint8_t *data,
          KS_VFS_FILE_ACCESS_WRITE,
          KS_VFS_FILE_ACCESS_HINT_NONE);
    ret = rpng_save_image_stream(data, intf_s, width, height, 
-                                (signed) pitch, 3);
+                                (signed) pitch, 3, flags);
    intfstream_close(intf_s);
    free(intf_s);
    return ret;
 }
 
+bool rpng_save_image_argb(const char *path, const uint32_t *data,
+      unsigned width, unsigned height, unsigned pitch)
+{
+   return rpng_save_image_argb_ex(path, data, width, height, pitch, 0);
+}
+
+bool rpng_save_image_bgr24(const char *path, const uint8_t *data,
+      unsigned width, unsigned height, unsigned pitch)
+{
+   return rpng_save_image_bgr24_ex(path, data, width, height, pitch, 0);
+}
+
 
 uint8_t* rpng_save_image_bgr24_string(const uint8_t *data,
       unsigned width, unsigned height, signed pitch, uint64_t* bytes)
@@ -420,7 +598,7 @@ uint8_t* rpng_save_image_bgr24_string(const uint8_t *data,
          buf_length);
 
    ret = rpng_save_image_stream((const uint8_t*)data, 
-            intf_s, width, height, pitch, 3);
+            intf_s, width, height, pitch, 3, 0);
 
    *bytes = intfstream_get_ptr(intf_s);
    intfstream_rewind(intf_s);
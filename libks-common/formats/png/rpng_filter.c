@@ -0,0 +1,988 @@
+/* Copyright  (C) 2010-2020 The KingStation team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (rpng_filter.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Scanline unfilter, filter and pixel conversion kernels.
+ *
+ * Sub, Average and Paeth depend on the pixel to the left, so the
+ * SIMD kernels work on one 3 or 4 byte pixel per register, except
+ * for Sub, which is a prefix sum and handles four pixels per step.
+ * Up and the 8-bit RGB(A) -> ARGB conversions have no dependencies
+ * and handle 16 bytes at a time. The encoder side filters from the
+ * raw scanlines, so it has no dependencies either and handles 16
+ * bytes (8 on NEON) at a time for any pixel size. The best kernels
+ * for the CPU are picked on first use, like encoding_crc32() does. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ks_inline.h>
+#include <filters.h>
+#include <libks.h>
+#include <features/features_cpu.h>
+
+#include "rpng_internal.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RPNG_SSE2
+#include <emmintrin.h>
+#endif
+
+/* SSSE3 kernels are built with a target attribute and only
+ * picked when cpu_features_get() reports SSSE3 */
+#if defined(__x86_64__) && defined(__GNUC__) || defined(_M_X64)
+#define RPNG_SSSE3
+#include <tmmintrin.h>
+#if defined(__GNUC__)
+#define RPNG_TARGET_SSSE3 __attribute__((target("ssse3")))
+#else
+#define RPNG_TARGET_SSSE3
+#endif
+#endif
+
+/* The NEON kernels are opt-in until they have been
+ * checked on ARM hardware */
+#if (defined(__ARM_NEON__) || defined(__ARM_NEON)) && defined(HAVE_RPNG_NEON) && !defined(DONT_WANT_ARM_OPTIMIZATIONS)
+#define RPNG_NEON
+#include <arm_neon.h>
+#endif
+
+/* Generic kernels, any bytes per pixel */
+
+static void rpng_unfilter_sub_c(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+
+   for (i = 0; i < bpp; i++)
+      dst[i] = src[i];
+   for (i = bpp; i < pitch; i++)
+      dst[i] = dst[i - bpp] + src[i];
+}
+
+static void rpng_unfilter_up_c(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+
+   for (i = 0; i < pitch; i++)
+      dst[i] = prev[i] + src[i];
+}
+
+static void rpng_unfilter_avg_c(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+
+   for (i = 0; i < bpp; i++)
+      dst[i] = (prev[i] >> 1) + src[i];
+   for (i = bpp; i < pitch; i++)
+      dst[i] = ((dst[i - bpp] + prev[i]) >> 1) + src[i];
+}
+
+static void rpng_unfilter_paeth_c(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+
+   for (i = 0; i < bpp; i++)
+      dst[i] = paeth(0, prev[i], 0) + src[i];
+   for (i = bpp; i < pitch; i++)
+      dst[i] = paeth(dst[i - bpp], prev[i], prev[i - bpp]) + src[i];
+}
+
+static void rpng_copy_line_rgb8_c(uint32_t *data,
+      const uint8_t *decoded, unsigned width)
+{
+   unsigned i;
+
+   for (i = 0; i < width; i++, decoded += 3)
+      data[i] = (0xffu << 24) | ((uint32_t)decoded[0] << 16)
+         | ((uint32_t)decoded[1] << 8) | decoded[2];
+}
+
+static void rpng_copy_line_rgba8_c(uint32_t *data,
+      const uint8_t *decoded, unsigned width)
+{
+   unsigned i;
+
+   for (i = 0; i < width; i++, decoded += 4)
+      data[i] = ((uint32_t)decoded[3] << 24) | ((uint32_t)decoded[0] << 16)
+         | ((uint32_t)decoded[1] << 8) | decoded[2];
+}
+
+static INLINE uint8_t rpng_filter_byte(unsigned type,
+      uint8_t x, uint8_t a, uint8_t b, uint8_t c)
+{
+   switch (type)
+   {
+      case 1:
+         return x - a;
+      case 2:
+         return x - b;
+      case 3:
+         return x - ((a + b) >> 1);
+      case 4:
+         return x - paeth(a, b, c);
+   }
+   return x;
+}
+
+static void rpng_filter_score_c(unsigned *scores, const uint8_t *line,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i, type;
+   const uint8_t *left   = line - bpp;
+   const uint8_t *upleft = prev - bpp;
+
+   for (type = 0; type < 5; type++)
+   {
+      unsigned sum = 0;
+      for (i = 0; i < pitch; i++)
+         sum += abs((int8_t)rpng_filter_byte(type,
+                  line[i], left[i], prev[i], upleft[i]));
+      scores[type] = sum;
+   }
+}
+
+static void rpng_filter_apply_c(uint8_t *dst, const uint8_t *line,
+      const uint8_t *prev, unsigned pitch, unsigned bpp, unsigned type)
+{
+   unsigned i;
+   const uint8_t *left   = line - bpp;
+   const uint8_t *upleft = prev - bpp;
+
+   for (i = 0; i < pitch; i++)
+      dst[i] = rpng_filter_byte(type, line[i], left[i], prev[i], upleft[i]);
+}
+
+#if defined(RPNG_SSE2) || defined(RPNG_SSSE3)
+static INLINE __m128i rpng_load3(const uint8_t *p)
+{
+   uint32_t v = 0;
+   memcpy(&v, p, 3);
+   return _mm_cvtsi32_si128((int)v);
+}
+
+static INLINE __m128i rpng_load4(const uint8_t *p)
+{
+   uint32_t v;
+   memcpy(&v, p, 4);
+   return _mm_cvtsi32_si128((int)v);
+}
+
+static INLINE void rpng_store3(uint8_t *p, __m128i v)
+{
+   uint32_t w = (uint32_t)_mm_cvtsi128_si32(v);
+   memcpy(p, &w, 3);
+}
+
+static INLINE void rpng_store4(uint8_t *p, __m128i v)
+{
+   uint32_t w = (uint32_t)_mm_cvtsi128_si32(v);
+   memcpy(p, &w, 4);
+}
+
+/* Loads/stores four 3 byte pixels */
+static INLINE __m128i rpng_load12(const uint8_t *p)
+{
+   uint32_t hi;
+   memcpy(&hi, p + 8, 4);
+   return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)p),
+         _mm_cvtsi32_si128((int)hi));
+}
+
+static INLINE void rpng_store12(uint8_t *p, __m128i v)
+{
+   uint32_t hi = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+   _mm_storel_epi64((__m128i*)p, v);
+   memcpy(p + 8, &hi, 4);
+}
+#endif
+
+#ifdef RPNG_SSE2
+static void rpng_unfilter_up_sse2(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+
+   for (i = 0; i + 16 <= pitch; i += 16)
+      _mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi8(
+               _mm_loadu_si128((const __m128i*)(src + i)),
+               _mm_loadu_si128((const __m128i*)(prev + i))));
+   for (; i < pitch; i++)
+      dst[i] = prev[i] + src[i];
+}
+
+/* Sub is a running sum of pixels, done four pixels at a
+ * time with two shifted adds plus the last pixel so far */
+static void rpng_unfilter_sub4_sse2(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   __m128i last = _mm_setzero_si128();
+
+   for (i = 0; i + 16 <= pitch; i += 16)
+   {
+      __m128i x = _mm_loadu_si128((const __m128i*)(src + i));
+      x         = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+      x         = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+      x         = _mm_add_epi8(x, last);
+      _mm_storeu_si128((__m128i*)(dst + i), x);
+      last      = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+   }
+
+   for (; i < pitch; i += 4)
+   {
+      last = _mm_add_epi8(last, rpng_load4(src + i));
+      rpng_store4(dst + i, last);
+   }
+}
+
+static void rpng_unfilter_sub3_sse2(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   const __m128i mask = _mm_cvtsi32_si128(0xffffff);
+   __m128i last       = _mm_setzero_si128();
+
+   for (i = 0; i + 12 <= pitch; i += 12)
+   {
+      __m128i x = rpng_load12(src + i);
+      x         = _mm_add_epi8(x, _mm_slli_si128(x, 3));
+      x         = _mm_add_epi8(x, _mm_slli_si128(x, 6));
+      x         = _mm_add_epi8(x, last);
+      rpng_store12(dst + i, x);
+      /* Broadcast the fourth pixel */
+      last      = _mm_and_si128(_mm_srli_si128(x, 9), mask);
+      last      = _mm_or_si128(last, _mm_slli_si128(last, 3));
+      last      = _mm_or_si128(last, _mm_slli_si128(last, 6));
+   }
+
+   for (; i < pitch; i += 3)
+   {
+      last = _mm_add_epi8(last, rpng_load3(src + i));
+      rpng_store3(dst + i, last);
+   }
+}
+
+/* _mm_avg_epu8 rounds up, Average needs floor((a + b) / 2) */
+static INLINE __m128i rpng_avg_floor(__m128i a, __m128i b)
+{
+   return _mm_sub_epi8(_mm_avg_epu8(a, b),
+         _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+}
+
+static void rpng_unfilter_avg4_sse2(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   __m128i a = _mm_setzero_si128();
+
+   for (i = 0; i < pitch; i += 4)
+   {
+      a = _mm_add_epi8(rpng_avg_floor(a, rpng_load4(prev + i)),
+            rpng_load4(src + i));
+      rpng_store4(dst + i, a);
+   }
+}
+
+static void rpng_unfilter_avg3_sse2(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   __m128i a = _mm_setzero_si128();
+
+   for (i = 0; i < pitch; i += 3)
+   {
+      a = _mm_add_epi8(rpng_avg_floor(a, rpng_load3(prev + i)),
+            rpng_load3(src + i));
+      rpng_store3(dst + i, a);
+   }
+}
+
+static INLINE __m128i rpng_abs_epi16_sse2(__m128i x)
+{
+   return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+/* Paeth on one pixel widened to 16 bits. With p = a + b - c,
+ * |p - a| = |b - c|, |p - b| = |a - c| and |p - c| = |a + b - 2c| */
+static INLINE __m128i rpng_paeth_sse2(__m128i a, __m128i b, __m128i c)
+{
+   const __m128i zero = _mm_setzero_si128();
+   __m128i a16        = _mm_unpacklo_epi8(a, zero);
+   __m128i b16        = _mm_unpacklo_epi8(b, zero);
+   __m128i c16        = _mm_unpacklo_epi8(c, zero);
+   __m128i pa         = _mm_sub_epi16(b16, c16);
+   __m128i pb         = _mm_sub_epi16(a16, c16);
+   __m128i pc         = rpng_abs_epi16_sse2(_mm_add_epi16(pa, pb));
+   __m128i not_a, use_b, pred;
+
+   pa    = rpng_abs_epi16_sse2(pa);
+   pb    = rpng_abs_epi16_sse2(pb);
+
+   not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+   use_b = _mm_andnot_si128(_mm_cmpgt_epi16(pb, pc), not_a);
+   pred  = _mm_or_si128(_mm_andnot_si128(not_a, a16),
+         _mm_or_si128(_mm_and_si128(use_b, b16),
+            _mm_andnot_si128(use_b, _mm_and_si128(not_a, c16))));
+
+   return _mm_packus_epi16(pred, pred);
+}
+
+static void rpng_unfilter_paeth4_sse2(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   __m128i a = _mm_setzero_si128();
+   __m128i c = _mm_setzero_si128();
+
+   for (i = 0; i < pitch; i += 4)
+   {
+      __m128i b = rpng_load4(prev + i);
+      a         = _mm_add_epi8(rpng_paeth_sse2(a, b, c), rpng_load4(src + i));
+      c         = b;
+      rpng_store4(dst + i, a);
+   }
+}
+
+static void rpng_unfilter_paeth3_sse2(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   __m128i a = _mm_setzero_si128();
+   __m128i c = _mm_setzero_si128();
+
+   for (i = 0; i < pitch; i += 3)
+   {
+      __m128i b = rpng_load3(prev + i);
+      a         = _mm_add_epi8(rpng_paeth_sse2(a, b, c), rpng_load3(src + i));
+      c         = b;
+      rpng_store3(dst + i, a);
+   }
+}
+
+/* Swaps R and B in every 32-bit pixel */
+static void rpng_copy_line_rgba8_sse2(uint32_t *data,
+      const uint8_t *decoded, unsigned width)
+{
+   unsigned i;
+   const __m128i ga = _mm_set1_epi32((int)0xff00ff00);
+
+   for (i = 0; i + 4 <= width; i += 4)
+   {
+      __m128i x  = _mm_loadu_si128((const __m128i*)(decoded + i * 4));
+      __m128i rb = _mm_andnot_si128(ga, x);
+      x          = _mm_or_si128(_mm_and_si128(x, ga),
+            _mm_or_si128(_mm_srli_epi32(rb, 16), _mm_slli_epi32(rb, 16)));
+      _mm_storeu_si128((__m128i*)(data + i), x);
+   }
+
+   rpng_copy_line_rgba8_c(data + i, decoded + i * 4, width - i);
+}
+
+/* Paeth predictor for 16 bytes, 8 at a time */
+static INLINE __m128i rpng_paeth16_sse2(__m128i a, __m128i b, __m128i c)
+{
+   __m128i lo = rpng_paeth_sse2(a, b, c);
+   __m128i hi = rpng_paeth_sse2(_mm_srli_si128(a, 8),
+         _mm_srli_si128(b, 8), _mm_srli_si128(c, 8));
+   return _mm_unpacklo_epi64(lo, hi);
+}
+
+/* Adds up |x| over 16 bytes read as signed. min(x, -x) taken
+ * unsigned is |x|, -128 included */
+static INLINE __m128i rpng_sad_sse2(__m128i acc, __m128i x)
+{
+   const __m128i zero = _mm_setzero_si128();
+   return _mm_add_epi64(acc, _mm_sad_epu8(
+            _mm_min_epu8(x, _mm_sub_epi8(zero, x)), zero));
+}
+
+static void rpng_filter_score_sse2(unsigned *scores, const uint8_t *line,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i, type;
+   __m128i acc[5];
+   const uint8_t *left   = line - bpp;
+   const uint8_t *upleft = prev - bpp;
+
+   for (type = 0; type < 5; type++)
+      acc[type] = _mm_setzero_si128();
+
+   for (i = 0; i + 16 <= pitch; i += 16)
+   {
+      __m128i x = _mm_loadu_si128((const __m128i*)(line   + i));
+      __m128i a = _mm_loadu_si128((const __m128i*)(left   + i));
+      __m128i b = _mm_loadu_si128((const __m128i*)(prev   + i));
+      __m128i c = _mm_loadu_si128((const __m128i*)(upleft + i));
+
+      acc[0]    = rpng_sad_sse2(acc[0], x);
+      acc[1]    = rpng_sad_sse2(acc[1], _mm_sub_epi8(x, a));
+      acc[2]    = rpng_sad_sse2(acc[2], _mm_sub_epi8(x, b));
+      acc[3]    = rpng_sad_sse2(acc[3],
+            _mm_sub_epi8(x, rpng_avg_floor(a, b)));
+      acc[4]    = rpng_sad_sse2(acc[4],
+            _mm_sub_epi8(x, rpng_paeth16_sse2(a, b, c)));
+   }
+
+   for (type = 0; type < 5; type++)
+   {
+      unsigned sum = (unsigned)_mm_cvtsi128_si32(acc[type])
+         + (unsigned)_mm_cvtsi128_si32(_mm_srli_si128(acc[type], 8));
+      unsigned j;
+
+      for (j = i; j < pitch; j++)
+         sum += abs((int8_t)rpng_filter_byte(type,
+                  line[j], left[j], prev[j], upleft[j]));
+      scores[type] = sum;
+   }
+}
+
+static void rpng_filter_apply_sse2(uint8_t *dst, const uint8_t *line,
+      const uint8_t *prev, unsigned pitch, unsigned bpp, unsigned type)
+{
+   unsigned i;
+   const uint8_t *left   = line - bpp;
+   const uint8_t *upleft = prev - bpp;
+
+   for (i = 0; i + 16 <= pitch; i += 16)
+   {
+      __m128i x = _mm_loadu_si128((const __m128i*)(line + i));
+      __m128i a = _mm_loadu_si128((const __m128i*)(left + i));
+      __m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+
+      switch (type)
+      {
+         case 1:
+            x = _mm_sub_epi8(x, a);
+            break;
+         case 2:
+            x = _mm_sub_epi8(x, b);
+            break;
+         case 3:
+            x = _mm_sub_epi8(x, rpng_avg_floor(a, b));
+            break;
+         case 4:
+            x = _mm_sub_epi8(x, rpng_paeth16_sse2(a, b,
+                     _mm_loadu_si128((const __m128i*)(upleft + i))));
+            break;
+      }
+
+      _mm_storeu_si128((__m128i*)(dst + i), x);
+   }
+
+   for (; i < pitch; i++)
+      dst[i] = rpng_filter_byte(type, line[i], left[i], prev[i], upleft[i]);
+}
+#endif
+
+#ifdef RPNG_SSSE3
+static INLINE RPNG_TARGET_SSSE3 __m128i rpng_paeth_ssse3(
+      __m128i a, __m128i b, __m128i c)
+{
+   const __m128i zero = _mm_setzero_si128();
+   __m128i a16        = _mm_unpacklo_epi8(a, zero);
+   __m128i b16        = _mm_unpacklo_epi8(b, zero);
+   __m128i c16        = _mm_unpacklo_epi8(c, zero);
+   __m128i pa         = _mm_sub_epi16(b16, c16);
+   __m128i pb         = _mm_sub_epi16(a16, c16);
+   __m128i pc         = _mm_abs_epi16(_mm_add_epi16(pa, pb));
+   __m128i not_a, use_b, pred;
+
+   pa    = _mm_abs_epi16(pa);
+   pb    = _mm_abs_epi16(pb);
+
+   not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+   use_b = _mm_andnot_si128(_mm_cmpgt_epi16(pb, pc), not_a);
+   pred  = _mm_or_si128(_mm_andnot_si128(not_a, a16),
+         _mm_or_si128(_mm_and_si128(use_b, b16),
+            _mm_andnot_si128(use_b, _mm_and_si128(not_a, c16))));
+
+   return _mm_packus_epi16(pred, pred);
+}
+
+static RPNG_TARGET_SSSE3 void rpng_unfilter_paeth4_ssse3(uint8_t *dst,
+      const uint8_t *src, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   __m128i a = _mm_setzero_si128();
+   __m128i c = _mm_setzero_si128();
+
+   for (i = 0; i < pitch; i += 4)
+   {
+      __m128i b = rpng_load4(prev + i);
+      a         = _mm_add_epi8(rpng_paeth_ssse3(a, b, c), rpng_load4(src + i));
+      c         = b;
+      rpng_store4(dst + i, a);
+   }
+}
+
+static RPNG_TARGET_SSSE3 void rpng_unfilter_paeth3_ssse3(uint8_t *dst,
+      const uint8_t *src, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   __m128i a = _mm_setzero_si128();
+   __m128i c = _mm_setzero_si128();
+
+   for (i = 0; i < pitch; i += 3)
+   {
+      __m128i b = rpng_load3(prev + i);
+      a         = _mm_add_epi8(rpng_paeth_ssse3(a, b, c), rpng_load3(src + i));
+      c         = b;
+      rpng_store3(dst + i, a);
+   }
+}
+
+/* Sub with the fourth pixel broadcast by a single shuffle */
+static RPNG_TARGET_SSSE3 void rpng_unfilter_sub3_ssse3(uint8_t *dst,
+      const uint8_t *src, const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   const __m128i bcast = _mm_setr_epi8(9, 10, 11, 9, 10, 11, 9, 10,
+         11, 9, 10, 11, 9, 10, 11, 9);
+   __m128i last        = _mm_setzero_si128();
+
+   for (i = 0; i + 12 <= pitch; i += 12)
+   {
+      __m128i x = rpng_load12(src + i);
+      x         = _mm_add_epi8(x, _mm_slli_si128(x, 3));
+      x         = _mm_add_epi8(x, _mm_slli_si128(x, 6));
+      x         = _mm_add_epi8(x, last);
+      rpng_store12(dst + i, x);
+      last      = _mm_shuffle_epi8(x, bcast);
+   }
+
+   for (; i < pitch; i += 3)
+   {
+      last = _mm_add_epi8(last, rpng_load3(src + i));
+      rpng_store3(dst + i, last);
+   }
+}
+
+static RPNG_TARGET_SSSE3 void rpng_copy_line_rgb8_ssse3(uint32_t *data,
+      const uint8_t *decoded, unsigned width)
+{
+   unsigned i;
+   const __m128i shuf  = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1,
+         8, 7, 6, -1, 11, 10, 9, -1);
+   const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+
+   /* Reads 16 bytes for every 12 it uses, so stop one
+    * group early to stay inside the scanline */
+   for (i = 0; i + 6 <= width; i += 4)
+   {
+      __m128i x = _mm_loadu_si128((const __m128i*)(decoded + i * 3));
+      x         = _mm_or_si128(_mm_shuffle_epi8(x, shuf), alpha);
+      _mm_storeu_si128((__m128i*)(data + i), x);
+   }
+
+   rpng_copy_line_rgb8_c(data + i, decoded + i * 3, width - i);
+}
+
+static RPNG_TARGET_SSSE3 void rpng_copy_line_rgba8_ssse3(uint32_t *data,
+      const uint8_t *decoded, unsigned width)
+{
+   unsigned i;
+   const __m128i shuf = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7,
+         10, 9, 8, 11, 14, 13, 12, 15);
+
+   for (i = 0; i + 4 <= width; i += 4)
+   {
+      __m128i x = _mm_loadu_si128((const __m128i*)(decoded + i * 4));
+      _mm_storeu_si128((__m128i*)(data + i), _mm_shuffle_epi8(x, shuf));
+   }
+
+   rpng_copy_line_rgba8_c(data + i, decoded + i * 4, width - i);
+}
+#endif
+
+#ifdef RPNG_NEON
+static INLINE uint8x8_t rpng_paeth_neon(uint8x8_t a, uint8x8_t b,
+      uint8x8_t c)
+{
+   uint16x8_t pa   = vabdl_u8(b, c);
+   uint16x8_t pb   = vabdl_u8(a, c);
+   int16x8_t ac    = vreinterpretq_s16_u16(vsubl_u8(a, c));
+   int16x8_t bc    = vreinterpretq_s16_u16(vsubl_u8(b, c));
+   uint16x8_t pc   = vreinterpretq_u16_s16(vabsq_s16(vaddq_s16(ac, bc)));
+   uint8x8_t use_a = vmovn_u16(vandq_u16(vcleq_u16(pa, pb),
+            vcleq_u16(pa, pc)));
+   uint8x8_t use_b = vmovn_u16(vcleq_u16(pb, pc));
+
+   return vbsl_u8(use_a, a, vbsl_u8(use_b, b, c));
+}
+
+static INLINE uint8x8_t rpng_load3_neon(const uint8_t *p)
+{
+   uint32_t v = 0;
+   memcpy(&v, p, 3);
+   return vreinterpret_u8_u32(vdup_n_u32(v));
+}
+
+static INLINE uint8x8_t rpng_load4_neon(const uint8_t *p)
+{
+   uint32_t v;
+   memcpy(&v, p, 4);
+   return vreinterpret_u8_u32(vdup_n_u32(v));
+}
+
+static INLINE void rpng_store3_neon(uint8_t *p, uint8x8_t v)
+{
+   uint32_t w = vget_lane_u32(vreinterpret_u32_u8(v), 0);
+   memcpy(p, &w, 3);
+}
+
+static INLINE void rpng_store4_neon(uint8_t *p, uint8x8_t v)
+{
+   uint32_t w = vget_lane_u32(vreinterpret_u32_u8(v), 0);
+   memcpy(p, &w, 4);
+}
+
+static void rpng_unfilter_up_neon(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+
+   for (i = 0; i + 16 <= pitch; i += 16)
+      vst1q_u8(dst + i, vaddq_u8(vld1q_u8(src + i), vld1q_u8(prev + i)));
+   for (; i < pitch; i++)
+      dst[i] = prev[i] + src[i];
+}
+
+static void rpng_unfilter_sub4_neon(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   uint8x8_t a = vdup_n_u8(0);
+
+   for (i = 0; i < pitch; i += 4)
+   {
+      a = vadd_u8(a, rpng_load4_neon(src + i));
+      rpng_store4_neon(dst + i, a);
+   }
+}
+
+static void rpng_unfilter_sub3_neon(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   uint8x8_t a = vdup_n_u8(0);
+
+   for (i = 0; i < pitch; i += 3)
+   {
+      a = vadd_u8(a, rpng_load3_neon(src + i));
+      rpng_store3_neon(dst + i, a);
+   }
+}
+
+/* vhadd_u8 is exactly floor((a + b) / 2) */
+static void rpng_unfilter_avg4_neon(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   uint8x8_t a = vdup_n_u8(0);
+
+   for (i = 0; i < pitch; i += 4)
+   {
+      a = vadd_u8(vhadd_u8(a, rpng_load4_neon(prev + i)),
+            rpng_load4_neon(src + i));
+      rpng_store4_neon(dst + i, a);
+   }
+}
+
+static void rpng_unfilter_avg3_neon(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   uint8x8_t a = vdup_n_u8(0);
+
+   for (i = 0; i < pitch; i += 3)
+   {
+      a = vadd_u8(vhadd_u8(a, rpng_load3_neon(prev + i)),
+            rpng_load3_neon(src + i));
+      rpng_store3_neon(dst + i, a);
+   }
+}
+
+static void rpng_unfilter_paeth4_neon(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   uint8x8_t a = vdup_n_u8(0);
+   uint8x8_t c = vdup_n_u8(0);
+
+   for (i = 0; i < pitch; i += 4)
+   {
+      uint8x8_t b = rpng_load4_neon(prev + i);
+      a           = vadd_u8(rpng_paeth_neon(a, b, c),
+            rpng_load4_neon(src + i));
+      c           = b;
+      rpng_store4_neon(dst + i, a);
+   }
+}
+
+static void rpng_unfilter_paeth3_neon(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i;
+   uint8x8_t a = vdup_n_u8(0);
+   uint8x8_t c = vdup_n_u8(0);
+
+   for (i = 0; i < pitch; i += 3)
+   {
+      uint8x8_t b = rpng_load3_neon(prev + i);
+      a           = vadd_u8(rpng_paeth_neon(a, b, c),
+            rpng_load3_neon(src + i));
+      c           = b;
+      rpng_store3_neon(dst + i, a);
+   }
+}
+
+#ifndef MSB_FIRST
+static void rpng_copy_line_rgb8_neon(uint32_t *data,
+      const uint8_t *decoded, unsigned width)
+{
+   unsigned i;
+
+   for (i = 0; i + 8 <= width; i += 8)
+   {
+      uint8x8x3_t rgb = vld3_u8(decoded + i * 3);
+      uint8x8x4_t out;
+
+      out.val[0]      = rgb.val[2];
+      out.val[1]      = rgb.val[1];
+      out.val[2]      = rgb.val[0];
+      out.val[3]      = vdup_n_u8(0xff);
+      vst4_u8((uint8_t*)(data + i), out);
+   }
+
+   rpng_copy_line_rgb8_c(data + i, decoded + i * 3, width - i);
+}
+
+static void rpng_copy_line_rgba8_neon(uint32_t *data,
+      const uint8_t *decoded, unsigned width)
+{
+   unsigned i;
+
+   for (i = 0; i + 8 <= width; i += 8)
+   {
+      uint8x8x4_t px = vld4_u8(decoded + i * 4);
+      uint8x8_t r    = px.val[0];
+
+      px.val[0]      = px.val[2];
+      px.val[2]      = r;
+      vst4_u8((uint8_t*)(data + i), px);
+   }
+
+   rpng_copy_line_rgba8_c(data + i, decoded + i * 4, width - i);
+}
+#endif
+
+static INLINE uint32x2_t rpng_sad_neon(uint32x2_t acc, uint8x8_t x)
+{
+   /* vabs wraps -128 to itself, which is 128 unsigned */
+   return vpadal_u16(acc, vpaddl_u8(
+            vreinterpret_u8_s8(vabs_s8(vreinterpret_s8_u8(x)))));
+}
+
+static void rpng_filter_score_neon(unsigned *scores, const uint8_t *line,
+      const uint8_t *prev, unsigned pitch, unsigned bpp)
+{
+   unsigned i, type;
+   uint32x2_t acc[5];
+   const uint8_t *left   = line - bpp;
+   const uint8_t *upleft = prev - bpp;
+
+   for (type = 0; type < 5; type++)
+      acc[type] = vdup_n_u32(0);
+
+   for (i = 0; i + 8 <= pitch; i += 8)
+   {
+      uint8x8_t x = vld1_u8(line   + i);
+      uint8x8_t a = vld1_u8(left   + i);
+      uint8x8_t b = vld1_u8(prev   + i);
+      uint8x8_t c = vld1_u8(upleft + i);
+
+      acc[0]      = rpng_sad_neon(acc[0], x);
+      acc[1]      = rpng_sad_neon(acc[1], vsub_u8(x, a));
+      acc[2]      = rpng_sad_neon(acc[2], vsub_u8(x, b));
+      acc[3]      = rpng_sad_neon(acc[3], vsub_u8(x, vhadd_u8(a, b)));
+      acc[4]      = rpng_sad_neon(acc[4],
+            vsub_u8(x, rpng_paeth_neon(a, b, c)));
+   }
+
+   for (type = 0; type < 5; type++)
+   {
+      unsigned sum = vget_lane_u32(acc[type], 0)
+         + vget_lane_u32(acc[type], 1);
+      unsigned j;
+
+      for (j = i; j < pitch; j++)
+         sum += abs((int8_t)rpng_filter_byte(type,
+                  line[j], left[j], prev[j], upleft[j]));
+      scores[type] = sum;
+   }
+}
+
+static void rpng_filter_apply_neon(uint8_t *dst, const uint8_t *line,
+      const uint8_t *prev, unsigned pitch, unsigned bpp, unsigned type)
+{
+   unsigned i;
+   const uint8_t *left   = line - bpp;
+   const uint8_t *upleft = prev - bpp;
+
+   for (i = 0; i + 8 <= pitch; i += 8)
+   {
+      uint8x8_t x = vld1_u8(line + i);
+      uint8x8_t a = vld1_u8(left + i);
+      uint8x8_t b = vld1_u8(prev + i);
+
+      switch (type)
+      {
+         case 1:
+            x = vsub_u8(x, a);
+            break;
+         case 2:
+            x = vsub_u8(x, b);
+            break;
+         case 3:
+            x = vsub_u8(x, vhadd_u8(a, b));
+            break;
+         case 4:
+            x = vsub_u8(x, rpng_paeth_neon(a, b, vld1_u8(upleft + i)));
+            break;
+      }
+
+      vst1_u8(dst + i, x);
+   }
+
+   for (; i < pitch; i++)
+      dst[i] = rpng_filter_byte(type, line[i], left[i], prev[i], upleft[i]);
+}
+#endif
+
+struct rpng_filter_table
+{
+   struct rpng_filter bpp3;
+   struct rpng_filter bpp4;
+   rpng_copy_line_t copy_rgb8;
+   rpng_copy_line_t copy_rgba8;
+   rpng_filter_score_t score;
+   rpng_filter_apply_t apply;
+};
+
+static struct rpng_filter_table rpng_filter_kernels;
+static bool rpng_filter_detected;
+
+/* Threads racing on the first call all store the same kernels */
+static void rpng_filter_detect(void)
+{
+   struct rpng_filter_table t;
+#ifdef RPNG_SSSE3
+   uint64_t cpu        = cpu_features_get();
+#endif
+
+   t.bpp3.sub          = rpng_unfilter_sub_c;
+   t.bpp3.up           = rpng_unfilter_up_c;
+   t.bpp3.avg          = rpng_unfilter_avg_c;
+   t.bpp3.paeth        = rpng_unfilter_paeth_c;
+   t.bpp4              = t.bpp3;
+   t.copy_rgb8         = rpng_copy_line_rgb8_c;
+   t.copy_rgba8        = rpng_copy_line_rgba8_c;
+   t.score             = rpng_filter_score_c;
+   t.apply             = rpng_filter_apply_c;
+
+#if defined(RPNG_SSE2)
+   t.bpp3.sub          = rpng_unfilter_sub3_sse2;
+   t.bpp3.up           = rpng_unfilter_up_sse2;
+   t.bpp3.avg          = rpng_unfilter_avg3_sse2;
+   t.bpp3.paeth        = rpng_unfilter_paeth3_sse2;
+   t.bpp4.sub          = rpng_unfilter_sub4_sse2;
+   t.bpp4.up           = rpng_unfilter_up_sse2;
+   t.bpp4.avg          = rpng_unfilter_avg4_sse2;
+   t.bpp4.paeth        = rpng_unfilter_paeth4_sse2;
+   t.copy_rgba8        = rpng_copy_line_rgba8_sse2;
+   t.score             = rpng_filter_score_sse2;
+   t.apply             = rpng_filter_apply_sse2;
+#endif
+
+#if defined(RPNG_SSSE3)
+   if (cpu & KS_SIMD_SSSE3)
+   {
+      t.bpp3.sub       = rpng_unfilter_sub3_ssse3;
+      t.bpp3.paeth     = rpng_unfilter_paeth3_ssse3;
+      t.bpp4.paeth     = rpng_unfilter_paeth4_ssse3;
+      t.copy_rgb8      = rpng_copy_line_rgb8_ssse3;
+      t.copy_rgba8     = rpng_copy_line_rgba8_ssse3;
+   }
+#endif
+
+#if defined(RPNG_NEON)
+   t.bpp3.sub          = rpng_unfilter_sub3_neon;
+   t.bpp3.up           = rpng_unfilter_up_neon;
+   t.bpp3.avg          = rpng_unfilter_avg3_neon;
+   t.bpp3.paeth        = rpng_unfilter_paeth3_neon;
+   t.bpp4.sub          = rpng_unfilter_sub4_neon;
+   t.bpp4.up           = rpng_unfilter_up_neon;
+   t.bpp4.avg          = rpng_unfilter_avg4_neon;
+   t.bpp4.paeth        = rpng_unfilter_paeth4_neon;
+   t.score             = rpng_filter_score_neon;
+   t.apply             = rpng_filter_apply_neon;
+#ifndef MSB_FIRST
+   t.copy_rgb8         = rpng_copy_line_rgb8_neon;
+   t.copy_rgba8        = rpng_copy_line_rgba8_neon;
+#endif
+#endif
+
+   rpng_filter_kernels  = t;
+   rpng_filter_detected = true;
+}
+
+void rpng_filter_init(struct rpng_filter *filter, unsigned bpp,
+      bool simd)
+{
+   if (simd && !rpng_filter_detected)
+      rpng_filter_detect();
+
+   if (simd && bpp == 3)
+      *filter = rpng_filter_kernels.bpp3;
+   else if (simd && bpp == 4)
+      *filter = rpng_filter_kernels.bpp4;
+   else
+   {
+      filter->sub   = rpng_unfilter_sub_c;
+      filter->up    = simd ? rpng_filter_kernels.bpp4.up : rpng_unfilter_up_c;
+      filter->avg   = rpng_unfilter_avg_c;
+      filter->paeth = rpng_unfilter_paeth_c;
+   }
+
+   filter->copy_rgb8  = simd
+      ? rpng_filter_kernels.copy_rgb8  : rpng_copy_line_rgb8_c;
+   filter->copy_rgba8 = simd
+      ? rpng_filter_kernels.copy_rgba8 : rpng_copy_line_rgba8_c;
+   filter->score      = simd
+      ? rpng_filter_kernels.score      : rpng_filter_score_c;
+   filter->apply      = simd
+      ? rpng_filter_kernels.apply      : rpng_filter_apply_c;
+}
@@ -24,6 +24,7 @@
 #define _RPNG_COMMON_H
 
 #include <stdint.h>
+#include <boolean.h>
 #include <filters.h>
 #include <formats/rpng.h>
 
@@ -46,4 +47,40 @@ struct png_ihdr
    uint8_t interlace;
 };
 
+/* Reverses one filter over a scanline of 'pitch' bytes */
+typedef void (*rpng_unfilter_t)(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch, unsigned bpp);
+
+/* Converts 8-bit RGB or RGBA to ARGB8888 */
+typedef void (*rpng_copy_line_t)(uint32_t *data,
+      const uint8_t *decoded, unsigned width);
+
+/* Sums |x| over a scanline of 'pitch' bytes filtered with None,
+ * Sub, Up, Average and Paeth, reading x as signed. 'line' and
+ * 'prev' must be preceded by 'bpp' zero bytes */
+typedef void (*rpng_filter_score_t)(unsigned *scores,
+      const uint8_t *line, const uint8_t *prev, unsigned pitch,
+      unsigned bpp);
+
+/* Filters a scanline with filter 'type', padded like above */
+typedef void (*rpng_filter_apply_t)(uint8_t *dst, const uint8_t *line,
+      const uint8_t *prev, unsigned pitch, unsigned bpp, unsigned type);
+
+struct rpng_filter
+{
+   rpng_unfilter_t sub;
+   rpng_unfilter_t up;
+   rpng_unfilter_t avg;
+   rpng_unfilter_t paeth;
+   rpng_copy_line_t copy_rgb8;
+   rpng_copy_line_t copy_rgba8;
+   rpng_filter_score_t score;
+   rpng_filter_apply_t apply;
+};
+
+/* Picks the kernels for 'bpp' bytes per pixel. With 'simd'
+ * unset only the plain C kernels are used (rpng_filter.c) */
+void rpng_filter_init(struct rpng_filter *filter, unsigned bpp,
+      bool simd);
+
 #endif
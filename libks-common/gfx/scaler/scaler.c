@@ -192,6 +192,10 @@ bool scaler_ctx_gen_filter(struct scaler_ctx *ctx)
                   case SCALER_FMT_BGR24:
                      ctx->direct_pixconv = conv_abgr8888_bgr24;
                      break;
+                  case SCALER_FMT_ARGB8888:
+                     /* Swapping R and B works both ways */
+                     ctx->direct_pixconv = conv_argb8888_abgr8888;
+                     break;
                   default:
                      break;
                }
@@ -229,6 +233,10 @@ bool scaler_ctx_gen_filter(struct scaler_ctx *ctx)
             ctx->in_pixconv = conv_rgba4444_argb8888;
             break;
 
+         case SCALER_FMT_ABGR8888:
+            ctx->in_pixconv = conv_argb8888_abgr8888;
+            break;
+
          default:
             return false;
       }
@@ -46,6 +46,8 @@ KS_BEGIN_DECLS
 #define RESAMPLER_SIMD_AVX2     (1 << 12)
 #define RESAMPLER_SIMD_VFPU     (1 << 13)
 #define RESAMPLER_SIMD_PS       (1 << 14)
+#define RESAMPLER_SIMD_FMA3     (1 << 24)
+#define RESAMPLER_SIMD_AVX512   (1 << 25)
 
 enum resampler_quality
 {
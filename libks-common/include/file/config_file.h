@@ -59,6 +59,9 @@ struct config_file
    struct config_entry_list *tail;
    struct config_entry_list *last;
    struct config_include_list *includes;
+   /* Hash of each key mapped to the first entry
+    * with that hash (see array/rhmap.h) */
+   struct config_entry_list **entries_map;
    unsigned include_depth;
    bool guaranteed_no_duplicates;
    bool modified;
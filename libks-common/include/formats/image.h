@@ -87,6 +87,15 @@ void image_transfer_set_buffer_ptr(
       void *ptr,
       size_t len);
 
+/* Lets PNG and JPEG images be decoded at a reduced size
+ * that still covers 'width' x 'height'. Other formats
+ * are always decoded at full size */
+void image_transfer_set_target_size(
+      void *data,
+      enum image_type_enum type,
+      unsigned width,
+      unsigned height);
+
 int image_transfer_process(
       void *data,
       enum image_type_enum type,
@@ -39,6 +39,13 @@ int rjpeg_process_image(rjpeg_t *rjpeg, void **buf,
 
 bool rjpeg_set_buf_ptr(rjpeg_t *rjpeg, void *data);
 
+/* Lets the decoder produce a 1/2, 1/4 or 1/8 sized image,
+ * as long as it is still at least 'width' wide or 'height'
+ * high, so that fitting it into a 'width' x 'height' box
+ * afterwards loses no detail. Pass 0 to decode at full size */
+void rjpeg_set_target_size(rjpeg_t *rjpeg,
+      unsigned width, unsigned height);
+
 void rjpeg_free(rjpeg_t *rjpeg);
 
 rjpeg_t *rjpeg_alloc(void);
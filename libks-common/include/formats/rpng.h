@@ -34,6 +34,25 @@ KS_BEGIN_DECLS
 
 typedef struct rpng rpng_t;
 
+enum rpng_decode_flags
+{
+   /* Only use the plain C unfilter kernels */
+   RPNG_DECODE_NO_SIMD     = (1 << 0),
+   /* Never inflate on a separate thread */
+   RPNG_DECODE_NO_PIPELINE = (1 << 1)
+};
+
+enum rpng_encode_flags
+{
+   /* Only use the plain C filter kernels */
+   RPNG_ENCODE_NO_SIMD    = (1 << 0),
+   /* Filter and deflate on the calling thread only */
+   RPNG_ENCODE_NO_THREADS = (1 << 1),
+   /* Fastest zlib level, for images that are written often
+    * and kept around briefly, such as savestate thumbnails */
+   RPNG_ENCODE_FAST       = (1 << 2)
+};
+
 rpng_t *rpng_init(const char *path);
 
 bool rpng_is_valid(rpng_t *rpng);
@@ -51,11 +70,36 @@ int rpng_process_image(rpng_t *rpng,
 
 bool rpng_start(rpng_t *rpng);
 
+/* Takes a combination of enum rpng_decode_flags. Must be
+ * called before the first rpng_process_image() */
+void rpng_set_decode_flags(rpng_t *rpng, unsigned flags);
+
+/* Lets the decoder shrink the image by an integer factor
+ * while unfiltering, as long as it is still at least 'width'
+ * wide or 'height' high. Interlaced images are always
+ * decoded at full size. Must be called before the first
+ * rpng_process_image(); pass 0 to decode at full size */
+void rpng_set_target_size(rpng_t *rpng, unsigned width, unsigned height);
+
+/* Decodes a whole PNG file held in memory to ARGB8888 */
+bool rpng_load_image_argb_buffer(const void *buf, size_t len,
+      uint32_t **data, unsigned *width, unsigned *height,
+      unsigned flags);
+
 bool rpng_save_image_argb(const char *path, const uint32_t *data,
       unsigned width, unsigned height, unsigned pitch);
 bool rpng_save_image_bgr24(const char *path, const uint8_t *data,
       unsigned width, unsigned height, unsigned pitch);
 
+/* Same as above, taking a combination of enum rpng_encode_flags.
+ * Large images are filtered in strips and deflated in chunks
+ * on a pool of threads; the output is one ordinary zlib stream
+ * either way */
+bool rpng_save_image_argb_ex(const char *path, const uint32_t *data,
+      unsigned width, unsigned height, unsigned pitch, unsigned flags);
+bool rpng_save_image_bgr24_ex(const char *path, const uint8_t *data,
+      unsigned width, unsigned height, unsigned pitch, unsigned flags);
+
 uint8_t* rpng_save_image_bgr24_string(const uint8_t *data,
       unsigned width, unsigned height, signed pitch, uint64_t *bytes);
 
@@ -1956,6 +1956,10 @@ struct ks_log_callback
 #define KS_SIMD_MOVBE    (1 << 19)
 #define KS_SIMD_CMOV     (1 << 20)
 #define KS_SIMD_ASIMD    (1 << 21)
+#define KS_SIMD_PCLMUL   (1 << 22)
+#define KS_SIMD_PMULL    (1 << 23)
+#define KS_SIMD_FMA3     (1 << 24)
+#define KS_SIMD_AVX512   (1 << 25)
 
 typedef uint64_t ks_perf_tick_t;
 typedef int64_t ks_time_t;
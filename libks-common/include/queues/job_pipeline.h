@@ -0,0 +1,80 @@
+/* Copyright  (C) 2010-2020 The KingStation team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (job_pipeline.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __LIBKS_SDK_JOB_PIPELINE_H
+#define __LIBKS_SDK_JOB_PIPELINE_H
+
+#include <ks_common_api.h>
+#include <boolean.h>
+
+KS_BEGIN_DECLS
+
+/* Runs jobs on a small pool of worker threads while handing the
+ * results back strictly in submission order. The number of jobs
+ * in flight is bounded by the pipeline depth, so a producer can
+ * keep a few expensive operations (e.g. hashing files) running
+ * ahead of a consumer that has to process them sequentially.
+ *
+ * Without thread support, jobs run when they are popped. */
+typedef struct job_pipeline job_pipeline_t;
+
+typedef void (*job_pipeline_handler_t)(void *job, void *userdata);
+
+/**
+ * job_pipeline_new:
+ * @workers            : Number of worker threads.
+ * @depth              : Maximum number of jobs queued or in flight.
+ * @handler            : Called on a worker thread for every job.
+ * @userdata           : Passed to @handler.
+ *
+ * Returns: new pipeline, or NULL on failure.
+ **/
+job_pipeline_t *job_pipeline_new(unsigned workers, unsigned depth,
+      job_pipeline_handler_t handler, void *userdata);
+
+/**
+ * job_pipeline_free:
+ * @discard            : Called for every job that has not been
+ *                       popped yet, may be NULL.
+ *
+ * Jobs that have not been started are not run any more;
+ * waits for the ones that are already running.
+ **/
+void job_pipeline_free(job_pipeline_t *pipeline,
+      void (*discard)(void *job));
+
+/* Queues a job. Returns false if the pipeline is full. */
+bool job_pipeline_push(job_pipeline_t *pipeline, void *job);
+
+/* Returns the oldest job that has not been popped, finished
+ * or not, or NULL if the pipeline is empty. The caller must
+ * only read fields that the handler does not write. */
+void *job_pipeline_peek(job_pipeline_t *pipeline);
+
+/* Removes and returns the oldest job once it has finished.
+ * If @wait is false and the job is still running,
+ * returns NULL instead of blocking. */
+void *job_pipeline_pop(job_pipeline_t *pipeline, bool wait);
+
+KS_END_DECLS
+
+#endif
@@ -0,0 +1,97 @@
+/* Copyright  (C) 2010-2020 The KingStation team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (spsc_queue.h).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __LIBKS_SDK_SPSC_QUEUE_H
+#define __LIBKS_SDK_SPSC_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <ks_common_api.h>
+#include <boolean.h>
+
+KS_BEGIN_DECLS
+
+/* Byte ring buffer for exactly one producer thread and one
+ * consumer thread. Unlike fifo_buffer_t it needs no external
+ * locking: the write side only ever touches the write index
+ * and the read side only ever touches the read index.
+ *
+ * The blocking wait functions only take a lock when the calling
+ * side actually has to sleep. */
+typedef struct spsc_queue spsc_queue_t;
+
+/**
+ * spsc_queue_new:
+ * @size               : Capacity in bytes.
+ *
+ * Returns: new queue, or NULL on allocation failure.
+ **/
+spsc_queue_t *spsc_queue_new(size_t size);
+
+void spsc_queue_free(spsc_queue_t *queue);
+
+/* Discards queued data. Neither side may be
+ * using the queue concurrently. */
+void spsc_queue_clear(spsc_queue_t *queue);
+
+size_t spsc_queue_capacity(spsc_queue_t *queue);
+
+/* Producer side */
+size_t spsc_queue_write_avail(spsc_queue_t *queue);
+
+/* Writes up to @size bytes and returns how many were written. */
+size_t spsc_queue_write(spsc_queue_t *queue,
+      const void *in_buf, size_t size);
+
+/* Consumer side */
+size_t spsc_queue_read_avail(spsc_queue_t *queue);
+
+/* Reads up to @size bytes and returns how many were read. */
+size_t spsc_queue_read(spsc_queue_t *queue, void *out_buf, size_t size);
+
+/**
+ * spsc_queue_wait_write:
+ * @amount             : Bytes of free space to wait for.
+ * @timeout_us         : Timeout in microseconds, or negative to
+ *                       wait indefinitely.
+ *
+ * Blocks the producer until @amount bytes can be written, the
+ * timeout expires or spsc_queue_wake() has been called.
+ *
+ * Returns: true if @amount bytes can be written.
+ **/
+bool spsc_queue_wait_write(spsc_queue_t *queue,
+      size_t amount, int64_t timeout_us);
+
+/* Consumer counterpart of spsc_queue_wait_write. */
+bool spsc_queue_wait_read(spsc_queue_t *queue,
+      size_t amount, int64_t timeout_us);
+
+/* Wakes up any side blocked in a wait function and makes
+ * later waits return immediately, e.g. once the other side
+ * has shut down. */
+void spsc_queue_wake(spsc_queue_t *queue);
+
+KS_END_DECLS
+
+#endif
@@ -44,6 +44,19 @@ enum task_type
    TASK_TYPE_BLOCKING
 };
 
+/* Only honoured by the threaded task queue: whenever a worker
+ * is free it runs the next step of the highest priority task
+ * that is ready, so interactive work (savestates, screenshots)
+ * is not stuck behind bulk jobs such as content scans. */
+enum task_priority
+{
+   TASK_PRIORITY_LOW = 0,
+   TASK_PRIORITY_NORMAL,
+   TASK_PRIORITY_HIGH,
+
+   TASK_PRIORITY_COUNT
+};
+
 typedef struct ks_task ks_task_t;
 typedef void (*ks_task_callback_t)(ks_task_t *task,
       void *task_data,
@@ -107,6 +120,10 @@ struct ks_task
    /* don't touch this. */
    ks_task_t *next;
 
+   /* don't touch this either - links the task
+    * into a worker run queue. */
+   ks_task_t *sched_next;
+
    /* -1 = unmetered/indeterminate, 0-100 = current progress percentage */
    int8_t progress;
 
@@ -115,6 +132,14 @@ struct ks_task
 
    enum task_type type;
 
+   enum task_priority priority;
+
+   /* if set to true, the handler may run on one worker while
+    * other tasks run on the others. Only set this for handlers
+    * that touch nothing but their own task state; all other
+    * tasks run one at a time, as on a single worker. */
+   bool concurrent;
+
    /* if set to true, frontend will
    use an alternative look for the
    task progress display */
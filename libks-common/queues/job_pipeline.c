@@ -0,0 +1,262 @@
+/* Copyright  (C) 2010-2020 The KingStation team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (job_pipeline.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include <boolean.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#include <queues/job_pipeline.h>
+
+#define JOB_PIPELINE_MAX_WORKERS 16
+
+struct job_slot
+{
+   void *job;
+   bool done;
+};
+
+struct job_pipeline
+{
+   struct job_slot *slots;
+   job_pipeline_handler_t handler;
+   void *userdata;
+   /* Sequence numbers of the oldest job, the next job to start
+    * and the next free slot; slot index is seq % depth. */
+   unsigned head;
+   unsigned next;
+   unsigned tail;
+   unsigned depth;
+#ifdef HAVE_THREADS
+   slock_t *lock;
+   scond_t *work_cond;
+   scond_t *done_cond;
+   sthread_t *threads[JOB_PIPELINE_MAX_WORKERS];
+   unsigned num_threads;
+   bool quit;
+#endif
+};
+
+#ifdef HAVE_THREADS
+static void job_pipeline_worker(void *data)
+{
+   job_pipeline_t *pipeline = (job_pipeline_t*)data;
+
+   slock_lock(pipeline->lock);
+
+   for (;;)
+   {
+      struct job_slot *slot = NULL;
+
+      if (pipeline->quit)
+         break;
+
+      if (pipeline->next == pipeline->tail)
+      {
+         scond_wait(pipeline->work_cond, pipeline->lock);
+         continue;
+      }
+
+      slot = &pipeline->slots[pipeline->next++ % pipeline->depth];
+      slock_unlock(pipeline->lock);
+
+      pipeline->handler(slot->job, pipeline->userdata);
+
+      slock_lock(pipeline->lock);
+      slot->done = true;
+      scond_broadcast(pipeline->done_cond);
+   }
+
+   slock_unlock(pipeline->lock);
+}
+#endif
+
+job_pipeline_t *job_pipeline_new(unsigned workers, unsigned depth,
+      job_pipeline_handler_t handler, void *userdata)
+{
+   job_pipeline_t *pipeline = NULL;
+
+   if (!handler || depth == 0)
+      return NULL;
+
+   if (!(pipeline = (job_pipeline_t*)calloc(1, sizeof(*pipeline))))
+      return NULL;
+
+   pipeline->handler  = handler;
+   pipeline->userdata = userdata;
+   pipeline->depth    = depth;
+
+   if (!(pipeline->slots = (struct job_slot*)
+            calloc(depth, sizeof(*pipeline->slots))))
+      goto error;
+
+#ifdef HAVE_THREADS
+   if (workers < 1)
+      workers = 1;
+   if (workers > JOB_PIPELINE_MAX_WORKERS)
+      workers = JOB_PIPELINE_MAX_WORKERS;
+
+   if (!(pipeline->lock      = slock_new()))
+      goto error;
+   if (!(pipeline->work_cond = scond_new()))
+      goto error;
+   if (!(pipeline->done_cond = scond_new()))
+      goto error;
+
+   for (; pipeline->num_threads < workers; pipeline->num_threads++)
+   {
+      if (!(pipeline->threads[pipeline->num_threads] =
+               sthread_create(job_pipeline_worker, pipeline)))
+         break;
+   }
+
+   if (pipeline->num_threads == 0)
+      goto error;
+#else
+   (void)workers;
+#endif
+
+   return pipeline;
+
+error:
+   job_pipeline_free(pipeline, NULL);
+   return NULL;
+}
+
+void job_pipeline_free(job_pipeline_t *pipeline,
+      void (*discard)(void *job))
+{
+   unsigned i;
+
+   if (!pipeline)
+      return;
+
+#ifdef HAVE_THREADS
+   if (pipeline->lock)
+   {
+      slock_lock(pipeline->lock);
+      pipeline->quit = true;
+      scond_broadcast(pipeline->work_cond);
+      slock_unlock(pipeline->lock);
+   }
+
+   for (i = 0; i < pipeline->num_threads; i++)
+      sthread_join(pipeline->threads[i]);
+
+   if (pipeline->done_cond)
+      scond_free(pipeline->done_cond);
+   if (pipeline->work_cond)
+      scond_free(pipeline->work_cond);
+   if (pipeline->lock)
+      slock_free(pipeline->lock);
+#endif
+
+   if (discard)
+      for (i = pipeline->head; i != pipeline->tail; i++)
+         discard(pipeline->slots[i % pipeline->depth].job);
+
+   free(pipeline->slots);
+   free(pipeline);
+}
+
+bool job_pipeline_push(job_pipeline_t *pipeline, void *job)
+{
+   struct job_slot *slot = NULL;
+
+#ifdef HAVE_THREADS
+   slock_lock(pipeline->lock);
+#endif
+
+   if (pipeline->tail - pipeline->head >= pipeline->depth)
+   {
+#ifdef HAVE_THREADS
+      slock_unlock(pipeline->lock);
+#endif
+      return false;
+   }
+
+   slot       = &pipeline->slots[pipeline->tail++ % pipeline->depth];
+   slot->job  = job;
+   slot->done = false;
+
+#ifdef HAVE_THREADS
+   scond_signal(pipeline->work_cond);
+   slock_unlock(pipeline->lock);
+#endif
+
+   return true;
+}
+
+void *job_pipeline_peek(job_pipeline_t *pipeline)
+{
+   void *job = NULL;
+
+#ifdef HAVE_THREADS
+   slock_lock(pipeline->lock);
+#endif
+   if (pipeline->head != pipeline->tail)
+      job = pipeline->slots[pipeline->head % pipeline->depth].job;
+#ifdef HAVE_THREADS
+   slock_unlock(pipeline->lock);
+#endif
+
+   return job;
+}
+
+void *job_pipeline_pop(job_pipeline_t *pipeline, bool wait)
+{
+   struct job_slot *slot = NULL;
+   void *job             = NULL;
+
+#ifdef HAVE_THREADS
+   slock_lock(pipeline->lock);
+
+   if (pipeline->head != pipeline->tail)
+   {
+      slot = &pipeline->slots[pipeline->head % pipeline->depth];
+
+      while (wait && !slot->done)
+         scond_wait(pipeline->done_cond, pipeline->lock);
+
+      if (slot->done)
+      {
+         job = slot->job;
+         pipeline->head++;
+      }
+   }
+
+   slock_unlock(pipeline->lock);
+#else
+   if (pipeline->head != pipeline->tail)
+   {
+      slot = &pipeline->slots[pipeline->head++ % pipeline->depth];
+      job  = slot->job;
+      pipeline->handler(job, pipeline->userdata);
+      pipeline->next = pipeline->head;
+   }
+#endif
+
+   return job;
+}
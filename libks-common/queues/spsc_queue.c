@@ -0,0 +1,359 @@
+/* Copyright  (C) 2010-2020 The KingStation team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (spsc_queue.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <ks_common_api.h>
+#include <ks_inline.h>
+#include <boolean.h>
+#include <memalign.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#include <queues/spsc_queue.h>
+
+#if defined(_MSC_VER) && !defined(_XBOX)
+#include <windows.h>
+#endif
+
+/* Index loads/stores need acquire/release ordering so that the
+ * buffer contents are visible before the index that publishes
+ * them. Without compiler support for that, fall back to taking
+ * a lock around index accesses. */
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#define SPSC_LOAD_ACQUIRE(ptr)       __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define SPSC_STORE_RELEASE(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#define SPSC_FULL_BARRIER()          __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#elif defined(_MSC_VER) && !defined(_XBOX) && (defined(_M_IX86) || defined(_M_X64))
+/* x86 loads have acquire and stores have release semantics,
+ * only the compiler has to be kept from reordering. */
+#define SPSC_LOAD_ACQUIRE(ptr)       spsc_msvc_load(ptr)
+#define SPSC_STORE_RELEASE(ptr, val) spsc_msvc_store((ptr), (val))
+#define SPSC_FULL_BARRIER()          MemoryBarrier()
+
+static INLINE size_t spsc_msvc_load(volatile size_t *ptr)
+{
+   size_t val = *ptr;
+   _ReadWriteBarrier();
+   return val;
+}
+
+static INLINE void spsc_msvc_store(volatile size_t *ptr, size_t val)
+{
+   _ReadWriteBarrier();
+   *ptr = val;
+}
+#elif defined(HAVE_THREADS)
+#define SPSC_QUEUE_LOCKED
+#else
+/* Single-threaded platforms: both sides run on the same thread */
+#define SPSC_LOAD_ACQUIRE(ptr)       (*(ptr))
+#define SPSC_STORE_RELEASE(ptr, val) (*(ptr) = (val))
+#define SPSC_FULL_BARRIER()
+#endif
+
+#define SPSC_CACHE_LINE 64
+
+struct spsc_queue
+{
+   /* Written by the producer only */
+   volatile size_t write_pos;
+   size_t read_pos_cache;
+   char pad_producer[SPSC_CACHE_LINE - 2 * sizeof(size_t)];
+
+   /* Written by the consumer only */
+   volatile size_t read_pos;
+   size_t write_pos_cache;
+   char pad_consumer[SPSC_CACHE_LINE - 2 * sizeof(size_t)];
+
+   /* Read-only after creation. The ring is a power of two in
+    * size so positions can wrap with a mask, but never holds
+    * more than 'size' bytes. */
+   uint8_t *buffer;
+   size_t size;
+   size_t mask;
+#ifdef HAVE_THREADS
+   slock_t *lock;
+   scond_t *cond;
+#endif
+#ifdef SPSC_QUEUE_LOCKED
+   slock_t *index_lock;
+#endif
+   volatile unsigned waiters;
+   bool woken;
+};
+
+#ifdef SPSC_QUEUE_LOCKED
+static size_t spsc_locked_load(spsc_queue_t *queue, volatile size_t *ptr)
+{
+   size_t val;
+   slock_lock(queue->index_lock);
+   val = *ptr;
+   slock_unlock(queue->index_lock);
+   return val;
+}
+
+static void spsc_locked_store(spsc_queue_t *queue,
+      volatile size_t *ptr, size_t val)
+{
+   slock_lock(queue->index_lock);
+   *ptr = val;
+   slock_unlock(queue->index_lock);
+}
+
+#define SPSC_LOAD_ACQUIRE(ptr)       spsc_locked_load(queue, (ptr))
+#define SPSC_STORE_RELEASE(ptr, val) spsc_locked_store(queue, (ptr), (val))
+#define SPSC_FULL_BARRIER()
+#endif
+
+spsc_queue_t *spsc_queue_new(size_t size)
+{
+   size_t storage      = 1;
+   spsc_queue_t *queue = NULL;
+
+   if (size == 0)
+      return NULL;
+
+   while (storage < size)
+      storage <<= 1;
+
+   /* Aligned so that the two index blocks each get
+    * a cache line of their own */
+   if (!(queue = (spsc_queue_t*)memalign_alloc(
+               SPSC_CACHE_LINE, sizeof(*queue))))
+      return NULL;
+
+   memset(queue, 0, sizeof(*queue));
+
+   queue->size         = size;
+   queue->mask         = storage - 1;
+
+   if (!(queue->buffer = (uint8_t*)calloc(1, storage)))
+      goto error;
+
+#ifdef HAVE_THREADS
+   if (!(queue->lock   = slock_new()))
+      goto error;
+   if (!(queue->cond   = scond_new()))
+      goto error;
+#endif
+#ifdef SPSC_QUEUE_LOCKED
+   if (!(queue->index_lock = slock_new()))
+      goto error;
+#endif
+
+   return queue;
+
+error:
+   spsc_queue_free(queue);
+   return NULL;
+}
+
+void spsc_queue_free(spsc_queue_t *queue)
+{
+   if (!queue)
+      return;
+
+#ifdef HAVE_THREADS
+   if (queue->cond)
+      scond_free(queue->cond);
+   if (queue->lock)
+      slock_free(queue->lock);
+#endif
+#ifdef SPSC_QUEUE_LOCKED
+   if (queue->index_lock)
+      slock_free(queue->index_lock);
+#endif
+   free(queue->buffer);
+   memalign_free(queue);
+}
+
+void spsc_queue_clear(spsc_queue_t *queue)
+{
+   queue->write_pos       = 0;
+   queue->read_pos_cache  = 0;
+   queue->read_pos        = 0;
+   queue->write_pos_cache = 0;
+}
+
+size_t spsc_queue_capacity(spsc_queue_t *queue)
+{
+   return queue->size;
+}
+
+/* Positions increase monotonically and wrap around
+ * naturally; only their difference matters. */
+size_t spsc_queue_write_avail(spsc_queue_t *queue)
+{
+   queue->read_pos_cache  = SPSC_LOAD_ACQUIRE(&queue->read_pos);
+   return queue->size - (queue->write_pos - queue->read_pos_cache);
+}
+
+size_t spsc_queue_read_avail(spsc_queue_t *queue)
+{
+   queue->write_pos_cache = SPSC_LOAD_ACQUIRE(&queue->write_pos);
+   return queue->write_pos_cache - queue->read_pos;
+}
+
+static void spsc_queue_notify(spsc_queue_t *queue)
+{
+#ifdef HAVE_THREADS
+   /* Pairs with the barrier in spsc_queue_wait: either the
+    * waiter sees the new position or we see the waiter. */
+   SPSC_FULL_BARRIER();
+   if (queue->waiters)
+   {
+      slock_lock(queue->lock);
+      scond_broadcast(queue->cond);
+      slock_unlock(queue->lock);
+   }
+#endif
+}
+
+size_t spsc_queue_write(spsc_queue_t *queue,
+      const void *in_buf, size_t size)
+{
+   size_t pos, first_write;
+   /* Only look at the consumer's cache line if the
+    * last known read position doesn't leave enough room */
+   size_t avail = queue->size - (queue->write_pos - queue->read_pos_cache);
+
+   if (size > avail && size > (avail = spsc_queue_write_avail(queue)))
+      size = avail;
+
+   if (size == 0)
+      return 0;
+
+   pos         = queue->write_pos & queue->mask;
+   first_write = queue->mask + 1 - pos;
+
+   if (first_write > size)
+      first_write = size;
+
+   memcpy(queue->buffer + pos, in_buf, first_write);
+   memcpy(queue->buffer, (const uint8_t*)in_buf + first_write,
+         size - first_write);
+
+   SPSC_STORE_RELEASE(&queue->write_pos, queue->write_pos + size);
+   spsc_queue_notify(queue);
+
+   return size;
+}
+
+size_t spsc_queue_read(spsc_queue_t *queue, void *out_buf, size_t size)
+{
+   size_t pos, first_read;
+   size_t avail = queue->write_pos_cache - queue->read_pos;
+
+   if (size > avail && size > (avail = spsc_queue_read_avail(queue)))
+      size = avail;
+
+   if (size == 0)
+      return 0;
+
+   pos        = queue->read_pos & queue->mask;
+   first_read = queue->mask + 1 - pos;
+
+   if (first_read > size)
+      first_read = size;
+
+   memcpy(out_buf, queue->buffer + pos, first_read);
+   memcpy((uint8_t*)out_buf + first_read, queue->buffer,
+         size - first_read);
+
+   SPSC_STORE_RELEASE(&queue->read_pos, queue->read_pos + size);
+   spsc_queue_notify(queue);
+
+   return size;
+}
+
+#ifdef HAVE_THREADS
+static bool spsc_queue_wait(spsc_queue_t *queue, size_t amount,
+      int64_t timeout_us, bool producer)
+{
+   bool ready = false;
+
+   if (amount > queue->size)
+      amount = queue->size;
+
+   slock_lock(queue->lock);
+   queue->waiters++;
+
+   for (;;)
+   {
+      SPSC_FULL_BARRIER();
+
+      if (producer)
+         ready = queue->size - (queue->write_pos
+               - SPSC_LOAD_ACQUIRE(&queue->read_pos)) >= amount;
+      else
+         ready = SPSC_LOAD_ACQUIRE(&queue->write_pos)
+            - queue->read_pos >= amount;
+
+      if (ready || queue->woken)
+         break;
+
+      if (timeout_us < 0)
+         scond_wait(queue->cond, queue->lock);
+      else if (!scond_wait_timeout(queue->cond, queue->lock, timeout_us))
+         break;
+   }
+
+   queue->waiters--;
+   slock_unlock(queue->lock);
+
+   return ready;
+}
+#endif
+
+bool spsc_queue_wait_write(spsc_queue_t *queue,
+      size_t amount, int64_t timeout_us)
+{
+#ifdef HAVE_THREADS
+   return spsc_queue_wait(queue, amount, timeout_us, true);
+#else
+   return spsc_queue_write_avail(queue) >= amount;
+#endif
+}
+
+bool spsc_queue_wait_read(spsc_queue_t *queue,
+      size_t amount, int64_t timeout_us)
+{
+#ifdef HAVE_THREADS
+   return spsc_queue_wait(queue, amount, timeout_us, false);
+#else
+   return spsc_queue_read_avail(queue) >= amount;
+#endif
+}
+
+void spsc_queue_wake(spsc_queue_t *queue)
+{
+#ifdef HAVE_THREADS
+   slock_lock(queue->lock);
+   queue->woken = true;
+   scond_broadcast(queue->cond);
+   slock_unlock(queue->lock);
+#endif
+}
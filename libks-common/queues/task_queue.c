@@ -66,14 +66,36 @@ static struct ks_task_impl *impl_current = NULL;
 static bool task_threaded_enable            = false;
 
 #ifdef HAVE_THREADS
+/* Upper bound for the threaded task queue. Most tasks are
+ * I/O bound, so more workers mostly add disk contention. */
+#define TASK_WORKERS_MAX 4
+
+/* Every worker owns one run queue per priority. A worker
+ * takes from its own queues first and steals from the other
+ * workers' queues of the same priority before it looks at a
+ * lower priority. Only tasks flagged 'concurrent' overlap;
+ * the others are handed out one at a time, so their handlers
+ * never run alongside each other. */
+typedef struct
+{
+   slock_t *lock;
+   sthread_t *thread;
+   task_queue_t queues[TASK_PRIORITY_COUNT];
+} task_worker_t;
+
 static slock_t *running_lock                = NULL;
 static slock_t *finished_lock               = NULL;
 static slock_t *property_lock               = NULL;
 static slock_t *queue_lock                  = NULL;
+static slock_t *sched_lock                  = NULL;
 static scond_t *worker_cond                 = NULL;
-static sthread_t *worker_thread             = NULL;
-static bool worker_continue                 = true; 
-/* use running_lock when touching it */
+static task_worker_t task_workers[TASK_WORKERS_MAX];
+static unsigned task_workers_count          = 0;
+/* use sched_lock when touching the following */
+static task_queue_t tasks_delayed           = {NULL, NULL};
+static unsigned task_workers_next           = 0;
+static bool task_serial_busy                = false;
+static bool worker_continue                 = true;
 #endif
 
 static void task_queue_msg_push(ks_task_t *task,
@@ -366,14 +388,107 @@ static void task_queue_remove(task_queue_t *queue, ks_task_t *task)
    }
 }
 
+/* Run queues are linked through 'sched_next', so a task can sit
+ * in a run queue and in 'tasks_running' at the same time. */
+static void task_runq_put(task_queue_t *queue, ks_task_t *task)
+{
+   task->sched_next = NULL;
+
+   if (queue->back)
+      queue->back->sched_next = task;
+   else
+      queue->front            = task;
+
+   queue->back                = task;
+}
+
+static ks_task_t *task_runq_get(task_queue_t *queue)
+{
+   ks_task_t *task = queue->front;
+
+   if (task)
+   {
+      queue->front     = task->sched_next;
+      if (!queue->front)
+         queue->back   = NULL;
+      task->sched_next = NULL;
+   }
+
+   return task;
+}
+
+/* Like task_runq_get(), but skips tasks that are not flagged
+ * 'concurrent' if 'serial_busy' is set. */
+static ks_task_t *task_runq_get_eligible(task_queue_t *queue,
+      bool serial_busy)
+{
+   ks_task_t *prev = NULL;
+   ks_task_t *task = queue->front;
+
+   if (!serial_busy)
+      return task_runq_get(queue);
+
+   while (task && !task->concurrent)
+   {
+      prev = task;
+      task = task->sched_next;
+   }
+
+   if (task)
+   {
+      if (prev)
+         prev->sched_next = task->sched_next;
+      else
+         queue->front     = task->sched_next;
+      if (queue->back == task)
+         queue->back      = prev;
+      task->sched_next    = NULL;
+   }
+
+   return task;
+}
+
+static bool task_is_due(ks_task_t *task, ks_time_t now)
+{
+   /* allow half a millisecond for context switching */
+   return !task->when || task->when - now - 500 <= 0;
+}
+
+/* Makes a task runnable, or parks it until its 'when' if it
+ * is scheduled for later, and wakes up an idle worker.
+ * If 'worker' is NULL, workers are picked round-robin. */
+static void task_threaded_schedule(ks_task_t *task, task_worker_t *worker)
+{
+   unsigned priority = task->priority < TASK_PRIORITY_COUNT
+      ? task->priority : TASK_PRIORITY_NORMAL;
+
+   slock_lock(sched_lock);
+
+   if (!task_is_due(task, cpu_features_get_time_usec()))
+      task_runq_put(&tasks_delayed, task);
+   else
+   {
+      if (!worker)
+         worker = &task_workers[task_workers_next++ % task_workers_count];
+
+      slock_lock(worker->lock);
+      task_runq_put(&worker->queues[priority], task);
+      slock_unlock(worker->lock);
+   }
+
+   scond_signal(worker_cond);
+   slock_unlock(sched_lock);
+}
+
 static void ks_task_threaded_push_running(ks_task_t *task)
 {
    slock_lock(running_lock);
    slock_lock(queue_lock);
    task_queue_put(&tasks_running, task);
-   scond_signal(worker_cond);
    slock_unlock(queue_lock);
    slock_unlock(running_lock);
+
+   task_threaded_schedule(task, NULL);
 }
 
 static void ks_task_threaded_cancel(void *task)
@@ -467,42 +582,115 @@ static void ks_task_threaded_retrieve(task_retriever_data_t *data)
    slock_unlock(running_lock);
 }
 
+/* 'sched_lock' must be held for the duration of this function.
+ * Moves delayed tasks that are due into the worker's own run
+ * queues and returns how long until the next one is due,
+ * or 0 if there are no delayed tasks left. */
+static int64_t task_threaded_release_delayed(task_worker_t *worker)
+{
+   ks_time_t now     = cpu_features_get_time_usec();
+   int64_t   delay   = 0;
+   task_queue_t keep = {NULL, NULL};
+   ks_task_t *task   = NULL;
+
+   while ((task = task_runq_get(&tasks_delayed)))
+   {
+      if (task_is_due(task, now))
+      {
+         unsigned priority = task->priority < TASK_PRIORITY_COUNT
+            ? task->priority : TASK_PRIORITY_NORMAL;
+
+         slock_lock(worker->lock);
+         task_runq_put(&worker->queues[priority], task);
+         slock_unlock(worker->lock);
+      }
+      else
+      {
+         int64_t wait = task->when - now - 500;
+         if (!delay || wait < delay)
+            delay = wait;
+         task_runq_put(&keep, task);
+      }
+   }
+
+   tasks_delayed = keep;
+
+   return delay;
+}
+
+/* 'sched_lock' must be held for the duration of this function.
+ * Takes the highest priority runnable task, preferring the
+ * worker's own queues and stealing from the others otherwise.
+ * A task that is not 'concurrent' claims the serial slot. */
+static ks_task_t *task_threaded_take(task_worker_t *worker)
+{
+   int priority;
+
+   for (priority = TASK_PRIORITY_COUNT - 1; priority >= 0; priority--)
+   {
+      unsigned i;
+      unsigned self = (unsigned)(worker - task_workers);
+
+      for (i = 0; i < task_workers_count; i++)
+      {
+         task_worker_t *victim = &task_workers[
+            (self + i) % task_workers_count];
+         ks_task_t *task       = NULL;
+
+         slock_lock(victim->lock);
+         task = task_runq_get_eligible(&victim->queues[priority],
+               task_serial_busy);
+         slock_unlock(victim->lock);
+
+         if (task)
+         {
+            if (!task->concurrent)
+               task_serial_busy = true;
+            return task;
+         }
+      }
+   }
+
+   return NULL;
+}
+
 static void threaded_worker(void *userdata)
 {
-   (void)userdata;
+   task_worker_t *worker = (task_worker_t*)userdata;
 
    for (;;)
    {
-      ks_task_t *task  = NULL;
+      ks_task_t *task     = NULL;
       bool       finished = false;
+      bool       serial   = false;
+      int64_t    delay    = 0;
 
+      slock_lock(sched_lock);
       if (!worker_continue)
-         break; /* should we keep running until all tasks finished? */
-
-      slock_lock(running_lock);
-
-      /* Get first task to run */
-      task = tasks_running.front;
-      if (!task)
       {
-         scond_wait(worker_cond, running_lock);
-         slock_unlock(running_lock);
-         continue;
+         /* should we keep running until all tasks finished? */
+         slock_unlock(sched_lock);
+         break;
       }
+      if (tasks_delayed.front)
+         delay   = task_threaded_release_delayed(worker);
 
-      if (task->when)
+      /* Scanning under 'sched_lock' means nothing can be
+       * scheduled, nor the serial slot freed, before we sleep */
+      if (!(task = task_threaded_take(worker)))
       {
-         ks_time_t now   = cpu_features_get_time_usec();
-         ks_time_t delay = task->when - now - 500; /* allow half a millisecond for context switching */
          if (delay > 0)
-         {
-            scond_wait_timeout(worker_cond, running_lock, delay);
-            slock_unlock(running_lock);
-            continue;
-         }
+            scond_wait_timeout(worker_cond, sched_lock, delay);
+         else
+            scond_wait(worker_cond, sched_lock);
+         slock_unlock(sched_lock);
+         continue;
       }
+      slock_unlock(sched_lock);
 
-      slock_unlock(running_lock);
+      /* A finished task may be freed by task_queue_check()
+       * as soon as it is in 'tasks_finished' */
+      serial = !task->concurrent;
 
       task->handler(task);
 
@@ -510,24 +698,22 @@ static void threaded_worker(void *userdata)
       finished = task->finished;
       slock_unlock(property_lock);
 
-      /* Update queue */
       if (!finished)
       {
-         /* Move the task to the back of the queue */
-         /* mimics ks_task_threaded_push_running, 
-          * but also includes a task_queue_remove */
-         slock_lock(running_lock);
-         slock_lock(queue_lock);
-
-         /* do nothing if only item in queue */
-         if (task->next) 
+         /* Requeue behind the other tasks of the same priority.
+          * A task that is due again goes back into this worker's
+          * own queue; idle workers will steal it if needed. */
+         if (task_is_due(task, cpu_features_get_time_usec()))
          {
-            task_queue_remove(&tasks_running, task);
-            task_queue_put(&tasks_running, task);
-            scond_signal(worker_cond);
+            unsigned priority = task->priority < TASK_PRIORITY_COUNT
+               ? task->priority : TASK_PRIORITY_NORMAL;
+
+            slock_lock(worker->lock);
+            task_runq_put(&worker->queues[priority], task);
+            slock_unlock(worker->lock);
          }
-         slock_unlock(queue_lock);
-         slock_unlock(running_lock);
+         else
+            task_threaded_schedule(task, worker);
       }
       else
       {
@@ -543,45 +729,94 @@ static void threaded_worker(void *userdata)
          task_queue_put(&tasks_finished, task);
          slock_unlock(finished_lock);
       }
+
+      if (serial)
+      {
+         /* Hand the serial slot to whoever is waiting for it */
+         slock_lock(sched_lock);
+         task_serial_busy = false;
+         scond_signal(worker_cond);
+         slock_unlock(sched_lock);
+      }
    }
 }
 
 static void ks_task_threaded_init(void)
 {
+   unsigned i;
+   ks_task_t *task = NULL;
+   unsigned cores  = cpu_features_get_core_amount();
+
    running_lock    = slock_new();
    finished_lock   = slock_new();
    property_lock   = slock_new();
    queue_lock      = slock_new();
+   sched_lock      = slock_new();
    worker_cond     = scond_new();
 
-   slock_lock(running_lock);
-   worker_continue = true;
-   slock_unlock(running_lock);
+   task_workers_count = cores < 1 ? 1
+      : (cores > TASK_WORKERS_MAX ? TASK_WORKERS_MAX : cores);
 
-   worker_thread   = sthread_create(threaded_worker, NULL);
+   for (i = 0; i < task_workers_count; i++)
+   {
+      unsigned j;
+      task_workers[i].lock   = slock_new();
+      task_workers[i].thread = NULL;
+      for (j = 0; j < TASK_PRIORITY_COUNT; j++)
+      {
+         task_workers[i].queues[j].front = NULL;
+         task_workers[i].queues[j].back  = NULL;
+      }
+   }
+
+   tasks_delayed.front = NULL;
+   tasks_delayed.back  = NULL;
+   task_workers_next   = 0;
+   task_serial_busy    = false;
+   worker_continue     = true;
+
+   /* Tasks left over from a previous implementation
+    * stay in 'tasks_running'; hand them to the workers */
+   for (task = tasks_running.front; task; task = task->next)
+      task_threaded_schedule(task, NULL);
+
+   for (i = 0; i < task_workers_count; i++)
+      task_workers[i].thread = sthread_create(threaded_worker,
+            &task_workers[i]);
 }
 
 static void ks_task_threaded_deinit(void)
 {
-   slock_lock(running_lock);
+   unsigned i;
+
+   slock_lock(sched_lock);
    worker_continue = false;
-   scond_signal(worker_cond);
-   slock_unlock(running_lock);
+   scond_broadcast(worker_cond);
+   slock_unlock(sched_lock);
 
-   sthread_join(worker_thread);
+   for (i = 0; i < task_workers_count; i++)
+   {
+      if (task_workers[i].thread)
+         sthread_join(task_workers[i].thread);
+      slock_free(task_workers[i].lock);
+      task_workers[i].thread = NULL;
+      task_workers[i].lock   = NULL;
+   }
+   task_workers_count = 0;
 
    scond_free(worker_cond);
    slock_free(running_lock);
    slock_free(finished_lock);
    slock_free(property_lock);
    slock_free(queue_lock);
+   slock_free(sched_lock);
 
-   worker_thread   = NULL;
    worker_cond     = NULL;
    running_lock    = NULL;
    finished_lock   = NULL;
    property_lock   = NULL;
    queue_lock      = NULL;
+   sched_lock      = NULL;
 }
 
 static struct ks_task_impl impl_threaded = {
@@ -900,6 +1135,7 @@ ks_task_t *task_init(void)
    task->finished          = false;
    task->cancelled         = false;
    task->mute              = false;
+   task->concurrent        = false;
    task->task_data         = NULL;
    task->user_data         = NULL;
    task->state             = NULL;
@@ -912,6 +1148,8 @@ ks_task_t *task_init(void)
    task->frontend_userdata = NULL;
    task->alternative_look  = false;
    task->next              = NULL;
+   task->sched_next        = NULL;
+   task->priority          = TASK_PRIORITY_NORMAL;
    task->when              = 0;
 
    return task;
@@ -0,0 +1,540 @@
+/* Copyright  (C) 2010-2020 The KingStation team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (audio_flush_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Audio flush benchmark. Feeds ten seconds of s16 stereo core audio,
+ * one video frame worth at a time, split into flushes of at most
+ * 512 frames like audio_driver_sample_batch() does, through the
+ * same stages as the frontend's audio_driver_flush(): conversion
+ * to float, DSP filter, resampling to 48 kHz with a ratio that
+ * changes every flush like dynamic rate control does, the audio
+ * mixer and conversion back to s16. Each stage runs once over the
+ * whole flush ("passes"), and once block by block so that a block
+ * stays in the cache from the first stage to the last ("blocks",
+ * what the frontend does). Reports CPU cycles per output
+ * frame for both, and checks that they write the same samples.
+ * The last rows run the heaviest configuration with smaller
+ * blocks.
+ *
+ * Without arguments the core audio is synthesized at 32040 Hz and
+ * 44100 Hz. A raw s16 stereo file can be given instead.
+ *
+ * Usage: audio_flush_bench [file.raw rate] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libks.h>
+#include <ks_miscellaneous.h>
+#include <features/features_cpu.h>
+#include <audio/audio_resampler.h>
+#include <audio/audio_mixer.h>
+#include <audio/dsp_filter.h>
+#include <audio/conversion/s16_to_float.h>
+#include <audio/conversion/float_to_s16.h>
+
+#define OUT_RATE     48000.0
+#define FPS          60
+#define SECONDS      10
+#define RUNS         3
+#define FLUSH_FRAMES 512
+#define BLOCK_FRAMES 256
+#define DSP_PATH     "audio_flush_bench.dsp"
+
+struct bench_config
+{
+   const char *name;
+   const ks_resampler_t *resampler;
+   bool use_float;
+   bool dsp;
+   bool mixer;
+};
+
+struct bench_state
+{
+   const struct bench_config *config;
+   const ks_resampler_t *resampler;
+   void *resampler_data;
+   ks_dsp_filter_t *dsp;
+   float *input_data;
+   float *output_samples_buf;
+   int16_t *output_samples_conv_buf;
+   double ratio;
+};
+
+static const struct bench_config configs[] = {
+   { "s16 sinc",               &sinc_resampler,    false, false, false },
+   { "float sinc",             &sinc_resampler,    true,  false, false },
+   { "s16 nearest",            &nearest_resampler, false, false, false },
+   { "s16 sinc + dsp",         &sinc_resampler,    false, true,  false },
+   { "s16 sinc + mixer",       &sinc_resampler,    false, false, true  },
+   { "s16 sinc + dsp + mixer", &sinc_resampler,    false, true,  true  },
+};
+
+static const unsigned block_sizes[] = { 32, 64, 128 };
+
+/* A square wave, a sine and a bit of noise, like a chiptune */
+static int16_t *generate_input(size_t frames, double rate)
+{
+   size_t i;
+   int16_t *input = (int16_t*)malloc(frames * 2 * sizeof(int16_t));
+
+   if (!input)
+      return NULL;
+
+   srand(1234);
+   for (i = 0; i < frames; i++)
+   {
+      double t      = i / rate;
+      double square = fmod(t * 220.0, 1.0) < 0.5 ? 0.25 : -0.25;
+      double noise  = (rand() / (double)RAND_MAX - 0.5) * 0.05;
+      input[2 * i + 0] = (int16_t)((square
+               + 0.3 * sin(2.0 * M_PI * 440.0 * t) + noise) * 0x7fff);
+      input[2 * i + 1] = (int16_t)((square
+               + 0.3 * sin(2.0 * M_PI * 660.0 * t) - noise) * 0x7fff);
+   }
+
+   return input;
+}
+
+static int16_t *load_input(const char *path, size_t *frames)
+{
+   long size;
+   int16_t *input = NULL;
+   FILE *file     = fopen(path, "rb");
+
+   if (!file)
+      return NULL;
+
+   fseek(file, 0, SEEK_END);
+   size = ftell(file);
+   fseek(file, 0, SEEK_SET);
+
+   *frames = size > 0 ? (size_t)size / 4 : 0;
+   if (*frames && (input = (int16_t*)malloc(*frames * 4)))
+   {
+      if (fread(input, 4, *frames, file) != *frames)
+      {
+         free(input);
+         input = NULL;
+      }
+   }
+
+   fclose(file);
+   return input;
+}
+
+/* Half a second of a 48 kHz menu sound for the mixer */
+static void *generate_wav(int32_t *size)
+{
+   unsigned i;
+   unsigned frames = 24000;
+   uint32_t data   = frames * 4;
+   uint8_t *wav    = (uint8_t*)malloc(44 + data);
+   int16_t *pcm    = (int16_t*)(wav + 44);
+   static const uint8_t header[44] = {
+      'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+      'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 2, 0,
+      0x80, 0xbb, 0, 0, 0, 0xee, 2, 0, 4, 0, 16, 0,
+      'd', 'a', 't', 'a', 0, 0, 0, 0
+   };
+
+   if (!wav)
+      return NULL;
+
+   memcpy(wav, header, sizeof(header));
+   wav[4]  = (uint8_t)(36 + data);
+   wav[5]  = (uint8_t)((36 + data) >> 8);
+   wav[6]  = (uint8_t)((36 + data) >> 16);
+   wav[40] = (uint8_t)data;
+   wav[41] = (uint8_t)(data >> 8);
+   wav[42] = (uint8_t)(data >> 16);
+
+   for (i = 0; i < frames; i++)
+   {
+      int16_t s      = (int16_t)(0x2000 * sin(2.0 * M_PI * 880.0 * i / OUT_RATE));
+      pcm[2 * i + 0] = s;
+      pcm[2 * i + 1] = s;
+   }
+
+   *size = (int32_t)(44 + data);
+   return wav;
+}
+
+static bool write_dsp_config(void)
+{
+   FILE *file = fopen(DSP_PATH, "w");
+
+   if (!file)
+      return false;
+
+   fprintf(file,
+         "filters = 2\n"
+         "filter0 = iir\n"
+         "filter1 = echo\n"
+         "iir_type = BBOOST\n"
+         "iir_gain = 6.0\n"
+         "echo_delay = \"200\"\n"
+         "echo_feedback = \"0.5\"\n"
+         "echo_amp = 0.2\n");
+   fclose(file);
+   return true;
+}
+
+static void dsp_process(struct bench_state *st, struct resampler_data *src,
+      float *in, size_t frames)
+{
+   struct ks_dsp_data dsp_data;
+
+   src->data_in            = in;
+   src->input_frames       = frames;
+
+   if (!st->dsp)
+      return;
+
+   dsp_data.input          = in;
+   dsp_data.input_frames   = (unsigned)frames;
+   dsp_data.output         = NULL;
+   dsp_data.output_frames  = 0;
+
+   ks_dsp_filter_process(st->dsp, &dsp_data);
+
+   if (dsp_data.output)
+   {
+      src->data_in         = dsp_data.output;
+      src->input_frames    = dsp_data.output_frames;
+   }
+}
+
+/* One pass per stage over the whole flush */
+static size_t flush_passes(struct bench_state *st,
+      const int16_t *data, size_t frames, double ratio)
+{
+   struct resampler_data src_data;
+
+   convert_s16_to_float(st->input_data, data, frames * 2, 1.0f);
+   dsp_process(st, &src_data, st->input_data, frames);
+
+   src_data.data_out      = st->output_samples_buf;
+   src_data.output_frames = 0;
+   src_data.ratio         = ratio;
+
+   st->resampler->process(st->resampler_data, &src_data);
+
+   if (st->config->mixer)
+      audio_mixer_mix(st->output_samples_buf,
+            src_data.output_frames, 0.0f, false);
+
+   if (!st->config->use_float)
+      convert_float_to_s16(st->output_samples_conv_buf,
+            st->output_samples_buf, src_data.output_frames * 2);
+
+   return src_data.output_frames;
+}
+
+/* The same, fused into blocks like audio_driver_flush() */
+static size_t flush_blocks(struct bench_state *st,
+      const int16_t *data, size_t frames, double ratio, size_t block)
+{
+   size_t pos;
+   size_t output_frames = 0;
+
+   for (pos = 0; pos < frames; pos += block)
+   {
+      struct resampler_data src_data;
+      size_t block_frames = MIN(frames - pos, block);
+      float *block_out    = st->output_samples_buf + output_frames * 2;
+
+      convert_s16_to_float(st->input_data, data + pos * 2,
+            block_frames * 2, 1.0f);
+      dsp_process(st, &src_data, st->input_data, block_frames);
+
+      src_data.data_out      = block_out;
+      src_data.output_frames = 0;
+      src_data.ratio         = ratio;
+
+      st->resampler->process(st->resampler_data, &src_data);
+
+      if (st->config->mixer)
+         audio_mixer_mix(block_out, src_data.output_frames, 0.0f, false);
+
+      if (!st->config->use_float)
+         convert_float_to_s16(
+               st->output_samples_conv_buf + output_frames * 2,
+               block_out, src_data.output_frames * 2);
+
+      output_frames         += src_data.output_frames;
+   }
+
+   return output_frames;
+}
+
+/* Runs the whole stream with @block frames per block, or as passes
+ * if @block is 0. Copies what the audio driver would get to @out.
+ * Returns output frames, or 0 on failure. */
+static size_t run(const struct bench_config *config,
+      const int16_t *input, size_t in_frames, double in_rate,
+      audio_mixer_sound_t *sound, size_t block, void *out,
+      uint64_t *ticks)
+{
+   size_t pos;
+   struct bench_state st;
+   unsigned flush             = 0;
+   size_t out_frames          = 0;
+   size_t chunk               = (size_t)(in_rate / FPS);
+   size_t sample_size         = config->use_float
+      ? sizeof(float) : sizeof(int16_t);
+   audio_mixer_voice_t *voice = NULL;
+   resampler_simd_mask_t mask = (resampler_simd_mask_t)cpu_features_get();
+
+   memset(&st, 0, sizeof(st));
+   st.config                  = config;
+   st.resampler               = config->resampler;
+   st.ratio                   = OUT_RATE / in_rate;
+   st.input_data              = (float*)malloc(
+         FLUSH_FRAMES * 2 * sizeof(float));
+   st.output_samples_buf      = (float*)malloc(
+         (FLUSH_FRAMES * 2 + 64) * 2 * sizeof(float));
+   st.output_samples_conv_buf = (int16_t*)malloc(
+         (FLUSH_FRAMES * 2 + 64) * 2 * sizeof(int16_t));
+   st.resampler_data          = st.resampler->init(NULL, st.ratio,
+         RESAMPLER_QUALITY_DONTCARE, mask);
+
+   if (config->dsp)
+      st.dsp                  = ks_dsp_filter_new(DSP_PATH, NULL,
+            (float)in_rate);
+
+   if (     !st.input_data
+         || !st.output_samples_buf
+         || !st.output_samples_conv_buf
+         || !st.resampler_data
+         || (config->dsp && !st.dsp))
+      goto end;
+
+   if (config->mixer)
+      voice = audio_mixer_play(sound, true, 0.5f, NULL);
+
+   *ticks = 0;
+
+   for (pos = 0; pos + chunk <= in_frames; pos += chunk)
+   {
+      size_t offset;
+
+      for (offset = 0; offset < chunk; offset += FLUSH_FRAMES)
+      {
+         size_t frames;
+         ks_perf_tick_t start;
+         const int16_t *data     = input + (pos + offset) * 2;
+         size_t flush_frames     = MIN(chunk - offset, FLUSH_FRAMES);
+         double ratio            = st.ratio * (1.0 + 0.005 * sin(flush * 0.1));
+         const void *output_data = config->use_float
+            ? (const void*)st.output_samples_buf
+            : (const void*)st.output_samples_conv_buf;
+
+         start   = cpu_features_get_perf_counter();
+         if (block)
+            frames = flush_blocks(&st, data, flush_frames, ratio, block);
+         else
+            frames = flush_passes(&st, data, flush_frames, ratio);
+         *ticks += cpu_features_get_perf_counter() - start;
+
+         /* The audio driver's write */
+         memcpy((uint8_t*)out + out_frames * 2 * sample_size,
+               output_data, frames * 2 * sample_size);
+
+         out_frames += frames;
+         flush++;
+      }
+   }
+
+end:
+   if (voice)
+      audio_mixer_stop(voice);
+   if (st.dsp)
+      ks_dsp_filter_free(st.dsp);
+   if (st.resampler_data)
+      st.resampler->free(st.resampler_data);
+   free(st.input_data);
+   free(st.output_samples_buf);
+   free(st.output_samples_conv_buf);
+
+   return out_frames;
+}
+
+/* Best of RUNS, as cycles per output frame */
+static double bench(const struct bench_config *config,
+      const int16_t *input, size_t in_frames, double in_rate,
+      audio_mixer_sound_t *sound, size_t block, void *out,
+      size_t *out_frames)
+{
+   unsigned i;
+   uint64_t best = 0;
+
+   for (i = 0; i < RUNS; i++)
+   {
+      uint64_t ticks = 0;
+
+      if (!(*out_frames = run(config, input, in_frames, in_rate,
+                  sound, block, out, &ticks)))
+         return 0.0;
+      if (!i || ticks < best)
+         best = ticks;
+   }
+
+   return (double)best / *out_frames;
+}
+
+static bool bench_rate(const int16_t *input, size_t in_frames,
+      double in_rate, audio_mixer_sound_t *sound)
+{
+   unsigned c, b;
+   bool ok         = true;
+   size_t out_cap  = (size_t)(in_frames * OUT_RATE / in_rate * 1.1) + 4096;
+   float *passes   = (float*)malloc(out_cap * 2 * sizeof(float));
+   float *blocks   = (float*)malloc(out_cap * 2 * sizeof(float));
+
+   if (!passes || !blocks)
+   {
+      free(passes);
+      free(blocks);
+      return false;
+   }
+
+   for (c = 0; c < sizeof(configs) / sizeof(configs[0]); c++)
+   {
+      const struct bench_config *config = &configs[c];
+      size_t pass_frames  = 0;
+      size_t block_frames = 0;
+      size_t sample_size  = config->use_float
+         ? sizeof(float) : sizeof(int16_t);
+      double pass_cycles  = bench(config, input, in_frames, in_rate,
+            sound, 0, passes, &pass_frames);
+      double block_cycles = bench(config, input, in_frames, in_rate,
+            sound, BLOCK_FRAMES, blocks, &block_frames);
+      bool match          = pass_frames && pass_frames == block_frames
+         && !memcmp(passes, blocks, pass_frames * 2 * sample_size);
+
+      if (!pass_frames || !block_frames)
+      {
+         printf("%-8.0f %-24s failed to initialize\n",
+               in_rate, config->name);
+         ok = false;
+         continue;
+      }
+
+      printf("%-8.0f %-24s %10.2f %10.2f %7.2fx%s\n",
+            in_rate, config->name, pass_cycles, block_cycles,
+            pass_cycles / block_cycles, match ? "" : "  MISMATCH");
+
+      if (!match)
+         ok = false;
+
+      /* Other block sizes for the last configuration */
+      if (c != sizeof(configs) / sizeof(configs[0]) - 1)
+         continue;
+
+      for (b = 0; b < sizeof(block_sizes) / sizeof(block_sizes[0]); b++)
+      {
+         char name[64];
+         double cycles = bench(config, input, in_frames, in_rate,
+               sound, block_sizes[b], blocks, &block_frames);
+
+         match = block_frames == pass_frames
+            && !memcmp(passes, blocks, pass_frames * 2 * sample_size);
+
+         snprintf(name, sizeof(name), "  %u frame blocks", block_sizes[b]);
+         printf("%-8.0f %-24s %10s %10.2f %7.2fx%s\n",
+               in_rate, name, "", cycles, pass_cycles / cycles,
+               match ? "" : "  MISMATCH");
+
+         if (!match)
+            ok = false;
+      }
+   }
+
+   free(passes);
+   free(blocks);
+   return ok;
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned r;
+   int32_t wav_size;
+   bool ok                    = true;
+   void *wav                  = NULL;
+   audio_mixer_sound_t *sound = NULL;
+   static const double rates[] = { 32040.0, 44100.0 };
+
+   convert_s16_to_float_init_simd();
+   convert_float_to_s16_init_simd();
+
+   audio_mixer_init((unsigned)OUT_RATE);
+
+   if (     !write_dsp_config()
+         || !(wav = generate_wav(&wav_size))
+         || !(sound = audio_mixer_load_wav(wav, wav_size)))
+   {
+      fprintf(stderr, "Could not set up the DSP filter or mixer.\n");
+      free(wav);
+      return 1;
+   }
+
+   printf("%-8s %-24s %10s %10s %8s\n",
+         "rate", "config", "passes", "blocks", "speedup");
+   printf("%-8s %-24s %10s %10s\n", "", "", "cyc/frame", "cyc/frame");
+
+   if (argc > 2)
+   {
+      size_t in_frames = 0;
+      double in_rate   = atof(argv[2]);
+      int16_t *input   = load_input(argv[1], &in_frames);
+
+      if (!input || in_rate <= 0.0)
+      {
+         fprintf(stderr, "Could not load %s.\n", argv[1]);
+         ok = false;
+      }
+      else
+         ok = bench_rate(input, in_frames, in_rate, sound);
+      free(input);
+   }
+   else
+   {
+      for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+      {
+         size_t in_frames = (size_t)(rates[r] * SECONDS);
+         int16_t *input   = generate_input(in_frames, rates[r]);
+
+         if (!input || !bench_rate(input, in_frames, rates[r], sound))
+            ok = false;
+         free(input);
+      }
+   }
+
+   audio_mixer_destroy(sound);
+   audio_mixer_done();
+   remove(DSP_PATH);
+
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+/* Copyright  (C) 2010-2020 The KingStation team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (resampler_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Sinc resampler benchmark. Resamples two seconds of stereo audio
+ * in 512 frame batches for every quality preset and a few common
+ * rate pairs, once per SIMD kernel the CPU supports, and reports
+ * ns per output frame. A fixed ratio lets the resampler use its
+ * polyphase bank; the "drift" rows wobble the ratio every batch
+ * like dynamic rate control does, which keeps it interpolating.
+ * Every kernel's output is checked against the plain C kernel.
+ *
+ * Usage: resampler_bench [quality] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <libks.h>
+#include <features/features_cpu.h>
+#include <audio/audio_resampler.h>
+
+#define BATCH_FRAMES 512
+#define SECONDS      2
+#define RUNS         3
+#define MAX_ERROR    1e-4
+
+struct bench_rate
+{
+   const char *name;
+   double in_rate;
+   double out_rate;
+   bool drift;
+};
+
+struct bench_kernel
+{
+   const char *name;
+   resampler_simd_mask_t mask;
+};
+
+static const struct bench_rate rates[] = {
+   { "44100->48000",       44100.0, 48000.0, false },
+   { "44100->48000 drift", 44100.0, 48000.0, true  },
+   { "32040->48000",       32040.0, 48000.0, false },
+   { "48000->44100",       48000.0, 44100.0, false },
+   { "96000->48000",       96000.0, 48000.0, false },
+};
+
+static const struct bench_kernel kernels[] = {
+   { "C",        0 },
+   { "SSE",      RESAMPLER_SIMD_SSE },
+   { "AVX",      RESAMPLER_SIMD_SSE | RESAMPLER_SIMD_AVX },
+   { "AVX2+FMA", RESAMPLER_SIMD_SSE | RESAMPLER_SIMD_AVX
+      | RESAMPLER_SIMD_AVX2 | RESAMPLER_SIMD_FMA3 },
+   { "AVX-512",  RESAMPLER_SIMD_SSE | RESAMPLER_SIMD_AVX
+      | RESAMPLER_SIMD_AVX2 | RESAMPLER_SIMD_FMA3 | RESAMPLER_SIMD_AVX512 },
+   { "NEON",     RESAMPLER_SIMD_NEON },
+};
+
+static const char *quality_names[] = {
+   "dontcare", "lowest", "lower", "normal", "higher", "highest"
+};
+
+static double now_sec(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static float *generate_input(size_t frames, double rate)
+{
+   size_t i;
+   float *input = (float*)malloc(frames * 2 * sizeof(float));
+
+   if (!input)
+      return NULL;
+
+   srand(1234);
+   for (i = 0; i < frames; i++)
+   {
+      double t     = i / rate;
+      float noise  = (rand() / (float)RAND_MAX - 0.5f) * 0.05f;
+      input[2 * i + 0] = 0.4f * sin(2.0 * M_PI * 440.0 * t)
+         + 0.2f * sin(2.0 * M_PI * 7040.0 * t) + noise;
+      input[2 * i + 1] = 0.4f * sin(2.0 * M_PI * 660.0 * t)
+         + 0.2f * sin(2.0 * M_PI * 12345.0 * t) - noise;
+   }
+
+   return input;
+}
+
+/* Returns output frames, or 0 if the resampler could not be created */
+static size_t run(const struct bench_rate *rate,
+      enum resampler_quality quality, resampler_simd_mask_t mask,
+      const float *input, size_t in_frames, float *output,
+      double *secs)
+{
+   size_t pos;
+   double start;
+   unsigned batch        = 0;
+   size_t out_frames     = 0;
+   double ratio          = rate->out_rate / rate->in_rate;
+   void *re              = sinc_resampler.init(NULL, ratio, quality, mask);
+
+   if (!re)
+      return 0;
+
+   start = now_sec();
+
+   for (pos = 0; pos + BATCH_FRAMES <= in_frames; pos += BATCH_FRAMES)
+   {
+      struct resampler_data data;
+
+      data.data_in       = input + pos * 2;
+      data.data_out      = output + out_frames * 2;
+      data.input_frames  = BATCH_FRAMES;
+      data.output_frames = 0;
+      data.ratio         = ratio;
+
+      if (rate->drift)
+         data.ratio     *= 1.0 + 0.005 * sin(batch * 0.1);
+
+      sinc_resampler.process(re, &data);
+      out_frames        += data.output_frames;
+      batch++;
+   }
+
+   *secs = now_sec() - start;
+   sinc_resampler.free(re);
+   return out_frames;
+}
+
+static double max_error(const float *a, const float *b, size_t frames)
+{
+   size_t i;
+   double error = 0.0;
+
+   for (i = 0; i < frames * 2; i++)
+   {
+      double diff = fabs(a[i] - b[i]);
+      if (diff > error)
+         error = diff;
+   }
+
+   return error;
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned q, r, k;
+   bool ok                 = true;
+   unsigned first_quality  = RESAMPLER_QUALITY_LOWEST;
+   unsigned last_quality   = RESAMPLER_QUALITY_HIGHEST;
+   resampler_simd_mask_t cpu = (resampler_simd_mask_t)cpu_features_get();
+
+   if (argc > 1)
+   {
+      for (q = RESAMPLER_QUALITY_LOWEST; q <= RESAMPLER_QUALITY_HIGHEST; q++)
+         if (!strcmp(argv[1], quality_names[q]))
+            first_quality = last_quality = q;
+   }
+
+   printf("%-8s %-20s %-9s %9s %8s %10s\n",
+         "quality", "rates", "kernel", "ns/frame", "speedup", "max error");
+
+   for (q = first_quality; q <= last_quality; q++)
+   {
+      for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+      {
+         const struct bench_rate *rate = &rates[r];
+         size_t in_frames  = (size_t)(rate->in_rate * SECONDS);
+         size_t out_cap    = (size_t)(in_frames
+               * rate->out_rate / rate->in_rate * 1.1) + 1024;
+         float *input      = generate_input(in_frames, rate->in_rate);
+         float *reference  = (float*)calloc(out_cap * 2, sizeof(float));
+         float *output     = (float*)calloc(out_cap * 2, sizeof(float));
+         size_t ref_frames = 0;
+         double ref_ns     = 0.0;
+
+         if (!input || !reference || !output)
+            return 1;
+
+         for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+         {
+            unsigned i;
+            double error;
+            size_t frames  = 0;
+            double best    = 0.0;
+            float *dst     = k ? output : reference;
+
+            if ((cpu & kernels[k].mask) != kernels[k].mask)
+               continue;
+
+            for (i = 0; i < RUNS; i++)
+            {
+               double secs;
+               if (!(frames = run(rate, (enum resampler_quality)q,
+                           kernels[k].mask, input, in_frames, dst, &secs)))
+                  break;
+               if (!i || secs < best)
+                  best = secs;
+            }
+
+            if (!frames)
+            {
+               printf("%-8s %-20s %-9s failed to initialize\n",
+                     quality_names[q], rate->name, kernels[k].name);
+               ok = false;
+               continue;
+            }
+
+            if (!k)
+            {
+               ref_frames = frames;
+               ref_ns     = best * 1e9 / frames;
+            }
+
+            error = k ? max_error(reference, output, frames) : 0.0;
+
+            printf("%-8s %-20s %-9s %9.2f %7.2fx %10.2e%s\n",
+                  quality_names[q], rate->name, kernels[k].name,
+                  best * 1e9 / frames, ref_ns / (best * 1e9 / frames),
+                  error,
+                  (frames != ref_frames || error > MAX_ERROR)
+                  ? "  MISMATCH" : "");
+
+            if (frames != ref_frames || error > MAX_ERROR)
+               ok = false;
+         }
+
+         free(input);
+         free(reference);
+         free(output);
+      }
+   }
+
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,322 @@
+/* Copyright  (C) 2010-2020 The KingStation team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (config_file_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* config_file benchmark. Loads a main config plus a core override
+ * the way the frontend does at startup: parse the main file, append
+ * the override on top, then look up every known setting (most are
+ * present, some are not), and finally update every setting and
+ * write the file back. Lookups go through config_get_array(), and
+ * once more through a walk of the entry list, which is what every
+ * lookup used to cost. Both have to return the same values.
+ *
+ * Without arguments a synthetic KingStation.cfg with the same number
+ * and shape of keys as a full one (about 3000), and a 60 key core
+ * override, are written to the current directory.
+ *
+ * Usage: config_file_bench [KingStation.cfg [override.cfg]] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <boolean.h>
+#include <file/config_file.h>
+#include <string/stdstring.h>
+
+#define RUNS 10
+
+/* Settings the frontend asks for which are not in the file */
+#define MISSING_KEYS 400
+
+static const char *groups[] = {
+   "video", "audio", "input", "menu", "ozone", "xmb", "rgui",
+   "netplay", "cheevos", "playlist", "content", "savestate",
+   "log", "core", "quick_menu", "settings_show", "notification",
+   "network", "bluetooth", "camera", "location", "ai_service",
+   "gfx", "run_ahead", "rewind", "cheat", "overlay", "osk",
+   "assets", "system",
+};
+
+static const char *names[] = {
+   "enable", "driver", "scale", "filter", "shader", "directory",
+   "path", "timeout", "threaded", "show", "hide", "size", "color",
+   "mode", "rate", "latency", "count", "index", "speed", "ratio",
+   "position_x", "position_y", "font_path", "font_size", "opacity",
+   "sort", "compress", "sync", "limit", "entries",
+};
+
+static const char *input_binds[] = {
+   "a", "b", "x", "y", "l", "r", "l2", "r2", "l3", "r3", "start",
+   "select", "up", "down", "left", "right", "l_x_plus", "l_x_minus",
+   "l_y_plus", "l_y_minus", "r_x_plus", "r_x_minus", "r_y_plus",
+   "r_y_minus", "turbo",
+};
+
+static double now_sec(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool write_synthetic(const char *cfg_path, const char *override_path)
+{
+   unsigned g, n, p, b;
+   unsigned count = 0;
+   FILE *file     = fopen(cfg_path, "w");
+
+   if (!file)
+      return false;
+
+   for (g = 0; g < sizeof(groups) / sizeof(groups[0]); g++)
+      for (n = 0; n < sizeof(names) / sizeof(names[0]); n++)
+         fprintf(file, "%s_%s = \"%u\"\n", groups[g], names[n], count++);
+
+   /* Per user bindings make up most of a real config */
+   for (p = 1; p <= 16; p++)
+   {
+      for (b = 0; b < sizeof(input_binds) / sizeof(input_binds[0]); b++)
+      {
+         fprintf(file, "input_player%u_%s = \"nul\"\n", p, input_binds[b]);
+         fprintf(file, "input_player%u_%s_btn = \"%u\"\n", p, input_binds[b], b);
+         fprintf(file, "input_player%u_%s_axis = \"nul\"\n", p, input_binds[b]);
+         fprintf(file, "input_player%u_%s_mbtn = \"nul\"\n", p, input_binds[b]);
+         fprintf(file, "input_player%u_%s_btn_label = \"\"\n", p, input_binds[b]);
+         count += 5;
+      }
+   }
+
+   fclose(file);
+
+   if (!(file = fopen(override_path, "w")))
+      return false;
+
+   for (n = 0; n < 60; n++)
+      fprintf(file, "%s_%s = \"override\"\n",
+            groups[n % 8], names[(n * 7) % (sizeof(names) / sizeof(names[0]))]);
+
+   fclose(file);
+   printf("Wrote %u keys to %s.\n", count, cfg_path);
+   return true;
+}
+
+/* What config_get_entry() used to do */
+static const char *list_walk_get(config_file_t *conf, const char *key)
+{
+   struct config_file_entry entry;
+
+   if (!config_get_entry_list_head(conf, &entry))
+      return NULL;
+
+   do
+   {
+      if (string_is_equal(key, entry.key))
+         return entry.value;
+   } while (config_get_entry_list_next(&entry));
+
+   return NULL;
+}
+
+/* The keys to look up: every key of the main config,
+ * plus some that are not there */
+static char **collect_keys(const char *cfg_path, size_t *count)
+{
+   struct config_file_entry entry;
+   size_t i            = 0;
+   size_t total        = 0;
+   char **keys         = NULL;
+   config_file_t *conf = config_file_new(cfg_path);
+
+   if (!conf)
+      return NULL;
+
+   if (config_get_entry_list_head(conf, &entry))
+   {
+      do
+      {
+         total++;
+      } while (config_get_entry_list_next(&entry));
+   }
+
+   total += MISSING_KEYS;
+   keys   = (char**)calloc(total, sizeof(*keys));
+
+   if (keys && config_get_entry_list_head(conf, &entry))
+   {
+      do
+      {
+         if (entry.key)
+            keys[i++] = strdup(entry.key);
+      } while (config_get_entry_list_next(&entry));
+   }
+
+   for (; keys && i < total; i++)
+   {
+      char buf[64];
+      snprintf(buf, sizeof(buf), "missing_setting_%u", (unsigned)i);
+      keys[i] = strdup(buf);
+   }
+
+   config_file_free(conf);
+   *count = total;
+   return keys;
+}
+
+static config_file_t *load(const char *cfg_path, const char *override_path)
+{
+   config_file_t *conf = config_file_new(cfg_path);
+   if (conf && override_path)
+      config_append_file(conf, override_path);
+   return conf;
+}
+
+int main(int argc, char *argv[])
+{
+   size_t i, count;
+   unsigned run;
+   char buf[256];
+   char **keys                = NULL;
+   const char *cfg_path       = "config_file_bench.cfg";
+   const char *override_path  = "config_file_bench_override.cfg";
+   const char *write_path     = "config_file_bench_out.cfg";
+   double best_parse          = 0.0;
+   double best_index          = 0.0;
+   double best_walk           = 0.0;
+   double best_set            = 0.0;
+   unsigned long sum_index    = 0;
+   unsigned long sum_walk     = 0;
+   bool synthetic             = argc < 2;
+   bool ok                    = true;
+
+   if (!synthetic)
+   {
+      cfg_path      = argv[1];
+      override_path = argc > 2 ? argv[2] : NULL;
+   }
+   else if (!write_synthetic(cfg_path, override_path))
+   {
+      fprintf(stderr, "Could not write %s.\n", cfg_path);
+      return 1;
+   }
+
+   if (!(keys = collect_keys(cfg_path, &count)))
+   {
+      fprintf(stderr, "Could not load %s.\n", cfg_path);
+      return 1;
+   }
+
+   printf("%u lookups per pass\n", (unsigned)count);
+
+   for (run = 0; run < RUNS; run++)
+   {
+      double start, secs;
+      config_file_t *conf;
+
+      /* Parse only */
+      start = now_sec();
+      conf  = load(cfg_path, override_path);
+      secs  = now_sec() - start;
+      config_file_free(conf);
+      if (!run || secs < best_parse)
+         best_parse = secs;
+
+      /* Parse and look up every setting */
+      start = now_sec();
+      conf  = load(cfg_path, override_path);
+      for (i = 0, sum_index = 0; i < count; i++)
+         if (config_get_array(conf, keys[i], buf, sizeof(buf)))
+            sum_index += strlen(buf) + 1;
+      secs  = now_sec() - start;
+      config_file_free(conf);
+      if (!run || secs < best_index)
+         best_index = secs;
+
+      /* The same with a list walk per lookup */
+      start = now_sec();
+      conf  = load(cfg_path, override_path);
+      for (i = 0, sum_walk = 0; i < count; i++)
+      {
+         const char *value = list_walk_get(conf, keys[i]);
+         if (value)
+            sum_walk += strlen(value) + 1;
+      }
+      secs  = now_sec() - start;
+      config_file_free(conf);
+      if (!run || secs < best_walk)
+         best_walk = secs;
+
+      /* Update every setting and write it back */
+      start = now_sec();
+      conf  = load(cfg_path, override_path);
+      for (i = 0; i < count; i++)
+      {
+         snprintf(buf, sizeof(buf), "%u", (unsigned)(i + run));
+         config_set_string(conf, keys[i], buf);
+      }
+      secs  = now_sec() - start;
+
+      /* Everything that was set has to read back. This is
+       * checked before writing, as a sorted write reorders
+       * duplicate keys of the main config and the override */
+      for (i = 0; i < count; i++)
+      {
+         const char *value               = list_walk_get(conf, keys[i]);
+         const struct config_entry_list *e = config_get_entry(conf, keys[i]);
+         snprintf(buf, sizeof(buf), "%u", (unsigned)(i + run));
+         if (!value || !e || e->value != value
+               || !string_is_equal(value, buf))
+            ok = false;
+      }
+
+      start = now_sec();
+      config_file_write(conf, write_path, true);
+      secs += now_sec() - start;
+      if (!run || secs < best_set)
+         best_set = secs;
+      config_file_free(conf);
+   }
+
+   if (sum_index != sum_walk)
+      ok = false;
+
+   printf("%-22s %10s\n", "pass", "ms");
+   printf("%-22s %10.3f\n", "parse", best_parse * 1e3);
+   printf("%-22s %10.3f\n", "parse + get (walk)", best_walk * 1e3);
+   printf("%-22s %10.3f  %.2fx\n", "parse + get (index)", best_index * 1e3,
+         best_walk / best_index);
+   printf("%-22s %10.3f\n", "parse + set + write", best_set * 1e3);
+   printf("%s\n", ok ? "Lookups match." : "MISMATCH");
+
+   remove(write_path);
+   if (synthetic)
+   {
+      remove(cfg_path);
+      remove(override_path);
+   }
+
+   for (i = 0; i < count; i++)
+      free(keys[i]);
+   free(keys);
+
+   return ok ? 0 : 1;
+}
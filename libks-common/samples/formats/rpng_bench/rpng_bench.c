@@ -0,0 +1,329 @@
+/* Copyright  (C) 2010-2020 The KingStation team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (rpng_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* rpng decode benchmark. Decodes a corpus of PNGs with the plain
+ * C unfilter kernels, with the SIMD kernels and with the SIMD
+ * kernels plus the pipelined inflate thread, and reports
+ * milliseconds per pass over the corpus.
+ * Every mode's pixels are checked against the plain C decode.
+ *
+ * Without arguments a fixed set of synthetic box-art images (flat
+ * panels, gradients, text-like stripes and noisy "artwork", RGB
+ * and RGBA, 256x256 up to 1920x1080) is written to the current
+ * directory and used as the corpus.
+ *
+ * Usage: rpng_bench [file.png ...] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <boolean.h>
+#include <formats/rpng.h>
+#include <streams/file_stream.h>
+
+#define RUNS 5
+
+struct bench_image
+{
+   unsigned width;
+   unsigned height;
+   bool alpha;
+};
+
+struct bench_mode
+{
+   const char *name;
+   unsigned flags;
+};
+
+struct bench_decode
+{
+   const void *data;
+   size_t len;
+   uint32_t *pixels;
+   unsigned width;
+   unsigned height;
+   bool ok;
+};
+
+static const struct bench_image synthetic[] = {
+   {  512,  512, false },
+   {  512,  512, true  },
+   {  640,  480, false },
+   {  480,  640, true  },
+   {  256,  256, true  },
+   {  300,  420, false },
+   { 1024,  768, false },
+   { 1920, 1080, true  },
+};
+
+static const struct bench_mode modes[] = {
+   { "C",             RPNG_DECODE_NO_SIMD | RPNG_DECODE_NO_PIPELINE },
+   { "SIMD",          RPNG_DECODE_NO_PIPELINE                       },
+   { "SIMD+pipeline", 0                                             },
+};
+
+static double now_sec(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t lcg(uint32_t *state)
+{
+   *state = *state * 1664525u + 1013904223u;
+   return *state >> 8;
+}
+
+/* Something that compresses and filters roughly like cover
+ * art: a gradient backdrop, a flat title panel with stripes,
+ * a noisy picture area and soft edges on the RGBA ones */
+static uint32_t *generate_image(const struct bench_image *img,
+      unsigned seed)
+{
+   unsigned x, y;
+   uint32_t state = 0x9e3779b9u * (seed + 1);
+   uint32_t *px   = (uint32_t*)malloc(img->width * img->height
+         * sizeof(uint32_t));
+
+   if (!px)
+      return NULL;
+
+   for (y = 0; y < img->height; y++)
+   {
+      unsigned noise = 0;
+
+      for (x = 0; x < img->width; x++)
+      {
+         uint32_t r = 40  + y * 150 / img->height;
+         uint32_t g = 20  + x * 100 / img->width + seed * 8;
+         uint32_t b = 200 - y * 120 / img->height;
+         uint32_t a = 0xff;
+
+         if (     y > img->height / 12 && y < img->height / 4
+               && x > img->width / 10  && x < img->width * 9 / 10)
+         {
+            r = g = b = 0xf0;
+            if (((x + y) / 3) % 7 < 2 && (y / 4) % 3)
+               r = g = b = 0x20;
+         }
+         else if (y > img->height / 3 && y < img->height * 5 / 6
+               && x > img->width / 8  && x < img->width * 7 / 8)
+         {
+            noise = (noise * 3 + (lcg(&state) & 0xff)) / 4;
+            r     = (r + noise) / 2;
+            g     = (g * 3 + noise) / 4;
+            b     = (b + (noise ^ 0x55)) / 2;
+         }
+
+         if (img->alpha)
+         {
+            unsigned dx = x < img->width  - 1 - x ? x : img->width  - 1 - x;
+            unsigned dy = y < img->height - 1 - y ? y : img->height - 1 - y;
+            unsigned d  = dx < dy ? dx : dy;
+            if (d < 16)
+               a = d * 16;
+         }
+
+         px[y * img->width + x] = (a << 24) | ((r & 0xff) << 16)
+            | ((g & 0xff) << 8) | (b & 0xff);
+      }
+   }
+
+   return px;
+}
+
+static bool write_image(const char *path, const struct bench_image *img,
+      unsigned seed)
+{
+   bool ret;
+   uint32_t *px = generate_image(img, seed);
+
+   if (!px)
+      return false;
+
+   if (img->alpha)
+      ret = rpng_save_image_argb(path, px, img->width, img->height,
+            img->width * sizeof(uint32_t));
+   else
+   {
+      /* BGR24 so that the corpus has 3 byte pixels too */
+      unsigned i;
+      uint8_t *bgr = (uint8_t*)malloc(img->width * img->height * 3);
+
+      if (!bgr)
+      {
+         free(px);
+         return false;
+      }
+
+      for (i = 0; i < img->width * img->height; i++)
+      {
+         bgr[i * 3 + 0] = (uint8_t)(px[i] >>  0);
+         bgr[i * 3 + 1] = (uint8_t)(px[i] >>  8);
+         bgr[i * 3 + 2] = (uint8_t)(px[i] >> 16);
+      }
+
+      ret = rpng_save_image_bgr24(path, bgr, img->width, img->height,
+            img->width * 3);
+      free(bgr);
+   }
+
+   free(px);
+   return ret;
+}
+
+static void free_pixels(struct bench_decode *images, size_t count)
+{
+   size_t i;
+
+   for (i = 0; i < count; i++)
+   {
+      free(images[i].pixels);
+      images[i].pixels = NULL;
+   }
+}
+
+static bool same_pixels(const struct bench_decode *a,
+      const struct bench_decode *b)
+{
+   return a->ok && b->ok && a->width == b->width && a->height == b->height
+      && !memcmp(a->pixels, b->pixels,
+            (size_t)a->width * a->height * sizeof(uint32_t));
+}
+
+int main(int argc, char *argv[])
+{
+   size_t i, count;
+   unsigned m;
+   char path[64];
+   struct bench_decode *reference = NULL;
+   struct bench_decode *images    = NULL;
+   double ref_ms                      = 0.0;
+   double megapixels                  = 0.0;
+   bool ok                            = true;
+
+   count     = argc > 1 ? (size_t)(argc - 1)
+      : sizeof(synthetic) / sizeof(synthetic[0]);
+   reference = (struct bench_decode*)calloc(count, sizeof(*reference));
+   images    = (struct bench_decode*)calloc(count, sizeof(*images));
+
+   if (!reference || !images)
+      return 1;
+
+   for (i = 0; i < count; i++)
+   {
+      void *buf   = NULL;
+      int64_t len = 0;
+
+      if (argc > 1)
+         snprintf(path, sizeof(path), "%s", argv[i + 1]);
+      else
+      {
+         snprintf(path, sizeof(path), "rpng_bench_%u.png", (unsigned)i);
+         if (!write_image(path, &synthetic[i], (unsigned)i))
+         {
+            fprintf(stderr, "Could not write %s.\n", path);
+            return 1;
+         }
+      }
+
+      if (!filestream_read_file(argc > 1 ? argv[i + 1] : path, &buf, &len))
+      {
+         fprintf(stderr, "Could not read %s.\n", path);
+         return 1;
+      }
+
+      if (argc == 1)
+         remove(path);
+
+      reference[i].data = buf;
+      reference[i].len  = (size_t)len;
+      images[i].data    = buf;
+      images[i].len     = (size_t)len;
+   }
+
+   /* Reference decode */
+   for (i = 0; i < count; i++)
+   {
+      reference[i].ok = rpng_load_image_argb_buffer(reference[i].data,
+            reference[i].len, &reference[i].pixels, &reference[i].width,
+            &reference[i].height, modes[0].flags);
+      if (reference[i].ok)
+         megapixels += reference[i].width * reference[i].height / 1e6;
+      else
+         fprintf(stderr, "Image %u failed to decode.\n", (unsigned)i);
+   }
+
+   printf("%u images, %.2f megapixels\n",
+         (unsigned)count, megapixels);
+   printf("%-14s %10s %10s %8s\n", "mode", "ms/pass", "MP/s", "speedup");
+
+   for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+   {
+      unsigned run;
+      double best     = 0.0;
+      bool mismatch   = false;
+
+      for (run = 0; run < RUNS; run++)
+      {
+         double secs;
+         double start = now_sec();
+
+         for (i = 0; i < count; i++)
+            images[i].ok = rpng_load_image_argb_buffer(images[i].data,
+                  images[i].len, &images[i].pixels, &images[i].width,
+                  &images[i].height, modes[m].flags);
+
+         secs = now_sec() - start;
+         if (!run || secs < best)
+            best = secs;
+
+         for (i = 0; i < count; i++)
+            if (reference[i].ok && !same_pixels(&reference[i], &images[i]))
+               mismatch = true;
+
+         free_pixels(images, count);
+      }
+
+      if (!m)
+         ref_ms = best * 1e3;
+
+      printf("%-14s %10.2f %10.1f %7.2fx%s\n", modes[m].name, best * 1e3,
+            megapixels / best, ref_ms / (best * 1e3),
+            mismatch ? "  MISMATCH" : "");
+
+      if (mismatch)
+         ok = false;
+   }
+
+   free_pixels(reference, count);
+   for (i = 0; i < count; i++)
+      free((void*)reference[i].data);
+   free(reference);
+   free(images);
+
+   return ok ? 0 : 1;
+}
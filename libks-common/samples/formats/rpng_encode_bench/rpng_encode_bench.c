@@ -0,0 +1,253 @@
+/* Copyright  (C) 2010-2020 The KingStation team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (rpng_encode_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* rpng encode benchmark. Encodes synthetic 1080p and 4K frames,
+ * as BGR24 (what screenshots use) and as ARGB8888, with the plain
+ * C filter kernels on one thread, with the SIMD kernels, with the
+ * SIMD kernels on the thread pool, and with the fast preset on one
+ * thread and on the pool. Reports milliseconds per frame and the
+ * output size. Every file is decoded again and checked against the
+ * source pixels.
+ *
+ * Usage: rpng_encode_bench */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <boolean.h>
+#include <features/features_cpu.h>
+#include <formats/rpng.h>
+#include <streams/file_stream.h>
+
+#define RUNS 3
+
+struct bench_frame
+{
+   const char *name;
+   unsigned width;
+   unsigned height;
+   bool bgr24;
+};
+
+struct bench_mode
+{
+   const char *name;
+   unsigned flags;
+};
+
+static const struct bench_frame frames[] = {
+   { "1080p BGR24", 1920, 1080, true  },
+   { "1080p ARGB",  1920, 1080, false },
+   { "4K BGR24",    3840, 2160, true  },
+   { "4K ARGB",     3840, 2160, false },
+};
+
+static const struct bench_mode modes[] = {
+   { "C",            RPNG_ENCODE_NO_SIMD | RPNG_ENCODE_NO_THREADS },
+   { "SIMD",         RPNG_ENCODE_NO_THREADS                       },
+   { "SIMD+threads", 0                                            },
+   { "fast",         RPNG_ENCODE_FAST | RPNG_ENCODE_NO_THREADS    },
+   { "fast+threads", RPNG_ENCODE_FAST                             },
+};
+
+static double now_sec(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t lcg(uint32_t *state)
+{
+   *state = *state * 1664525u + 1013904223u;
+   return *state >> 8;
+}
+
+/* Something that compresses roughly like an upscaled game
+ * frame: blocky tiles out of a small palette, a gradient sky,
+ * a HUD bar and some dithering noise */
+static uint32_t *generate_frame(const struct bench_frame *frame)
+{
+   unsigned x, y;
+   uint32_t state = 0x2545f491u;
+   unsigned scale = frame->height / 240;
+   uint32_t *px   = (uint32_t*)malloc(frame->width * frame->height
+         * sizeof(uint32_t));
+
+   if (!px)
+      return NULL;
+
+   for (y = 0; y < frame->height; y++)
+   {
+      for (x = 0; x < frame->width; x++)
+      {
+         unsigned tx = x / (16 * scale);
+         unsigned ty = y / (16 * scale);
+         uint32_t r, g, b;
+
+         if (y < frame->height / 3)
+         {
+            r = 60 + y * 80 / frame->height;
+            g = 120 + y * 60 / frame->height;
+            b = 230;
+         }
+         else
+         {
+            uint32_t tile = (tx * 7 + ty * 13 + (tx ^ ty)) % 5;
+            r = 40 + tile * 40;
+            g = 90 + tile * 25;
+            b = 30 + tile * 15;
+            /* Pixel art detail within the tile */
+            if (((x / scale) ^ (y / scale)) % 5 == 0)
+            {
+               r /= 2;
+               g /= 2;
+               b /= 2;
+            }
+         }
+
+         if (y < frame->height / 16)
+            r = g = b = ((x / scale) % 40 < 30) ? 0x10 : 0xe0;
+         else if ((lcg(&state) & 0x3f) == 0)
+            r = g = b = lcg(&state) & 0xff;
+
+         px[y * frame->width + x] = (0xffu << 24) | ((r & 0xff) << 16)
+            | ((g & 0xff) << 8) | (b & 0xff);
+      }
+   }
+
+   return px;
+}
+
+static bool encode(const char *path, const struct bench_frame *frame,
+      const uint32_t *argb, const uint8_t *bgr, unsigned flags)
+{
+   if (frame->bgr24)
+      return rpng_save_image_bgr24_ex(path, bgr, frame->width,
+            frame->height, frame->width * 3, flags);
+   return rpng_save_image_argb_ex(path, argb, frame->width,
+         frame->height, frame->width * sizeof(uint32_t), flags);
+}
+
+/* Decodes 'path' and compares it with the source frame,
+ * returning the file size or 0 on a mismatch */
+static int64_t verify(const char *path, const struct bench_frame *frame,
+      const uint32_t *argb)
+{
+   unsigned width, height;
+   void *buf          = NULL;
+   uint32_t *pixels   = NULL;
+   int64_t len        = 0;
+   bool ok            = false;
+
+   if (!filestream_read_file(path, &buf, &len))
+      return 0;
+
+   if (rpng_load_image_argb_buffer(buf, (size_t)len, &pixels,
+            &width, &height, 0))
+      ok = width == frame->width && height == frame->height
+         && !memcmp(pixels, argb,
+               (size_t)width * height * sizeof(uint32_t));
+
+   free(pixels);
+   free(buf);
+   return ok ? len : 0;
+}
+
+int main(void)
+{
+   unsigned f, m;
+   const char *path = "rpng_encode_bench.png";
+   bool ok          = true;
+
+   printf("%u threads\n", cpu_features_get_core_amount());
+
+   for (f = 0; f < sizeof(frames) / sizeof(frames[0]); f++)
+   {
+      size_t i;
+      double ref_ms  = 0.0;
+      uint8_t *bgr   = NULL;
+      uint32_t *argb = generate_frame(&frames[f]);
+
+      if (!argb)
+         return 1;
+
+      if (frames[f].bgr24)
+      {
+         bgr = (uint8_t*)malloc(frames[f].width * frames[f].height * 3);
+         if (!bgr)
+            return 1;
+         for (i = 0; i < (size_t)frames[f].width * frames[f].height; i++)
+         {
+            bgr[i * 3 + 0] = (uint8_t)(argb[i] >>  0);
+            bgr[i * 3 + 1] = (uint8_t)(argb[i] >>  8);
+            bgr[i * 3 + 2] = (uint8_t)(argb[i] >> 16);
+         }
+      }
+
+      printf("\n%s (%ux%u)\n", frames[f].name,
+            frames[f].width, frames[f].height);
+      printf("%-14s %10s %10s %8s\n", "mode", "ms/frame", "KB", "speedup");
+
+      for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+      {
+         unsigned run;
+         int64_t size = 0;
+         double best  = 0.0;
+         bool failed  = false;
+
+         for (run = 0; run < RUNS; run++)
+         {
+            double secs;
+            double start = now_sec();
+
+            if (!encode(path, &frames[f], argb, bgr, modes[m].flags))
+               failed = true;
+
+            secs = now_sec() - start;
+            if (!run || secs < best)
+               best = secs;
+         }
+
+         if (!failed)
+            size = verify(path, &frames[f], argb);
+         remove(path);
+
+         if (!m)
+            ref_ms = best * 1e3;
+
+         printf("%-14s %10.2f %10.1f %7.2fx%s\n", modes[m].name,
+               best * 1e3, size / 1024.0, ref_ms / (best * 1e3),
+               size ? "" : "  MISMATCH");
+
+         if (!size)
+            ok = false;
+      }
+
+      free(bgr);
+      free(argb);
+   }
+
+   return ok ? 0 : 1;
+}
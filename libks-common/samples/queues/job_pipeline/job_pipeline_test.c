@@ -0,0 +1,270 @@
+/* Copyright  (C) 2010-2020 The KingStation team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (job_pipeline_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Content scan benchmark. Generates a directory of synthetic
+ * ROM files, then CRC32s all of them the way the database
+ * scanner does: sequentially, and through job_pipeline_t with
+ * an increasing number of workers, consuming the results in
+ * order. Reports files/sec and checks that every configuration
+ * produces the same CRCs.
+ *
+ * Usage: job_pipeline_test [directory] [files]
+ * The directory defaults to a new one in /tmp and is removed
+ * afterwards unless it was given on the command line. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <encodings/crc32.h>
+#include <queues/job_pipeline.h>
+
+#define DEFAULT_FILES   1024
+#define MIN_FILE_SIZE   (16 * 1024)
+#define MAX_FILE_SIZE   (256 * 1024)
+#define JOBS_PER_WORKER 4
+
+struct scan_job
+{
+   char path[256];
+   unsigned index;
+   uint32_t crc;
+};
+
+static double now_sec(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t file_get_crc(const char *path)
+{
+   uint8_t buf[64 * 1024];
+   size_t len;
+   uint32_t crc = 0;
+   FILE *fp     = fopen(path, "rb");
+
+   if (!fp)
+      return 0;
+
+   while ((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+      crc = encoding_crc32(crc, buf, len);
+
+   fclose(fp);
+   return crc;
+}
+
+static void scan_handler(void *job, void *userdata)
+{
+   struct scan_job *scan = (struct scan_job*)job;
+   scan->crc             = file_get_crc(scan->path);
+}
+
+static bool generate_files(const char *dir, unsigned count)
+{
+   unsigned i;
+   uint8_t *data = (uint8_t*)malloc(MAX_FILE_SIZE);
+
+   if (!data)
+      return false;
+
+   srand(1234);
+
+   for (i = 0; i < count; i++)
+   {
+      char path[256];
+      size_t j;
+      FILE *fp    = NULL;
+      size_t size = MIN_FILE_SIZE
+         + (size_t)rand() % (MAX_FILE_SIZE - MIN_FILE_SIZE);
+
+      for (j = 0; j < size; j++)
+         data[j] = (uint8_t)rand();
+
+      snprintf(path, sizeof(path), "%s/rom_%05u.bin", dir, i);
+      if (!(fp = fopen(path, "wb")))
+         break;
+      fwrite(data, 1, size, fp);
+      fclose(fp);
+   }
+
+   free(data);
+   return i == count;
+}
+
+static void remove_files(const char *dir, unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i < count; i++)
+   {
+      char path[256];
+      snprintf(path, sizeof(path), "%s/rom_%05u.bin", dir, i);
+      remove(path);
+   }
+   rmdir(dir);
+}
+
+static void scan_sequential(const char *dir, unsigned count, uint32_t *crcs)
+{
+   unsigned i;
+
+   for (i = 0; i < count; i++)
+   {
+      char path[256];
+      snprintf(path, sizeof(path), "%s/rom_%05u.bin", dir, i);
+      crcs[i] = file_get_crc(path);
+   }
+}
+
+static bool scan_pipeline(const char *dir, unsigned count,
+      unsigned workers, uint32_t *crcs)
+{
+   unsigned submitted = 0;
+   unsigned consumed  = 0;
+   job_pipeline_t *pipeline = job_pipeline_new(workers,
+         workers * JOBS_PER_WORKER, scan_handler, NULL);
+
+   if (!pipeline)
+      return false;
+
+   while (consumed < count)
+   {
+      struct scan_job *job = NULL;
+
+      /* Keep the pipeline full, like task_database_pipeline_fill */
+      while (submitted < count)
+      {
+         if (!(job = (struct scan_job*)malloc(sizeof(*job))))
+            break;
+         snprintf(job->path, sizeof(job->path),
+               "%s/rom_%05u.bin", dir, submitted);
+         job->index = submitted;
+         if (!job_pipeline_push(pipeline, job))
+         {
+            free(job);
+            break;
+         }
+         submitted++;
+      }
+
+      if (!(job = (struct scan_job*)job_pipeline_pop(pipeline, true)))
+         break;
+
+      /* Results must come back in submission order */
+      if (job->index != consumed)
+      {
+         free(job);
+         break;
+      }
+
+      crcs[consumed++] = job->crc;
+      free(job);
+   }
+
+   job_pipeline_free(pipeline, free);
+   return consumed == count;
+}
+
+static void report(const char *name, unsigned count, double secs)
+{
+   printf("%-12s %8.1f files/sec  (%.3f s)\n", name, count / secs, secs);
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned workers;
+   char dir[256];
+   double start;
+   bool ok          = true;
+   bool own_dir     = argc < 2;
+   unsigned count   = argc > 2 ? (unsigned)atoi(argv[2]) : DEFAULT_FILES;
+   uint32_t *expect = NULL;
+   uint32_t *crcs   = NULL;
+
+   if (own_dir)
+   {
+      strcpy(dir, "/tmp/job_pipeline_XXXXXX");
+      if (!mkdtemp(dir))
+         return 1;
+   }
+   else
+   {
+      snprintf(dir, sizeof(dir), "%s", argv[1]);
+      mkdir(dir, 0755);
+   }
+
+   expect = (uint32_t*)calloc(count, sizeof(uint32_t));
+   crcs   = (uint32_t*)calloc(count, sizeof(uint32_t));
+
+   if (!count || !expect || !crcs || !generate_files(dir, count))
+   {
+      fprintf(stderr, "Could not generate test files in %s\n", dir);
+      return 1;
+   }
+
+   printf("%u files of %u-%u KB in %s\n", count,
+         MIN_FILE_SIZE / 1024, MAX_FILE_SIZE / 1024, dir);
+
+   /* Warm the page cache so all runs see the same I/O cost */
+   scan_sequential(dir, count, expect);
+
+   start = now_sec();
+   scan_sequential(dir, count, expect);
+   report("sequential", count, now_sec() - start);
+
+   for (workers = 1; workers <= 8; workers *= 2)
+   {
+      char name[32];
+
+      memset(crcs, 0, count * sizeof(uint32_t));
+      snprintf(name, sizeof(name), "%u worker%s", workers,
+            workers > 1 ? "s" : "");
+
+      start = now_sec();
+      if (!scan_pipeline(dir, count, workers, crcs))
+      {
+         printf("%s: results out of order\n", name);
+         ok = false;
+         continue;
+      }
+      report(name, count, now_sec() - start);
+
+      if (memcmp(crcs, expect, count * sizeof(uint32_t)))
+      {
+         printf("%s: CRC mismatch\n", name);
+         ok = false;
+      }
+   }
+
+   if (own_dir)
+      remove_files(dir, count);
+
+   free(expect);
+   free(crcs);
+
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+/* Copyright  (C) 2010-2020 The KingStation team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (spsc_queue_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Pushes timestamped audio-sized batches from one thread to
+ * another, first through fifo_buffer_t guarded by a lock and
+ * condition variable (the pattern the threaded audio drivers
+ * used), then through spsc_queue_t, and reports per-batch
+ * latency and jitter for both. Also checks that every byte
+ * arrives intact and in order. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <rthreads/rthreads.h>
+#include <queues/fifo_queue.h>
+#include <queues/spsc_queue.h>
+
+#define BATCH_SIZE   2048
+#define QUEUE_SIZE   (8 * BATCH_SIZE)
+#define NUM_BATCHES  100000
+
+struct bench
+{
+   fifo_buffer_t *fifo;
+   slock_t *lock;
+   scond_t *cond;
+   spsc_queue_t *spsc;
+   double *latencies;
+   bool corrupt;
+};
+
+static uint64_t now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void fill_batch(uint8_t *batch, unsigned index)
+{
+   unsigned i;
+   uint64_t ts = now_ns();
+
+   memcpy(batch, &ts, sizeof(ts));
+   memcpy(batch + sizeof(ts), &index, sizeof(index));
+   for (i = sizeof(ts) + sizeof(index); i < BATCH_SIZE; i++)
+      batch[i] = (uint8_t)(index + i);
+}
+
+static void check_batch(struct bench *b, const uint8_t *batch,
+      unsigned index)
+{
+   unsigned i, got;
+   uint64_t ts;
+
+   memcpy(&ts, batch, sizeof(ts));
+   memcpy(&got, batch + sizeof(ts), sizeof(got));
+   b->latencies[index] = (now_ns() - ts) / 1000.0;
+
+   if (got != index)
+      b->corrupt = true;
+   for (i = sizeof(ts) + sizeof(index); i < BATCH_SIZE; i++)
+      if (batch[i] != (uint8_t)(index + i))
+         b->corrupt = true;
+}
+
+static void fifo_producer(void *data)
+{
+   unsigned i;
+   uint8_t batch[BATCH_SIZE];
+   struct bench *b = (struct bench*)data;
+
+   for (i = 0; i < NUM_BATCHES; i++)
+   {
+      slock_lock(b->lock);
+      while (FIFO_WRITE_AVAIL(b->fifo) < BATCH_SIZE)
+         scond_wait(b->cond, b->lock);
+      fill_batch(batch, i);
+      fifo_write(b->fifo, batch, BATCH_SIZE);
+      scond_signal(b->cond);
+      slock_unlock(b->lock);
+   }
+}
+
+static void fifo_consumer(struct bench *b)
+{
+   unsigned i;
+   uint8_t batch[BATCH_SIZE];
+
+   for (i = 0; i < NUM_BATCHES; i++)
+   {
+      slock_lock(b->lock);
+      while (FIFO_READ_AVAIL(b->fifo) < BATCH_SIZE)
+         scond_wait(b->cond, b->lock);
+      fifo_read(b->fifo, batch, BATCH_SIZE);
+      scond_signal(b->cond);
+      slock_unlock(b->lock);
+      check_batch(b, batch, i);
+   }
+}
+
+static void spsc_producer(void *data)
+{
+   unsigned i;
+   uint8_t batch[BATCH_SIZE];
+   struct bench *b = (struct bench*)data;
+
+   for (i = 0; i < NUM_BATCHES; i++)
+   {
+      while (spsc_queue_write_avail(b->spsc) < BATCH_SIZE)
+         spsc_queue_wait_write(b->spsc, BATCH_SIZE, -1);
+      fill_batch(batch, i);
+      spsc_queue_write(b->spsc, batch, BATCH_SIZE);
+   }
+}
+
+static void spsc_consumer(struct bench *b)
+{
+   unsigned i;
+   uint8_t batch[BATCH_SIZE];
+
+   for (i = 0; i < NUM_BATCHES; i++)
+   {
+      while (spsc_queue_read_avail(b->spsc) < BATCH_SIZE)
+         spsc_queue_wait_read(b->spsc, BATCH_SIZE, -1);
+      spsc_queue_read(b->spsc, batch, BATCH_SIZE);
+      check_batch(b, batch, i);
+   }
+}
+
+static int compare_double(const void *a, const void *b)
+{
+   double x = *(const double*)a;
+   double y = *(const double*)b;
+   return (x > y) - (x < y);
+}
+
+static void report(const char *name, struct bench *b, double total_us)
+{
+   unsigned i;
+   double mean   = 0.0;
+   double stddev = 0.0;
+
+   for (i = 0; i < NUM_BATCHES; i++)
+      mean += b->latencies[i];
+   mean /= NUM_BATCHES;
+
+   for (i = 0; i < NUM_BATCHES; i++)
+      stddev += (b->latencies[i] - mean) * (b->latencies[i] - mean);
+   stddev = sqrt(stddev / NUM_BATCHES);
+
+   qsort(b->latencies, NUM_BATCHES, sizeof(double), compare_double);
+
+   printf("%-12s %8.2f MB/s  latency us: mean %7.2f  p50 %7.2f  "
+         "p99 %8.2f  max %9.2f  jitter (stddev) %8.2f%s\n",
+         name,
+         (double)NUM_BATCHES * BATCH_SIZE / total_us,
+         mean,
+         b->latencies[NUM_BATCHES / 2],
+         b->latencies[NUM_BATCHES * 99 / 100],
+         b->latencies[NUM_BATCHES - 1],
+         stddev,
+         b->corrupt ? "  CORRUPT" : "");
+}
+
+static bool run(const char *name, struct bench *b,
+      void (*producer)(void*), void (*consumer)(struct bench*))
+{
+   uint64_t start;
+   sthread_t *thread;
+
+   b->corrupt = false;
+   start      = now_ns();
+
+   if (!(thread = sthread_create(producer, b)))
+      return false;
+   consumer(b);
+   sthread_join(thread);
+
+   report(name, b, (now_ns() - start) / 1000.0);
+   return !b->corrupt;
+}
+
+int main(void)
+{
+   bool ok = true;
+   struct bench b;
+
+   memset(&b, 0, sizeof(b));
+   b.fifo      = fifo_new(QUEUE_SIZE);
+   b.lock      = slock_new();
+   b.cond      = scond_new();
+   b.spsc      = spsc_queue_new(QUEUE_SIZE);
+   b.latencies = (double*)malloc(NUM_BATCHES * sizeof(double));
+
+   if (!b.fifo || !b.lock || !b.cond || !b.spsc || !b.latencies)
+      return 1;
+
+   printf("%u batches of %u bytes through a %u byte queue\n",
+         NUM_BATCHES, BATCH_SIZE, QUEUE_SIZE);
+
+   ok &= run("fifo+slock", &b, fifo_producer, fifo_consumer);
+   ok &= run("spsc_queue", &b, spsc_producer, spsc_consumer);
+
+   fifo_free(b.fifo);
+   slock_free(b.lock);
+   scond_free(b.cond);
+   spsc_queue_free(b.spsc);
+   free(b.latencies);
+
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,241 @@
+/* Copyright  (C) 2010-2020 The KingStation team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (task_queue_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Stress test for the threaded task queue. Pushes a mix of long
+ * low priority tasks (think content scans), normal tasks and
+ * short high priority tasks (think savestates) in random order,
+ * some of them scheduled for later, pumps task_queue_check()
+ * like the main loop does and reports push-to-finish latency
+ * per priority. Also checks that every callback runs exactly
+ * once, that no task is ever stepped by two workers at once and
+ * that tasks not flagged 'concurrent' never overlap each other. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <rthreads/rthreads.h>
+#include <features/features_cpu.h>
+#include <queues/task_queue.h>
+
+#define NUM_TASKS    4000
+#define STEP_USEC    50
+
+struct test_task
+{
+   ks_time_t pushed;
+   ks_time_t finished;
+   unsigned steps_left;
+   unsigned callbacks;
+   enum task_priority priority;
+   bool concurrent;
+   volatile int running;
+};
+
+static struct test_task test_tasks[NUM_TASKS];
+static unsigned tasks_done     = 0;
+static bool overlap            = false;
+static bool serial_overlap     = false;
+static volatile int serial_running = 0;
+
+static void sleep_usec(unsigned usec)
+{
+   struct timespec ts;
+   ts.tv_sec  = 0;
+   ts.tv_nsec = usec * 1000;
+   nanosleep(&ts, NULL);
+}
+
+static void test_handler(ks_task_t *task)
+{
+   struct test_task *t = (struct test_task*)task->state;
+
+   if (__sync_fetch_and_add(&t->running, 1) != 0)
+      overlap = true;
+   if (!t->concurrent && __sync_fetch_and_add(&serial_running, 1) != 0)
+      serial_overlap = true;
+
+   /* One step of I/O-ish work per call, like
+    * the real polled task handlers */
+   sleep_usec(STEP_USEC);
+
+   if (!t->concurrent)
+      __sync_fetch_and_sub(&serial_running, 1);
+   __sync_fetch_and_sub(&t->running, 1);
+
+   if (--t->steps_left == 0)
+   {
+      t->finished = cpu_features_get_time_usec();
+      task_set_finished(task, true);
+   }
+}
+
+static void test_callback(ks_task_t *task,
+      void *task_data, void *user_data, const char *error)
+{
+   struct test_task *t = (struct test_task*)task->state;
+   t->callbacks++;
+   tasks_done++;
+}
+
+static int compare_time(const void *a, const void *b)
+{
+   ks_time_t x = *(const ks_time_t*)a;
+   ks_time_t y = *(const ks_time_t*)b;
+   return (x > y) - (x < y);
+}
+
+static void report(enum task_priority priority, const char *name)
+{
+   unsigned i;
+   unsigned count      = 0;
+   double mean         = 0.0;
+   ks_time_t *latency  = (ks_time_t*)malloc(NUM_TASKS * sizeof(ks_time_t));
+
+   if (!latency)
+      return;
+
+   for (i = 0; i < NUM_TASKS; i++)
+   {
+      if (test_tasks[i].priority != priority)
+         continue;
+      latency[count] = test_tasks[i].finished - test_tasks[i].pushed;
+      mean          += latency[count];
+      count++;
+   }
+
+   if (count)
+   {
+      qsort(latency, count, sizeof(ks_time_t), compare_time);
+      printf("%-7s %5u tasks  latency ms: mean %8.2f  p50 %8.2f  "
+            "p99 %8.2f  max %8.2f\n",
+            name, count, mean / count / 1000.0,
+            latency[count / 2] / 1000.0,
+            latency[count * 99 / 100] / 1000.0,
+            latency[count - 1] / 1000.0);
+   }
+
+   free(latency);
+}
+
+int main(void)
+{
+   unsigned i;
+   ks_time_t start;
+   bool ok = true;
+
+   srand(1234);
+   task_queue_init(true, NULL);
+
+   printf("%u mixed tasks, %u us per step, %u cores\n",
+         NUM_TASKS, STEP_USEC, cpu_features_get_core_amount());
+
+   start = cpu_features_get_time_usec();
+
+   for (i = 0; i < NUM_TASKS; i++)
+   {
+      ks_task_t *task     = task_init();
+      struct test_task *t = &test_tasks[i];
+      unsigned kind       = rand() % 100;
+
+      if (kind < 70)
+      {
+         t->priority   = TASK_PRIORITY_LOW;
+         t->steps_left = 20;
+      }
+      else if (kind < 95)
+      {
+         t->priority   = TASK_PRIORITY_NORMAL;
+         t->steps_left = 4;
+      }
+      else
+      {
+         t->priority   = TASK_PRIORITY_HIGH;
+         t->steps_left = 1;
+      }
+
+      /* High priority tasks and some of the others
+       * are safe to run alongside other tasks */
+      t->concurrent  = t->priority == TASK_PRIORITY_HIGH || (rand() % 4) == 0;
+      t->pushed      = cpu_features_get_time_usec();
+
+      task->handler  = test_handler;
+      task->callback = test_callback;
+      task->state    = t;
+      task->priority   = t->priority;
+      task->concurrent = t->concurrent;
+      task->mute       = true;
+
+      /* A few tasks are scheduled to run a little later */
+      if (rand() % 50 == 0)
+      {
+         task->when  = t->pushed + 2000;
+         t->pushed   = task->when;
+      }
+
+      task_queue_push(task);
+
+      /* Keep feeding work while the queue is busy */
+      if ((i % 64) == 0)
+         task_queue_check();
+   }
+
+   while (tasks_done < NUM_TASKS)
+   {
+      task_queue_check();
+      sleep_usec(1000);
+   }
+
+   printf("total %.2f ms\n",
+         (cpu_features_get_time_usec() - start) / 1000.0);
+
+   report(TASK_PRIORITY_HIGH,   "high");
+   report(TASK_PRIORITY_NORMAL, "normal");
+   report(TASK_PRIORITY_LOW,    "low");
+
+   task_queue_deinit();
+
+   for (i = 0; i < NUM_TASKS; i++)
+   {
+      if (test_tasks[i].callbacks != 1)
+      {
+         printf("task %u: callback ran %u times\n",
+               i, test_tasks[i].callbacks);
+         ok = false;
+      }
+   }
+
+   if (overlap)
+   {
+      printf("a task was run by two workers at once\n");
+      ok = false;
+   }
+
+   if (serial_overlap)
+   {
+      printf("two tasks not flagged concurrent ran at once\n");
+      ok = false;
+   }
+
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,314 @@
+/*  KingStation - A frontend for libks.
+ *  Copyright (C) 2010-2020 - The KingStation team
+ *
+ *  KingStation is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  KingStation is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with KingStation.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* record_ffmpeg benchmark. Records N frames of a synthetic 60 fps
+ * source, plus silence, through the ffmpeg record driver as fast
+ * as it takes them. Reports the achieved frame rate, including
+ * finalizing the file, and how long every frame held up the
+ * caller.
+ *
+ * Every source is recorded once:
+ * - copy: XRGB8888 frames the driver has to copy.
+ * - lend: the same frames lent to the driver. Like
+ *   video_driver_frame(), the caller waits for each one to be
+ *   released before it produces the next.
+ * - readback: bottom-up RGBX frames lent to the driver, the way
+ *   asynchronous GPU readbacks are recorded.
+ *
+ * Usage: record_bench [FRAMES [WIDTH HEIGHT [PRESET]]]
+ * PRESET is a record_config_type, the default is medium quality
+ * recording. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include <boolean.h>
+#include <features/features_cpu.h>
+#include <rthreads/rthreads.h>
+
+#include "../../../../KingStation.h"
+#include "../../../../verbosity.h"
+
+#define OUTPUT_PATH   "record_bench.mkv"
+
+/* Pre-rendered frames the source cycles through */
+#define SOURCE_FRAMES 8
+
+#define SOURCE_FPS    60
+#define SAMPLE_RATE   48000
+
+enum bench_source
+{
+   BENCH_SOURCE_COPY = 0,
+   BENCH_SOURCE_LEND,
+   BENCH_SOURCE_READBACK,
+   BENCH_SOURCE_LAST
+};
+
+static const char *source_names[] = { "copy", "lend", "readback" };
+
+struct bench_lender
+{
+   slock_t *lock;
+   scond_t *cond;
+   unsigned lent;
+};
+
+extern const record_driver_t record_ffmpeg;
+
+/* The driver logs through the frontend */
+void KINGSN_LOG(const char *fmt, ...)
+{
+   (void)fmt;
+}
+
+void KINGSN_WARN(const char *fmt, ...)
+{
+   va_list ap;
+   va_start(ap, fmt);
+   vfprintf(stderr, fmt, ap);
+   va_end(ap);
+}
+
+void KINGSN_ERR(const char *fmt, ...)
+{
+   va_list ap;
+   va_start(ap, fmt);
+   vfprintf(stderr, fmt, ap);
+   va_end(ap);
+}
+
+static void bench_release(void *userdata)
+{
+   struct bench_lender *lender = (struct bench_lender*)userdata;
+
+   slock_lock(lender->lock);
+   lender->lent--;
+   scond_signal(lender->cond);
+   slock_unlock(lender->lock);
+}
+
+static void bench_wait(struct bench_lender *lender)
+{
+   slock_lock(lender->lock);
+   while (lender->lent)
+      scond_wait(lender->cond, lender->lock);
+   slock_unlock(lender->lock);
+}
+
+/* A scrolling gradient with a box bouncing over it, so the
+ * encoder has some motion to work on. @rgba swaps R and B and
+ * @bottom_up stores the last row first. */
+static uint32_t *render_frames(unsigned width, unsigned height,
+      bool rgba, bool bottom_up)
+{
+   unsigned f, x, y;
+   uint32_t *frames = (uint32_t*)malloc(
+         (size_t)width * height * sizeof(uint32_t) * SOURCE_FRAMES);
+
+   if (!frames)
+      return NULL;
+
+   for (f = 0; f < SOURCE_FRAMES; f++)
+   {
+      unsigned box_x = (width  / 2) * f / SOURCE_FRAMES;
+      unsigned box_y = (height / 2) * f / SOURCE_FRAMES;
+
+      for (y = 0; y < height; y++)
+      {
+         uint32_t *row = frames + (size_t)width * height * f
+            + (size_t)width * (bottom_up ? height - 1 - y : y);
+
+         for (x = 0; x < width; x++)
+         {
+            uint32_t r = (x * 4 + f * 16) & 0xff;
+            uint32_t g = (y * 4) & 0xff;
+            uint32_t b = ((x + y) * 2) & 0xff;
+
+            if (     x >= box_x && x < box_x + width  / 4
+                  && y >= box_y && y < box_y + height / 4)
+               r = g = b = 0xff;
+
+            row[x] = rgba
+               ? (0xff000000 | (b << 16) | (g << 8) | r)
+               : (0xff000000 | (r << 16) | (g << 8) | b);
+         }
+      }
+   }
+
+   return frames;
+}
+
+static bool run(enum bench_source source, unsigned frames,
+      unsigned width, unsigned height, enum record_config_type preset)
+{
+   unsigned i;
+   struct record_params params;
+   struct bench_lender lender;
+   struct record_audio_data audio;
+   ks_time_t start, total;
+   ks_time_t held_max    = 0;
+   ks_time_t held_sum    = 0;
+   void *handle          = NULL;
+   bool lend             = source != BENCH_SOURCE_COPY;
+   bool readback         = source == BENCH_SOURCE_READBACK;
+   size_t frame_size     = (size_t)width * height;
+   uint32_t *pixels      = render_frames(width, height,
+         readback, readback);
+   int16_t *silence      = (int16_t*)calloc(
+         SAMPLE_RATE / SOURCE_FPS * 2, sizeof(int16_t));
+
+   memset(&params, 0, sizeof(params));
+   params.fps                       = SOURCE_FPS;
+   params.samplerate                = SAMPLE_RATE;
+   params.filename                  = OUTPUT_PATH;
+   params.audio_resampler           = "sinc";
+   params.out_width                 = width;
+   params.out_height                = height;
+   params.fb_width                  = width;
+   params.fb_height                 = height;
+   params.channels                  = 2;
+   params.video_record_scale_factor = 1;
+   params.video_stream_scale_factor = 1;
+   params.aspect_ratio              = (float)width / height;
+   params.preset                    = preset;
+   params.pix_fmt                   = FFEMU_PIX_ARGB8888;
+   params.video_gpu_record          = readback;
+
+   lender.lock           = slock_new();
+   lender.cond           = scond_new();
+   lender.lent           = 0;
+
+   audio.data            = silence;
+   audio.frames          = SAMPLE_RATE / SOURCE_FPS;
+
+   if (     !pixels || !silence || !lender.lock || !lender.cond
+         || !(handle = record_ffmpeg.init(&params)))
+   {
+      fprintf(stderr, "Could not start recording %s.\n",
+            source_names[source]);
+      free(pixels);
+      free(silence);
+      if (lender.lock)
+         slock_free(lender.lock);
+      if (lender.cond)
+         scond_free(lender.cond);
+      return false;
+   }
+
+   start = cpu_features_get_time_usec();
+
+   for (i = 0; i < frames; i++)
+   {
+      struct record_video_data video;
+      ks_time_t held      = cpu_features_get_time_usec();
+      const uint32_t *src = pixels + frame_size * (i % SOURCE_FRAMES);
+
+      video.data          = src;
+      video.release       = NULL;
+      video.userdata      = NULL;
+      video.width         = width;
+      video.height        = height;
+      video.pitch         = (int)(width * sizeof(uint32_t));
+      video.is_dupe       = false;
+      video.rgba          = readback;
+
+      if (readback)
+      {
+         video.data       = src + (size_t)width * (height - 1);
+         video.pitch      = -video.pitch;
+      }
+
+      if (lend)
+      {
+         slock_lock(lender.lock);
+         lender.lent++;
+         slock_unlock(lender.lock);
+
+         video.release    = bench_release;
+         video.userdata   = &lender;
+      }
+
+      record_ffmpeg.push_video(handle, &video);
+      record_ffmpeg.push_audio(handle, &audio);
+
+      if (lend)
+         bench_wait(&lender);
+
+      held                = cpu_features_get_time_usec() - held;
+      held_sum           += held;
+      if (held > held_max)
+         held_max         = held;
+   }
+
+   record_ffmpeg.finalize(handle);
+   total = cpu_features_get_time_usec() - start;
+   record_ffmpeg.free(handle);
+
+   printf("%-10s %10.2f %12.3f %12.3f\n",
+         source_names[source],
+         frames / (total / 1000000.0),
+         held_sum / 1000.0 / frames,
+         held_max / 1000.0);
+
+   remove(OUTPUT_PATH);
+   slock_free(lender.lock);
+   scond_free(lender.cond);
+   free(pixels);
+   free(silence);
+
+   return true;
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned source;
+   unsigned frames               = 600;
+   unsigned width                = 1920;
+   unsigned height               = 1080;
+   enum record_config_type preset =
+      RECORD_CONFIG_TYPE_RECORDING_MED_QUALITY;
+   bool ok                       = true;
+
+   if (argc > 1)
+      frames = (unsigned)strtoul(argv[1], NULL, 0);
+   if (argc > 3)
+   {
+      width  = (unsigned)strtoul(argv[2], NULL, 0);
+      height = (unsigned)strtoul(argv[3], NULL, 0);
+   }
+   if (argc > 4)
+      preset = (enum record_config_type)strtoul(argv[4], NULL, 0);
+
+   if (!frames || !width || !height)
+   {
+      fprintf(stderr, "Usage: %s [FRAMES [WIDTH HEIGHT [PRESET]]]\n",
+            argv[0]);
+      return 1;
+   }
+
+   printf("%u frames at %ux%u, %u cores\n", frames, width, height,
+         cpu_features_get_core_amount());
+   printf("%-10s %10s %12s %12s\n",
+         "source", "fps", "held ms", "max held ms");
+
+   for (source = 0; source < BENCH_SOURCE_LAST; source++)
+      if (!run((enum bench_source)source, frames, width, height, preset))
+         ok = false;
+
+   return ok ? 0 : 1;
+}
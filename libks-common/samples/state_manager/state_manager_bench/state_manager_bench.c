@@ -0,0 +1,320 @@
+/*  KingStation - A frontend for libks.
+ *  Copyright (C) 2010-2020 - The KingStation team
+ *
+ *  KingStation is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  KingStation is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with KingStation.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Rewind state manager benchmark. Generates N synthetic save
+ * states, each one a copy of the previous with a few scattered
+ * runs of bytes changed, the way emulated RAM changes from one
+ * frame to the next, and pushes them through the state manager:
+ * - encode: waits for every push to be encoded before the next
+ *   one, with a budget that holds the whole history, so every
+ *   state gets its own delta. Then pops the history back and
+ *   checks every state comes back unchanged.
+ * - thin: the same, with a budget for about a quarter of the
+ *   deltas the encode pass held, so pushes also pay for merging
+ *   old deltas.
+ * - push: pushes as fast as the caller can, the way the runloop
+ *   does, and reports how long the push held up the caller and
+ *   how many states the encoder kept up with.
+ *
+ * Usage: state_manager_bench [STATES [STATE_KB]] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include <boolean.h>
+#include <features/features_cpu.h>
+
+#include "../../../../state_manager.h"
+#include "../../../../core.h"
+#include "../../../../msg_hash.h"
+#include "../../../../KingStation.h"
+#include "../../../../verbosity.h"
+
+/* Changed runs per state and their maximum length */
+#define BENCH_RUNS        24
+#define BENCH_RUN_MAX     256
+
+enum bench_pass
+{
+   BENCH_PASS_ENCODE = 0,
+   BENCH_PASS_THIN,
+   BENCH_PASS_PUSH,
+   BENCH_PASS_LAST
+};
+
+static const char *pass_names[] = { "encode", "thin", "push" };
+
+/* The state manager's rewind glue calls into the frontend */
+void KINGSN_LOG(const char *fmt, ...)
+{
+   (void)fmt;
+}
+
+void KINGSN_WARN(const char *fmt, ...)
+{
+   va_list ap;
+   va_start(ap, fmt);
+   vfprintf(stderr, fmt, ap);
+   va_end(ap);
+}
+
+void KINGSN_ERR(const char *fmt, ...)
+{
+   va_list ap;
+   va_start(ap, fmt);
+   vfprintf(stderr, fmt, ap);
+   va_end(ap);
+}
+
+const char *msg_hash_to_str(enum msg_hash_enums msg)
+{
+   (void)msg;
+   return "";
+}
+
+bool core_serialize_size(ks_ctx_size_info_t *info)
+{
+   info->size = 0;
+   return false;
+}
+
+bool core_serialize(ks_ctx_serialize_info_t *info)
+{
+   (void)info;
+   return false;
+}
+
+bool core_unserialize(ks_ctx_serialize_info_t *info)
+{
+   (void)info;
+   return false;
+}
+
+bool core_set_rewind_callbacks(void)
+{
+   return true;
+}
+
+bool audio_driver_has_callback(void)
+{
+   return false;
+}
+
+void audio_driver_setup_rewind(void) { }
+void audio_driver_frame_is_reverse(void) { }
+void bsv_movie_frame_rewind(void) { }
+
+static uint32_t bench_rand(uint32_t *seed)
+{
+   uint32_t x = *seed;
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   return *seed = x;
+}
+
+/* State 0 is half zeroes, half noise. Every later state is the
+ * one before it with BENCH_RUNS runs of bytes rewritten, plus a
+ * frame counter at the start. */
+static uint8_t *generate_states(unsigned count, size_t size)
+{
+   unsigned k;
+   size_t i;
+   uint32_t seed  = 0x12345678;
+   uint8_t *states = (uint8_t*)malloc((size_t)count * size);
+
+   if (!states)
+      return NULL;
+
+   for (i = 0; i < size; i++)
+      states[i] = (i / 4096) & 1 ? (uint8_t)bench_rand(&seed) : 0;
+
+   for (k = 1; k < count; k++)
+   {
+      unsigned r;
+      uint8_t *state = states + (size_t)k * size;
+
+      memcpy(state, state - size, size);
+      memcpy(state, &k, sizeof(k));
+
+      for (r = 0; r < BENCH_RUNS; r++)
+      {
+         size_t len   = 1 + bench_rand(&seed) % BENCH_RUN_MAX;
+         size_t start = bench_rand(&seed) % size;
+
+         if (start + len > size)
+            len = size - start;
+         for (i = start; i < start + len; i++)
+            state[i] = (uint8_t)bench_rand(&seed);
+      }
+   }
+
+   return states;
+}
+
+static void push_state(state_manager_t *state,
+      const uint8_t *src, size_t size)
+{
+   void *dst = NULL;
+
+   if (state_manager_push_where(state, &dst))
+   {
+      memcpy(dst, src, size);
+      state_manager_push_do(state);
+   }
+}
+
+/* Pops the whole history and checks it against @states */
+static bool verify(state_manager_t *state, const uint8_t *states,
+      unsigned count, size_t size, ks_time_t *pop_time)
+{
+   unsigned k;
+   const void *data = NULL;
+   ks_time_t start  = cpu_features_get_time_usec();
+
+   /* Popping rewinds the current state in place and hands it
+    * back, so the first pop yields the second newest state */
+   for (k = count - 1; k-- > 0; )
+   {
+      if (     !state_manager_pop(state, &data)
+            || memcmp(data, states + (size_t)k * size, size))
+      {
+         fprintf(stderr, "State %u does not match.\n", k);
+         return false;
+      }
+   }
+
+   *pop_time = cpu_features_get_time_usec() - start;
+
+   if (state_manager_pop(state, &data))
+   {
+      fprintf(stderr, "History holds more states than were pushed.\n");
+      return false;
+   }
+
+   return true;
+}
+
+static bool run(enum bench_pass pass, const uint8_t *states,
+      unsigned count, size_t size, size_t *held_bytes)
+{
+   unsigned k;
+   unsigned entries   = 0;
+   size_t bytes       = 0;
+   bool full          = false;
+   bool ok            = true;
+   ks_time_t total    = 0;
+   ks_time_t held_max = 0;
+   ks_time_t pop_time = 0;
+   /* Every delta is at most a bit larger than the state, on top
+    * of the buffers the manager keeps itself */
+   size_t budget      = ((size_t)count + 8) * size * 2;
+   state_manager_t *state;
+
+   /* The manager's own buffers take up to seven states */
+   if (pass == BENCH_PASS_THIN && *held_bytes > 7 * size)
+      budget          = 7 * size + (*held_bytes - 7 * size) / 4;
+
+   if (!(state = state_manager_new(size, budget)))
+   {
+      fprintf(stderr, "Could not create the state manager.\n");
+      return false;
+   }
+
+   for (k = 0; k < count; k++)
+   {
+      ks_time_t held = cpu_features_get_time_usec();
+
+      push_state(state, states + (size_t)k * size, size);
+
+      /* Waits for the encoder to finish */
+      if (pass != BENCH_PASS_PUSH)
+         state_manager_capacity(state, NULL, NULL, NULL);
+
+      held           = cpu_features_get_time_usec() - held;
+      total         += held;
+      if (held > held_max)
+         held_max    = held;
+   }
+
+   state_manager_capacity(state, &entries, &bytes, &full);
+
+   if (pass == BENCH_PASS_ENCODE)
+   {
+      *held_bytes     = bytes;
+
+      if (full || entries + 1 != count)
+      {
+         fprintf(stderr, "History was thinned out.\n");
+         ok = false;
+      }
+      else
+         ok = verify(state, states, count, size, &pop_time);
+   }
+
+   printf("%-8s %10.3f %10.3f %10.1f %8u %10.1f %10.3f\n",
+         pass_names[pass],
+         total / 1000.0 / count,
+         held_max / 1000.0,
+         total ? (double)count * size / total : 0.0,
+         entries,
+         bytes / 1024.0,
+         pop_time / 1000.0 / (count > 1 ? count - 1 : 1));
+
+   state_manager_free(state);
+   return ok;
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned pass;
+   uint8_t *states;
+   unsigned count    = 240;
+   size_t size       = 256 * 1024;
+   size_t held_bytes = 0;
+   bool ok           = true;
+
+   if (argc > 1)
+      count = (unsigned)strtoul(argv[1], NULL, 0);
+   if (argc > 2)
+      size  = (size_t)strtoul(argv[2], NULL, 0) * 1024;
+
+   if (count < 2 || !size)
+   {
+      fprintf(stderr, "Usage: %s [STATES [STATE_KB]]\n", argv[0]);
+      return 1;
+   }
+
+   if (!(states = generate_states(count, size)))
+   {
+      fprintf(stderr, "Out of memory.\n");
+      return 1;
+   }
+
+   printf("%u states of %u KB, %u cores\n", count,
+         (unsigned)(size / 1024), cpu_features_get_core_amount());
+   printf("%-8s %10s %10s %10s %8s %10s %10s\n",
+         "pass", "push ms", "max ms", "MB/s", "entries",
+         "KB held", "pop ms");
+
+   for (pass = 0; pass < BENCH_PASS_LAST; pass++)
+      if (!run((enum bench_pass)pass, states, count, size, &held_bytes))
+         ok = false;
+
+   free(states);
+   return ok ? 0 : 1;
+}
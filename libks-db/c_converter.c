@@ -36,6 +36,11 @@
 
 #include "libksdb.h"
 
+/* Fields the frontend looks records up by */
+static const char *dat_converter_indexes[] = {
+   "crc", "serial", "name", "developer", "releaseyear"
+};
+
 static void dat_converter_exit(int rc)
 {
    fflush(stdout);
@@ -832,6 +837,22 @@ int main(int argc, char** argv)
 
    filestream_close(rdb_file);
 
+   {
+      unsigned i;
+      libksdb_t *db = libksdb_new();
+
+      if (db && libksdb_open(rdb_path, db) == 0)
+      {
+         /* Fields missing from every entry are skipped */
+         for (i = 0; i < sizeof(dat_converter_indexes)
+               / sizeof(*dat_converter_indexes); i++)
+            libksdb_create_index(db, dat_converter_indexes[i],
+                  dat_converter_indexes[i]);
+         libksdb_close(db);
+      }
+      libksdb_free(db);
+   }
+
    dat_converter_list_free(dat_parser_list);
 
    while (dat_count--)
@@ -20,6 +20,10 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <sys/types.h>
 #ifdef _WIN32
 #include <direct.h>
@@ -31,30 +35,45 @@
 #include <sys/stat.h>
 #include <stdlib.h>
 
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
 #include <streams/file_stream.h>
 #include <ks_endianness.h>
+#include <ks_miscellaneous.h>
 #include <string/stdstring.h>
 #include <compat/strl.h>
 
 #include "libksdb.h"
 #include "rmsgpack_dom.h"
 #include "rmsgpack.h"
-#include "bintree.h"
 #include "query.h"
 #include "libksdb.h"
 
 #define MAGIC_NUMBER "KINGSNDB"
 
-struct node_iter_ctx
-{
-	libksdb_t *db;
-	libksdb_index_t *idx;
-};
+/* Index keys are the fields of an index one after the other, each
+ * cut or padded to the longest value of that field, so that keys
+ * compare with memcmp. Strings are kept short since lookups only
+ * need the key to narrow records down, the query checks the rest. */
+#define LIBKSDB_INDEX_MAX_FIELDS 4
+#define LIBKSDB_INDEX_MAX_FIELD  32
+#define LIBKSDB_INDEX_MAX_WIDTH  64
+#define LIBKSDB_INDEX_MAX_STRING 32
+#define LIBKSDB_INDEX_MAX_KEY    (LIBKSDB_INDEX_MAX_FIELDS * LIBKSDB_INDEX_MAX_WIDTH)
+
+/* Lookups for several values on more than one field are made for
+ * every combination, up to this many */
+#define LIBKSDB_INDEX_MAX_PROBES 256
 
 struct libksdb
 {
 	RFILE *fd;
    char *path;
+   const uint8_t *map; /* Whole file, when it could be memory-mapped */
+   size_t map_size;
 	uint64_t root;
 	uint64_t count;
 	uint64_t first_index_offset;
@@ -65,6 +84,19 @@ struct libksdb_index
 	char name[50];
 	uint64_t key_size;
 	uint64_t next;
+   uint64_t offset;      /* Where the entries start */
+   unsigned field_count; /* 0 if the fields were not recorded */
+   uint8_t widths[LIBKSDB_INDEX_MAX_FIELDS];
+   char fields[LIBKSDB_INDEX_MAX_FIELDS][LIBKSDB_INDEX_MAX_FIELD];
+};
+
+/* Values an index lookup is made for, on one field */
+struct libksdb_index_keys
+{
+   const struct rmsgpack_dom_value * const *values;
+   size_t count;
+   size_t prefix_len;
+   enum libksdb_query_key_type type;
 };
 
 typedef struct libksdb_metadata
@@ -80,9 +112,17 @@ typedef struct libksdb_header
 
 struct libksdb_cursor
 {
-   RFILE *fd;
+   RFILE *fd;                       /* Only when db->map is NULL */
+   const uint8_t *ptr;              /* Read position in db->map */
 	libksdb_query_t *query;
 	libksdb_t *db;
+   struct rmsgpack_dom_arena arena; /* Records decoded from db->map */
+   struct rmsgpack_dom_value item;  /* Record read from fd for a view */
+   uint64_t *offsets;               /* Records found through an index */
+   size_t offsets_count;
+   size_t offsets_cap;
+   size_t offsets_pos;
+   int indexed;                     /* Only visit offsets */
 	int is_valid;
 	int eof;
 };
@@ -180,28 +220,150 @@ clean:
    return rv;
 }
 
-static int libksdb_read_index_header(RFILE *fd, libksdb_index_t *idx)
+static void libksdb_parse_index_fields(libksdb_index_t *idx,
+      const struct rmsgpack_dom_value *fields,
+      const struct rmsgpack_dom_value *widths)
+{
+   unsigned i;
+   uint64_t key_size = 0;
+
+   if (     !fields || fields->type != RDT_ARRAY
+         || !widths || widths->type != RDT_ARRAY
+         || fields->val.array.len != widths->val.array.len
+         || fields->val.array.len == 0
+         || fields->val.array.len > LIBKSDB_INDEX_MAX_FIELDS)
+      return;
+
+   for (i = 0; i < fields->val.array.len; i++)
+   {
+      const struct rmsgpack_dom_value *field = &fields->val.array.items[i];
+      const struct rmsgpack_dom_value *width = &widths->val.array.items[i];
+
+      if (     field->type != RDT_STRING
+            || field->val.string.len >= LIBKSDB_INDEX_MAX_FIELD
+            || (width->type != RDT_UINT && width->type != RDT_INT)
+            || width->val.uint_ == 0
+            || width->val.uint_ > LIBKSDB_INDEX_MAX_WIDTH)
+         return;
+
+      strlcpy(idx->fields[i], field->val.string.buff,
+            sizeof(idx->fields[i]));
+      idx->widths[i] = (uint8_t)width->val.uint_;
+      key_size      += width->val.uint_;
+   }
+
+   /* Lookups need to know where every field is in the key */
+   if (key_size == idx->key_size)
+      idx->field_count = fields->val.array.len;
+}
+
+static int libksdb_parse_index_header(
+      const struct rmsgpack_dom_value *header, libksdb_index_t *idx)
 {
-   uint64_t name_len = 50;
-   return rmsgpack_dom_read_into(fd,
-         "name", idx->name, &name_len,
-         "key_size", &idx->key_size,
-         "next", &idx->next, NULL);
+   unsigned i;
+   const struct rmsgpack_dom_value *fields = NULL;
+   const struct rmsgpack_dom_value *widths = NULL;
+
+   if (header->type != RDT_MAP)
+      return -EINVAL;
+
+   idx->name[0]     = '\0';
+   idx->key_size    = 0;
+   idx->next        = 0;
+   idx->field_count = 0;
+
+   for (i = 0; i < header->val.map.len; i++)
+   {
+      const struct rmsgpack_dom_value *key   =
+         &header->val.map.items[i].key;
+      const struct rmsgpack_dom_value *value =
+         &header->val.map.items[i].value;
+
+      if (key->type != RDT_STRING)
+         continue;
+
+      if (string_is_equal(key->val.string.buff, "name")
+            && value->type == RDT_STRING)
+         strlcpy(idx->name, value->val.string.buff, sizeof(idx->name));
+      else if (string_is_equal(key->val.string.buff, "key_size"))
+         idx->key_size = value->val.uint_;
+      else if (string_is_equal(key->val.string.buff, "next"))
+         idx->next     = value->val.uint_;
+      else if (string_is_equal(key->val.string.buff, "fields"))
+         fields        = value;
+      else if (string_is_equal(key->val.string.buff, "widths"))
+         widths        = value;
+   }
+
+   libksdb_parse_index_fields(idx, fields, widths);
+   return 0;
 }
 
 static void libksdb_write_index_header(RFILE *fd, libksdb_index_t *idx)
 {
-   rmsgpack_write_map_header(fd, 3);
+   unsigned i;
+
+   rmsgpack_write_map_header(fd, idx->field_count ? 5 : 3);
    rmsgpack_write_string(fd, "name", STRLEN_CONST("name"));
    rmsgpack_write_string(fd, idx->name, (uint32_t)strlen(idx->name));
    rmsgpack_write_string(fd, "key_size", (uint32_t)STRLEN_CONST("key_size"));
    rmsgpack_write_uint(fd, idx->key_size);
    rmsgpack_write_string(fd, "next", STRLEN_CONST("next"));
    rmsgpack_write_uint(fd, idx->next);
+
+   if (!idx->field_count)
+      return;
+
+   rmsgpack_write_string(fd, "fields", STRLEN_CONST("fields"));
+   rmsgpack_write_array_header(fd, idx->field_count);
+   for (i = 0; i < idx->field_count; i++)
+      rmsgpack_write_string(fd, idx->fields[i],
+            (uint32_t)strlen(idx->fields[i]));
+
+   rmsgpack_write_string(fd, "widths", STRLEN_CONST("widths"));
+   rmsgpack_write_array_header(fd, idx->field_count);
+   for (i = 0; i < idx->field_count; i++)
+      rmsgpack_write_uint(fd, idx->widths[i]);
+}
+
+static void libksdb_map(libksdb_t *db)
+{
+#ifdef HAVE_MMAP
+   struct stat st;
+   int fd = open(db->path, O_RDONLY);
+
+   if (fd < 0)
+      return;
+
+   if (fstat(fd, &st) == 0 && st.st_size > 0)
+   {
+      void *data = mmap(NULL, (size_t)st.st_size,
+            PROT_READ, MAP_SHARED, fd, 0);
+
+      if (data != MAP_FAILED)
+      {
+         db->map      = (const uint8_t*)data;
+         db->map_size = (size_t)st.st_size;
+      }
+   }
+
+   close(fd);
+#endif
+}
+
+static void libksdb_unmap(libksdb_t *db)
+{
+#ifdef HAVE_MMAP
+   if (db->map)
+      munmap((void*)db->map, db->map_size);
+#endif
+   db->map      = NULL;
+   db->map_size = 0;
 }
 
 void libksdb_close(libksdb_t *db)
 {
+   libksdb_unmap(db);
    if (db->fd)
       filestream_close(db->fd);
    if (!string_is_empty(db->path))
@@ -253,6 +415,10 @@ int libksdb_open(const char *path, libksdb_t *db)
    db->count              = md.count;
    db->first_index_offset = filestream_tell(fd);
    db->fd                 = fd;
+
+   /* Cursors and lookups read straight from the mapping if
+    * there is one, and fall back to the file otherwise */
+   libksdb_map(db);
    return 0;
 
 error:
@@ -261,52 +427,106 @@ error:
    return rv;
 }
 
+static uint64_t libksdb_size(libksdb_t *db)
+{
+   if (db->map)
+      return db->map_size;
+   return (uint64_t)filestream_get_size(db->fd);
+}
+
+/* Reads the header of the index at @offset */
+static int libksdb_read_index_at(libksdb_t *db, uint64_t offset,
+      libksdb_index_t *idx)
+{
+   int rv;
+   uint64_t size;
+   struct rmsgpack_dom_value header;
+
+   if (db->map)
+   {
+      struct rmsgpack_dom_arena arena = {0};
+      const uint8_t *ptr              = db->map + offset;
+
+      rv = rmsgpack_dom_read_buf(&arena, &ptr,
+            db->map + db->map_size, &header);
+      if (rv == 0)
+         rv = libksdb_parse_index_header(&header, idx);
+      idx->offset = (uint64_t)(ptr - db->map);
+
+      rmsgpack_dom_arena_free(&arena);
+   }
+   else
+   {
+      filestream_seek(db->fd, (ssize_t)offset,
+            KS_VFS_SEEK_POSITION_START);
+
+      header.type = RDT_NULL;
+      rv = rmsgpack_dom_read(db->fd, &header);
+      if (rv == 0)
+         rv = libksdb_parse_index_header(&header, idx);
+      idx->offset = filestream_tell(db->fd);
+
+      rmsgpack_dom_value_free(&header);
+   }
+
+   if (rv < 0)
+      return rv;
+
+   size = libksdb_size(db);
+   if (idx->offset > size || idx->next > size - idx->offset)
+      return -EINVAL;
+
+   return 0;
+}
+
 static int libksdb_find_index(libksdb_t *db, const char *index_name,
       libksdb_index_t *idx)
 {
-   ssize_t eof    = filestream_get_size(db->fd);
-   ssize_t offset = filestream_seek(db->fd,
-         (ssize_t)db->first_index_offset,
-         KS_VFS_SEEK_POSITION_START);
+   uint64_t size   = libksdb_size(db);
+   uint64_t offset = db->first_index_offset;
 
-   /* TODO: this should use filestream_eof instead */
-   while (offset < eof)
+   while (offset < size)
    {
-      libksdb_read_index_header(db->fd, idx);
+      if (libksdb_read_index_at(db, offset, idx) < 0)
+         break;
 
       if (strncmp(index_name, idx->name, strlen(idx->name)) == 0)
          return 0;
 
-      filestream_seek(db->fd, (ssize_t)idx->next,
-            KS_VFS_SEEK_POSITION_CURRENT);
-      offset = filestream_tell(db->fd);
+      offset = idx->offset + idx->next;
    }
 
    return -1;
 }
 
+/* Index entries are the key followed by the record offset */
 static int binsearch(const void *buff, const void *item,
-      uint64_t count, uint8_t field_size, uint64_t *offset)
+      uint64_t count, size_t field_size, uint64_t *offset)
 {
-   int mid            = (int)(count / 2);
-   int item_size      = field_size + sizeof(uint64_t);
-   uint64_t *current  = (uint64_t *)buff + (mid * item_size);
-   int rv             = memcmp(current, item, field_size);
+   const uint8_t *base = (const uint8_t*)buff;
+   size_t item_size    = field_size + sizeof(uint64_t);
+   uint64_t low        = 0;
+   uint64_t high       = count;
 
-   if (rv == 0)
+   while (low < high)
    {
-      *offset = *(uint64_t *)(current + field_size);
-      return 0;
-   }
+      uint64_t mid           = low + (high - low) / 2;
+      const uint8_t *current = base + mid * item_size;
+      int rv                 = memcmp(current, item, field_size);
 
-   if (count == 0)
-      return -1;
+      if (rv == 0)
+      {
+         memcpy(offset, current + field_size, sizeof(uint64_t));
+         return 0;
+      }
 
-   if (rv > 0)
-      return binsearch(buff, item, mid, field_size, offset);
+      if (rv > 0)
+         high = mid;
+      else
+         low  = mid + 1;
+   }
 
-   return binsearch(current + item_size, item,
-         count - mid, field_size, offset);
+   return -1;
 }
 
 int libksdb_find_entry(libksdb_t *db, const char *index_name,
@@ -321,15 +541,47 @@ int libksdb_find_entry(libksdb_t *db, const char *index_name,
    if (libksdb_find_index(db, index_name, &idx) < 0)
       return -1;
 
+   if (     idx.key_size > idx.next
+         || db->count > idx.next / (idx.key_size + sizeof(uint64_t)))
+      return -EINVAL;
+
+   /* Search the index in place, without reading it in */
+   if (db->map)
+   {
+      struct rmsgpack_dom_value item;
+      struct rmsgpack_dom_arena arena = {0};
+      const uint8_t *ptr              = NULL;
+
+      if (binsearch(db->map + idx.offset, key, db->count,
+               (size_t)idx.key_size, &offset) < 0)
+         return -1;
+
+      if (offset >= db->map_size)
+         return -EINVAL;
+
+      ptr = db->map + offset;
+      rv  = rmsgpack_dom_read_buf(&arena, &ptr,
+            db->map + db->map_size, &item);
+
+      if (rv == 0)
+         rv = rmsgpack_dom_value_copy(out, &item);
+
+      rmsgpack_dom_arena_free(&arena);
+      return rv;
+   }
+
    bufflen = idx.next;
    buff    = malloc(bufflen);
 
    if (!buff)
       return -ENOMEM;
 
+   filestream_seek(db->fd, (ssize_t)idx.offset,
+         KS_VFS_SEEK_POSITION_START);
+
    while (nread < bufflen)
    {
-      void *buff_ = (uint64_t *)buff + nread;
+      void *buff_ = (uint8_t *)buff + nread;
       rv          = (int)filestream_read(db->fd, buff_, bufflen - nread);
 
       if (rv <= 0)
@@ -340,16 +592,324 @@ int libksdb_find_entry(libksdb_t *db, const char *index_name,
       nread += rv;
    }
 
-   rv = binsearch(buff, key, db->count, (ssize_t)idx.key_size, &offset);
+   rv = binsearch(buff, key, db->count, (size_t)idx.key_size, &offset);
    free(buff);
 
-   if (rv == 0)
-      filestream_seek(db->fd, (ssize_t)offset,
-            KS_VFS_SEEK_POSITION_START);
+   if (rv != 0)
+      return -1;
+
+   filestream_seek(db->fd, (ssize_t)offset,
+         KS_VFS_SEEK_POSITION_START);
 
    return rmsgpack_dom_read(db->fd, out);
 }
 
+/* Writes @value as @width bytes that sort the way the value does.
+ * Strings and binaries are cut or padded with zeros, integers are
+ * stored big endian with the sign bit flipped so that negative
+ * numbers come first and signed and unsigned values are equal
+ * when func_equals considers them equal. */
+static void libksdb_index_encode(const struct rmsgpack_dom_value *value,
+      uint8_t *out, unsigned width)
+{
+   unsigned i;
+   uint64_t bits;
+
+   memset(out, 0, width);
+
+   if (!value)
+      return;
+
+   switch (value->type)
+   {
+      case RDT_STRING:
+         memcpy(out, value->val.string.buff,
+               MIN(value->val.string.len, width));
+         break;
+      case RDT_BINARY:
+         memcpy(out, value->val.binary.buff,
+               MIN(value->val.binary.len, width));
+         break;
+      case RDT_INT:
+      case RDT_UINT:
+         bits = value->val.uint_ ^ (UINT64_C(1) << 63);
+         for (i = 0; i < width && i < sizeof(bits); i++)
+            out[i] = (uint8_t)(bits >> (56 - 8 * i));
+         break;
+      default:
+         break;
+   }
+}
+
+/* Key bytes @value needs in an index */
+static unsigned libksdb_index_width(const struct rmsgpack_dom_value *value)
+{
+   if (!value)
+      return 0;
+
+   switch (value->type)
+   {
+      case RDT_STRING:
+         return MIN(value->val.string.len, LIBKSDB_INDEX_MAX_STRING);
+      case RDT_BINARY:
+         return MIN(value->val.binary.len, LIBKSDB_INDEX_MAX_WIDTH);
+      case RDT_INT:
+      case RDT_UINT:
+         return sizeof(uint64_t);
+      default:
+         break;
+   }
+
+   return 0;
+}
+
+static int libksdb_index_read_entry(libksdb_t *db,
+      const libksdb_index_t *idx, uint64_t i, uint8_t *entry)
+{
+   size_t entry_size = (size_t)idx->key_size + sizeof(uint64_t);
+   uint64_t pos      = idx->offset + i * entry_size;
+
+   if (db->map)
+   {
+      memcpy(entry, db->map + pos, entry_size);
+      return 0;
+   }
+
+   filestream_seek(db->fd, (ssize_t)pos, KS_VFS_SEEK_POSITION_START);
+   if (filestream_read(db->fd, entry, entry_size) != (int64_t)entry_size)
+      return -1;
+   return 0;
+}
+
+static int libksdb_cursor_add_offset(libksdb_cursor_t *cursor,
+      uint64_t offset)
+{
+   if (cursor->offsets_count == cursor->offsets_cap)
+   {
+      size_t cap    = cursor->offsets_cap ? cursor->offsets_cap * 2 : 64;
+      uint64_t *tmp = (uint64_t*)realloc(cursor->offsets,
+            cap * sizeof(*tmp));
+
+      if (!tmp)
+         return -ENOMEM;
+
+      cursor->offsets     = tmp;
+      cursor->offsets_cap = cap;
+   }
+
+   cursor->offsets[cursor->offsets_count++] = offset;
+   return 0;
+}
+
+/* Adds the records whose key starts with something between the
+ * first @len bytes of @lo and @hi to the cursor */
+static int libksdb_index_probe(libksdb_cursor_t *cursor,
+      const libksdb_index_t *idx,
+      const uint8_t *lo, const uint8_t *hi, size_t len)
+{
+   uint8_t entry[LIBKSDB_INDEX_MAX_KEY + sizeof(uint64_t)];
+   libksdb_t *db  = cursor->db;
+   uint64_t count = idx->next / (idx->key_size + sizeof(uint64_t));
+   uint64_t low   = 0;
+   uint64_t high  = count;
+
+   while (low < high)
+   {
+      uint64_t mid = low + (high - low) / 2;
+
+      if (libksdb_index_read_entry(db, idx, mid, entry) < 0)
+         return -1;
+
+      if (memcmp(entry, lo, len) < 0)
+         low  = mid + 1;
+      else
+         high = mid;
+   }
+
+   for (; low < count; low++)
+   {
+      uint64_t offset;
+
+      if (libksdb_index_read_entry(db, idx, low, entry) < 0)
+         return -1;
+
+      if (memcmp(entry, hi, len) > 0)
+         break;
+
+      memcpy(&offset, entry + idx->key_size, sizeof(offset));
+      if (offset >= libksdb_size(db))
+         return -EINVAL;
+
+      if (libksdb_cursor_add_offset(cursor, offset) < 0)
+         return -ENOMEM;
+   }
+
+   return 0;
+}
+
+/* Looks up every combination of @keys for the first @used fields
+ * of @idx, @len bytes of the key being set so far */
+static int libksdb_index_lookup(libksdb_cursor_t *cursor,
+      const libksdb_index_t *idx, const struct libksdb_index_keys *keys,
+      unsigned used, unsigned field, uint8_t *lo, uint8_t *hi, size_t len)
+{
+   size_t i, n;
+   const struct libksdb_index_keys *key = &keys[field];
+   unsigned width                       = idx->widths[field];
+
+   if (field == used)
+      return libksdb_index_probe(cursor, idx, lo, hi, len);
+
+   switch (key->type)
+   {
+      case LIBKSDB_QUERY_KEY_EQUAL:
+         for (i = 0; i < key->count; i++)
+         {
+            int rv;
+
+            libksdb_index_encode(key->values[i], lo + len, width);
+            memcpy(hi + len, lo + len, width);
+
+            if ((rv = libksdb_index_lookup(cursor, idx, keys,
+                        used, field + 1, lo, hi, len + width)) < 0)
+               return rv;
+         }
+         return 0;
+      case LIBKSDB_QUERY_KEY_PREFIX:
+         n = MIN(key->prefix_len, width);
+         memcpy(lo + len, key->values[0]->val.string.buff, n);
+         memcpy(hi + len, key->values[0]->val.string.buff, n);
+         return libksdb_index_probe(cursor, idx, lo, hi, len + n);
+      case LIBKSDB_QUERY_KEY_RANGE:
+         n = MIN(sizeof(uint64_t), width);
+         libksdb_index_encode(key->values[0], lo + len, (unsigned)n);
+         libksdb_index_encode(key->values[1], hi + len, (unsigned)n);
+         return libksdb_index_probe(cursor, idx, lo, hi, len + n);
+   }
+
+   return 0;
+}
+
+/* How many leading fields of an index @keys can look up */
+static unsigned libksdb_index_usable_fields(
+      const struct libksdb_index_keys *keys, unsigned count)
+{
+   unsigned i;
+   size_t probes = 1;
+
+   for (i = 0; i < count; i++)
+   {
+      if (keys[i].type != LIBKSDB_QUERY_KEY_EQUAL)
+         return i + 1;
+
+      probes *= keys[i].count;
+      if (i > 0 && probes > LIBKSDB_INDEX_MAX_PROBES)
+         break;
+   }
+
+   return i;
+}
+
+static int libksdb_compare_offsets(const void *a, const void *b)
+{
+   uint64_t x = *(const uint64_t*)a;
+   uint64_t y = *(const uint64_t*)b;
+   return (x > y) - (x < y);
+}
+
+/* Collects the records an index lookup finds for the cursor to
+ * visit, once each and in the order they are in the database,
+ * which is also the order a scan would return them in */
+static int libksdb_cursor_lookup(libksdb_cursor_t *cursor,
+      const libksdb_index_t *idx, const struct libksdb_index_keys *keys,
+      unsigned used)
+{
+   int rv;
+   size_t i, n;
+   uint8_t lo[LIBKSDB_INDEX_MAX_KEY] = {0};
+   uint8_t hi[LIBKSDB_INDEX_MAX_KEY] = {0};
+
+   cursor->offsets_count = 0;
+   cursor->offsets_pos   = 0;
+
+   if ((rv = libksdb_index_lookup(cursor, idx, keys, used, 0,
+               lo, hi, 0)) < 0)
+      return rv;
+
+   qsort(cursor->offsets, cursor->offsets_count,
+         sizeof(*cursor->offsets), libksdb_compare_offsets);
+
+   for (i = n = 0; i < cursor->offsets_count; i++)
+      if (n == 0 || cursor->offsets[i] != cursor->offsets[n - 1])
+         cursor->offsets[n++] = cursor->offsets[i];
+
+   cursor->offsets_count = n;
+   cursor->indexed       = 1;
+   return 0;
+}
+
+/* The conditions of the cursor's query on the leading fields of
+ * @idx. Returns how many of them an index lookup can use. */
+static unsigned libksdb_cursor_query_keys(libksdb_cursor_t *cursor,
+      const libksdb_index_t *idx,
+      struct libksdb_query_key *query_keys,
+      struct libksdb_index_keys *keys)
+{
+   unsigned i;
+
+   for (i = 0; i < idx->field_count; i++)
+   {
+      if (!libksdb_query_get_key(cursor->query,
+               idx->fields[i], &query_keys[i]))
+         break;
+
+      keys[i].values     = query_keys[i].values;
+      keys[i].count      = query_keys[i].count;
+      keys[i].prefix_len = query_keys[i].prefix_len;
+      keys[i].type       = query_keys[i].type;
+   }
+
+   return libksdb_index_usable_fields(keys, i);
+}
+
+/* Picks the index that covers the most fields of the cursor's
+ * query and looks up the records it finds. Without one, or if the
+ * lookup fails, the cursor scans the whole database. */
+static void libksdb_cursor_plan(libksdb_cursor_t *cursor)
+{
+   libksdb_index_t idx, best;
+   struct libksdb_query_key query_keys[LIBKSDB_INDEX_MAX_FIELDS];
+   struct libksdb_index_keys keys[LIBKSDB_INDEX_MAX_FIELDS];
+   libksdb_t *db      = cursor->db;
+   uint64_t size      = libksdb_size(db);
+   uint64_t offset    = db->first_index_offset;
+   unsigned best_used = 0;
+
+   while (offset < size)
+   {
+      unsigned used;
+
+      if (libksdb_read_index_at(db, offset, &idx) < 0)
+         break;
+
+      offset = idx.offset + idx.next;
+      used   = libksdb_cursor_query_keys(cursor, &idx, query_keys, keys);
+
+      if (used > best_used)
+      {
+         best_used = used;
+         best      = idx;
+      }
+   }
+
+   if (!best_used)
+      return;
+
+   libksdb_cursor_query_keys(cursor, &best, query_keys, keys);
+   if (libksdb_cursor_lookup(cursor, &best, keys, best_used) < 0)
+      cursor->indexed = 0;
+}
+
 /**
  * libksdb_cursor_reset:
  * @cursor              : Handle to database cursor.
@@ -360,12 +920,89 @@ int libksdb_find_entry(libksdb_t *db, const char *index_name,
  **/
 int libksdb_cursor_reset(libksdb_cursor_t *cursor)
 {
-   cursor->eof = 0;
+   cursor->eof         = 0;
+   cursor->offsets_pos = 0;
+
+   if (cursor->db->map)
+   {
+      cursor->ptr = cursor->db->map
+         + cursor->db->root + sizeof(libksdb_header_t);
+      return 0;
+   }
+
    return (int)filestream_seek(cursor->fd,
          (ssize_t)(cursor->db->root + sizeof(libksdb_header_t)),
          KS_VFS_SEEK_POSITION_START);
 }
 
+static uint64_t libksdb_cursor_tell(libksdb_cursor_t *cursor)
+{
+   if (cursor->db->map)
+      return (uint64_t)(cursor->ptr - cursor->db->map);
+   return filestream_tell(cursor->fd);
+}
+
+/**
+ * libksdb_cursor_read_item_view:
+ * @cursor              : Handle to database cursor.
+ * @out                 : Next record matching the cursor's query.
+ *
+ * Like libksdb_cursor_read_item, but @out belongs to the cursor.
+ * It stays valid until the next read or until the cursor is
+ * closed, and must not be freed. On a memory-mapped database the
+ * record is decoded in place without per-record allocations, and
+ * binary values point into the mapping, so they may be unaligned.
+ *
+ * Returns: 0 if successful, EOF at the end, otherwise negative.
+ **/
+int libksdb_cursor_read_item_view(libksdb_cursor_t *cursor,
+      struct rmsgpack_dom_value *out)
+{
+   int rv;
+
+   if (cursor->eof)
+      return EOF;
+
+   if (!cursor->db->map)
+   {
+      rmsgpack_dom_value_free(&cursor->item);
+      cursor->item.type = RDT_NULL;
+
+      if ((rv = libksdb_cursor_read_item(cursor, &cursor->item)) != 0)
+         return rv;
+
+      *out = cursor->item;
+      return 0;
+   }
+
+   do
+   {
+      if (cursor->indexed)
+      {
+         if (cursor->offsets_pos >= cursor->offsets_count)
+         {
+            cursor->eof = 1;
+            return EOF;
+         }
+         cursor->ptr = cursor->db->map
+            + cursor->offsets[cursor->offsets_pos++];
+      }
+
+      rv = rmsgpack_dom_read_buf(&cursor->arena, &cursor->ptr,
+            cursor->db->map + cursor->db->map_size, out);
+      if (rv < 0)
+         return rv;
+
+      if (out->type == RDT_NULL)
+      {
+         cursor->eof = 1;
+         return EOF;
+      }
+   } while (cursor->query && !libksdb_query_filter(cursor->query, out));
+
+   return 0;
+}
+
 int libksdb_cursor_read_item(libksdb_cursor_t *cursor,
       struct rmsgpack_dom_value *out)
 {
@@ -374,7 +1011,29 @@ int libksdb_cursor_read_item(libksdb_cursor_t *cursor,
    if (cursor->eof)
       return EOF;
 
+   if (cursor->db->map)
+   {
+      struct rmsgpack_dom_value item;
+
+      if ((rv = libksdb_cursor_read_item_view(cursor, &item)) != 0)
+         return rv;
+
+      return rmsgpack_dom_value_copy(out, &item);
+   }
+
 retry:
+   if (cursor->indexed)
+   {
+      if (cursor->offsets_pos >= cursor->offsets_count)
+      {
+         cursor->eof = 1;
+         return EOF;
+      }
+      filestream_seek(cursor->fd,
+            (ssize_t)cursor->offsets[cursor->offsets_pos++],
+            KS_VFS_SEEK_POSITION_START);
+   }
+
    rv = rmsgpack_dom_read(cursor->fd, out);
    if (rv < 0)
       return rv;
@@ -414,24 +1073,25 @@ void libksdb_cursor_close(libksdb_cursor_t *cursor)
    if (cursor->query)
       libksdb_query_free(cursor->query);
 
+   rmsgpack_dom_value_free(&cursor->item);
+   rmsgpack_dom_arena_free(&cursor->arena);
+   free(cursor->offsets);
+
+   cursor->offsets       = NULL;
+   cursor->offsets_count = 0;
+   cursor->offsets_cap   = 0;
+   cursor->offsets_pos   = 0;
+   cursor->indexed       = 0;
+   cursor->item.type = RDT_NULL;
    cursor->is_valid = 0;
    cursor->eof      = 1;
+   cursor->ptr      = NULL;
    cursor->fd       = NULL;
    cursor->db       = NULL;
    cursor->query    = NULL;
 }
 
-/**
- * libksdb_cursor_open:
- * @db                  : Handle to database.
- * @cursor              : Handle to database cursor.
- * @q                   : Query to execute.
- *
- * Opens cursor to database based on query @q.
- *
- * Returns: 0 if successful, otherwise negative.
- **/
-int libksdb_cursor_open(libksdb_t *db,
+static int libksdb_cursor_open_scan(libksdb_t *db,
       libksdb_cursor_t *cursor,
       libksdb_query_t *q)
 {
@@ -439,16 +1099,22 @@ int libksdb_cursor_open(libksdb_t *db,
    if (!db || string_is_empty(db->path))
       return -errno;
 
-   fd = filestream_open(db->path,
-         KS_VFS_FILE_ACCESS_READ,
-         KS_VFS_FILE_ACCESS_HINT_NONE);
+   /* Each cursor needs its own file position, but
+    * a mapped database can be shared as it is */
+   if (!db->map)
+   {
+      fd = filestream_open(db->path,
+            KS_VFS_FILE_ACCESS_READ,
+            KS_VFS_FILE_ACCESS_HINT_NONE);
 
-   if (!fd)
-      return -errno;
+      if (!fd)
+         return -errno;
+   }
 
    cursor->fd       = fd;
    cursor->db       = db;
    cursor->is_valid = 1;
+   cursor->indexed  = 0;
    libksdb_cursor_reset(cursor);
    cursor->query    = q;
 
@@ -458,121 +1124,308 @@ int libksdb_cursor_open(libksdb_t *db,
    return 0;
 }
 
-static int node_iter(void *value, void *ctx)
+/**
+ * libksdb_cursor_open:
+ * @db                  : Handle to database.
+ * @cursor              : Handle to database cursor.
+ * @q                   : Query to execute.
+ *
+ * Opens cursor to database based on query @q. If an index covers
+ * fields @q looks for, only the records it finds are read.
+ *
+ * Returns: 0 if successful, otherwise negative.
+ **/
+int libksdb_cursor_open(libksdb_t *db,
+      libksdb_cursor_t *cursor,
+      libksdb_query_t *q)
 {
-   struct node_iter_ctx *nictx = (struct node_iter_ctx*)ctx;
+   int rv;
 
-   if (filestream_write(nictx->db->fd, value,
-            (ssize_t)(nictx->idx->key_size + sizeof(uint64_t))) > 0)
-      return 0;
+   if ((rv = libksdb_cursor_open_scan(db, cursor, q)) != 0)
+      return rv;
 
-   return -1;
+   if (q)
+      libksdb_cursor_plan(cursor);
+
+   return 0;
 }
 
-static uint64_t libksdb_tell(libksdb_t *db)
+/**
+ * libksdb_cursor_open_keys:
+ * @db                  : Handle to database.
+ * @cursor              : Handle to database cursor.
+ * @field               : Field to look up.
+ * @keys                : Values to look for.
+ * @count               : Number of values in @keys.
+ *
+ * Opens a cursor over the records whose @field equals one of
+ * @keys, found through an index on @field. Records are returned
+ * once each, in database order. Long strings are only indexed by
+ * their start, so records that share it with one of @keys come
+ * back as well and callers have to check @field themselves.
+ *
+ * Returns: 0 if successful, otherwise negative, also if there is
+ * no index on @field.
+ **/
+int libksdb_cursor_open_keys(libksdb_t *db,
+      libksdb_cursor_t *cursor, const char *field,
+      const struct rmsgpack_dom_value *keys, size_t count)
 {
-   return filestream_tell(db->fd);
+   int rv;
+   size_t i;
+   libksdb_index_t idx;
+   struct libksdb_index_keys key;
+   const struct rmsgpack_dom_value **values = NULL;
+   uint64_t size                            = libksdb_size(db);
+   uint64_t offset                          = db->first_index_offset;
+
+   for (;;)
+   {
+      if (offset >= size || libksdb_read_index_at(db, offset, &idx) < 0)
+         return -1;
+
+      if (idx.field_count && string_is_equal(idx.fields[0], field))
+         break;
+
+      offset = idx.offset + idx.next;
+   }
+
+   if (!(values = (const struct rmsgpack_dom_value**)
+            malloc(MAX(count, 1) * sizeof(*values))))
+      return -ENOMEM;
+
+   for (i = 0; i < count; i++)
+      values[i] = &keys[i];
+
+   key.values     = values;
+   key.count      = count;
+   key.prefix_len = 0;
+   key.type       = LIBKSDB_QUERY_KEY_EQUAL;
+
+   if ((rv = libksdb_cursor_open_scan(db, cursor, NULL)) == 0)
+   {
+      if ((rv = libksdb_cursor_lookup(cursor, &idx, &key, 1)) < 0)
+         libksdb_cursor_close(cursor);
+   }
+
+   free(values);
+   return rv;
 }
 
-static int node_compare(const void *a, const void *b, void *ctx)
+/* Fills in the fields of @idx from "field" or "field,field,..." */
+static int libksdb_parse_field_list(const char *field_names,
+      libksdb_index_t *idx)
 {
-   return memcmp(a, b, *(uint8_t *)ctx);
+   const char *p = field_names;
+
+   idx->field_count = 0;
+
+   while (*p)
+   {
+      size_t len = strcspn(p, ",");
+
+      if (     len == 0
+            || len >= LIBKSDB_INDEX_MAX_FIELD
+            || idx->field_count == LIBKSDB_INDEX_MAX_FIELDS)
+         return -EINVAL;
+
+      memcpy(idx->fields[idx->field_count], p, len);
+      idx->fields[idx->field_count][len] = '\0';
+      idx->widths[idx->field_count]      = 0;
+      idx->field_count++;
+
+      p += len;
+      if (*p == ',')
+         p++;
+   }
+
+   return idx->field_count ? 0 : -EINVAL;
 }
 
+/* Index entry being sorted, keys are compared first and equal keys
+ * stay in database order */
+struct libksdb_index_sort
+{
+   const uint8_t *entry;
+   uint64_t key_size;
+   uint64_t offset;
+};
+
+static int libksdb_index_sort_compare(const void *a, const void *b)
+{
+   const struct libksdb_index_sort *x = (const struct libksdb_index_sort*)a;
+   const struct libksdb_index_sort *y = (const struct libksdb_index_sort*)b;
+   int rv = memcmp(x->entry, y->entry, (size_t)x->key_size);
+
+   if (rv)
+      return rv;
+   return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+/**
+ * libksdb_create_index:
+ * @db                  : Handle to database.
+ * @name                : Name of the new index.
+ * @field_name          : Field to index, or several separated by
+ *                        commas for a composite index.
+ *
+ * Appends an index to the database file. Values do not need to
+ * be unique, and records without a field are indexed as if it
+ * was empty. Cursors pick indexes by their fields, see
+ * libksdb_cursor_open.
+ *
+ * Returns: 0 if successful, otherwise negative.
+ **/
 int libksdb_create_index(libksdb_t *db,
       const char *name, const char *field_name)
 {
-   struct node_iter_ctx nictx;
-   struct rmsgpack_dom_value key;
+   unsigned i;
+   uint64_t n;
    libksdb_index_t idx;
    struct rmsgpack_dom_value item;
-   libksdb_cursor_t cur          = {0};
-   struct rmsgpack_dom_value *field = NULL;
-   void *buff                       = NULL;
-   uint64_t *buff_u64               = NULL;
-   uint8_t field_size               = 0;
-   uint64_t item_loc                = libksdb_tell(db);
-   bintree_t *tree                  = bintree_new(node_compare, &field_size);
+   struct rmsgpack_dom_value keys[LIBKSDB_INDEX_MAX_FIELDS];
+   libksdb_cursor_t cur              = {0};
+   struct libksdb_index_sort *sorted = NULL;
+   uint8_t *entries                  = NULL;
+   RFILE *fd                         = NULL;
+   uint64_t count                    = 0;
+   size_t key_size                   = 0;
+   size_t entry_size                 = 0;
+   int rv                            = -EINVAL;
+
+   memset(&idx, 0, sizeof(idx));
+   strlcpy(idx.name, name, sizeof(idx.name));
+
+   if (libksdb_parse_field_list(field_name, &idx) < 0)
+      return -EINVAL;
 
-   item.type                        = RDT_NULL;
+   for (i = 0; i < idx.field_count; i++)
+   {
+      keys[i].type            = RDT_STRING;
+      keys[i].val.string.len  = (uint32_t)strlen(idx.fields[i]);
+      keys[i].val.string.buff = idx.fields[i];
+   }
 
-   if (!tree || (libksdb_cursor_open(db, &cur, NULL) != 0))
+   if ((rv = libksdb_cursor_open_scan(db, &cur, NULL)) != 0)
       goto clean;
 
-   key.type            = RDT_STRING;
-   key.val.string.len  = (uint32_t)strlen(field_name);
-   key.val.string.buff = (char *) field_name;   /* We know we aren't going to change it */
-
-   while (libksdb_cursor_read_item(&cur, &item) == 0)
+   /* Make every field as wide as its longest value */
+   while (libksdb_cursor_read_item_view(&cur, &item) == 0)
    {
       /* Only map keys are supported */
       if (item.type != RDT_MAP)
+      {
+         rv = -EINVAL;
          goto clean;
+      }
 
-      field = rmsgpack_dom_value_map_value(&item, &key);
-
-      /* Field not found in item */
-      if (!field)
-         goto clean;
-
-      /* Field is not binary */
-      if (field->type != RDT_BINARY)
-         goto clean;
+      for (i = 0; i < idx.field_count; i++)
+      {
+         unsigned width = libksdb_index_width(
+               rmsgpack_dom_value_map_value(&item, &keys[i]));
+         if (width > idx.widths[i])
+            idx.widths[i] = (uint8_t)width;
+      }
 
-      /* Field is empty */
-      if (field->val.binary.len == 0)
-         goto clean;
+      count++;
+   }
 
-      if (field_size == 0)
-         field_size = field->val.binary.len;
-      /* Field is not of correct size */
-      else if (field->val.binary.len != field_size) 
+   for (i = 0; i < idx.field_count; i++)
+   {
+      /* Field not found in any item */
+      if (!idx.widths[i])
+      {
+         rv = -EINVAL;
          goto clean;
+      }
+      key_size += idx.widths[i];
+   }
 
-      buff = malloc(field_size + sizeof(uint64_t));
-      if (!buff)
-         goto clean;
+   entry_size = key_size + sizeof(uint64_t);
+   entries    = (uint8_t*)malloc(MAX(count, 1) * entry_size);
+   sorted     = (struct libksdb_index_sort*)
+      malloc(MAX(count, 1) * sizeof(*sorted));
 
-      memcpy(buff, field->val.binary.buff, field_size);
+   if (!entries || !sorted)
+   {
+      rv = -ENOMEM;
+      goto clean;
+   }
 
-      buff_u64 = (uint64_t *)buff + field_size;
+   libksdb_cursor_reset(&cur);
 
-      memcpy(buff_u64, &item_loc, sizeof(uint64_t));
+   for (n = 0; n < count; n++)
+   {
+      uint8_t *entry   = entries + n * entry_size;
+      uint64_t item_loc = libksdb_cursor_tell(&cur);
 
-      /* Value is not unique? */
-      if (bintree_insert(tree, buff) != 0)
+      if (libksdb_cursor_read_item_view(&cur, &item) != 0)
       {
-         rmsgpack_dom_value_print(field);
+         rv = -EINVAL;
          goto clean;
       }
-      buff     = NULL;
-      rmsgpack_dom_value_free(&item);
-      item_loc = libksdb_tell(db);
+
+      for (i = 0; i < idx.field_count; i++)
+      {
+         libksdb_index_encode(
+               rmsgpack_dom_value_map_value(&item, &keys[i]),
+               entry, idx.widths[i]);
+         entry += idx.widths[i];
+      }
+      memcpy(entry, &item_loc, sizeof(uint64_t));
+
+      sorted[n].entry    = entries + n * entry_size;
+      sorted[n].key_size = key_size;
+      sorted[n].offset   = item_loc;
    }
 
-   filestream_seek(db->fd, 0, KS_VFS_SEEK_POSITION_END);
+   qsort(sorted, (size_t)count, sizeof(*sorted),
+         libksdb_index_sort_compare);
 
-   strncpy(idx.name, name, 50);
+   /* The database itself is only opened for reading */
+   fd = filestream_open(db->path,
+         KS_VFS_FILE_ACCESS_READ_WRITE | KS_VFS_FILE_ACCESS_UPDATE_EXISTING,
+         KS_VFS_FILE_ACCESS_HINT_NONE);
 
-   idx.name[49] = '\0';
-   idx.key_size = field_size;
-   idx.next     = db->count * (field_size + sizeof(uint64_t));
-   libksdb_write_index_header(db->fd, &idx);
+   if (!fd)
+   {
+      rv = -errno;
+      goto clean;
+   }
+
+   filestream_seek(fd, 0, KS_VFS_SEEK_POSITION_END);
 
-   nictx.db     = db;
-   nictx.idx    = &idx;
-   bintree_iterate(tree, node_iter, &nictx);
+   idx.key_size = key_size;
+   idx.next     = count * entry_size;
+   libksdb_write_index_header(fd, &idx);
+
+   for (n = 0; n < count; n++)
+   {
+      if (filestream_write(fd, sorted[n].entry, entry_size)
+            != (int64_t)entry_size)
+      {
+         rv = -EIO;
+         goto clean;
+      }
+   }
+
+   rv = 0;
 
 clean:
-   rmsgpack_dom_value_free(&item);
-   if (buff)
-      free(buff);
+   if (fd)
+      filestream_close(fd);
    if (cur.is_valid)
       libksdb_cursor_close(&cur);
-   if (tree)
-      bintree_free(tree);
-   free(tree);
-   return 0;
+   free(entries);
+   free(sorted);
+
+   /* The file has grown past the end of the mapping */
+   if (rv == 0 && db->map)
+   {
+      libksdb_unmap(db);
+      libksdb_map(db);
+   }
+   return rv;
 }
 
 libksdb_cursor_t *libksdb_cursor_new(void)
@@ -585,6 +1438,15 @@ libksdb_cursor_t *libksdb_cursor_new(void)
 
    dbc->is_valid            = 0;
    dbc->fd                  = NULL;
+   dbc->ptr                 = NULL;
+   dbc->arena.head          = NULL;
+   dbc->arena.cur           = NULL;
+   dbc->item.type           = RDT_NULL;
+   dbc->offsets             = NULL;
+   dbc->offsets_count       = 0;
+   dbc->offsets_cap         = 0;
+   dbc->offsets_pos         = 0;
+   dbc->indexed             = 0;
    dbc->eof                 = 0;
    dbc->query               = NULL;
    dbc->db                  = NULL;
@@ -608,6 +1470,8 @@ libksdb_t *libksdb_new(void)
       return NULL;
 
    db->fd                 = NULL;
+   db->map                = NULL;
+   db->map_size           = 0;
    db->root               = 0;
    db->count              = 0;
    db->first_index_offset = 0;
@@ -71,7 +71,8 @@ void libksdb_cursor_free(libksdb_cursor_t *dbc);
  * @cursor              : Handle to database cursor.
  * @q                   : Query to execute.
  *
- * Opens cursor to database based on query @q.
+ * Opens cursor to database based on query @q. If an index covers
+ * fields @q looks for, only the records it finds are read.
  *
  * Returns: 0 if successful, otherwise negative.
  **/
@@ -79,6 +80,26 @@ int libksdb_cursor_open(libksdb_t *db,
       libksdb_cursor_t *cursor,
       libksdb_query_t *query);
 
+/**
+ * libksdb_cursor_open_keys:
+ * @db                  : Handle to database.
+ * @cursor              : Handle to database cursor.
+ * @field               : Field to look up.
+ * @keys                : Values to look for.
+ * @count               : Number of values in @keys.
+ *
+ * Opens a cursor over the records whose @field equals one of
+ * @keys, found through an index on @field. Long strings are only
+ * indexed by their start, so callers have to check @field of the
+ * records that come back.
+ *
+ * Returns: 0 if successful, otherwise negative, also if there is
+ * no index on @field.
+ **/
+int libksdb_cursor_open_keys(libksdb_t *db,
+      libksdb_cursor_t *cursor, const char *field,
+      const struct rmsgpack_dom_value *keys, size_t count);
+
 /**
  * libksdb_cursor_reset:
  * @cursor              : Handle to database cursor.
@@ -105,6 +126,9 @@ void libksdb_query_free(void *q);
 int libksdb_cursor_read_item(libksdb_cursor_t *cursor,
       struct rmsgpack_dom_value *out);
 
+int libksdb_cursor_read_item_view(libksdb_cursor_t *cursor,
+      struct rmsgpack_dom_value *out);
+
 KS_END_DECLS
 
 #endif
@@ -0,0 +1,483 @@
+/* Copyright  (C) 2010-2020 The KingStation team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (libksdb_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Database load benchmark. Generates a set of synthetic .rdb
+ * files shaped like the libks databases, then reads every
+ * record of every database the way database_info_list_new and
+ * the explore view do: through rmsgpack_dom_read on the file,
+ * which is what the cursor used to do, and through the cursor's
+ * in-place view of the memory-mapped file. Each is run with
+ * the page cache dropped for the files (cold) and again with
+ * the files cached (warm). Both paths must see the same data.
+ *
+ * Then runs the kinds of queries the frontend makes against the
+ * first database, scanning it, and again after indexing it, and
+ * checks that the indexes find the same records.
+ *
+ * Usage: libksdb_bench [databases] [records per database] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <streams/file_stream.h>
+#include <string/stdstring.h>
+
+#include "libksdb.h"
+#include "rmsgpack_dom.h"
+
+#define DEFAULT_DATABASES 64
+#define DEFAULT_RECORDS   4096
+#define QUERIES           200
+/* sizeof(libksdb_header_t): the magic number padded to 16 bytes
+ * and the metadata offset */
+#define RDB_HEADER_SIZE   24
+
+static const char *genres[] = {
+   "Action", "Platform", "Shooter", "Role playing", "Sports", "Puzzle"
+};
+static const char *developers[] = {
+   "Capcom", "Konami", "Nintendo", "Sega", "Hudson Soft|NEC", "Namco"
+};
+
+/* Indexes made for the query benchmark, name and fields */
+static const char *indexes[][2] = {
+   { "crc",              "crc" },
+   { "serial",           "serial" },
+   { "name",             "name" },
+   { "developer_year",   "developer,releaseyear" },
+   { "releaseyear",      "releaseyear" }
+};
+
+struct generator
+{
+   unsigned db;
+   unsigned next;
+   unsigned count;
+};
+
+static double now_sec(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void set_string(struct rmsgpack_dom_value *v, const char *s)
+{
+   v->type            = RDT_STRING;
+   v->val.string.len  = (uint32_t)strlen(s);
+   v->val.string.buff = strdup(s);
+}
+
+static void set_binary(struct rmsgpack_dom_value *v, uint32_t len,
+      uint32_t seed)
+{
+   uint32_t i;
+   v->type            = RDT_BINARY;
+   v->val.binary.len  = len;
+   v->val.binary.buff = (char*)malloc(len);
+   for (i = 0; i < len; i++)
+      v->val.binary.buff[i] = (char)(seed >> ((i & 3) * 8)) ^ (char)i;
+}
+
+static void set_uint(struct rmsgpack_dom_value *v, uint64_t value)
+{
+   v->type      = RDT_UINT;
+   v->val.uint_ = value;
+}
+
+static int generate_record(void *ctx, struct rmsgpack_dom_value *out)
+{
+   char buf[256];
+   struct generator *gen = (struct generator*)ctx;
+   unsigned n            = gen->next;
+   uint32_t seed         = (gen->db * 2654435761u) ^ (n * 40503u);
+   struct rmsgpack_dom_pair *items;
+
+   if (gen->next >= gen->count)
+      return 1;
+   gen->next++;
+
+   if (!(items = (struct rmsgpack_dom_pair*)calloc(12, sizeof(*items))))
+      return -1;
+
+   out->type         = RDT_MAP;
+   out->val.map.len  = 12;
+   out->val.map.items = items;
+
+   set_string(&items[0].key, "name");
+   snprintf(buf, sizeof(buf), "Game %u-%u (USA) (Rev %u)",
+         gen->db, n, n % 3);
+   set_string(&items[0].value, buf);
+   set_string(&items[1].key, "description");
+   set_string(&items[1].value, buf);
+   set_string(&items[2].key, "rom_name");
+   snprintf(buf, sizeof(buf), "Game %u-%u (USA).bin", gen->db, n);
+   set_string(&items[2].value, buf);
+   set_string(&items[3].key, "genre");
+   set_string(&items[3].value, genres[seed % 6]);
+   set_string(&items[4].key, "developer");
+   set_string(&items[4].value, developers[(seed >> 8) % 6]);
+   set_string(&items[5].key, "publisher");
+   set_string(&items[5].value, developers[(seed >> 12) % 6]);
+   set_string(&items[6].key, "serial");
+   snprintf(buf, sizeof(buf), "SLUS-%05u", seed % 100000);
+   set_string(&items[6].value, buf);
+   set_string(&items[7].key, "releaseyear");
+   set_uint(&items[7].value, 1985 + seed % 30);
+   set_string(&items[8].key, "size");
+   set_uint(&items[8].value, 65536 + seed % 4000000);
+   set_string(&items[9].key, "crc");
+   set_binary(&items[9].value, 4, seed);
+   set_string(&items[10].key, "md5");
+   set_binary(&items[10].value, 16, seed);
+   set_string(&items[11].key, "sha1");
+   set_binary(&items[11].value, 20, seed);
+
+   return 0;
+}
+
+static bool generate_database(const char *path, unsigned db, unsigned count)
+{
+   int rv;
+   struct generator gen;
+   RFILE *fd = filestream_open(path, KS_VFS_FILE_ACCESS_WRITE,
+         KS_VFS_FILE_ACCESS_HINT_NONE);
+
+   if (!fd)
+      return false;
+
+   gen.db    = db;
+   gen.next  = 0;
+   gen.count = count;
+   rv        = libksdb_create(fd, generate_record, &gen);
+   filestream_close(fd);
+   return rv >= 0;
+}
+
+/* Folds every field of a record into a checksum */
+static uint64_t hash_value(uint64_t h, const struct rmsgpack_dom_value *v)
+{
+   unsigned i;
+
+   h = (h ^ v->type) * 1099511628211ull;
+
+   switch (v->type)
+   {
+      case RDT_STRING:
+      case RDT_BINARY:
+         for (i = 0; i < v->val.string.len; i++)
+            h = (h ^ (uint8_t)v->val.string.buff[i]) * 1099511628211ull;
+         break;
+      case RDT_MAP:
+         for (i = 0; i < v->val.map.len; i++)
+         {
+            h = hash_value(h, &v->val.map.items[i].key);
+            h = hash_value(h, &v->val.map.items[i].value);
+         }
+         break;
+      case RDT_ARRAY:
+         for (i = 0; i < v->val.array.len; i++)
+            h = hash_value(h, &v->val.array.items[i]);
+         break;
+      default:
+         h = (h ^ v->val.uint_) * 1099511628211ull;
+         break;
+   }
+
+   return h;
+}
+
+/* The old cursor: rmsgpack_dom_read from the file, one heap
+ * allocated tree per record */
+static uint64_t load_file(const char *path, unsigned *records)
+{
+   struct rmsgpack_dom_value item;
+   uint64_t h = 14695981039346656037ull;
+   RFILE *fd  = filestream_open(path, KS_VFS_FILE_ACCESS_READ,
+         KS_VFS_FILE_ACCESS_HINT_NONE);
+
+   if (!fd)
+      return 0;
+
+   /* Skip the header, like libksdb_cursor_reset */
+   filestream_seek(fd, RDB_HEADER_SIZE, KS_VFS_SEEK_POSITION_START);
+
+   while (rmsgpack_dom_read(fd, &item) >= 0 && item.type != RDT_NULL)
+   {
+      h = hash_value(h, &item);
+      rmsgpack_dom_value_free(&item);
+      (*records)++;
+   }
+
+   filestream_close(fd);
+   return h;
+}
+
+static uint64_t load_view(const char *path, unsigned *records)
+{
+   struct rmsgpack_dom_value item;
+   uint64_t h            = 14695981039346656037ull;
+   libksdb_t *db         = libksdb_new();
+   libksdb_cursor_t *cur = libksdb_cursor_new();
+
+   if (db && cur && libksdb_open(path, db) == 0)
+   {
+      if (libksdb_cursor_open(db, cur, NULL) == 0)
+      {
+         while (libksdb_cursor_read_item_view(cur, &item) == 0)
+         {
+            h = hash_value(h, &item);
+            (*records)++;
+         }
+         libksdb_cursor_close(cur);
+      }
+      libksdb_close(db);
+   }
+
+   libksdb_cursor_free(cur);
+   libksdb_free(db);
+   return h;
+}
+
+static void drop_cache(const char *path)
+{
+   int fd = open(path, O_RDONLY);
+   if (fd < 0)
+      return;
+   posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+   close(fd);
+}
+
+static uint32_t record_seed(unsigned db, unsigned n)
+{
+   return (db * 2654435761u) ^ (n * 40503u);
+}
+
+/* Writes the query for kind @kind that finds record @n of database 0 */
+static void build_query(char *s, size_t len, unsigned kind, unsigned n,
+      unsigned records)
+{
+   uint32_t seed  = record_seed(0, n);
+   uint32_t other = record_seed(0, (n * 7 + 1) % records);
+
+   switch (kind)
+   {
+      case 0:
+         snprintf(s, len, "{crc: b\"%02X%02X%02X%02X\"}",
+               (uint8_t)seed, (uint8_t)(seed >> 8) ^ 1,
+               (uint8_t)(seed >> 16) ^ 2, (uint8_t)(seed >> 24) ^ 3);
+         break;
+      case 1:
+         snprintf(s, len, "{crc: or(b\"%02X%02X%02X%02X\", "
+               "b\"%02X%02X%02X%02X\")}",
+               (uint8_t)seed, (uint8_t)(seed >> 8) ^ 1,
+               (uint8_t)(seed >> 16) ^ 2, (uint8_t)(seed >> 24) ^ 3,
+               (uint8_t)other, (uint8_t)(other >> 8) ^ 1,
+               (uint8_t)(other >> 16) ^ 2, (uint8_t)(other >> 24) ^ 3);
+         break;
+      case 2:
+         snprintf(s, len, "{name: \"Game 0-%u (USA) (Rev %u)\"}",
+               n, n % 3);
+         break;
+      case 3:
+         snprintf(s, len, "{name: glob('Game 0-%u*')}", n);
+         break;
+      case 4:
+         snprintf(s, len, "{serial: \"SLUS-%05u\"}", seed % 100000);
+         break;
+      case 5:
+         snprintf(s, len, "{developer: \"%s\", releaseyear: %u}",
+               developers[(seed >> 8) % 6], 1985 + seed % 30);
+         break;
+      default:
+         snprintf(s, len, "{releaseyear: between(%u, %u)}",
+               1985 + seed % 30, 1985 + seed % 30 + 1);
+         break;
+   }
+}
+
+static const char *query_kinds[] = {
+   "crc", "crc or", "name", "name prefix", "serial",
+   "developer+year", "year range"
+};
+
+/* Runs QUERIES queries of every kind, returns a checksum of what
+ * each kind found */
+static void run_queries(const char *path, unsigned records,
+      const char *name, uint64_t *hashes)
+{
+   unsigned kind, i;
+   libksdb_t *db = libksdb_new();
+
+   if (!db || libksdb_open(path, db) != 0)
+   {
+      libksdb_free(db);
+      return;
+   }
+
+   for (kind = 0; kind < sizeof(query_kinds) / sizeof(*query_kinds); kind++)
+   {
+      unsigned found = 0;
+      uint64_t h     = 14695981039346656037ull;
+      double start   = now_sec();
+
+      for (i = 0; i < QUERIES; i++)
+      {
+         char query[256];
+         struct rmsgpack_dom_value item;
+         const char *error     = NULL;
+         libksdb_query_t *q    = NULL;
+         libksdb_cursor_t *cur = libksdb_cursor_new();
+
+         build_query(query, sizeof(query), kind,
+               (i * 2654435761u) % records, records);
+         q = (libksdb_query_t*)libksdb_query_compile(db, query,
+               strlen(query), &error);
+
+         if (q && libksdb_cursor_open(db, cur, q) == 0)
+         {
+            while (libksdb_cursor_read_item_view(cur, &item) == 0)
+            {
+               h = hash_value(h, &item);
+               found++;
+            }
+            libksdb_cursor_close(cur);
+         }
+         else
+            printf("query failed: %s %s\n", query, error ? error : "");
+
+         if (q)
+            libksdb_query_free(q);
+         libksdb_cursor_free(cur);
+      }
+
+      hashes[kind] = h ^ found;
+      printf("%-8s %-15s %9.3f ms/query  %8.1f matches/query\n",
+            name, query_kinds[kind],
+            (now_sec() - start) * 1000.0 / QUERIES,
+            (double)found / QUERIES);
+   }
+
+   libksdb_close(db);
+   libksdb_free(db);
+}
+
+static uint64_t run(const char *name, char paths[][256], unsigned count,
+      uint64_t (*load)(const char*, unsigned*), bool cold)
+{
+   unsigned i;
+   double start;
+   unsigned records = 0;
+   uint64_t h       = 0;
+
+   if (cold)
+      for (i = 0; i < count; i++)
+         drop_cache(paths[i]);
+
+   start = now_sec();
+   for (i = 0; i < count; i++)
+      h ^= load(paths[i], &records) + i;
+
+   printf("%-14s %-5s %9.2f ms  %10.0f records/sec\n", name,
+         cold ? "cold" : "warm", (now_sec() - start) * 1000.0,
+         records / (now_sec() - start));
+   return h;
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned i;
+   char dir[256];
+   char (*paths)[256];
+   bool ok            = true;
+   unsigned databases = argc > 1 ? (unsigned)atoi(argv[1]) : DEFAULT_DATABASES;
+   unsigned records   = argc > 2 ? (unsigned)atoi(argv[2]) : DEFAULT_RECORDS;
+   uint64_t expect, got;
+
+   strcpy(dir, "/tmp/libksdb_bench_XXXXXX");
+   if (!databases || !mkdtemp(dir)
+         || !(paths = (char(*)[256])calloc(databases, 256)))
+      return 1;
+
+   for (i = 0; i < databases; i++)
+   {
+      snprintf(paths[i], 256, "%s/system_%03u.rdb", dir, i);
+      if (!generate_database(paths[i], i, records))
+      {
+         fprintf(stderr, "Could not create %s\n", paths[i]);
+         return 1;
+      }
+   }
+
+   printf("%u databases of %u records in %s\n", databases, records, dir);
+
+   expect = run("dom_read", paths, databases, load_file, true);
+   got    = run("cursor view", paths, databases, load_view, true);
+   ok    &= got == expect;
+   got    = run("dom_read", paths, databases, load_file, false);
+   ok    &= got == expect;
+   got    = run("cursor view", paths, databases, load_view, false);
+   ok    &= got == expect;
+
+   if (!ok)
+      printf("records differ between the two readers\n");
+
+   {
+      uint64_t scanned[sizeof(query_kinds) / sizeof(*query_kinds)];
+      uint64_t indexed[sizeof(query_kinds) / sizeof(*query_kinds)];
+      libksdb_t *db = libksdb_new();
+
+      memset(scanned, 0, sizeof(scanned));
+      memset(indexed, 0, sizeof(indexed));
+
+      run_queries(paths[0], records, "scan", scanned);
+
+      if (db && libksdb_open(paths[0], db) == 0)
+      {
+         for (i = 0; i < sizeof(indexes) / sizeof(*indexes); i++)
+            if (libksdb_create_index(db, indexes[i][0], indexes[i][1]) != 0)
+               printf("could not create index %s\n", indexes[i][0]);
+         libksdb_close(db);
+      }
+      libksdb_free(db);
+
+      run_queries(paths[0], records, "indexed", indexed);
+
+      if (memcmp(scanned, indexed, sizeof(scanned)))
+      {
+         printf("indexed queries found different records\n");
+         ok = false;
+      }
+   }
+
+   for (i = 0; i < databases; i++)
+      remove(paths[i]);
+   rmdir(dir);
+   free(paths);
+
+   return ok ? 0 : 1;
+}
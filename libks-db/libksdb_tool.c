@@ -45,7 +45,7 @@ int main(int argc, char ** argv)
       printf("Usage: %s <db file> <command> [extra args...]\n", argv[0]);
       printf("Available Commands:\n");
       printf("\tlist\n");
-      printf("\tcreate-index <index name> <field name>\n");
+      printf("\tcreate-index <index name> <field name>[,<field name>...]\n");
       printf("\tfind <query expression>\n");
       printf("\tget-names <query expression>\n");
       return 1;
@@ -165,14 +165,18 @@ int main(int argc, char ** argv)
 
       if (argc != 5)
       {
-         printf("Usage: %s <db file> create-index <index name> <field name>\n", argv[0]);
+         printf("Usage: %s <db file> create-index <index name> <field name>[,<field name>...]\n", argv[0]);
          goto error;
       }
 
       index_name = argv[3];
       field_name = argv[4];
 
-      libksdb_create_index(db, index_name, field_name);
+      if ((rv = libksdb_create_index(db, index_name, field_name)) != 0)
+      {
+         printf("Could not create index: %s\n", strerror(-rv));
+         goto error;
+      }
    }
    else
    {
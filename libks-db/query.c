@@ -40,7 +40,7 @@
 #include "rmsgpack_dom.h"
 
 #define MAX_ERROR_LEN   256
-#define QUERY_MAX_ARGS  50
+#define QUERY_MAX_ARGS  LIBKSDB_QUERY_MAX_VALUES
 
 struct buffer
 {
@@ -999,3 +999,141 @@ int libksdb_query_filter(libksdb_query_t *q,
    struct rmsgpack_dom_value res = inv.func(*v, inv.argc, inv.argv);
    return (res.type == RDT_BOOL && res.val.bool_);
 }
+
+static bool query_key_value_is_indexable(const struct rmsgpack_dom_value *v)
+{
+   switch (v->type)
+   {
+      case RDT_UINT:
+      case RDT_INT:
+      case RDT_STRING:
+      case RDT_BINARY:
+         return true;
+      default:
+         break;
+   }
+   return false;
+}
+
+/* What @arg requires of the field it is applied to */
+static bool query_key_from_argument(const struct argument *arg,
+      struct libksdb_query_key *key)
+{
+   unsigned i;
+   const struct invocation *inv = NULL;
+
+   if (arg->type == AT_VALUE)
+   {
+      key->type       = LIBKSDB_QUERY_KEY_EQUAL;
+      key->count      = 1;
+      key->values[0]  = &arg->a.value;
+      key->prefix_len = 0;
+      return query_key_value_is_indexable(&arg->a.value);
+   }
+
+   inv = &arg->a.invocation;
+
+   if (inv->func == query_func_operator_or)
+   {
+      if (inv->argc == 0 || inv->argc > LIBKSDB_QUERY_MAX_VALUES)
+         return false;
+
+      for (i = 0; i < inv->argc; i++)
+      {
+         if (     inv->argv[i].type != AT_VALUE
+               || !query_key_value_is_indexable(&inv->argv[i].a.value))
+            return false;
+         key->values[i] = &inv->argv[i].a.value;
+      }
+
+      key->type       = LIBKSDB_QUERY_KEY_EQUAL;
+      key->count      = inv->argc;
+      key->prefix_len = 0;
+      return true;
+   }
+
+   if (inv->func == query_func_glob)
+   {
+      const struct rmsgpack_dom_value *pattern = NULL;
+
+      if (inv->argc != 1 || inv->argv[0].type != AT_VALUE)
+         return false;
+
+      pattern = &inv->argv[0].a.value;
+      if (pattern->type != RDT_STRING)
+         return false;
+
+      /* Everything up to the first wildcard has to match as is */
+      key->prefix_len = strcspn(pattern->val.string.buff, "*?[\\");
+      if (key->prefix_len == 0)
+         return false;
+
+      key->type       = (key->prefix_len == pattern->val.string.len)
+         ? LIBKSDB_QUERY_KEY_EQUAL : LIBKSDB_QUERY_KEY_PREFIX;
+      key->count      = 1;
+      key->values[0]  = pattern;
+      return true;
+   }
+
+   if (inv->func == query_func_between)
+   {
+      if (     inv->argc != 2
+            || inv->argv[0].type != AT_VALUE
+            || inv->argv[1].type != AT_VALUE
+            || inv->argv[0].a.value.type != RDT_INT
+            || inv->argv[1].a.value.type != RDT_INT)
+         return false;
+
+      key->type       = LIBKSDB_QUERY_KEY_RANGE;
+      key->count      = 2;
+      key->values[0]  = &inv->argv[0].a.value;
+      key->values[1]  = &inv->argv[1].a.value;
+      key->prefix_len = 0;
+      return true;
+   }
+
+   return false;
+}
+
+static bool query_find_key(const struct invocation *inv,
+      const char *field, struct libksdb_query_key *key)
+{
+   unsigned i;
+
+   /* {field: ..., field: ...} has to match every pair */
+   if (inv->func == query_func_all_map)
+   {
+      for (i = 0; i + 1 < inv->argc; i += 2)
+      {
+         const struct rmsgpack_dom_value *name = &inv->argv[i].a.value;
+
+         if (     inv->argv[i].type != AT_VALUE
+               || name->type        != RDT_STRING
+               || !string_is_equal(name->val.string.buff, field))
+            continue;
+
+         if (query_key_from_argument(&inv->argv[i + 1], key))
+            return true;
+      }
+   }
+   /* and({...}, {...}) has to match every table */
+   else if (inv->func == query_func_operator_and)
+   {
+      for (i = 0; i < inv->argc; i++)
+      {
+         if (     inv->argv[i].type == AT_FUNCTION
+               && query_find_key(&inv->argv[i].a.invocation, field, key))
+            return true;
+      }
+   }
+
+   return false;
+}
+
+bool libksdb_query_get_key(libksdb_query_t *q, const char *field,
+      struct libksdb_query_key *key)
+{
+   if (!q || !field)
+      return false;
+   return query_find_key(&((struct query*)q)->root, field, key);
+}
@@ -24,6 +24,7 @@
 #define __LIBKSDB_QUERY_H__
 
 #include <ks_common_api.h>
+#include <boolean.h>
 
 #include "libksdb.h"
 #include "rmsgpack_dom.h"
@@ -32,12 +33,50 @@ KS_BEGIN_DECLS
 
 typedef struct libksdb_query libksdb_query_t;
 
+/* Most arguments a query function call can take */
+#define LIBKSDB_QUERY_MAX_VALUES 50
+
+enum libksdb_query_key_type
+{
+   LIBKSDB_QUERY_KEY_EQUAL = 0, /* Field equals one of the values */
+   LIBKSDB_QUERY_KEY_PREFIX,    /* Field starts with prefix_len bytes of values[0] */
+   LIBKSDB_QUERY_KEY_RANGE      /* Field is between values[0] and values[1] */
+};
+
+/* A condition on a single field that every record matching a
+ * query meets, which an index can use to find candidates.
+ * Values point into the query. */
+struct libksdb_query_key
+{
+   const struct rmsgpack_dom_value *values[LIBKSDB_QUERY_MAX_VALUES];
+   size_t prefix_len;
+   unsigned count;
+   enum libksdb_query_key_type type;
+};
+
 void libksdb_query_inc_ref(libksdb_query_t *q);
 
 void libksdb_query_dec_ref(libksdb_query_t *q);
 
 int libksdb_query_filter(libksdb_query_t *q, struct rmsgpack_dom_value *v);
 
+/**
+ * libksdb_query_get_key:
+ * @q                   : Compiled query.
+ * @field               : Name of a record field.
+ * @key                 : Condition on @field.
+ *
+ * Looks for an equality ({field: value} or {field: or(...)}),
+ * prefix ({field: glob('prefix*')}) or range
+ * ({field: between(a, b)}) condition on @field that the whole
+ * query depends on. Records meeting it still have to be passed
+ * through libksdb_query_filter.
+ *
+ * Returns: true if there is one.
+ **/
+bool libksdb_query_get_key(libksdb_query_t *q, const char *field,
+      struct libksdb_query_key *key);
+
 KS_END_DECLS
 
 #endif
@@ -658,3 +658,216 @@ int rmsgpack_read(RFILE *fd,
 error:
    return -errno;
 }
+
+static int read_buf_uint(const uint8_t **ptr, const uint8_t *end,
+      uint64_t *out, size_t size)
+{
+   const uint8_t *p = *ptr;
+   uint64_t value   = 0;
+
+   if ((size_t)(end - p) < size)
+      return -EINVAL;
+
+   while (size--)
+      value = (value << 8) | *p++;
+
+   *out = value;
+   *ptr = p;
+   return 0;
+}
+
+static int read_buf_int(const uint8_t **ptr, const uint8_t *end,
+      int64_t *out, size_t size)
+{
+   uint64_t value = 0;
+
+   if (read_buf_uint(ptr, end, &value, size) < 0)
+      return -EINVAL;
+
+   switch (size)
+   {
+      case 1:
+         *out = (int8_t)value;
+         break;
+      case 2:
+         *out = (int16_t)value;
+         break;
+      case 4:
+         *out = (int32_t)value;
+         break;
+      case 8:
+         *out = (int64_t)value;
+         break;
+   }
+   return 0;
+}
+
+static int read_buf_data(const uint8_t **ptr, const uint8_t *end,
+      uint64_t len, char **data)
+{
+   if ((uint64_t)(end - *ptr) < len)
+      return -EINVAL;
+
+   *data = (char*)*ptr;
+   *ptr += len;
+   return 0;
+}
+
+static int read_buf_map(const uint8_t **ptr, const uint8_t *end,
+      uint32_t len, struct rmsgpack_read_callbacks *callbacks, void *data)
+{
+   int rv;
+   unsigned i;
+
+   if (callbacks->read_map_start &&
+         (rv = callbacks->read_map_start(len, data)) < 0)
+      return rv;
+
+   for (i = 0; i < len; i++)
+   {
+      if ((rv = rmsgpack_read_buf(ptr, end, callbacks, data)) < 0)
+         return rv;
+      if ((rv = rmsgpack_read_buf(ptr, end, callbacks, data)) < 0)
+         return rv;
+   }
+
+   return 0;
+}
+
+static int read_buf_array(const uint8_t **ptr, const uint8_t *end,
+      uint32_t len, struct rmsgpack_read_callbacks *callbacks, void *data)
+{
+   int rv;
+   unsigned i;
+
+   if (callbacks->read_array_start &&
+         (rv = callbacks->read_array_start(len, data)) < 0)
+      return rv;
+
+   for (i = 0; i < len; i++)
+   {
+      if ((rv = rmsgpack_read_buf(ptr, end, callbacks, data)) < 0)
+         return rv;
+   }
+
+   return 0;
+}
+
+int rmsgpack_read_buf(const uint8_t **ptr, const uint8_t *end,
+      struct rmsgpack_read_callbacks *callbacks, void *data)
+{
+   uint64_t tmp_len  = 0;
+   uint64_t tmp_uint = 0;
+   int64_t tmp_int   = 0;
+   char *buff        = NULL;
+   uint8_t type      = 0;
+
+   if (*ptr >= end)
+      return -EINVAL;
+
+   type = *(*ptr)++;
+
+   if (type < MPF_FIXMAP)
+   {
+      if (!callbacks->read_int)
+         return 0;
+      return callbacks->read_int(type, data);
+   }
+   else if (type < MPF_FIXARRAY)
+   {
+      tmp_len = type - MPF_FIXMAP;
+      return read_buf_map(ptr, end, (uint32_t)tmp_len, callbacks, data);
+   }
+   else if (type < MPF_FIXSTR)
+   {
+      tmp_len = type - MPF_FIXARRAY;
+      return read_buf_array(ptr, end, (uint32_t)tmp_len, callbacks, data);
+   }
+   else if (type < MPF_NIL)
+   {
+      tmp_len = type - MPF_FIXSTR;
+      if (read_buf_data(ptr, end, tmp_len, &buff) < 0)
+         return -EINVAL;
+      if (!callbacks->read_string)
+         return 0;
+      return callbacks->read_string(buff, (uint32_t)tmp_len, data);
+   }
+   else if (type > MPF_MAP32)
+   {
+      if (!callbacks->read_int)
+         return 0;
+      return callbacks->read_int(type - 0xff - 1, data);
+   }
+
+   switch (type)
+   {
+      case _MPF_NIL:
+         if (callbacks->read_nil)
+            return callbacks->read_nil(data);
+         break;
+      case _MPF_FALSE:
+         if (callbacks->read_bool)
+            return callbacks->read_bool(0, data);
+         break;
+      case _MPF_TRUE:
+         if (callbacks->read_bool)
+            return callbacks->read_bool(1, data);
+         break;
+      case _MPF_BIN8:
+      case _MPF_BIN16:
+      case _MPF_BIN32:
+         if (   read_buf_uint(ptr, end, &tmp_len,
+                  (size_t)(1 << (type - _MPF_BIN8))) < 0
+             || read_buf_data(ptr, end, tmp_len, &buff) < 0)
+            return -EINVAL;
+
+         if (callbacks->read_bin)
+            return callbacks->read_bin(buff, (uint32_t)tmp_len, data);
+         break;
+      case _MPF_UINT8:
+      case _MPF_UINT16:
+      case _MPF_UINT32:
+      case _MPF_UINT64:
+         tmp_len  = UINT64_C(1) << (type - _MPF_UINT8);
+         if (read_buf_uint(ptr, end, &tmp_uint, (size_t)tmp_len) < 0)
+            return -EINVAL;
+
+         if (callbacks->read_uint)
+            return callbacks->read_uint(tmp_uint, data);
+         break;
+      case _MPF_INT8:
+      case _MPF_INT16:
+      case _MPF_INT32:
+      case _MPF_INT64:
+         tmp_len = UINT64_C(1) << (type - _MPF_INT8);
+         if (read_buf_int(ptr, end, &tmp_int, (size_t)tmp_len) < 0)
+            return -EINVAL;
+
+         if (callbacks->read_int)
+            return callbacks->read_int(tmp_int, data);
+         break;
+      case _MPF_STR8:
+      case _MPF_STR16:
+      case _MPF_STR32:
+         if (   read_buf_uint(ptr, end, &tmp_len,
+                  (size_t)(1 << (type - _MPF_STR8))) < 0
+             || read_buf_data(ptr, end, tmp_len, &buff) < 0)
+            return -EINVAL;
+
+         if (callbacks->read_string)
+            return callbacks->read_string(buff, (uint32_t)tmp_len, data);
+         break;
+      case _MPF_ARRAY16:
+      case _MPF_ARRAY32:
+         if (read_buf_uint(ptr, end, &tmp_len, 2<<(type - _MPF_ARRAY16)) < 0)
+            return -EINVAL;
+         return read_buf_array(ptr, end, (uint32_t)tmp_len, callbacks, data);
+      case _MPF_MAP16:
+      case _MPF_MAP32:
+         if (read_buf_uint(ptr, end, &tmp_len, 2<<(type - _MPF_MAP16)) < 0)
+            return -EINVAL;
+         return read_buf_map(ptr, end, (uint32_t)tmp_len, callbacks, data);
+   }
+
+   return 0;
+}
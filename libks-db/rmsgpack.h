@@ -57,4 +57,11 @@ int rmsgpack_write_uint(RFILE *fd, uint64_t value );
 
 int rmsgpack_read(RFILE *fd, struct rmsgpack_read_callbacks *callbacks, void *data);
 
+/* Like rmsgpack_read, but decodes the value at *ptr from memory
+ * and advances *ptr past it. Strings and binaries are passed to
+ * the callbacks as pointers into the buffer; they are not
+ * NUL-terminated and must not be freed. */
+int rmsgpack_read_buf(const uint8_t **ptr, const uint8_t *end,
+      struct rmsgpack_read_callbacks *callbacks, void *data);
+
 #endif
@@ -33,12 +33,73 @@
 
 #define MAX_DEPTH 128
 
+/* Smallest arena block; larger documents get a block of their own size */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+struct rmsgpack_dom_arena_block
+{
+   struct rmsgpack_dom_arena_block *next;
+   size_t size;
+   size_t used;
+   uint64_t data[1];
+};
+
 struct dom_reader_state
 {
 	int i;
 	struct rmsgpack_dom_value *stack[MAX_DEPTH];
+	struct rmsgpack_dom_arena *arena; /* NULL when reading from a file */
 };
 
+static void *dom_arena_alloc(struct rmsgpack_dom_arena *arena, size_t size)
+{
+   struct rmsgpack_dom_arena_block *block = arena->cur;
+
+   /* Keep every allocation 8-byte aligned */
+   size = (size + 7) & ~(size_t)7;
+
+   while (block && block->size - block->used < size)
+   {
+      if (!block->next)
+      {
+         size_t block_size = size > ARENA_BLOCK_SIZE
+            ? size : ARENA_BLOCK_SIZE;
+         struct rmsgpack_dom_arena_block *next =
+            (struct rmsgpack_dom_arena_block*)malloc(
+                  sizeof(*next) + block_size);
+
+         if (!next)
+            return NULL;
+
+         next->next  = NULL;
+         next->size  = block_size;
+         next->used  = 0;
+         block->next = next;
+      }
+
+      block        = block->next;
+      block->used  = 0;
+   }
+
+   if (!block)
+   {
+      size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+
+      if (!(block = (struct rmsgpack_dom_arena_block*)malloc(
+                  sizeof(*block) + block_size)))
+         return NULL;
+
+      block->next  = NULL;
+      block->size  = block_size;
+      block->used  = 0;
+      arena->head  = block;
+   }
+
+   arena->cur   = block;
+   block->used += size;
+   return (uint8_t*)block->data + block->used - size;
+}
+
 static struct rmsgpack_dom_value *dom_reader_state_pop(
       struct dom_reader_state *s)
 {
@@ -105,6 +166,17 @@ static int dom_read_string(char *value, uint32_t len, void *data)
    struct rmsgpack_dom_value *v       =
       (struct rmsgpack_dom_value*)dom_reader_state_pop(dom_state);
 
+   /* Strings read from memory are not NUL-terminated */
+   if (dom_state->arena)
+   {
+      char *copy = (char*)dom_arena_alloc(dom_state->arena, len + 1);
+      if (!copy)
+         return -ENOMEM;
+      memcpy(copy, value, len);
+      copy[len] = '\0';
+      value     = copy;
+   }
+
    v->type                            = RDT_STRING;
    v->val.string.len                  = len;
    v->val.string.buff                 = value;
@@ -134,8 +206,16 @@ static int dom_read_map_start(uint32_t len, void *data)
    v->val.map.len                     = len;
    v->val.map.items                   = NULL;
 
-   items                              = (struct rmsgpack_dom_pair *)
-      calloc(len, sizeof(struct rmsgpack_dom_pair));
+   if (dom_state->arena)
+   {
+      items = (struct rmsgpack_dom_pair *)dom_arena_alloc(
+            dom_state->arena, len * sizeof(struct rmsgpack_dom_pair));
+      if (items)
+         memset(items, 0, len * sizeof(struct rmsgpack_dom_pair));
+   }
+   else
+      items = (struct rmsgpack_dom_pair *)
+         calloc(len, sizeof(struct rmsgpack_dom_pair));
 
    if (!items)
       return -ENOMEM;
@@ -164,15 +244,23 @@ static int dom_read_array_start(uint32_t len, void *data)
 	v->val.array.len                   = len;
 	v->val.array.items                 = NULL;
 
-	items                              = (struct rmsgpack_dom_value *)
-      calloc(len, sizeof(*items));
+	if (dom_state->arena)
+	{
+		items = (struct rmsgpack_dom_value *)dom_arena_alloc(
+				dom_state->arena, len * sizeof(*items));
+		if (items)
+			memset(items, 0, len * sizeof(*items));
+	}
+	else
+		items = (struct rmsgpack_dom_value *)calloc(len, sizeof(*items));
 
 	if (!items)
 		return -ENOMEM;
 
 	v->val.array.items = items;
 
-	for (i = 0; i < len; i++)
+	/* Items are popped in reverse, the first one has to go last */
+	for (i = len; i-- > 0; )
    {
       if (dom_reader_state_push(dom_state, &items[i]) < 0)
          return -ENOMEM;
@@ -414,6 +502,7 @@ int rmsgpack_dom_read(RFILE *fd, struct rmsgpack_dom_value *out)
 
    s.i        = 0;
    s.stack[0] = out;
+   s.arena    = NULL;
 
    rv         = rmsgpack_read(fd, &dom_reader_callbacks, &s);
 
@@ -505,3 +594,96 @@ clean:
    rmsgpack_dom_value_free(&map);
    return 0;
 }
+
+int rmsgpack_dom_read_buf(struct rmsgpack_dom_arena *arena,
+      const uint8_t **ptr, const uint8_t *end,
+      struct rmsgpack_dom_value *out)
+{
+   struct dom_reader_state s;
+
+   /* Start over at the first block; the previous value is gone */
+   if ((arena->cur = arena->head))
+      arena->cur->used = 0;
+
+   s.i        = 0;
+   s.stack[0] = out;
+   s.arena    = arena;
+   out->type  = RDT_NULL;
+
+   return rmsgpack_read_buf(ptr, end, &dom_reader_callbacks, &s);
+}
+
+void rmsgpack_dom_arena_free(struct rmsgpack_dom_arena *arena)
+{
+   struct rmsgpack_dom_arena_block *block = arena->head;
+
+   while (block)
+   {
+      struct rmsgpack_dom_arena_block *next = block->next;
+      free(block);
+      block = next;
+   }
+
+   arena->head = NULL;
+   arena->cur  = NULL;
+}
+
+int rmsgpack_dom_value_copy(struct rmsgpack_dom_value *dst,
+      const struct rmsgpack_dom_value *src)
+{
+   unsigned i;
+
+   *dst = *src;
+
+   switch (src->type)
+   {
+      case RDT_STRING:
+      case RDT_BINARY:
+         /* Both arms of the union have the same layout */
+         if (!(dst->val.string.buff = (char*)malloc(
+                     src->val.string.len + 1)))
+            goto error;
+         memcpy(dst->val.string.buff, src->val.string.buff,
+               src->val.string.len);
+         dst->val.string.buff[src->val.string.len] = '\0';
+         break;
+      case RDT_MAP:
+         if (!(dst->val.map.items = (struct rmsgpack_dom_pair*)calloc(
+                     src->val.map.len, sizeof(struct rmsgpack_dom_pair))))
+            goto error;
+         for (i = 0; i < src->val.map.len; i++)
+         {
+            if (  rmsgpack_dom_value_copy(&dst->val.map.items[i].key,
+                     &src->val.map.items[i].key) < 0
+               || rmsgpack_dom_value_copy(&dst->val.map.items[i].value,
+                     &src->val.map.items[i].value) < 0)
+            {
+               rmsgpack_dom_value_free(dst);
+               return -ENOMEM;
+            }
+         }
+         break;
+      case RDT_ARRAY:
+         if (!(dst->val.array.items = (struct rmsgpack_dom_value*)calloc(
+                     src->val.array.len, sizeof(struct rmsgpack_dom_value))))
+            goto error;
+         for (i = 0; i < src->val.array.len; i++)
+         {
+            if (rmsgpack_dom_value_copy(&dst->val.array.items[i],
+                     &src->val.array.items[i]) < 0)
+            {
+               rmsgpack_dom_value_free(dst);
+               return -ENOMEM;
+            }
+         }
+         break;
+      default:
+         break;
+   }
+
+   return 0;
+
+error:
+   dst->type = RDT_NULL;
+   return -ENOMEM;
+}
@@ -79,6 +79,18 @@ struct rmsgpack_dom_pair
 	struct rmsgpack_dom_value value; /* uint64_t alignment */
 };
 
+struct rmsgpack_dom_arena_block;
+
+/* Backing storage for values decoded by rmsgpack_dom_read_buf.
+ * Blocks are kept between reads, so once the arena has grown to
+ * fit the largest document it is used for, further reads do not
+ * allocate. Zero-initialize before first use. */
+struct rmsgpack_dom_arena
+{
+   struct rmsgpack_dom_arena_block *head;
+   struct rmsgpack_dom_arena_block *cur;
+};
+
 void rmsgpack_dom_value_print(struct rmsgpack_dom_value *obj);
 void rmsgpack_dom_value_free(struct rmsgpack_dom_value *v);
 
@@ -95,6 +107,31 @@ int rmsgpack_dom_write(RFILE *fd, const struct rmsgpack_dom_value *obj);
 
 int rmsgpack_dom_read_into(RFILE *fd, ...);
 
+/**
+ * rmsgpack_dom_read_buf:
+ * @arena               : Storage for the decoded value.
+ * @ptr                 : Position in the buffer, advanced past the value.
+ * @end                 : End of the buffer.
+ * @out                 : Decoded value.
+ *
+ * Decodes a value from memory without per-value allocations.
+ * Maps, arrays and NUL-terminated copies of strings live in
+ * @arena, binaries point straight into the buffer. @out stays
+ * valid until the next read with the same arena and must not be
+ * passed to rmsgpack_dom_value_free.
+ *
+ * Returns: 0 if successful, otherwise negative.
+ **/
+int rmsgpack_dom_read_buf(struct rmsgpack_dom_arena *arena,
+      const uint8_t **ptr, const uint8_t *end,
+      struct rmsgpack_dom_value *out);
+
+void rmsgpack_dom_arena_free(struct rmsgpack_dom_arena *arena);
+
+/* Deep copy of @src that can be freed with rmsgpack_dom_value_free */
+int rmsgpack_dom_value_copy(struct rmsgpack_dom_value *dst,
+      const struct rmsgpack_dom_value *src);
+
 KS_END_DECLS
 
 #endif
@@ -7388,6 +7388,8 @@ static void materialui_layout(materialui_handle_t *mui, bool video_is_threaded)
    int title_font_size;
    int list_font_size;
    int hint_font_size;
+   int thumbnail_max_width;
+   int thumbnail_max_height;
    unsigned new_header_height;
    gfx_display_t *p_disp     = disp_get_ptr();
 
@@ -7456,6 +7458,18 @@ static void materialui_layout(materialui_handle_t *mui, bool video_is_threaded)
       mui->nav_bar_layout_height       = mui->nav_bar.width;
    }
 
+   /* The largest thumbnails are drawn in the fullscreen
+    * view, which fills the space left by the header
+    * and navigation bar */
+   thumbnail_max_width  = (int)mui->last_width -
+         (int)mui->nav_bar_layout_width - (int)(mui->margin * 4);
+   thumbnail_max_height = (int)mui->last_height -
+         (int)mui->nav_bar_layout_height - (int)new_header_height -
+         (int)(mui->margin * 4);
+   thumbnail_max_width  = MAX(thumbnail_max_width, thumbnail_max_height);
+   gfx_thumbnail_set_max_size((thumbnail_max_width > 0) ?
+         (unsigned)thumbnail_max_width : 0);
+
    /* We assume the average glyph aspect ratio is close to 3:4 */
    mui->font_data.title.glyph_width = (int)((title_font_size * (3.0f / 4.0f)) + 0.5f);
    mui->font_data.list.glyph_width  = (int)((list_font_size  * (3.0f / 4.0f)) + 0.5f);
@@ -1071,6 +1071,7 @@ static void ozone_set_layout(ozone_handle_t *ozone, bool is_threaded)
 {
    char s1[PATH_MAX_LENGTH];
    char font_path[PATH_MAX_LENGTH];
+   int thumbnail_max_size;
    float scale_factor  = 0.0f;
    bool font_inited    = false;
 
@@ -1119,6 +1120,17 @@ static void ozone_set_layout(ozone_handle_t *ozone, bool is_threaded)
 
    ozone->dimensions.fullscreen_thumbnail_padding = FULLSCREEN_THUMBNAIL_PADDING * scale_factor;
 
+   /* The largest thumbnails are drawn in the fullscreen
+    * view, between the header and the footer */
+   thumbnail_max_size = (int)ozone->last_height -
+         (int)ozone->dimensions.header_height -
+         (int)ozone->dimensions.footer_height;
+   if (thumbnail_max_size < (int)ozone->last_width)
+      thumbnail_max_size = (int)ozone->last_width;
+   thumbnail_max_size -= (int)ozone->dimensions.fullscreen_thumbnail_padding * 2;
+   gfx_thumbnail_set_max_size((thumbnail_max_size > 0) ?
+         (unsigned)thumbnail_max_size : 0);
+
    ozone->dimensions.spacer_1px = (scale_factor > 1.0f) ? (unsigned)(scale_factor + 0.5f) : 1;
    ozone->dimensions.spacer_2px = ozone->dimensions.spacer_1px * 2;
    ozone->dimensions.spacer_3px = (unsigned)((scale_factor * 3.0f) + 0.5f);
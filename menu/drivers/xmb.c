@@ -5394,6 +5394,7 @@ static void xmb_layout_psp(xmb_handle_t *xmb, int width)
 static void xmb_layout(xmb_handle_t *xmb)
 {
    unsigned width, height, i, current, end;
+   int thumbnail_max_size;
    file_list_t *selection_buf = menu_entries_get_selection_buf_ptr(0);
    size_t selection           = menu_navigation_get_selection();
 
@@ -5404,6 +5405,12 @@ static void xmb_layout(xmb_handle_t *xmb)
    else
       xmb_layout_psp(xmb, width);
 
+   /* The largest thumbnails are drawn in the fullscreen
+    * view, inset by half an icon on each side */
+   thumbnail_max_size = (int)MAX(width, height) - (int)xmb->icon_size;
+   gfx_thumbnail_set_max_size((thumbnail_max_size > 0) ?
+         (unsigned)thumbnail_max_size : 0);
+
 #ifdef XMB_DEBUG
    KINGSN_LOG("[XMB] margin screen left: %.2f\n",  xmb->margins_screen_left);
    KINGSN_LOG("[XMB] margin screen top:  %.2f\n",  xmb->margins_screen_top);
@@ -399,19 +399,263 @@ static void explore_load_icons(explore_state_t *state)
    }
 }
 
+struct explore_rdb
+{
+   libksdb_t *handle;
+   const struct playlist_entry **playlist_crcs;
+   const struct playlist_entry **playlist_names;
+   size_t count;
+   char systemname[256];
+};
+
+/* Adds the playlist entry that database record @item belongs to,
+ * if any. With @skip_crc_matches, records whose CRC is in a
+ * playlist are left out since they have been added already. */
+static bool explore_add_rdb_entry(explore_state_t *explore,
+      explore_string_t **cat_maps[EXPLORE_CAT_COUNT],
+      explore_string_t ***split_buf, struct explore_rdb *rdb,
+      const struct rmsgpack_dom_value *item, bool skip_crc_matches)
+{
+   unsigned k, l, cat;
+   explore_entry_t e;
+   char *fields[EXPLORE_CAT_COUNT];
+   char numeric_buf[EXPLORE_CAT_COUNT][16];
+   const struct playlist_entry *entry = NULL;
+   uint32_t crc32                     = 0;
+   char *name                         = NULL;
+#ifdef EXPLORE_SHOW_ORIGINAL_TITLE
+   char *original_title               = NULL;
+#endif
+
+   if (item->type != RDT_MAP)
+      return false;
+
+   for (k = 0; k < EXPLORE_CAT_COUNT; k++)
+      fields[k]                       = NULL;
+
+   for (k = 0; k < item->val.map.len; k++)
+   {
+      const char *key_str             = NULL;
+      struct rmsgpack_dom_value *key  = &item->val.map.items[k].key;
+      struct rmsgpack_dom_value *val  = &item->val.map.items[k].value;
+      if (!key || !val || key->type != RDT_STRING)
+         continue;
+
+      key_str                         = key->val.string.buff;
+      if (string_is_equal(key_str, "crc"))
+      {
+         memcpy(&crc32, val->val.binary.buff, sizeof(crc32));
+         crc32 = swap_if_little32(crc32);
+         continue;
+      }
+      else if (string_is_equal(key_str, "name"))
+      {
+         name = val->val.string.buff;
+         continue;
+      }
+#ifdef EXPLORE_SHOW_ORIGINAL_TITLE
+      else if (string_is_equal(key_str, "original_title"))
+      {
+         original_title = val->val.string.buff;
+         continue;
+      }
+#endif
+
+      for (cat = 0; cat != EXPLORE_CAT_COUNT; cat++)
+      {
+         if (!string_is_equal(key_str, explore_by_info[cat].rdbkey))
+            continue;
+
+         if (explore_by_info[cat].is_numeric)
+         {
+            if (!val->val.int_)
+               break;
+            snprintf(numeric_buf[cat],
+                  sizeof(numeric_buf[cat]),
+                  "%d", (int)val->val.int_);
+            fields[cat] = numeric_buf[cat];
+            break;
+         }
+         if (val->type != RDT_STRING)
+            break;
+         fields[cat] = val->val.string.buff;
+         break;
+      }
+   }
+
+   if (crc32)
+   {
+      if (skip_crc_matches && RHMAP_HAS(rdb->playlist_crcs, crc32))
+         return false;
+      entry = RHMAP_GET(rdb->playlist_crcs, crc32);
+   }
+   if (!entry && name)
+   {
+      entry = RHMAP_GET_STR(rdb->playlist_names, name);
+   }
+   if (!entry)
+      return false;
+
+   e.playlist_entry  = entry;
+   for (l = 0; l < EXPLORE_CAT_COUNT; l++)
+      e.by[l]        = NULL;
+   e.split           = NULL;
+#ifdef EXPLORE_SHOW_ORIGINAL_TITLE
+   e.original_title  = NULL;
+#endif
+
+   fields[EXPLORE_BY_SYSTEM] = rdb->systemname;
+
+   for (cat = 0; cat != EXPLORE_CAT_COUNT; cat++)
+   {
+      explore_add_unique_string(explore,
+            cat_maps, &e, cat,
+            fields[cat], split_buf);
+   }
+
+#ifdef EXPLORE_SHOW_ORIGINAL_TITLE
+   if (original_title && *original_title)
+   {
+      size_t len       = strlen(original_title) + 1;
+      e.original_title = (char*)
+         ex_arena_alloc(&explore->arena, len);
+      memcpy(e.original_title, original_title, len);
+   }
+#endif
+
+   if (RBUF_LEN(*split_buf))
+   {
+      size_t len;
+
+      RBUF_PUSH(*split_buf, NULL); /* terminator */
+      len        = RBUF_SIZEOF(*split_buf);
+      e.split    = (explore_string_t **)
+         ex_arena_alloc(&explore->arena, len);
+      memcpy(e.split, *split_buf, len);
+      RBUF_CLEAR(*split_buf);
+   }
+
+   RBUF_PUSH(explore->entries, e);
+   return true;
+}
+
+static void explore_add_rdb_entries(explore_state_t *explore,
+      explore_string_t **cat_maps[EXPLORE_CAT_COUNT],
+      explore_string_t ***split_buf, struct explore_rdb *rdb,
+      libksdb_cursor_t *cur, bool skip_crc_matches)
+{
+   struct rmsgpack_dom_value item;
+
+   /* Items belong to the cursor and are only valid until the
+    * next read, strings are copied into the arena */
+   while (rdb->count && libksdb_cursor_read_item_view(cur, &item) == 0)
+   {
+      /* if all entries have found connections, we can leave early */
+      if (explore_add_rdb_entry(explore, cat_maps, split_buf,
+               rdb, &item, skip_crc_matches))
+         rdb->count--;
+   }
+
+   libksdb_cursor_close(cur);
+}
+
+/* Looks up the records for all playlist entries of @rdb. With
+ * indexes on "crc" and "name" only those records are read,
+ * otherwise the whole database is. */
+static void explore_load_rdb(explore_state_t *explore,
+      explore_string_t **cat_maps[EXPLORE_CAT_COUNT],
+      explore_string_t ***split_buf, struct explore_rdb *rdb)
+{
+   size_t i, n;
+   uint8_t *crcs                     = NULL;
+   struct rmsgpack_dom_value *keys   = NULL;
+   libksdb_cursor_t *cur             = libksdb_cursor_new();
+   size_t num_crcs                   = RHMAP_LEN(rdb->playlist_crcs);
+   size_t num_names                  = RHMAP_LEN(rdb->playlist_names);
+
+   if (!cur)
+      return;
+
+   keys = (struct rmsgpack_dom_value*)malloc(
+         (MAX(num_crcs, num_names) + 1) * sizeof(*keys));
+   crcs = (uint8_t*)malloc((num_crcs + 1) * sizeof(uint32_t));
+
+   if (!keys || !crcs)
+      goto scan;
+
+   if (num_crcs)
+   {
+      /* Database CRCs are big endian binaries */
+      for (i = n = 0; i < RHMAP_CAP(rdb->playlist_crcs); i++)
+      {
+         uint32_t crc32 = RHMAP_KEY(rdb->playlist_crcs, i);
+         uint8_t *crc   = crcs + n * sizeof(uint32_t);
+
+         if (!crc32)
+            continue;
+
+         crc[0] = (uint8_t)(crc32 >> 24);
+         crc[1] = (uint8_t)(crc32 >> 16);
+         crc[2] = (uint8_t)(crc32 >>  8);
+         crc[3] = (uint8_t)(crc32);
+
+         keys[n].type            = RDT_BINARY;
+         keys[n].val.binary.len  = sizeof(uint32_t);
+         keys[n].val.binary.buff = (char*)crc;
+         n++;
+      }
+
+      if (libksdb_cursor_open_keys(rdb->handle, cur, "crc", keys, n) != 0)
+         goto scan;
+
+      explore_add_rdb_entries(explore, cat_maps, split_buf,
+            rdb, cur, false);
+   }
+
+   if (num_names)
+   {
+      for (i = n = 0; i < RHMAP_CAP(rdb->playlist_names); i++)
+      {
+         const struct playlist_entry *entry;
+
+         if (!RHMAP_KEY(rdb->playlist_names, i))
+            continue;
+
+         entry                   = rdb->playlist_names[i];
+         keys[n].type            = RDT_STRING;
+         keys[n].val.string.len  = (uint32_t)strlen(entry->label);
+         keys[n].val.string.buff = entry->label;
+         n++;
+      }
+
+      /* Records found by CRC are in already, if there is no index
+       * on names the rest of them are scanned for */
+      if (     libksdb_cursor_open_keys(rdb->handle, cur, "name", keys, n) != 0
+            && libksdb_cursor_open(rdb->handle, cur, NULL) != 0)
+         goto end;
+
+      explore_add_rdb_entries(explore, cat_maps, split_buf,
+            rdb, cur, true);
+   }
+
+   goto end;
+
+scan:
+   if (libksdb_cursor_open(rdb->handle, cur, NULL) == 0)
+      explore_add_rdb_entries(explore, cat_maps, split_buf,
+            rdb, cur, false);
+
+end:
+   free(keys);
+   free(crcs);
+   libksdb_cursor_free(cur);
+}
+
 static explore_state_t *explore_build_list(void)
 {
    unsigned i;
    char tmp[PATH_MAX_LENGTH];
-   struct explore_rdb
-   {
-      libksdb_t *handle;
-      const struct playlist_entry **playlist_crcs;
-      const struct playlist_entry **playlist_names;
-      size_t count;
-      char systemname[256];
-   }
-   *rdbs                                          = NULL;
+   struct explore_rdb *rdbs                       = NULL;
    int *rdb_indices                               = NULL;
    explore_string_t **cat_maps[EXPLORE_CAT_COUNT] = {NULL};
    explore_string_t **split_buf                   = NULL;
@@ -445,6 +689,7 @@ static explore_state_t *explore_build_list(void)
       playlist_config.old_format                = false;
       playlist_config.compress                  = false;
       playlist_config.fuzzy_archive_match       = false;
+      playlist_config.binary_cache              = false;
       playlist_config.autofix_paths             = false;
 
       if (!ks_vfs_readdir_impl(dir))
@@ -558,145 +803,10 @@ static explore_state_t *explore_build_list(void)
     * and load meta data strings */
    for (i = 0; i != RBUF_LEN(rdbs); i++)
    {
-      struct rmsgpack_dom_value item;
       struct explore_rdb* rdb  = &rdbs[i];
-      libksdb_cursor_t *cur = libksdb_cursor_new();
-      bool more                = 
-         (
-          libksdb_cursor_open(rdb->handle, cur, NULL) == 0
-          && libksdb_cursor_read_item(cur, &item) == 0);
-
-      for (; more; more = (rmsgpack_dom_value_free(&item),
-               libksdb_cursor_read_item(cur, &item) == 0))
-      {
-         unsigned k, l, cat;
-         explore_entry_t e;
-         char *fields[EXPLORE_CAT_COUNT];
-         char numeric_buf[EXPLORE_CAT_COUNT][16];
-         const struct playlist_entry *entry = NULL;
-         uint32_t crc32                     = 0;
-         char *name                         = NULL;
-#ifdef EXPLORE_SHOW_ORIGINAL_TITLE
-         char *original_title               = NULL;
-#endif
-
-         if (item.type != RDT_MAP)
-            continue;
-
-         for (k = 0; k < EXPLORE_CAT_COUNT; k++)
-            fields[k]                       = NULL;
-
-         for (k = 0; k < item.val.map.len; k++)
-         {
-            const char *key_str             = NULL;
-            struct rmsgpack_dom_value *key  = &item.val.map.items[k].key;
-            struct rmsgpack_dom_value *val  = &item.val.map.items[k].value;
-            if (!key || !val || key->type != RDT_STRING)
-               continue;
-
-            key_str                         = key->val.string.buff;
-            if (string_is_equal(key_str, "crc"))
-            {
-               crc32 = swap_if_little32(*(uint32_t*)val->val.binary.buff);
-               continue;
-            }
-            else if (string_is_equal(key_str, "name"))
-            {
-               name = val->val.string.buff;
-               continue;
-            }
-#ifdef EXPLORE_SHOW_ORIGINAL_TITLE
-            else if (string_is_equal(key_str, "original_title"))
-            {
-               original_title = val->val.string.buff;
-               continue;
-            }
-#endif
-
-            for (cat = 0; cat != EXPLORE_CAT_COUNT; cat++)
-            {
-               if (!string_is_equal(key_str, explore_by_info[cat].rdbkey))
-                  continue;
-
-               if (explore_by_info[cat].is_numeric)
-               {
-                  if (!val->val.int_)
-                     break;
-                  snprintf(numeric_buf[cat],
-                        sizeof(numeric_buf[cat]),
-                        "%d", (int)val->val.int_);
-                  fields[cat] = numeric_buf[cat];
-                  break;
-               }
-               if (val->type != RDT_STRING)
-                  break;
-               fields[cat] = val->val.string.buff;
-               break;
-            }
-         }
-
-         if (crc32)
-         {
-            entry = RHMAP_GET(rdb->playlist_crcs, crc32);
-         }
-         if (!entry && name)
-         {
-            entry = RHMAP_GET_STR(rdb->playlist_names, name);
-         }
-         if (!entry)
-            continue;
-
-         e.playlist_entry  = entry;
-         for (l = 0; l < EXPLORE_CAT_COUNT; l++)
-            e.by[l]        = NULL;
-         e.split           = NULL;
-#ifdef EXPLORE_SHOW_ORIGINAL_TITLE
-         e.original_title  = NULL;
-#endif
-
-         fields[EXPLORE_BY_SYSTEM] = rdb->systemname;
-
-         for (cat = 0; cat != EXPLORE_CAT_COUNT; cat++)
-         {
-            explore_add_unique_string(explore,
-                  cat_maps, &e, cat,
-                  fields[cat], &split_buf);
-         }
 
-#ifdef EXPLORE_SHOW_ORIGINAL_TITLE
-         if (original_title && *original_title)
-         {
-            size_t len       = strlen(original_title) + 1;
-            e.original_title = (char*)
-               ex_arena_alloc(&explore->arena, len);
-            memcpy(e.original_title, original_title, len);
-         }
-#endif
-
-         if (RBUF_LEN(split_buf))
-         {
-            size_t len;
-
-            RBUF_PUSH(split_buf, NULL); /* terminator */
-            len        = RBUF_SIZEOF(split_buf);
-            e.split    = (explore_string_t **)
-               ex_arena_alloc(&explore->arena, len);
-            memcpy(e.split, split_buf, len);
-            RBUF_CLEAR(split_buf);
-         }
-
-         RBUF_PUSH(explore->entries, e);
-
-         /* if all entries have found connections, we can leave early */
-         if (--rdb->count == 0)
-         {
-            rmsgpack_dom_value_free(&item);
-            break;
-         }
-      }
+      explore_load_rdb(explore, cat_maps, &split_buf, rdb);
 
-      libksdb_cursor_close(cur);
-      libksdb_cursor_free(cur);
       libksdb_close(rdb->handle);
       libksdb_free(rdb->handle);
       RHMAP_FREE(rdb->playlist_crcs);
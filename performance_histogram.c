@@ -0,0 +1,123 @@
+/*  KingStation - A frontend for libks.
+ *  Copyright (C) 2011-2017 - Daniel De Matteis
+ *
+ *  KingStation is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  KingStation is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with KingStation.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "performance_histogram.h"
+
+#define HIST_HALF (1 << (PERFORMANCE_HISTOGRAM_SUB_BITS - 1))
+
+static unsigned performance_histogram_index(uint64_t value)
+{
+   unsigned msb = 0;
+   unsigned shift;
+
+   if (value < (1 << PERFORMANCE_HISTOGRAM_SUB_BITS))
+      return (unsigned)value;
+
+   if (value >> 32)
+      return PERFORMANCE_HISTOGRAM_BUCKETS - 1;
+
+   while (value >> (msb + 1))
+      msb++;
+
+   /* value >> shift keeps the top SUB_BITS bits, which are
+    * between HIST_HALF and 2 * HIST_HALF - 1 */
+   shift = msb - (PERFORMANCE_HISTOGRAM_SUB_BITS - 1);
+   return shift * HIST_HALF + (unsigned)(value >> shift);
+}
+
+/* Highest value which maps to bucket @index */
+static uint64_t performance_histogram_value(unsigned index)
+{
+   unsigned shift, sub;
+
+   if (index < (1 << PERFORMANCE_HISTOGRAM_SUB_BITS))
+      return index;
+
+   shift = index / HIST_HALF - 1;
+   sub   = index - shift * HIST_HALF;
+   return (((uint64_t)sub + 1) << shift) - 1;
+}
+
+void performance_histogram_reset(performance_histogram_t *hist)
+{
+   memset(hist, 0, sizeof(*hist));
+}
+
+void performance_histogram_add(performance_histogram_t *hist,
+      uint64_t value)
+{
+   if (!hist->count || value < hist->min)
+      hist->min = value;
+   if (value > hist->max)
+      hist->max = value;
+
+   hist->count++;
+   hist->sum += value;
+   hist->buckets[performance_histogram_index(value)]++;
+}
+
+uint64_t performance_histogram_percentile(
+      const performance_histogram_t *hist, double percentile)
+{
+   unsigned i;
+   uint64_t rank;
+   uint64_t seen = 0;
+
+   if (!hist->count)
+      return 0;
+
+   rank = (uint64_t)(percentile / 100.0 * hist->count + 0.5);
+   if (rank < 1)
+      rank = 1;
+   if (rank > hist->count)
+      rank = hist->count;
+
+   for (i = 0; i < PERFORMANCE_HISTOGRAM_BUCKETS; i++)
+   {
+      seen += hist->buckets[i];
+      if (seen >= rank)
+      {
+         uint64_t value = performance_histogram_value(i);
+         return value < hist->max ? value : hist->max;
+      }
+   }
+
+   return hist->max;
+}
+
+size_t performance_histogram_format(const performance_histogram_t *hist,
+      const char *name, const char *unit, char *s, size_t len)
+{
+   int ret = snprintf(s, len,
+         "%s: count=%llu min=%llu p50=%llu p90=%llu p99=%llu "
+         "p99.9=%llu max=%llu mean=%.1f %s",
+         name,
+         (unsigned long long)hist->count,
+         (unsigned long long)hist->min,
+         (unsigned long long)performance_histogram_percentile(hist, 50.0),
+         (unsigned long long)performance_histogram_percentile(hist, 90.0),
+         (unsigned long long)performance_histogram_percentile(hist, 99.0),
+         (unsigned long long)performance_histogram_percentile(hist, 99.9),
+         (unsigned long long)hist->max,
+         hist->count ? (double)hist->sum / hist->count : 0.0,
+         unit);
+
+   if (ret < 0)
+      return 0;
+   return (size_t)ret < len ? (size_t)ret : len - 1;
+}
@@ -0,0 +1,80 @@
+/*  KingStation - A frontend for libks.
+ *  Copyright (C) 2011-2017 - Daniel De Matteis
+ *
+ *  KingStation is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  KingStation is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with KingStation.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PERFORMANCE_HISTOGRAM_H
+#define _PERFORMANCE_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <boolean.h>
+#include <ks_common_api.h>
+
+KS_BEGIN_DECLS
+
+/* Log-linear (HDR style) histogram of non-negative integer
+ * samples. Values below 2^PERFORMANCE_HISTOGRAM_SUB_BITS are
+ * counted exactly, every larger power of two is split into
+ * 2^(PERFORMANCE_HISTOGRAM_SUB_BITS - 1) buckets, which keeps
+ * percentiles within 1.6% of the real value from 1 up to
+ * 2^32. Larger values land in the last bucket; min, max and
+ * the mean are always exact. */
+#define PERFORMANCE_HISTOGRAM_SUB_BITS 7
+#define PERFORMANCE_HISTOGRAM_BUCKETS  ((32 - PERFORMANCE_HISTOGRAM_SUB_BITS + 2) << (PERFORMANCE_HISTOGRAM_SUB_BITS - 1))
+
+typedef struct performance_histogram
+{
+   uint64_t count;
+   uint64_t sum;
+   uint64_t min;
+   uint64_t max;
+   uint32_t buckets[PERFORMANCE_HISTOGRAM_BUCKETS];
+} performance_histogram_t;
+
+void performance_histogram_reset(performance_histogram_t *hist);
+
+void performance_histogram_add(performance_histogram_t *hist,
+      uint64_t value);
+
+/**
+ * performance_histogram_percentile:
+ * @hist               : histogram
+ * @percentile         : 0.0 to 100.0
+ *
+ * Returns: the highest value that falls in the same bucket
+ * as the sample at @percentile, or 0 if @hist is empty.
+ **/
+uint64_t performance_histogram_percentile(
+      const performance_histogram_t *hist, double percentile);
+
+/**
+ * performance_histogram_format:
+ * @hist               : histogram
+ * @name               : name to prefix the line with
+ * @unit               : unit of the samples
+ * @s                  : output buffer
+ * @len                : size of @s
+ *
+ * Writes one line with the sample count, min, p50, p90,
+ * p99, p99.9, max and mean of @hist to @s.
+ *
+ * Returns: length of the line.
+ **/
+size_t performance_histogram_format(const performance_histogram_t *hist,
+      const char *name, const char *unit, char *s, size_t len);
+
+KS_END_DECLS
+
+#endif
@@ -0,0 +1,376 @@
+/*  KingStation - A frontend for libks.
+ *  Copyright (C) 2011-2017 - Daniel De Matteis
+ *
+ *  KingStation is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  KingStation is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with KingStation.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <compat/strl.h>
+#include <features/features_cpu.h>
+#include <ks_timers.h>
+#include <memalign.h>
+#include <streams/file_stream.h>
+#include <string/stdstring.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#include "performance_trace.h"
+#include "verbosity.h"
+
+#define PERFORMANCE_TRACE_MAX_THREADS 64
+#define PERFORMANCE_TRACE_CACHE_LINE  64
+
+/* The head of a ring is only written by its own thread. The
+ * release store makes the event visible before the head that
+ * counts it, for a reader on another thread. The same goes
+ * for a new ring and the thread count that publishes it.
+ *
+ * A thread raises the busy flag of its ring before checking
+ * that recording is on, and performance_trace_stop() turns
+ * recording off before checking the flags. Both sides need a
+ * full barrier between their store and their load (hence the
+ * seq-cst operations), so that at least one of them sees
+ * the other: either the thread sees recording off and leaves
+ * the ring alone, or stop waits for the flag to drop before
+ * it frees the events.
+ *
+ * The ring headers (and the flags in them) are never freed,
+ * so a thread that looked its ring up just before recording
+ * stopped still raises the flag in valid memory. A ring stays
+ * with its thread across traces. */
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#define TRACE_LOAD_ACQUIRE(ptr)       __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define TRACE_STORE_RELEASE(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#define TRACE_LOAD_SEQ_CST(ptr)       __atomic_load_n((ptr), __ATOMIC_SEQ_CST)
+#define TRACE_STORE_SEQ_CST(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_SEQ_CST)
+#elif defined(_MSC_VER)
+#include <windows.h>
+/* volatile accesses have acquire/release semantics on MSVC,
+ * the barrier after a store orders it before later loads */
+#define TRACE_LOAD_ACQUIRE(ptr)       (*(ptr))
+#define TRACE_STORE_RELEASE(ptr, val) (*(ptr) = (val))
+#define TRACE_LOAD_SEQ_CST(ptr)       (*(ptr))
+#define TRACE_STORE_SEQ_CST(ptr, val) \
+   do { *(ptr) = (val); MemoryBarrier(); } while (0)
+#else
+#define TRACE_LOAD_ACQUIRE(ptr)       (*(ptr))
+#define TRACE_STORE_RELEASE(ptr, val) (*(ptr) = (val))
+#define TRACE_LOAD_SEQ_CST(ptr)       (*(ptr))
+#define TRACE_STORE_SEQ_CST(ptr, val) (*(ptr) = (val))
+#endif
+
+struct trace_event
+{
+   const char *name;
+   int64_t time;
+   char phase;
+};
+
+struct trace_buffer
+{
+   /* Allocated by the owning thread on its first event of
+    * a trace, freed by performance_trace_stop() */
+   struct trace_event *events;
+   uintptr_t thread_id;
+   /* Number of events recorded in this trace, the ring
+    * holds the last PERFORMANCE_TRACE_EVENTS of them */
+   volatile size_t head;
+   unsigned index;
+   /* Set while the owning thread records an event */
+   volatile bool busy;
+};
+
+/* Each ring header gets a cache line of its own, so the
+ * stores to head and busy don't bounce between threads */
+union trace_slot
+{
+   struct trace_buffer buf;
+   char pad[PERFORMANCE_TRACE_CACHE_LINE];
+};
+
+struct trace_state
+{
+   struct trace_buffer *buffers[PERFORMANCE_TRACE_MAX_THREADS];
+#ifdef HAVE_THREADS
+   slock_t *lock;
+#ifdef HAVE_THREAD_STORAGE
+   sthread_tls_t tls;
+#endif
+#endif
+   uintptr_t main_thread_id;
+   int64_t start_time;
+   volatile unsigned count;
+   char path[4096];
+};
+
+bool performance_trace_enabled = false;
+
+static struct trace_state trace_st;
+
+static uintptr_t performance_trace_thread_id(void)
+{
+#ifdef HAVE_THREADS
+   return sthread_get_current_thread_id();
+#else
+   return 0;
+#endif
+}
+
+static struct trace_buffer *performance_trace_buffer_new(uintptr_t id)
+{
+   struct trace_buffer *buf = NULL;
+
+   if (trace_st.count >= PERFORMANCE_TRACE_MAX_THREADS)
+      return NULL;
+
+   buf = (struct trace_buffer*)memalign_alloc(
+         PERFORMANCE_TRACE_CACHE_LINE, sizeof(union trace_slot));
+   if (!buf)
+      return NULL;
+
+   memset(buf, 0, sizeof(union trace_slot));
+   buf->thread_id                   = id;
+   buf->index                       = trace_st.count;
+   trace_st.buffers[trace_st.count] = buf;
+   TRACE_STORE_RELEASE(&trace_st.count, trace_st.count + 1);
+   return buf;
+}
+
+/* Returns the calling thread's buffer, creating it on
+ * its first event. Only registration takes the lock;
+ * without thread-local storage the buffer is looked up
+ * in the list of registered threads instead. */
+static struct trace_buffer *performance_trace_get_buffer(void)
+{
+   unsigned i, count;
+   uintptr_t id;
+   struct trace_buffer *buf = NULL;
+
+#if defined(HAVE_THREADS) && defined(HAVE_THREAD_STORAGE)
+   buf = (struct trace_buffer*)sthread_tls_get(&trace_st.tls);
+   if (buf)
+      return buf;
+#endif
+
+   id    = performance_trace_thread_id();
+   count = TRACE_LOAD_ACQUIRE(&trace_st.count);
+
+   for (i = 0; i < count; i++)
+      if (trace_st.buffers[i]->thread_id == id)
+         return trace_st.buffers[i];
+
+#ifdef HAVE_THREADS
+   slock_lock(trace_st.lock);
+#endif
+   for (i = 0; i < trace_st.count; i++)
+   {
+      if (trace_st.buffers[i]->thread_id == id)
+      {
+         buf = trace_st.buffers[i];
+         break;
+      }
+   }
+   if (!buf)
+      buf = performance_trace_buffer_new(id);
+#ifdef HAVE_THREADS
+   slock_unlock(trace_st.lock);
+#endif
+
+#if defined(HAVE_THREADS) && defined(HAVE_THREAD_STORAGE)
+   if (buf)
+      sthread_tls_set(&trace_st.tls, buf);
+#endif
+
+   return buf;
+}
+
+void performance_trace_event(const char *name, char phase)
+{
+   struct trace_event *ev;
+   size_t head;
+   struct trace_buffer *buf = NULL;
+
+   /* Pairs with performance_trace_start(), which sets up
+    * the lock and the thread-local storage key first */
+   if (     !TRACE_LOAD_ACQUIRE(&performance_trace_enabled)
+         || !(buf = performance_trace_get_buffer()))
+      return;
+
+   /* Raise the flag before checking that recording is still
+    * on, so performance_trace_stop() either waits for us or
+    * we see it and back out */
+   TRACE_STORE_SEQ_CST(&buf->busy, true);
+
+   if (TRACE_LOAD_SEQ_CST(&performance_trace_enabled))
+   {
+      if (!buf->events)
+         buf->events = (struct trace_event*)malloc(
+               PERFORMANCE_TRACE_EVENTS * sizeof(*buf->events));
+
+      if (buf->events)
+      {
+         head       = buf->head;
+         ev         = &buf->events[head & (PERFORMANCE_TRACE_EVENTS - 1)];
+         ev->name   = name;
+         ev->time   = cpu_features_get_time_usec();
+         ev->phase  = phase;
+         TRACE_STORE_RELEASE(&buf->head, head + 1);
+      }
+   }
+
+   TRACE_STORE_RELEASE(&buf->busy, false);
+}
+
+void performance_trace_start(const char *path)
+{
+   if (performance_trace_enabled || string_is_empty(path))
+      return;
+
+   /* The lock and the thread-local storage key are kept
+    * after a trace stops, a late event may still use them */
+#ifdef HAVE_THREADS
+   if (!trace_st.lock)
+   {
+      if (!(trace_st.lock = slock_new()))
+         return;
+#ifdef HAVE_THREAD_STORAGE
+      if (!sthread_tls_create(&trace_st.tls))
+      {
+         slock_free(trace_st.lock);
+         trace_st.lock = NULL;
+         return;
+      }
+#endif
+   }
+#endif
+
+   strlcpy(trace_st.path, path, sizeof(trace_st.path));
+   trace_st.main_thread_id   = performance_trace_thread_id();
+   trace_st.start_time       = cpu_features_get_time_usec();
+   TRACE_STORE_SEQ_CST(&performance_trace_enabled, true);
+
+   KINGSN_LOG("[Trace]: Recording trace events to \"%s\".\n", path);
+}
+
+static void performance_trace_write_buffer(RFILE *file,
+      struct trace_buffer *buf, bool *first)
+{
+   size_t i, start;
+   unsigned depth = 0;
+   size_t head    = TRACE_LOAD_ACQUIRE(&buf->head);
+
+   start = head > PERFORMANCE_TRACE_EVENTS
+      ? head - PERFORMANCE_TRACE_EVENTS : 0;
+
+   filestream_printf(file,
+         "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+         "\"args\":{\"name\":\"%s%u\"}}",
+         *first ? "" : ",", buf->index,
+         buf->thread_id == trace_st.main_thread_id ? "main " : "thread ",
+         buf->index);
+   *first = false;
+
+   for (i = start; i < head; i++)
+   {
+      const struct trace_event *ev =
+         &buf->events[i & (PERFORMANCE_TRACE_EVENTS - 1)];
+
+      /* The begin event of this scope was overwritten */
+      if (ev->phase == 'E')
+      {
+         if (!depth)
+            continue;
+         depth--;
+      }
+      else
+         depth++;
+
+      filestream_printf(file,
+            ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld,"
+            "\"pid\":1,\"tid\":%u}",
+            ev->name, ev->phase,
+            (long long)(ev->time - trace_st.start_time), buf->index);
+   }
+}
+
+bool performance_trace_stop(void)
+{
+   unsigned i, count;
+   unsigned threads = 0;
+   RFILE *file = NULL;
+   bool first  = true;
+   bool ret    = false;
+
+   if (!performance_trace_enabled)
+      return false;
+
+   TRACE_STORE_SEQ_CST(&performance_trace_enabled, false);
+
+   /* A thread registering after this sees recording off */
+#ifdef HAVE_THREADS
+   slock_lock(trace_st.lock);
+#endif
+   count = trace_st.count;
+#ifdef HAVE_THREADS
+   slock_unlock(trace_st.lock);
+#endif
+
+   /* Events already past the check in
+    * performance_trace_event() may still be writing */
+   for (i = 0; i < count; i++)
+      while (TRACE_LOAD_SEQ_CST(&trace_st.buffers[i]->busy))
+         ks_sleep(0);
+
+   file = filestream_open(trace_st.path,
+         KS_VFS_FILE_ACCESS_WRITE,
+         KS_VFS_FILE_ACCESS_HINT_NONE);
+
+   if (file)
+   {
+      filestream_printf(file, "{\"traceEvents\":[");
+      for (i = 0; i < count; i++)
+      {
+         /* Registered in an earlier trace, idle in this one */
+         if (!trace_st.buffers[i]->events)
+            continue;
+         performance_trace_write_buffer(file, trace_st.buffers[i], &first);
+         threads++;
+      }
+      filestream_printf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+      filestream_close(file);
+      ret = true;
+
+      KINGSN_LOG("[Trace]: Wrote trace of %u thread(s) to \"%s\".\n",
+            threads, trace_st.path);
+   }
+   else
+      KINGSN_ERR("[Trace]: Could not write trace to \"%s\".\n",
+            trace_st.path);
+
+   for (i = 0; i < count; i++)
+   {
+      free(trace_st.buffers[i]->events);
+      trace_st.buffers[i]->events = NULL;
+      trace_st.buffers[i]->head   = 0;
+   }
+
+   return ret;
+}
@@ -0,0 +1,89 @@
+/*  KingStation - A frontend for libks.
+ *  Copyright (C) 2011-2017 - Daniel De Matteis
+ *
+ *  KingStation is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  KingStation is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with KingStation.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PERFORMANCE_TRACE_H
+#define _PERFORMANCE_TRACE_H
+
+#include <boolean.h>
+
+#include <ks_common_api.h>
+
+KS_BEGIN_DECLS
+
+/* Trace recorder for frame timelines.
+ *
+ * Every thread that records an event gets its own ring
+ * buffer of begin/end events, which only that thread writes
+ * to, so recording takes no lock. When a ring is full the
+ * oldest events are overwritten, so a trace always holds the
+ * last PERFORMANCE_TRACE_EVENTS events of each thread.
+ *
+ * Threads find their ring through thread-local storage.
+ * Without HAVE_THREAD_STORAGE they search the (short) list
+ * of rings instead, which costs a scan per event but still
+ * no lock. Only a thread's first event locks, to register.
+ * A thread keeps its ring (but not the events in it) from
+ * one trace to the next.
+ *
+ * The recorded events are written out in the Chrome trace
+ * event format, which chrome://tracing, Perfetto and
+ * speedscope can load. */
+
+#ifndef PERFORMANCE_TRACE_EVENTS
+#define PERFORMANCE_TRACE_EVENTS 65536
+#endif
+
+extern bool performance_trace_enabled;
+
+void performance_trace_event(const char *name, char phase);
+
+/**
+ * performance_trace_start:
+ * @path               : file to write the trace to
+ *
+ * Starts recording trace events. The trace is written
+ * to @path by performance_trace_stop().
+ **/
+void performance_trace_start(const char *path);
+
+/**
+ * performance_trace_stop:
+ *
+ * Stops recording, waits for events that are still being
+ * recorded on other threads, writes the trace out and frees
+ * the recorded events.
+ *
+ * Returns: true if the trace was written.
+ **/
+bool performance_trace_stop(void);
+
+/* @name has to be a string literal (or otherwise outlive
+ * the trace), only the pointer is recorded. Begin and end
+ * events of a scope have to come from the same thread. */
+#define performance_trace_begin(name) \
+   do { \
+      if (performance_trace_enabled) \
+         performance_trace_event(name, 'B'); \
+   } while (0)
+
+#define performance_trace_end(name) \
+   do { \
+      if (performance_trace_enabled) \
+         performance_trace_event(name, 'E'); \
+   } while (0)
+
+KS_END_DECLS
+
+#endif
@@ -15,10 +15,22 @@
  *  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 #include <libks.h>
 #include <boolean.h>
@@ -26,11 +38,13 @@
 #include <ks_miscellaneous.h>
 #include <compat/posix_string.h>
 #include <string/stdstring.h>
+#include <streams/file_stream.h>
 #include <streams/interface_stream.h>
 #include <file/file_path.h>
 #include <lists/string_list.h>
 #include <formats/rjson.h>
 #include <array/rbuf.h>
+#include <array/rhmap.h>
 
 #include "playlist.h"
 #include "verbosity.h"
@@ -56,6 +70,16 @@
 #define USING_POSIX_FILE_SYSTEM
 #endif
 
+typedef struct
+{
+   size_t count;
+   /* While there is a single entry with this hash, its
+    * distance from the end of the playlist. Pushing to the
+    * top does not change it; other moves can, and are
+    * caught when the entry at the hint has another hash */
+   size_t hint;
+} playlist_index_slot_t;
+
 struct content_playlist
 {
    char *default_core_path;
@@ -64,6 +88,17 @@ struct content_playlist
 
    struct playlist_entry *entries;
 
+   /* Entries per path hash and per crc32/db_name hash.
+    * Built by the first lookup, so that playlists which
+    * are only displayed never resolve their paths */
+   playlist_index_slot_t *path_index;
+   playlist_index_slot_t *crc32_index;
+
+   /* Binary cache the playlist was loaded from. Strings
+    * of the entries and metadata may point into it */
+   uint8_t *cache_data;
+   size_t cache_size;
+
    playlist_config_t config;  /* size_t alignment */
 
    enum playlist_label_display_mode label_display_mode;
@@ -75,6 +110,8 @@ struct content_playlist
    bool old_format;
    bool compressed;
    bool cached_external;
+   bool indexed;
+   bool cache_mapped;
 };
 
 typedef struct
@@ -163,6 +200,7 @@ bool playlist_config_copy(const playlist_config_t *src,
    dst->old_format          = src->old_format;
    dst->compress            = src->compress;
    dst->fuzzy_archive_match = src->fuzzy_archive_match;
+   dst->binary_cache        = src->binary_cache;
    dst->autofix_paths       = src->autofix_paths;
 
    return true;
@@ -352,6 +390,271 @@ static bool playlist_core_path_equal(const char *real_core_path, const char *ent
    return false;
 }
 
+/**
+ * playlist_path_hash:
+ * @real_path           : 'Real' path, generated by path_resolve_realpath()
+ *
+ * Hash used by the path index. Only the part before
+ * an archive delimiter is hashed, so that paths which
+ * playlist_path_equal() matches 'fuzzily' (archive
+ * vs. file inside the archive) share a hash.
+ **/
+static uint32_t playlist_path_hash(const char *real_path)
+{
+   const char *delim = path_get_archive_delim(real_path);
+   const char *end   = delim ? delim : real_path + strlen(real_path);
+   uint32_t hash     = (uint32_t)0x811c9dc5;
+
+   for (; real_path < end; real_path++)
+   {
+#ifdef _WIN32
+      /* Handle case-insensitive operating systems*/
+      unsigned char c = (unsigned char)tolower((unsigned char)*real_path);
+#else
+      unsigned char c = (unsigned char)*real_path;
+#endif
+      hash = (hash * (uint32_t)0x01000193) ^ (uint32_t)c;
+   }
+
+   return hash ? hash : 1;
+}
+
+static uint32_t playlist_crc32_hash(const char *crc32, const char *db_name)
+{
+   unsigned char c;
+   uint32_t hash = (uint32_t)0x811c9dc5;
+
+   /* CRC32 values are hex strings, case does not matter */
+   if (crc32)
+      while ((c = (unsigned char)*(crc32++)) != '\0')
+         hash = (hash * (uint32_t)0x01000193) ^ (uint32_t)tolower(c);
+
+   /* Separator, so that the boundary between
+    * both strings is part of the hash */
+   hash = (hash * (uint32_t)0x01000193) ^ (uint32_t)'|';
+
+   if (db_name)
+      while ((c = (unsigned char)*(db_name++)) != '\0')
+         hash = (hash * (uint32_t)0x01000193) ^ (uint32_t)c;
+
+   return hash ? hash : 1;
+}
+
+static uint32_t playlist_entry_hash(const struct playlist_entry *entry,
+      bool crc32)
+{
+   return crc32 ? entry->crc32_hash : entry->path_hash;
+}
+
+/* Counts one more entry with @hash, the one at @idx */
+static void playlist_index_inc(playlist_t *playlist, bool crc32,
+      uint32_t hash, size_t idx)
+{
+   playlist_index_slot_t *map = crc32
+      ? playlist->crc32_index : playlist->path_index;
+   ptrdiff_t map_idx          = RHMAP_IDX(map, hash);
+   size_t hint                = RBUF_LEN(playlist->entries) - 1 - idx;
+
+   if (map_idx >= 0)
+   {
+      map[map_idx].count++;
+      map[map_idx].hint = hint;
+   }
+   else
+   {
+      playlist_index_slot_t slot;
+      slot.count = 1;
+      slot.hint  = hint;
+      RHMAP_SET(map, hash, slot);
+   }
+
+   if (crc32)
+      playlist->crc32_index = map;
+   else
+      playlist->path_index  = map;
+}
+
+static void playlist_index_dec(playlist_t *playlist, bool crc32,
+      uint32_t hash)
+{
+   playlist_index_slot_t *map = crc32
+      ? playlist->crc32_index : playlist->path_index;
+   ptrdiff_t map_idx          = RHMAP_IDX(map, hash);
+
+   if (map_idx >= 0 && --map[map_idx].count == 0)
+      (void)RHMAP_DEL(map, hash);
+}
+
+/**
+ * playlist_index_first:
+ * @playlist            : Playlist handle.
+ * @crc32               : Look up a crc32/db_name hash instead of a path hash.
+ * @hash                : Hash to look up.
+ * @count               : Set to the number of entries with @hash.
+ *
+ * Returns the index of the first entry with @hash, or the
+ * size of the playlist if there is none. Callers look at
+ * the following entries with the same hash until they
+ * have seen @count of them.
+ **/
+static size_t playlist_index_first(playlist_t *playlist, bool crc32,
+      uint32_t hash, size_t *count)
+{
+   size_t i;
+   playlist_index_slot_t *slot = NULL;
+   playlist_index_slot_t *map  = crc32
+      ? playlist->crc32_index : playlist->path_index;
+   ptrdiff_t map_idx           = RHMAP_IDX(map, hash);
+   size_t len                  = RBUF_LEN(playlist->entries);
+
+   *count = 0;
+
+   if (map_idx < 0)
+      return len;
+
+   slot   = &map[map_idx];
+   *count = slot->count;
+
+   /* A single entry with this hash is the one at the hint,
+    * unless entries have moved in a way which changes their
+    * distance from the end of the playlist (delete, move
+    * to top, capacity overflow) */
+   if (slot->count == 1 && slot->hint < len)
+   {
+      i = len - 1 - slot->hint;
+      if (playlist_entry_hash(&playlist->entries[i], crc32) == hash)
+         return i;
+   }
+
+   for (i = 0; i < len; i++)
+      if (playlist_entry_hash(&playlist->entries[i], crc32) == hash)
+         break;
+
+   if (i < len)
+      slot->hint = len - 1 - i;
+
+   return i;
+}
+
+/* The entry path goes through path_resolve_realpath(),
+ * the same as in playlist_path_equal(), so that equal
+ * paths always have equal hashes */
+static void playlist_index_add_path(playlist_t *playlist, size_t idx)
+{
+   char entry_real_path[PATH_MAX_LENGTH];
+   struct playlist_entry *entry = &playlist->entries[idx];
+
+   entry_real_path[0] = '\0';
+
+   if (!string_is_empty(entry->path))
+   {
+      strlcpy(entry_real_path, entry->path, sizeof(entry_real_path));
+      path_resolve_realpath(entry_real_path, sizeof(entry_real_path), true);
+   }
+
+   entry->path_hash = playlist_path_hash(entry_real_path);
+   playlist_index_inc(playlist, false, entry->path_hash, idx);
+}
+
+static void playlist_index_add_crc32(playlist_t *playlist, size_t idx)
+{
+   struct playlist_entry *entry = &playlist->entries[idx];
+
+   entry->crc32_hash = playlist_crc32_hash(entry->crc32, entry->db_name);
+   playlist_index_inc(playlist, true, entry->crc32_hash, idx);
+}
+
+static void playlist_index_add(playlist_t *playlist, size_t idx)
+{
+   if (!playlist->indexed)
+      return;
+
+   playlist_index_add_path(playlist, idx);
+   playlist_index_add_crc32(playlist, idx);
+}
+
+/* Re-hashes an entry after its path has changed */
+static void playlist_index_update_path(playlist_t *playlist, size_t idx)
+{
+   if (!playlist->indexed)
+      return;
+
+   playlist_index_dec(playlist, false, playlist->entries[idx].path_hash);
+   playlist_index_add_path(playlist, idx);
+}
+
+/* Re-hashes an entry after its crc32 or db_name has changed */
+static void playlist_index_update_crc32(playlist_t *playlist, size_t idx)
+{
+   if (!playlist->indexed)
+      return;
+
+   playlist_index_dec(playlist, true, playlist->entries[idx].crc32_hash);
+   playlist_index_add_crc32(playlist, idx);
+}
+
+static void playlist_index_remove(playlist_t *playlist,
+      const struct playlist_entry *entry)
+{
+   if (!playlist->indexed)
+      return;
+
+   playlist_index_dec(playlist, false, entry->path_hash);
+   playlist_index_dec(playlist, true, entry->crc32_hash);
+}
+
+/**
+ * playlist_index_build:
+ * @playlist            : Playlist handle.
+ *
+ * Indexes all entries, if that has not happened yet.
+ * From then on, every function that adds, removes or
+ * modifies entries keeps the index up to date. Entries
+ * only move in the array (push, delete, sort), and
+ * their hashes move with them.
+ **/
+static void playlist_index_build(playlist_t *playlist)
+{
+   size_t i, len;
+
+   if (playlist->indexed)
+      return;
+
+   playlist->indexed = true;
+
+   for (i = 0, len = RBUF_LEN(playlist->entries); i < len; i++)
+      playlist_index_add(playlist, i);
+}
+
+/* Points the hints back at their entries,
+ * after all entries have moved */
+static void playlist_index_update_hints(playlist_t *playlist)
+{
+   size_t i, len;
+
+   if (!playlist->indexed)
+      return;
+
+   for (i = 0, len = RBUF_LEN(playlist->entries); i < len; i++)
+   {
+      const struct playlist_entry *entry = &playlist->entries[i];
+      ptrdiff_t path_idx  = RHMAP_IDX(playlist->path_index,  entry->path_hash);
+      ptrdiff_t crc32_idx = RHMAP_IDX(playlist->crc32_index, entry->crc32_hash);
+
+      if (path_idx >= 0)
+         playlist->path_index[path_idx].hint   = len - 1 - i;
+      if (crc32_idx >= 0)
+         playlist->crc32_index[crc32_idx].hint = len - 1 - i;
+   }
+}
+
+static void playlist_index_free(playlist_t *playlist)
+{
+   RHMAP_FREE(playlist->path_index);
+   RHMAP_FREE(playlist->crc32_index);
+   playlist->indexed = false;
+}
+
 uint32_t playlist_get_size(playlist_t *playlist)
 {
    if (!playlist)
@@ -386,33 +689,43 @@ void playlist_get_index(playlist_t *playlist,
    *entry = &playlist->entries[idx];
 }
 
+/* Frees a string of an entry or of the playlist
+ * metadata, unless it is in the binary cache */
+static void playlist_free_string(playlist_t *playlist, char *s)
+{
+   if (!s)
+      return;
+
+   if (     playlist->cache_data
+         && (uintptr_t)s >= (uintptr_t)playlist->cache_data
+         && (uintptr_t)s <  (uintptr_t)playlist->cache_data
+            + playlist->cache_size)
+      return;
+
+   free(s);
+}
+
 /**
  * playlist_free_entry:
+ * @playlist            : Playlist handle.
  * @entry               : Playlist entry handle.
  *
  * Frees playlist entry.
  **/
-static void playlist_free_entry(struct playlist_entry *entry)
+static void playlist_free_entry(playlist_t *playlist,
+      struct playlist_entry *entry)
 {
    if (!entry)
       return;
 
-   if (entry->path)
-      free(entry->path);
-   if (entry->label)
-      free(entry->label);
-   if (entry->core_path)
-      free(entry->core_path);
-   if (entry->core_name)
-      free(entry->core_name);
-   if (entry->db_name)
-      free(entry->db_name);
-   if (entry->crc32)
-      free(entry->crc32);
-   if (entry->subsystem_ident)
-      free(entry->subsystem_ident);
-   if (entry->subsystem_name)
-      free(entry->subsystem_name);
+   playlist_free_string(playlist, entry->path);
+   playlist_free_string(playlist, entry->label);
+   playlist_free_string(playlist, entry->core_path);
+   playlist_free_string(playlist, entry->core_name);
+   playlist_free_string(playlist, entry->db_name);
+   playlist_free_string(playlist, entry->crc32);
+   playlist_free_string(playlist, entry->subsystem_ident);
+   playlist_free_string(playlist, entry->subsystem_name);
    if (entry->runtime_str)
       free(entry->runtime_str);
    if (entry->last_played_str)
@@ -466,7 +779,10 @@ void playlist_delete_index(playlist_t *playlist,
    /* Free unwanted entry */
    entry_to_delete = (struct playlist_entry *)(playlist->entries + idx);
    if (entry_to_delete)
-      playlist_free_entry(entry_to_delete);
+   {
+      playlist_index_remove(playlist, entry_to_delete);
+      playlist_free_entry(playlist, entry_to_delete);
+   }
 
    /* Shift remaining entries to fill the gap */
    memmove(playlist->entries + idx, playlist->entries + idx + 1,
@@ -488,7 +804,8 @@ void playlist_delete_index(playlist_t *playlist,
 void playlist_delete_by_path(playlist_t *playlist,
       const char *search_path)
 {
-   size_t i = 0;
+   size_t i, count;
+   uint32_t path_hash;
    char real_search_path[PATH_MAX_LENGTH];
 
    real_search_path[0] = '\0';
@@ -500,8 +817,20 @@ void playlist_delete_by_path(playlist_t *playlist,
    strlcpy(real_search_path, search_path, sizeof(real_search_path));
    path_resolve_realpath(real_search_path, sizeof(real_search_path), true);
 
-   while (i < RBUF_LEN(playlist->entries))
+   playlist_index_build(playlist);
+   path_hash = playlist_path_hash(real_search_path);
+   i         = playlist_index_first(playlist, false, path_hash, &count);
+
+   while (count && i < RBUF_LEN(playlist->entries))
    {
+      if (playlist->entries[i].path_hash != path_hash)
+      {
+         i++;
+         continue;
+      }
+
+      count--;
+
       if (!playlist_path_equal(real_search_path, playlist->entries[i].path,
             &playlist->config))
       {
@@ -521,7 +850,8 @@ void playlist_get_index_by_path(playlist_t *playlist,
       const char *search_path,
       const struct playlist_entry **entry)
 {
-   size_t i, len;
+   size_t i, len, count;
+   uint32_t path_hash;
    char real_search_path[PATH_MAX_LENGTH];
 
    real_search_path[0] = '\0';
@@ -533,8 +863,18 @@ void playlist_get_index_by_path(playlist_t *playlist,
    strlcpy(real_search_path, search_path, sizeof(real_search_path));
    path_resolve_realpath(real_search_path, sizeof(real_search_path), true);
 
-   for (i = 0, len = RBUF_LEN(playlist->entries); i < len; i++)
+   playlist_index_build(playlist);
+   path_hash = playlist_path_hash(real_search_path);
+   len       = RBUF_LEN(playlist->entries);
+
+   for (i = playlist_index_first(playlist, false, path_hash, &count);
+         count && i < len; i++)
    {
+      if (playlist->entries[i].path_hash != path_hash)
+         continue;
+
+      count--;
+
       if (!playlist_path_equal(real_search_path, playlist->entries[i].path,
                &playlist->config))
          continue;
@@ -548,7 +888,8 @@ void playlist_get_index_by_path(playlist_t *playlist,
 bool playlist_entry_exists(playlist_t *playlist,
       const char *path)
 {
-   size_t i, len;
+   size_t i, len, count;
+   uint32_t path_hash;
    char real_search_path[PATH_MAX_LENGTH];
 
    real_search_path[0] = '\0';
@@ -560,8 +901,18 @@ bool playlist_entry_exists(playlist_t *playlist,
    strlcpy(real_search_path, path, sizeof(real_search_path));
    path_resolve_realpath(real_search_path, sizeof(real_search_path), true);
 
-   for (i = 0, len = RBUF_LEN(playlist->entries); i < len; i++)
+   playlist_index_build(playlist);
+   path_hash = playlist_path_hash(real_search_path);
+   len       = RBUF_LEN(playlist->entries);
+
+   for (i = playlist_index_first(playlist, false, path_hash, &count);
+         count && i < len; i++)
    {
+      if (playlist->entries[i].path_hash != path_hash)
+         continue;
+
+      count--;
+
       if (playlist_path_equal(real_search_path, playlist->entries[i].path,
                &playlist->config))
          return true;
@@ -570,10 +921,48 @@ bool playlist_entry_exists(playlist_t *playlist,
    return false;
 }
 
+void playlist_get_index_by_crc32(playlist_t *playlist,
+      const char *crc32, const char *db_name,
+      const struct playlist_entry **entry)
+{
+   size_t i, len, count;
+   uint32_t crc32_hash;
+
+   if (!playlist || !entry || string_is_empty(crc32))
+      return;
+
+   playlist_index_build(playlist);
+   crc32_hash = playlist_crc32_hash(crc32, db_name);
+   len        = RBUF_LEN(playlist->entries);
+
+   for (i = playlist_index_first(playlist, true, crc32_hash, &count);
+         count && i < len; i++)
+   {
+      const struct playlist_entry *candidate = &playlist->entries[i];
+
+      if (candidate->crc32_hash != crc32_hash)
+         continue;
+
+      count--;
+
+      if (!string_is_equal_noncase(candidate->crc32, crc32))
+         continue;
+
+      if (string_is_empty(db_name)
+            ? !string_is_empty(candidate->db_name)
+            : !string_is_equal(candidate->db_name, db_name))
+         continue;
+
+      *entry = candidate;
+      break;
+   }
+}
+
 void playlist_update(playlist_t *playlist, size_t idx,
       const struct playlist_entry *update_entry)
 {
    struct playlist_entry *entry = NULL;
+   bool crc32_updated           = false;
 
    if (!playlist || idx >= RBUF_LEN(playlist->entries))
       return;
@@ -582,24 +971,22 @@ void playlist_update(playlist_t *playlist, size_t idx,
 
    if (update_entry->path && (update_entry->path != entry->path))
    {
-      if (entry->path)
-         free(entry->path);
+      playlist_free_string(playlist, entry->path);
       entry->path        = strdup(update_entry->path);
       playlist->modified = true;
+      playlist_index_update_path(playlist, idx);
    }
 
    if (update_entry->label && (update_entry->label != entry->label))
    {
-      if (entry->label)
-         free(entry->label);
+      playlist_free_string(playlist, entry->label);
       entry->label       = strdup(update_entry->label);
       playlist->modified = true;
    }
 
    if (update_entry->core_path && (update_entry->core_path != entry->core_path))
    {
-      if (entry->core_path)
-         free(entry->core_path);
+      playlist_free_string(playlist, entry->core_path);
       entry->core_path   = NULL;
       entry->core_path   = strdup(update_entry->core_path);
       playlist->modified = true;
@@ -607,27 +994,29 @@ void playlist_update(playlist_t *playlist, size_t idx,
 
    if (update_entry->core_name && (update_entry->core_name != entry->core_name))
    {
-      if (entry->core_name)
-         free(entry->core_name);
+      playlist_free_string(playlist, entry->core_name);
       entry->core_name   = strdup(update_entry->core_name);
       playlist->modified = true;
    }
 
    if (update_entry->db_name && (update_entry->db_name != entry->db_name))
    {
-      if (entry->db_name)
-         free(entry->db_name);
+      playlist_free_string(playlist, entry->db_name);
       entry->db_name     = strdup(update_entry->db_name);
       playlist->modified = true;
+      crc32_updated      = true;
    }
 
    if (update_entry->crc32 && (update_entry->crc32 != entry->crc32))
    {
-      if (entry->crc32)
-         free(entry->crc32);
+      playlist_free_string(playlist, entry->crc32);
       entry->crc32       = strdup(update_entry->crc32);
       playlist->modified = true;
+      crc32_updated      = true;
    }
+
+   if (crc32_updated)
+      playlist_index_update_crc32(playlist, idx);
 }
 
 void playlist_update_runtime(playlist_t *playlist, size_t idx,
@@ -643,17 +1032,16 @@ void playlist_update_runtime(playlist_t *playlist, size_t idx,
 
    if (update_entry->path && (update_entry->path != entry->path))
    {
-      if (entry->path)
-         free(entry->path);
+      playlist_free_string(playlist, entry->path);
       entry->path        = NULL;
       entry->path        = strdup(update_entry->path);
       playlist->modified = playlist->modified || register_update;
+      playlist_index_update_path(playlist, idx);
    }
 
    if (update_entry->core_path && (update_entry->core_path != entry->core_path))
    {
-      if (entry->core_path)
-         free(entry->core_path);
+      playlist_free_string(playlist, entry->core_path);
       entry->core_path   = NULL;
       entry->core_path   = strdup(update_entry->core_path);
       playlist->modified = playlist->modified || register_update;
@@ -741,7 +1129,8 @@ void playlist_update_runtime(playlist_t *playlist, size_t idx,
 bool playlist_push_runtime(playlist_t *playlist,
       const struct playlist_entry *entry)
 {
-   size_t i, len;
+   size_t i, len, count;
+   uint32_t path_hash;
    char real_path[PATH_MAX_LENGTH];
    char real_core_path[PATH_MAX_LENGTH];
 
@@ -777,12 +1166,26 @@ bool playlist_push_runtime(playlist_t *playlist,
       return false;
    }
 
-   len = RBUF_LEN(playlist->entries);
-   for (i = 0; i < len; i++)
+   /* Only entries with the same path hash can match. When
+    * there are none (always the case when scanning new
+    * content), there is no need to look at any entry */
+   playlist_index_build(playlist);
+   path_hash = playlist_path_hash(real_path);
+   len       = RBUF_LEN(playlist->entries);
+
+   for (i = playlist_index_first(playlist, false, path_hash, &count);
+         count && i < len; i++)
    {
       struct playlist_entry tmp;
       const char *entry_path = playlist->entries[i].path;
-      bool equal_path        =
+      bool equal_path;
+
+      if (playlist->entries[i].path_hash != path_hash)
+         continue;
+
+      count--;
+
+      equal_path =
          (string_is_empty(real_path) && string_is_empty(entry_path)) ||
          playlist_path_equal(real_path, entry_path, &playlist->config);
 
@@ -814,7 +1217,8 @@ bool playlist_push_runtime(playlist_t *playlist,
    if (len == playlist->config.capacity)
    {
       struct playlist_entry *last_entry = &playlist->entries[len - 1];
-      playlist_free_entry(last_entry);
+      playlist_index_remove(playlist, last_entry);
+      playlist_free_entry(playlist, last_entry);
       len--;
    }
    else
@@ -856,6 +1260,8 @@ bool playlist_push_runtime(playlist_t *playlist,
          playlist->entries[0].runtime_str     = strdup(entry->runtime_str);
       if (!string_is_empty(entry->last_played_str))
          playlist->entries[0].last_played_str = strdup(entry->last_played_str);
+
+      playlist_index_add(playlist, 0);
    }
 
 success:
@@ -930,9 +1336,10 @@ void playlist_resolve_path(enum playlist_file_mode mode,
 bool playlist_push(playlist_t *playlist,
       const struct playlist_entry *entry)
 {
-   size_t i, len;
+   size_t i, len, count;
    char real_path[PATH_MAX_LENGTH];
    char real_core_path[PATH_MAX_LENGTH];
+   uint32_t path_hash;
    const char *core_name = entry->core_name;
    bool entry_updated    = false;
 
@@ -981,12 +1388,26 @@ bool playlist_push(playlist_t *playlist,
       }
    }
 
-   len = RBUF_LEN(playlist->entries);
-   for (i = 0; i < len; i++)
+   /* Only entries with the same path hash can match. When
+    * there are none (always the case when scanning new
+    * content), there is no need to look at any entry */
+   playlist_index_build(playlist);
+   path_hash = playlist_path_hash(real_path);
+   len       = RBUF_LEN(playlist->entries);
+
+   for (i = playlist_index_first(playlist, false, path_hash, &count);
+         count && i < len; i++)
    {
       struct playlist_entry tmp;
       const char *entry_path = playlist->entries[i].path;
-      bool equal_path        =
+      bool equal_path;
+
+      if (playlist->entries[i].path_hash != path_hash)
+         continue;
+
+      count--;
+
+      equal_path =
          (string_is_empty(real_path) && string_is_empty(entry_path)) ||
          playlist_path_equal(real_path, entry_path, &playlist->config);
 
@@ -1076,6 +1497,8 @@ bool playlist_push(playlist_t *playlist,
          playlist->entries[i].db_name = strdup(entry->db_name);
          entry_updated                = true;
       }
+      if (entry_updated)
+         playlist_index_update_crc32(playlist, i);
 
       /* If top entry, we don't want to push a new entry since
        * the top and the entry to be pushed are the same. */
@@ -1102,7 +1525,8 @@ bool playlist_push(playlist_t *playlist,
    if (len == playlist->config.capacity)
    {
       struct playlist_entry *last_entry = &playlist->entries[len - 1];
-      playlist_free_entry(last_entry);
+      playlist_index_remove(playlist, last_entry);
+      playlist_free_entry(playlist, last_entry);
       len--;
    }
    else
@@ -1165,6 +1589,8 @@ bool playlist_push(playlist_t *playlist,
          for (i = 0; i < entry->subsystem_roms->size; i++)
             string_list_append(playlist->entries[0].subsystem_roms, entry->subsystem_roms->elems[i].data, attributes);
       }
+
+      playlist_index_add(playlist, 0);
    }
 
 success:
@@ -1173,6 +1599,466 @@ success:
    return true;
 }
 
+/* Binary cache of a playlist, kept next to it in
+ * '<playlist path>b' (e.g. 'history.lplb'). The file is a
+ * header, one fixed size record per entry, a table of
+ * subsystem rom strings and a blob of nul terminated
+ * strings. Strings are referenced by their offset into
+ * the blob, which starts with an empty string so that
+ * offset 0 means 'not set'. The cache is only used while
+ * the size and modification time of the playlist match
+ * the ones it was written for; the playlist itself stays
+ * the reference. It never leaves the machine that wrote
+ * it, so fields are native endian */
+#define PLAYLIST_CACHE_MAGIC   0x424C534B /* "KSLB" */
+#define PLAYLIST_CACHE_VERSION 1
+#define PLAYLIST_CACHE_STRINGS 8
+#define PLAYLIST_CACHE_VALUES  9
+
+#define PLAYLIST_CACHE_FLAG_OLD_FORMAT (1 << 0)
+#define PLAYLIST_CACHE_FLAG_COMPRESSED (1 << 1)
+
+typedef struct
+{
+   uint32_t magic;
+   uint32_t version;
+   uint64_t size;
+   uint64_t mtime;
+   uint32_t entry_count;
+   uint32_t rom_count;
+   uint32_t strings_size;
+   uint32_t default_core_path;
+   uint32_t default_core_name;
+   uint32_t base_content_directory;
+   uint32_t label_display_mode;
+   uint32_t right_thumbnail_mode;
+   uint32_t left_thumbnail_mode;
+   uint32_t sort_mode;
+   uint32_t flags;
+   uint32_t reserved;
+} playlist_cache_header_t;
+
+typedef struct
+{
+   uint32_t strings[PLAYLIST_CACHE_STRINGS];
+   uint32_t values[PLAYLIST_CACHE_VALUES];
+   uint32_t roms;
+   uint32_t rom_count;
+   uint32_t reserved;
+} playlist_cache_record_t;
+
+/* The fields of playlist_entry which are saved
+ * in the playlist, in record order */
+static const size_t playlist_cache_strings[PLAYLIST_CACHE_STRINGS] = {
+   offsetof(struct playlist_entry, path),
+   offsetof(struct playlist_entry, label),
+   offsetof(struct playlist_entry, core_path),
+   offsetof(struct playlist_entry, core_name),
+   offsetof(struct playlist_entry, db_name),
+   offsetof(struct playlist_entry, crc32),
+   offsetof(struct playlist_entry, subsystem_ident),
+   offsetof(struct playlist_entry, subsystem_name),
+};
+
+static const size_t playlist_cache_values[PLAYLIST_CACHE_VALUES] = {
+   offsetof(struct playlist_entry, runtime_hours),
+   offsetof(struct playlist_entry, runtime_minutes),
+   offsetof(struct playlist_entry, runtime_seconds),
+   offsetof(struct playlist_entry, last_played_year),
+   offsetof(struct playlist_entry, last_played_month),
+   offsetof(struct playlist_entry, last_played_day),
+   offsetof(struct playlist_entry, last_played_hour),
+   offsetof(struct playlist_entry, last_played_minute),
+   offsetof(struct playlist_entry, last_played_second),
+};
+
+#define PLAYLIST_CACHE_ENTRY_STR(entry, i) \
+   ((char**)((uint8_t*)(entry) + playlist_cache_strings[i]))
+#define PLAYLIST_CACHE_ENTRY_VALUE(entry, i) \
+   ((unsigned*)((uint8_t*)(entry) + playlist_cache_values[i]))
+
+static void playlist_cache_path(const playlist_t *playlist,
+      char *s, size_t len)
+{
+   strlcpy(s, playlist->config.path, len);
+   strlcat(s, "b", len);
+}
+
+static bool playlist_cache_stat(const char *path,
+      uint64_t *size, uint64_t *mtime)
+{
+   struct stat st;
+
+   if (string_is_empty(path) || stat(path, &st) != 0)
+      return false;
+
+   *size  = (uint64_t)st.st_size;
+   *mtime = (uint64_t)st.st_mtime;
+
+   return true;
+}
+
+static void playlist_cache_unload(playlist_t *playlist)
+{
+   if (playlist->cache_data)
+   {
+#ifdef HAVE_MMAP
+      if (playlist->cache_mapped)
+         munmap(playlist->cache_data, playlist->cache_size);
+      else
+#endif
+         free(playlist->cache_data);
+   }
+
+   playlist->cache_data   = NULL;
+   playlist->cache_size   = 0;
+   playlist->cache_mapped = false;
+}
+
+static char *playlist_cache_string(const char *strings, uint32_t offset)
+{
+   return offset ? (char*)strings + offset : NULL;
+}
+
+/* Fills the playlist from its binary cache, if there is
+ * one which is up to date. Entries are set up to point
+ * at the strings in the cache, which is mapped, so that
+ * only the parts of it which are looked at are read */
+static bool playlist_cache_load(playlist_t *playlist)
+{
+   size_t i, j, count;
+   uint64_t expected, size, mtime;
+   char path[PATH_MAX_LENGTH];
+   const playlist_cache_header_t *header = NULL;
+   const playlist_cache_record_t *records = NULL;
+   const uint32_t *roms                   = NULL;
+   const char *strings                    = NULL;
+
+   if (     !playlist->config.binary_cache
+         || !playlist_cache_stat(playlist->config.path, &size, &mtime))
+      return false;
+
+   playlist_cache_path(playlist, path, sizeof(path));
+
+#ifdef HAVE_MMAP
+   {
+      struct stat st;
+      int fd = open(path, O_RDONLY);
+
+      if (fd >= 0)
+      {
+         if (fstat(fd, &st) == 0 && st.st_size > 0)
+         {
+            /* Private and writable, so that nothing which
+             * writes to an entry string can fault */
+            void *data = mmap(NULL, (size_t)st.st_size,
+                  PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+            if (data != MAP_FAILED)
+            {
+               playlist->cache_data   = (uint8_t*)data;
+               playlist->cache_size   = (size_t)st.st_size;
+               playlist->cache_mapped = true;
+            }
+         }
+         close(fd);
+      }
+   }
+#endif
+
+   if (!playlist->cache_data)
+   {
+      void *buf   = NULL;
+      int64_t len = 0;
+
+      if (!path_is_valid(path))
+         return false;
+
+      if (!filestream_read_file(path, &buf, &len) || len <= 0)
+      {
+         free(buf);
+         return false;
+      }
+
+      playlist->cache_data = (uint8_t*)buf;
+      playlist->cache_size = (size_t)len;
+   }
+
+   if (playlist->cache_size < sizeof(*header))
+      goto error;
+
+   header   = (const playlist_cache_header_t*)playlist->cache_data;
+   expected = sizeof(*header)
+      + (uint64_t)header->entry_count * sizeof(playlist_cache_record_t)
+      + (uint64_t)header->rom_count   * sizeof(uint32_t)
+      + header->strings_size;
+
+   if (     header->magic   != PLAYLIST_CACHE_MAGIC
+         || header->version != PLAYLIST_CACHE_VERSION
+         || expected        != playlist->cache_size
+         || header->strings_size < 1)
+      goto error;
+
+   /* Playlist was changed since the cache was written */
+   if (header->size != size || header->mtime != mtime)
+   {
+      playlist_cache_unload(playlist);
+      return false;
+   }
+
+   records = (const playlist_cache_record_t*)(header + 1);
+   roms    = (const uint32_t*)(records + header->entry_count);
+   strings = (const char*)(roms + header->rom_count);
+
+   if (     strings[0]
+         || strings[header->strings_size - 1]
+         || header->default_core_path      >= header->strings_size
+         || header->default_core_name      >= header->strings_size
+         || header->base_content_directory >= header->strings_size)
+      goto error;
+
+   for (i = 0; i < header->rom_count; i++)
+      if (roms[i] >= header->strings_size)
+         goto error;
+
+   /* Check every offset before the first entry is
+    * set up, so that a bad cache leaves no trace */
+   for (i = 0; i < header->entry_count; i++)
+   {
+      const playlist_cache_record_t *rec = &records[i];
+
+      if (     rec->roms > header->rom_count
+            || rec->rom_count > header->rom_count - rec->roms)
+         goto error;
+
+      for (j = 0; j < PLAYLIST_CACHE_STRINGS; j++)
+         if (rec->strings[j] >= header->strings_size)
+            goto error;
+   }
+
+   count = header->entry_count;
+   if (count > playlist->config.capacity)
+   {
+      KINGSN_WARN("JSON file contains more entries than current playlist capacity. Excess entries will be discarded.\n");
+      count              = playlist->config.capacity;
+      playlist->modified = true;
+   }
+
+   if (count && !RBUF_TRYFIT(playlist->entries, count))
+      goto error;
+   RBUF_RESIZE(playlist->entries, count);
+
+   for (i = 0; i < count; i++)
+   {
+      const playlist_cache_record_t *rec = &records[i];
+      struct playlist_entry *entry       = &playlist->entries[i];
+
+      memset(entry, 0, sizeof(*entry));
+
+      for (j = 0; j < PLAYLIST_CACHE_STRINGS; j++)
+         *PLAYLIST_CACHE_ENTRY_STR(entry, j) =
+            playlist_cache_string(strings, rec->strings[j]);
+
+      for (j = 0; j < PLAYLIST_CACHE_VALUES; j++)
+         *PLAYLIST_CACHE_ENTRY_VALUE(entry, j) = rec->values[j];
+
+      if (rec->rom_count)
+      {
+         union string_list_elem_attr attr = {0};
+
+         if ((entry->subsystem_roms = string_list_new()))
+            for (j = 0; j < rec->rom_count; j++)
+               string_list_append(entry->subsystem_roms,
+                     strings + roms[rec->roms + j], attr);
+      }
+   }
+
+   playlist->default_core_path      = playlist_cache_string(strings,
+         header->default_core_path);
+   playlist->default_core_name      = playlist_cache_string(strings,
+         header->default_core_name);
+   playlist->base_content_directory = playlist_cache_string(strings,
+         header->base_content_directory);
+   playlist->label_display_mode     =
+      (enum playlist_label_display_mode)header->label_display_mode;
+   playlist->right_thumbnail_mode   =
+      (enum playlist_thumbnail_mode)header->right_thumbnail_mode;
+   playlist->left_thumbnail_mode    =
+      (enum playlist_thumbnail_mode)header->left_thumbnail_mode;
+   playlist->sort_mode              =
+      (enum playlist_sort_mode)header->sort_mode;
+   playlist->old_format             =
+      (header->flags & PLAYLIST_CACHE_FLAG_OLD_FORMAT) != 0;
+   playlist->compressed             =
+      (header->flags & PLAYLIST_CACHE_FLAG_COMPRESSED) != 0;
+
+   return true;
+
+error:
+   KINGSN_WARN("[Playlist]: Ignoring invalid playlist cache \"%s\".\n", path);
+   playlist_cache_unload(playlist);
+   return false;
+}
+
+static uint32_t playlist_cache_push_string(char **strings, const char *s,
+      bool *ok)
+{
+   size_t len;
+   size_t offset = RBUF_LEN(*strings);
+
+   if (string_is_empty(s))
+      return 0;
+
+   len = strlen(s) + 1;
+
+   if (!RBUF_TRYFIT(*strings, offset + len))
+   {
+      *ok = false;
+      return 0;
+   }
+
+   RBUF_RESIZE(*strings, offset + len);
+   memcpy(*strings + offset, s, len);
+
+   return (uint32_t)offset;
+}
+
+/* Writes the binary cache for the playlist file as it
+ * is on disk now, which has to match the entries. The
+ * old cache may still be mapped; the mapping survives
+ * the file being replaced */
+static bool playlist_cache_write(playlist_t *playlist)
+{
+   size_t i, j;
+   char path[PATH_MAX_LENGTH];
+   char tmp_path[PATH_MAX_LENGTH];
+   playlist_cache_header_t header;
+   RFILE *fd                         = NULL;
+   playlist_cache_record_t *records  = NULL;
+   uint32_t *roms                    = NULL;
+   char *strings                     = NULL;
+   size_t count                      = RBUF_LEN(playlist->entries);
+   bool ok                           = true;
+   bool ret                          = false;
+
+   if (!playlist->config.binary_cache)
+      return false;
+
+   memset(&header, 0, sizeof(header));
+
+   if (!playlist_cache_stat(playlist->config.path,
+            &header.size, &header.mtime))
+      return false;
+
+   if (count && !(records = (playlist_cache_record_t*)
+            calloc(count, sizeof(*records))))
+      return false;
+
+   /* Offset 0 is the empty string */
+   if (!RBUF_TRYFIT(strings, 1))
+      goto end;
+   RBUF_PUSH(strings, '\0');
+
+   header.default_core_path      = playlist_cache_push_string(&strings,
+         playlist->default_core_path, &ok);
+   header.default_core_name      = playlist_cache_push_string(&strings,
+         playlist->default_core_name, &ok);
+   header.base_content_directory = playlist_cache_push_string(&strings,
+         playlist->base_content_directory, &ok);
+
+   for (i = 0; i < count; i++)
+   {
+      struct playlist_entry *entry = &playlist->entries[i];
+      playlist_cache_record_t *rec = &records[i];
+
+      for (j = 0; j < PLAYLIST_CACHE_STRINGS; j++)
+         rec->strings[j] = playlist_cache_push_string(&strings,
+               *PLAYLIST_CACHE_ENTRY_STR(entry, j), &ok);
+
+      for (j = 0; j < PLAYLIST_CACHE_VALUES; j++)
+         rec->values[j]  = *PLAYLIST_CACHE_ENTRY_VALUE(entry, j);
+
+      rec->roms          = (uint32_t)RBUF_LEN(roms);
+
+      /* Empty roms are written to the playlist,
+       * but not read back from it */
+      if (entry->subsystem_roms)
+      {
+         for (j = 0; j < entry->subsystem_roms->size; j++)
+         {
+            const char *rom = entry->subsystem_roms->elems[j].data;
+
+            if (string_is_empty(rom))
+               continue;
+
+            if (!RBUF_TRYFIT(roms, RBUF_LEN(roms) + 1))
+               ok = false;
+            else
+               RBUF_PUSH(roms,
+                     playlist_cache_push_string(&strings, rom, &ok));
+         }
+      }
+
+      rec->rom_count     = (uint32_t)RBUF_LEN(roms) - rec->roms;
+   }
+
+   if (!ok)
+      goto end;
+
+   header.magic                = PLAYLIST_CACHE_MAGIC;
+   header.version              = PLAYLIST_CACHE_VERSION;
+   header.entry_count          = (uint32_t)count;
+   header.rom_count            = (uint32_t)RBUF_LEN(roms);
+   header.strings_size         = (uint32_t)RBUF_LEN(strings);
+   header.label_display_mode   = (uint32_t)playlist->label_display_mode;
+   header.right_thumbnail_mode = (uint32_t)playlist->right_thumbnail_mode;
+   header.left_thumbnail_mode  = (uint32_t)playlist->left_thumbnail_mode;
+   header.sort_mode            = (uint32_t)playlist->sort_mode;
+
+   if (playlist->old_format)
+      header.flags |= PLAYLIST_CACHE_FLAG_OLD_FORMAT;
+   if (playlist->compressed)
+      header.flags |= PLAYLIST_CACHE_FLAG_COMPRESSED;
+
+   playlist_cache_path(playlist, path, sizeof(path));
+   strlcpy(tmp_path, path, sizeof(tmp_path));
+   strlcat(tmp_path, ".tmp", sizeof(tmp_path));
+
+   if (!(fd = filestream_open(tmp_path,
+               KS_VFS_FILE_ACCESS_WRITE, KS_VFS_FILE_ACCESS_HINT_NONE)))
+      goto end;
+
+   ret =    filestream_write(fd, &header, sizeof(header))
+               == (int64_t)sizeof(header)
+         && filestream_write(fd, records, count * sizeof(*records))
+               == (int64_t)(count * sizeof(*records))
+         && filestream_write(fd, roms, RBUF_SIZEOF(roms))
+               == (int64_t)RBUF_SIZEOF(roms)
+         && filestream_write(fd, strings, RBUF_LEN(strings))
+               == (int64_t)RBUF_LEN(strings);
+
+   if (filestream_close(fd) != 0)
+      ret = false;
+
+   /* Renaming over an existing file fails on some platforms.
+    * Those do not map the cache, so it can be deleted */
+   if (ret && filestream_rename(tmp_path, path) != 0)
+   {
+      filestream_delete(path);
+      ret = filestream_rename(tmp_path, path) == 0;
+   }
+
+   if (!ret)
+      filestream_delete(tmp_path);
+
+end:
+   free(records);
+   RBUF_FREE(roms);
+   RBUF_FREE(strings);
+
+   return ret;
+}
+
 void playlist_write_runtime_file(playlist_t *playlist)
 {
    size_t i, len;
@@ -1338,6 +2224,7 @@ void playlist_write_file(playlist_t *playlist)
    size_t i, len;
    intfstream_t *file = NULL;
    bool compressed    = false;
+   bool written       = false;
 
    /* Playlist will be written if any of the
     * following are true:
@@ -1635,11 +2522,17 @@ void playlist_write_file(playlist_t *playlist)
 
    playlist->modified   = false;
    playlist->compressed = compressed;
+   written              = true;
 
    KINGSN_LOG("[Playlist]: Written to playlist file: %s\n", playlist->config.path);
 end:
    intfstream_close(file);
    free(file);
+
+   if (written && playlist->config.binary_cache
+         && !playlist_cache_write(playlist))
+      KINGSN_ERR("[Playlist]: Failed to write playlist cache for: %s\n",
+            playlist->config.path);
 }
 
 /**
@@ -1655,16 +2548,13 @@ void playlist_free(playlist_t *playlist)
    if (!playlist)
       return;
 
-   if (playlist->default_core_path)
-      free(playlist->default_core_path);
+   playlist_free_string(playlist, playlist->default_core_path);
    playlist->default_core_path = NULL;
 
-   if (playlist->default_core_name)
-      free(playlist->default_core_name);
+   playlist_free_string(playlist, playlist->default_core_name);
    playlist->default_core_name = NULL;
 
-   if (playlist->base_content_directory)
-      free(playlist->base_content_directory);
+   playlist_free_string(playlist, playlist->base_content_directory);
    playlist->base_content_directory = NULL;
 
    if (playlist->entries)
@@ -1674,12 +2564,15 @@ void playlist_free(playlist_t *playlist)
          struct playlist_entry *entry = &playlist->entries[i];
 
          if (entry)
-            playlist_free_entry(entry);
+            playlist_free_entry(playlist, entry);
       }
 
       RBUF_FREE(playlist->entries);
    }
 
+   playlist_index_free(playlist);
+   playlist_cache_unload(playlist);
+
    free(playlist);
 }
 
@@ -1700,9 +2593,10 @@ void playlist_clear(playlist_t *playlist)
       struct playlist_entry *entry = &playlist->entries[i];
 
       if (entry)
-         playlist_free_entry(entry);
+         playlist_free_entry(playlist, entry);
    }
    RBUF_CLEAR(playlist->entries);
+   playlist_index_free(playlist);
 }
 
 /**
@@ -2046,17 +2940,22 @@ static bool playlist_read_file(playlist_t *playlist)
 {
    unsigned i;
    int test_char;
-   bool res = true;
+   bool res             = true;
+   bool parsed          = false;
+   intfstream_t *file   = NULL;
+
+   if (playlist_cache_load(playlist))
+      return true;
 
 #if defined(HAVE_ZLIB)
       /* Always use RZIP interface when reading playlists
        * > this will automatically handle uncompressed
        *   data */
-   intfstream_t *file   = intfstream_open_rzip_file(
+   file                 = intfstream_open_rzip_file(
          playlist->config.path,
          KS_VFS_FILE_ACCESS_READ);
 #else
-   intfstream_t *file   = intfstream_open_file(
+   file                 = intfstream_open_file(
          playlist->config.path,
          KS_VFS_FILE_ACCESS_READ,
          KS_VFS_FILE_ACCESS_HINT_NONE);
@@ -2128,7 +3027,9 @@ static bool playlist_read_file(playlist_t *playlist)
             JSONStartArrayHandler,
             JSONEndArrayHandler,
             NULL, NULL) /* unused boolean/null handlers */
-            != RJSON_DONE)
+            == RJSON_DONE)
+         parsed = true;
+      else
       {
          if (context.out_of_memory)
          {
@@ -2343,11 +3244,20 @@ static bool playlist_read_file(playlist_t *playlist)
             break;
          }
       }
+
+      /* Stopping at the capacity skips the rest of the file */
+      parsed = len < playlist->config.capacity;
    }
 
 end:
    intfstream_close(file);
    free(file);
+
+   /* Next time, load the cache instead. Not when entries
+    * were dropped, as it has to match the file */
+   if (res && parsed && !playlist->modified)
+      playlist_cache_write(playlist);
+
    return res;
 }
 
@@ -2408,6 +3318,12 @@ playlist_t *playlist_init(const playlist_config_t *config)
    playlist->default_core_path      = NULL;
    playlist->base_content_directory = NULL;
    playlist->entries                = NULL;
+   playlist->path_index             = NULL;
+   playlist->crc32_index            = NULL;
+   playlist->indexed                = false;
+   playlist->cache_data             = NULL;
+   playlist->cache_size             = 0;
+   playlist->cache_mapped           = false;
    playlist->label_display_mode     = LABEL_DISPLAY_MODE_DEFAULT;
    playlist->right_thumbnail_mode   = PLAYLIST_THUMBNAIL_MODE_DEFAULT;
    playlist->left_thumbnail_mode    = PLAYLIST_THUMBNAIL_MODE_DEFAULT;
@@ -2444,7 +3360,7 @@ playlist_t *playlist_init(const playlist_config_t *config)
                playlist->base_content_directory, playlist->config.base_content_directory,
                sizeof(tmp_entry_path));
 
-            free(entry->path);
+            playlist_free_string(playlist, entry->path);
             entry->path = strdup(tmp_entry_path);
 
             /* Fix subsystem roms paths*/
@@ -2478,8 +3394,7 @@ playlist_t *playlist_init(const playlist_config_t *config)
       }
 
       /* Update playlist base content directory*/
-      if (playlist->base_content_directory)
-         free(playlist->base_content_directory);
+      playlist_free_string(playlist, playlist->base_content_directory);
       playlist->base_content_directory = strdup(playlist->config.base_content_directory);
 
       /* Save playlist */
@@ -2585,6 +3500,8 @@ void playlist_qsort(playlist_t *playlist)
    qsort(playlist->entries, RBUF_LEN(playlist->entries),
          sizeof(struct playlist_entry),
          (int (*)(const void *, const void *))playlist_qsort_func);
+
+   playlist_index_update_hints(playlist);
 }
 
 void command_playlist_push_write(
@@ -2776,8 +3693,7 @@ void playlist_set_default_core_path(playlist_t *playlist, const char *core_path)
 
    if (!string_is_equal(playlist->default_core_path, real_core_path))
    {
-      if (playlist->default_core_path)
-         free(playlist->default_core_path);
+      playlist_free_string(playlist, playlist->default_core_path);
       playlist->default_core_path = strdup(real_core_path);
       playlist->modified = true;
    }
@@ -2791,8 +3707,7 @@ void playlist_set_default_core_name(
 
    if (!string_is_equal(playlist->default_core_name, core_name))
    {
-      if (playlist->default_core_name)
-         free(playlist->default_core_name);
+      playlist_free_string(playlist, playlist->default_core_name);
       playlist->default_core_name = strdup(core_name);
       playlist->modified = true;
    }
@@ -19,6 +19,7 @@
 #define _PLAYLIST_H__
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <ks_common_api.h>
 #include <boolean.h>
@@ -112,6 +113,12 @@ struct playlist_entry
    unsigned last_played_minute;
    unsigned last_played_second;
    enum playlist_runtime_status runtime_status;
+   /* Hashes of the 'real' content path and of the
+    * crc32/db_name pair, kept by the playlist lookup
+    * index. Ignored in entries passed to playlist
+    * functions. */
+   uint32_t path_hash;
+   uint32_t crc32_hash;
 };
 
 /* Holds all configuration parameters required
@@ -123,6 +130,7 @@ typedef struct
    bool compress;
    bool fuzzy_archive_match;
    bool autofix_paths;   
+   bool binary_cache;
    char path[PATH_MAX_LENGTH];
    char base_content_directory[PATH_MAX_LENGTH];
 } playlist_config_t;
@@ -267,6 +275,20 @@ void playlist_get_index_by_path(playlist_t *playlist,
 bool playlist_entry_exists(playlist_t *playlist,
       const char *path);
 
+/**
+ * playlist_get_index_by_crc32:
+ * @playlist            : Playlist handle.
+ * @crc32               : CRC32 value, as stored in the playlist.
+ * @db_name             : Database name (can be NULL).
+ * @entry               : Set to the first entry with the same
+ *                        CRC32 (case insensitive) and database name.
+ *
+ * Leaves @entry unchanged if there is no such entry.
+ **/
+void playlist_get_index_by_crc32(playlist_t *playlist,
+      const char *crc32, const char *db_name,
+      const struct playlist_entry **entry);
+
 char *playlist_get_conf_path(playlist_t *playlist);
 
 uint32_t playlist_get_size(playlist_t *playlist);
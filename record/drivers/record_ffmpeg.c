@@ -25,7 +25,9 @@
 
 #include <boolean.h>
 #include <queues/fifo_queue.h>
+#include <queues/job_pipeline.h>
 #include <rthreads/rthreads.h>
+#include <features/features_cpu.h>
 #include <gfx/scaler/scaler.h>
 #include <gfx/video_frame.h>
 #include <file/config_file.h>
@@ -125,13 +127,40 @@ extern "C" {
 #define av_frame_free avcodec_free_frame
 #endif
 
+/* Video frames that can be queued for conversion and encoding,
+ * plus the one the encoder keeps around for dupes. */
+#define FF_FRAME_POOL (8 + 1)
+
+/* Most threads that convert frames at the same time */
+#define FF_MAX_CONVERT_THREADS 4
+
+/* Frames come from a fixed pool. A frame is referenced while
+ * it is in the pipeline, and by the encoder for as long as it
+ * is the last picture, which dupes encode again. Each frame has
+ * its own scaler, as several are converted at the same time. */
+struct ff_frame
+{
+   struct record_video_data attr;
+
+   AVFrame *conv_frame;
+   uint8_t *conv_frame_buf;
+
+   /* Copy of the input, unless the caller lent us its frame
+    * until attr.release is called. */
+   uint8_t *buf;
+   size_t buf_size;
+
+   struct scaler_ctx scaler;
+   struct SwsContext *sws;
+
+   unsigned refs;
+};
+
 struct ff_video_info
 {
    AVCodecContext *codec;
    AVCodec *encoder;
 
-   AVFrame *conv_frame;
-   uint8_t *conv_frame_buf;
    int64_t frame_cnt;
 
    uint8_t *outbuf;
@@ -150,8 +179,8 @@ struct ff_video_info
 
    AVFormatContext *format;
 
+   /* Only holds the formats, every frame has its own scaler. */
    struct scaler_ctx scaler;
-   struct SwsContext *sws;
    bool use_sws;
 };
 
@@ -235,16 +264,29 @@ typedef struct ffmpeg
 
    struct record_params params;
 
+   /* cond wakes the encoder thread, audio_cond wakes
+    * ffmpeg_push_audio() once there is room in the fifo.
+    * Both are waited on with cond_lock held. */
    scond_t *cond;
+   scond_t *audio_cond;
    slock_t *cond_lock;
    slock_t *lock;
    fifo_buffer_t *audio_fifo;
-   fifo_buffer_t *video_fifo;
-   fifo_buffer_t *attr_fifo;
    sthread_t *thread;
 
+   /* Converts frames on worker threads, the encoder
+    * thread takes them out in order. */
+   job_pipeline_t *video_pipeline;
+   struct ff_frame frames[FF_FRAME_POOL];
+   struct ff_frame *last_frame;
+   slock_t *frame_lock;
+   scond_t *frame_cond;
+
    volatile bool alive;
-   volatile bool can_sleep;
+   /* Set under cond_lock when a frame finishes converting
+    * or audio is queued, so the encoder does not sleep
+    * through work that arrived after it last looked. */
+   bool work_pending;
 } ffmpeg_t;
 
 AVFormatContext *ctx;
@@ -426,7 +468,6 @@ static bool ffmpeg_init_audio(ffmpeg_t *handle, const char *audio_resampler)
 
 static bool ffmpeg_init_video(ffmpeg_t *handle)
 {
-   size_t size;
    struct ff_config_param *params  = &handle->config;
    struct ff_video_info *video     = &handle->video;
    struct record_params *param     = &handle->params;
@@ -548,18 +589,6 @@ static bool ffmpeg_init_video(ffmpeg_t *handle)
 
    video->frame_drop_ratio = params->frame_drop_ratio;
 
-   size = avpicture_get_size(video->pix_fmt, param->out_width,
-         param->out_height);
-   video->conv_frame_buf   = (uint8_t*)av_malloc(size);
-   video->conv_frame       = av_frame_alloc();
-
-   avpicture_fill((AVPicture*)video->conv_frame, video->conv_frame_buf,
-         video->pix_fmt, param->out_width, param->out_height);
-
-   video->conv_frame->width  = param->out_width;
-   video->conv_frame->height = param->out_height;
-   video->conv_frame->format = video->pix_fmt;
-
    return true;
 }
 
@@ -925,29 +954,69 @@ static bool ffmpeg_init_muxer_post(ffmpeg_t *handle)
 #define MAX_FRAMES 32
 
 static void ffmpeg_thread(void *data);
+static void ffmpeg_convert_frame(void *job, void *userdata);
+static void ffmpeg_discard_frame(void *job);
 
 static bool init_thread(ffmpeg_t *handle)
 {
+   unsigned i;
+   unsigned workers = cpu_features_get_core_amount();
+   int size         = avpicture_get_size(handle->video.pix_fmt,
+         handle->params.out_width, handle->params.out_height);
+
+   for (i = 0; i < FF_FRAME_POOL; i++)
+   {
+      struct ff_frame *frame = &handle->frames[i];
+
+      frame->conv_frame_buf  = (uint8_t*)av_malloc(size);
+      frame->conv_frame      = av_frame_alloc();
+
+      if (!frame->conv_frame_buf || !frame->conv_frame)
+         return false;
+
+      avpicture_fill((AVPicture*)frame->conv_frame, frame->conv_frame_buf,
+            handle->video.pix_fmt,
+            handle->params.out_width, handle->params.out_height);
+
+      frame->conv_frame->width  = handle->params.out_width;
+      frame->conv_frame->height = handle->params.out_height;
+      frame->conv_frame->format = handle->video.pix_fmt;
+
+      frame->scaler.in_fmt      = handle->video.scaler.in_fmt;
+      frame->scaler.out_fmt     = handle->video.scaler.out_fmt;
+   }
+
+   /* Leave a core to the main thread and one to the encoder. */
+   workers = workers > 3 ? workers - 2 : 1;
+   workers = MIN(workers, FF_MAX_CONVERT_THREADS);
+
    handle->lock = slock_new();
    handle->cond_lock = slock_new();
    handle->cond = scond_new();
+   handle->audio_cond = scond_new();
+   handle->frame_lock = slock_new();
+   handle->frame_cond = scond_new();
    handle->audio_fifo = fifo_new(32000 * sizeof(int16_t) *
          handle->params.channels * MAX_FRAMES / 60); /* Some arbitrary max size. */
-   handle->attr_fifo = fifo_new(sizeof(struct record_video_data) * MAX_FRAMES);
-   handle->video_fifo = fifo_new(handle->params.fb_width * handle->params.fb_height *
-            handle->video.pix_size * MAX_FRAMES);
+   /* Deep enough for the whole pool, so a frame that
+    * ffmpeg_frame_get() handed out always fits. */
+   handle->video_pipeline = job_pipeline_new(workers, FF_FRAME_POOL,
+         ffmpeg_convert_frame, handle);
 
    handle->alive = true;
-   handle->can_sleep = true;
+   handle->work_pending = false;
    handle->thread = sthread_create(ffmpeg_thread, handle);
 
    ks_assert(handle->lock && handle->cond_lock &&
-      handle->cond && handle->audio_fifo &&
-      handle->attr_fifo && handle->video_fifo && handle->thread);
+      handle->cond && handle->audio_cond &&
+      handle->frame_lock && handle->frame_cond &&
+      handle->audio_fifo && handle->video_pipeline && handle->thread);
 
    return true;
 }
 
+/* Only stops the encoder thread, the buffers and locks are
+ * still needed to flush what is left in them. */
 static void deinit_thread(ffmpeg_t *handle)
 {
    if (!handle->thread)
@@ -955,38 +1024,74 @@ static void deinit_thread(ffmpeg_t *handle)
 
    slock_lock(handle->cond_lock);
    handle->alive = false;
-   handle->can_sleep = false;
+   scond_signal(handle->cond);
+   scond_broadcast(handle->audio_cond);
    slock_unlock(handle->cond_lock);
 
-   scond_signal(handle->cond);
    sthread_join(handle->thread);
 
-   slock_free(handle->lock);
-   slock_free(handle->cond_lock);
-   scond_free(handle->cond);
-
    handle->thread = NULL;
 }
 
 static void deinit_thread_buf(ffmpeg_t *handle)
 {
-   if (handle->audio_fifo)
+   unsigned i;
+
+   /* Joins the converters, frames which never made it out
+    * still have to give back what they borrowed. */
+   if (handle->video_pipeline)
    {
-      fifo_free(handle->audio_fifo);
-      handle->audio_fifo = NULL;
+      job_pipeline_free(handle->video_pipeline, ffmpeg_discard_frame);
+      handle->video_pipeline = NULL;
    }
 
-   if (handle->attr_fifo)
+   handle->last_frame = NULL;
+
+   for (i = 0; i < FF_FRAME_POOL; i++)
    {
-      fifo_free(handle->attr_fifo);
-      handle->attr_fifo = NULL;
+      struct ff_frame *frame = &handle->frames[i];
+
+      av_frame_free(&frame->conv_frame);
+      av_free(frame->conv_frame_buf);
+      frame->conv_frame_buf = NULL;
+
+      free(frame->buf);
+      frame->buf            = NULL;
+      frame->buf_size       = 0;
+
+      scaler_ctx_gen_reset(&frame->scaler);
+
+      if (frame->sws)
+         sws_freeContext(frame->sws);
+      frame->sws            = NULL;
+      frame->refs           = 0;
    }
 
-   if (handle->video_fifo)
+   if (handle->audio_fifo)
    {
-      fifo_free(handle->video_fifo);
-      handle->video_fifo = NULL;
+      fifo_free(handle->audio_fifo);
+      handle->audio_fifo = NULL;
    }
+
+   if (handle->lock)
+      slock_free(handle->lock);
+   if (handle->cond_lock)
+      slock_free(handle->cond_lock);
+   if (handle->cond)
+      scond_free(handle->cond);
+   if (handle->audio_cond)
+      scond_free(handle->audio_cond);
+   if (handle->frame_lock)
+      slock_free(handle->frame_lock);
+   if (handle->frame_cond)
+      scond_free(handle->frame_cond);
+
+   handle->lock       = NULL;
+   handle->cond_lock  = NULL;
+   handle->cond       = NULL;
+   handle->audio_cond = NULL;
+   handle->frame_lock = NULL;
+   handle->frame_cond = NULL;
 }
 
 static void ffmpeg_free(void *data)
@@ -1012,14 +1117,8 @@ static void ffmpeg_free(void *data)
       av_free(handle->video.codec);
    }
 
-   av_frame_free(&handle->video.conv_frame);
-   av_free(handle->video.conv_frame_buf);
-
    scaler_ctx_gen_reset(&handle->video.scaler);
 
-   if (handle->video.sws)
-      sws_freeContext(handle->video.sws);
-
    if (handle->config.conf)
       config_file_free(handle->config.conf);
    if (handle->config.video_opts)
@@ -1097,73 +1196,146 @@ error:
    return NULL;
 }
 
+/* Gives back the frame the caller lent us, if any. */
+static void ffmpeg_frame_release_input(struct record_video_data *vid)
+{
+   if (vid->release)
+      vid->release(vid->userdata);
+   vid->release  = NULL;
+   vid->userdata = NULL;
+   vid->data     = NULL;
+}
+
+/* Takes a free frame out of the pool, waits for the
+ * encoder to be done with one if there is none. */
+static struct ff_frame *ffmpeg_frame_get(ffmpeg_t *handle)
+{
+   unsigned i;
+   struct ff_frame *frame = NULL;
+
+   slock_lock(handle->frame_lock);
+   for (;;)
+   {
+      for (i = 0; i < FF_FRAME_POOL; i++)
+      {
+         if (!handle->frames[i].refs)
+         {
+            frame = &handle->frames[i];
+            break;
+         }
+      }
+
+      if (frame || !handle->alive)
+         break;
+
+      scond_wait(handle->frame_cond, handle->frame_lock);
+   }
+
+   if (frame)
+      frame->refs = 1;
+   slock_unlock(handle->frame_lock);
+
+   return frame;
+}
+
+static void ffmpeg_frame_ref(ffmpeg_t *handle, struct ff_frame *frame)
+{
+   slock_lock(handle->frame_lock);
+   frame->refs++;
+   slock_unlock(handle->frame_lock);
+}
+
+static void ffmpeg_frame_unref(ffmpeg_t *handle, struct ff_frame *frame)
+{
+   slock_lock(handle->frame_lock);
+   if (--frame->refs == 0)
+      scond_signal(handle->frame_cond);
+   slock_unlock(handle->frame_lock);
+}
+
 static bool ffmpeg_push_video(void *data,
       const struct record_video_data *vid)
 {
    unsigned y;
-   struct record_video_data attr_data;
-   bool drop_frame  = false;
-   ffmpeg_t *handle = (ffmpeg_t*)data;
-   int       offset = 0;
+   struct record_video_data input;
+   struct ff_frame *frame = NULL;
+   bool drop_frame        = false;
+   ffmpeg_t *handle       = (ffmpeg_t*)data;
 
-   if (!handle || !vid)
+   if (!vid)
       return false;
 
+   /* From here on we own whatever vid lends us */
+   input = *vid;
+
+   if (!handle)
+   {
+      ffmpeg_frame_release_input(&input);
+      return false;
+   }
+
    drop_frame       = handle->video.frame_drop_count++ %
       handle->video.frame_drop_ratio;
 
    handle->video.frame_drop_count %= handle->video.frame_drop_ratio;
 
    if (drop_frame)
+   {
+      ffmpeg_frame_release_input(&input);
       return true;
+   }
 
-   for (;;)
+   if (!(frame = ffmpeg_frame_get(handle)))
    {
-      unsigned avail;
-
-      slock_lock(handle->lock);
-      avail = FIFO_WRITE_AVAIL(handle->attr_fifo);
-      slock_unlock(handle->lock);
-
-      if (!handle->alive)
-         return false;
-
-      if (avail >= sizeof(*vid))
-         break;
+      ffmpeg_frame_release_input(&input);
+      return false;
+   }
 
-      slock_lock(handle->cond_lock);
-      if (handle->can_sleep)
+   if (input.is_dupe)
+   {
+      ffmpeg_frame_release_input(&input);
+      input.width = input.height = input.pitch = 0;
+   }
+   else if (!input.release)
+   {
+      /* Tightly pack our frame to conserve memory.
+       * libks tends to use a very large pitch.
+       */
+      const uint8_t *src = (const uint8_t*)input.data;
+      size_t pitch       = input.width * handle->video.pix_size;
+      size_t size        = pitch * input.height;
+
+      if (size > frame->buf_size)
       {
-         handle->can_sleep = false;
-         scond_wait(handle->cond, handle->cond_lock);
-         handle->can_sleep = true;
-      }
-      else
-         scond_signal(handle->cond);
+         uint8_t *buf = (uint8_t*)realloc(frame->buf, size);
 
-      slock_unlock(handle->cond_lock);
-   }
+         if (!buf)
+         {
+            ffmpeg_frame_unref(handle, frame);
+            return false;
+         }
 
-   slock_lock(handle->lock);
+         frame->buf      = buf;
+         frame->buf_size = size;
+      }
 
-   /* Tightly pack our frame to conserve memory.
-    * libks tends to use a very large pitch.
-    */
-   attr_data = *vid;
+      for (y = 0; y < input.height; y++, src += input.pitch)
+         memcpy(frame->buf + y * pitch, src, pitch);
 
-   if (attr_data.is_dupe)
-      attr_data.width = attr_data.height = attr_data.pitch = 0;
-   else
-      attr_data.pitch = attr_data.width * handle->video.pix_size;
-
-   fifo_write(handle->attr_fifo, &attr_data, sizeof(attr_data));
+      input.data  = frame->buf;
+      input.pitch = (int)pitch;
+   }
+   /* Otherwise the frame is converted straight from the
+    * caller's memory, which is given back once it is. */
 
-   for (y = 0; y < attr_data.height; y++, offset += vid->pitch)
-      fifo_write(handle->video_fifo,
-            (const uint8_t*)vid->data + offset, attr_data.pitch);
+   frame->attr = input;
 
-   slock_unlock(handle->lock);
-   scond_signal(handle->cond);
+   if (!job_pipeline_push(handle->video_pipeline, frame))
+   {
+      ffmpeg_frame_release_input(&frame->attr);
+      ffmpeg_frame_unref(handle, frame);
+      return false;
+   }
 
    return true;
 }
@@ -1179,6 +1351,7 @@ static bool ffmpeg_push_audio(void *data,
    if (!handle->config.audio_enable)
       return true;
 
+   slock_lock(handle->cond_lock);
    for (;;)
    {
       unsigned avail;
@@ -1188,30 +1361,30 @@ static bool ffmpeg_push_audio(void *data,
       slock_unlock(handle->lock);
 
       if (!handle->alive)
+      {
+         slock_unlock(handle->cond_lock);
          return false;
+      }
 
       if (avail >= audio_data->frames * handle->params.channels
             * sizeof(int16_t))
          break;
 
-      slock_lock(handle->cond_lock);
-      if (handle->can_sleep)
-      {
-         handle->can_sleep = false;
-         scond_wait(handle->cond, handle->cond_lock);
-         handle->can_sleep = true;
-      }
-      else
-         scond_signal(handle->cond);
-
-      slock_unlock(handle->cond_lock);
+      /* The encoder takes cond_lock to signal after reading,
+       * so it cannot make room between the check and the wait */
+      scond_wait(handle->audio_cond, handle->cond_lock);
    }
+   slock_unlock(handle->cond_lock);
 
    slock_lock(handle->lock);
    fifo_write(handle->audio_fifo, audio_data->data,
          audio_data->frames * handle->params.channels * sizeof(int16_t));
    slock_unlock(handle->lock);
+
+   slock_lock(handle->cond_lock);
+   handle->work_pending = true;
    scond_signal(handle->cond);
+   slock_unlock(handle->cond_lock);
 
    return true;
 }
@@ -1274,9 +1447,10 @@ static bool encode_video(ffmpeg_t *handle, AVFrame *frame)
    return true;
 }
 
-static void ffmpeg_scale_input(ffmpeg_t *handle,
-      const struct record_video_data *vid)
+/* Runs on the converter threads, several frames at once. */
+static void ffmpeg_scale_input(ffmpeg_t *handle, struct ff_frame *frame)
 {
+   const struct record_video_data *vid = &frame->attr;
    /* Attempt to preserve more information if we scale down. */
    bool shrunk = handle->params.out_width < vid->width
       || handle->params.out_height < vid->height;
@@ -1284,44 +1458,97 @@ static void ffmpeg_scale_input(ffmpeg_t *handle,
    if (handle->video.use_sws)
    {
       int linesize      = vid->pitch;
+      enum PixelFormat in_pix_fmt = vid->rgba
+         ? PIX_FMT_RGBA : handle->video.in_pix_fmt;
 
-      handle->video.sws = sws_getCachedContext(handle->video.sws,
-            vid->width, vid->height, handle->video.in_pix_fmt,
+      frame->sws        = sws_getCachedContext(frame->sws,
+            vid->width, vid->height, in_pix_fmt,
             handle->params.out_width, handle->params.out_height,
             handle->video.pix_fmt,
             shrunk ? SWS_BILINEAR : SWS_POINT, NULL, NULL, NULL);
 
-      sws_scale(handle->video.sws, (const uint8_t* const*)&vid->data,
-            &linesize, 0, vid->height, handle->video.conv_frame->data,
-            handle->video.conv_frame->linesize);
+      sws_scale(frame->sws, (const uint8_t* const*)&vid->data,
+            &linesize, 0, vid->height, frame->conv_frame->data,
+            frame->conv_frame->linesize);
    }
    else
+   {
+      enum scaler_pix_fmt in_fmt = vid->rgba
+         ? SCALER_FMT_ABGR8888 : handle->video.scaler.in_fmt;
+
+      /* video_frame_record_scale() only regenerates the
+       * filter when the size changes. */
+      if (     frame->scaler.in_fmt    != in_fmt
+            || frame->scaler.in_stride != vid->pitch)
+      {
+         frame->scaler.in_fmt   = in_fmt;
+         frame->scaler.in_width = 0;
+      }
+
       video_frame_record_scale(
-            &handle->video.scaler,
-            handle->video.conv_frame->data[0],
+            &frame->scaler,
+            frame->conv_frame->data[0],
             vid->data,
             handle->params.out_width,
             handle->params.out_height,
-            handle->video.conv_frame->linesize[0],
+            frame->conv_frame->linesize[0],
             vid->width,
             vid->height,
             vid->pitch,
             shrunk);
+   }
+}
+
+static void ffmpeg_convert_frame(void *job, void *userdata)
+{
+   struct ff_frame *frame = (struct ff_frame*)job;
+   ffmpeg_t *handle       = (ffmpeg_t*)userdata;
+
+   if (!frame->attr.is_dupe)
+      ffmpeg_scale_input(handle, frame);
+
+   ffmpeg_frame_release_input(&frame->attr);
+
+   slock_lock(handle->cond_lock);
+   handle->work_pending = true;
+   scond_signal(handle->cond);
+   slock_unlock(handle->cond_lock);
+}
+
+static void ffmpeg_discard_frame(void *job)
+{
+   ffmpeg_frame_release_input(&((struct ff_frame*)job)->attr);
 }
 
+/* Encodes a converted frame and drops the pipeline's
+ * reference to it. A dupe encodes the last picture again. */
 static bool ffmpeg_push_video_thread(ffmpeg_t *handle,
-      const struct record_video_data *vid)
+      struct ff_frame *frame)
 {
-   if (!vid->is_dupe)
-      ffmpeg_scale_input(handle, vid);
+   bool ret                 = true;
+   struct ff_frame *picture = frame;
 
-   handle->video.conv_frame->pts = handle->video.frame_cnt;
+   if (frame->attr.is_dupe)
+      picture = handle->last_frame;
+   else
+   {
+      ffmpeg_frame_ref(handle, frame);
+      if (handle->last_frame)
+         ffmpeg_frame_unref(handle, handle->last_frame);
+      handle->last_frame = frame;
+   }
 
-   if (!encode_video(handle, handle->video.conv_frame))
-      return false;
+   if (picture)
+   {
+      picture->conv_frame->pts = handle->video.frame_cnt;
+      ret = encode_video(handle, picture->conv_frame);
+   }
 
-   handle->video.frame_cnt++;
-   return true;
+   if (ret)
+      handle->video.frame_cnt++;
+
+   ffmpeg_frame_unref(handle, frame);
+   return ret;
 }
 
 static void planarize_float(float *out, const float *in, size_t frames)
@@ -1606,8 +1833,6 @@ static void ffmpeg_flush_buffers(ffmpeg_t *handle)
 {
    void *audio_buf       = NULL;
    bool did_work         = false;
-   void *video_buf       = av_malloc(2 * handle->params.fb_width *
-         handle->params.fb_height * handle->video.pix_size);
    size_t audio_buf_size = handle->config.audio_enable ?
       (handle->audio.codec->frame_size *
        handle->params.channels * sizeof(int16_t)) : 0;
@@ -1619,8 +1844,6 @@ static void ffmpeg_flush_buffers(ffmpeg_t *handle)
 
    do
    {
-      struct record_video_data attr_buf;
-
       did_work = false;
 
       if (handle->config.audio_enable)
@@ -1638,13 +1861,10 @@ static void ffmpeg_flush_buffers(ffmpeg_t *handle)
          }
       }
 
-      if (FIFO_READ_AVAIL(handle->attr_fifo) >= sizeof(attr_buf))
+      if (job_pipeline_peek(handle->video_pipeline))
       {
-         fifo_read(handle->attr_fifo, &attr_buf, sizeof(attr_buf));
-         fifo_read(handle->video_fifo, video_buf,
-               attr_buf.height * attr_buf.pitch);
-         attr_buf.data = video_buf;
-         ffmpeg_push_video_thread(handle, &attr_buf);
+         ffmpeg_push_video_thread(handle, (struct ff_frame*)
+               job_pipeline_pop(handle->video_pipeline, true));
 
          did_work = true;
       }
@@ -1657,7 +1877,6 @@ static void ffmpeg_flush_buffers(ffmpeg_t *handle)
    /* Flush out last video. */
    ffmpeg_flush_video(handle);
 
-   av_free(video_buf);
    av_free(audio_buf);
 }
 
@@ -1687,12 +1906,6 @@ static void ffmpeg_thread(void *data)
    size_t audio_buf_size;
    void *audio_buf = NULL;
    ffmpeg_t *ff    = (ffmpeg_t*)data;
-   /* For some reason, FFmpeg has a tendency to crash
-    * if we don't overallocate a bit. */
-   void *video_buf = av_malloc(2 * ff->params.fb_width *
-         ff->params.fb_height * ff->video.pix_size);
-
-   ks_assert(video_buf);
 
    audio_buf_size = ff->config.audio_enable ?
       (ff->audio.codec->frame_size * ff->params.channels * sizeof(int16_t)) : 0;
@@ -1700,47 +1913,33 @@ static void ffmpeg_thread(void *data)
 
    while (ff->alive)
    {
-      struct record_video_data attr_buf;
-
-      bool avail_video = false;
-      bool avail_audio = false;
-
-      slock_lock(ff->lock);
-      if (FIFO_READ_AVAIL(ff->attr_fifo) >= sizeof(attr_buf))
-         avail_video = true;
+      /* Frames come out in the order they were pushed,
+       * once they are converted. */
+      struct ff_frame *frame = (struct ff_frame*)
+         job_pipeline_pop(ff->video_pipeline, false);
+      bool avail_audio       = false;
 
       if (ff->config.audio_enable)
+      {
+         slock_lock(ff->lock);
          if (FIFO_READ_AVAIL(ff->audio_fifo) >= audio_buf_size)
             avail_audio = true;
-      slock_unlock(ff->lock);
+         slock_unlock(ff->lock);
+      }
 
-      if (!avail_video && !avail_audio)
+      if (!frame && !avail_audio)
       {
+         /* Anything that completed since the checks above
+          * left work_pending set, so no wakeup is lost */
          slock_lock(ff->cond_lock);
-         if (ff->can_sleep)
-         {
-            ff->can_sleep = false;
+         while (!ff->work_pending && ff->alive)
             scond_wait(ff->cond, ff->cond_lock);
-            ff->can_sleep = true;
-         }
-         else
-            scond_signal(ff->cond);
-
+         ff->work_pending = false;
          slock_unlock(ff->cond_lock);
       }
 
-      if (avail_video && video_buf)
-      {
-         slock_lock(ff->lock);
-         fifo_read(ff->attr_fifo, &attr_buf, sizeof(attr_buf));
-         fifo_read(ff->video_fifo, video_buf,
-               attr_buf.height * attr_buf.pitch);
-         slock_unlock(ff->lock);
-         scond_signal(ff->cond);
-
-         attr_buf.data = video_buf;
-         ffmpeg_push_video_thread(ff, &attr_buf);
-      }
+      if (frame)
+         ffmpeg_push_video_thread(ff, frame);
 
       if (avail_audio && audio_buf)
       {
@@ -1749,7 +1948,10 @@ static void ffmpeg_thread(void *data)
          slock_lock(ff->lock);
          fifo_read(ff->audio_fifo, audio_buf, audio_buf_size);
          slock_unlock(ff->lock);
-         scond_signal(ff->cond);
+
+         slock_lock(ff->cond_lock);
+         scond_signal(ff->audio_cond);
+         slock_unlock(ff->cond_lock);
 
          aud.frames = ff->audio.codec->frame_size;
          aud.data   = audio_buf;
@@ -1758,7 +1960,6 @@ static void ffmpeg_thread(void *data)
       }
    }
 
-   av_free(video_buf);
    av_free(audio_buf);
 }
 
@@ -0,0 +1,808 @@
+/*  KingStation - A frontend for libks.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2017 - Daniel De Matteis
+ *
+ *  KingStation is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  KingStation is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with KingStation.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <compat/strl.h>
+#include <memalign.h>
+#include <ks_inline.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "state_manager.h"
+#include "msg_hash.h"
+#include "core.h"
+#include "KingStation.h"
+#include "verbosity.h"
+
+/* States are compared in blocks of this many bytes. A delta
+ * is a sequence of records, each made of a uint32_t count of
+ * unchanged blocks, a uint32_t count of changed blocks and the
+ * XOR of the changed blocks. */
+#define STATE_BLOCK_SIZE 16
+
+/* A changed run is only ended by at least this many unchanged
+ * blocks, so that isolated equal blocks do not each cost
+ * a record header. */
+#define STATE_MIN_SKIP_BLOCKS 2
+
+struct state_entry
+{
+   uint8_t *data;
+   size_t size;
+   /* Number of pushed states this delta steps back over */
+   unsigned span;
+};
+
+struct state_manager
+{
+   /* Ring of deltas, oldest first. Applying entry N to the
+    * state after it yields the state before it. */
+   struct state_entry *entries;
+
+   uint8_t *current;  /* Newest encoded state */
+   uint8_t *incoming; /* Being serialized into by the core */
+   uint8_t *pending;  /* Handed off, not yet encoded */
+   uint8_t *work;     /* Being encoded by the worker */
+   uint8_t *scratch;  /* Encoder output */
+   uint8_t *merged;   /* Decoded deltas while thinning */
+
+#ifdef HAVE_THREADS
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+#endif
+
+   size_t entries_cap;
+   size_t entries_head;
+   size_t entries_count;
+   size_t state_size;
+   size_t blocks;
+   size_t scratch_size;
+   size_t buffer_size;
+   size_t used;
+
+   /* States dropped because the worker had not picked up
+    * the previous one yet; folded into the next entry's span */
+   unsigned skipped;
+   /* States the encoder could not store for lack of memory;
+    * folded into the next entry's span. Only touched by
+    * the encoder */
+   unsigned dropped;
+
+   bool has_current;
+   bool has_pending;
+   bool busy;
+   bool thinned;
+   bool alive;
+   bool alloc_failed;
+};
+
+#define STATE_ENTRY(state, i) \
+   (&(state)->entries[((state)->entries_head + (i)) % (state)->entries_cap])
+
+static INLINE bool state_block_equal(const uint8_t *a, const uint8_t *b)
+{
+   if (!b)
+   {
+#if defined(__SSE2__)
+      __m128i v = _mm_load_si128((const __m128i*)a);
+      return _mm_movemask_epi8(
+            _mm_cmpeq_epi8(v, _mm_setzero_si128())) == 0xFFFF;
+#else
+      const uint64_t *x = (const uint64_t*)a;
+      return (x[0] | x[1]) == 0;
+#endif
+   }
+   else
+   {
+#if defined(__SSE2__)
+      __m128i v = _mm_load_si128((const __m128i*)a);
+      __m128i w = _mm_load_si128((const __m128i*)b);
+      return _mm_movemask_epi8(_mm_cmpeq_epi8(v, w)) == 0xFFFF;
+#else
+      const uint64_t *x = (const uint64_t*)a;
+      const uint64_t *y = (const uint64_t*)b;
+      return ((x[0] ^ y[0]) | (x[1] ^ y[1])) == 0;
+#endif
+   }
+}
+
+/* out = a ^ b, where b == NULL stands for all zeroes */
+static INLINE void state_block_xor(uint8_t *out,
+      const uint8_t *a, const uint8_t *b)
+{
+#if defined(__SSE2__)
+   __m128i v = _mm_load_si128((const __m128i*)a);
+   if (b)
+      v      = _mm_xor_si128(v, _mm_load_si128((const __m128i*)b));
+   _mm_storeu_si128((__m128i*)out, v);
+#else
+   uint64_t x[2];
+   memcpy(x, a, sizeof(x));
+   if (b)
+   {
+      x[0] ^= ((const uint64_t*)b)[0];
+      x[1] ^= ((const uint64_t*)b)[1];
+   }
+   memcpy(out, x, sizeof(x));
+#endif
+}
+
+/**
+ * state_delta_encode:
+ *
+ * Writes the delta between @a and @b (or @a alone if @b is NULL)
+ * to state->scratch.
+ *
+ * Returns: size of the encoded delta.
+ **/
+static size_t state_delta_encode(state_manager_t *state,
+      const uint8_t *a, const uint8_t *b)
+{
+   size_t i   = 0;
+   uint8_t *out = state->scratch;
+
+   while (i < state->blocks)
+   {
+      uint32_t skip   = 0;
+      uint32_t count  = 0;
+      size_t   start;
+
+      while (i < state->blocks && state_block_equal(
+               a + i * STATE_BLOCK_SIZE,
+               b ? b + i * STATE_BLOCK_SIZE : NULL))
+      {
+         skip++;
+         i++;
+      }
+
+      if (i == state->blocks)
+         break;
+
+      start = i;
+
+      while (i < state->blocks)
+      {
+         size_t run = 0;
+
+         while (  run < STATE_MIN_SKIP_BLOCKS
+               && i + run < state->blocks
+               && state_block_equal(
+                  a + (i + run) * STATE_BLOCK_SIZE,
+                  b ? b + (i + run) * STATE_BLOCK_SIZE : NULL))
+            run++;
+
+         if (run == STATE_MIN_SKIP_BLOCKS || i + run == state->blocks)
+            break;
+
+         i += run + 1;
+      }
+
+      count = (uint32_t)(i - start);
+
+      memcpy(out, &skip,  sizeof(skip));
+      out  += sizeof(skip);
+      memcpy(out, &count, sizeof(count));
+      out  += sizeof(count);
+
+      for (; start < i; start++, out += STATE_BLOCK_SIZE)
+         state_block_xor(out,
+               a + start * STATE_BLOCK_SIZE,
+               b ? b + start * STATE_BLOCK_SIZE : NULL);
+   }
+
+   return out - state->scratch;
+}
+
+/* XORs an encoded delta into @dst in place. */
+static void state_delta_apply(uint8_t *dst,
+      const uint8_t *delta, size_t size)
+{
+   const uint8_t *end = delta + size;
+
+   while (delta < end)
+   {
+      uint32_t skip, count, i;
+
+      memcpy(&skip,  delta, sizeof(skip));
+      delta += sizeof(skip);
+      memcpy(&count, delta, sizeof(count));
+      delta += sizeof(count);
+      dst   += (size_t)skip * STATE_BLOCK_SIZE;
+
+      for (i = 0; i < count; i++)
+      {
+#if defined(__SSE2__)
+         __m128i v = _mm_xor_si128(
+               _mm_load_si128((const __m128i*)dst),
+               _mm_loadu_si128((const __m128i*)delta));
+         _mm_store_si128((__m128i*)dst, v);
+#else
+         uint64_t x[2];
+         memcpy(x, delta, sizeof(x));
+         ((uint64_t*)dst)[0] ^= x[0];
+         ((uint64_t*)dst)[1] ^= x[1];
+#endif
+         dst   += STATE_BLOCK_SIZE;
+         delta += STATE_BLOCK_SIZE;
+      }
+   }
+}
+
+static void state_entry_drop_at(state_manager_t *state, size_t idx)
+{
+   size_t i;
+   struct state_entry *entry = STATE_ENTRY(state, idx);
+
+   state->used -= entry->size;
+   free(entry->data);
+
+   /* Entries to be dropped sit near the old end of
+    * the ring, so shift that side. */
+   for (i = idx; i > 0; i--)
+      *STATE_ENTRY(state, i) = *STATE_ENTRY(state, i - 1);
+
+   state->entries_head = (state->entries_head + 1) % state->entries_cap;
+   state->entries_count--;
+}
+
+/* Replaces entries @idx and @idx + 1 with a single delta that
+ * steps back over both. */
+static bool state_entry_merge(state_manager_t *state, size_t idx)
+{
+   struct state_entry *older = STATE_ENTRY(state, idx);
+   struct state_entry *newer = STATE_ENTRY(state, idx + 1);
+   size_t size;
+   uint8_t *data;
+
+   memset(state->merged, 0, state->state_size);
+   state_delta_apply(state->merged, older->data, older->size);
+   state_delta_apply(state->merged, newer->data, newer->size);
+
+   size = state_delta_encode(state, state->merged, NULL);
+   data = (uint8_t*)malloc(size ? size : 1);
+   if (!data)
+      return false;
+   memcpy(data, state->scratch, size);
+
+   state->used     -= newer->size;
+   state->used     += size;
+   free(newer->data);
+   newer->data      = data;
+   newer->size      = size;
+   newer->span     += older->span;
+   older->span      = 0;
+
+   state_entry_drop_at(state, idx);
+   return true;
+}
+
+/* Everything the history holds: the deltas plus the full-state
+ * buffers, the encoder output and the entry ring */
+static size_t state_manager_footprint(const state_manager_t *state)
+{
+   return state->used
+      + state->state_size * 5
+      + state->scratch_size
+      + state->entries_cap * sizeof(struct state_entry);
+}
+
+/* Thins out the history until it fits the memory budget. Finds
+ * the oldest pair of neighbours that cover the same number of
+ * states and merges them, so density halves with every tier
+ * towards the past. Drops the oldest entry if no such pair exists. */
+static void state_manager_enforce_budget(state_manager_t *state)
+{
+   while (     state_manager_footprint(state) > state->buffer_size
+            && state->entries_count > 1)
+   {
+      size_t i;
+      bool merged = false;
+
+      state->thinned = true;
+
+      for (i = 0; i + 1 < state->entries_count; i++)
+      {
+         if (STATE_ENTRY(state, i)->span != STATE_ENTRY(state, i + 1)->span)
+            continue;
+         merged = state_entry_merge(state, i);
+         break;
+      }
+
+      if (!merged)
+         state_entry_drop_at(state, 0);
+   }
+}
+
+static bool state_manager_grow_entries(state_manager_t *state)
+{
+   size_t i;
+   size_t new_cap                = state->entries_cap * 2;
+   struct state_entry *entries   = (struct state_entry*)
+      malloc(new_cap * sizeof(*entries));
+
+   if (!entries)
+      return false;
+
+   for (i = 0; i < state->entries_count; i++)
+      entries[i] = *STATE_ENTRY(state, i);
+
+   free(state->entries);
+   state->entries      = entries;
+   state->entries_cap  = new_cap;
+   state->entries_head = 0;
+   return true;
+}
+
+/* Encodes state->work against the current state and makes it
+ * the new current state. If the delta cannot be stored, the
+ * state is dropped and the current state kept, so the next
+ * delta steps back over both. */
+static void state_manager_encode_work(state_manager_t *state, unsigned span)
+{
+   uint8_t *tmp;
+
+   span += state->dropped;
+
+   if (state->has_current)
+   {
+      struct state_entry *entry;
+      size_t size   = state_delta_encode(state, state->current, state->work);
+      uint8_t *data = NULL;
+
+      if (  (state->entries_count == state->entries_cap
+               && !state_manager_grow_entries(state))
+            || !(data = (uint8_t*)malloc(size ? size : 1)))
+      {
+         /* Only log the first failure of a run */
+         if (!state->alloc_failed)
+            KINGSN_WARN("[Rewind]: Out of memory, dropping states "
+                  "from the history.\n");
+         state->alloc_failed = true;
+         state->dropped      = span;
+         return;
+      }
+      memcpy(data, state->scratch, size);
+
+      entry        = STATE_ENTRY(state, state->entries_count);
+      entry->data  = data;
+      entry->size  = size;
+      entry->span  = span;
+      state->used += size;
+      state->entries_count++;
+   }
+
+   tmp                 = state->current;
+   state->current      = state->work;
+   state->work         = tmp;
+   state->has_current  = true;
+   state->dropped      = 0;
+   state->alloc_failed = false;
+
+   state_manager_enforce_budget(state);
+}
+
+#ifdef HAVE_THREADS
+static void state_manager_thread(void *data)
+{
+   state_manager_t *state = (state_manager_t*)data;
+
+   slock_lock(state->lock);
+
+   for (;;)
+   {
+      uint8_t *tmp;
+      unsigned span;
+
+      while (state->alive && !state->has_pending)
+         scond_wait(state->cond, state->lock);
+
+      if (!state->alive)
+         break;
+
+      tmp                = state->pending;
+      state->pending     = state->work;
+      state->work        = tmp;
+      span               = 1 + state->skipped;
+      state->skipped     = 0;
+      state->has_pending = false;
+      state->busy        = true;
+      slock_unlock(state->lock);
+
+      state_manager_encode_work(state, span);
+
+      slock_lock(state->lock);
+      state->busy        = false;
+      scond_broadcast(state->cond);
+   }
+
+   slock_unlock(state->lock);
+}
+
+/* Waits until every pushed state has been encoded. Must be
+ * called with the lock held. */
+static void state_manager_wait_idle(state_manager_t *state)
+{
+   while (state->has_pending || state->busy)
+      scond_wait(state->cond, state->lock);
+}
+#endif
+
+state_manager_t *state_manager_new(size_t state_size, size_t buffer_size)
+{
+   state_manager_t *state = (state_manager_t*)calloc(1, sizeof(*state));
+
+   if (!state)
+      return NULL;
+
+   state->blocks       = (state_size + STATE_BLOCK_SIZE - 1)
+      / STATE_BLOCK_SIZE;
+   state->state_size   = state->blocks * STATE_BLOCK_SIZE;
+   /* Worst case: every other block changed */
+   state->scratch_size = state->state_size
+      + (state->blocks / 2 + 1) * 2 * sizeof(uint32_t);
+   state->buffer_size  = buffer_size;
+   state->entries_cap  = 64;
+   state->entries      = (struct state_entry*)
+      malloc(state->entries_cap * sizeof(*state->entries));
+   state->current      = (uint8_t*)memalign_alloc(STATE_BLOCK_SIZE, state->state_size);
+   state->incoming     = (uint8_t*)memalign_alloc(STATE_BLOCK_SIZE, state->state_size);
+   state->pending      = (uint8_t*)memalign_alloc(STATE_BLOCK_SIZE, state->state_size);
+   state->work         = (uint8_t*)memalign_alloc(STATE_BLOCK_SIZE, state->state_size);
+   state->merged       = (uint8_t*)memalign_alloc(STATE_BLOCK_SIZE, state->state_size);
+   state->scratch      = (uint8_t*)malloc(state->scratch_size);
+
+   if (  !state->entries || !state->current || !state->incoming
+      || !state->pending || !state->work    || !state->merged
+      || !state->scratch)
+      goto error;
+
+   if (state_manager_footprint(state) > buffer_size)
+      KINGSN_WARN("[Rewind]: %u KB buffer leaves no room for history "
+            "with %u KB states.\n", (unsigned)(buffer_size / 1024),
+            (unsigned)(state->state_size / 1024));
+
+   /* Serialized states don't fill the padding at the end */
+   memset(state->current,  0, state->state_size);
+   memset(state->incoming, 0, state->state_size);
+   memset(state->pending,  0, state->state_size);
+   memset(state->work,     0, state->state_size);
+
+#ifdef HAVE_THREADS
+   state->alive        = true;
+   state->lock         = slock_new();
+   state->cond         = scond_new();
+   if (!state->lock || !state->cond)
+      goto error;
+   state->thread       = sthread_create(state_manager_thread, state);
+   if (!state->thread)
+      goto error;
+#endif
+
+   return state;
+
+error:
+   state_manager_free(state);
+   return NULL;
+}
+
+void state_manager_free(state_manager_t *state)
+{
+   size_t i;
+
+   if (!state)
+      return;
+
+#ifdef HAVE_THREADS
+   if (state->thread)
+   {
+      slock_lock(state->lock);
+      state->alive = false;
+      scond_broadcast(state->cond);
+      slock_unlock(state->lock);
+      sthread_join(state->thread);
+   }
+   if (state->cond)
+      scond_free(state->cond);
+   if (state->lock)
+      slock_free(state->lock);
+#endif
+
+   for (i = 0; i < state->entries_count; i++)
+      free(STATE_ENTRY(state, i)->data);
+   free(state->entries);
+
+   memalign_free(state->current);
+   memalign_free(state->incoming);
+   memalign_free(state->pending);
+   memalign_free(state->work);
+   memalign_free(state->merged);
+   free(state->scratch);
+   free(state);
+}
+
+bool state_manager_push_where(state_manager_t *state, void **data)
+{
+   if (!state)
+      return false;
+   *data = state->incoming;
+   return true;
+}
+
+void state_manager_push_do(state_manager_t *state)
+{
+   uint8_t *tmp;
+
+   if (!state)
+      return;
+
+#ifdef HAVE_THREADS
+   slock_lock(state->lock);
+   /* Never wait for the encoder here; if it is still behind,
+    * the state it has not picked up yet is superseded. */
+   if (state->has_pending)
+      state->skipped++;
+   tmp                = state->pending;
+   state->pending     = state->incoming;
+   state->incoming    = tmp;
+   state->has_pending = true;
+   scond_signal(state->cond);
+   slock_unlock(state->lock);
+#else
+   tmp                = state->work;
+   state->work        = state->incoming;
+   state->incoming    = tmp;
+   state_manager_encode_work(state, 1);
+#endif
+}
+
+bool state_manager_pop(state_manager_t *state, const void **data)
+{
+   bool ret = false;
+   struct state_entry *entry;
+
+   *data    = NULL;
+
+   if (!state)
+      return false;
+
+#ifdef HAVE_THREADS
+   slock_lock(state->lock);
+   state_manager_wait_idle(state);
+#endif
+
+   if (state->has_current)
+      *data = state->current;
+
+   /* Stepping back passes the dropped states as well */
+   state->dropped = 0;
+
+   if (state->entries_count > 0)
+   {
+      entry = STATE_ENTRY(state, state->entries_count - 1);
+      state_delta_apply(state->current, entry->data, entry->size);
+
+      state->used -= entry->size;
+      free(entry->data);
+      entry->data  = NULL;
+      state->entries_count--;
+      ret          = true;
+   }
+
+#ifdef HAVE_THREADS
+   slock_unlock(state->lock);
+#endif
+
+   return ret;
+}
+
+void state_manager_capacity(state_manager_t *state,
+      unsigned *entries, size_t *bytes, bool *full)
+{
+   if (!state)
+      return;
+
+#ifdef HAVE_THREADS
+   /* The worker updates the history without the lock */
+   slock_lock(state->lock);
+   state_manager_wait_idle(state);
+#endif
+
+   if (entries)
+      *entries = (unsigned)state->entries_count;
+   if (bytes)
+      *bytes   = state_manager_footprint(state);
+   if (full)
+      *full    = state->thinned;
+
+#ifdef HAVE_THREADS
+   slock_unlock(state->lock);
+#endif
+}
+
+static void state_manager_push_core_state(
+      struct state_manager_rewind_state *rewind_st)
+{
+   ks_ctx_serialize_info_t serial_info;
+   void *state = NULL;
+
+   if (!state_manager_push_where(rewind_st->state, &state))
+      return;
+
+   serial_info.data       = state;
+   serial_info.data_const = state;
+   serial_info.size       = rewind_st->size;
+
+   if (core_serialize(&serial_info))
+      state_manager_push_do(rewind_st->state);
+}
+
+void state_manager_event_deinit(
+      struct state_manager_rewind_state *rewind_st)
+{
+   if (!rewind_st)
+      return;
+
+   if (rewind_st->state)
+   {
+      unsigned entries = 0;
+      size_t bytes     = 0;
+
+      state_manager_capacity(rewind_st->state, &entries, &bytes, NULL);
+      KINGSN_LOG("[Rewind]: History held %u states in %u KB.\n",
+            entries, (unsigned)(bytes / 1024));
+
+      state_manager_free(rewind_st->state);
+   }
+
+   rewind_st->state             = NULL;
+   rewind_st->size              = 0;
+   rewind_st->frame_counter     = 0;
+   rewind_st->frame_is_reversed = false;
+   rewind_st->init_attempted    = false;
+
+   /* Restore regular (non-rewind) core audio callbacks */
+   core_set_rewind_callbacks();
+}
+
+void state_manager_event_init(
+      struct state_manager_rewind_state *rewind_st,
+      unsigned rewind_buffer_size)
+{
+   ks_ctx_size_info_t info;
+
+   if (!rewind_st || rewind_st->state)
+      return;
+
+   rewind_st->init_attempted = true;
+
+   if (audio_driver_has_callback())
+   {
+      KINGSN_ERR("%s.\n", msg_hash_to_str(MSG_REWIND_INIT_FAILED_THREADED_AUDIO));
+      return;
+   }
+
+   core_serialize_size(&info);
+
+   if (!info.size)
+   {
+      KINGSN_ERR("%s.\n", msg_hash_to_str(MSG_REWIND_INIT_FAILED));
+      return;
+   }
+
+   rewind_st->size = info.size;
+
+   KINGSN_LOG("%s: %u MB\n",
+         msg_hash_to_str(MSG_REWIND_INIT),
+         (unsigned)(rewind_buffer_size / 1000000));
+
+   rewind_st->state = state_manager_new(rewind_st->size,
+         rewind_buffer_size);
+
+   if (!rewind_st->state)
+   {
+      KINGSN_WARN("%s.\n", msg_hash_to_str(MSG_REWIND_INIT_FAILED));
+      return;
+   }
+
+   state_manager_push_core_state(rewind_st);
+}
+
+bool state_manager_check_rewind(
+      struct state_manager_rewind_state *rewind_st,
+      bool pressed,
+      unsigned rewind_granularity, bool is_paused,
+      char *s, size_t len, unsigned *time)
+{
+   bool ret = false;
+
+   if (!rewind_st || !rewind_st->state)
+      return false;
+
+   if (rewind_st->frame_is_reversed)
+   {
+      audio_driver_frame_is_reverse();
+      rewind_st->frame_is_reversed = false;
+   }
+
+   if (pressed)
+   {
+      ks_ctx_serialize_info_t serial_info;
+      const void *buf = NULL;
+
+      if (state_manager_pop(rewind_st->state, &buf))
+      {
+         rewind_st->frame_is_reversed = true;
+         audio_driver_setup_rewind();
+
+         strlcpy(s, msg_hash_to_str(MSG_REWINDING), len);
+         *time = is_paused ? 1 : 30;
+         ret   = true;
+
+         serial_info.data       = NULL;
+         serial_info.data_const = buf;
+         serial_info.size       = rewind_st->size;
+         core_unserialize(&serial_info);
+
+         bsv_movie_frame_rewind();
+      }
+      else
+      {
+         /* Hold the oldest state we still have */
+         if (buf)
+         {
+            serial_info.data       = NULL;
+            serial_info.data_const = buf;
+            serial_info.size       = rewind_st->size;
+            core_unserialize(&serial_info);
+         }
+
+         strlcpy(s, msg_hash_to_str(MSG_REWIND_REACHED_END), len);
+         *time = 30;
+         ret   = true;
+      }
+
+      rewind_st->frame_counter = 0;
+   }
+   else
+   {
+      if (rewind_granularity == 0)
+         rewind_granularity = 1;
+
+      if (++rewind_st->frame_counter >= rewind_granularity)
+      {
+         rewind_st->frame_counter = 0;
+         state_manager_push_core_state(rewind_st);
+      }
+   }
+
+   core_set_rewind_callbacks();
+
+   return ret;
+}
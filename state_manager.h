@@ -0,0 +1,115 @@
+/*  KingStation - A frontend for libks.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2017 - Daniel De Matteis
+ *
+ *  KingStation is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  KingStation is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with KingStation.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KINGSN_STATE_MANAGER_H
+#define __KINGSN_STATE_MANAGER_H
+
+#include <stddef.h>
+
+#include <boolean.h>
+#include <ks_common_api.h>
+
+KS_BEGIN_DECLS
+
+typedef struct state_manager state_manager_t;
+
+struct state_manager_rewind_state
+{
+   /* Rewind support. */
+   state_manager_t *state;
+   size_t size;
+   unsigned frame_counter;
+   bool frame_is_reversed;
+   bool init_attempted;
+};
+
+/**
+ * state_manager_new:
+ * @state_size         : Size of a serialized core state, in bytes.
+ * @buffer_size        : Memory budget for the rewind history, in bytes.
+ *                       This covers the full-state buffers as well as
+ *                       the deltas.
+ *
+ * Creates a rewind history. Every pushed state is stored as an
+ * XOR/RLE delta against the state pushed after it; encoding and
+ * eviction happen on a worker thread when threads are available.
+ *
+ * Once @buffer_size is exceeded, old history is thinned out by
+ * merging neighbouring deltas of the same age tier, so the
+ * history gets sparser towards the past instead of being
+ * truncated. Only when nothing can be merged any more is the
+ * oldest state dropped.
+ *
+ * Returns: new state manager, or NULL on failure.
+ **/
+state_manager_t *state_manager_new(size_t state_size, size_t buffer_size);
+
+void state_manager_free(state_manager_t *state);
+
+/**
+ * state_manager_push_where:
+ *
+ * Returns a buffer of 'state_size' bytes that the next state
+ * should be serialized into, or false if none is available.
+ **/
+bool state_manager_push_where(state_manager_t *state, void **data);
+
+/* Hands the buffer returned by state_manager_push_where back
+ * for encoding. Does not block on the encoder. */
+void state_manager_push_do(state_manager_t *state);
+
+/**
+ * state_manager_pop:
+ *
+ * Steps one entry back in the history. On success, @data points
+ * to the previous state, which stays valid until the next call
+ * into the state manager.
+ **/
+bool state_manager_pop(state_manager_t *state, const void **data);
+
+/**
+ * state_manager_capacity:
+ *
+ * Reports how many states the history holds, how many bytes it
+ * uses against its budget and whether it has been thinned out.
+ * Waits for the encoder to finish the state it is working on.
+ **/
+void state_manager_capacity(state_manager_t *state,
+      unsigned *entries, size_t *bytes, bool *full);
+
+bool state_manager_frame_is_reversed(void);
+
+void state_manager_event_deinit(
+      struct state_manager_rewind_state *rewind_st);
+
+void state_manager_event_init(struct state_manager_rewind_state *rewind_st,
+      unsigned rewind_buffer_size);
+
+/**
+ * state_manager_check_rewind:
+ * @pressed              : was rewind key pressed or held?
+ *
+ * Checks if rewind toggle/hold was being pressed and/or held.
+ **/
+bool state_manager_check_rewind(
+      struct state_manager_rewind_state *rewind_st,
+      bool pressed,
+      unsigned rewind_granularity, bool is_paused,
+      char *s, size_t len, unsigned *time);
+
+KS_END_DECLS
+
+#endif
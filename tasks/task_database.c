@@ -27,10 +27,13 @@
 #include <streams/file_stream.h>
 #include <streams/chd_stream.h>
 #include <streams/interface_stream.h>
+#include <queues/job_pipeline.h>
+#include <features/features_cpu.h>
 #include "tasks_internal.h"
 
 #include "../core_info.h"
 #include "../database_info.h"
+#include "../database_scan_cache.h"
 
 #include "../file_path_special.h"
 #include "../msg_hash.h"
@@ -56,12 +59,36 @@ typedef struct database_state_handle
    char serial[4096];
 } database_state_handle_t;
 
+/* Hashes and serials of directory scan entries are computed
+ * ahead of time on a few worker threads, since reading the files
+ * dominates the scan. Database matching stays sequential. */
+#define DATABASE_SCAN_MAX_WORKERS 4
+#define DATABASE_SCAN_JOBS_PER_WORKER 4
+
+typedef struct database_probe
+{
+   char *path;
+   size_t index;
+   database_scan_cache_key_t key;
+   database_scan_cache_info_t info;
+   int ret;
+   /* 'key' is valid, result may be cached */
+   bool cacheable;
+   /* result came from the scan cache */
+   bool cached;
+} database_probe_t;
+
 typedef struct db_handle
 {
    char *playlist_directory;
    char *content_database_path;
    char *fullpath;
    database_info_handle_t *handle;
+   database_scan_cache_t *cache;
+   job_pipeline_t *pipeline;
+   size_t pipeline_next;
+   unsigned cache_hits;
+   unsigned cache_misses;
    database_state_handle_t state;
    playlist_config_t playlist_config; /* size_t alignment */
    unsigned status;
@@ -455,7 +482,7 @@ static bool task_database_chd_get_crc(const char *name, uint32_t *crc)
 }
 
 static void task_database_cue_prune(database_info_handle_t *db,
-      const char *name)
+      size_t start, const char *name)
 {
    size_t i;
    char path[PATH_MAX_LENGTH];
@@ -469,7 +496,7 @@ static void task_database_cue_prune(database_info_handle_t *db,
 
    while (cue_next_file(fd, name, path, sizeof(path)))
    {
-      for (i = db->list_ptr; i < db->list->size; ++i)
+      for (i = start; i < db->list->size; ++i)
       {
          if (db->list->elems[i].data
                && string_is_equal(path, db->list->elems[i].data))
@@ -485,7 +512,8 @@ static void task_database_cue_prune(database_info_handle_t *db,
    free(fd);
 }
 
-static void gdi_prune(database_info_handle_t *db, const char *name)
+static void gdi_prune(database_info_handle_t *db,
+      size_t start, const char *name)
 {
    size_t i;
    char path[PATH_MAX_LENGTH];
@@ -499,7 +527,7 @@ static void gdi_prune(database_info_handle_t *db, const char *name)
 
    while (gdi_next_file(fd, name, path, sizeof(path)))
    {
-      for (i = db->list_ptr; i < db->list->size; ++i)
+      for (i = start; i < db->list->size; ++i)
       {
          if (db->list->elems[i].data
                && string_is_equal(path, db->list->elems[i].data))
@@ -557,71 +585,295 @@ static enum msg_file_type extension_to_file_type(const char *ext)
    return FILE_TYPE_NONE;
 }
 
-static int task_database_iterate_playlist(
-      database_state_handle_t *db_state,
-      database_info_handle_t *db, const char *name)
+/* Builds the scan cache key for a file. The result for a cue
+ * or gdi sheet depends on the track files as well, so their
+ * total size and latest modification time are part of it. */
+static bool task_database_cache_key(const char *name,
+      enum msg_file_type type, database_scan_cache_key_t *key)
 {
-   switch (extension_to_file_type(path_get_extension(name)))
+   char track_path[PATH_MAX_LENGTH];
+   intfstream_t *fd = NULL;
+   bool ret         = true;
+
+   if (!database_scan_cache_stat(name, key))
+      return false;
+
+   if (type != FILE_TYPE_CUE && type != FILE_TYPE_GDI)
+      return true;
+
+   if (!(fd = intfstream_open_file(name,
+         KS_VFS_FILE_ACCESS_READ, KS_VFS_FILE_ACCESS_HINT_NONE)))
+      return false;
+
+   track_path[0] = '\0';
+
+   while (type == FILE_TYPE_CUE
+         ? cue_next_file(fd, name, track_path, sizeof(track_path))
+         : gdi_next_file(fd, name, track_path, sizeof(track_path)))
+   {
+      database_scan_cache_key_t track;
+
+      if (!database_scan_cache_stat(track_path, &track))
+      {
+         ret = false;
+         break;
+      }
+
+      key->dep_size += track.size;
+      if (track.mtime > key->dep_mtime)
+         key->dep_mtime = track.mtime;
+   }
+
+   intfstream_close(fd);
+   free(fd);
+
+   return ret;
+}
+
+/* Reads the file and computes whatever the database lookup for
+ * it needs, unless the scan cache already knows. Doesn't touch
+ * the scan state, so it can run on a pipeline worker while
+ * earlier entries are being matched. */
+static void task_database_probe_file(database_probe_t *probe,
+      database_scan_cache_t *cache)
+{
+   const char *name              = probe->path;
+   database_scan_cache_info_t *info = &probe->info;
+   enum msg_file_type file_type  = extension_to_file_type(
+         path_get_extension(name));
+
+   probe->ret      = 1;
+   info->serial[0] = '\0';
+
+   if (cache && task_database_cache_key(name, file_type, &probe->key))
+   {
+      probe->cacheable = true;
+
+      if (database_scan_cache_find(cache, name, &probe->key, info))
+      {
+         probe->cached = true;
+         return;
+      }
+   }
+
+   switch (file_type)
    {
       case FILE_TYPE_COMPRESSED:
 #ifdef HAVE_COMPRESSION
-         db->type = DATABASE_TYPE_CRC_LOOKUP;
+         info->type = DATABASE_TYPE_CRC_LOOKUP;
          /* first check crc of archive itself */
-         return intfstream_file_get_crc(name,
-               0, SIZE_MAX, &db_state->archive_crc);
-#else
-         break;
+         probe->ret = intfstream_file_get_crc(name,
+               0, SIZE_MAX, &info->archive_crc);
 #endif
+         break;
       case FILE_TYPE_CUE:
-         task_database_cue_prune(db, name);
-         db_state->serial[0] = '\0';
-         if (task_database_cue_get_serial(name, db_state->serial))
-            db->type = DATABASE_TYPE_SERIAL_LOOKUP;
+         if (task_database_cue_get_serial(name, info->serial))
+            info->type = DATABASE_TYPE_SERIAL_LOOKUP;
          else
          {
-            db->type = DATABASE_TYPE_CRC_LOOKUP;
-            return task_database_cue_get_crc(name, &db_state->crc);
+            info->type = DATABASE_TYPE_CRC_LOOKUP;
+            probe->ret = task_database_cue_get_crc(name, &info->crc);
          }
          break;
       case FILE_TYPE_GDI:
-         gdi_prune(db, name);
-         db_state->serial[0] = '\0';
          /* There are no serial databases, so don't bother with
             serials at the moment */
-         if (0 && task_database_gdi_get_serial(name, db_state->serial))
-            db->type = DATABASE_TYPE_SERIAL_LOOKUP;
+         if (0 && task_database_gdi_get_serial(name, info->serial))
+            info->type = DATABASE_TYPE_SERIAL_LOOKUP;
          else
          {
-            db->type = DATABASE_TYPE_CRC_LOOKUP;
-            return task_database_gdi_get_crc(name, &db_state->crc);
+            info->type = DATABASE_TYPE_CRC_LOOKUP;
+            probe->ret = task_database_gdi_get_crc(name, &info->crc);
          }
          break;
       /* Consider Wii WBFS files similar to ISO files. */
       case FILE_TYPE_WBFS:
       case FILE_TYPE_ISO:
-         db_state->serial[0] = '\0';
-         intfstream_file_get_serial(name, 0, SIZE_MAX, db_state->serial);
-         db->type            =  DATABASE_TYPE_SERIAL_LOOKUP;
+         intfstream_file_get_serial(name, 0, SIZE_MAX, info->serial);
+         info->type    = DATABASE_TYPE_SERIAL_LOOKUP;
          break;
       case FILE_TYPE_CHD:
-         db_state->serial[0] = '\0';
-         if (task_database_chd_get_serial(name, db_state->serial))
-            db->type         = DATABASE_TYPE_SERIAL_LOOKUP;
+         if (task_database_chd_get_serial(name, info->serial))
+            info->type = DATABASE_TYPE_SERIAL_LOOKUP;
          else
          {
-            db->type         = DATABASE_TYPE_CRC_LOOKUP;
-            return task_database_chd_get_crc(name, &db_state->crc);
+            info->type = DATABASE_TYPE_CRC_LOOKUP;
+            probe->ret = task_database_chd_get_crc(name, &info->crc);
          }
          break;
       case FILE_TYPE_LUTRO:
-         db->type            = DATABASE_TYPE_ITERATE_LUTRO;
+         info->type    = DATABASE_TYPE_ITERATE_LUTRO;
          break;
       default:
-         db->type            = DATABASE_TYPE_CRC_LOOKUP;
-         return intfstream_file_get_crc(name, 0, SIZE_MAX, &db_state->crc);
+         info->type    = DATABASE_TYPE_CRC_LOOKUP;
+         probe->ret    = intfstream_file_get_crc(name,
+               0, SIZE_MAX, &info->crc);
+         break;
    }
 
-   return 1;
+   /* Don't remember files that could not be read */
+   if (!probe->ret || info->type == DATABASE_TYPE_NONE)
+      probe->cacheable = false;
+}
+
+static void task_database_probe_handler(void *job, void *userdata)
+{
+   task_database_probe_file((database_probe_t*)job,
+         (database_scan_cache_t*)userdata);
+}
+
+static void task_database_probe_free(void *job)
+{
+   database_probe_t *probe = (database_probe_t*)job;
+
+   if (!probe)
+      return;
+
+   free(probe->path);
+   free(probe);
+}
+
+/* Cue and gdi sheets remove the tracks they reference from
+ * the rest of the scan list. */
+static void task_database_prune(database_info_handle_t *db,
+      size_t start, const char *name)
+{
+   switch (extension_to_file_type(path_get_extension(name)))
+   {
+      case FILE_TYPE_CUE:
+         task_database_cue_prune(db, start, name);
+         break;
+      case FILE_TYPE_GDI:
+         gdi_prune(db, start, name);
+         break;
+      default:
+         break;
+   }
+}
+
+static void task_database_pipeline_init(db_handle_t *_db,
+      database_info_handle_t *db)
+{
+   unsigned workers = cpu_features_get_core_amount();
+
+   if (workers > DATABASE_SCAN_MAX_WORKERS)
+      workers = DATABASE_SCAN_MAX_WORKERS;
+   else if (workers < 1)
+      workers = 1;
+
+   _db->pipeline      = job_pipeline_new(workers,
+         workers * DATABASE_SCAN_JOBS_PER_WORKER,
+         task_database_probe_handler, _db->cache);
+   _db->pipeline_next = db->list_ptr;
+
+   if (_db->pipeline)
+      KINGSN_LOG("[Scanner]: Reading content with %u threads.\n", workers);
+}
+
+/* Keeps the pipeline full with the entries following the
+ * current one. Entries are submitted in list order, and
+ * pruning happens at submission so that tracks referenced by
+ * a cue or gdi sheet are never read on their own. */
+static void task_database_pipeline_fill(db_handle_t *_db,
+      database_info_handle_t *db)
+{
+   if (_db->pipeline_next < db->list_ptr)
+      _db->pipeline_next = db->list_ptr;
+
+   while (_db->pipeline_next < db->list->size)
+   {
+      database_probe_t *probe = NULL;
+      size_t index            = _db->pipeline_next;
+      const char *name        = db->list->elems[index].data;
+
+      /* Archive members are looked up by the CRC
+       * stored in the archive, nothing to read */
+      if (!name || path_contains_compressed_file(name))
+      {
+         _db->pipeline_next++;
+         continue;
+      }
+
+      if (!(probe = (database_probe_t*)calloc(1, sizeof(*probe))))
+         break;
+
+      probe->path  = strdup(name);
+      probe->index = index;
+
+      if (!probe->path || !job_pipeline_push(_db->pipeline, probe))
+      {
+         task_database_probe_free(probe);
+         break;
+      }
+
+      task_database_prune(db, index + 1, name);
+      _db->pipeline_next++;
+   }
+}
+
+/* Returns the probe for the entry at 'index' if it
+ * was submitted to the pipeline, waiting for it if needed. */
+static database_probe_t *task_database_pipeline_take(
+      db_handle_t *_db, size_t index)
+{
+   database_probe_t *probe = NULL;
+
+   if (!_db->pipeline)
+      return NULL;
+
+   /* Drop results of entries that were skipped */
+   while ((probe = (database_probe_t*)job_pipeline_peek(_db->pipeline))
+         && probe->index < index)
+      task_database_probe_free(job_pipeline_pop(_db->pipeline, true));
+
+   if (!probe || probe->index != index)
+      return NULL;
+
+   return (database_probe_t*)job_pipeline_pop(_db->pipeline, true);
+}
+
+static int task_database_iterate_playlist(
+      db_handle_t *_db,
+      database_state_handle_t *db_state,
+      database_info_handle_t *db, const char *name)
+{
+   int ret;
+   database_probe_t *probe = task_database_pipeline_take(
+         _db, db->list_ptr);
+
+   if (!probe)
+   {
+      if (!(probe = (database_probe_t*)calloc(1, sizeof(*probe))))
+         return 0;
+
+      task_database_prune(db, db->list_ptr, name);
+
+      probe->path = strdup(name);
+      if (probe->path)
+         task_database_probe_file(probe, _db->cache);
+      else
+         probe->ret = 0;
+   }
+
+   if (probe->info.type != DATABASE_TYPE_NONE)
+      db->type           = (enum database_type)probe->info.type;
+   db_state->crc         = probe->info.crc;
+   db_state->archive_crc = probe->info.archive_crc;
+   strlcpy(db_state->serial, probe->info.serial, sizeof(db_state->serial));
+   ret                   = probe->ret;
+
+   if (probe->cached)
+      _db->cache_hits++;
+   else if (probe->cacheable)
+   {
+      _db->cache_misses++;
+      database_scan_cache_add(_db->cache, probe->path,
+            &probe->key, &probe->info);
+   }
+
+   task_database_probe_free(probe);
+
+   return ret;
 }
 
 static int database_info_list_iterate_end_no_match(
@@ -1083,7 +1335,7 @@ static int task_database_iterate(
    switch (db->type)
    {
       case DATABASE_TYPE_ITERATE:
-         return task_database_iterate_playlist(db_state, db, name);
+         return task_database_iterate_playlist(_db, db_state, db, name);
       case DATABASE_TYPE_ITERATE_ARCHIVE:
 #ifdef HAVE_COMPRESSION
          return task_database_iterate_crc_lookup(
@@ -1209,10 +1461,26 @@ static void task_database_handler(ks_task_t *task)
                }
             }
          }
+
+         if (!string_is_empty(db->playlist_directory))
+         {
+            char cache_path[PATH_MAX_LENGTH];
+
+            fill_pathname_join(cache_path, db->playlist_directory,
+                  FILE_PATH_CONTENT_SCAN_CACHE, sizeof(cache_path));
+            db->cache = database_scan_cache_open(cache_path);
+         }
+
+#ifdef HAVE_THREADS
+         if (db->is_directory && dbinfo->list->size > 1)
+            task_database_pipeline_init(db, dbinfo);
+#endif
          dbinfo->status = DATABASE_STATUS_ITERATE_START;
          break;
       case DATABASE_STATUS_ITERATE_START:
          name                 = database_info_get_current_element_name(dbinfo);
+         if (db->pipeline)
+            task_database_pipeline_fill(db, dbinfo);
          task_database_cleanup_state(dbstate);
          dbstate->list_index  = 0;
          dbstate->entry_index = 0;
@@ -1281,6 +1549,14 @@ task_finished:
 
    if (db)
    {
+      if (db->pipeline)
+         job_pipeline_free(db->pipeline, task_database_probe_free);
+      if (db->cache)
+      {
+         KINGSN_LOG("[Scanner]: %u files unchanged since the last scan, "
+               "%u read.\n", db->cache_hits, db->cache_misses);
+         database_scan_cache_close(db->cache);
+      }
       if (!string_is_empty(db->playlist_directory))
          free(db->playlist_directory);
       if (!string_is_empty(db->content_database_path))
@@ -1331,6 +1607,7 @@ bool task_push_dbscan(
    t->title                                = strdup(msg_hash_to_str(
             MSG_PREPARING_FOR_CONTENT_SCAN));
    t->alternative_look                     = true;
+   t->priority                             = TASK_PRIORITY_LOW;
 
 #ifdef KINGSN_INTERNAL
    t->progress_cb                          = task_database_progress_cb;
@@ -1339,12 +1616,14 @@ bool task_push_dbscan(
    db->playlist_config.old_format          = settings->bools.playlist_use_old_format;
    db->playlist_config.compress            = settings->bools.playlist_compression;
    db->playlist_config.fuzzy_archive_match = settings->bools.playlist_fuzzy_archive_match;
+   db->playlist_config.binary_cache        = settings->bools.playlist_binary_cache;
    playlist_config_set_base_content_directory(&db->playlist_config, settings->bools.playlist_portable_paths ? settings->paths.directory_menu_content : NULL);
 #else
    db->playlist_config.capacity            = COLLECTION_SIZE;
    db->playlist_config.old_format          = false;
    db->playlist_config.compress            = false;
    db->playlist_config.fuzzy_archive_match = false;
+   db->playlist_config.binary_cache        = false;
    playlist_config_set_base_content_directory(&db->playlist_config, NULL);
 #endif
    db->show_hidden_files                   = db_dir_show_hidden_files;
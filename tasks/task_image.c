@@ -44,10 +44,13 @@ struct nbio_image_handle
    void *handle;
    transfer_cb_t  cb;
    struct texture_image ti; /* ptr alignment */
+   gfx_thumbnail_cache_t *cache;
+   gfx_thumbnail_cache_key_t cache_key;
    size_t size;
    int processing_final_state;
    unsigned frame_duration;
    unsigned upscale_threshold;
+   unsigned max_size;
    enum image_type_enum type;
    enum image_status_enum status;
    bool is_blocking;
@@ -161,9 +164,11 @@ static void task_image_cleanup(nbio_handle_t *nbio)
    if (image)
    {
       image_transfer_free(image->handle, image->type);
+      gfx_thumbnail_cache_release(image->cache);
 
       image->handle                 = NULL;
       image->cb                     = NULL;
+      image->cache                  = NULL;
    }
    if (!string_is_empty(nbio->path))
       free(nbio->path);
@@ -206,6 +211,14 @@ static int cb_nbio_image_thumbnail(void *data, size_t len)
 
    image_transfer_set_buffer_ptr(image->handle, image->type, ptr, len);
 
+   /* Anything beyond 'max_size' gets scaled away below, so
+    * let the decoder skip most of it. Upscaled images must
+    * keep their full size, since they are measured after
+    * decoding */
+   if (image->max_size > 0 && image->upscale_threshold == 0)
+      image_transfer_set_target_size(image->handle, image->type,
+            image->max_size, image->max_size);
+
    /* Set image size */
    image->size                     = len;
 
@@ -272,6 +285,96 @@ static bool upscale_image(
    return true;
 }
 
+/* Box filter, each destination pixel averages the
+ * source pixels it covers. Channels are averaged
+ * independently, so the pixel format does not matter */
+static bool downscale_image(
+      unsigned max_size,
+      struct texture_image *image_src,
+      struct texture_image *image_dst)
+{
+   unsigned x_dst, y_dst;
+   unsigned *x_start = NULL;
+
+   /* Sanity check */
+   if ((max_size < 1) || !image_src || !image_dst)
+      return false;
+
+   if (!image_src->pixels || (image_src->width < 1) || (image_src->height < 1))
+      return false;
+
+   /* Get output dimensions, preserving aspect ratio */
+   if (image_src->width >= image_src->height)
+   {
+      image_dst->width  = max_size;
+      image_dst->height = (unsigned)(((uint64_t)image_src->height * max_size
+               + image_src->width / 2) / image_src->width);
+   }
+   else
+   {
+      image_dst->height = max_size;
+      image_dst->width  = (unsigned)(((uint64_t)image_src->width * max_size
+               + image_src->height / 2) / image_src->height);
+   }
+
+   if (image_dst->width < 1)
+      image_dst->width  = 1;
+   if (image_dst->height < 1)
+      image_dst->height = 1;
+
+   /* Allocate pixel buffer */
+   image_dst->pixels = (uint32_t*)malloc(image_dst->width * image_dst->height * sizeof(uint32_t));
+   x_start           = (unsigned*)malloc((image_dst->width + 1) * sizeof(unsigned));
+   if (!image_dst->pixels || !x_start)
+   {
+      free(image_dst->pixels);
+      free(x_start);
+      image_dst->pixels = NULL;
+      return false;
+   }
+
+   for (x_dst = 0; x_dst <= image_dst->width; x_dst++)
+      x_start[x_dst] = (unsigned)((uint64_t)x_dst * image_src->width / image_dst->width);
+
+   for (y_dst = 0; y_dst < image_dst->height; y_dst++)
+   {
+      unsigned y0 = (unsigned)((uint64_t)y_dst       * image_src->height / image_dst->height);
+      unsigned y1 = (unsigned)((uint64_t)(y_dst + 1) * image_src->height / image_dst->height);
+
+      for (x_dst = 0; x_dst < image_dst->width; x_dst++)
+      {
+         unsigned x, y;
+         uint32_t sum[4] = {0};
+         unsigned x0     = x_start[x_dst];
+         unsigned x1     = x_start[x_dst + 1];
+         uint32_t count  = (x1 - x0) * (y1 - y0);
+
+         for (y = y0; y < y1; y++)
+         {
+            const uint32_t *src = image_src->pixels + (size_t)y * image_src->width;
+
+            for (x = x0; x < x1; x++)
+            {
+               uint32_t pixel = src[x];
+               sum[0]        += (pixel      ) & 0xff;
+               sum[1]        += (pixel >>  8) & 0xff;
+               sum[2]        += (pixel >> 16) & 0xff;
+               sum[3]        += (pixel >> 24);
+            }
+         }
+
+         image_dst->pixels[(y_dst * image_dst->width) + x_dst] =
+                ((sum[0] + count / 2) / count)
+             | (((sum[1] + count / 2) / count) <<  8)
+             | (((sum[2] + count / 2) / count) << 16)
+             | (((sum[3] + count / 2) / count) << 24);
+      }
+   }
+
+   free(x_start);
+   return true;
+}
+
 bool task_image_load_handler(ks_task_t *task)
 {
    nbio_handle_t            *nbio  = (nbio_handle_t*)task->state;
@@ -366,6 +469,35 @@ bool task_image_load_handler(ks_task_t *task)
             }
          }
 
+         /* Scale down to what the screen can show */
+         if ((image->max_size > 0) &&
+             ((image->ti.width  > image->max_size) ||
+              (image->ti.height > image->max_size)))
+         {
+            struct texture_image img_resampled = {
+               NULL,
+               0,
+               0,
+               false
+            };
+
+            if (downscale_image(image->max_size, &image->ti, &img_resampled))
+            {
+               image->ti.width  = img_resampled.width;
+               image->ti.height = img_resampled.height;
+
+               if (image->ti.pixels)
+                  free(image->ti.pixels);
+               image->ti.pixels = img_resampled.pixels;
+            }
+         }
+
+         /* Store the result, so the next request
+          * skips all of this */
+         if (image->cache)
+            gfx_thumbnail_cache_insert(image->cache, nbio->path,
+                  &image->cache_key, &image->ti);
+
          img->width         = image->ti.width;
          img->height        = image->ti.height;
          img->pixels        = image->ti.pixels;
@@ -380,8 +512,10 @@ bool task_image_load_handler(ks_task_t *task)
    return true;
 }
 
-bool task_push_image_load(const char *fullpath, 
+static bool task_push_image_load_internal(const char *fullpath,
       bool supports_rgba, unsigned upscale_threshold,
+      unsigned max_size, gfx_thumbnail_cache_t *cache,
+      const gfx_thumbnail_cache_key_t *cache_key,
       ks_task_callback_t cb, void *user_data)
 {
    nbio_handle_t             *nbio   = NULL;
@@ -430,7 +564,16 @@ bool task_push_image_load(const char *fullpath,
    image->frame_duration             = 0;
    image->size                       = 0;
    image->upscale_threshold          = upscale_threshold;
+   image->max_size                   = max_size;
    image->handle                     = NULL;
+   image->cache                      = NULL;
+
+   if (cache && cache_key)
+   {
+      gfx_thumbnail_cache_retain(cache);
+      image->cache                   = cache;
+      image->cache_key               = *cache_key;
+   }
 
    image->ti.width                   = 0;
    image->ti.height                  = 0;
@@ -464,8 +607,37 @@ bool task_push_image_load(const char *fullpath,
    t->cleanup         = task_image_load_free;
    t->callback        = cb;
    t->user_data       = user_data;
+   /* Reading and decoding only touch the task's own
+    * nbio and image handles. The one shared object is
+    * the thumbnail cache, which the handler writes the
+    * result to through gfx_thumbnail_cache_insert();
+    * that takes the cache's own lock, and the task holds
+    * a reference so the cache outlives it */
+   t->concurrent      = true;
 
    task_queue_push(t);
 
    return true;
 }
+
+bool task_push_image_load(const char *fullpath,
+      bool supports_rgba, unsigned upscale_threshold,
+      ks_task_callback_t cb, void *user_data)
+{
+   return task_push_image_load_internal(fullpath,
+         supports_rgba, upscale_threshold, 0, NULL, NULL, cb, user_data);
+}
+
+/* Same as task_push_image_load(), but decodes and scales
+ * the image down to fit 'max_size' x 'max_size'. If
+ * 'cache' is not NULL, the result is also stored there */
+bool task_push_thumbnail_load(const char *fullpath,
+      bool supports_rgba, unsigned upscale_threshold,
+      unsigned max_size, gfx_thumbnail_cache_t *cache,
+      const gfx_thumbnail_cache_key_t *cache_key,
+      ks_task_callback_t cb, void *user_data)
+{
+   return task_push_image_load_internal(fullpath,
+         supports_rgba, upscale_threshold, max_size,
+         cache, cache_key, cb, user_data);
+}
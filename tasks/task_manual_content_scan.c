@@ -508,6 +508,7 @@ bool task_push_manual_content_scan(
    task->state                   = manual_scan;
    task->title                   = strdup(task_title);
    task->alternative_look        = true;
+   task->priority                = TASK_PRIORITY_LOW;
    task->progress                = 0;
    task->callback                = cb_task_manual_content_scan;
    task->cleanup                 = task_manual_content_scan_free;
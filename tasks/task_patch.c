@@ -19,21 +19,44 @@
 
 /* TODO/FIXME - turn this into actual task */
 
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <boolean.h>
+#include <ks_inline.h>
 
 #include <compat/msvc.h>
 #include <file/file_path.h>
 #include <streams/file_stream.h>
+#include <streams/interface_stream.h>
 #include <string/stdstring.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
 #include <encodings/crc32.h>
 
 #include "../msg_hash.h"
 #include "../verbosity.h"
 
+/* Patches are read through a buffer of this size, so
+ * memory use does not depend on the size of the patch */
+#define PATCH_BUFFER_SIZE    (64 * 1024)
+
+/* Output is checksummed in chunks of this size, right
+ * after it was written and while it is still in cache */
+#define PATCH_CRC_CHUNK      (256 * 1024)
+
+/* Sources at least this big are checksummed on a thread
+ * of their own while the patch is applied */
+#define PATCH_CRC_THREAD_MIN (4 * 1024 * 1024)
+
 enum bps_mode
 {
    SOURCE_READ = 0,
@@ -58,662 +81,788 @@ enum patch_error
    PATCH_PATCH_CHECKSUM_INVALID
 };
 
-struct bps_data
+/* Buffered reader over the patch file. The checksum of
+ * the patch (all but its last four bytes) is updated
+ * whenever the buffer is refilled. */
+struct patch_reader
 {
-   const uint8_t *modify_data;
-   const uint8_t *source_data;
-   uint8_t *target_data;
-   size_t modify_length;
-   size_t source_length;
-   size_t target_length;
-   size_t modify_offset;
-   size_t source_offset;
-   size_t target_offset;
-   size_t source_relative_offset;
-   size_t target_relative_offset;
-   size_t output_offset;
-   uint32_t modify_checksum;
-   uint32_t source_checksum;
-   uint32_t target_checksum;
+   intfstream_t *stream;
+   uint64_t size;
+   uint64_t crc_end;
+   uint64_t buf_start;
+   size_t pos;
+   size_t len;
+   uint32_t crc;
+   bool overrun;
+   uint8_t buf[PATCH_BUFFER_SIZE];
 };
 
-struct ups_data
+/* Where the patched content goes, allocated once the
+ * patch header gives the target size */
+struct patch_target
 {
-   const uint8_t *patch_data;
-   const uint8_t *source_data;
-   uint8_t *target_data;
-   unsigned patch_length;
-   unsigned source_length;
-   unsigned target_length;
-   unsigned patch_offset;
-   unsigned source_offset;
-   unsigned target_offset;
-   unsigned patch_checksum;
-   unsigned source_checksum;
-   unsigned target_checksum;
+   uint8_t *data;
+   uint64_t size;
 };
 
-typedef enum patch_error (*patch_func_t)(const uint8_t*, uint64_t,
-      const uint8_t*, uint64_t, uint8_t**, uint64_t*);
+/* Checksum of data that is produced front to back,
+ * updated every PATCH_CRC_CHUNK bytes */
+struct patch_crc
+{
+   const uint8_t *data;
+   uint64_t done;
+   uint32_t crc;
+};
 
-static uint8_t bps_read(struct bps_data *bps)
+/* Checksum of a whole buffer, computed concurrently
+ * with the patch if threads are available */
+struct patch_crc_job
 {
-   uint8_t data         = bps->modify_data[bps->modify_offset++];
-   bps->modify_checksum = ~(encoding_crc32(
-         ~bps->modify_checksum, &data, 1));
-   return data;
-}
+   const uint8_t *data;
+   uint64_t size;
+   uint32_t crc;
+#ifdef HAVE_THREADS
+   sthread_t *thread;
+#endif
+};
+
+typedef enum patch_error (*patch_func_t)(struct patch_reader*,
+      const uint8_t*, uint64_t, struct patch_target*);
 
-static uint64_t bps_decode(struct bps_data *bps)
+static struct patch_reader *patch_reader_open(const char *path)
 {
-   uint64_t data = 0, shift = 1;
+   int64_t size;
+   struct patch_reader *patch = NULL;
+   intfstream_t *stream       = intfstream_open_file(path,
+         KS_VFS_FILE_ACCESS_READ, KS_VFS_FILE_ACCESS_HINT_NONE);
 
-   for (;;)
+   if (!stream)
+      return NULL;
+
+   size = intfstream_get_size(stream);
+
+   if (size < 0 || !(patch = (struct patch_reader*)
+            malloc(sizeof(*patch))))
    {
-      uint8_t x  = bps_read(bps);
-      data      += (x & 0x7f) * shift;
-      if (x & 0x80)
-         break;
-      shift    <<= 7;
-      data      += shift;
+      intfstream_close(stream);
+      free(stream);
+      return NULL;
    }
 
-   return data;
+   patch->stream    = stream;
+   patch->size      = (uint64_t)size;
+   patch->crc_end   = patch->size >= 4 ? patch->size - 4 : 0;
+   patch->buf_start = 0;
+   patch->pos       = 0;
+   patch->len       = 0;
+   patch->crc       = 0;
+   patch->overrun   = false;
+
+   return patch;
 }
 
-static void bps_write(struct bps_data *bps, uint8_t data)
+static void patch_reader_close(struct patch_reader *patch)
 {
-   bps->target_data[bps->output_offset++] = data;
-   bps->target_checksum = ~(encoding_crc32(~bps->target_checksum, &data, 1));
+   intfstream_close(patch->stream);
+   free(patch->stream);
+   free(patch);
 }
 
-static enum patch_error bps_apply_patch(
-      const uint8_t *modify_data, uint64_t modify_length,
-      const uint8_t *source_data, uint64_t source_length,
-      uint8_t **target_data, uint64_t *target_length)
+static bool patch_reader_fill(struct patch_reader *patch)
 {
-   size_t i;
-   struct bps_data bps;
-   uint32_t checksum               = 0;
-   size_t modify_source_size       = 0;
-   size_t modify_target_size       = 0;
-   size_t modify_markup_size       = 0;
-   uint32_t modify_source_checksum = 0;
-   uint32_t modify_target_checksum = 0;
-   uint32_t modify_modify_checksum = 0;
-
-   if (modify_length < 19)
-      return PATCH_PATCH_TOO_SMALL;
-
-   bps.modify_data            = modify_data;
-   bps.source_data            = source_data;
-   bps.target_data            = *target_data;
-   bps.modify_length          = modify_length;
-   bps.source_length          = source_length;
-   bps.target_length          = *target_length;
-   bps.modify_offset          = 0;
-   bps.source_offset          = 0;
-   bps.target_offset          = 0;
-   bps.modify_checksum        = ~0;
-   bps.source_checksum        = 0;
-   bps.target_checksum        = ~0;
-   bps.source_relative_offset = 0;
-   bps.target_relative_offset = 0;
-   bps.output_offset          = 0;
-
-   if (  (bps_read(&bps) != 'B') ||
-         (bps_read(&bps) != 'P') ||
-         (bps_read(&bps) != 'S') ||
-         (bps_read(&bps) != '1'))
-      return PATCH_PATCH_INVALID_HEADER;
-
-   modify_source_size  = bps_decode(&bps);
-   modify_target_size  = bps_decode(&bps);
-   modify_markup_size  = bps_decode(&bps);
+   int64_t len;
+   uint64_t left;
 
-   for (i = 0; i < modify_markup_size; i++)
-      bps_read(&bps);
+   patch->buf_start += patch->len;
+   patch->pos        = 0;
+   patch->len        = 0;
 
-   if (modify_source_size > bps.source_length)
-      return PATCH_SOURCE_TOO_SMALL;
-
-   if (modify_target_size > bps.target_length)
+   if (patch->buf_start >= patch->size)
    {
-      uint8_t *prov=(uint8_t*)malloc((size_t)modify_target_size);
+      patch->overrun = true;
+      return false;
+   }
 
-      if (!prov)
-         return PATCH_TARGET_ALLOC_FAILED;
+   left = patch->size - patch->buf_start;
+   len  = intfstream_read(patch->stream, patch->buf,
+         left < PATCH_BUFFER_SIZE ? left : PATCH_BUFFER_SIZE);
 
-      free(*target_data);
-      bps.target_data   = prov;
-      *target_data      = prov;
-      bps.target_length = modify_target_size;
+   if (len <= 0)
+   {
+      patch->overrun = true;
+      return false;
    }
 
-   while (bps.modify_offset < bps.modify_length - 12)
-   {
-      size_t length = bps_decode(&bps);
-      unsigned mode = length & 3;
+   patch->len = (size_t)len;
 
-      length = (length >> 2) + 1;
+   if (patch->buf_start < patch->crc_end)
+   {
+      uint64_t n = patch->crc_end - patch->buf_start;
+      patch->crc = encoding_crc32(patch->crc, patch->buf,
+            n < patch->len ? (size_t)n : patch->len);
+   }
 
-      switch (mode)
-      {
-         case SOURCE_READ:
-            while (length--)
-               bps_write(&bps, bps.source_data[bps.output_offset]);
-            break;
+   return true;
+}
 
-         case TARGET_READ:
-            while (length--)
-               bps_write(&bps, bps_read(&bps));
-            break;
+/* Reading past the end yields zeroes and sets 'overrun' */
+static INLINE uint8_t patch_reader_byte(struct patch_reader *patch)
+{
+   if (patch->pos == patch->len && !patch_reader_fill(patch))
+      return 0;
+   return patch->buf[patch->pos++];
+}
 
-         case SOURCE_COPY:
-         case TARGET_COPY:
-         {
-            int    offset = (int)bps_decode(&bps);
-            bool negative = offset & 1;
+/* Copies the next @len bytes of the patch to @s, or
+ * skips them if @s is NULL */
+static bool patch_reader_read(struct patch_reader *patch,
+      uint8_t *s, uint64_t len)
+{
+   while (len)
+   {
+      size_t n;
 
-            offset >>= 1;
+      if (patch->pos == patch->len && !patch_reader_fill(patch))
+         return false;
 
-            if (negative)
-               offset = -offset;
+      n = patch->len - patch->pos;
+      if (n > len)
+         n = (size_t)len;
 
-            if (mode == SOURCE_COPY)
-            {
-               bps.source_offset += offset;
-               while (length--)
-                  bps_write(&bps, bps.source_data[bps.source_offset++]);
-            }
-            else
-            {
-               bps.target_offset += offset;
-               while (length--)
-                  bps_write(&bps, bps.target_data[bps.target_offset++]);
-               break;
-            }
-            break;
-         }
+      if (s)
+      {
+         memcpy(s, patch->buf + patch->pos, n);
+         s += n;
       }
+
+      patch->pos += n;
+      len        -= n;
    }
 
-   for (i = 0; i < 32; i += 8)
-      modify_source_checksum |= bps_read(&bps) << i;
-   for (i = 0; i < 32; i += 8)
-      modify_target_checksum |= bps_read(&bps) << i;
+   return true;
+}
 
-   checksum = ~bps.modify_checksum;
-   for (i = 0; i < 32; i += 8)
-      modify_modify_checksum |= bps_read(&bps) << i;
+static INLINE uint64_t patch_reader_tell(const struct patch_reader *patch)
+{
+   return patch->buf_start + patch->pos;
+}
 
-   bps.source_checksum = encoding_crc32(0,
-         bps.source_data, bps.source_length);
-   bps.target_checksum = ~bps.target_checksum;
+/* Only used before anything past @offset was read,
+ * so the patch checksum stays valid */
+static bool patch_reader_seek(struct patch_reader *patch, uint64_t offset)
+{
+   if (intfstream_seek(patch->stream, (int64_t)offset, SEEK_SET) < 0)
+      return false;
 
-   if (bps.source_checksum != modify_source_checksum)
-      return PATCH_SOURCE_CHECKSUM_INVALID;
+   patch->buf_start = offset;
+   patch->pos       = 0;
+   patch->len       = 0;
+   patch->overrun   = false;
+   return true;
+}
 
-   if (bps.target_checksum != modify_target_checksum)
-      return PATCH_TARGET_CHECKSUM_INVALID;
+/* Variable length number, shared by BPS and UPS */
+static uint64_t patch_reader_decode(struct patch_reader *patch)
+{
+   uint64_t data  = 0;
+   uint64_t shift = 1;
 
-   if (checksum != modify_modify_checksum)
-      return PATCH_PATCH_CHECKSUM_INVALID;
+   for (;;)
+   {
+      uint8_t x = patch_reader_byte(patch);
+      data     += (x & 0x7f) * shift;
+      if ((x & 0x80) || patch->overrun)
+         break;
+      shift   <<= 7;
+      data     += shift;
+   }
 
-   *target_length = modify_target_size;
+   return data;
+}
 
-   return PATCH_SUCCESS;
+static uint32_t patch_reader_u32(struct patch_reader *patch)
+{
+   uint32_t ret  = patch_reader_byte(patch) <<  0;
+   ret          |= patch_reader_byte(patch) <<  8;
+   ret          |= patch_reader_byte(patch) << 16;
+   ret          |= (uint32_t)patch_reader_byte(patch) << 24;
+   return ret;
 }
 
-static uint8_t ups_patch_read(struct ups_data *data)
+static void patch_target_init(struct patch_target *target)
 {
-   if (data && data->patch_offset < data->patch_length)
-   {
-      uint8_t n = data->patch_data[data->patch_offset++];
-      data->patch_checksum =
-         ~(encoding_crc32(~data->patch_checksum, &n, 1));
-      return n;
-   }
-   return 0x00;
+   target->data   = NULL;
+   target->size   = 0;
+}
+
+static bool patch_target_alloc(struct patch_target *target, uint64_t size)
+{
+   if (size != (size_t)size)
+      return false;
+
+   target->size = size;
+   target->data = (uint8_t*)malloc(size ? (size_t)size : 1);
+   return target->data != NULL;
 }
 
-static uint8_t ups_source_read(struct ups_data *data)
+/**
+ * patch_target_finish:
+ *
+ * Hands the patched content over to the caller if
+ * @success, frees it otherwise.
+ *
+ * Returns: @success.
+ **/
+static bool patch_target_finish(struct patch_target *target, bool success)
 {
-   if (data && data->source_offset < data->source_length)
+   if (!success)
    {
-      uint8_t n = data->source_data[data->source_offset++];
-      data->source_checksum =
-         ~(encoding_crc32(~data->source_checksum, &n, 1));
-      return n;
+      free(target->data);
+      target->data = NULL;
    }
-   return 0x00;
+   return success;
 }
 
-static void ups_target_write(struct ups_data *data, uint8_t n)
+static INLINE void patch_crc_init(struct patch_crc *crc,
+      const uint8_t *data)
 {
+   crc->data = data;
+   crc->done = 0;
+   crc->crc  = 0;
+}
 
-   if (data && data->target_offset < data->target_length)
+/* Adds everything before @end to the checksum, once there
+ * is at least a chunk of it or if @flush is set */
+static INLINE void patch_crc_update(struct patch_crc *crc,
+      uint64_t end, bool flush)
+{
+   if (end > crc->done && (flush || end - crc->done >= PATCH_CRC_CHUNK))
    {
-      data->target_data[data->target_offset] = n;
-      data->target_checksum =
-         ~(encoding_crc32(~data->target_checksum, &n, 1));
+      crc->crc  = encoding_crc32(crc->crc, crc->data + crc->done,
+            (size_t)(end - crc->done));
+      crc->done = end;
    }
+}
 
-   if (data)
-      data->target_offset++;
+#ifdef HAVE_THREADS
+static void patch_crc_thread(void *data)
+{
+   struct patch_crc_job *job = (struct patch_crc_job*)data;
+   job->crc                  = encoding_crc32(0, job->data,
+         (size_t)job->size);
 }
+#endif
 
-static uint64_t ups_decode(struct ups_data *data)
+static void patch_crc_job_start(struct patch_crc_job *job,
+      const uint8_t *data, uint64_t size)
 {
-   uint64_t offset = 0, shift = 1;
+   job->data   = data;
+   job->size   = size;
+   job->crc    = 0;
+#ifdef HAVE_THREADS
+   job->thread = NULL;
+   if (size >= PATCH_CRC_THREAD_MIN)
+      job->thread = sthread_create(patch_crc_thread, job);
+#endif
+}
 
-   for (;;)
+static uint32_t patch_crc_job_finish(struct patch_crc_job *job)
+{
+#ifdef HAVE_THREADS
+   if (job->thread)
    {
-      uint8_t x = ups_patch_read(data);
-      offset   += (x & 0x7f) * shift;
-
-      if (x & 0x80)
-         break;
-      shift <<= 7;
-      offset += shift;
+      sthread_join(job->thread);
+      job->thread = NULL;
+      return job->crc;
    }
-   return offset;
+#endif
+   return encoding_crc32(0, job->data, (size_t)job->size);
 }
 
-static enum patch_error ups_apply_patch(
-      const uint8_t *patchdata, uint64_t patchlength,
-      const uint8_t *sourcedata, uint64_t sourcelength,
-      uint8_t **targetdata, uint64_t *targetlength)
+static enum patch_error bps_apply_patch(struct patch_reader *patch,
+      const uint8_t *source_data, uint64_t source_length,
+      struct patch_target *target)
 {
-   size_t i;
-   struct ups_data data;
-   unsigned source_read_length;
-   unsigned target_read_length;
-   uint32_t patch_result_checksum = 0;
-   uint32_t patch_read_checksum   = 0;
-   uint32_t source_read_checksum  = 0;
-   uint32_t target_read_checksum  = 0;
-
-   data.patch_data      = patchdata;
-   data.source_data     = sourcedata;
-   data.target_data     = *targetdata;
-   data.patch_length    = (unsigned)patchlength;
-   data.source_length   = (unsigned)sourcelength;
-   data.target_length   = (unsigned)*targetlength;
-   data.patch_offset    = 0;
-   data.source_offset   = 0;
-   data.target_offset   = 0;
-   data.patch_checksum  = ~0;
-   data.source_checksum = ~0;
-   data.target_checksum = ~0;
-
-   if (data.patch_length < 18)
-      return PATCH_PATCH_INVALID;
+   uint8_t header[4];
+   struct patch_crc target_crc;
+   struct patch_crc_job source_crc;
+   uint64_t source_size, target_size, markup_size;
+   uint32_t modify_source_checksum, modify_target_checksum;
+   uint32_t modify_modify_checksum, source_checksum;
+   uint64_t output_offset = 0;
+   uint64_t source_offset = 0;
+   uint64_t target_offset = 0;
+   uint8_t *out           = NULL;
+   enum patch_error err   = PATCH_SUCCESS;
+
+   if (patch->size < 19)
+      return PATCH_PATCH_TOO_SMALL;
+
+   if (     !patch_reader_read(patch, header, sizeof(header))
+         || memcmp(header, "BPS1", sizeof(header)))
+      return PATCH_PATCH_INVALID_HEADER;
+
+   source_size = patch_reader_decode(patch);
+   target_size = patch_reader_decode(patch);
+   markup_size = patch_reader_decode(patch);
 
-   if (
-         (ups_patch_read(&data) != 'U') ||
-         (ups_patch_read(&data) != 'P') ||
-         (ups_patch_read(&data) != 'S') ||
-         (ups_patch_read(&data) != '1')
-      )
+   if (patch->overrun || !patch_reader_read(patch, NULL, markup_size))
       return PATCH_PATCH_INVALID;
 
-   source_read_length = (unsigned)ups_decode(&data);
-   target_read_length = (unsigned)ups_decode(&data);
+   if (source_size > source_length)
+      return PATCH_SOURCE_TOO_SMALL;
 
-   if (     (data.source_length != source_read_length)
-         && (data.source_length != target_read_length))
-      return PATCH_SOURCE_INVALID;
+   if (!patch_target_alloc(target, target_size))
+      return PATCH_TARGET_ALLOC_FAILED;
 
-   *targetlength = (data.source_length == source_read_length ?
-         target_read_length : source_read_length);
+   out = target->data;
+   patch_crc_init(&target_crc, out);
+   patch_crc_job_start(&source_crc, source_data, source_length);
 
-   if (data.target_length < *targetlength)
+   while (patch_reader_tell(patch) < patch->size - 12)
    {
-      uint8_t *prov=(uint8_t*)malloc((size_t)*targetlength);
-      if (!prov)
-         return PATCH_TARGET_ALLOC_FAILED;
-      free(*targetdata);
-      *targetdata      = prov;
-      data.target_data = prov;
-   }
+      uint64_t length = patch_reader_decode(patch);
+      unsigned mode   = length & 3;
+      length          = (length >> 2) + 1;
 
-   data.target_length = (unsigned)*targetlength;
-   
-   while (data.patch_offset < data.patch_length - 12)
-   {
-      unsigned length = (unsigned)ups_decode(&data);
-      while (length--)
-         ups_target_write(&data, ups_source_read(&data));
+      if (patch->overrun || length > target_size - output_offset)
+      {
+         err = PATCH_PATCH_INVALID;
+         break;
+      }
 
-      for (;;)
+      switch (mode)
       {
-         uint8_t patch_xor = ups_patch_read(&data);
-         ups_target_write(&data, patch_xor ^ ups_source_read(&data));
-         if (patch_xor == 0)
+         case SOURCE_READ:
+            if (output_offset + length > source_length)
+               err = PATCH_PATCH_INVALID;
+            else
+               memcpy(out + output_offset, source_data + output_offset,
+                     (size_t)length);
+            break;
+         case TARGET_READ:
+            if (!patch_reader_read(patch, out + output_offset, length))
+               err = PATCH_PATCH_INVALID;
+            break;
+         case SOURCE_COPY:
+         case TARGET_COPY:
+            {
+               uint64_t offset = patch_reader_decode(patch);
+               uint64_t delta  = offset >> 1;
+
+               if (mode == SOURCE_COPY)
+               {
+                  source_offset = (offset & 1)
+                     ? source_offset - delta : source_offset + delta;
+
+                  if (     source_offset > source_length
+                        || length > source_length - source_offset)
+                     err = PATCH_PATCH_INVALID;
+                  else
+                     memcpy(out + output_offset, source_data + source_offset,
+                           (size_t)length);
+                  source_offset += length;
+               }
+               else
+               {
+                  uint64_t dst  = output_offset;
+                  uint64_t left = length;
+
+                  target_offset = (offset & 1)
+                     ? target_offset - delta : target_offset + delta;
+
+                  if (target_offset >= output_offset)
+                  {
+                     err = PATCH_PATCH_INVALID;
+                     break;
+                  }
+
+                  /* A run may overlap the bytes it produces, which
+                   * repeats the last (dst - target_offset) bytes.
+                   * Copy as many of them at a time as are there. */
+                  while (left)
+                  {
+                     uint64_t n = dst - target_offset;
+                     if (n > left)
+                        n = left;
+                     memcpy(out + dst, out + target_offset, (size_t)n);
+                     dst           += n;
+                     target_offset += n;
+                     left          -= n;
+                  }
+               }
+            }
             break;
       }
+
+      if (err != PATCH_SUCCESS || patch->overrun)
+      {
+         err = PATCH_PATCH_INVALID;
+         break;
+      }
+
+      output_offset += length;
+      patch_crc_update(&target_crc, output_offset, false);
    }
 
-   while (data.source_offset < data.source_length)
-      ups_target_write(&data, ups_source_read(&data));
-   while (data.target_offset < data.target_length)
-      ups_target_write(&data, ups_source_read(&data));
+   if (err == PATCH_SUCCESS)
+   {
+      modify_source_checksum = patch_reader_u32(patch);
+      modify_target_checksum = patch_reader_u32(patch);
+      modify_modify_checksum = patch_reader_u32(patch);
 
-   for (i = 0; i < 4; i++)
-      source_read_checksum |= ups_patch_read(&data) << (i * 8);
-   for (i = 0; i < 4; i++)
-      target_read_checksum |= ups_patch_read(&data) << (i * 8);
+      if (patch->overrun)
+         err = PATCH_PATCH_INVALID;
+   }
 
-   patch_result_checksum = ~data.patch_checksum;
-   data.source_checksum  = ~data.source_checksum;
-   data.target_checksum  = ~data.target_checksum;
+   patch_crc_update(&target_crc, output_offset, true);
+   source_checksum = patch_crc_job_finish(&source_crc);
 
-   for (i = 0; i < 4; i++)
-      patch_read_checksum |= ups_patch_read(&data) << (i * 8);
+   if (err != PATCH_SUCCESS)
+      return err;
 
-   if (patch_result_checksum != patch_read_checksum)
-      return PATCH_PATCH_INVALID;
+   if (source_checksum != modify_source_checksum)
+      return PATCH_SOURCE_CHECKSUM_INVALID;
+   if (target_crc.crc != modify_target_checksum)
+      return PATCH_TARGET_CHECKSUM_INVALID;
+   if (patch->crc != modify_modify_checksum)
+      return PATCH_PATCH_CHECKSUM_INVALID;
 
-   if (     data.source_checksum == source_read_checksum
-         && data.source_length   == source_read_length)
-   {
-      if (     data.target_checksum == target_read_checksum
-            && data.target_length   == target_read_length)
-         return PATCH_SUCCESS;
-      return PATCH_TARGET_INVALID;
-   }
-   else if (data.source_checksum == target_read_checksum
-         && data.source_length   == target_read_length)
+   return PATCH_SUCCESS;
+}
+
+/* Fills [pos, pos + length) of the target from the source,
+ * which reads as zeroes past its end. Bytes past the end of
+ * the target are dropped. */
+static void ups_copy(uint8_t *out, uint64_t target_length,
+      const uint8_t *source_data, uint64_t source_length,
+      uint64_t pos, uint64_t length)
+{
+   uint64_t end = pos + length;
+
+   if (end > target_length)
+      end = target_length;
+   if (pos >= end)
+      return;
+
+   if (pos < source_length)
    {
-      if (     data.target_checksum == source_read_checksum
-            && data.target_length   == source_read_length)
-         return PATCH_SUCCESS;
-      return PATCH_TARGET_INVALID;
+      uint64_t n = (end < source_length ? end : source_length) - pos;
+      memcpy(out + pos, source_data + pos, (size_t)n);
+      pos       += n;
    }
 
-   return PATCH_SOURCE_INVALID;
+   if (pos < end)
+      memset(out + pos, 0, (size_t)(end - pos));
 }
 
-static enum patch_error ips_alloc_targetdata(
-      const uint8_t *patchdata, uint64_t patchlen,
-      uint64_t sourcelength,
-      uint8_t **targetdata, uint64_t *targetlength)
+static enum patch_error ups_apply_patch(struct patch_reader *patch,
+      const uint8_t *source_data, uint64_t source_length,
+      struct patch_target *target)
 {
-   uint8_t *prov_alloc;
-   uint32_t offset = 5;
-   *targetlength   = sourcelength;
+   uint8_t header[4];
+   struct patch_crc source_crc, target_crc;
+   uint64_t source_read_length, target_read_length;
+   uint64_t target_length, end;
+   uint32_t patch_read_checksum, patch_result_checksum;
+   uint32_t source_read_checksum, target_read_checksum;
+   uint64_t pos = 0;
+   uint8_t *out = NULL;
+
+   if (patch->size < 18)
+      return PATCH_PATCH_INVALID;
 
-   for (;;)
-   {
-      uint32_t address;
-      unsigned length;
+   if (     !patch_reader_read(patch, header, sizeof(header))
+         || memcmp(header, "UPS1", sizeof(header)))
+      return PATCH_PATCH_INVALID;
 
-      if (offset > patchlen - 3)
-         break;
+   source_read_length = patch_reader_decode(patch);
+   target_read_length = patch_reader_decode(patch);
 
-      address  = patchdata[offset++] << 16;
-      address |= patchdata[offset++] << 8;
-      address |= patchdata[offset++] << 0;
+   if (     source_length != source_read_length
+         && source_length != target_read_length)
+      return PATCH_SOURCE_INVALID;
 
-      if (address == 0x454f46) /* EOF */
-      {
-         if (offset == patchlen)
-         {
-            prov_alloc     = (uint8_t*)malloc((size_t)*targetlength);
-            if (!prov_alloc)
-               return PATCH_TARGET_ALLOC_FAILED;
-            free(*targetdata);
-            *targetdata    = prov_alloc;
-            return PATCH_SUCCESS;
-         }
-         else if (offset == patchlen - 3)
-         {
-            uint32_t size  = patchdata[offset++] << 16;
-            size          |= patchdata[offset++] << 8;
-            size          |= patchdata[offset++] << 0;
-            *targetlength  = size;
-            prov_alloc     = (uint8_t*)malloc((size_t)*targetlength);
-
-            if (!prov_alloc)
-               return PATCH_TARGET_ALLOC_FAILED;
-            free(*targetdata);
-            *targetdata    = prov_alloc;
-            return PATCH_SUCCESS;
-         }
-      }
+   target_length = (source_length == source_read_length)
+      ? target_read_length : source_read_length;
+
+   if (!patch_target_alloc(target, target_length))
+      return PATCH_TARGET_ALLOC_FAILED;
+
+   out = target->data;
+   end = source_length > target_length ? source_length : target_length;
+   patch_crc_init(&source_crc, source_data);
+   patch_crc_init(&target_crc, out);
+
+   while (patch_reader_tell(patch) < patch->size - 12)
+   {
+      uint64_t length = patch_reader_decode(patch);
 
-      if (offset > patchlen - 2)
+      if (patch->overrun)
          break;
 
-      length  = patchdata[offset++] << 8;
-      length |= patchdata[offset++] << 0;
+      /* Nothing past both the source and the target matters */
+      if (length > end - pos)
+         length = end - pos;
 
-      if (length) /* Copy */
-      {
-         if (offset > patchlen - length)
-            break;
+      ups_copy(out, target_length, source_data, source_length, pos, length);
+      pos += length;
 
-         while (length--)
-         {
-            address++;
-            offset++;
-         }
-      }
-      else /* RLE */
+      for (;;)
       {
-         if (offset > patchlen - 3)
-            break;
+         uint8_t x = patch_reader_byte(patch);
 
-         length  = patchdata[offset++] << 8;
-         length |= patchdata[offset++] << 0;
+         if (pos < target_length)
+            out[pos] = x ^ (pos < source_length ? source_data[pos] : 0);
+         if (pos < end)
+            pos++;
 
-         if (length == 0) /* Illegal */
+         if (x == 0 || patch->overrun)
             break;
+      }
 
-         while (length--)
-            address++;
+      patch_crc_update(&source_crc,
+            pos < source_length ? pos : source_length, false);
+      patch_crc_update(&target_crc,
+            pos < target_length ? pos : target_length, false);
+   }
 
-         offset++;
-      }
+   ups_copy(out, target_length, source_data, source_length, pos, end - pos);
+   patch_crc_update(&source_crc, source_length, true);
+   patch_crc_update(&target_crc, target_length, true);
+
+   source_read_checksum  = patch_reader_u32(patch);
+   target_read_checksum  = patch_reader_u32(patch);
+   patch_result_checksum = patch->crc;
+   patch_read_checksum   = patch_reader_u32(patch);
+
+   if (patch->overrun || patch_result_checksum != patch_read_checksum)
+      return PATCH_PATCH_INVALID;
 
-      if (address > *targetlength)
-         *targetlength = address;
+   if (     source_crc.crc == source_read_checksum
+         && source_length  == source_read_length)
+   {
+      if (     target_crc.crc == target_read_checksum
+            && target_length  == target_read_length)
+         return PATCH_SUCCESS;
+      return PATCH_TARGET_INVALID;
+   }
+   else if (source_crc.crc == target_read_checksum
+         && source_length  == target_read_length)
+   {
+      if (     target_crc.crc == source_read_checksum
+            && target_length  == source_read_length)
+         return PATCH_SUCCESS;
+      return PATCH_TARGET_INVALID;
    }
 
-   return PATCH_PATCH_INVALID;
+   return PATCH_SOURCE_INVALID;
 }
 
-static enum patch_error ips_apply_patch(
-      const uint8_t *patchdata, uint64_t patchlen,
-      const uint8_t *sourcedata, uint64_t sourcelength,
-      uint8_t **targetdata, uint64_t *targetlength)
+/* IPS walks the patch twice: once to find the size of
+ * the target, then to apply the records. With @target
+ * NULL, only *@target_length is updated. */
+static enum patch_error ips_walk(struct patch_reader *patch,
+      struct patch_target *target, uint64_t *target_length)
 {
-   uint32_t offset = 5;
-   enum patch_error error_patch = PATCH_UNKNOWN;
-   if (  patchlen      < 8   ||
-         patchdata[0] != 'P' ||
-         patchdata[1] != 'A' ||
-         patchdata[2] != 'T' ||
-         patchdata[3] != 'C' ||
-         patchdata[4] != 'H')
+   if (!patch_reader_seek(patch, 5))
       return PATCH_PATCH_INVALID;
-   
-   if ((error_patch = ips_alloc_targetdata(
-               patchdata, patchlen, sourcelength,
-               targetdata, targetlength)) != PATCH_SUCCESS)
-      return error_patch;
-
-   memcpy(*targetdata, sourcedata, (size_t)sourcelength);
 
    for (;;)
    {
       uint32_t address;
       unsigned length;
+      uint64_t offset = patch_reader_tell(patch);
 
-      if (offset > patchlen - 3)
+      if (offset > patch->size - 3)
          break;
 
-      address  = patchdata[offset++] << 16;
-      address |= patchdata[offset++] << 8;
-      address |= patchdata[offset++] << 0;
+      address  = patch_reader_byte(patch) << 16;
+      address |= patch_reader_byte(patch) << 8;
+      address |= patch_reader_byte(patch) << 0;
+      offset  += 3;
 
       if (address == 0x454f46) /* EOF */
       {
-         if (offset == patchlen)
+         if (offset == patch->size)
             return PATCH_SUCCESS;
 
-         if (offset == patchlen - 3)
+         if (offset == patch->size - 3)
          {
-            uint32_t size  = patchdata[offset++] << 16;
-            size          |= patchdata[offset++] << 8;
-            size          |= patchdata[offset++] << 0;
+            uint32_t size  = patch_reader_byte(patch) << 16;
+            size          |= patch_reader_byte(patch) << 8;
+            size          |= patch_reader_byte(patch) << 0;
+            if (!target)
+               *target_length = size;
             return PATCH_SUCCESS;
          }
       }
 
-      if (offset > patchlen - 2)
+      if (offset > patch->size - 2)
          break;
 
-      length  = patchdata[offset++] << 8;
-      length |= patchdata[offset++] << 0;
+      length  = patch_reader_byte(patch) << 8;
+      length |= patch_reader_byte(patch) << 0;
+      offset += 2;
 
       if (length) /* Copy */
       {
-         if (offset > patchlen - length)
+         if (offset > patch->size - length)
             break;
 
-         while (length--)
-            (*targetdata)[address++] = patchdata[offset++];
+         if (target)
+         {
+            /* Records may reach past a truncated target */
+            uint64_t n = 0;
+            if (address < target->size)
+               n = target->size - address;
+            if (n > length)
+               n = length;
+            patch_reader_read(patch, target->data + address, n);
+            patch_reader_read(patch, NULL, length - n);
+         }
+         else
+            patch_reader_read(patch, NULL, length);
       }
       else /* RLE */
       {
-         if (offset > patchlen - 3)
+         uint8_t value;
+
+         if (offset > patch->size - 3)
             break;
 
-         length  = patchdata[offset++] << 8;
-         length |= patchdata[offset++] << 0;
+         length  = patch_reader_byte(patch) << 8;
+         length |= patch_reader_byte(patch) << 0;
 
          if (length == 0) /* Illegal */
             break;
 
-         while (length--)
-            (*targetdata)[address++] = patchdata[offset];
+         value = patch_reader_byte(patch);
 
-         offset++;
+         if (target && address < target->size)
+         {
+            uint64_t n = target->size - address;
+            if (n > length)
+               n = length;
+            memset(target->data + address, value, (size_t)n);
+         }
       }
+
+      address += length;
+
+      if (!target && address > *target_length)
+         *target_length = address;
    }
 
    return PATCH_PATCH_INVALID;
 }
 
-static bool apply_patch_content(uint8_t **buf,
-      ssize_t *size, const char *patch_desc, const char *patch_path,
-      patch_func_t func, void *patch_data, int64_t patch_size)
+static enum patch_error ips_apply_patch(struct patch_reader *patch,
+      const uint8_t *source_data, uint64_t source_length,
+      struct patch_target *target)
 {
-   enum patch_error err     = PATCH_UNKNOWN;
-   ssize_t ret_size         = *size;
-   uint8_t *ret_buf         = *buf;
-   uint64_t target_size     = 0;
-   uint8_t *patched_content = NULL;
+   uint8_t header[5];
+   uint64_t target_length       = source_length;
+   uint64_t n                   = 0;
+   enum patch_error error_patch = PATCH_UNKNOWN;
 
-   KINGSN_LOG("Found %s file in \"%s\", attempting to patch ...\n",
-         patch_desc, patch_path);
+   if (     patch->size < 8
+         || !patch_reader_read(patch, header, sizeof(header))
+         || memcmp(header, "PATCH", sizeof(header)))
+      return PATCH_PATCH_INVALID;
 
-   if ((err = func((const uint8_t*)patch_data, patch_size, ret_buf,
-         ret_size, &patched_content, &target_size)) == PATCH_SUCCESS)
-   {
-      free(ret_buf);
-      *buf  = patched_content;
-      *size = target_size;
-   }
-   else
-      KINGSN_ERR("%s %s: %s #%u\n",
-            msg_hash_to_str(MSG_FAILED_TO_PATCH),
-            patch_desc,
-            msg_hash_to_str(MSG_ERROR),
-            (unsigned)err);
+   if ((error_patch = ips_walk(patch, NULL, &target_length))
+         != PATCH_SUCCESS)
+      return error_patch;
 
-   return true;
+   if (!patch_target_alloc(target, target_length))
+      return PATCH_TARGET_ALLOC_FAILED;
+
+   /* The trailing size can truncate the content */
+   n = source_length < target_length ? source_length : target_length;
+   memcpy(target->data, source_data, (size_t)n);
+   if (n < target_length)
+      memset(target->data + n, 0, (size_t)(target_length - n));
+
+   return ips_walk(patch, target, &target_length);
 }
 
-static bool try_bps_patch(bool allow_bps, const char *name_bps,
-      uint8_t **buf, ssize_t *size)
+static const char *patch_find(
+      bool is_ips_pref,
+      bool is_bps_pref,
+      bool is_ups_pref,
+      const char *name_ips,
+      const char *name_bps,
+      const char *name_ups,
+      const char **patch_desc,
+      patch_func_t *func)
 {
-   if (     allow_bps 
-         && !string_is_empty(name_bps)
-         && path_is_valid(name_bps)
-      )
+   bool allow_ups   = !is_bps_pref && !is_ips_pref;
+   bool allow_ips   = !is_ups_pref && !is_bps_pref;
+   bool allow_bps   = !is_ups_pref && !is_ips_pref;
+
+   if (    (unsigned)is_ips_pref
+         + (unsigned)is_bps_pref
+         + (unsigned)is_ups_pref > 1)
    {
-      int64_t patch_size;
-      bool ret                 = false;
-      void *patch_data         = NULL;
+      KINGSN_WARN("%s\n",
+            msg_hash_to_str(MSG_SEVERAL_PATCHES_ARE_EXPLICITLY_DEFINED));
+      return NULL;
+   }
 
-      if (!filestream_read_file(name_bps, &patch_data, &patch_size))
-         return false;
+   if (allow_ips && !string_is_empty(name_ips) && path_is_valid(name_ips))
+   {
+      *patch_desc = "IPS";
+      *func       = ips_apply_patch;
+      return name_ips;
+   }
 
-      if (patch_size >= 0)
-         ret = apply_patch_content(buf, size, "BPS", name_bps,
-               bps_apply_patch, patch_data, patch_size);
+   if (allow_bps && !string_is_empty(name_bps) && path_is_valid(name_bps))
+   {
+      *patch_desc = "BPS";
+      *func       = bps_apply_patch;
+      return name_bps;
+   }
 
-      if (patch_data)
-         free(patch_data);
-      return ret;
+   if (allow_ups && !string_is_empty(name_ups) && path_is_valid(name_ups))
+   {
+      *patch_desc = "UPS";
+      *func       = ups_apply_patch;
+      return name_ups;
    }
 
-   return false;
+   KINGSN_LOG("%s\n",
+         msg_hash_to_str(MSG_DID_NOT_FIND_A_VALID_CONTENT_PATCH));
+   return NULL;
 }
 
-static bool try_ups_patch(bool allow_ups, const char *name_ups,
-      uint8_t **buf, ssize_t *size)
+static enum patch_error apply_patch_content(
+      const char *patch_desc, const char *patch_path, patch_func_t func,
+      const uint8_t *source_data, uint64_t source_length,
+      struct patch_target *target)
 {
-   if (     allow_ups
-         && !string_is_empty(name_ups)
-         && path_is_valid(name_ups)
-      )
-   {
-      int64_t patch_size;
-      bool ret                 = false;
-      void *patch_data         = NULL;
+   enum patch_error err       = PATCH_UNKNOWN;
+   struct patch_reader *patch = patch_reader_open(patch_path);
 
-      if (!filestream_read_file(name_ups, &patch_data, &patch_size))
-         return false;
-
-      if (patch_size >= 0)
-         ret = apply_patch_content(buf, size, "UPS", name_ups,
-               ups_apply_patch, patch_data, patch_size);
-
-      if (patch_data)
-         free(patch_data);
-      return ret;
-   }
-   return false;
-}
+   KINGSN_LOG("Found %s file in \"%s\", attempting to patch ...\n",
+         patch_desc, patch_path);
 
-static bool try_ips_patch(bool allow_ips,
-      const char *name_ips, uint8_t **buf, ssize_t *size)
-{
-   if (     allow_ips 
-         && !string_is_empty(name_ips)
-         && path_is_valid(name_ips)
-      )
+   if (patch)
    {
-      int64_t patch_size;
-      bool ret                 = false;
-      void *patch_data         = NULL;
+      err = func(patch, source_data, source_length, target);
+      patch_reader_close(patch);
+   }
 
-      if (!filestream_read_file(name_ips, &patch_data, &patch_size))
-         return false;
+   patch_target_finish(target, err == PATCH_SUCCESS);
 
-      if (patch_size >= 0)
-         ret = apply_patch_content(buf, size, "IPS", name_ips,
-               ips_apply_patch, patch_data, patch_size);
+   if (err != PATCH_SUCCESS)
+      KINGSN_ERR("%s %s: %s #%u\n",
+            msg_hash_to_str(MSG_FAILED_TO_PATCH),
+            patch_desc,
+            msg_hash_to_str(MSG_ERROR),
+            (unsigned)err);
 
-      if (patch_data)
-         free(patch_data);
-      return ret;
-   }
-   return false;
+   return err;
 }
 
 /**
@@ -721,7 +870,9 @@ static bool try_ips_patch(bool allow_ips,
  * @buf          : buffer of the content file.
  * @size         : size   of the content file.
  *
- * Apply patch to the content file in-memory.
+ * Apply patch to the content file in-memory. The patch
+ * is streamed from disk; @buf is only replaced once the
+ * patch applied cleanly.
  *
  **/
 bool patch_content(
@@ -734,27 +885,24 @@ bool patch_content(
       uint8_t **buf,
       void *data)
 {
-   ssize_t *size    = (ssize_t*)data;
-   bool allow_ups   = !is_bps_pref && !is_ips_pref;
-   bool allow_ips   = !is_ups_pref && !is_bps_pref;
-   bool allow_bps   = !is_ups_pref && !is_ips_pref;
-
-   if (    (unsigned)is_ips_pref
-         + (unsigned)is_bps_pref
-         + (unsigned)is_ups_pref > 1)
-   {
-      KINGSN_WARN("%s\n",
-            msg_hash_to_str(MSG_SEVERAL_PATCHES_ARE_EXPLICITLY_DEFINED));
+   struct patch_target target;
+   ssize_t *size          = (ssize_t*)data;
+   const char *patch_desc = NULL;
+   patch_func_t func      = NULL;
+   const char *patch_path = patch_find(is_ips_pref, is_bps_pref,
+         is_ups_pref, name_ips, name_bps, name_ups, &patch_desc, &func);
+
+   if (!patch_path)
       return false;
-   }
 
-   if (     !try_ips_patch(allow_ips, name_ips, buf, size)
-         && !try_bps_patch(allow_bps, name_bps, buf, size)
-         && !try_ups_patch(allow_ups, name_ups, buf, size))
+   patch_target_init(&target);
+
+   if (apply_patch_content(patch_desc, patch_path, func,
+            *buf, (uint64_t)*size, &target) == PATCH_SUCCESS)
    {
-      KINGSN_LOG("%s\n",
-            msg_hash_to_str(MSG_DID_NOT_FIND_A_VALID_CONTENT_PATCH));
-      return false;
+      free(*buf);
+      *buf  = target.data;
+      *size = (ssize_t)target.size;
    }
 
    return true;
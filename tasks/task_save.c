@@ -740,6 +740,7 @@ static bool task_push_undo_save_state(const char *path, void *data, size_t size)
    state->compress_files         = compress_files;
 
    task->type                    = TASK_TYPE_BLOCKING;
+   task->priority                = TASK_PRIORITY_HIGH;
    task->state                   = state;
    task->handler                 = task_save_handler;
    task->callback                = undo_save_state_cb;
@@ -1130,6 +1131,7 @@ static void task_push_save_state(const char *path, void *data, size_t size, bool
    state->compress_files         = compress_files;
 
    task->type              = TASK_TYPE_BLOCKING;
+   task->priority          = TASK_PRIORITY_HIGH;
    task->state             = state;
    task->handler           = task_save_handler;
    task->callback          = save_state_cb;
@@ -1237,6 +1239,7 @@ static void task_push_load_and_save_state(const char *path, void *data,
 
    task->state       = state;
    task->type        = TASK_TYPE_BLOCKING;
+   task->priority    = TASK_PRIORITY_HIGH;
    task->handler     = task_load_handler;
    task->callback    = content_load_and_save_state_cb;
    task->title       = strdup(msg_hash_to_str(MSG_LOADING_STATE));
@@ -1409,6 +1412,7 @@ bool content_load_state(const char *path,
    state->compress_files        = compress_files;
 
    task->type                   = TASK_TYPE_BLOCKING;
+   task->priority               = TASK_PRIORITY_HIGH;
    task->state                  = state;
    task->handler                = task_load_handler;
    task->callback               = content_load_state_cb;
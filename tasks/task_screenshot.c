@@ -54,6 +54,7 @@
 #include "../paths.h"
 #include "../msg_hash.h"
 #include "../verbosity.h"
+#include "../performance_trace.h"
 
 #include "tasks_internal.h"
 
@@ -62,6 +63,7 @@ typedef struct screenshot_task_state screenshot_task_state_t;
 struct screenshot_task_state
 {
    struct scaler_ctx scaler;
+   video_viewport_readback_t readback;
    uint8_t *out_buffer;
    const void *frame;
    void *userbuf;
@@ -80,6 +82,7 @@ struct screenshot_task_state
    bool is_paused;
    bool history_list_enable;
    bool widgets_ready;
+   bool has_readback;
 };
 
 static bool screenshot_dump_direct(screenshot_task_state_t *state)
@@ -88,7 +91,10 @@ static bool screenshot_dump_direct(screenshot_task_state_t *state)
    bool ret                       = false;
 
 #if defined(HAVE_RPNG)
-   if (state->bgr24)
+   if (state->has_readback)
+      scaler->in_fmt              = state->readback.rgba
+         ? SCALER_FMT_ABGR8888 : SCALER_FMT_ARGB8888;
+   else if (state->bgr24)
       scaler->in_fmt              = SCALER_FMT_BGR24;
    else if (state->pixel_format_type == KS_PIXEL_FORMAT_XRGB8888)
       scaler->in_fmt              = SCALER_FMT_ARGB8888;
@@ -105,12 +111,15 @@ static bool screenshot_dump_direct(screenshot_task_state_t *state)
 
    scaler_ctx_gen_reset(&state->scaler);
 
-   ret = rpng_save_image_bgr24(
+   /* Savestate thumbnails are rewritten on every save,
+    * so favour speed over size for those */
+   ret = rpng_save_image_bgr24_ex(
          state->filename,
          state->out_buffer,
          state->width,
          state->height,
-         state->width * 3
+         state->width * 3,
+         state->silence ? RPNG_ENCODE_FAST : 0
          );
 
    free(state->out_buffer);
@@ -205,12 +214,12 @@ task_finished:
    if (state && state->userbuf)
       free(state->userbuf);
 
-#if defined(HAVE_GFX_WIDGETS)
    /* If display widgets are enabled, state is freed
       in the callback after the notification
-      is displayed */
-   if (state && !state->widgets_ready)
-#endif
+      is displayed. The same goes for a viewport
+      readback, which has to be handed back to the
+      video driver on the main thread. */
+   if (state && !state->widgets_ready && !state->has_readback)
    {
       free(state);
       /* Must explicitly set task->state to NULL here,
@@ -220,7 +229,6 @@ task_finished:
    }
 }
 
-#if defined(HAVE_GFX_WIDGETS)
 static void task_screenshot_callback(ks_task_t *task,
       void *task_data,
       void *user_data, const char *error)
@@ -235,9 +243,14 @@ static void task_screenshot_callback(ks_task_t *task,
    if (!state)
       return;
 
+   if (state->has_readback)
+      video_driver_read_viewport_async_release(&state->readback);
+
+#if defined(HAVE_GFX_WIDGETS)
    if (!state->silence && state->widgets_ready)
       gfx_widget_screenshot_taken(dispwidget_get_ptr(),
             state->shotname, state->filename);
+#endif
 
    free(state);
    /* Must explicitly set task->state to NULL here,
@@ -245,31 +258,26 @@ static void task_screenshot_callback(ks_task_t *task,
    state       = NULL;
    task->state = NULL;
 }
-#endif
 
-/* Take frame bottom-up. */
-static bool screenshot_dump(
+/* Works out where the screenshot goes. The frame itself
+ * is filled in by the caller. */
+static screenshot_task_state_t *screenshot_state_new(
       const char *screenshot_dir,
       const char *name_base,
-      const void *frame,
-      unsigned width,
-      unsigned height,
-      int pitch,
-      bool bgr24,
-      void *userbuf,
       bool savestate,
       bool is_idle,
       bool is_paused,
       bool fullpath,
-      bool use_thread,
       unsigned pixel_format_type)
 {
    struct ks_system_info system_info;
-   uint8_t *buf                   = NULL;
    settings_t *settings           = config_get_ptr();
    screenshot_task_state_t *state = (screenshot_task_state_t*)
          calloc(1, sizeof(*state));
 
+   if (!state)
+      return NULL;
+
    state->shotname[0]             = '\0';
 
    /* If fullpath is true, name_base already contains a 
@@ -279,12 +287,6 @@ static bool screenshot_dump(
 
    state->is_idle                = is_idle;
    state->is_paused              = is_paused;
-   state->bgr24                  = bgr24;
-   state->height                 = height;
-   state->width                  = width;
-   state->pitch                  = pitch;
-   state->frame                  = frame;
-   state->userbuf                = userbuf;
 #if defined(HAVE_GFX_WIDGETS)
    state->widgets_ready          = gfx_widgets_ready();
 #else
@@ -343,7 +345,7 @@ static bool screenshot_dump(
                if (!core_get_system_info(&system_info))
                {
                   free(state);
-                  return false;
+                  return NULL;
                }
 
                if (string_is_empty(system_info.library_name))
@@ -379,14 +381,30 @@ static bool screenshot_dump(
          /* Create screenshot directory, if required */
          if (!path_is_directory(new_screenshot_dir))
             if (!path_mkdir(new_screenshot_dir))
-               return false;
+            {
+               free(state);
+               return NULL;
+            }
       }
    }
 
+   return state;
+}
+
+/* Encodes and saves the frame of @state, on a worker
+ * if @use_thread is set. Takes ownership of @state. */
+static bool screenshot_queue(screenshot_task_state_t *state,
+      bool savestate, bool use_thread)
+{
+   settings_t *settings           = config_get_ptr();
 #if defined(HAVE_RPNG)
-   buf = (uint8_t*)malloc(width * height * 3);
+   uint8_t *buf                   = (uint8_t*)
+      malloc(state->width * state->height * 3);
+
    if (!buf)
    {
+      if (state->has_readback)
+         video_driver_read_viewport_async_release(&state->readback);
       free(state);
       return false;
    }
@@ -398,14 +416,19 @@ static bool screenshot_dump(
       ks_task_t *task = task_init();
 
       task->type        = TASK_TYPE_BLOCKING;
+      task->priority    = TASK_PRIORITY_HIGH;
       task->state       = state;
       task->handler     = task_screenshot_handler;
       task->mute        = savestate;
-#if defined(HAVE_GFX_WIDGETS)
+      /* Encoding only touches our own state; pushing
+       * to the image history playlist does not */
+      task->concurrent  = state->silence || !state->history_list_enable;
       /* This callback is only required when
-       * widgets are enabled */
-      task->callback    = state->widgets_ready ?
-            task_screenshot_callback : NULL;
+       * widgets are enabled or the frame is a
+       * viewport readback */
+      task->callback    = (state->widgets_ready || state->has_readback)
+         ? task_screenshot_callback : NULL;
+#if defined(HAVE_GFX_WIDGETS)
       if (state->widgets_ready && !savestate)
          task_free_title(task);
       else
@@ -427,6 +450,9 @@ static bool screenshot_dump(
       if (state->out_buffer)
          free(state->out_buffer);
 
+      if (state->has_readback)
+         video_driver_read_viewport_async_release(&state->readback);
+
       free(state);
 
       return false;
@@ -435,6 +461,111 @@ static bool screenshot_dump(
    return screenshot_dump_direct(state);
 }
 
+/* Take frame bottom-up. */
+static bool screenshot_dump(
+      const char *screenshot_dir,
+      const char *name_base,
+      const void *frame,
+      unsigned width,
+      unsigned height,
+      int pitch,
+      bool bgr24,
+      void *userbuf,
+      bool savestate,
+      bool is_idle,
+      bool is_paused,
+      bool fullpath,
+      bool use_thread,
+      unsigned pixel_format_type)
+{
+   screenshot_task_state_t *state = screenshot_state_new(
+         screenshot_dir, name_base, savestate, is_idle, is_paused,
+         fullpath, pixel_format_type);
+
+   if (!state)
+      return false;
+
+   state->bgr24                  = bgr24;
+   state->height                 = height;
+   state->width                  = width;
+   state->pitch                  = pitch;
+   state->frame                  = frame;
+   state->userbuf                = userbuf;
+
+   return screenshot_queue(state, savestate, use_thread);
+}
+
+#if defined(HAVE_RPNG)
+/* Called on the main thread once the GPU has finished
+ * copying the viewport out. Only the encode is left, which
+ * goes to a worker. */
+static void screenshot_readback_cb(void *userdata,
+      const video_viewport_readback_t *readback)
+{
+   bool queued;
+   screenshot_task_state_t *state = (screenshot_task_state_t*)userdata;
+
+   if (!readback)
+   {
+      KINGSN_WARN("[Screenshot]: Viewport readback dropped.\n");
+      free(state);
+      return;
+   }
+
+   state->readback        = *readback;
+   state->has_readback    = true;
+   /* The readback is bottom-up, just like the frames
+    * screenshot_dump() takes */
+   state->frame           = readback->data;
+   state->pitch           = readback->pitch;
+   state->width           = readback->width;
+   state->height          = readback->height;
+
+   performance_trace_begin("screenshot_readback_handover");
+   queued = screenshot_queue(state, state->silence, true);
+   performance_trace_end("screenshot_readback_handover");
+
+   if (!queued)
+   {
+      char *msg = strdup(msg_hash_to_str(MSG_FAILED_TO_TAKE_SCREENSHOT));
+      runloop_msg_queue_push(msg, 1, 180, true, NULL,
+            MESSAGE_QUEUE_ICON_DEFAULT, MESSAGE_QUEUE_CATEGORY_INFO);
+      free(msg);
+   }
+}
+
+/* Asks the video driver to copy the next frame out of the
+ * viewport without stalling the pipeline. Costs one copy
+ * command on the GPU timeline; the pixels arrive a frame or
+ * two later through screenshot_readback_cb(). */
+static bool take_screenshot_viewport_async(
+      const char *screenshot_dir,
+      const char *name_base,
+      bool savestate,
+      bool is_idle,
+      bool is_paused,
+      bool fullpath,
+      unsigned pixel_format_type)
+{
+   bool queued;
+   screenshot_task_state_t *state = NULL;
+
+   if (!(state = screenshot_state_new(screenshot_dir, name_base,
+               savestate, is_idle, is_paused, fullpath,
+               pixel_format_type)))
+      return false;
+
+   performance_trace_begin("screenshot_readback_queue");
+   queued = video_driver_read_viewport_async(screenshot_readback_cb, state);
+   performance_trace_end("screenshot_readback_queue");
+
+   if (!queued)
+      free(state);
+
+   return queued;
+}
+#endif
+
 static bool take_screenshot_viewport(
       const char *screenshot_dir,
       const char *name_base,
@@ -540,6 +671,25 @@ static bool take_screenshot_choice(
 
    if (supports_viewport_read)
    {
+#if defined(HAVE_RPNG)
+      /* While content is running the next frame is as good
+       * as a re-rendered one, so read it back without
+       * stalling. The menu and paused content still go
+       * through the synchronous path below, as only a
+       * re-rendered frame keeps GUI overlays out. */
+      if (     use_thread
+            && !is_idle
+            && !is_paused
+#ifdef HAVE_MENU
+            && !menu_driver_is_alive()
+#endif
+            && video_driver_supports_viewport_read_async()
+            && take_screenshot_viewport_async(screenshot_dir,
+               name_base, savestate, is_idle, is_paused, fullpath,
+               pixel_format_type))
+         return true;
+#endif
+
       /* Avoid taking screenshot of GUI overlays. */
       video_driver_set_texture_enable(false, false);
       if (!is_idle)
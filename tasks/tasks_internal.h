@@ -37,6 +37,9 @@
 /* Required for task_push_core_backup() */
 #include "../core_backup.h"
 
+/* Required for task_push_thumbnail_load() */
+#include "../gfx/gfx_thumbnail_cache.h"
+
 #if defined(HAVE_OVERLAY)
 #include "../input/input_overlay.h"
 #endif
@@ -158,6 +161,12 @@ bool task_push_image_load(const char *fullpath,
       bool supports_rgba, unsigned upscale_threshold,
       ks_task_callback_t cb, void *userdata);
 
+bool task_push_thumbnail_load(const char *fullpath,
+      bool supports_rgba, unsigned upscale_threshold,
+      unsigned max_size, gfx_thumbnail_cache_t *cache,
+      const gfx_thumbnail_cache_key_t *cache_key,
+      ks_task_callback_t cb, void *userdata);
+
 #ifdef HAVE_LIBKSDB
 bool task_push_dbscan(
       const char *playlist_directory,